@@ -333,6 +333,30 @@ modify_cq(
 
 
 
+ib_api_status_t
+ib_modify_cq_moderation(
+	IN		const	ib_cq_handle_t				h_cq,
+	IN				uint16_t					moder_cnt,
+	IN				uint16_t					moder_time )
+{
+	ib_api_status_t			status;
+
+	AL_ENTER( AL_DBG_CQ );
+
+	if( AL_OBJ_INVALID_HANDLE( h_cq, AL_OBJ_TYPE_H_CQ ) )
+	{
+		AL_PRINT_EXIT( TRACE_LEVEL_ERROR, AL_DBG_ERROR, ("IB_INVALID_CQ_HANDLE\n") );
+		return IB_INVALID_CQ_HANDLE;
+	}
+
+	status = verbs_modify_cq_moder( h_cq, moder_cnt, moder_time );
+
+	AL_EXIT( AL_DBG_CQ );
+	return status;
+}
+
+
+
 ib_api_status_t
 ib_query_cq(
 	IN		const	ib_cq_handle_t				h_cq,
@@ -181,8 +181,33 @@ __cleanup_mad_send(
 
 static __inline int
 __set_retry_time(
+	IN				ib_mad_svc_handle_t			h_mad_svc,
+	IN				ib_mad_send_handle_t		h_send );
+
+static void
+__insert_send(
+	IN				ib_mad_svc_handle_t			h_mad_svc,
+	IN				ib_mad_send_handle_t		h_send );
+
+static void
+__remove_send(
+	IN				ib_mad_svc_handle_t			h_mad_svc,
+	IN				ib_mad_send_handle_t		h_send );
+
+static void
+__wheel_insert(
+	IN				ib_mad_svc_handle_t			h_mad_svc,
 	IN				ib_mad_send_handle_t		h_send,
-    IN              ULONG                       send_jitter );
+	IN				uint64_t					due_time );
+
+static void
+__wheel_remove(
+	IN				ib_mad_send_handle_t		h_send );
+
+static void
+__trim_send_timer(
+	IN				ib_mad_svc_handle_t			h_mad_svc,
+	IN				uint64_t					cur_time );
 
 static void
 __mad_svc_send_done(
@@ -1073,6 +1098,7 @@ reg_mad_svc(
 	ib_mad_svc_handle_t	h_mad_svc;
 	al_qp_alias_t		*p_qp_alias;
 	ib_qp_attr_t		qp_attr;
+	uint32_t			i;
     static ULONG        seed = 0;
 
 	AL_ENTER( AL_DBG_MAD_SVC );
@@ -1110,6 +1136,11 @@ reg_mad_svc(
 	cl_timer_construct( &h_mad_svc->recv_timer );
 	cl_qlist_init( &h_mad_svc->send_list );
 	cl_qlist_init( &h_mad_svc->recv_list );
+	for( i = 0; i < AL_MAD_TID_TBL_SIZE; i++ )
+		cl_qlist_init( &h_mad_svc->tid_tbl[i] );
+	for( i = 0; i < AL_MAD_WHEEL_SIZE; i++ )
+		cl_qlist_init( &h_mad_svc->timer_wheel[i] );
+	h_mad_svc->wheel_tick = cl_get_time_stamp() / AL_MAD_WHEEL_TICK_US;
 
     if( seed == 0 )
     {
@@ -1234,6 +1265,10 @@ __destroying_mad_svc(
 		AL_PRINT( TRACE_LEVEL_INFORMATION, AL_DBG_MAD_SVC, ("canceling MAD\n") );
 		h_send = PARENT_STRUCT( p_list_item, al_mad_send_t, pool_item );
 		h_send->canceled = TRUE;
+
+		/* Inactive sends must be on a slot the timer callback will visit. */
+		if( h_send->retry_time != MAX_TIME )
+			__wheel_insert( h_mad_svc, h_send, 0 );
 	}
 	cl_spinlock_release( &h_mad_svc->obj.lock );
 
@@ -1402,8 +1437,7 @@ ib_send_mad(
 
 		/* Add the MADs to our list. */
 		cl_spinlock_acquire( &h_mad_svc->obj.lock );
-		cl_qlist_insert_tail( &h_mad_svc->send_list,
-			(cl_list_item_t*)&h_send->pool_item );
+		__insert_send( h_mad_svc, h_send );
 
 		/* Post the MAD to the dispatcher, and check for failures. */
 		ref_al_obj( &h_mad_svc->obj );
@@ -1632,6 +1666,7 @@ __queue_rmpp_seg(
 
 	/* Reset information to track the send. */
 	h_send->retry_time = MAX_TIME;
+	__wheel_remove( h_send );
 
 	/* Set the RMPP header information. */
 	p_rmpp_hdr = (ib_rmpp_mad_t*)h_send->p_send_mad->p_mad_buf;
@@ -1776,19 +1811,51 @@ __queue_mad_wr(
 
 
 
-static cl_status_t
+static __inline cl_qlist_t*
+__tid_bucket(
+	IN		const	ib_mad_svc_handle_t			h_mad_svc,
+	IN		const	ib_mad_element_t* const		p_mad_element )
+{
+	uint32_t				tid;
+
+	/*
+	 * Only the user portion of the TID is stable; AL rewrites the upper
+	 * half while the send is posted.
+	 */
+	tid = cl_ntoh32( al_get_user_tid(
+		((ib_mad_t*)ib_get_mad_buf( p_mad_element ))->trans_id ) );
+	tid ^= (tid >> 16);
+	tid ^= (tid >> 8);
+
+	return &h_mad_svc->tid_tbl[tid & (AL_MAD_TID_TBL_SIZE - 1)];
+}
+
+
+
+/*
+ * Find the send tracking the given MAD element.  This call must be
+ * synchronized with access to the MAD service send_list.
+ */
+static ib_mad_send_handle_t
 __mad_svc_find_send(
-	IN		const	cl_list_item_t* const		p_list_item,
-	IN				void*						context )
+	IN		const	ib_mad_svc_handle_t			h_mad_svc,
+	IN		const	ib_mad_element_t* const		p_mad_element )
 {
+	cl_qlist_t				*p_bucket;
+	cl_list_item_t			*p_list_item;
 	ib_mad_send_handle_t	h_send;
 
-	h_send = PARENT_STRUCT( p_list_item, al_mad_send_t, pool_item );
+	p_bucket = __tid_bucket( h_mad_svc, p_mad_element );
+	for( p_list_item = cl_qlist_head( p_bucket );
+		 p_list_item != cl_qlist_end( p_bucket );
+		 p_list_item = cl_qlist_next( p_list_item ) )
+	{
+		h_send = PARENT_STRUCT( p_list_item, al_mad_send_t, tid_item );
+		if( h_send->p_send_mad == p_mad_element )
+			return h_send;
+	}
 
-	if( h_send->p_send_mad == context )
-		return CL_SUCCESS;
-	else
-		return CL_NOT_FOUND;
+	return NULL;
 }
 
 
@@ -1799,7 +1866,6 @@ ib_cancel_mad(
 	IN				ib_mad_element_t* const		p_mad_element )
 {
 #ifdef CL_KERNEL
-	cl_list_item_t			*p_list_item;
 	ib_mad_send_handle_t	h_send;
 #else
 	ib_api_status_t			status;
@@ -1826,10 +1892,9 @@ ib_cancel_mad(
 #else
 	/* Search for the MAD in our MAD list.  It may have already completed. */
 	cl_spinlock_acquire( &h_mad_svc->obj.lock );
-	p_list_item = cl_qlist_find_from_head( &h_mad_svc->send_list,
-		__mad_svc_find_send, p_mad_element );
+	h_send = __mad_svc_find_send( h_mad_svc, p_mad_element );
 
-	if( p_list_item == cl_qlist_end( &h_mad_svc->send_list ) )
+	if( !h_send )
 	{
 		cl_spinlock_release( &h_mad_svc->obj.lock );
 		AL_PRINT( TRACE_LEVEL_INFORMATION, AL_DBG_MAD_SVC, ("mad not found\n") );
@@ -1837,13 +1902,13 @@ ib_cancel_mad(
 	}
 
 	/* Mark the MAD as having been canceled. */
-	h_send = PARENT_STRUCT( p_list_item, al_mad_send_t, pool_item );
 	h_send->canceled = TRUE;
 
 	/* If the MAD is active, process it in the send callback. */
 	if( h_send->retry_time != MAX_TIME )
 	{
 		/* Process the canceled MAD using the timer thread. */
+		__wheel_insert( h_mad_svc, h_send, 0 );
 		cl_timer_trim( &h_mad_svc->send_timer, 0 );
 	}
 
@@ -1861,7 +1926,6 @@ ib_delay_mad(
 	IN		const	uint32_t					delay_ms )
 {
 #ifdef CL_KERNEL
-	cl_list_item_t			*p_list_item;
 	ib_mad_send_handle_t	h_send;
 #endif
 
@@ -1887,23 +1951,24 @@ ib_delay_mad(
 #else
 	/* Search for the MAD in our MAD list.  It may have already completed. */
 	cl_spinlock_acquire( &h_mad_svc->obj.lock );
-	p_list_item = cl_qlist_find_from_head( &h_mad_svc->send_list,
-		__mad_svc_find_send, p_mad_element );
+	h_send = __mad_svc_find_send( h_mad_svc, p_mad_element );
 
-	if( p_list_item == cl_qlist_end( &h_mad_svc->send_list ) )
+	if( !h_send )
 	{
 		cl_spinlock_release( &h_mad_svc->obj.lock );
 		AL_PRINT( TRACE_LEVEL_INFORMATION, AL_DBG_MAD_SVC, ("MAD not found\n") );
 		return IB_NOT_FOUND;
 	}
 
-	/* Mark the MAD as having been canceled. */
-	h_send = PARENT_STRUCT( p_list_item, al_mad_send_t, pool_item );
-
 	if( h_send->retry_time == MAX_TIME )
+	{
 		h_send->delay = delay_ms;
+	}
 	else
+	{
 		h_send->retry_time += ((uint64_t)delay_ms * 1000Ui64);
+		__wheel_insert( h_mad_svc, h_send, h_send->retry_time );
+	}
 
 	cl_spinlock_release( &h_mad_svc->obj.lock );
 	AL_EXIT( AL_DBG_MAD_SVC );
@@ -1937,8 +2002,7 @@ __mad_svc_send_done(
 	if( __is_internal_send( h_mad_svc->svc_type, h_send->p_send_mad ) )
 	{
 		AL_PRINT_EXIT( TRACE_LEVEL_WARNING, AL_DBG_MAD_SVC, ("internal send\n") );
-		cl_qlist_remove_item( &h_mad_svc->send_list,
-			(cl_list_item_t*)&h_send->pool_item );
+		__remove_send( h_mad_svc, h_send );
 		cl_spinlock_release( &h_mad_svc->obj.lock );
 		ib_put_mad( h_send->p_send_mad );
 		__cleanup_mad_send( h_mad_svc, h_send, 1 );
@@ -1949,8 +2013,7 @@ __mad_svc_send_done(
 	if( __is_send_mad_done( h_send, p_wc->status ) )
 	{
 		/* The send has completed. */
-		cl_qlist_remove_item( &h_mad_svc->send_list,
-			(cl_list_item_t*)&h_send->pool_item );
+		__remove_send( h_mad_svc, h_send );
 		cl_spinlock_release( &h_mad_svc->obj.lock );
 
 		/* Report the send as canceled only if we don't have the response. */
@@ -1979,7 +2042,7 @@ __mad_svc_send_done(
 				__get_send_tid( h_send )) );
 
 			cl_timer_trim( &h_mad_svc->send_timer,
-				__set_retry_time( h_send, h_mad_svc->send_jitter ) );
+				__set_retry_time( h_mad_svc, h_send ) );
 		}
 		cl_spinlock_release( &h_mad_svc->obj.lock );
 	}
@@ -2129,6 +2192,7 @@ __mad_svc_match_recv(
 	IN				ib_mad_element_t* const		p_recv_mad )
 {
 	ib_mad_t				*p_recv_hdr;
+	cl_qlist_t				*p_bucket;
 	cl_list_item_t			*p_list_item;
 	ib_mad_send_handle_t	h_send;
 
@@ -2136,12 +2200,13 @@ __mad_svc_match_recv(
 
 	p_recv_hdr = p_recv_mad->p_mad_buf;
 
-	/* Search the send list for a matching request. */
-	for( p_list_item = cl_qlist_head( &h_mad_svc->send_list );
-		 p_list_item != cl_qlist_end( &h_mad_svc->send_list );
+	/* Search the sends hashed to the same TID for a matching request. */
+	p_bucket = __tid_bucket( h_mad_svc, p_recv_mad );
+	for( p_list_item = cl_qlist_head( p_bucket );
+		 p_list_item != cl_qlist_end( p_bucket );
 		 p_list_item = cl_qlist_next( p_list_item ) )
 	{
-		h_send = PARENT_STRUCT( p_list_item, al_mad_send_t, pool_item );
+		h_send = PARENT_STRUCT( p_list_item, al_mad_send_t, tid_item );
 
 		/* Match on the transaction ID, ignoring internally generated sends. */
 		AL_EXIT( AL_DBG_MAD_SVC );
@@ -2291,8 +2356,7 @@ __process_recv_resp(
 			("resp received TID:0x%I64x\n", p_mad_hdr->trans_id) );
 
 		/* Report the send completion below. */
-		cl_qlist_remove_item( &h_mad_svc->send_list,
-			(cl_list_item_t*)&h_send->pool_item );
+		__remove_send( h_mad_svc, h_send );
 		cl_spinlock_release( &h_mad_svc->obj.lock );
 
 		/* Report the receive. */
@@ -2907,8 +2971,7 @@ __process_rmpp_ack(
 	if( send_done )
 	{
 		/* Notify the user of a send completion or error. */
-		cl_qlist_remove_item( &h_mad_svc->send_list,
-			(cl_list_item_t*)&h_send->pool_item );
+		__remove_send( h_mad_svc, h_send );
 		cl_spinlock_release( &h_mad_svc->obj.lock );
 		__notify_send_comp( h_mad_svc, h_send, wc_status );
 	}
@@ -2962,8 +3025,7 @@ __process_rmpp_nack(
 	}
 
 	/* Fail the send operation. */
-	cl_qlist_remove_item( &h_mad_svc->send_list,
-		(cl_list_item_t*)&h_send->pool_item );
+	__remove_send( h_mad_svc, h_send );
 	cl_spinlock_release( &h_mad_svc->obj.lock );
 	__notify_send_comp( h_mad_svc, h_send, IB_WCS_CANCELED );
 
@@ -2974,8 +3036,8 @@ __process_rmpp_nack(
 
 static __inline int
 __set_retry_time(
-	IN				ib_mad_send_handle_t		h_send,
-    IN              ULONG                       send_jitter )
+	IN				ib_mad_svc_handle_t			h_mad_svc,
+	IN				ib_mad_send_handle_t		h_send )
 {
     int timeout = (int)h_send->p_send_mad->timeout_ms;
 
@@ -3011,16 +3073,138 @@ __set_retry_time(
     // Add some jitter, random number between 0 and 1/2 timeout.
     // Note that this is in microseconds and not milliseconds.
     //
-    timeout += (send_jitter % timeout) / 2;
+    timeout += (h_mad_svc->send_jitter % timeout) / 2;
     timeout += h_send->delay;
 
 	h_send->retry_time = (uint64_t)(timeout) * 1000Ui64 + cl_get_time_stamp();
 	h_send->delay = 0;
+	__wheel_insert( h_mad_svc, h_send, h_send->retry_time );
     return timeout;
 }
 
 
 
+/*
+ * Track a new send by TID.  It goes on the timer wheel once it is waiting
+ * for a retry.
+ */
+static void
+__insert_send(
+	IN				ib_mad_svc_handle_t			h_mad_svc,
+	IN				ib_mad_send_handle_t		h_send )
+{
+	cl_qlist_insert_tail( &h_mad_svc->send_list,
+		(cl_list_item_t*)&h_send->pool_item );
+	cl_qlist_insert_tail( __tid_bucket( h_mad_svc, h_send->p_send_mad ),
+		&h_send->tid_item );
+}
+
+
+
+static void
+__remove_send(
+	IN				ib_mad_svc_handle_t			h_mad_svc,
+	IN				ib_mad_send_handle_t		h_send )
+{
+	cl_qlist_remove_item( &h_mad_svc->send_list,
+		(cl_list_item_t*)&h_send->pool_item );
+	cl_qlist_remove_item( __tid_bucket( h_mad_svc, h_send->p_send_mad ),
+		&h_send->tid_item );
+	__wheel_remove( h_send );
+}
+
+
+
+/*
+ * Place a send on the timer wheel slot for the given time.  Times that
+ * have already passed land on the current slot.
+ */
+static void
+__wheel_insert(
+	IN				ib_mad_svc_handle_t			h_mad_svc,
+	IN				ib_mad_send_handle_t		h_send,
+	IN				uint64_t					due_time )
+{
+	uint64_t				tick;
+
+	__wheel_remove( h_send );
+
+	tick = due_time / AL_MAD_WHEEL_TICK_US;
+	if( tick < h_mad_svc->wheel_tick )
+		tick = h_mad_svc->wheel_tick;
+
+	h_send->p_timer_slot =
+		&h_mad_svc->timer_wheel[tick & (AL_MAD_WHEEL_SIZE - 1)];
+	cl_qlist_insert_tail( h_send->p_timer_slot, &h_send->timer_item );
+}
+
+
+
+static void
+__wheel_remove(
+	IN				ib_mad_send_handle_t		h_send )
+{
+	if( !h_send->p_timer_slot )
+		return;
+
+	cl_qlist_remove_item( h_send->p_timer_slot, &h_send->timer_item );
+	h_send->p_timer_slot = NULL;
+}
+
+
+
+/*
+ * Set the send timer for the first occupied slot on the wheel.  Sends
+ * left on the current slot are either due later in this tick or on a
+ * later turn of the wheel, so their own retry time is used.
+ */
+static void
+__trim_send_timer(
+	IN				ib_mad_svc_handle_t			h_mad_svc,
+	IN				uint64_t					cur_time )
+{
+	cl_qlist_t				*p_slot;
+	cl_list_item_t			*p_list_item;
+	ib_mad_send_handle_t	h_send;
+	uint64_t				tick, due_time;
+	uint32_t				i;
+
+	due_time = MAX_TIME;
+	tick = cur_time / AL_MAD_WHEEL_TICK_US;
+
+	p_slot = &h_mad_svc->timer_wheel[tick & (AL_MAD_WHEEL_SIZE - 1)];
+	for( p_list_item = cl_qlist_head( p_slot );
+		 p_list_item != cl_qlist_end( p_slot );
+		 p_list_item = cl_qlist_next( p_list_item ) )
+	{
+		h_send = PARENT_STRUCT( p_list_item, al_mad_send_t, timer_item );
+		if( h_send->retry_time < due_time )
+			due_time = h_send->retry_time;
+	}
+
+	for( i = 1; i < AL_MAD_WHEEL_SIZE; i++ )
+	{
+		if( (tick + i) * AL_MAD_WHEEL_TICK_US >= due_time )
+			break;
+
+		p_slot = &h_mad_svc->timer_wheel[(tick + i) & (AL_MAD_WHEEL_SIZE - 1)];
+		if( !cl_is_qlist_empty( p_slot ) )
+		{
+			due_time = (tick + i) * AL_MAD_WHEEL_TICK_US;
+			break;
+		}
+	}
+
+	if( due_time == MAX_TIME )
+		return;
+
+	/* Round up so that the timer never fires ahead of the send. */
+	cl_timer_trim( &h_mad_svc->send_timer, (due_time <= cur_time) ? 0 :
+		(uint32_t)((due_time - cur_time + 999) / 1000) );
+}
+
+
+
 static void
 __send_timer_cb(
 	IN				void						*context )
@@ -3036,16 +3220,18 @@ __send_timer_cb(
 
 /*
  * Check the send queue for any sends that have timed out or were canceled
- * by the user.
+ * by the user.  Only the timer wheel slots that have come due since the
+ * last check are visited.
  */
 static void
 __check_send_queue(
 	IN				ib_mad_svc_handle_t			h_mad_svc )
 {
 	ib_mad_send_handle_t	h_send;
-	cl_list_item_t			*p_list_item, *p_next_item;
-	uint64_t				cur_time;
+	cl_list_item_t			*p_list_item;
+	uint64_t				cur_time, cur_tick, tick;
 	cl_qlist_t				timeout_list;
+	cl_qlist_t				due_list;
 
 	AL_ENTER( AL_DBG_MAD_SVC );
 
@@ -3054,28 +3240,37 @@ __check_send_queue(
 	 * holding the lock on the MAD service.
 	 */
 	cl_qlist_init( &timeout_list );
+	cl_qlist_init( &due_list );
 	cur_time = cl_get_time_stamp();
+	cur_tick = cur_time / AL_MAD_WHEEL_TICK_US;
 
 	cl_spinlock_acquire( &h_mad_svc->obj.lock );
 
-	/* Check all outstanding sends. */
-	for( p_list_item = cl_qlist_head( &h_mad_svc->send_list );
-		 p_list_item != cl_qlist_end( &h_mad_svc->send_list );
-		 p_list_item = p_next_item )
+	/*
+	 * Pull the due slots off the wheel before looking at them, so that
+	 * sends put back on the wheel below are not visited twice.
+	 */
+	tick = h_mad_svc->wheel_tick;
+	if( cur_tick - tick >= AL_MAD_WHEEL_SIZE )
+		tick = cur_tick - AL_MAD_WHEEL_SIZE + 1;
+	for( ; tick <= cur_tick; tick++ )
 	{
-		p_next_item = cl_qlist_next( p_list_item );
-		h_send = PARENT_STRUCT( p_list_item, al_mad_send_t, pool_item );
+		cl_qlist_insert_list_tail( &due_list,
+			&h_mad_svc->timer_wheel[tick & (AL_MAD_WHEEL_SIZE - 1)] );
+	}
+	h_mad_svc->wheel_tick = cur_tick;
 
-		/* See if the request is active. */
-		if( h_send->retry_time == MAX_TIME )
-		{
-			/* The request is still active. */
-			AL_PRINT( TRACE_LEVEL_INFORMATION, AL_DBG_MAD_SVC, ("active TID:0x%I64x\n",
-				__get_send_tid( h_send )) );
-			continue;
-		}
+	/* Check the sends waiting in those slots. */
+	for( p_list_item = cl_qlist_remove_head( &due_list );
+		 p_list_item != cl_qlist_end( &due_list );
+		 p_list_item = cl_qlist_remove_head( &due_list ) )
+	{
+		h_send = PARENT_STRUCT( p_list_item, al_mad_send_t, timer_item );
+		h_send->p_timer_slot = NULL;
+
+		/* Active requests are never on the wheel. */
+		CL_ASSERT( h_send->retry_time != MAX_TIME );
 
-		/* The request is not active. */
 		/* See if the request has been canceled. */
 		if( h_send->canceled )
 		{
@@ -3084,21 +3279,20 @@ __check_send_queue(
 				__get_send_tid( h_send )) );
 
 			h_send->p_send_mad->status = IB_WCS_CANCELED;
-			cl_qlist_remove_item( &h_mad_svc->send_list, p_list_item );
-			cl_qlist_insert_tail( &timeout_list, p_list_item );
+			__remove_send( h_mad_svc, h_send );
+			cl_qlist_insert_tail( &timeout_list,
+				(cl_list_item_t*)&h_send->pool_item );
 			continue;
 		}
 
 		/* Skip requests that have not timed out. */
 		if( cur_time < h_send->retry_time )
 		{
-			/* The request has not timed out. */
+			/* The request is due later in this tick or on a later turn. */
 			AL_PRINT( TRACE_LEVEL_INFORMATION, AL_DBG_MAD_SVC, ("waiting on TID:0x%I64x\n",
 				__get_send_tid( h_send )) );
 
-			/* Set the retry timer to the minimum needed time, in ms. */
-			cl_timer_trim( &h_mad_svc->send_timer,
-				((uint32_t)(h_send->retry_time - cur_time) / 1000) );
+			__wheel_insert( h_mad_svc, h_send, h_send->retry_time );
 			continue;
 		}
 
@@ -3123,8 +3317,7 @@ __check_send_queue(
 				else
 				{
 					/* The send was delivered.  Continue waiting. */
-					cl_timer_trim( &h_mad_svc->send_timer,
-						__set_retry_time( h_send, h_mad_svc->send_jitter ) );
+					__set_retry_time( h_mad_svc, h_send );
 				}
 			}
 			else
@@ -3140,10 +3333,14 @@ __check_send_queue(
 			("timing out TID:0x%I64x\n", __get_send_tid( h_send )) );
 
 		h_send->p_send_mad->status = IB_WCS_TIMEOUT_RETRY_ERR;
-		cl_qlist_remove_item( &h_mad_svc->send_list, p_list_item );
-		cl_qlist_insert_tail( &timeout_list, p_list_item );
+		__remove_send( h_mad_svc, h_send );
+		cl_qlist_insert_tail( &timeout_list,
+			(cl_list_item_t*)&h_send->pool_item );
 	}
 
+	/* Set the retry timer to the minimum needed time. */
+	__trim_send_timer( h_mad_svc, cur_time );
+
 	cl_spinlock_release( &h_mad_svc->obj.lock );
 
 	/*
@@ -130,6 +130,17 @@ mad_disp_recv_done(
 
 
 
+/*
+ * Outstanding sends are indexed by user TID for response matching, and
+ * kept in a hashed timer wheel by retry time.  Both sizes must be powers
+ * of 2.  Sends due further out than one turn of the wheel stay in their
+ * slot until they come due on a later turn.
+ */
+#define AL_MAD_TID_TBL_SIZE		128
+#define AL_MAD_WHEEL_SIZE		128
+#define AL_MAD_WHEEL_TICK_US	16000
+
+
 /*
  * MAD service used to send and receive MADs.  MAD services are responsible
  * for retransmissions and SAR.
@@ -150,6 +161,13 @@ typedef struct _al_mad_svc
 	cl_timer_t					send_timer;
     ULONG                       send_jitter;
 
+	/* Outstanding sends hashed by user TID. */
+	cl_qlist_t					tid_tbl[AL_MAD_TID_TBL_SIZE];
+
+	/* Sends waiting to be retried, slotted by retry time. */
+	cl_qlist_t					timer_wheel[AL_MAD_WHEEL_SIZE];
+	uint64_t					wheel_tick;
+
 	cl_qlist_t					recv_list;
 	cl_timer_t					recv_timer;
 
@@ -223,6 +223,15 @@ typedef struct _al_mad_send
 	uint32_t					retry_cnt;
 	boolean_t					canceled;	/* indicates if send was canceled */
 
+	/*
+	 * Links into the MAD service's TID table and send timer wheel.  The
+	 * send is on the timer wheel only while waiting for a retry, that is
+	 * when retry_time != MAX_TIME.
+	 */
+	cl_list_item_t				tid_item;
+	cl_list_item_t				timer_item;
+	cl_qlist_t					*p_timer_slot;
+
 	/*
 	 * SAR tracking information.
 	 */
@@ -94,6 +94,12 @@ verbs_create_cq(
 #define verbs_modify_cq(h_cq, p_size) \
 	h_cq->obj.p_ci_ca->verbs.resize_cq( h_cq->h_ci_cq, p_size, p_umv_buf )
 
+#define verbs_modify_cq_moder(h_cq, moder_cnt, moder_time) \
+	( ( h_cq->obj.p_ci_ca->verbs.modify_cq ) ? \
+		h_cq->obj.p_ci_ca->verbs.modify_cq( h_cq->h_ci_cq, \
+			moder_cnt, moder_time, NULL ) : \
+		IB_UNSUPPORTED )
+
 #define verbs_query_cq(h_cq, p_size) \
 	h_cq->obj.p_ci_ca->verbs.query_cq( h_cq->h_ci_cq, p_size, p_umv_buf )
 
@@ -444,6 +450,9 @@ verbs_create_cq(
 	ual_modify_cq(h_cq, p_size); \
 	UNUSED_PARAM( p_umv_buf )
 
+#define verbs_modify_cq_moder(h_cq, moder_cnt, moder_time) \
+	( UNUSED_PARAM( moder_cnt ), UNUSED_PARAM( moder_time ), IB_UNSUPPORTED )
+
 #define verbs_query_cq(h_cq, p_size) \
 	ual_query_cq(h_cq, p_size); \
 	UNUSED_PARAM( p_umv_buf )
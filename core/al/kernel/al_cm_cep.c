@@ -56,16 +56,6 @@
 #include "al_qp.h"
 
 
-/*
- * The vector object uses a list item at the front of the buffers
- * it allocates.  Take the list item into account so that allocations
- * are for full page sizes.
- */
-#define CEP_CID_MIN			\
-	((PAGE_SIZE - sizeof(cl_list_item_t)) / sizeof(cep_cid_t))
-#define CEP_CID_GROW		\
-	((PAGE_SIZE - sizeof(cl_list_item_t)) / sizeof(cep_cid_t))
-
 /*
  * We reserve the upper byte of the connection ID as a revolving counter so
  * that connections that are retried by the client change connection ID.
@@ -76,6 +66,51 @@
 #define CEP_MAX_CID					(0x00FFFFFF)
 #define CEP_MAX_CID_MASK			(0x00FFFFFF)
 
+/*
+ * The maps of connections by remote comm ID and by remote QPN are split
+ * into shards, selected by a hash of the key, so that the lookups done for
+ * every received CM MAD walk short trees during connection storms.
+ * Must be a power of two.
+ */
+#define CEP_MAP_SHARDS				(64)
+
+/*
+ * CEP state is guarded by one of CEP_LOCK_STRIPES locks, selected by the
+ * low bits of the CID, so that CM MADs and API calls for different
+ * connections are processed in parallel.  Must be a power of two.
+ */
+#define CEP_LOCK_STRIPES			(64)
+
+/*
+ * Lock ordering:
+ *
+ *	1. CEP stripe locks (cep_lock).  When two CEPs must be held, as for
+ *	   a listen and the CEP created for its REQ, the lower stripe is
+ *	   taken first (see __lock_cep_pair).  If both CIDs map to the same
+ *	   stripe it is taken once.
+ *
+ *	2. Leaf locks: the listen map, the connection ID and QPN map
+ *	   shards, the timewait list, the port map and cid_grow_lock.
+ *	   These may be taken with a CEP stripe held, but never while
+ *	   holding another leaf lock, and no lock is taken under them.
+ *
+ * A CEP found through a map without its stripe held must be looked up
+ * again once the stripe is taken (see __acquire_by_id), since it may have
+ * been destroyed or its CID reused in between.
+ */
+
+/*
+ * The CID table is a fixed directory of chunks that are allocated on
+ * demand and only freed with the CEP manager, so that entries can be
+ * located without holding a lock.
+ */
+#define CEP_CID_CHUNK_SHIFT			(10)
+#define CEP_CID_CHUNK_SIZE			(1 << CEP_CID_CHUNK_SHIFT)
+#define CEP_CID_CHUNKS				((CEP_MAX_CID + 1) >> CEP_CID_CHUNK_SHIFT)
+
+/* Empty free list marker. */
+#define CEP_CID_NONE				(0xFFFFFFFF)
+
 #define CEP_MAD_SQ_DEPTH			(128)
 #define CEP_MAD_RQ_DEPTH			(1)	/* ignored. */
 #define CEP_MAD_SQ_SGE				(1)
@@ -87,21 +122,32 @@ typedef struct _al_cep_mgr
 {
 	al_obj_t				obj;
 
+	KSPIN_LOCK				port_lock;
 	cl_qmap_t				port_map;
 
-	KSPIN_LOCK				lock;
+	/* Locks for CEP state, indexed by CID. */
+	KSPIN_LOCK				cep_lock[CEP_LOCK_STRIPES];
 
-	/* Bitmap of CEPs, indexed by CID. */
-	cl_vector_t				cid_vector;
-	uint32_t				free_cid;
+	/*
+	 * Table of CEPs, indexed by CID.  The free list is a lock-free stack
+	 * threaded through the entries: the low 32 bits of free_head hold the
+	 * first free CID, the high 32 bits a tag bumped on every update.
+	 */
+	struct _cep_cid			*cid_dir[CEP_CID_CHUNKS];
+	KSPIN_LOCK				cid_grow_lock;
+	uint32_t				cid_chunks;
+	volatile LONG64			free_head;
 
 	/* List of active listens. */
+	KSPIN_LOCK				listen_lock;
 	cl_rbmap_t				listen_map;
 
-	/* Map of CEP by remote CID and CA GUID. */
-	cl_rbmap_t				conn_id_map;
-	/* Map of CEP by remote QPN, used for stale connection matching. */
-	cl_rbmap_t				conn_qp_map;
+	/* Maps of CEP by remote CID and CA GUID, sharded by hash. */
+	KSPIN_LOCK				conn_id_lock[CEP_MAP_SHARDS];
+	cl_rbmap_t				conn_id_map[CEP_MAP_SHARDS];
+	/* Maps of CEP by remote QPN, used for stale connection matching. */
+	KSPIN_LOCK				conn_qp_lock[CEP_MAP_SHARDS];
+	cl_rbmap_t				conn_qp_map[CEP_MAP_SHARDS];
 
 	NPAGED_LOOKASIDE_LIST	cep_pool;
 	NPAGED_LOOKASIDE_LIST	req_pool;
@@ -110,6 +156,7 @@ typedef struct _al_cep_mgr
 	 * Periodically walk the list of connections in the time wait state
 	 * and flush them as appropriate.
 	 */
+	KSPIN_LOCK				timewait_lock;
 	cl_timer_t				timewait_timer;
 	cl_qlist_t				timewait_list;
 
@@ -379,7 +426,7 @@ typedef struct _al_kcep
 }	kcep_t;
 
 
-/* Structures stored in the CID vector. */
+/* Entries of the CID table. */
 typedef struct _cep_cid
 {
 	/* Owning AL handle.  NULL if invalid. */
@@ -451,6 +498,12 @@ __lookup_by_id(
 	IN				net32_t						remote_comm_id,
 	IN				net64_t						remote_ca_guid );
 
+static kcep_t*
+__acquire_by_id(
+	IN				net32_t						remote_comm_id,
+	IN				net64_t						remote_ca_guid,
+		OUT			KLOCK_QUEUE_HANDLE* const	p_hdl );
+
 static kcep_t*
 __lookup_listen(
 	IN				net64_t						sid,
@@ -462,9 +515,10 @@ __lookup_cep(
 	IN				ib_al_handle_t				h_al OPTIONAL,
 	IN				net32_t						cid );
 
-static inline kcep_t*
+static boolean_t
 __insert_cep(
-	IN				kcep_t* const				p_new_cep );
+	IN				kcep_t* const				p_new_cep,
+		OUT			net32_t* const				p_stale_id );
 
 static inline void
 __remove_cep(
@@ -498,6 +552,25 @@ static cep_cid_t*
 __get_lcid(
 		OUT			net32_t* const				p_cid );
 
+static inline KSPIN_LOCK*
+__cep_lock(
+	IN				net32_t						cid );
+
+static inline void
+__lock_cep_pair(
+	IN				net32_t						cid1,
+	IN				net32_t						cid2,
+		OUT			KLOCK_QUEUE_HANDLE* const	p_hdl1,
+		OUT			KLOCK_QUEUE_HANDLE* const	p_hdl2 );
+
+static inline void
+__unlock_cep_pair(
+	IN				KLOCK_QUEUE_HANDLE* const	p_hdl1,
+	IN				KLOCK_QUEUE_HANDLE* const	p_hdl2 );
+
+static void
+__cep_lock_barrier( void );
+
 static void
 __process_cep_send_comp(
 	IN				cl_async_proc_item_t		*p_item );
@@ -1087,9 +1160,10 @@ __req_handler(
 {
 	ib_api_status_t		status = IB_SUCCESS;
 	mad_cm_req_t		*p_req;
-	kcep_t				*p_cep, *p_new_cep, *p_stale_cep = NULL;
-	KLOCK_QUEUE_HANDLE	hdl;
+	kcep_t				*p_cep, *p_new_cep = NULL, *p_stale_cep = NULL;
+	KLOCK_QUEUE_HANDLE	hdl, new_hdl, listen_hdl;
 	ib_rej_status_t		reason;
+	net32_t				listen_id, stale_id = 0;
 
 	AL_ENTER( AL_DBG_CM );
 
@@ -1101,8 +1175,6 @@ __req_handler(
 		("REQ: comm_id (x%x) qpn (x%x) received\n",
 		p_req->local_comm_id, conn_req_get_lcl_qpn( p_req )) );
 
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
-
 	if( conn_req_get_qp_type( p_req ) > IB_QPT_UNRELIABLE_CONN ||
 		conn_req_get_lcl_qpn( p_req ) == 0 )
 	{
@@ -1113,7 +1185,7 @@ __req_handler(
 	}
 
 	/* Match against pending connections using remote comm ID and CA GUID. */
-	p_cep = __lookup_by_id( p_req->local_comm_id, p_req->local_ca_guid );
+	p_cep = __acquire_by_id( p_req->local_comm_id, p_req->local_ca_guid, &hdl );
 	if( p_cep )
 	{
 		/* Already received the REQ. */
@@ -1146,71 +1218,17 @@ __req_handler(
 		return;
 	}
 
+relookup:
 	/*
 	 * Match against listens using SID and compare data, also provide the receiving
 	 * MAD service's port GUID so we can properly filter.
 	 */
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->listen_lock, &hdl );
 	p_cep = __lookup_listen( p_req->sid, p_port_cep->port_guid, p_req->pdata );
 	if( p_cep )
-	{
-		/*
-		 * Allocate a new CEP for the new request.  This will
-		 * prevent multiple identical REQs from queueing up for processing.
-		 */
-		p_new_cep = __create_cep();
-		if( !p_new_cep )
-		{
-			/* Reject the request for insufficient resources. */
-			reason = IB_REJ_INSUF_RESOURCES;
-			AL_PRINT_EXIT( TRACE_LEVEL_ERROR, AL_DBG_ERROR,
-				("__create_cep failed\nREJ sent for insufficient resources.\n") );
-			goto reject;
-		}
-
-		__save_wire_req( p_new_cep, p_req );
-
-		__bind_cep( p_new_cep, p_cep->p_cid->h_al, p_cep->pfn_cb, NULL );
-		AL_PRINT( TRACE_LEVEL_VERBOSE, AL_DBG_CM,
-			("Created CEP with CID = %d, h_al %p, remote = %d\n",
-			p_new_cep->cid, p_cep->p_cid->h_al, p_new_cep->remote_comm_id) );
-
-		/* Add the new CEP to the map so that repeated REQs match up. */
-		p_stale_cep = __insert_cep( p_new_cep );
-		if( p_stale_cep != p_new_cep )
-		{
-			/* Duplicate - must be a stale connection. */
-			reason = IB_REJ_STALE_CONN;
-			/* Fail the local stale CEP. */
-			status = __process_stale( p_stale_cep );
-			goto unbind;
-		}
-
-		/* __cep_queue_mad may complete a pending IRP */
-		p_mad->send_context1 = p_new_cep;	 
-
-		/*
-		 * Queue the mad - the return value indicates whether we should
-		 * invoke the callback.
-		 */
-		status = __cep_queue_mad( p_cep, p_mad );
-		switch( status )
-		{
-		case IB_SUCCESS:
-		case IB_PENDING:
-			break;
-
-		case IB_UNSUPPORTED:
-			p_mad->send_context1 = NULL;
-			reason = IB_REJ_USER_DEFINED;
-			goto unbind;
-		
-		default:
-			p_mad->send_context1 = NULL;
-			reason = IB_REJ_INSUF_RESOURCES;
-			goto unbind;
-		}
-	}
-	else
+		listen_id = p_cep->local_comm_id;
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
+	if( !p_cep )
 	{
 		AL_PRINT( TRACE_LEVEL_INFORMATION, AL_DBG_CM, ("No listens active!\n") );
 
@@ -1239,11 +1257,101 @@ __req_handler(
 			/* No match found.  Reject. */
 			reason = IB_REJ_INVALID_SID;
 			AL_PRINT( TRACE_LEVEL_INFORMATION, AL_DBG_CM, ("REQ received but no match found.\n") );
+			if( p_new_cep )
+				goto destroy;
 			goto reject;
 		}
 	}
 
-	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
+	if( !p_new_cep )
+	{
+		/*
+		 * Allocate a new CEP for the new request.  This will
+		 * prevent multiple identical REQs from queueing up for processing.
+		 * It isn't visible to lookups until bound, so it is set up
+		 * without its lock.
+		 */
+		p_new_cep = __create_cep();
+		if( !p_new_cep )
+		{
+			/* Reject the request for insufficient resources. */
+			reason = IB_REJ_INSUF_RESOURCES;
+			AL_PRINT_EXIT( TRACE_LEVEL_ERROR, AL_DBG_ERROR,
+				("__create_cep failed\nREJ sent for insufficient resources.\n") );
+			goto reject;
+		}
+
+		__save_wire_req( p_new_cep, p_req );
+	}
+
+	__lock_cep_pair( listen_id, p_new_cep->cid, &hdl, &new_hdl );
+
+	/*
+	 * The listen lock ranks below CEP locks, so check that the listen is
+	 * still the one matching the REQ now that its CEP is locked.
+	 */
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->listen_lock, &listen_hdl );
+	p_cep = __lookup_listen( p_req->sid, p_port_cep->port_guid, p_req->pdata );
+	if( p_cep && p_cep->local_comm_id != listen_id )
+		p_cep = NULL;
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( &listen_hdl );
+	if( !p_cep )
+	{
+		__unlock_cep_pair( &hdl, &new_hdl );
+		goto relookup;
+	}
+
+	__bind_cep( p_new_cep, p_cep->p_cid->h_al, p_cep->pfn_cb, NULL );
+	AL_PRINT( TRACE_LEVEL_VERBOSE, AL_DBG_CM,
+		("Created CEP with CID = %d, h_al %p, remote = %d\n",
+		p_new_cep->cid, p_cep->p_cid->h_al, p_new_cep->remote_comm_id) );
+
+	/* Add the new CEP to the map so that repeated REQs match up. */
+	if( !__insert_cep( p_new_cep, &stale_id ) )
+	{
+		if( !stale_id )
+		{
+			/* A copy of this REQ is being processed concurrently. */
+			AL_PRINT( TRACE_LEVEL_INFORMATION, AL_DBG_CM, ("Duplicate REQ received.\n") );
+			__unbind_cep( p_new_cep );
+			p_new_cep->state = CEP_STATE_IDLE;
+			__cleanup_cep( p_new_cep );
+			__unlock_cep_pair( &hdl, &new_hdl );
+			ib_put_mad( p_mad );
+			AL_EXIT( AL_DBG_CM );
+			return;
+		}
+		/* Duplicate QPN - must be a stale connection. */
+		reason = IB_REJ_STALE_CONN;
+		goto unbind;
+	}
+
+	/* __cep_queue_mad may complete a pending IRP */
+	p_mad->send_context1 = p_new_cep;	 
+
+	/*
+	 * Queue the mad - the return value indicates whether we should
+	 * invoke the callback.
+	 */
+	status = __cep_queue_mad( p_cep, p_mad );
+	switch( status )
+	{
+	case IB_SUCCESS:
+	case IB_PENDING:
+		break;
+
+	case IB_UNSUPPORTED:
+		p_mad->send_context1 = NULL;
+		reason = IB_REJ_USER_DEFINED;
+		goto unbind;
+	
+	default:
+		p_mad->send_context1 = NULL;
+		reason = IB_REJ_INSUF_RESOURCES;
+		goto unbind;
+	}
+
+	__unlock_cep_pair( &hdl, &new_hdl );
 
 	/* Process any queued MADs for the CEP. */
 	if( status == IB_SUCCESS )
@@ -1265,13 +1373,41 @@ unbind:
 	p_new_cep->remote_qpn = 0;
 	__cleanup_cep( p_new_cep );
 
-reject:
 	__reject_req( p_port_cep, p_mad, reason );
 
-	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
+	__unlock_cep_pair( &hdl, &new_hdl );
+
+	if( stale_id )
+	{
+		/* Fail the local stale CEP. */
+		KeAcquireInStackQueuedSpinLockAtDpcLevel( __cep_lock( stale_id ), &hdl );
+		p_stale_cep = __lookup_cep( NULL, stale_id );
+		if( p_stale_cep &&
+			p_stale_cep->remote_qpn == conn_req_get_lcl_qpn( p_req ) &&
+			p_stale_cep->remote_ca_guid == p_req->local_ca_guid )
+		{
+			status = __process_stale( p_stale_cep );
+		}
+		else
+		{
+			/* Already gone. */
+			status = IB_NO_MATCH;
+		}
+		KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 
-	if( reason == IB_REJ_STALE_CONN && status == IB_SUCCESS )
-		__process_cep( p_stale_cep );
+		if( status == IB_SUCCESS )
+			__process_cep( p_stale_cep );
+	}
+
+	AL_EXIT( AL_DBG_CM );
+	return;
+
+destroy:
+	/* The new CEP was never bound, so no lookup can find it. */
+	__destroy_cep( p_new_cep );
+
+reject:
+	__reject_req( p_port_cep, p_mad, reason );
 
 	AL_EXIT( AL_DBG_CM );
 }
@@ -1338,7 +1474,8 @@ __mra_handler(
 
 	p_mra = (mad_cm_mra_t*)p_mad->p_mad_buf;
 
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLockAtDpcLevel(
+		__cep_lock( p_mra->remote_comm_id ), &hdl );
 	p_cep = __lookup_cep( NULL, p_mra->remote_comm_id );
 	if( !p_cep )
 	{
@@ -1426,21 +1563,24 @@ __rej_handler(
 		goto err1;
 
 	/* Check the pending list by the remote CA GUID and connection ID. */
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
 	if( p_rej->remote_comm_id )
 	{
+		KeAcquireInStackQueuedSpinLockAtDpcLevel(
+			__cep_lock( p_rej->remote_comm_id ), &hdl );
 		p_cep = __lookup_cep( NULL, p_rej->remote_comm_id );
+		if( !p_cep )
+			goto err2;
 	}
 	else if( p_rej->reason == IB_REJ_TIMEOUT &&
 		conn_rej_get_ari_len( p_rej ) == sizeof(net64_t) )
 	{
 		cl_memcpy( &ca_guid, p_rej->ari, sizeof(net64_t) );
-		p_cep = __lookup_by_id( p_rej->local_comm_id, ca_guid );
+		p_cep = __acquire_by_id( p_rej->local_comm_id, ca_guid, &hdl );
 	}
 
 	if( !p_cep )
 	{
-		goto err2;
+		goto err1;
 	}
 
 	if( p_cep->remote_comm_id &&
@@ -1475,6 +1615,7 @@ __rep_handler(
 	kcep_t				*p_cep;
 	KLOCK_QUEUE_HANDLE	hdl;
 	cep_state_t			old_state;
+	net32_t				stale_id;
 
 	AL_ENTER( AL_DBG_CM );
 
@@ -1485,7 +1626,8 @@ __rep_handler(
 	AL_PRINT( TRACE_LEVEL_INFORMATION, AL_DBG_CM,
 		("REP: comm_id (x%x) received\n", p_rep->local_comm_id ) );
 
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLockAtDpcLevel(
+		__cep_lock( p_rep->remote_comm_id ), &hdl );
 	p_cep = __lookup_cep( NULL, p_rep->remote_comm_id );
 	if( !p_cep )
 	{
@@ -1504,7 +1646,7 @@ __rep_handler(
 		/* Save pertinent information and change state. */
 		__save_wire_rep( p_cep, p_rep );
 
-		if( __insert_cep( p_cep ) != p_cep )
+		if( !__insert_cep( p_cep, &stale_id ) )
 		{
 			/* Roll back the state change. */
 			__reject_mad( p_port_cep, p_cep, p_mad, IB_REJ_STALE_CONN );
@@ -1576,7 +1718,8 @@ __rtu_handler(
 		("RTU: comm_id (x%x) received\n", p_rtu->local_comm_id) );
 
 	/* Find the connection by local connection ID. */
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLockAtDpcLevel(
+		__cep_lock( p_rtu->remote_comm_id ), &hdl );
 	p_cep = __lookup_cep( NULL, p_rtu->remote_comm_id );
 	if( !p_cep || p_cep->remote_comm_id != p_rtu->local_comm_id )
 	{
@@ -1686,7 +1829,8 @@ __dreq_handler(
 		p_dreq->local_comm_id, conn_dreq_get_remote_qpn( p_dreq )) );
 
 	/* Find the connection by connection IDs. */
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLockAtDpcLevel(
+		__cep_lock( p_dreq->remote_comm_id ), &hdl );
 	p_cep = __lookup_cep( NULL, p_dreq->remote_comm_id );
 	if( !p_cep ||
 		p_cep->remote_comm_id != p_dreq->local_comm_id ||
@@ -1781,7 +1925,8 @@ __drep_handler(
 	p_drep = (mad_cm_drep_t*)p_mad->p_mad_buf;
 
 	/* Find the connection by local connection ID. */
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLockAtDpcLevel(
+		__cep_lock( p_drep->remote_comm_id ), &hdl );
 	p_cep = __lookup_cep( NULL, p_drep->remote_comm_id );
 	if( !p_cep || p_cep->remote_comm_id != p_drep->local_comm_id )
 	{
@@ -1921,7 +2066,8 @@ __lap_handler(
 	p_lap = (mad_cm_lap_t*)p_mad->p_mad_buf;
 
 	/* Find the connection by local connection ID. */
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLockAtDpcLevel(
+		__cep_lock( p_lap->remote_comm_id ), &hdl );
 	p_cep = __lookup_cep( NULL, p_lap->remote_comm_id );
 	if( !p_cep || p_cep->remote_comm_id != p_lap->local_comm_id )
 	{
@@ -2008,7 +2154,8 @@ __apr_handler(
 
 	p_apr = (mad_cm_apr_t*)p_mad->p_mad_buf;
 
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLockAtDpcLevel(
+		__cep_lock( p_apr->remote_comm_id ), &hdl );
 	p_cep = __lookup_cep( NULL, p_apr->remote_comm_id );
 	if( !p_cep || p_cep->remote_comm_id != p_apr->local_comm_id )
 	{
@@ -2142,17 +2289,25 @@ __cep_mad_recv_cb(
 }
 
 
+/*
+ * Called with the CEP's lock held.  The port agent may only be used until
+ * that lock is released, see __destroying_port_cep.
+ */
 static inline cep_agent_t*
 __get_cep_agent(
 	IN				kcep_t* const				p_cep )
 {
 	cl_map_item_t		*p_item;
+	KLOCK_QUEUE_HANDLE	hdl;
 
 	CL_ASSERT( p_cep );
+	CL_ASSERT( KeGetCurrentIrql() == DISPATCH_LEVEL );
 
 	/* Look up the primary CEP port agent */
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->port_lock, &hdl );
 	p_item = cl_qmap_get( &gp_cep_mgr->port_map,
 		p_cep->av[p_cep->idx_primary].port_guid );
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 	if( p_item == cl_qmap_end( &gp_cep_mgr->port_map ) )
 		return NULL;
 
@@ -2308,7 +2463,8 @@ __cep_mad_send_cb(
 	CL_ASSERT( p_mad->status != IB_WCS_SUCCESS );
 	p_mad->context1 = NULL;
 
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
+	/* The reference held for the send keeps the CEP alive. */
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( __cep_lock( p_cep->cid ), &hdl );
 	if( p_cep->p_send_mad != p_mad )
 	{
 		KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
@@ -2483,9 +2639,15 @@ __destroying_port_cep(
 
 	if( p_port_cep->port_guid )
 	{
-		KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+		KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->port_lock, &hdl );
 		cl_qmap_remove_item( &gp_cep_mgr->port_map, &p_port_cep->item );
 		KeReleaseInStackQueuedSpinLock( &hdl );
+
+		/*
+		 * CEPs use the port agent found in the map only while holding
+		 * their lock - wait for them to be done with it.
+		 */
+		__cep_lock_barrier();
 	}
 
 	if( p_port_cep->h_qp )
@@ -2584,7 +2746,7 @@ __create_port_cep(
 	p_port_cep->port_num = p_pnp_rec->p_port_attr->port_num;
 	p_port_cep->base_lid = p_pnp_rec->p_port_attr->lid;
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->port_lock, &hdl );
 	cl_qmap_insert(
 		&gp_cep_mgr->port_map, p_port_cep->port_guid, &p_port_cep->item );
 	KeReleaseInStackQueuedSpinLock( &hdl );
@@ -2628,41 +2790,216 @@ __create_port_cep(
 * Global CEP manager
 ******************************************************************************/
 
+static inline KSPIN_LOCK*
+__cep_lock(
+	IN				net32_t						cid )
+{
+	/* The modifier in the upper byte is ignored, so comm IDs work too. */
+	return &gp_cep_mgr->cep_lock[cid & (CEP_LOCK_STRIPES - 1)];
+}
+
+
+/*
+ * Acquires the locks of two CEPs, lower stripe first.  Both handles are
+ * released with __unlock_cep_pair.
+ */
+static inline void
+__lock_cep_pair(
+	IN				net32_t						cid1,
+	IN				net32_t						cid2,
+		OUT			KLOCK_QUEUE_HANDLE* const	p_hdl1,
+		OUT			KLOCK_QUEUE_HANDLE* const	p_hdl2 )
+{
+	KSPIN_LOCK			*p_lock1, *p_lock2;
+
+	CL_ASSERT( KeGetCurrentIrql() == DISPATCH_LEVEL );
+
+	p_lock1 = __cep_lock( cid1 );
+	p_lock2 = __cep_lock( cid2 );
+	if( p_lock1 == p_lock2 )
+	{
+		KeAcquireInStackQueuedSpinLockAtDpcLevel( p_lock1, p_hdl1 );
+		p_hdl2->LockQueue.Lock = NULL;
+	}
+	else if( p_lock1 < p_lock2 )
+	{
+		KeAcquireInStackQueuedSpinLockAtDpcLevel( p_lock1, p_hdl1 );
+		KeAcquireInStackQueuedSpinLockAtDpcLevel( p_lock2, p_hdl2 );
+	}
+	else
+	{
+		KeAcquireInStackQueuedSpinLockAtDpcLevel( p_lock2, p_hdl2 );
+		KeAcquireInStackQueuedSpinLockAtDpcLevel( p_lock1, p_hdl1 );
+	}
+}
+
+
+static inline void
+__unlock_cep_pair(
+	IN				KLOCK_QUEUE_HANDLE* const	p_hdl1,
+	IN				KLOCK_QUEUE_HANDLE* const	p_hdl2 )
+{
+	if( p_hdl2->LockQueue.Lock )
+		KeReleaseInStackQueuedSpinLockFromDpcLevel( p_hdl2 );
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( p_hdl1 );
+}
+
+
+/*
+ * Waits for every thread holding a CEP lock to release it.  Anything
+ * looked up with a CEP lock held and used only under that lock is no
+ * longer referenced once this returns.
+ */
+static void
+__cep_lock_barrier( void )
+{
+	KLOCK_QUEUE_HANDLE	hdl;
+	uint32_t			i;
+
+	for( i = 0; i < CEP_LOCK_STRIPES; i++ )
+	{
+		KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->cep_lock[i], &hdl );
+		KeReleaseInStackQueuedSpinLock( &hdl );
+	}
+}
+
+
+static inline cep_cid_t*
+__cid_entry(
+	IN				uint32_t					idx )
+{
+	cep_cid_t			*p_chunk;
+
+	p_chunk = gp_cep_mgr->cid_dir[idx >> CEP_CID_CHUNK_SHIFT];
+	if( !p_chunk )
+		return NULL;
+
+	return &p_chunk[idx & (CEP_CID_CHUNK_SIZE - 1)];
+}
+
+
+/*
+ * Pushes a chain of free CID entries, linked through their p_cep fields,
+ * on the free list.
+ */
+static void
+__push_free_cids(
+	IN				uint32_t					first,
+	IN				cep_cid_t* const			p_last )
+{
+	LONG64				head, new_head;
+
+	do
+	{
+		head = gp_cep_mgr->free_head;
+		p_last->p_cep = (kcep_t*)(uintn_t)(uint32_t)head;
+		new_head = (LONG64)(((uint64_t)head & 0xFFFFFFFF00000000ULL) +
+			0x100000000ULL) | first;
+	} while( InterlockedCompareExchange64(
+		&gp_cep_mgr->free_head, new_head, head ) != head );
+}
+
+
+/*
+ * Adds a chunk of entries to the CID table.  The chunk is published
+ * before its entries are put on the free list so that any CID taken from
+ * the list resolves.
+ */
+static ib_api_status_t
+__grow_cids( void )
+{
+	KLOCK_QUEUE_HANDLE	hdl;
+	cep_cid_t			*p_chunk;
+	uint32_t			chunk, first, i;
+
+	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->cid_grow_lock, &hdl );
+	if( (uint32_t)gp_cep_mgr->free_head != CEP_CID_NONE )
+	{
+		/* Another thread grew the table or freed a CID meanwhile. */
+		KeReleaseInStackQueuedSpinLock( &hdl );
+		return IB_SUCCESS;
+	}
+
+	chunk = gp_cep_mgr->cid_chunks;
+	if( chunk == CEP_CID_CHUNKS )
+	{
+		KeReleaseInStackQueuedSpinLock( &hdl );
+		return IB_INSUFFICIENT_RESOURCES;
+	}
+
+	p_chunk = (cep_cid_t*)cl_zalloc( sizeof(cep_cid_t) * CEP_CID_CHUNK_SIZE );
+	if( !p_chunk )
+	{
+		KeReleaseInStackQueuedSpinLock( &hdl );
+		return IB_INSUFFICIENT_MEMORY;
+	}
+
+	first = chunk << CEP_CID_CHUNK_SHIFT;
+	for( i = 0; i < CEP_CID_CHUNK_SIZE - 1; i++ )
+		p_chunk[i].p_cep = (kcep_t*)(uintn_t)(first + i + 1);
+
+	InterlockedExchangePointer( &gp_cep_mgr->cid_dir[chunk], p_chunk );
+	gp_cep_mgr->cid_chunks++;
+
+	/*
+	 * CID zero is never handed out so that a full CID (base + counter)
+	 * is never zero.
+	 */
+	if( !first )
+		first++;
+	__push_free_cids( first, &p_chunk[CEP_CID_CHUNK_SIZE - 1] );
+
+	KeReleaseInStackQueuedSpinLock( &hdl );
+	return IB_SUCCESS;
+}
+
+
+/*
+ * Takes a CID from the free list without locking.  The tag in the list
+ * head guards against an entry being taken and put back between reading
+ * the head and swapping it.  The entry's h_al stays NULL until the CEP is
+ * bound, so lookups ignore it until then.
+ */
 static cep_cid_t*
 __get_lcid(
 		OUT			net32_t* const				p_cid )
 {
-	cl_status_t			status;
-	uint32_t			size, cid;
+	LONG64				head, new_head;
+	uint32_t			cid;
 	cep_cid_t			*p_cep_cid;
 
 	AL_ENTER( AL_DBG_CM );
 
-	size = (uint32_t)cl_vector_get_size( &gp_cep_mgr->cid_vector );
-	cid = gp_cep_mgr->free_cid;
-	if( gp_cep_mgr->free_cid == size )
+	for( ;; )
 	{
-		/* Grow the vector pool. */
-		status =
-			cl_vector_set_size( &gp_cep_mgr->cid_vector, size + CEP_CID_GROW );
-		if( status != CL_SUCCESS )
+		head = gp_cep_mgr->free_head;
+		cid = (uint32_t)head;
+		if( cid == CEP_CID_NONE )
 		{
-			AL_EXIT( AL_DBG_CM );
-			return NULL;
+			if( __grow_cids() != IB_SUCCESS )
+			{
+				AL_EXIT( AL_DBG_CM );
+				return NULL;
+			}
+			continue;
 		}
+
+		p_cep_cid = __cid_entry( cid );
+		CL_ASSERT( p_cep_cid );
+
 		/*
-		 * Return the the start of the free list since the
-		 * entry initializer incremented it.
+		 * The link may be stale if the entry was taken by another thread;
+		 * the tag then changed and the swap fails.
 		 */
-		gp_cep_mgr->free_cid = size;
+		new_head = (LONG64)(((uint64_t)head & 0xFFFFFFFF00000000ULL) +
+			0x100000000ULL) | (uint32_t)(uintn_t)p_cep_cid->p_cep;
+		if( InterlockedCompareExchange64(
+			&gp_cep_mgr->free_head, new_head, head ) == head )
+		{
+			break;
+		}
 	}
 
-	/* Get the next free entry. */
-	p_cep_cid = (cep_cid_t*)cl_vector_get_ptr( &gp_cep_mgr->cid_vector, cid );
-
-	/* Update the next entry index. */
-	gp_cep_mgr->free_cid = (uint32_t)(uintn_t)p_cep_cid->p_cep;
-
 	*p_cid = cid;
 
 	AL_EXIT( AL_DBG_CM );
@@ -2670,29 +3007,24 @@ __get_lcid(
 }
 
 
+/* Called with the CEP's lock held. */
 static inline kcep_t*
 __lookup_cep(
 	IN				ib_al_handle_t				h_al OPTIONAL,
 	IN				net32_t						cid )
 {
-	size_t				idx;
 	cep_cid_t			*p_cid;
 
-	/* Mask off the counter bits so we get the index in our vector. */
-	idx = cid & CEP_MAX_CID_MASK;
-
-	if( idx >= cl_vector_get_size( &gp_cep_mgr->cid_vector ) )
-		return NULL;
-
-	p_cid = (cep_cid_t*)cl_vector_get_ptr( &gp_cep_mgr->cid_vector, idx );
-	if( !p_cid->h_al )
+	/* Mask off the counter bits so we get the index in our table. */
+	p_cid = __cid_entry( cid & CEP_MAX_CID_MASK );
+	if( !p_cid || !p_cid->h_al )
 		return NULL;
 
 	/*
 	 * h_al is NULL when processing MADs, so we need to match on
 	 * the actual local communication ID.  If h_al is non-NULL, we
 	 * are doing a lookup from a call to our API, and only need to match
-	 * on the index in the vector (without the modifier).
+	 * on the index in the table (without the modifier).
 	 */
 	if( h_al )
 	{
@@ -2708,6 +3040,65 @@ __lookup_cep(
 }
 
 
+/*
+ * Select the shard of the remote comm ID or QPN maps for a key.  The key
+ * is folded with the CA GUID so that connections from different hosts
+ * using the same comm ID or QPN spread across shards.
+ */
+static inline uint32_t
+__conn_shard(
+	IN				net32_t						key,
+	IN				net64_t						remote_ca_guid )
+{
+	uint32_t	hash;
+
+	hash = key ^ (uint32_t)remote_ca_guid ^ (uint32_t)(remote_ca_guid >> 32);
+	hash ^= (hash >> 16);
+	hash ^= (hash >> 8);
+	return hash & (CEP_MAP_SHARDS - 1);
+}
+
+
+static inline cl_rbmap_t*
+__conn_id_map(
+	IN				net32_t						remote_comm_id,
+	IN				net64_t						remote_ca_guid )
+{
+	return &gp_cep_mgr->conn_id_map[
+		__conn_shard( remote_comm_id, remote_ca_guid )];
+}
+
+
+static inline cl_rbmap_t*
+__conn_qp_map(
+	IN				net32_t						remote_qpn,
+	IN				net64_t						remote_ca_guid )
+{
+	return &gp_cep_mgr->conn_qp_map[
+		__conn_shard( remote_qpn, remote_ca_guid )];
+}
+
+
+static inline KSPIN_LOCK*
+__conn_id_lock(
+	IN				net32_t						remote_comm_id,
+	IN				net64_t						remote_ca_guid )
+{
+	return &gp_cep_mgr->conn_id_lock[
+		__conn_shard( remote_comm_id, remote_ca_guid )];
+}
+
+
+static inline KSPIN_LOCK*
+__conn_qp_lock(
+	IN				net32_t						remote_qpn,
+	IN				net64_t						remote_ca_guid )
+{
+	return &gp_cep_mgr->conn_qp_lock[
+		__conn_shard( remote_qpn, remote_ca_guid )];
+}
+
+
 /*
  * Lookup a CEP by remote comm ID and CA GUID.
  */
@@ -2716,14 +3107,16 @@ __lookup_by_id(
 	IN				net32_t						remote_comm_id,
 	IN				net64_t						remote_ca_guid )
 {
+	cl_rbmap_t			*p_map;
 	cl_rbmap_item_t		*p_item;
 	kcep_t			*p_cep;
 
 	AL_ENTER( AL_DBG_CM );
 
 	/* Match against pending connections using remote comm ID and CA GUID. */
-	p_item = cl_rbmap_root( &gp_cep_mgr->conn_id_map );
-	while( p_item != cl_rbmap_end( &gp_cep_mgr->conn_id_map ) )
+	p_map = __conn_id_map( remote_comm_id, remote_ca_guid );
+	p_item = cl_rbmap_root( p_map );
+	while( p_item != cl_rbmap_end( p_map ) )
 	{
 		p_cep = PARENT_STRUCT( p_item, kcep_t, rem_id_item );
 
@@ -2744,6 +3137,49 @@ __lookup_by_id(
 }
 
 
+/*
+ * Looks up a CEP by remote comm ID and CA GUID and returns it with its
+ * lock held.  The map shard lock ranks below CEP locks, so the CEP is
+ * revalidated through its local comm ID once its lock is taken.
+ */
+static kcep_t*
+__acquire_by_id(
+	IN				net32_t						remote_comm_id,
+	IN				net64_t						remote_ca_guid,
+		OUT			KLOCK_QUEUE_HANDLE* const	p_hdl )
+{
+	KLOCK_QUEUE_HANDLE	hdl;
+	kcep_t				*p_cep;
+	net32_t				local_comm_id;
+
+	CL_ASSERT( KeGetCurrentIrql() == DISPATCH_LEVEL );
+
+	for( ;; )
+	{
+		KeAcquireInStackQueuedSpinLockAtDpcLevel(
+			__conn_id_lock( remote_comm_id, remote_ca_guid ), &hdl );
+		p_cep = __lookup_by_id( remote_comm_id, remote_ca_guid );
+		if( p_cep )
+			local_comm_id = p_cep->local_comm_id;
+		KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
+
+		if( !p_cep )
+			return NULL;
+
+		KeAcquireInStackQueuedSpinLockAtDpcLevel(
+			__cep_lock( local_comm_id ), p_hdl );
+		p_cep = __lookup_cep( NULL, local_comm_id );
+		if( p_cep && p_cep->remote_comm_id == remote_comm_id &&
+			p_cep->remote_ca_guid == remote_ca_guid )
+		{
+			return p_cep;
+		}
+		/* Removed from the map meanwhile - look again. */
+		KeReleaseInStackQueuedSpinLockFromDpcLevel( p_hdl );
+	}
+}
+
+
 static intn_t
 __cm_rdma_req_cmp(
 	__in UINT64 mask,
@@ -2897,19 +3333,23 @@ match:
 }
 
 
+/* Called with the CEP's and the map shard's locks held. */
 static kcep_t*
 __insert_by_id(
 	IN				kcep_t* const				p_new_cep )
 {
 	kcep_t				*p_cep;
+	cl_rbmap_t			*p_map;
 	cl_rbmap_item_t		*p_item, *p_insert_at;
 	boolean_t			left = TRUE;
 
 	AL_ENTER( AL_DBG_CM );
 
-	p_item = cl_rbmap_root( &gp_cep_mgr->conn_id_map );
+	p_map = __conn_id_map(
+		p_new_cep->remote_comm_id, p_new_cep->remote_ca_guid );
+	p_item = cl_rbmap_root( p_map );
 	p_insert_at = p_item;
-	while( p_item != cl_rbmap_end( &gp_cep_mgr->conn_id_map ) )
+	while( p_item != cl_rbmap_end( p_map ) )
 	{
 		p_insert_at = p_item;
 		p_cep = PARENT_STRUCT( p_item, kcep_t, rem_id_item );
@@ -2930,8 +3370,7 @@ __insert_by_id(
 		}
 	}
 
-	cl_rbmap_insert(
-		&gp_cep_mgr->conn_id_map, p_insert_at, &p_new_cep->rem_id_item, left );
+	cl_rbmap_insert( p_map, p_insert_at, &p_new_cep->rem_id_item, left );
 	p_cep = p_new_cep;
 
 done:
@@ -2940,22 +3379,25 @@ done:
 }
 
 
+/* Called with the CEP's and the map shard's locks held. */
 static kcep_t*
 __insert_by_qpn(
 	IN				kcep_t* const				p_new_cep )
 {
 	kcep_t				*p_cep;
+	cl_rbmap_t			*p_map;
 	cl_rbmap_item_t		*p_item, *p_insert_at;
 	boolean_t			left = TRUE;
 
 	AL_ENTER( AL_DBG_CM );
 
-	p_item = cl_rbmap_root( &gp_cep_mgr->conn_qp_map );
+	p_map = __conn_qp_map( p_new_cep->remote_qpn, p_new_cep->remote_ca_guid );
+	p_item = cl_rbmap_root( p_map );
 	p_insert_at = p_item;
-	while( p_item != cl_rbmap_end( &gp_cep_mgr->conn_qp_map ) )
+	while( p_item != cl_rbmap_end( p_map ) )
 	{
 		p_insert_at = p_item;
-		p_cep = PARENT_STRUCT( p_item, kcep_t, rem_id_item );
+		p_cep = PARENT_STRUCT( p_item, kcep_t, rem_qp_item );
 
 		if( p_new_cep->remote_qpn < p_cep->remote_qpn )
 			p_item = cl_rbmap_left( p_item ), left = TRUE;
@@ -2973,8 +3415,7 @@ __insert_by_qpn(
 		}
 	}
 
-	cl_rbmap_insert(
-		&gp_cep_mgr->conn_qp_map, p_insert_at, &p_new_cep->rem_qp_item, left );
+	cl_rbmap_insert( p_map, p_insert_at, &p_new_cep->rem_qp_item, left );
 	p_cep = p_new_cep;
 
 done:
@@ -2983,23 +3424,47 @@ done:
 }
 
 
-static inline kcep_t*
+/*
+ * Inserts a CEP in the remote comm ID and QPN maps.  Called with the CEP's
+ * lock held.  Returns FALSE if either key is already in use; the CEP is
+ * then left out of both maps and *p_stale_id is set to the local comm ID
+ * of the CEP holding the remote QPN, or to zero if the remote comm ID was
+ * taken (a duplicate of a message already being processed).  The CEP it
+ * collided with can only be used after taking its lock and looking it up
+ * again by that comm ID.
+ */
+static boolean_t
 __insert_cep(
-	IN				kcep_t* const				p_new_cep )
+	IN				kcep_t* const				p_new_cep,
+		OUT			net32_t* const				p_stale_id )
 {
 	kcep_t				*p_cep;
+	KLOCK_QUEUE_HANDLE	hdl;
 
 	AL_ENTER( AL_DBG_CM );
 
-	p_cep = __insert_by_qpn( p_new_cep );
+	*p_stale_id = 0;
+
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( __conn_id_lock(
+		p_new_cep->remote_comm_id, p_new_cep->remote_ca_guid ), &hdl );
+	p_cep = __insert_by_id( p_new_cep );
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 	if( p_cep != p_new_cep )
 		goto err;
 
-	p_cep = __insert_by_id( p_new_cep );
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( __conn_qp_lock(
+		p_new_cep->remote_qpn, p_new_cep->remote_ca_guid ), &hdl );
+	p_cep = __insert_by_qpn( p_new_cep );
+	if( p_cep != p_new_cep )
+		*p_stale_id = p_cep->local_comm_id;
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 	if( p_cep != p_new_cep )
 	{
-		cl_rbmap_remove_item(
-			&gp_cep_mgr->conn_qp_map, &p_new_cep->rem_qp_item );
+		KeAcquireInStackQueuedSpinLockAtDpcLevel( __conn_id_lock(
+			p_new_cep->remote_comm_id, p_new_cep->remote_ca_guid ), &hdl );
+		cl_rbmap_remove_item( __conn_id_map( p_new_cep->remote_comm_id,
+			p_new_cep->remote_ca_guid ), &p_new_cep->rem_id_item );
+		KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 err:
 		/*
 		 * Clear the remote QPN and comm ID so that we don't try
@@ -3007,30 +3472,41 @@ err:
 		 */
 		p_new_cep->remote_qpn = 0;
 		p_new_cep->remote_comm_id = 0;
+		AL_EXIT( AL_DBG_CM );
+		return FALSE;
 	}
 
 	AL_EXIT( AL_DBG_CM );
-	return p_cep;
+	return TRUE;
 }
 
 
+/* Called with the CEP's lock held. */
 static inline void
 __remove_cep(
 	IN				kcep_t* const				p_cep )
 {
+	KLOCK_QUEUE_HANDLE	hdl;
+
 	AL_ENTER( AL_DBG_CM );
 
 	if( p_cep->remote_comm_id )
 	{
-		cl_rbmap_remove_item(
-			&gp_cep_mgr->conn_id_map, &p_cep->rem_id_item );
+		KeAcquireInStackQueuedSpinLockAtDpcLevel( __conn_id_lock(
+			p_cep->remote_comm_id, p_cep->remote_ca_guid ), &hdl );
+		cl_rbmap_remove_item( __conn_id_map( p_cep->remote_comm_id,
+			p_cep->remote_ca_guid ), &p_cep->rem_id_item );
 		p_cep->remote_comm_id = 0;
+		KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 	}
 	if( p_cep->remote_qpn )
 	{
-		cl_rbmap_remove_item(
-			&gp_cep_mgr->conn_qp_map, &p_cep->rem_qp_item );
+		KeAcquireInStackQueuedSpinLockAtDpcLevel( __conn_qp_lock(
+			p_cep->remote_qpn, p_cep->remote_ca_guid ), &hdl );
+		cl_rbmap_remove_item( __conn_qp_map( p_cep->remote_qpn,
+			p_cep->remote_ca_guid ), &p_cep->rem_qp_item );
 		p_cep->remote_qpn = 0;
+		KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 	}
 
 	AL_EXIT( AL_DBG_CM );
@@ -3229,15 +3705,18 @@ __min_timewait(
 
 
 /*
- * Timer callback to process CEPs in timewait state.  Returns time in ms.
+ * Processes a list of CEPs taken off the timewait list.  CEPs still in
+ * timewait are put back on it.  Returns time in ms.
  */
 static uint32_t
-__process_timewait()
+__process_timewait(
+	IN				cl_qlist_t* const			p_list )
 {
 	cl_list_item_t		*p_item;
 	kcep_t				*p_cep;
 	LARGE_INTEGER		timeout;
 	int64_t				min_timewait = 0;
+	KLOCK_QUEUE_HANDLE	hdl, tw_hdl;
 
 	AL_ENTER( AL_DBG_CM );
 
@@ -3245,11 +3724,16 @@ __process_timewait()
 
 	timeout.QuadPart = 0;
 
-	p_item = cl_qlist_head( &gp_cep_mgr->timewait_list );
-	while( p_item != cl_qlist_end( &gp_cep_mgr->timewait_list ) )
+	/*
+	 * CEPs on the list can't be destroyed by anyone else - only this
+	 * function frees CEPs in timewait.
+	 */
+	while( (p_item = cl_qlist_remove_head( p_list )) != cl_qlist_end( p_list ) )
 	{
 		p_cep = PARENT_STRUCT( p_item, kcep_t, timewait_item );
-		p_item = cl_qlist_next( p_item );
+
+		KeAcquireInStackQueuedSpinLockAtDpcLevel(
+			__cep_lock( p_cep->cid ), &hdl );
 
 		CL_ASSERT( p_cep->state == CEP_STATE_DESTROY ||
 			p_cep->state == CEP_STATE_TIMEWAIT );
@@ -3257,23 +3741,23 @@ __process_timewait()
 		CL_ASSERT( !p_cep->p_mad );
 
 		if( KeWaitForSingleObject( &p_cep->timewait_timer, Executive,
-			KernelMode, FALSE, &timeout ) != STATUS_SUCCESS )
-		{
-			/* Still in timewait - try again next time. */
-			min_timewait = __min_timewait( min_timewait, p_cep );
-			continue;
-		}
-
-		if( p_cep->ref_cnt )
+			KernelMode, FALSE, &timeout ) != STATUS_SUCCESS ||
+			p_cep->ref_cnt )
 		{
-			/* Send outstanding or destruction in progress. */
+			/*
+			 * Still in timewait, or send outstanding or destruction in
+			 * progress - try again next time.
+			 */
 			min_timewait = __min_timewait( min_timewait, p_cep );
+			KeAcquireInStackQueuedSpinLockAtDpcLevel(
+				&gp_cep_mgr->timewait_lock, &tw_hdl );
+			cl_qlist_insert_tail(
+				&gp_cep_mgr->timewait_list, &p_cep->timewait_item );
+			KeReleaseInStackQueuedSpinLockFromDpcLevel( &tw_hdl );
+			KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 			continue;
 		}
 
-		/* Remove from the timewait list. */
-		cl_qlist_remove_item( &gp_cep_mgr->timewait_list, &p_cep->timewait_item );
-
 		/*
 		 * Not in timewait.  Remove the CEP from the maps - it should
 		 * no longer be matched against.
@@ -3289,6 +3773,7 @@ __process_timewait()
 			/* Move the CEP to the IDLE state so that it can be used again. */
 			p_cep->state = CEP_STATE_IDLE;
 		}
+		KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 	}
 
 	AL_EXIT( AL_DBG_CM );
@@ -3296,6 +3781,23 @@ __process_timewait()
 }
 
 
+/*
+ * Moves the timewait list to p_list so that its CEPs can be processed
+ * while taking their locks.
+ */
+static void
+__take_timewait_list(
+		OUT			cl_qlist_t* const			p_list )
+{
+	KLOCK_QUEUE_HANDLE	hdl;
+
+	cl_qlist_init( p_list );
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->timewait_lock, &hdl );
+	cl_qlist_insert_list_tail( p_list, &gp_cep_mgr->timewait_list );
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
+}
+
+
 /*
  * Timer callback to process CEPs in timewait state.
  */
@@ -3304,6 +3806,7 @@ __cep_timewait_cb(
 	IN				void						*context )
 {
 	KLOCK_QUEUE_HANDLE	hdl;
+	cl_qlist_t			list;
 	uint32_t			min_timewait;
 
 	AL_ENTER( AL_DBG_CM );
@@ -3312,10 +3815,10 @@ __cep_timewait_cb(
 
 	CL_ASSERT( KeGetCurrentIrql() == DISPATCH_LEVEL );
 
-	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->lock, &hdl );
-
-	min_timewait = __process_timewait();
+	__take_timewait_list( &list );
+	min_timewait = __process_timewait( &list );
 
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->timewait_lock, &hdl );
 	if( cl_qlist_count( &gp_cep_mgr->timewait_list ) )
 	{
 		/*
@@ -3324,7 +3827,6 @@ __cep_timewait_cb(
 		 */
 		cl_timer_trim( &gp_cep_mgr->timewait_timer, min_timewait );
 	}
-
 	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 
 	AL_EXIT( AL_DBG_CM );
@@ -3339,10 +3841,12 @@ __destroying_cep_mgr(
 	IN				al_obj_t*					p_obj )
 {
 	ib_api_status_t		status;
+	KIRQL				irql;
 	KLOCK_QUEUE_HANDLE	hdl;
 	cl_list_item_t		*p_item;
 	kcep_t				*p_cep;
 	LARGE_INTEGER		timeout;
+	cl_qlist_t			list;
 
 	AL_ENTER( AL_DBG_CM );
 
@@ -3365,7 +3869,8 @@ __destroying_cep_mgr(
 
 	/* Cancel all timewait timers. */
 	timeout.QuadPart = 0;
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	irql = KeRaiseIrqlToDpcLevel();
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->timewait_lock, &hdl );
 	for( p_item = cl_qlist_head( &gp_cep_mgr->timewait_list );
 		p_item != cl_qlist_end( &gp_cep_mgr->timewait_list );
 		p_item = cl_qlist_next( p_item ) )
@@ -3373,8 +3878,10 @@ __destroying_cep_mgr(
 		p_cep = PARENT_STRUCT( p_item, kcep_t, timewait_item );
 		KeSetTimer( &p_cep->timewait_timer, timeout, NULL );
 	}
-	__process_timewait();
-	KeReleaseInStackQueuedSpinLock( &hdl );
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
+	__take_timewait_list( &list );
+	__process_timewait( &list );
+	KeLowerIrql( irql );
 
 	AL_EXIT( AL_DBG_CM );
 }
@@ -3387,16 +3894,22 @@ static void
 __free_cep_mgr(
 	IN				al_obj_t*					p_obj )
 {
+	uint32_t			i;
+
 	AL_ENTER( AL_DBG_CM );
 
 	CL_ASSERT( &gp_cep_mgr->obj == p_obj );
 	/* All listen request should have been cleaned up by this point. */
 	CL_ASSERT( cl_is_rbmap_empty( &gp_cep_mgr->listen_map ) );
 	/* All connections should have been cancelled/disconnected by now. */
-	CL_ASSERT( cl_is_rbmap_empty( &gp_cep_mgr->conn_id_map ) );
-	CL_ASSERT( cl_is_rbmap_empty( &gp_cep_mgr->conn_qp_map ) );
+	for( i = 0; i < CEP_MAP_SHARDS; i++ )
+	{
+		CL_ASSERT( cl_is_rbmap_empty( &gp_cep_mgr->conn_id_map[i] ) );
+		CL_ASSERT( cl_is_rbmap_empty( &gp_cep_mgr->conn_qp_map[i] ) );
+	}
 
-	cl_vector_destroy( &gp_cep_mgr->cid_vector );
+	for( i = 0; i < gp_cep_mgr->cid_chunks; i++ )
+		cl_free( gp_cep_mgr->cid_dir[i] );
 
 	cl_timer_destroy( &gp_cep_mgr->timewait_timer );
 
@@ -3414,25 +3927,6 @@ __free_cep_mgr(
 }
 
 
-static cl_status_t
-__cid_init(
-	IN		void* const						p_element,
-	IN		void*							context )
-{
-	cep_cid_t		*p_cid;
-
-	UNUSED_PARAM( context );
-
-	p_cid = (cep_cid_t*)p_element;
-
-	p_cid->h_al = NULL;
-	p_cid->p_cep = (kcep_t*)(uintn_t)++gp_cep_mgr->free_cid;
-	p_cid->modifier = 0;
-
-	return CL_SUCCESS;
-}
-
-
 /*
  * Allocates and initialized the global CM agent.
  */
@@ -3441,8 +3935,8 @@ create_cep_mgr(
 	IN				al_obj_t* const				p_parent_obj )
 {
 	ib_api_status_t		status;
-	cl_status_t			cl_status;
 	ib_pnp_req_t		pnp_req;
+	uint32_t			i;
 
 	AL_ENTER( AL_DBG_CM );
 
@@ -3460,14 +3954,26 @@ create_cep_mgr(
 	construct_al_obj( &gp_cep_mgr->obj, AL_OBJ_TYPE_CM );
 	ExInitializeNPagedLookasideList( &gp_cep_mgr->cep_pool, NULL, NULL,
 		0, sizeof(kcep_t), 'PECK', 0 );
+	KeInitializeSpinLock( &gp_cep_mgr->port_lock );
 	cl_qmap_init( &gp_cep_mgr->port_map );
+	for( i = 0; i < CEP_LOCK_STRIPES; i++ )
+		KeInitializeSpinLock( &gp_cep_mgr->cep_lock[i] );
+	KeInitializeSpinLock( &gp_cep_mgr->cid_grow_lock );
+	/* The CID table is grown on first use. */
+	gp_cep_mgr->free_head = CEP_CID_NONE;
+	KeInitializeSpinLock( &gp_cep_mgr->listen_lock );
 	cl_rbmap_init( &gp_cep_mgr->listen_map );
-	cl_rbmap_init( &gp_cep_mgr->conn_id_map );
-	cl_rbmap_init( &gp_cep_mgr->conn_qp_map );
+	for( i = 0; i < CEP_MAP_SHARDS; i++ )
+	{
+		KeInitializeSpinLock( &gp_cep_mgr->conn_id_lock[i] );
+		cl_rbmap_init( &gp_cep_mgr->conn_id_map[i] );
+		KeInitializeSpinLock( &gp_cep_mgr->conn_qp_lock[i] );
+		cl_rbmap_init( &gp_cep_mgr->conn_qp_map[i] );
+	}
+	KeInitializeSpinLock( &gp_cep_mgr->timewait_lock );
 	cl_qlist_init( &gp_cep_mgr->timewait_list );
 	/* Timer initialization can't fail in kernel-mode. */
 	cl_timer_init( &gp_cep_mgr->timewait_timer, __cep_timewait_cb, NULL );
-	cl_vector_construct( &gp_cep_mgr->cid_vector );
 
 	status = init_al_obj( &gp_cep_mgr->obj, NULL, FALSE,
 		__destroying_cep_mgr, NULL, __free_cep_mgr );
@@ -3488,19 +3994,6 @@ create_cep_mgr(
 		return status;
 	}
 
-	cl_status = cl_vector_init( &gp_cep_mgr->cid_vector,
-		CEP_CID_MIN, CEP_CID_GROW, sizeof(cep_cid_t), __cid_init, NULL, NULL );
-	if( cl_status != CL_SUCCESS )
-	{
-		gp_cep_mgr->obj.pfn_destroy( &gp_cep_mgr->obj, NULL );
-		AL_PRINT_EXIT( TRACE_LEVEL_ERROR, AL_DBG_ERROR,
-			("cl_vector_init failed with status %#x.\n",
-			cl_status) );
-		return ib_convert_cl_status( cl_status );
-	}
-
-	gp_cep_mgr->free_cid = 1;
-
 	/* Register for port PnP notifications. */
 	cl_memclr( &pnp_req, sizeof(pnp_req) );
 	pnp_req.pnp_class = IB_PNP_PORT;
@@ -3666,7 +4159,10 @@ __calc_mad_timeout(
 }
 
 
-/* CEP manager lock is held when calling this function. */
+/*
+ * Called without locks - the new CEP is not visible to lookups until it is
+ * bound, which must be done with its lock held.
+ */
 static kcep_t*
 __create_cep()
 {
@@ -3753,18 +4249,17 @@ kal_cep_alloc(
 	kcep_t				*p_cep;
 	KLOCK_QUEUE_HANDLE	hdl;
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
 	p_cep = __create_cep();
-	KeReleaseInStackQueuedSpinLock( &hdl );
-
 	if( !p_cep )
 	{
 		AL_PRINT( TRACE_LEVEL_ERROR, AL_DBG_ERROR, ("Failed\n") );
 		return IB_INSUFFICIENT_MEMORY;
 	}
 
+	KeAcquireInStackQueuedSpinLock( __cep_lock( p_cep->cid ), &hdl );
 	__bind_cep(p_cep, h_al, NULL, NULL);
 	*p_cid = p_cep->cid;
+	KeReleaseInStackQueuedSpinLock( &hdl );
 	AL_PRINT( TRACE_LEVEL_VERBOSE, AL_DBG_CM, ("allocated CID = %d\n", p_cep->cid) );
 	return IB_SUCCESS;
 }
@@ -3780,7 +4275,7 @@ kal_cep_config(
 	kcep_t				*p_cep;
 	KLOCK_QUEUE_HANDLE	hdl;
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( p_cep == NULL )
 	{
@@ -3857,21 +4352,25 @@ __calc_timewait(
 }
 
 
-/* Called with CEP manager and CEP locks held. */
+/* Called with the CEP's lock held. */
 static inline void
 __insert_timewait(
 	IN				kcep_t* const				p_cep )
 {
-	cl_qlist_insert_tail( &gp_cep_mgr->timewait_list, &p_cep->timewait_item );
+	KLOCK_QUEUE_HANDLE	hdl;
 
 	KeSetTimer( &p_cep->timewait_timer, p_cep->timewait_time, NULL );
 
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->timewait_lock, &hdl );
+	cl_qlist_insert_tail( &gp_cep_mgr->timewait_list, &p_cep->timewait_item );
+
 	/*
 	 * Reset the timer for half of the shortest timeout - this results
 	 * in a worst case timeout of 150% of timewait.
 	 */
 	cl_timer_trim( &gp_cep_mgr->timewait_timer,
 		(uint32_t)(-p_cep->timewait_time.QuadPart / 20000) );
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 }
 
 
@@ -4048,25 +4547,48 @@ __drep_cep(
 }
 
 
-static inline void
-__cleanup_mad_list(
+/*
+ * Detaches the pending MAD list of a CEP.  Called with the CEP's lock held.
+ * REQs queued on a listen reference the new CEPs created for them, which
+ * are guarded by their own locks, so the list of a listen must be passed
+ * to __cleanup_mad_list only after releasing the listen's lock.
+ */
+static inline ib_mad_element_t*
+__detach_mad_list(
 	IN				kcep_t* const				p_cep )
+{
+	ib_mad_element_t	*p_mad_head;
+
+	p_mad_head = p_cep->p_mad_head;
+	p_cep->p_mad_head = NULL;
+	p_cep->p_mad_tail = NULL;
+	return p_mad_head;
+}
+
+
+static void
+__cleanup_mad_list(
+	IN				ib_mad_element_t*			p_mad_head )
 {
 	ib_mad_element_t	*p_mad;
 	kcep_t				*p_new_cep;
+	KLOCK_QUEUE_HANDLE	hdl;
 
 	/* Cleanup the pending MAD list. */
-	while( p_cep->p_mad_head )
+	while( p_mad_head )
 	{
-		p_mad = p_cep->p_mad_head;
-		p_cep->p_mad_head = p_mad->p_next;
+		p_mad = p_mad_head;
+		p_mad_head = p_mad->p_next;
 		p_mad->p_next = NULL;
 		if( p_mad->send_context1 )
 		{
 			p_new_cep = (kcep_t*)p_mad->send_context1;
 
+			KeAcquireInStackQueuedSpinLock(
+				__cep_lock( p_new_cep->cid ), &hdl );
 			__unbind_cep( p_new_cep );
 			__cleanup_cep( p_new_cep );
+			KeReleaseInStackQueuedSpinLock( &hdl );
 		}
 		ib_put_mad( p_mad );
 	}
@@ -4077,9 +4599,13 @@ static void
 __cancel_listen(
 	IN				kcep_t* const				p_cep )
 {
+	KLOCK_QUEUE_HANDLE	hdl;
+
 	CL_ASSERT( p_cep->state == CEP_STATE_LISTEN );
 	/* Remove from listen map. */
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->listen_lock, &hdl );
 	cl_rbmap_remove_item( &gp_cep_mgr->listen_map, &p_cep->listen_item );
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( &hdl );
 
 	if( p_cep->p_cmp_buf )
 	{
@@ -4104,8 +4630,11 @@ __cleanup_cep(
 	CL_ASSERT( p_cep->state != CEP_STATE_DESTROY &&
 		p_cep->state != CEP_STATE_DREQ_DESTROY );
 
-	/* Cleanup the pending MAD list. */
-	__cleanup_mad_list( p_cep );
+	/*
+	 * Cleanup the pending MAD list.  Callers detach the list of a listen
+	 * beforehand, so none of these MADs references a new CEP.
+	 */
+	__cleanup_mad_list( __detach_mad_list( p_cep ) );
 
 	switch( p_cep->state )
 	{
@@ -4199,16 +4728,11 @@ __destroy_cep(
 {
 	AL_ENTER( AL_DBG_CM );
 
-	CL_ASSERT(
-		p_cep->cid < cl_vector_get_size( &gp_cep_mgr->cid_vector ) );
-
-	CL_ASSERT( p_cep->p_cid == (cep_cid_t*)cl_vector_get_ptr(
-		&gp_cep_mgr->cid_vector, p_cep->cid ) );
+	CL_ASSERT( p_cep->p_cid == __cid_entry( p_cep->cid ) );
 
 	/* Free the CID. */
-	p_cep->p_cid->p_cep = (kcep_t*)(uintn_t)gp_cep_mgr->free_cid;
 	p_cep->p_cid->h_al = NULL;
-	gp_cep_mgr->free_cid = p_cep->cid;
+	__push_free_cids( p_cep->cid, p_cep->p_cid );
 
 	KeCancelTimer( &p_cep->timewait_timer );
 
@@ -4256,6 +4780,7 @@ al_destroy_cep(
 	void				*context;
     ib_pfn_destroy_cb_t pfn_destroy_cb;
 	int32_t				ref_cnt;
+	ib_mad_element_t	*p_mad_head;
 
 	AL_PRINT( TRACE_LEVEL_VERBOSE, AL_DBG_CM,("[ CID = %d\n", *p_cid) );
 
@@ -4265,8 +4790,8 @@ al_destroy_cep(
 	 * Remove the CEP from the CID vector - no further API calls
 	 * will succeed for it.
 	 */
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
 	cid = *p_cid;
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -4286,6 +4811,7 @@ al_destroy_cep(
 	__cep_complete_irp( p_cep, STATUS_CANCELLED, IO_NO_INCREMENT );
 
 	__unbind_cep( p_cep );
+	p_mad_head = __detach_mad_list( p_cep );
 	ref_cnt = __cleanup_cep( p_cep );
     if( reusable )
         *p_cid = AL_INVALID_CID;
@@ -4294,6 +4820,8 @@ al_destroy_cep(
 
 	KeReleaseInStackQueuedSpinLock( &hdl );
 
+	__cleanup_mad_list( p_mad_head );
+
 	if( !ref_cnt && pfn_destroy_cb )
 		pfn_destroy_cb( context );
 
@@ -4315,8 +4843,9 @@ kal_cep_destroy(
     ib_pfn_destroy_cb_t pfn_destroy_cb;
 	void				*context;
 	int32_t				ref_cnt;
+	ib_mad_element_t	*p_mad_head;
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	CL_ASSERT( p_cep );
 
@@ -4331,9 +4860,12 @@ kal_cep_destroy(
 	{
 		p_cep->state = CEP_STATE_IDLE;
 	}
+	p_mad_head = __detach_mad_list( p_cep );
 	ref_cnt = __cleanup_cep( p_cep );
 	KeReleaseInStackQueuedSpinLock( &hdl );
 
+	__cleanup_mad_list( p_mad_head );
+
 	if( !ref_cnt && pfn_destroy_cb )
 		pfn_destroy_cb( context );
 }
@@ -4346,8 +4878,9 @@ kal_cep_cancel_listen(
 {
 	KLOCK_QUEUE_HANDLE	hdl;
 	kcep_t				*p_cep;
+	ib_mad_element_t	*p_mad_head;
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( p_cep == NULL )
 	{
@@ -4355,11 +4888,13 @@ kal_cep_cancel_listen(
 		return IB_INVALID_HANDLE;
 	}
 
-	__cleanup_mad_list( p_cep );
+	p_mad_head = __detach_mad_list( p_cep );
 	__cancel_listen( p_cep );
 	p_cep->state = CEP_STATE_IDLE;
 
 	KeReleaseInStackQueuedSpinLock( &hdl );
+
+	__cleanup_mad_list( p_mad_head );
 	return STATUS_SUCCESS;
 }
 
@@ -4375,7 +4910,7 @@ al_cep_listen(
 	cl_rbmap_item_t		*p_item, *p_insert_at;
 	boolean_t			left = TRUE;
 	intn_t				cmp;
-	KLOCK_QUEUE_HANDLE	hdl;
+	KLOCK_QUEUE_HANDLE	hdl, listen_hdl;
 	ib_cm_rdma_req_t*	p_rdma_req = (ib_cm_rdma_req_t*)p_listen_info->p_cmp_buf;
 
 	AL_PRINT( TRACE_LEVEL_VERBOSE, AL_DBG_CM, ("[ CID = %d\n", cid) );
@@ -4383,7 +4918,7 @@ al_cep_listen(
 	CL_ASSERT( h_al );
 	CL_ASSERT( p_listen_info );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -4429,6 +4964,7 @@ al_cep_listen(
 	}
 
 	/* Insert the CEP into the listen map. */
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( &gp_cep_mgr->listen_lock, &listen_hdl );
 	p_item = cl_rbmap_root( &gp_cep_mgr->listen_map );
 	p_insert_at = p_item;
 	while( p_item != cl_rbmap_end( &gp_cep_mgr->listen_map ) )
@@ -4510,6 +5046,7 @@ pdata_cmp:
 	if( p_item != cl_rbmap_end( &gp_cep_mgr->listen_map ) )
 	{
 		/* Duplicate!!! */
+		KeReleaseInStackQueuedSpinLockFromDpcLevel( &listen_hdl );
 		status = IB_INVALID_SETTING;
 		goto done;
 	}
@@ -4520,6 +5057,7 @@ pdata_cmp:
 		p_cep->p_cmp_buf = cl_malloc( p_listen_info->cmp_len );
 		if( !p_cep->p_cmp_buf )
 		{
+			KeReleaseInStackQueuedSpinLockFromDpcLevel( &listen_hdl );
 			AL_PRINT( TRACE_LEVEL_ERROR, AL_DBG_ERROR,
 				("Failed to allocate compare buffer.\n") );
 			status = IB_INSUFFICIENT_MEMORY;
@@ -4537,6 +5075,7 @@ pdata_cmp:
 
 	cl_rbmap_insert( &gp_cep_mgr->listen_map, p_insert_at,
 		&p_cep->listen_item, left );
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( &listen_hdl );
 
 	status = IB_SUCCESS;
 
@@ -4889,7 +5428,7 @@ kal_cep_pre_req(
 	CL_ASSERT( h_al );
 	CL_ASSERT( p_cm_req );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -5001,7 +5540,7 @@ al_cep_send_req(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -5277,7 +5816,7 @@ al_cep_pre_rep(
 	rep.rnr_retry_cnt = p_cm_rep->rnr_retry_cnt;
 	rep.srq = (uint8_t) (p_cm_rep->h_qp->h_srq != NULL);
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if (!p_cep )
 	{
@@ -5317,7 +5856,7 @@ kal_cep_pre_rep(
 	CL_ASSERT( h_al );
 	CL_ASSERT( p_cm_rep );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -5347,7 +5886,7 @@ al_cep_send_rep(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -5443,7 +5982,7 @@ al_cep_rtu(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -5506,7 +6045,7 @@ al_cep_rej(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -5600,7 +6139,7 @@ al_cep_mra(
 	CL_ASSERT( h_al );
 	CL_ASSERT( p_cm_mra );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -5738,7 +6277,7 @@ al_cep_lap(
 	CL_ASSERT( p_cm_lap );
 	CL_ASSERT( p_cm_lap->p_alt_path );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -5869,7 +6408,7 @@ al_cep_pre_apr(
 	CL_ASSERT( p_cm_apr );
 	CL_ASSERT( p_apr );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -5955,7 +6494,7 @@ al_cep_send_apr(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6014,7 +6553,7 @@ al_cep_dreq(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6084,7 +6623,7 @@ al_cep_drep(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6135,7 +6674,7 @@ al_cep_migrate(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6187,7 +6726,7 @@ al_cep_established(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6329,7 +6868,7 @@ kal_cep_format_event(
 	
 	switch (p_mad->p_mad_buf->attr_id) {
 	case CM_REQ_ATTR_ID:
-		KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+		KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 		p_cep = __lookup_cep( h_al, cid );
 		if (p_mad->status == IB_SUCCESS && p_cep != NULL) {
 			p_event->type = iba_cm_req_received;
@@ -6416,7 +6955,7 @@ al_cep_get_init_attr(
 
 	AL_ENTER( AL_DBG_CM );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6468,7 +7007,7 @@ al_cep_get_rtr_attr(
 	CL_ASSERT( h_al );
 	CL_ASSERT( p_rtr );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6540,7 +7079,7 @@ al_cep_get_rts_attr(
 	CL_ASSERT( h_al );
 	CL_ASSERT( p_rts );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6613,7 +7152,7 @@ al_cep_get_timewait(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6647,7 +7186,7 @@ al_cep_poll(
 	CL_ASSERT( p_new_cid );
 	CL_ASSERT( pp_mad );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6707,7 +7246,7 @@ __cep_cancel_irp(
 	h_al = (ib_al_handle_t)p_irp->Tail.Overlay.DriverContext[1];
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( p_cep )
 		__cep_complete_irp( p_cep, STATUS_CANCELLED, IO_NO_INCREMENT );
@@ -6734,7 +7273,7 @@ al_cep_queue_irp(
 	CL_ASSERT( h_al );
 	CL_ASSERT( p_irp );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6805,41 +7344,6 @@ al_cep_cleanup_al(
 	AL_EXIT( AL_DBG_CM );
 }
 
-#ifdef NTDDI_WIN8
-_IRQL_requires_max_(DISPATCH_LEVEL)
-_IRQL_requires_min_(DISPATCH_LEVEL)
-__drv_at(p_irp->CancelIrql, __drv_restoresIRQL)
-#endif
-static void
-__cep_cancel_ndi_irp(
-	IN				DEVICE_OBJECT*				p_dev_obj,
-	IN				IRP*						p_irp )
-{
-	KLOCK_QUEUE_HANDLE		hdl;
-
-	AL_ENTER( AL_DBG_CM );
-
-	UNUSED_PARAM( p_dev_obj );
-	CL_ASSERT( p_irp );
-
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
-	RemoveEntryList( &p_irp->Tail.Overlay.ListEntry );
-	KeReleaseInStackQueuedSpinLock( &hdl );
-
-#pragma warning(push, 3)
-	IoSetCancelRoutine( p_irp, NULL );
-#pragma warning(pop)
-	IoReleaseCancelSpinLock( p_irp->CancelIrql );
-		
-	/* Complete the IRP. */
-	p_irp->IoStatus.Status = STATUS_CANCELLED;
-	p_irp->IoStatus.Information = 0;
-	IoCompleteRequest( p_irp, IO_NO_INCREMENT );
-
-	AL_EXIT( AL_DBG_CM );
-}
-
-
 NTSTATUS
 al_cep_get_pdata(
 	IN				ib_al_handle_t				h_al,
@@ -6857,7 +7361,7 @@ al_cep_get_pdata(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
@@ -6912,7 +7416,7 @@ kal_cep_get_context(
 
 	CL_ASSERT( h_al );
 
-	KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->lock, &hdl );
+	KeAcquireInStackQueuedSpinLock( __cep_lock( cid ), &hdl );
 	p_cep = __lookup_cep( h_al, cid );
 	if( !p_cep )
 	{
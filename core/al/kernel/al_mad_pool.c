@@ -767,6 +767,7 @@ get_mad_send(
 	p_mad_send->mad_send.retry_cnt = 0;
 	p_mad_send->mad_send.retry_time = 0;
 	p_mad_send->mad_send.delay = 0;
+	p_mad_send->mad_send.p_timer_slot = NULL;
 	p_mad_send->h_pool = p_mad_item->pool_key->h_pool;
 
 	ref_al_obj( &p_mad_item->pool_key->h_pool->obj );
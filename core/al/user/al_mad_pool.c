@@ -1256,6 +1256,7 @@ get_mad_send(
 	h_send->h_av = NULL;
 	h_send->retry_cnt = 0;
 	h_send->retry_time = 0;
+	h_send->p_timer_slot = NULL;
 
 	return h_send;
 }
@@ -1388,6 +1388,8 @@ __set_ifc(
 	
 	p_ifc->open_al_trk = ib_open_al_trk;
 
+	p_ifc->modify_cq_moder = ib_modify_cq_moderation;
+
     p_ifc->ibat_register = IbatRegister;
     p_ifc->ibat_deregister = IbatDeregister;
     p_ifc->ibat_update_reg = IbatUpdateRegistration;
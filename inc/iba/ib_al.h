@@ -1953,7 +1953,54 @@ ib_modify_cq(
 *	operation is aborted.
 *
 * SEE ALSO
-*	ib_create_cq
+*	ib_create_cq, ib_modify_cq_moderation
+*****/
+
+
+/****f* Access Layer/ib_modify_cq_moderation
+* NAME
+*	ib_modify_cq_moderation
+*
+* DESCRIPTION
+*	Modifies the interrupt moderation of a completion queue.
+*
+* SYNOPSIS
+*/
+AL_EXPORT ib_api_status_t AL_API
+ib_modify_cq_moderation(
+	IN		const	ib_cq_handle_t				h_cq,
+	IN				uint16_t					moder_cnt,
+	IN				uint16_t					moder_time );
+/*
+* PARAMETERS
+*	h_cq
+*		[in] A handle to an existing completion queue.
+*
+*	moder_cnt
+*		[in] Number of completions the channel adapter may coalesce before
+*		generating a completion event.  Zero disables count based moderation.
+*
+*	moder_time
+*		[in] Time, in microseconds, that the channel adapter may delay a
+*		completion event.  Zero disables time based moderation.
+*
+* RETURN VALUES
+*	IB_SUCCESS
+*		The completion queue moderation was successfully modified.
+*
+*	IB_INVALID_CQ_HANDLE
+*		The completion queue handle was invalid.
+*
+*	IB_UNSUPPORTED
+*		The channel adapter does not support completion queue moderation.
+*
+* NOTES
+*	A completion event is generated when either limit is reached.  The call
+*	may issue a command to the channel adapter and must be made at
+*	PASSIVE_LEVEL.  It is only supported by kernel mode clients.
+*
+* SEE ALSO
+*	ib_create_cq, ib_modify_cq, ib_rearm_cq
 *****/
 
 
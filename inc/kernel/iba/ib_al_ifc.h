@@ -47,7 +47,7 @@
 *	IB resources provided by HCAs.
 *********/
 
-#define AL_INTERFACE_VERSION		(19)
+#define AL_INTERFACE_VERSION		(20)
 
 
 
@@ -202,6 +202,12 @@ typedef ib_api_status_t
 	IN		const	ib_cq_handle_t				h_cq,
 	IN	OUT			uint32_t* const				p_size );
 
+typedef ib_api_status_t
+(*ib_pfn_modify_cq_moder_t)(
+	IN		const	ib_cq_handle_t				h_cq,
+	IN				uint16_t					moder_cnt,
+	IN				uint16_t					moder_time );
+
 typedef ib_api_status_t
 (*ib_pfn_query_cq_t)(
 	IN		const	ib_cq_handle_t				h_cq,
@@ -836,6 +842,8 @@ typedef struct _ib_al_ifc
 	ib_pfn_mcast_mgr_request_release_t	mcast_mgr_request_release;
 
 	ib_pfn_open_al_trk_t		open_al_trk;
+
+	ib_pfn_modify_cq_moder_t	modify_cq_moder;
 		
 }	ib_al_ifc_t;
 
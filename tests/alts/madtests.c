@@ -47,6 +47,7 @@
 #include <iba/ib_al.h>
 #include <complib/cl_memory.h>
 #include <complib/cl_thread.h>
+#include <complib/cl_atomic.h>
 #include <alts_debug.h>
 #include <alts_common.h>
 
@@ -120,6 +121,13 @@ typedef struct _alts_mad_ca_obj
 	boolean_t			is_loopback;
 	boolean_t			reply_requested;
 
+	/* stress test completion counts */
+	atomic32_t			stress_success;
+	atomic32_t			stress_timeout;
+	atomic32_t			stress_canceled;
+	atomic32_t			stress_error;
+	atomic32_t			stress_resp;
+
 } alts_mad_ca_obj_t;
 
 
@@ -256,6 +264,23 @@ alts_qp0_ping_switch (
 	ib_ca_handle_t	h_ca,
 	uint32_t		ca_attr_size );
 
+ib_api_status_t
+alts_qp1_stress(
+	ib_ca_handle_t	h_ca,
+	uint32_t		ca_attr_size );
+
+void
+mad_stress_send_cb(
+	IN		const	ib_mad_svc_handle_t			h_mad_svc,
+	IN				void						*mad_svc_context,
+	IN				ib_mad_element_t			*p_mad_element );
+
+void
+mad_stress_recv_cb(
+	IN		const	ib_mad_svc_handle_t			h_mad_svc,
+	IN				void						*mad_svc_context,
+	IN				ib_mad_element_t			*p_mad_element );
+
 #define ALTS_TEST_MGMT_CLASS	0x56
 #define ALTS_TEST_MGMT_CLASS_VER 1
 #define ALTS_TEST_MGMT_METHOD	0x56
@@ -283,6 +308,20 @@ ib_api_status_t		qp0_2_ports_100=IB_NOT_FOUND, qp0_pingpong=IB_NOT_FOUND;
 
 ib_api_status_t		qp0_ping_switch=IB_NOT_FOUND;
 
+ib_api_status_t		qp1_stress=IB_NOT_FOUND;
+
+/*
+ * The stress test keeps ALTS_MAD_STRESS_SENDS requests outstanding on one
+ * MAD service.  Requests are split in thirds by TID: the first third is
+ * answered, the second is never answered and times out, the third is
+ * never answered and canceled.  This drives TID matching, cancel and the
+ * retry timer with thousands of sends queued.
+ */
+#define ALTS_MAD_STRESS_SENDS	3000
+#define ALTS_MAD_STRESS_TIMEOUT	500		/* ms */
+#define ALTS_MAD_STRESS_ANSWER	0
+#define ALTS_MAD_STRESS_CANCEL	2
+
 
 /*	This test case assumes that the HCA has 2 port connected
  *  through the switch. Sends packets from lower port number to higher
@@ -389,6 +428,20 @@ al_test_mad(void)
 			("alts_qp1_pingpong() passed\n"));
 		}
 
+		qp1_stress = alts_qp1_stress(h_ca, bsize);
+		if(qp1_stress != IB_SUCCESS)
+		{
+			ALTS_PRINT( ALTS_DBG_ERROR,
+			("alts_qp1_stress() failed with status %d\n",
+			qp1_stress));
+			//break;
+		}
+		else
+		{
+			ALTS_PRINT( ALTS_DBG_VERBOSE,
+			("alts_qp1_stress() passed\n"));
+		}
+
 		// run tests
 		qp0_loopback = alts_qp0_loopback(h_ca, bsize);
 		if(qp0_loopback != IB_SUCCESS)
@@ -462,11 +515,13 @@ al_test_mad(void)
 		"\tqp1_loopback..........: %s\n"
 		"\tqp1_2_ports...........: %s\n"
 		"\tqp1_2_ports_100_msgs..: %s\n"
-		"\tqp1_pingpong..........: %s\n",
+		"\tqp1_pingpong..........: %s\n"
+		"\tqp1_stress............: %s\n",
 		ib_get_err_str(qp1_loopback),
 		ib_get_err_str(qp1_2_ports),
 		ib_get_err_str(qp1_2_ports_100),
-		ib_get_err_str(qp1_pingpong)
+		ib_get_err_str(qp1_pingpong),
+		ib_get_err_str(qp1_stress)
 		));
 
 	ALTS_PRINT(ALTS_DBG_STATUS,
@@ -3031,3 +3086,353 @@ alts_qp0_ping_switch (
 	ALTS_EXIT( ALTS_DBG_VERBOSE);
 	return ib_status;
 }
+
+
+/*
+ * Send side of the stress test: answered requests complete with success,
+ * the others with a timeout or cancel status.
+ */
+void
+mad_stress_send_cb(
+	IN		const	ib_mad_svc_handle_t			h_mad_svc,
+	IN				void						*mad_svc_context,
+	IN				ib_mad_element_t			*p_mad_element )
+{
+	ib_mad_element_t			*p_gmp;
+	alts_mad_ca_obj_t			*p_ca_obj;
+
+	UNUSED_PARAM( h_mad_svc );
+
+	CL_ASSERT (mad_svc_context);
+	CL_ASSERT (p_mad_element);
+
+	p_ca_obj = (alts_mad_ca_obj_t*)mad_svc_context;
+
+	for( p_gmp = p_mad_element; p_gmp; p_gmp = p_gmp->p_next )
+	{
+		/* responses sent by the answering side are not counted */
+		if( !p_gmp->resp_expected )
+			continue;
+
+		switch( p_gmp->status )
+		{
+		case IB_WCS_SUCCESS:
+			cl_atomic_inc( &p_ca_obj->stress_success );
+			break;
+		case IB_WCS_TIMEOUT_RETRY_ERR:
+			cl_atomic_inc( &p_ca_obj->stress_timeout );
+			break;
+		case IB_WCS_CANCELED:
+			cl_atomic_inc( &p_ca_obj->stress_canceled );
+			break;
+		default:
+			ALTS_PRINT(ALTS_DBG_ERROR,
+				("stress send tid x%"PRIx64" completed with %s\n",
+				p_gmp->p_mad_buf->trans_id,
+				ib_get_wc_status_str(p_gmp->status)));
+			cl_atomic_inc( &p_ca_obj->stress_error );
+			break;
+		}
+	}
+
+	ib_put_mad(p_mad_element);
+}
+
+/*
+ * Receive side of the stress test: answer only the requests whose TID
+ * falls in the answered third, count the responses that come back.
+ */
+void
+mad_stress_recv_cb(
+	IN		const	ib_mad_svc_handle_t			h_mad_svc,
+	IN				void						*mad_svc_context,
+	IN				ib_mad_element_t			*p_mad_element )
+{
+	ib_mad_element_t			*p_gmp;
+	alts_mad_ca_obj_t			*p_ca_obj;
+	ib_mad_t					*p_mad;
+	uint32_t					tid;
+
+	UNUSED_PARAM( h_mad_svc );
+
+	CL_ASSERT (mad_svc_context);
+	CL_ASSERT (p_mad_element);
+
+	p_ca_obj = (alts_mad_ca_obj_t*)mad_svc_context;
+
+	for( p_gmp = p_mad_element; p_gmp; p_gmp = p_gmp->p_next )
+	{
+		if( p_gmp->status != IB_WCS_SUCCESS )
+		{
+			cl_atomic_inc( &p_ca_obj->stress_error );
+			continue;
+		}
+
+		p_mad = p_gmp->p_mad_buf;
+		if( ib_mad_is_response(p_mad) )
+		{
+			cl_atomic_inc( &p_ca_obj->stress_resp );
+			continue;
+		}
+
+		/* the low 32 bits of the TID are the ones the sender chose */
+		tid = (uint32_t)CL_NTOH64(p_mad->trans_id);
+		if( tid % 3 == ALTS_MAD_STRESS_ANSWER )
+			alts_send_mad_resp(p_ca_obj, p_gmp);
+	}
+
+	ib_put_mad(p_mad_element);
+}
+
+static ib_api_status_t
+alts_mad_stress(
+	alts_mad_ca_obj_t *p_ca_obj,
+	uint32_t		*p_posted )
+{
+	ib_api_status_t				ib_status;
+	ib_mad_element_t			**pp_mad;
+	ib_mad_element_t			*p_mad_element;
+	uint32_t					i;
+
+	ALTS_ENTER( ALTS_DBG_VERBOSE );
+
+	*p_posted = 0;
+
+	//Create an Address vector
+	av_attr.dlid = p_ca_obj->dlid;
+	av_attr.port_num = p_ca_obj->src_port_num;
+	av_attr.sl = 0;
+	av_attr.path_bits = 0;
+	av_attr.static_rate = IB_PATH_RECORD_RATE_10_GBS;
+	av_attr.grh_valid = FALSE;
+
+	ib_status = ib_create_av(p_ca_obj->h_pd,&av_attr,&p_ca_obj->h_av_src);
+	if(ib_status != IB_SUCCESS)
+		return ib_status;
+
+	pp_mad = (ib_mad_element_t**)cl_zalloc(
+		sizeof(ib_mad_element_t*) * ALTS_MAD_STRESS_SENDS);
+	if (!pp_mad)
+		return IB_INSUFFICIENT_MEMORY;
+
+	for (i = 0; i < ALTS_MAD_STRESS_SENDS; i++)
+	{
+		ib_status = ib_get_mad(
+			p_ca_obj->h_src_pool,
+			MAD_BLOCK_SIZE,
+			&p_mad_element );
+		if (ib_status != IB_SUCCESS)
+		{
+			ALTS_PRINT(ALTS_DBG_ERROR,
+				("Error in ib_get_mad()! %s\n", ib_get_err_str(ib_status)));
+			break;
+		}
+
+		p_mad_element->context1 = (void*)(uintn_t)i;
+		p_mad_element->context2 = p_ca_obj;
+
+		p_mad_element->h_av = p_ca_obj->h_av_src;
+		p_mad_element->send_opt = IB_SEND_OPT_SIGNALED;
+		p_mad_element->resp_expected = TRUE;
+		p_mad_element->remote_qp = p_ca_obj->qp_attr[DEST_QP].num;
+		p_mad_element->remote_qkey = p_ca_obj->qkey;
+		p_mad_element->timeout_ms = ALTS_MAD_STRESS_TIMEOUT;
+		p_mad_element->retry_cnt = 1;
+		p_mad_element->status = 0;
+
+		ib_mad_init_new(
+			p_mad_element->p_mad_buf,
+			ALTS_TEST_MGMT_CLASS,
+			ALTS_TEST_MGMT_CLASS_VER,
+			ALTS_TEST_MGMT_METHOD,
+			CL_HTON64((uint64_t)i),
+			IB_MAD_ATTR_CLASS_PORT_INFO,
+			0 );
+
+		/* the send may complete before ib_send_mad returns */
+		pp_mad[i] = p_mad_element;
+		ib_status = ib_send_mad(
+			p_ca_obj->h_src_mad_svc,
+			p_mad_element,
+			NULL );
+		if (ib_status != IB_SUCCESS)
+		{
+			ALTS_PRINT(ALTS_DBG_ERROR,
+				("ib_send_mad failed for send %d: %s\n",
+				i, ib_get_err_str(ib_status)));
+			pp_mad[i] = NULL;
+			ib_put_mad(p_mad_element);
+			break;
+		}
+	}
+	*p_posted = i;
+
+	/*
+	 * The canceled third is never answered, so those sends are still
+	 * waiting for a response well before their first timeout.
+	 */
+	for (i = 0; i < *p_posted; i++)
+	{
+		if (i % 3 != ALTS_MAD_STRESS_CANCEL)
+			continue;
+
+		if (ib_cancel_mad(p_ca_obj->h_src_mad_svc, pp_mad[i]) != IB_SUCCESS)
+			ALTS_PRINT(ALTS_DBG_ERROR,
+				("ib_cancel_mad failed for send %d\n", i));
+	}
+
+	cl_free(pp_mad);
+
+	ALTS_EXIT( ALTS_DBG_VERBOSE);
+	return ib_status;
+}
+
+ib_api_status_t
+alts_qp1_stress(
+	ib_ca_handle_t	h_ca,
+	uint32_t		ca_attr_size )
+{
+	ib_api_status_t		ib_status = IB_ERROR, ib_status2;
+	uint32_t			bsize;
+	alts_mad_ca_obj_t	*p_ca_obj = NULL;
+	ib_ca_attr_t		*p_ca_attr = NULL;
+	uint32_t			posted = 0;
+	uint32_t			done;
+	uint32_t			answered, canceled;
+	int					i;
+
+	ALTS_ENTER( ALTS_DBG_VERBOSE );
+
+	CL_ASSERT (h_ca);
+	CL_ASSERT (ca_attr_size);
+
+	do
+	{
+		p_ca_obj = (alts_mad_ca_obj_t*)cl_zalloc(sizeof(alts_mad_ca_obj_t));
+		if (!p_ca_obj)
+		{
+			ALTS_PRINT( ALTS_DBG_ERROR,
+				("zalloc() failed for alts_mad_ca_obj_t!\n") );
+			break;
+		}
+
+		/* Allocate the memory needed for query_ca */
+		bsize = ca_attr_size;
+		p_ca_attr = (ib_ca_attr_t *)cl_zalloc(bsize);
+		if (!p_ca_attr)
+		{
+			ALTS_PRINT( ALTS_DBG_ERROR,
+				("zalloc() failed for p_ca_attr!\n") );
+			break;
+		}
+
+		ib_status = ib_query_ca(h_ca, p_ca_attr, &bsize);
+		if(ib_status != IB_SUCCESS)
+		{
+			ALTS_PRINT( ALTS_DBG_ERROR,
+				("ib_query_ca failed with status = %d\n", ib_status) );
+			break;
+		}
+
+		/*
+		 * Initialize the CA Object
+		 */
+		p_ca_obj->h_ca = h_ca;
+		p_ca_obj->p_ca_attr = p_ca_attr;
+		p_ca_obj->status = IB_SUCCESS;
+		p_ca_obj->cq_size = 255*2;
+		p_ca_obj->qkey = IB_QP1_WELL_KNOWN_Q_KEY;
+		p_ca_obj->ds_list_depth = 1;
+		p_ca_obj->num_wrs = 64;
+		p_ca_obj->msg_size = 256;
+
+		p_ca_obj->src_qp_num = IB_QP1;
+		p_ca_obj->is_loopback = FALSE;
+
+		p_ca_obj->reply_requested = TRUE;		// we need a reply
+
+		/*
+		 * get an active port
+		 */
+		ib_status = alts_mad_check_active_ports(p_ca_obj);
+		if(ib_status != IB_SUCCESS)
+		{
+			ALTS_PRINT( ALTS_DBG_ERROR,
+			("This test routing atleast 1 active port on the 1st hca\n"));
+			break;
+		}
+
+		/*
+		 * Create the necessary resource PD/QP/QP
+		 */
+		ib_status = mad_create_spl_resources(
+			p_ca_obj,
+			IB_QPT_QP1_ALIAS,
+			ALTS_TEST_MGMT_CLASS,
+			ALTS_TEST_MGMT_CLASS_VER,
+			mad_stress_send_cb,
+			mad_stress_recv_cb );
+		if(ib_status != IB_SUCCESS)
+		{
+			ALTS_PRINT( ALTS_DBG_ERROR,
+			("mad_create_spl_resources() failed with status %d\n", ib_status));
+			break;
+		}
+
+		ib_status = alts_mad_stress(p_ca_obj, &posted);
+		if(ib_status != IB_SUCCESS)
+		{
+			ALTS_PRINT( ALTS_DBG_ERROR,
+			("alts_mad_stress failed with status %d\n", ib_status));
+			break;
+		}
+
+		/* every send completes, the last ones after two timeouts */
+		for (i = 0; i < 20; i++)
+		{
+			done = p_ca_obj->stress_success + p_ca_obj->stress_timeout +
+				p_ca_obj->stress_canceled + p_ca_obj->stress_error;
+			if (done >= posted)
+				break;
+			cl_thread_suspend(ALTS_MAD_STRESS_TIMEOUT);
+		}
+
+		/* TIDs 0, 3, 6, ... are answered; 2, 5, 8, ... are canceled */
+		answered = (posted + 2) / 3;
+		canceled = posted / 3;
+		ALTS_PRINT( ALTS_DBG_INFO,
+			("stress: posted(%d) success(%d) timeout(%d) canceled(%d) "
+			"resp(%d) error(%d)\n",
+			posted, p_ca_obj->stress_success, p_ca_obj->stress_timeout,
+			p_ca_obj->stress_canceled, p_ca_obj->stress_resp,
+			p_ca_obj->stress_error) );
+
+		if ((uint32_t)p_ca_obj->stress_success == answered &&
+			(uint32_t)p_ca_obj->stress_resp == answered &&
+			(uint32_t)p_ca_obj->stress_timeout ==
+				posted - answered - canceled &&
+			(uint32_t)p_ca_obj->stress_canceled == canceled &&
+			!p_ca_obj->stress_error)
+			ib_status = IB_SUCCESS;
+		else
+			ib_status = IB_ERROR;
+
+	} while (0);
+
+	/*
+	 * Destroy the resources
+	 */
+	ib_status2 = alts_spl_destroy_resources(p_ca_obj);
+	if (ib_status == IB_SUCCESS)
+		ib_status = ib_status2;
+
+	if (p_ca_attr)
+		cl_free(p_ca_attr);
+
+	if (p_ca_obj)
+		cl_free(p_ca_obj);
+
+
+	ALTS_EXIT( ALTS_DBG_VERBOSE);
+	return ib_status;
+}
@@ -0,0 +1,898 @@
+/*
+ * Copyright (c) 2005 SilverStorm Technologies.  All rights reserved.
+ * Portions Copyright (c) 2008 Microsoft Corporation.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Simulated access layer services for the CEP manager.
+ *
+ * Replaces the parts of AL that al_cm_cep.c calls into: AL objects, the CA,
+ * PnP, the MAD service and its pool, and the complib timer.  Sent MADs are
+ * copied to an outbox owned by the sending thread.  Send completions,
+ * including those of cancelled sends, are queued to the thread that caused
+ * them and delivered by sim_poll(), as the MAD service delivers them from
+ * its completion DPC rather than from inside ib_cancel_mad.
+ */
+
+
+#include <iba/ib_al.h>
+#include <complib/cl_timer.h>
+#include "al_common.h"
+#include "al_cm_cep.h"
+#include "al_debug.h"
+#include "al_mgr.h"
+#include "al_ca.h"
+#include "al_ci_ca.h"
+#include "al.h"
+#include "cm_sim.h"
+
+
+uint32_t					g_al_dbg_level = TRACE_LEVEL_ERROR;
+uint32_t					g_al_dbg_flags = 0xf0;
+ib_al_handle_t				gh_al = NULL;
+__declspec(thread) KIRQL	g_sim_irql = PASSIVE_LEVEL;
+
+
+/* MAD element as handed out by the simulated pool. */
+typedef struct _sim_mad
+{
+	ib_mad_element_t			element;
+	struct _sim_mad				*p_next_comp;
+	atomic32_t					state;
+	ib_grh_t					grh;
+	uint8_t						buf[MAD_BLOCK_SIZE];
+
+}	sim_mad_t;
+
+#define SIM_MAD_IDLE				0
+#define SIM_MAD_POSTED				1	/* Waiting for a response or cancel. */
+#define SIM_MAD_DONE				2
+
+
+static al_obj_t						g_root_obj;
+static ib_al_t						g_al;
+static ib_ca_t						g_ca;
+static al_ci_ca_t					g_ci_ca;
+static ib_ca_attr_t					g_ca_attr;
+static ib_port_attr_t				g_port_attr;
+static ib_gid_t						g_gid;
+static ib_net16_t					g_pkey = IB_DEFAULT_PKEY;
+
+static ib_pnp_req_t					g_pnp_req;
+static ib_mad_svc_t					g_mad_svc;
+static uint8_t						g_pd, g_qp, g_pool_key, g_h_mad_svc;
+
+static cl_timer_t					*gp_timer;
+
+static atomic32_t					g_sends_pending;
+static atomic32_t					g_mads;
+
+static __declspec(thread) sim_msg_t	*tp_sent_head, *tp_sent_tail;
+static __declspec(thread) sim_mad_t	*tp_comp_head, *tp_comp_tail;
+
+
+/******************************************************************************
+* AL objects
+******************************************************************************/
+
+static void
+__sim_destroy_obj(
+	IN				al_obj_t					*p_obj,
+	IN		const	ib_pfn_destroy_cb_t			pfn_destroy_cb )
+{
+	UNUSED_PARAM( pfn_destroy_cb );
+
+	p_obj->state = CL_DESTROYING;
+	if( p_obj->pfn_destroying )
+		p_obj->pfn_destroying( p_obj );
+
+	if( p_obj->p_parent_obj )
+	{
+		cl_spinlock_acquire( &p_obj->p_parent_obj->lock );
+		cl_qlist_remove_item( &p_obj->p_parent_obj->obj_list,
+			(cl_list_item_t*)&p_obj->pool_item );
+		cl_spinlock_release( &p_obj->p_parent_obj->lock );
+		deref_al_obj( p_obj->p_parent_obj );
+		p_obj->p_parent_obj = NULL;
+	}
+
+	deref_al_obj( p_obj );
+}
+
+
+void
+construct_al_obj(
+	IN				al_obj_t * const			p_obj,
+	IN		const	al_obj_type_t				obj_type )
+{
+	cl_memclr( p_obj, sizeof( al_obj_t ) );
+
+	cl_spinlock_construct( &p_obj->lock );
+	p_obj->state = CL_UNINITIALIZED;
+	p_obj->type = obj_type;
+	p_obj->ref_cnt = 1;
+	cl_qlist_init( &p_obj->obj_list );
+	cl_event_construct( &p_obj->event );
+}
+
+
+ib_api_status_t
+init_al_obj(
+	IN				al_obj_t * const			p_obj,
+	IN		const	void* const					context,
+	IN				boolean_t					async_destroy,
+	IN		const	al_pfn_destroying_t			pfn_destroying,
+	IN		const	al_pfn_cleanup_t			pfn_cleanup,
+	IN		const	al_pfn_free_t				pfn_free )
+{
+	UNUSED_PARAM( async_destroy );
+
+	if( cl_spinlock_init( &p_obj->lock ) != CL_SUCCESS )
+		return IB_ERROR;
+
+	p_obj->context = context;
+	p_obj->pfn_destroy = __sim_destroy_obj;
+	p_obj->pfn_destroying = pfn_destroying;
+	p_obj->pfn_cleanup = pfn_cleanup;
+	p_obj->pfn_free = pfn_free;
+	p_obj->state = CL_INITIALIZED;
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+attach_al_obj(
+	IN				al_obj_t * const			p_parent_obj,
+	IN				al_obj_t * const			p_child_obj )
+{
+	cl_spinlock_acquire( &p_parent_obj->lock );
+	cl_qlist_insert_tail( &p_parent_obj->obj_list,
+		(cl_list_item_t*)&p_child_obj->pool_item );
+	p_child_obj->p_parent_obj = p_parent_obj;
+	p_child_obj->p_ci_ca = p_parent_obj->p_ci_ca;
+	cl_spinlock_release( &p_parent_obj->lock );
+
+	ref_al_obj( p_parent_obj );
+	return IB_SUCCESS;
+}
+
+
+int32_t
+ref_al_obj_inner(
+	IN				al_obj_t * const			p_obj )
+{
+	return cl_atomic_inc( &p_obj->ref_cnt );
+}
+
+
+AL_EXPORT int32_t AL_API
+deref_al_obj_inner(
+	IN				al_obj_t * const			p_obj )
+{
+	int32_t		ref_cnt;
+
+	ref_cnt = cl_atomic_dec( &p_obj->ref_cnt );
+	CL_ASSERT( ref_cnt >= 0 );
+	if( !ref_cnt )
+	{
+		if( p_obj->pfn_cleanup )
+			p_obj->pfn_cleanup( p_obj );
+		if( p_obj->pfn_free )
+			p_obj->pfn_free( p_obj );
+	}
+	return ref_cnt;
+}
+
+
+int32_t
+ref_trace_insert(
+	__in char*						file,
+	__in LONG						line,
+	__in void * const				p_obj,
+	__in al_ref_change_type_t		change_type,
+	__in uint8_t					ref_ctx )
+{
+	UNUSED_PARAM( file );
+	UNUSED_PARAM( line );
+	UNUSED_PARAM( ref_ctx );
+
+	if( change_type == AL_REF )
+		return ref_al_obj_inner( (al_obj_t*)p_obj );
+	return deref_al_obj_inner( (al_obj_t*)p_obj );
+}
+
+
+AL_EXPORT int32_t AL_API
+deref_al_obj_cb(
+	IN				al_obj_t * const			p_obj )
+{
+	return deref_al_obj( p_obj );
+}
+
+
+void
+destroy_al_obj(
+	IN				al_obj_t * const			p_obj )
+{
+	cl_spinlock_destroy( &p_obj->lock );
+}
+
+
+ib_al_handle_t
+sim_open_al( void )
+{
+	ib_al_handle_t		h_al;
+
+	h_al = (ib_al_handle_t)cl_zalloc( sizeof(ib_al_t) );
+	if( !h_al )
+		return NULL;
+
+	construct_al_obj( &h_al->obj, AL_OBJ_TYPE_H_AL );
+	cl_qlist_init( &h_al->cep_list );
+	if( init_al_obj( &h_al->obj, h_al, FALSE, NULL, NULL, NULL ) != IB_SUCCESS )
+	{
+		cl_free( h_al );
+		return NULL;
+	}
+	return h_al;
+}
+
+
+void
+sim_close_al(
+	IN				ib_al_handle_t				h_al )
+{
+	CL_ASSERT( !cl_qlist_count( &h_al->cep_list ) );
+	destroy_al_obj( &h_al->obj );
+	cl_free( h_al );
+}
+
+
+/******************************************************************************
+* CA, PnP and QP
+******************************************************************************/
+
+static enum rdma_transport_type
+__sim_get_transport(
+	IN		const	ib_ca_handle_t				h_ca,
+	IN		const	uint8_t						port_num )
+{
+	UNUSED_PARAM( h_ca );
+	UNUSED_PARAM( port_num );
+	return RDMA_TRANSPORT_IB;
+}
+
+
+static uint8_t
+__sim_get_sl_for_ip_port(
+	IN		const	ib_ca_handle_t				h_ca,
+	IN		const	uint8_t						adapter_port_num,
+	IN		const	uint16_t					ip_port_num )
+{
+	UNUSED_PARAM( h_ca );
+	UNUSED_PARAM( adapter_port_num );
+	UNUSED_PARAM( ip_port_num );
+	return (uint8_t)-1;
+}
+
+
+ib_ca_handle_t
+acquire_ca(
+	IN		const	ib_net64_t					ci_ca_guid )
+{
+	if( ci_ca_guid != SIM_CA_GUID )
+		return NULL;
+
+	ref_al_obj( &g_ca.obj );
+	return &g_ca;
+}
+
+
+ib_api_status_t
+ib_reg_pnp(
+	IN		const	ib_al_handle_t				h_al,
+	IN		const	ib_pnp_req_t* const			p_pnp_req,
+		OUT			ib_pnp_handle_t* const		ph_pnp )
+{
+	UNUSED_PARAM( h_al );
+
+	g_pnp_req = *p_pnp_req;
+	*ph_pnp = (ib_pnp_handle_t)&g_pnp_req;
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+ib_dereg_pnp(
+	IN		const	ib_pnp_handle_t				h_pnp,
+	IN		const	ib_pfn_destroy_cb_t			pfn_destroy_cb OPTIONAL )
+{
+	UNUSED_PARAM( h_pnp );
+
+	if( pfn_destroy_cb )
+		pfn_destroy_cb( (void*)g_pnp_req.pnp_context );
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+ib_modify_ca(
+	IN		const	ib_ca_handle_t				h_ca,
+	IN		const	uint8_t						port_num,
+	IN		const	ib_ca_mod_t					ca_mod,
+	IN		const	ib_port_attr_mod_t* const	p_port_attr_mod )
+{
+	UNUSED_PARAM( h_ca );
+	UNUSED_PARAM( port_num );
+	UNUSED_PARAM( ca_mod );
+	UNUSED_PARAM( p_port_attr_mod );
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+ib_alloc_pd(
+	IN		const	ib_ca_handle_t				h_ca,
+	IN		const	ib_pd_type_t				pd_type,
+	IN		const	void* const					pd_context,
+		OUT			ib_pd_handle_t* const		ph_pd )
+{
+	UNUSED_PARAM( h_ca );
+	UNUSED_PARAM( pd_type );
+	UNUSED_PARAM( pd_context );
+
+	*ph_pd = (ib_pd_handle_t)&g_pd;
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+ib_dealloc_pd(
+	IN		const	ib_pd_handle_t				h_pd,
+	IN		const	ib_pfn_destroy_cb_t			pfn_destroy_cb OPTIONAL )
+{
+	UNUSED_PARAM( h_pd );
+	UNUSED_PARAM( pfn_destroy_cb );
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+ib_get_spl_qp(
+	IN		const	ib_pd_handle_t				h_pd,
+	IN		const	ib_net64_t					port_guid,
+	IN	OUT			ib_qp_create_t* const		p_qp_create,
+	IN		const	void* const					qp_context,
+	IN		const	ib_pfn_event_cb_t			pfn_qp_event_cb OPTIONAL,
+		OUT			ib_pool_key_t* const		p_pool_key OPTIONAL,
+		OUT			ib_qp_handle_t* const		ph_qp )
+{
+	UNUSED_PARAM( h_pd );
+	UNUSED_PARAM( p_qp_create );
+	UNUSED_PARAM( qp_context );
+	UNUSED_PARAM( pfn_qp_event_cb );
+
+	if( port_guid != SIM_PORT_GUID )
+		return IB_INVALID_GUID;
+
+	if( p_pool_key )
+		*p_pool_key = (ib_pool_key_t)&g_pool_key;
+	*ph_qp = (ib_qp_handle_t)&g_qp;
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+ib_destroy_qp(
+	IN		const	ib_qp_handle_t				h_qp,
+	IN		const	ib_pfn_destroy_cb_t			pfn_destroy_cb OPTIONAL )
+{
+	UNUSED_PARAM( h_qp );
+	UNUSED_PARAM( pfn_destroy_cb );
+	return IB_SUCCESS;
+}
+
+
+static void
+__sim_init_ca( void )
+{
+	g_gid.unicast.prefix = SIM_GID_PREFIX;
+	g_gid.unicast.interface_id = SIM_PORT_GUID;
+
+	g_port_attr.port_guid = SIM_PORT_GUID;
+	g_port_attr.port_num = 1;
+	g_port_attr.mtu = IB_MTU_LEN_2048;
+	g_port_attr.transport = RDMA_TRANSPORT_IB;
+	g_port_attr.lid = SIM_LID;
+	g_port_attr.link_state = IB_LINK_ACTIVE;
+	g_port_attr.num_gids = 1;
+	g_port_attr.p_gid_table = &g_gid;
+	g_port_attr.num_pkeys = 1;
+	g_port_attr.p_pkey_table = &g_pkey;
+
+	g_ca_attr.ca_guid = SIM_CA_GUID;
+	g_ca_attr.num_ports = 1;
+	g_ca_attr.p_port_attr = &g_port_attr;
+	g_ca_attr.max_qp_resp_res = 16;
+	g_ca_attr.local_ack_delay = 8;
+
+	construct_al_obj( &g_ci_ca.obj, AL_OBJ_TYPE_CI_CA );
+	init_al_obj( &g_ci_ca.obj, &g_ci_ca, FALSE, NULL, NULL, NULL );
+	g_ci_ca.verbs.guid = SIM_CA_GUID;
+	g_ci_ca.verbs.rdma_port_get_transport = __sim_get_transport;
+	g_ci_ca.verbs.get_sl_for_ip_port = __sim_get_sl_for_ip_port;
+	g_ci_ca.p_pnp_attr = &g_ca_attr;
+	g_ci_ca.num_ports = 1;
+	cl_spinlock_construct( &g_ci_ca.attr_lock );
+	cl_spinlock_init( &g_ci_ca.attr_lock );
+
+	construct_al_obj( &g_ca.obj, AL_OBJ_TYPE_H_CA );
+	init_al_obj( &g_ca.obj, &g_ca, FALSE, NULL, NULL, NULL );
+	g_ca.obj.p_ci_ca = &g_ci_ca;
+}
+
+
+ib_api_status_t
+sim_init( void )
+{
+	ib_api_status_t		status;
+	ib_pnp_port_rec_t	port_rec;
+	KIRQL				irql;
+
+	__sim_init_ca();
+
+	construct_al_obj( &g_root_obj, AL_OBJ_TYPE_AL_MGR );
+	init_al_obj( &g_root_obj, NULL, FALSE, NULL, NULL, NULL );
+
+	construct_al_obj( &g_al.obj, AL_OBJ_TYPE_H_AL );
+	cl_qlist_init( &g_al.cep_list );
+	init_al_obj( &g_al.obj, &g_al, FALSE, NULL, NULL, NULL );
+	gh_al = &g_al;
+
+	status = create_cep_mgr( &g_root_obj );
+	if( status != IB_SUCCESS )
+		return status;
+
+	/* PnP callbacks run at passive level from the PnP thread. */
+	cl_memclr( &port_rec, sizeof(port_rec) );
+	port_rec.pnp_rec.pnp_event = IB_PNP_PORT_ADD;
+	port_rec.pnp_rec.pnp_context = (void*)g_pnp_req.pnp_context;
+	port_rec.pnp_rec.guid = SIM_PORT_GUID;
+	port_rec.pnp_rec.ca_guid = SIM_CA_GUID;
+	port_rec.p_ca_attr = &g_ca_attr;
+	port_rec.p_port_attr = &g_port_attr;
+
+	KeRaiseIrql( PASSIVE_LEVEL, &irql );
+	status = g_pnp_req.pfn_pnp_cb( &port_rec.pnp_rec );
+	KeLowerIrql( irql );
+	return status;
+}
+
+
+/******************************************************************************
+* MAD service
+******************************************************************************/
+
+ib_api_status_t
+ib_reg_mad_svc(
+	IN		const	ib_qp_handle_t				h_qp,
+	IN		const	ib_mad_svc_t* const			p_mad_svc,
+		OUT			ib_mad_svc_handle_t* const	ph_mad_svc )
+{
+	UNUSED_PARAM( h_qp );
+
+	g_mad_svc = *p_mad_svc;
+	*ph_mad_svc = (ib_mad_svc_handle_t)&g_h_mad_svc;
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+ib_get_mad_insert(
+	__in		char*							file,
+	__in		LONG							line,
+	__in		const	ib_pool_key_t			pool_key,
+	__in		const	size_t					buf_size,
+	__out		ib_mad_element_t				**pp_mad_element )
+{
+	sim_mad_t		*p_sim;
+
+	UNUSED_PARAM( file );
+	UNUSED_PARAM( line );
+	UNUSED_PARAM( pool_key );
+
+	if( buf_size > MAD_BLOCK_SIZE )
+		return IB_INVALID_SETTING;
+
+	p_sim = (sim_mad_t*)cl_zalloc( sizeof(sim_mad_t) );
+	if( !p_sim )
+		return IB_INSUFFICIENT_MEMORY;
+
+	p_sim->element.p_mad_buf = (ib_mad_t*)p_sim->buf;
+	p_sim->element.size = (uint32_t)buf_size;
+	p_sim->element.p_grh = &p_sim->grh;
+	cl_atomic_inc( &g_mads );
+
+	*pp_mad_element = &p_sim->element;
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+ib_put_mad_insert(
+	__in		char*							file,
+	__in		LONG							line,
+	__in		const	ib_mad_element_t*		p_mad_element_list )
+{
+	ib_mad_element_t	*p_mad, *p_next;
+
+	UNUSED_PARAM( file );
+	UNUSED_PARAM( line );
+
+	for( p_mad = (ib_mad_element_t*)p_mad_element_list; p_mad; p_mad = p_next )
+	{
+		p_next = p_mad->p_next;
+		CL_ASSERT( ((sim_mad_t*)p_mad)->state != SIM_MAD_POSTED );
+		cl_free( p_mad );
+		cl_atomic_dec( &g_mads );
+	}
+	return IB_SUCCESS;
+}
+
+
+static void
+__sim_queue_comp(
+	IN				sim_mad_t* const			p_sim,
+	IN		const	ib_wc_status_t				status )
+{
+	p_sim->element.status = status;
+	p_sim->p_next_comp = NULL;
+	if( tp_comp_tail )
+		tp_comp_tail->p_next_comp = p_sim;
+	else
+		tp_comp_head = p_sim;
+	tp_comp_tail = p_sim;
+}
+
+
+ib_api_status_t
+ib_send_mad(
+	IN		const	ib_mad_svc_handle_t			h_mad_svc,
+	IN				ib_mad_element_t* const		p_mad_element_list,
+		OUT			ib_mad_element_t			**pp_mad_failure OPTIONAL )
+{
+	sim_mad_t		*p_sim;
+	sim_msg_t		*p_msg;
+
+	UNUSED_PARAM( h_mad_svc );
+
+	CL_ASSERT( !p_mad_element_list->p_next );
+
+	p_msg = (sim_msg_t*)cl_malloc( sizeof(sim_msg_t) );
+	if( !p_msg )
+	{
+		if( pp_mad_failure )
+			*pp_mad_failure = p_mad_element_list;
+		return IB_INSUFFICIENT_RESOURCES;
+	}
+	cl_memcpy( p_msg->mad, p_mad_element_list->p_mad_buf, MAD_BLOCK_SIZE );
+	p_msg->p_next = NULL;
+	if( tp_sent_tail )
+		tp_sent_tail->p_next = p_msg;
+	else
+		tp_sent_head = p_msg;
+	tp_sent_tail = p_msg;
+
+	p_sim = PARENT_STRUCT( p_mad_element_list, sim_mad_t, element );
+	cl_atomic_inc( &g_sends_pending );
+	if( p_mad_element_list->resp_expected )
+	{
+		/* Retried sends complete when cancelled by the response handler. */
+		p_sim->state = SIM_MAD_POSTED;
+	}
+	else
+	{
+		p_sim->state = SIM_MAD_DONE;
+		__sim_queue_comp( p_sim, IB_WCS_SUCCESS );
+	}
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+ib_cancel_mad(
+	IN		const	ib_mad_svc_handle_t			h_mad_svc,
+	IN				ib_mad_element_t* const		p_mad_element )
+{
+	sim_mad_t		*p_sim;
+
+	UNUSED_PARAM( h_mad_svc );
+
+	p_sim = PARENT_STRUCT( p_mad_element, sim_mad_t, element );
+	if( cl_atomic_comp_xchg( &p_sim->state, SIM_MAD_POSTED, SIM_MAD_DONE ) !=
+		SIM_MAD_POSTED )
+	{
+		return IB_NOT_FOUND;
+	}
+
+	__sim_queue_comp( p_sim, IB_WCS_CANCELED );
+	return IB_SUCCESS;
+}
+
+
+ib_api_status_t
+ib_delay_mad(
+	IN		const	ib_mad_svc_handle_t			h_mad_svc,
+	IN				ib_mad_element_t* const		p_mad_element,
+	IN		const	uint32_t					delay_ms )
+{
+	UNUSED_PARAM( h_mad_svc );
+	UNUSED_PARAM( p_mad_element );
+	UNUSED_PARAM( delay_ms );
+	return IB_SUCCESS;
+}
+
+
+void
+sim_recv(
+	IN		const	void* const					p_buf )
+{
+	ib_mad_element_t	*p_mad;
+	KIRQL				irql;
+
+	if( ib_get_mad( (ib_pool_key_t)&g_pool_key, MAD_BLOCK_SIZE, &p_mad ) !=
+		IB_SUCCESS )
+	{
+		return;
+	}
+
+	cl_memcpy( p_mad->p_mad_buf, p_buf, MAD_BLOCK_SIZE );
+	p_mad->remote_qp = IB_QP1;
+	p_mad->remote_lid = SIM_REMOTE_LID;
+	p_mad->pkey_index = 0;
+
+	irql = KeRaiseIrqlToDpcLevel();
+	g_mad_svc.pfn_mad_recv_cb( (ib_mad_svc_handle_t)&g_h_mad_svc,
+		(void*)g_mad_svc.mad_svc_context, p_mad );
+	KeLowerIrql( irql );
+}
+
+
+sim_msg_t*
+sim_get_sent( void )
+{
+	sim_msg_t		*p_msg;
+
+	p_msg = tp_sent_head;
+	if( p_msg )
+	{
+		tp_sent_head = p_msg->p_next;
+		if( !tp_sent_head )
+			tp_sent_tail = NULL;
+	}
+	return p_msg;
+}
+
+
+void
+sim_put_sent(
+	IN				sim_msg_t* const			p_msg )
+{
+	cl_free( p_msg );
+}
+
+
+int32_t
+sim_sends_pending( void )
+{
+	return g_sends_pending;
+}
+
+
+int32_t
+sim_mads_outstanding( void )
+{
+	return g_mads;
+}
+
+
+/******************************************************************************
+* Timer
+*
+* The kernel complib timer fires a DPC; here whichever thread polls first
+* after the due time runs the callback.  timeout_time holds the absolute
+* due time in 100ns units, zero when the timer is not running.
+******************************************************************************/
+
+cl_status_t
+cl_timer_init(
+	IN	cl_timer_t* const		p_timer,
+	IN	cl_pfn_timer_callback_t	pfn_callback,
+	IN	const void* const		context )
+{
+	cl_memclr( p_timer, sizeof(cl_timer_t) );
+	p_timer->pfn_callback = pfn_callback;
+	p_timer->context = context;
+	KeInitializeSpinLock( &p_timer->cb_lock );
+	gp_timer = p_timer;
+	return CL_SUCCESS;
+}
+
+
+void
+cl_timer_destroy(
+	IN	cl_timer_t* const	p_timer )
+{
+	cl_timer_stop( p_timer );
+	if( gp_timer == p_timer )
+		gp_timer = NULL;
+}
+
+
+cl_status_t
+cl_timer_start(
+	IN	cl_timer_t* const	p_timer,
+	IN	const uint32_t		time_ms )
+{
+	InterlockedExchange64( (LONGLONG*)&p_timer->timeout_time,
+		KeQueryInterruptTime() + (uint64_t)time_ms * 10000 + 1 );
+	return CL_SUCCESS;
+}
+
+
+cl_status_t
+cl_timer_trim(
+	IN	cl_timer_t* const	p_timer,
+	IN	const uint32_t		time_ms )
+{
+	uint64_t	due, cur;
+
+	due = KeQueryInterruptTime() + (uint64_t)time_ms * 10000 + 1;
+	do
+	{
+		cur = p_timer->timeout_time;
+		if( cur && cur <= due )
+			break;
+	} while( (uint64_t)InterlockedCompareExchange64(
+		(LONGLONG*)&p_timer->timeout_time, due, cur ) != cur );
+
+	return CL_SUCCESS;
+}
+
+
+void
+cl_timer_stop(
+	IN	cl_timer_t* const	p_timer )
+{
+	InterlockedExchange64( (LONGLONG*)&p_timer->timeout_time, 0 );
+}
+
+
+static void
+__sim_run_timer( void )
+{
+	cl_timer_t	*p_timer = gp_timer;
+	uint64_t	due;
+
+	if( !p_timer )
+		return;
+
+	due = p_timer->timeout_time;
+	if( !due || KeQueryInterruptTime() < due )
+		return;
+
+	if( (uint64_t)InterlockedCompareExchange64(
+		(LONGLONG*)&p_timer->timeout_time, 0, due ) != due )
+	{
+		return;
+	}
+
+	/* Timer DPCs for the same timer never run concurrently. */
+	KeAcquireSpinLockAtDpcLevel( &p_timer->cb_lock );
+	p_timer->pfn_callback( (void*)p_timer->context );
+	KeReleaseSpinLockFromDpcLevel( &p_timer->cb_lock );
+}
+
+
+void
+sim_poll( void )
+{
+	sim_mad_t	*p_sim;
+	KIRQL		irql;
+
+	irql = KeRaiseIrqlToDpcLevel();
+	while( tp_comp_head )
+	{
+		p_sim = tp_comp_head;
+		tp_comp_head = p_sim->p_next_comp;
+		if( !tp_comp_head )
+			tp_comp_tail = NULL;
+
+		cl_atomic_dec( &g_sends_pending );
+		g_mad_svc.pfn_mad_send_cb( (ib_mad_svc_handle_t)&g_h_mad_svc,
+			(void*)g_mad_svc.mad_svc_context, &p_sim->element );
+	}
+
+	__sim_run_timer();
+	KeLowerIrql( irql );
+}
+
+
+/******************************************************************************
+* complib and status text
+******************************************************************************/
+
+cl_status_t
+cl_event_wait_on(
+	IN	cl_event_t* const	p_event,
+	IN	const uint32_t		wait_us,
+	IN	const boolean_t		interruptible )
+{
+	UNUSED_PARAM( p_event );
+	UNUSED_PARAM( wait_us );
+	UNUSED_PARAM( interruptible );
+	return CL_SUCCESS;
+}
+
+
+/*
+ * cl_memory.c references the object manager from _cl_init.  cmstorm never
+ * calls it, and cl_obj.c would pull in the async processor and its threads.
+ */
+cl_status_t
+cl_obj_mgr_create( void )
+{
+	return CL_SUCCESS;
+}
+
+
+void
+cl_obj_mgr_destroy( void )
+{
+}
+
+
+NTSTATUS
+cl_to_ntstatus(
+	IN	enum _cl_status	status )
+{
+	return (NTSTATUS)status;
+}
+
+
+VOID
+cl_dbg_out(
+	IN const char* const format, ... )
+{
+	va_list	list;
+
+	va_start( list, format );
+	vprintf( format, list );
+	va_end( list );
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2005 SilverStorm Technologies.  All rights reserved.
+ * Portions Copyright (c) 2008 Microsoft Corporation.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#if !defined(__CM_SIM_H__)
+#define __CM_SIM_H__
+
+
+/*
+ * Simulated HCA and MAD transport for cmstorm, see cm_sim.c.
+ *
+ * The CA has a single port.  MADs sent by the CEP manager are copied to
+ * a per-thread outbox, so each thread plays the remote CM for its own
+ * connections.
+ */
+#define SIM_CA_GUID					CL_HTON64( 0x0002C90300001000ULL )
+#define SIM_PORT_GUID				CL_HTON64( 0x0002C90300001001ULL )
+#define SIM_GID_PREFIX				CL_HTON64( 0xFE80000000000000ULL )
+#define SIM_LID						CL_HTON16( 0x0001 )
+#define SIM_REMOTE_LID				CL_HTON16( 0x0002 )
+
+
+/* Copy of a MAD sent by the CEP manager. */
+typedef struct _sim_msg
+{
+	struct _sim_msg				*p_next;
+	uint8_t						mad[MAD_BLOCK_SIZE];
+
+}	sim_msg_t;
+
+
+/*
+ * Creates the CEP manager and reports the simulated port to it.
+ */
+ib_api_status_t
+sim_init( void );
+
+ib_al_handle_t
+sim_open_al( void );
+
+void
+sim_close_al(
+	IN				ib_al_handle_t				h_al );
+
+/*
+ * Delivers a MAD from the remote CM to the CEP manager's receive callback
+ * at DISPATCH_LEVEL.
+ */
+void
+sim_recv(
+	IN		const	void* const					p_buf );
+
+/* Removes the oldest MAD sent on this thread, NULL if none. */
+sim_msg_t*
+sim_get_sent( void );
+
+void
+sim_put_sent(
+	IN				sim_msg_t* const			p_msg );
+
+/*
+ * Completes the sends and cancellations done on this thread and runs the
+ * CEP manager's timer if it is due.  Stands in for the send completion and
+ * timer DPCs, so call it with no locks held.
+ */
+void
+sim_poll( void );
+
+/* Sends not completed yet, all threads. */
+int32_t
+sim_sends_pending( void );
+
+/* MAD elements not returned to the pool yet, all threads. */
+int32_t
+sim_mads_outstanding( void );
+
+
+#endif	/* __CM_SIM_H__ */
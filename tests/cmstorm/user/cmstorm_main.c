@@ -0,0 +1,580 @@
+/*
+ * Copyright (c) 2005 SilverStorm Technologies.  All rights reserved.
+ * Portions Copyright (c) 2008 Microsoft Corporation.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Abstract:
+ *	Connection storm benchmark for the kernel CEP manager.
+ *
+ *	al_cm_cep.c is built into this program on top of the simulated access
+ *	layer in cm_sim.c.  Each thread owns a listen and plays the remote
+ *	(active) CM for it, replaying the wire MADs of complete connections
+ *	through the CM's receive handler:
+ *
+ *		REQ -> REP -> RTU -> DREQ -> DREP, then timewait
+ *
+ *	Some connections repeat the REQ, are rejected by the remote side
+ *	instead of being established, or are disconnected locally.  All threads
+ *	share the CEP manager, so the run measures how well CID allocation and
+ *	the connection maps scale across processors.
+ *
+ * Environment:
+ *	User Mode
+ */
+
+
+#include "..\..\..\core\al\kernel\al_cm_cep.c"
+#include <stdio.h>
+#include "cm_sim.h"
+
+
+#define STORM_SID_BASE		0x0000000001000000ULL
+#define STORM_CA_GUID_BASE	0x0002C90300200000ULL
+#define STORM_MAX_THREADS	64
+#define STORM_DRAIN_MS		10000
+
+
+typedef struct _storm_thread
+{
+	HANDLE					h_thread;
+	uint32_t				index;
+	ib_al_handle_t			h_al;
+	net32_t					listen_cid;
+	net64_t					sid;
+	net64_t					ca_guid;
+	uint32_t				seed;
+
+	uint32_t				conns;
+	uint32_t				dup_reqs;
+	uint32_t				rejects;
+	uint32_t				local_disc;
+	uint32_t				errors;
+
+}	storm_thread_t;
+
+
+static uint32_t				g_threads = 4;
+static uint32_t				g_conns = 20000;
+static uint32_t				g_dup_pct = 5;
+static uint32_t				g_rej_pct = 5;
+static uint32_t				g_local_pct = 50;
+
+static storm_thread_t		g_thread[STORM_MAX_THREADS];
+static volatile LONG		g_start;
+static atomic32_t			g_cb_cnt;
+
+
+static void
+__storm_cep_cb(
+	IN				ib_al_handle_t				h_al,
+	IN				net32_t						cid )
+{
+	UNUSED_PARAM( h_al );
+	UNUSED_PARAM( cid );
+	cl_atomic_inc( &g_cb_cnt );
+}
+
+
+static uint32_t
+__storm_rand(
+	IN	OUT			storm_thread_t* const		p_thread )
+{
+	p_thread->seed = p_thread->seed * 1103515245 + 12345;
+	return (p_thread->seed >> 16) % 100;
+}
+
+
+static void
+__storm_error(
+	IN	OUT			storm_thread_t* const		p_thread,
+	IN		const	char* const					p_what,
+	IN				ib_api_status_t				status )
+{
+	if( !p_thread->errors++ )
+	{
+		printf( "thread %u connection %u: %s (%s)\n", p_thread->index,
+			p_thread->conns, p_what, ib_get_err_str( status ) );
+	}
+}
+
+
+static void
+__storm_format_hdr(
+		OUT			ib_mad_t* const				p_hdr,
+	IN		const	net16_t						attr_id,
+	IN		const	net32_t						comm_id )
+{
+	ib_mad_init_new( p_hdr, IB_MCLASS_COMM_MGMT, IB_MCLASS_CM_VER_2,
+		IB_MAD_METHOD_SEND, (net64_t)comm_id, attr_id, 0 );
+}
+
+
+static void
+__storm_format_req(
+	IN		const	storm_thread_t* const		p_thread,
+	IN		const	net32_t						comm_id,
+	IN		const	net32_t						qpn,
+		OUT			mad_cm_req_t* const			p_req )
+{
+	cl_memclr( p_req, sizeof(mad_cm_req_t) );
+	__storm_format_hdr( &p_req->hdr, CM_REQ_ATTR_ID, comm_id );
+
+	p_req->local_comm_id = comm_id;
+	p_req->sid = p_thread->sid;
+	p_req->local_ca_guid = p_thread->ca_guid;
+
+	conn_req_set_lcl_qpn( qpn, p_req );
+	conn_req_set_resp_res( 4, p_req );
+	conn_req_set_init_depth( 4, p_req );
+	conn_req_set_remote_resp_timeout( 20, p_req );
+	conn_req_set_qp_type( IB_QPT_RELIABLE_CONN, p_req );
+	conn_req_set_flow_ctrl( TRUE, p_req );
+	conn_req_set_starting_psn( qpn, p_req );
+	conn_req_set_lcl_resp_timeout( 20, p_req );
+	conn_req_set_retry_cnt( 7, p_req );
+	p_req->pkey = IB_DEFAULT_PKEY;
+	conn_req_set_mtu( IB_MTU_LEN_2048, p_req );
+	conn_req_set_rnr_retry_cnt( 7, p_req );
+	conn_req_set_max_cm_retries( 15, p_req );
+
+	/* The remote end of the path is the simulated port. */
+	p_req->primary_path.local_lid = SIM_REMOTE_LID;
+	p_req->primary_path.remote_lid = SIM_LID;
+	p_req->primary_path.local_gid.unicast.prefix = SIM_GID_PREFIX;
+	p_req->primary_path.local_gid.unicast.interface_id = p_thread->ca_guid;
+	p_req->primary_path.remote_gid.unicast.prefix = SIM_GID_PREFIX;
+	p_req->primary_path.remote_gid.unicast.interface_id = SIM_PORT_GUID;
+	p_req->primary_path.hop_limit = 1;
+	conn_req_path_set_pkt_rate( IB_PATH_RECORD_RATE_10_GBS,
+		&p_req->primary_path );
+	conn_req_path_set_svc_lvl( 0, &p_req->primary_path );
+	conn_req_path_set_subn_lcl( TRUE, &p_req->primary_path );
+	/* Keeps timewait at the minimum. */
+	conn_req_path_set_lcl_ack_timeout( 1, &p_req->primary_path );
+
+	conn_req_clr_rsvd_fields( p_req );
+}
+
+
+/* Returns the next MAD sent to the remote CM if it has the expected type. */
+static sim_msg_t*
+__storm_get_sent(
+	IN		const	net16_t						attr_id )
+{
+	sim_msg_t		*p_msg;
+
+	p_msg = sim_get_sent();
+	if( p_msg && ((ib_mad_t*)p_msg->mad)->attr_id != attr_id )
+	{
+		sim_put_sent( p_msg );
+		return NULL;
+	}
+	return p_msg;
+}
+
+
+static void
+__storm_drain_sent( void )
+{
+	sim_msg_t		*p_msg;
+
+	while( (p_msg = sim_get_sent()) != NULL )
+		sim_put_sent( p_msg );
+}
+
+
+/* Polls the CEP for a MAD of the given type and releases it. */
+static ib_api_status_t
+__storm_poll(
+	IN				storm_thread_t* const		p_thread,
+	IN				net32_t						cid,
+	IN		const	net16_t						attr_id,
+		OUT			net32_t* const				p_new_cid OPTIONAL )
+{
+	ib_api_status_t		status;
+	void				*context;
+	net32_t				new_cid;
+	ib_mad_element_t	*p_mad;
+
+	status = al_cep_poll( p_thread->h_al, cid, &context, &new_cid, &p_mad );
+	if( status != IB_SUCCESS )
+		return status;
+
+	if( p_mad->p_mad_buf->attr_id != attr_id )
+		status = IB_INVALID_STATE;
+	else if( p_new_cid )
+		*p_new_cid = new_cid;
+
+	ib_put_mad( p_mad );
+	return status;
+}
+
+
+static void
+__storm_connect(
+	IN				storm_thread_t* const		p_thread )
+{
+	ib_api_status_t		status;
+	mad_cm_req_t		req;
+	mad_cm_rep_t		*p_rep;
+	mad_cm_rtu_t		rtu;
+	mad_cm_rej_t		rej;
+	mad_cm_dreq_t		dreq;
+	mad_cm_drep_t		drep;
+	iba_cm_rep			cm_rep;
+	sim_msg_t			*p_msg;
+	net32_t				comm_id, qpn, cid, local_comm_id, local_qpn;
+
+	/*
+	 * Comm IDs of the remote side are unique across threads, QPNs are
+	 * unique per remote CA so that none matches a connection in timewait.
+	 */
+	comm_id = cl_hton32( (p_thread->index << 24) | (p_thread->conns + 1) );
+	qpn = cl_hton32( p_thread->conns + 1 );
+
+	__storm_format_req( p_thread, comm_id, qpn, &req );
+	sim_recv( &req );
+	if( __storm_rand( p_thread ) < g_dup_pct )
+	{
+		/* Repeated REQ, e.g. from a retry that crossed our REP. */
+		sim_recv( &req );
+		p_thread->dup_reqs++;
+	}
+
+	cid = AL_INVALID_CID;
+	status = __storm_poll( p_thread, p_thread->listen_cid, CM_REQ_ATTR_ID, &cid );
+	if( status != IB_SUCCESS || cid == AL_INVALID_CID )
+	{
+		__storm_error( p_thread, "REQ not delivered to listen", status );
+		goto out;
+	}
+
+	cl_memclr( &cm_rep, sizeof(cm_rep) );
+	cm_rep.qpn = cl_hton32( 0x100 + (cid & 0xFFFF) );
+	cm_rep.starting_psn = cm_rep.qpn;
+	cm_rep.failover_accepted = IB_FAILOVER_ACCEPT_UNSUPPORTED;
+	cm_rep.resp_res = 4;
+	cm_rep.init_depth = 4;
+	cm_rep.flow_ctrl = TRUE;
+	cm_rep.rnr_retry_cnt = 7;
+	status = kal_cep_pre_rep( p_thread->h_al, cid, &cm_rep, 7, NULL );
+	if( status == IB_SUCCESS )
+		status = al_cep_send_rep( p_thread->h_al, cid );
+	if( status != IB_SUCCESS )
+	{
+		__storm_error( p_thread, "REP failed", status );
+		goto destroy;
+	}
+
+	p_msg = __storm_get_sent( CM_REP_ATTR_ID );
+	if( !p_msg )
+	{
+		__storm_error( p_thread, "REP not sent", IB_ERROR );
+		goto destroy;
+	}
+	p_rep = (mad_cm_rep_t*)p_msg->mad;
+	local_comm_id = p_rep->local_comm_id;
+	local_qpn = conn_rep_get_lcl_qpn( p_rep );
+	sim_put_sent( p_msg );
+
+	if( __storm_rand( p_thread ) < g_rej_pct )
+	{
+		cl_memclr( &rej, sizeof(rej) );
+		__storm_format_hdr( &rej.hdr, CM_REJ_ATTR_ID, comm_id );
+		rej.local_comm_id = comm_id;
+		rej.remote_comm_id = local_comm_id;
+		conn_rej_set_msg_rejected( 1, &rej );
+		rej.reason = IB_REJ_USER_DEFINED;
+		conn_rej_clr_rsvd_fields( &rej );
+		sim_recv( &rej );
+
+		status = __storm_poll( p_thread, cid, CM_REJ_ATTR_ID, NULL );
+		if( status != IB_SUCCESS )
+			__storm_error( p_thread, "REJ not delivered", status );
+		p_thread->rejects++;
+		goto destroy;
+	}
+
+	cl_memclr( &rtu, sizeof(rtu) );
+	__storm_format_hdr( &rtu.hdr, CM_RTU_ATTR_ID, comm_id );
+	rtu.local_comm_id = comm_id;
+	rtu.remote_comm_id = local_comm_id;
+	sim_recv( &rtu );
+
+	status = __storm_poll( p_thread, cid, CM_RTU_ATTR_ID, NULL );
+	if( status != IB_SUCCESS )
+	{
+		__storm_error( p_thread, "RTU not delivered", status );
+		goto destroy;
+	}
+
+	if( __storm_rand( p_thread ) < g_local_pct )
+	{
+		status = al_cep_dreq( p_thread->h_al, cid, NULL, 0 );
+		p_msg = __storm_get_sent( CM_DREQ_ATTR_ID );
+		if( status != IB_SUCCESS || !p_msg )
+		{
+			__storm_error( p_thread, "DREQ not sent", status );
+			if( p_msg )
+				sim_put_sent( p_msg );
+			goto destroy;
+		}
+		sim_put_sent( p_msg );
+
+		cl_memclr( &drep, sizeof(drep) );
+		__storm_format_hdr( &drep.hdr, CM_DREP_ATTR_ID, comm_id );
+		drep.local_comm_id = comm_id;
+		drep.remote_comm_id = local_comm_id;
+		sim_recv( &drep );
+
+		status = __storm_poll( p_thread, cid, CM_DREP_ATTR_ID, NULL );
+		if( status != IB_SUCCESS )
+			__storm_error( p_thread, "DREP not delivered", status );
+		p_thread->local_disc++;
+	}
+	else
+	{
+		cl_memclr( &dreq, sizeof(dreq) );
+		__storm_format_hdr( &dreq.hdr, CM_DREQ_ATTR_ID, comm_id );
+		dreq.local_comm_id = comm_id;
+		dreq.remote_comm_id = local_comm_id;
+		conn_dreq_set_remote_qpn( local_qpn, &dreq );
+		conn_dreq_clr_rsvd_fields( &dreq );
+		sim_recv( &dreq );
+
+		status = __storm_poll( p_thread, cid, CM_DREQ_ATTR_ID, NULL );
+		if( status == IB_SUCCESS )
+			status = al_cep_drep( p_thread->h_al, cid, NULL, 0 );
+		if( status != IB_SUCCESS )
+			__storm_error( p_thread, "DREQ not handled", status );
+	}
+
+destroy:
+	al_destroy_cep( p_thread->h_al, &cid, FALSE );
+out:
+	__storm_drain_sent();
+	sim_poll();
+	p_thread->conns++;
+}
+
+
+static DWORD WINAPI
+__storm_thread(
+	IN				LPVOID						context )
+{
+	storm_thread_t		*p_thread = (storm_thread_t*)context;
+	uint32_t			i;
+
+	while( !g_start )
+		YieldProcessor();
+
+	for( i = 0; i < g_conns; i++ )
+		__storm_connect( p_thread );
+
+	return 0;
+}
+
+
+static ib_api_status_t
+__storm_listen(
+	IN				storm_thread_t* const		p_thread )
+{
+	ib_api_status_t		status;
+	ib_cep_listen_t		listen;
+
+	p_thread->h_al = sim_open_al();
+	if( !p_thread->h_al )
+		return IB_INSUFFICIENT_MEMORY;
+
+	p_thread->listen_cid = AL_INVALID_CID;
+	status = al_create_cep( p_thread->h_al, __storm_cep_cb, p_thread, NULL,
+		&p_thread->listen_cid );
+	if( status != IB_SUCCESS )
+		return status;
+
+	cl_memclr( &listen, sizeof(listen) );
+	listen.svc_id = p_thread->sid;
+	listen.port_guid = IB_ALL_PORTS;
+	return al_cep_listen( p_thread->h_al, p_thread->listen_cid, &listen );
+}
+
+
+/* Runs the timewait timer until every connection has left timewait. */
+static uint32_t
+__storm_drain_timewait( void )
+{
+	KLOCK_QUEUE_HANDLE	hdl;
+	uint32_t			count, waited;
+
+	for( waited = 0; ; waited += 10 )
+	{
+		KeAcquireInStackQueuedSpinLock( &gp_cep_mgr->timewait_lock, &hdl );
+		count = (uint32_t)cl_qlist_count( &gp_cep_mgr->timewait_list );
+		KeReleaseInStackQueuedSpinLock( &hdl );
+		if( !count || waited >= STORM_DRAIN_MS )
+			return count;
+
+		Sleep( 10 );
+		sim_poll();
+	}
+}
+
+
+static void
+__usage( void )
+{
+	fprintf( stderr, "Usage: cmstorm [-t threads] [-n connections_per_thread]\n"
+		"               [-d dup_req_pct] [-r reject_pct] [-l local_disconnect_pct]\n" );
+	exit( 2 );
+}
+
+
+int __cdecl
+main(
+	IN				int							argc,
+	IN				char*						argv[] )
+{
+	ib_api_status_t		status;
+	LARGE_INTEGER		freq, start, end;
+	storm_thread_t		total;
+	uint32_t			i, timewait;
+	double				secs;
+	int					rc = 0;
+
+	for( i = 1; i < (uint32_t)argc; i++ )
+	{
+		if( argv[i][0] != '-' || i + 1 >= (uint32_t)argc )
+			__usage();
+
+		switch( argv[i][1] )
+		{
+		case 't':
+			g_threads = atoi( argv[++i] );
+			break;
+		case 'n':
+			g_conns = atoi( argv[++i] );
+			break;
+		case 'd':
+			g_dup_pct = atoi( argv[++i] );
+			break;
+		case 'r':
+			g_rej_pct = atoi( argv[++i] );
+			break;
+		case 'l':
+			g_local_pct = atoi( argv[++i] );
+			break;
+		default:
+			__usage();
+		}
+	}
+	if( !g_threads || g_threads > STORM_MAX_THREADS ||
+		!g_conns || g_conns >= (1 << 24) )
+	{
+		__usage();
+	}
+
+	status = sim_init();
+	if( status != IB_SUCCESS )
+	{
+		fprintf( stderr, "sim_init failed: %s\n", ib_get_err_str( status ) );
+		return 1;
+	}
+
+	for( i = 0; i < g_threads; i++ )
+	{
+		g_thread[i].index = i + 1;
+		g_thread[i].sid = cl_hton64( STORM_SID_BASE + i );
+		g_thread[i].ca_guid = cl_hton64( STORM_CA_GUID_BASE + i );
+		g_thread[i].seed = i + 1;
+		status = __storm_listen( &g_thread[i] );
+		if( status != IB_SUCCESS )
+		{
+			fprintf( stderr, "listen failed: %s\n", ib_get_err_str( status ) );
+			return 1;
+		}
+	}
+
+	for( i = 0; i < g_threads; i++ )
+	{
+		g_thread[i].h_thread =
+			CreateThread( NULL, 0, __storm_thread, &g_thread[i], 0, NULL );
+		if( !g_thread[i].h_thread )
+		{
+			fprintf( stderr, "CreateThread failed\n" );
+			return 1;
+		}
+	}
+
+	QueryPerformanceFrequency( &freq );
+	QueryPerformanceCounter( &start );
+	InterlockedExchange( &g_start, 1 );
+	for( i = 0; i < g_threads; i++ )
+	{
+		WaitForSingleObject( g_thread[i].h_thread, INFINITE );
+		CloseHandle( g_thread[i].h_thread );
+	}
+	QueryPerformanceCounter( &end );
+	secs = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+
+	cl_memclr( &total, sizeof(total) );
+	for( i = 0; i < g_threads; i++ )
+	{
+		total.conns += g_thread[i].conns;
+		total.dup_reqs += g_thread[i].dup_reqs;
+		total.rejects += g_thread[i].rejects;
+		total.local_disc += g_thread[i].local_disc;
+		total.errors += g_thread[i].errors;
+	}
+
+	printf( "%u threads, %u connections in %.3f s: %.0f conn/s, "
+		"%.2f us/conn per thread\n", g_threads, total.conns, secs,
+		total.conns / secs, secs * 1e6 * g_threads / total.conns );
+	printf( "duplicate REQs %u, rejected %u, local disconnects %u, "
+		"callbacks %d, errors %u\n", total.dup_reqs, total.rejects,
+		total.local_disc, g_cb_cnt, total.errors );
+
+	for( i = 0; i < g_threads; i++ )
+	{
+		al_destroy_cep( g_thread[i].h_al, &g_thread[i].listen_cid, FALSE );
+		sim_close_al( g_thread[i].h_al );
+	}
+
+	timewait = __storm_drain_timewait();
+	if( total.errors || timewait || sim_sends_pending() ||
+		sim_mads_outstanding() )
+	{
+		printf( "FAILED: %u errors, %u CEPs stuck in timewait, "
+			"%d sends pending, %d MADs leaked\n", total.errors, timewait,
+			sim_sends_pending(), sim_mads_outstanding() );
+		rc = 1;
+	}
+
+	return rc;
+}
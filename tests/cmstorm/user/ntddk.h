@@ -0,0 +1,536 @@
+/*
+ * Copyright (c) 2005 SilverStorm Technologies.  All rights reserved.
+ * Portions Copyright (c) 2008 Microsoft Corporation.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+/*
+ * User-mode stand-in for the kernel DDK headers.
+ *
+ * cmstorm compiles the kernel CEP manager from source as a console
+ * program.  This header supplies the small part of the kernel API it
+ * uses: spin locks map to interlocked spinning, IRQL is tracked per
+ * thread so the lock assertions still hold, timers are polled and the
+ * lookaside lists fall through to the heap.  Everything else the CEP
+ * manager calls is provided by cm_sim.c.
+ */
+
+#ifndef _CMSTORM_NTDDK_H_
+#define _CMSTORM_NTDDK_H_
+
+#define WIN32_NO_STATUS
+#include <windows.h>
+#undef WIN32_NO_STATUS
+#include <ntstatus.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <winioctl.h>
+
+#define _NTDDK_
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE						0x1000
+#endif
+
+#define DbgBreakPoint()					abort()
+#ifndef ASSERT
+#if DBG
+#define ASSERT( exp )					((exp) ? (void)0 : abort())
+#else
+#define ASSERT( exp )					((void)0)
+#endif
+#endif
+
+#define __drv_maxIRQL( x )
+#define __drv_requiresIRQL( x )
+#define __drv_when( c, a )
+#define __drv_at( e, a )
+#define __drv_savesIRQL
+#define __drv_restoresIRQL
+#define __drv_acquiresExclusiveResource( x )
+#define __drv_releasesExclusiveResource( x )
+#define _IRQL_requires_max_( x )
+#define _IRQL_requires_min_( x )
+#define _IRQL_raises_( x )
+#define _Function_class_( x )
+#define __drv_maxFunctionIRQL( x )
+#define __drv_functionClass( x )
+
+typedef LONG					NTSTATUS;
+typedef UCHAR					KIRQL, *PKIRQL;
+typedef CCHAR					KPROCESSOR_MODE;
+typedef ULONG_PTR				KSPIN_LOCK, *PKSPIN_LOCK;
+
+#define PASSIVE_LEVEL					0
+#define APC_LEVEL						1
+#define DISPATCH_LEVEL					2
+
+#define KernelMode						0
+#define UserMode						1
+
+#define NT_SUCCESS( s )					((NTSTATUS)(s) >= 0)
+
+typedef enum _POOL_TYPE
+{
+	NonPagedPool,
+	PagedPool
+
+}	POOL_TYPE;
+
+#define ExAllocatePoolWithTag( t, n, g )	malloc( n )
+#define ExAllocatePool( t, n )				malloc( n )
+#define ExFreePoolWithTag( p, g )			free( p )
+#define ExFreePool( p )						free( p )
+
+#define ProbeForRead( p, n, a )
+#define ProbeForWrite( p, n, a )
+
+#ifndef __try
+#define __try							if( 1 )
+#define __except( x )					else
+#define EXCEPTION_EXECUTE_HANDLER		1
+#endif
+
+/* IRQL is tracked per thread; nothing is actually masked. */
+extern __declspec(thread) KIRQL	g_sim_irql;
+
+static __inline KIRQL
+KeGetCurrentIrql( void )
+{
+	return g_sim_irql;
+}
+
+static __inline KIRQL
+KeRaiseIrqlToDpcLevel( void )
+{
+	KIRQL	irql = g_sim_irql;
+
+	g_sim_irql = DISPATCH_LEVEL;
+	return irql;
+}
+
+#define KeRaiseIrql( n, p )				(*(p) = g_sim_irql, g_sim_irql = (n))
+#define KeLowerIrql( n )				(g_sim_irql = (n))
+
+typedef struct _KLOCK_QUEUE_HANDLE
+{
+	struct
+	{
+		PKSPIN_LOCK		Lock;
+
+	}	LockQueue;
+	KIRQL				OldIrql;
+
+}	KLOCK_QUEUE_HANDLE, *PKLOCK_QUEUE_HANDLE;
+
+#define KeInitializeSpinLock( p )		(*(p) = 0)
+
+static __inline void
+KeAcquireSpinLockAtDpcLevel(
+	IN				PKSPIN_LOCK					p_lock )
+{
+	while( InterlockedCompareExchangePointer( (PVOID*)p_lock, (PVOID)1, NULL ) )
+	{
+		while( *(volatile KSPIN_LOCK*)p_lock )
+			YieldProcessor();
+	}
+}
+
+static __inline void
+KeReleaseSpinLockFromDpcLevel(
+	IN				PKSPIN_LOCK					p_lock )
+{
+	InterlockedExchangePointer( (PVOID*)p_lock, NULL );
+}
+
+static __inline void
+KeAcquireSpinLock(
+	IN				PKSPIN_LOCK					p_lock,
+		OUT			PKIRQL						p_irql )
+{
+	*p_irql = KeRaiseIrqlToDpcLevel();
+	KeAcquireSpinLockAtDpcLevel( p_lock );
+}
+
+static __inline void
+KeReleaseSpinLock(
+	IN				PKSPIN_LOCK					p_lock,
+	IN				KIRQL						irql )
+{
+	KeReleaseSpinLockFromDpcLevel( p_lock );
+	KeLowerIrql( irql );
+}
+
+static __inline void
+KeAcquireInStackQueuedSpinLockAtDpcLevel(
+	IN				PKSPIN_LOCK					p_lock,
+	IN				PKLOCK_QUEUE_HANDLE			p_hdl )
+{
+	p_hdl->LockQueue.Lock = p_lock;
+	KeAcquireSpinLockAtDpcLevel( p_lock );
+}
+
+static __inline void
+KeReleaseInStackQueuedSpinLockFromDpcLevel(
+	IN				PKLOCK_QUEUE_HANDLE			p_hdl )
+{
+	KeReleaseSpinLockFromDpcLevel( p_hdl->LockQueue.Lock );
+}
+
+static __inline void
+KeAcquireInStackQueuedSpinLock(
+	IN				PKSPIN_LOCK					p_lock,
+	IN				PKLOCK_QUEUE_HANDLE			p_hdl )
+{
+	p_hdl->OldIrql = KeRaiseIrqlToDpcLevel();
+	KeAcquireInStackQueuedSpinLockAtDpcLevel( p_lock, p_hdl );
+}
+
+static __inline void
+KeReleaseInStackQueuedSpinLock(
+	IN				PKLOCK_QUEUE_HANDLE			p_hdl )
+{
+	KeReleaseInStackQueuedSpinLockFromDpcLevel( p_hdl );
+	KeLowerIrql( p_hdl->OldIrql );
+}
+
+#define PsGetCurrentThread()			((PVOID)(ULONG_PTR)GetCurrentThreadId())
+#define KeGetCurrentProcessorNumber()	GetCurrentProcessorNumber()
+#define DbgPrint						printf
+#define DbgPrintEx( c, l, ... )			printf( __VA_ARGS__ )
+#define KeStallExecutionProcessor( us )	Sleep( ((us) + 999) / 1000 )
+
+typedef PVOID					PKTHREAD;
+typedef PVOID					PETHREAD;
+
+/* Time is the host clock in 100ns units, as the kernel reports it. */
+static __inline ULONGLONG
+KeQueryInterruptTime( void )
+{
+	LARGE_INTEGER	count, freq;
+
+	QueryPerformanceCounter( &count );
+	QueryPerformanceFrequency( &freq );
+	return (ULONGLONG)(count.QuadPart / freq.QuadPart) * 10000000 +
+		(ULONGLONG)(count.QuadPart % freq.QuadPart) * 10000000 /
+		freq.QuadPart;
+}
+
+static __inline LARGE_INTEGER
+KeQueryPerformanceCounter(
+		OUT			PLARGE_INTEGER				p_freq OPTIONAL )
+{
+	LARGE_INTEGER	count;
+
+	QueryPerformanceCounter( &count );
+	if( p_freq )
+		QueryPerformanceFrequency( p_freq );
+	return count;
+}
+
+static __inline NTSTATUS
+KeDelayExecutionThread(
+	IN				KPROCESSOR_MODE				mode,
+	IN				BOOLEAN						alertable,
+	IN				PLARGE_INTEGER				p_interval )
+{
+	UNREFERENCED_PARAMETER( mode );
+	UNREFERENCED_PARAMETER( alertable );
+	Sleep( (DWORD)(-p_interval->QuadPart / 10000) );
+	return STATUS_SUCCESS;
+}
+
+/*
+ * Events only need to exist: the CEP manager signals them for
+ * user-mode waiters, which the benchmark does not have.
+ */
+typedef enum _EVENT_TYPE
+{
+	NotificationEvent,
+	SynchronizationEvent
+
+}	EVENT_TYPE;
+
+typedef struct _KEVENT
+{
+	volatile LONG		state;
+
+}	KEVENT, *PKEVENT, *PRKEVENT;
+
+#define KeInitializeEvent( p, t, s )	((p)->state = (s))
+#define KeSetEvent( p, i, w )			InterlockedExchange( &(p)->state, 1 )
+#define KeClearEvent( p )				((p)->state = 0)
+#define KeResetEvent( p )				InterlockedExchange( &(p)->state, 0 )
+
+#define STANDARD_RIGHTS_ALL				0x001F0000
+#define ExEventObjectType				NULL
+#define ObReferenceObjectByHandle( h, a, t, m, pp, i )	\
+	(*(pp) = (h), STATUS_SUCCESS)
+#define ObDereferenceObject( p )
+
+/*
+ * Timers are never queued: KeWaitForSingleObject with a zero timeout
+ * reports whether the due time has passed, which is the only way the
+ * CEP manager waits on them.
+ */
+typedef struct _KDPC
+{
+	PVOID				context;
+
+}	KDPC, *PKDPC, *PRKDPC;
+
+typedef struct _KTIMER
+{
+	volatile LONGLONG	due;
+
+}	KTIMER, *PKTIMER;
+
+typedef enum _KWAIT_REASON
+{
+	Executive
+
+}	KWAIT_REASON;
+
+#define KeInitializeTimer( p )			((p)->due = 0)
+#define KeInitializeDpc( p, f, c )		((p)->context = (c))
+
+static __inline BOOLEAN
+KeSetTimer(
+	IN				PKTIMER						p_timer,
+	IN				LARGE_INTEGER				due_time,
+	IN				PKDPC						p_dpc OPTIONAL )
+{
+	UNREFERENCED_PARAMETER( p_dpc );
+	/* Absolute due times are all in the past, zero included. */
+	if( due_time.QuadPart < 0 )
+		p_timer->due = KeQueryInterruptTime() - due_time.QuadPart;
+	else
+		p_timer->due = 1;
+	return FALSE;
+}
+
+#define KeCancelTimer( p )				((p)->due = 0, FALSE)
+
+static __inline NTSTATUS
+KeWaitForSingleObject(
+	IN				PVOID						p_obj,
+	IN				KWAIT_REASON				reason,
+	IN				KPROCESSOR_MODE				mode,
+	IN				BOOLEAN						alertable,
+	IN				PLARGE_INTEGER				p_timeout OPTIONAL )
+{
+	PKTIMER		p_timer = (PKTIMER)p_obj;
+
+	UNREFERENCED_PARAMETER( reason );
+	UNREFERENCED_PARAMETER( mode );
+	UNREFERENCED_PARAMETER( alertable );
+	UNREFERENCED_PARAMETER( p_timeout );
+	if( p_timer->due && (ULONGLONG)p_timer->due <= KeQueryInterruptTime() )
+		return STATUS_SUCCESS;
+	return STATUS_TIMEOUT;
+}
+
+typedef struct _FAST_MUTEX
+{
+	KSPIN_LOCK			lock;
+	KIRQL				irql;
+
+}	FAST_MUTEX, *PFAST_MUTEX;
+
+#define ExInitializeFastMutex( p )		KeInitializeSpinLock( &(p)->lock )
+#define ExAcquireFastMutex( p )			KeAcquireSpinLock( &(p)->lock, &(p)->irql )
+#define ExReleaseFastMutex( p )			KeReleaseSpinLock( &(p)->lock, (p)->irql )
+
+typedef struct _KINTERRUPT		*PKINTERRUPT;
+#define KeAcquireInterruptSpinLock( p )	(UNREFERENCED_PARAMETER( p ), g_sim_irql)
+#define KeReleaseInterruptSpinLock( p, i )
+
+typedef LARGE_INTEGER			PHYSICAL_ADDRESS;
+
+static __inline PHYSICAL_ADDRESS
+MmGetPhysicalAddress(
+	IN				PVOID						vaddr )
+{
+	PHYSICAL_ADDRESS	pa;
+
+	pa.QuadPart = (LONGLONG)(ULONG_PTR)vaddr;
+	return pa;
+}
+
+typedef struct _NPAGED_LOOKASIDE_LIST
+{
+	SIZE_T				size;
+
+}	NPAGED_LOOKASIDE_LIST, *PNPAGED_LOOKASIDE_LIST;
+
+#define ExInitializeNPagedLookasideList( p, a, f, fl, n, t, d )	\
+	((p)->size = (n))
+#define ExDeleteNPagedLookasideList( p )
+#define ExAllocateFromNPagedLookasideList( p )	malloc( (p)->size )
+#define ExFreeToNPagedLookasideList( p, e )		free( e )
+
+/*
+ * IRPs are only queued by user-mode clients through the proxy, so the
+ * benchmark never sees one; the types are here for the code to compile.
+ */
+typedef void (*PINTERFACE_REFERENCE)( PVOID context );
+typedef void (*PINTERFACE_DEREFERENCE)( PVOID context );
+
+typedef struct _INTERFACE
+{
+	USHORT					Size;
+	USHORT					Version;
+	PVOID					Context;
+	PINTERFACE_REFERENCE	InterfaceReference;
+	PINTERFACE_DEREFERENCE	InterfaceDereference;
+
+}	INTERFACE, *PINTERFACE;
+
+typedef struct _DEVICE_OBJECT	DEVICE_OBJECT, *PDEVICE_OBJECT;
+typedef struct _FILE_OBJECT		FILE_OBJECT, *PFILE_OBJECT;
+typedef struct _MDL				MDL, *PMDL;
+
+typedef struct _IO_STATUS_BLOCK
+{
+	NTSTATUS			Status;
+	ULONG_PTR			Information;
+
+}	IO_STATUS_BLOCK;
+
+typedef struct _IRP				IRP, *PIRP;
+typedef void DRIVER_CANCEL( PDEVICE_OBJECT p_dev_obj, PIRP p_irp );
+typedef DRIVER_CANCEL			*PDRIVER_CANCEL;
+
+struct _IRP
+{
+	PMDL				MdlAddress;
+	union
+	{
+		PVOID			SystemBuffer;
+
+	}	AssociatedIrp;
+	IO_STATUS_BLOCK		IoStatus;
+	PVOID				UserBuffer;
+	KIRQL				CancelIrql;
+	BOOLEAN				Cancel;
+	PDRIVER_CANCEL		CancelRoutine;
+	union
+	{
+		struct
+		{
+			PVOID		DriverContext[4];
+			LIST_ENTRY	ListEntry;
+
+		}	Overlay;
+
+	}	Tail;
+};
+
+typedef struct _IO_STACK_LOCATION
+{
+	union
+	{
+		struct
+		{
+			ULONG		OutputBufferLength;
+			ULONG		InputBufferLength;
+			ULONG		IoControlCode;
+			PVOID		Type3InputBuffer;
+
+		}	DeviceIoControl;
+
+	}	Parameters;
+	PFILE_OBJECT		FileObject;
+
+}	IO_STACK_LOCATION, *PIO_STACK_LOCATION;
+
+typedef struct _IO_CSQ			IO_CSQ, *PIO_CSQ;
+typedef void IO_CSQ_INSERT_IRP( PIO_CSQ p_csq, PIRP p_irp );
+typedef void IO_CSQ_REMOVE_IRP( PIO_CSQ p_csq, PIRP p_irp );
+typedef PIRP IO_CSQ_PEEK_NEXT_IRP( PIO_CSQ p_csq, PIRP p_irp, PVOID context );
+typedef void IO_CSQ_ACQUIRE_LOCK( PIO_CSQ p_csq, PKIRQL p_irql );
+typedef void IO_CSQ_RELEASE_LOCK( PIO_CSQ p_csq, KIRQL irql );
+typedef void IO_CSQ_COMPLETE_CANCELED_IRP( PIO_CSQ p_csq, PIRP p_irp );
+
+struct _IO_CSQ
+{
+	PVOID				reserved[8];
+};
+
+#define IoCsqInitialize( p, a, b, c, d, e, f )	STATUS_SUCCESS
+#define IoCsqInsertIrp( p, i, c )				((void)0)
+#define IoCsqRemoveNextIrp( p, c )				((PIRP)NULL)
+#define IoCsqRemoveIrp( p, c )					((PIRP)NULL)
+
+typedef struct _IO_WORKITEM		*PIO_WORKITEM;
+
+#ifndef _NTDEF_
+typedef struct _UNICODE_STRING
+{
+	USHORT				Length;
+	USHORT				MaximumLength;
+	PWSTR				Buffer;
+
+}	UNICODE_STRING, *PUNICODE_STRING;
+#endif
+
+#define InitializeListHead( h )			((h)->Flink = (h)->Blink = (h))
+#define IsListEmpty( h )				((h)->Flink == (h))
+
+static __inline void
+InsertTailList(
+	IN				PLIST_ENTRY					p_head,
+	IN				PLIST_ENTRY					p_entry )
+{
+	p_entry->Flink = p_head;
+	p_entry->Blink = p_head->Blink;
+	p_head->Blink->Flink = p_entry;
+	p_head->Blink = p_entry;
+}
+
+static __inline BOOLEAN
+RemoveEntryList(
+	IN				PLIST_ENTRY					p_entry )
+{
+	p_entry->Blink->Flink = p_entry->Flink;
+	p_entry->Flink->Blink = p_entry->Blink;
+	return p_entry->Flink == p_entry->Blink;
+}
+
+#define IO_NO_INCREMENT					0
+#define IO_NETWORK_INCREMENT			2
+#define IoGetCurrentIrpStackLocation( p )	((PIO_STACK_LOCATION)NULL)
+#define IoMarkIrpPending( p )
+#define IoSetCancelRoutine( p, r )		\
+	((PDRIVER_CANCEL)InterlockedExchangePointer( (PVOID*)&(p)->CancelRoutine, (PVOID)(r) ))
+#define IoReleaseCancelSpinLock( i )
+#define IoCompleteRequest( p, i )
+
+#endif	/* _CMSTORM_NTDDK_H_ */
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2008 Mellanox Technologies.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Abstract:
+ *	Internet checksum benchmark.
+ *
+ *	Times ipoib_csum_add, which the data path uses for software checksums,
+ *	against the 32-bit word loop it falls back to without vector support,
+ *	for buffer sizes from a TCP ACK to a 64KB coalesced receive.
+ *
+ *	Before timing, sums of every length up to a few blocks, at every
+ *	alignment, of large buffers that need several lane folds, and of
+ *	buffers split at odd offsets are checked against a byte-wise
+ *	reference.
+ *
+ * Environment:
+ *	User Mode
+ */
+
+
+#include <string.h>
+#include "ipoib_csum.h"
+#include "ipoibbench.h"
+
+
+/* Longest buffer checked: several IPOIB_CSUM_MAX_BLOCKS runs. */
+#define CSUM_CHECK_LEN		(3 * IPOIB_CSUM_MAX_BLOCKS * IPOIB_CSUM_BLOCK + 77)
+
+#define CSUM_MAX_LEN		(64 * 1024)
+
+
+#if defined( IPOIB_CSUM_AVX2 )
+#define CSUM_PATH			"AVX2"
+#elif defined( IPOIB_CSUM_SSE2 )
+#define CSUM_PATH			"SSE2"
+#else
+#define CSUM_PATH			"32-bit words"
+#endif
+
+
+static const uint32_t	g_sizes[] = { 64, 256, 1500, 2044, 4096, 9000, CSUM_MAX_LEN };
+
+static uint32_t			g_mb = 256;
+
+/*
+ * The timed loops read the buffer through g_p_buf and store their result
+ * in g_sink, so the sums can't be hoisted out of the loop or eliminated.
+ */
+static const uint8_t* volatile	g_p_buf;
+static volatile uint32_t		g_sink;
+
+
+/* ipoib_csum_add without the vector loop. */
+static uint32_t
+__csum_words(
+	IN				uint32_t					sum,
+	IN		const	void*						p_data,
+	IN				uint32_t					len )
+{
+	const uint8_t	*p = (const uint8_t*)p_data;
+	uint64_t		acc = sum;
+
+	while( len >= sizeof(uint32_t) )
+	{
+		acc += *(const ipoib_csum_u32_t*)p;
+		p += sizeof(uint32_t);
+		len -= sizeof(uint32_t);
+	}
+	if( len >= sizeof(uint16_t) )
+	{
+		acc += *(const ipoib_csum_u16_t*)p;
+		p += sizeof(uint16_t);
+		len -= sizeof(uint16_t);
+	}
+	if( len )
+		acc += *p;
+
+	acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+	acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+	return (uint32_t)acc;
+}
+
+
+/*
+ * Returns the folded sum of a buffer in network order, comparable with
+ * bench_csum_ref.
+ */
+static uint16_t
+__csum_net(
+	IN				uint32_t					sum )
+{
+	return cl_ntoh16( ipoib_csum_fold( sum ) );
+}
+
+
+/* Returns the number of failed checks. */
+static uint32_t
+__csum_check(
+	IN				uint8_t* const				p_buf )
+{
+	uint32_t	len, align, split, sum, seed = 1;
+	uint32_t	errors = 0;
+
+	for( len = 0; len < CSUM_CHECK_LEN + 8; len++ )
+		p_buf[len] = (uint8_t)bench_rand( &seed );
+
+	for( align = 0; align < 8; align++ )
+	{
+		for( len = 0; len <= 4 * IPOIB_CSUM_BLOCK + 3; len++ )
+		{
+			if( __csum_net( ipoib_csum_add( 0, p_buf + align, len ) ) !=
+				bench_csum_ref( 0, p_buf + align, len ) )
+			{
+				errors++;
+				fprintf( stderr, "check: sum of %u bytes at offset %u\n", len, align );
+			}
+		}
+
+		if( __csum_net( ipoib_csum_add( 0, p_buf + align, CSUM_CHECK_LEN ) ) !=
+			bench_csum_ref( 0, p_buf + align, CSUM_CHECK_LEN ) )
+		{
+			errors++;
+			fprintf( stderr, "check: sum of %u bytes at offset %u\n",
+				CSUM_CHECK_LEN, align );
+		}
+	}
+
+	/* Nonzero starting sum, the same in either byte order. */
+	if( __csum_net( ipoib_csum_add( 0xABABABAB, p_buf, 1500 ) ) !=
+		bench_csum_ref( 0xABAB + 0xABAB, p_buf, 1500 ) )
+	{
+		errors++;
+		fprintf( stderr, "check: sum with a starting value\n" );
+	}
+
+	/* Buffers split at odd offsets of the checksummed data. */
+	for( split = 1; split < 2 * IPOIB_CSUM_BLOCK; split += 2 )
+	{
+		sum = ipoib_csum_add( 0, p_buf, split - 1 );
+		sum = ipoib_csum_add_at( sum, p_buf + split - 1, 1, split - 1 );
+		sum = ipoib_csum_add_at( sum, p_buf + split, 4000 - split, split );
+		if( __csum_net( sum ) != bench_csum_ref( 0, p_buf, 4000 ) )
+		{
+			errors++;
+			fprintf( stderr, "check: buffer split at offset %u\n", split );
+		}
+	}
+
+	/* Largest lane values. */
+	cl_memset( p_buf, 0xFF, CSUM_CHECK_LEN );
+	if( __csum_net( ipoib_csum_add( 0, p_buf, CSUM_CHECK_LEN ) ) !=
+		bench_csum_ref( 0, p_buf, CSUM_CHECK_LEN ) )
+	{
+		errors++;
+		fprintf( stderr, "check: sum of all ones\n" );
+	}
+
+	return errors;
+}
+
+
+/* Returns ns per sum of len bytes. */
+static double
+__csum_time(
+	IN				uint32_t					len,
+	IN				boolean_t					words )
+{
+	LARGE_INTEGER	start, end;
+	uint32_t		i, iters, sum = 0;
+
+	iters = (uint32_t)(((uint64_t)g_mb << 20) / len);
+	if( !iters )
+		iters = 1;
+
+	QueryPerformanceCounter( &start );
+	if( words )
+	{
+		for( i = 0; i < iters; i++ )
+			sum += __csum_words( 0, g_p_buf, len );
+	}
+	else
+	{
+		for( i = 0; i < iters; i++ )
+			sum += ipoib_csum_add( 0, g_p_buf, len );
+	}
+	QueryPerformanceCounter( &end );
+
+	g_sink = sum;
+	return bench_ns( &start, &end ) / iters;
+}
+
+
+static void
+__csum_usage( void )
+{
+	fprintf( stderr, "Usage: ipoibbench csum [-m MB_per_size]\n" );
+	exit( 2 );
+}
+
+
+int
+csum_bench(
+	IN				int							argc,
+	IN				char*						argv[] )
+{
+	uint8_t		*p_buf;
+	uint32_t	i, errors;
+	double		ns_vec, ns_words;
+
+	for( i = 1; i < (uint32_t)argc; i++ )
+	{
+		if( argv[i][0] != '-' || i + 1 >= (uint32_t)argc )
+			__csum_usage();
+
+		switch( argv[i][1] )
+		{
+		case 'm':
+			g_mb = atoi( argv[++i] );
+			break;
+		default:
+			__csum_usage();
+		}
+	}
+	if( !g_mb )
+		__csum_usage();
+
+	p_buf = (uint8_t*)cl_malloc( CSUM_CHECK_LEN + 8 );
+	if( !p_buf )
+	{
+		fprintf( stderr, "initialization failed\n" );
+		return 1;
+	}
+
+	errors = __csum_check( p_buf );
+	if( errors )
+	{
+		cl_free( p_buf );
+		printf( "FAILED: %u errors\n", errors );
+		return 1;
+	}
+
+	g_p_buf = p_buf;
+	printf( "ipoib_csum_add uses %s\n", CSUM_PATH );
+	printf( "%6s %12s %8s %12s %8s %8s\n",
+		"bytes", "ns/buffer", "GB/s", "words ns", "GB/s", "speedup" );
+	for( i = 0; i < sizeof(g_sizes) / sizeof(g_sizes[0]); i++ )
+	{
+		ns_vec = __csum_time( g_sizes[i], FALSE );
+		ns_words = __csum_time( g_sizes[i], TRUE );
+		printf( "%6u %12.1f %8.2f %12.1f %8.2f %7.2fx\n", g_sizes[i],
+			ns_vec, g_sizes[i] / ns_vec, ns_words, g_sizes[i] / ns_words,
+			ns_words / ns_vec );
+	}
+
+	cl_free( p_buf );
+	return 0;
+}
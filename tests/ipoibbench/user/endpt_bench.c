@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2008 Mellanox Technologies.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Abstract:
+ *	Endpoint lookup benchmark.
+ *
+ *	Compares the send path's MAC to endpoint lookup through the
+ *	per-processor cache in ipoib_endpt_cache.h with the lookup in the
+ *	MAC map under the port lock that it replaces.  Each thread stands in
+ *	for one processor and looks up endpoints from a working set, taking
+ *	and dropping a reference like __endpt_mgr_ref.  With -r, thread 0
+ *	periodically takes an endpoint outside the working set out of the map
+ *	and puts it back, the way ARP updates and the multicast garbage
+ *	collector do.  Every removal invalidates all caches, so invalidations
+ *	and refills become part of the measurement, while every lookup must
+ *	still find its endpoint.
+ *
+ *	Before timing, the invalidation protocol is checked: fills are blocked
+ *	while a removal is in progress, and a removed endpoint is never
+ *	returned from the cache.
+ *
+ * Environment:
+ *	User Mode
+ */
+
+
+#include <string.h>
+#include <complib/cl_qmap.h>
+#include <complib/cl_spinlock.h>
+#include "ipoib_endpt_cache.h"
+#include "ipoibbench.h"
+
+
+#define ENDPT_MAX_THREADS	IPOIB_ENDPT_CACHE_MAX_CPUS
+
+
+/* Stand-in for the driver's endpoint: what the lookup touches. */
+typedef struct _ipoib_endpt
+{
+	cl_map_item_t			mac_item;
+	uint64_t				key;
+	atomic32_t				ref_cnt;
+	boolean_t				in_map;
+
+}	ipoib_endpt_t;
+
+
+/* Stand-in for the port object's endpoint manager state. */
+typedef struct _endpt_port
+{
+	cl_spinlock_t			lock;
+	cl_qmap_t				mac_endpts;
+	ipoib_endpt_cache_t		cache;
+	atomic32_t				endpt_rdr;
+
+}	endpt_port_t;
+
+
+typedef struct _endpt_thread
+{
+	HANDLE					h_thread;
+	uint32_t				cpu;
+	uint32_t				seed;
+	uint32_t				hits;
+	uint32_t				lookups;
+	uint32_t				removals;
+	uint32_t				errors;
+
+}	endpt_thread_t;
+
+
+static uint32_t				g_threads = 1;
+static uint32_t				g_endpts = 4096;
+static uint32_t				g_working_set = 64;
+static uint32_t				g_iters = 2000000;
+static uint32_t				g_remove_every = 0;
+
+static endpt_port_t			g_port;
+static ipoib_endpt_t		*g_endpt;
+static boolean_t			g_use_cache;
+static volatile LONG		g_start;
+static endpt_thread_t		g_thread[ENDPT_MAX_THREADS];
+
+
+/*
+ * Key of endpoint i: a locally administered MAC whose low three bytes
+ * hold a QPN, copied into a uint64_t like the driver's map keys.
+ */
+static uint64_t
+__endpt_key(
+	IN				uint32_t					i )
+{
+	uint8_t		mac[6];
+	uint64_t	key = 0;
+	uint32_t	qpn = 0x000048 + i;
+
+	mac[0] = 0x02;
+	mac[1] = 0x00;
+	mac[2] = 0x00;
+	mac[3] = (uint8_t)(qpn >> 16);
+	mac[4] = (uint8_t)(qpn >> 8);
+	mac[5] = (uint8_t)qpn;
+	memcpy( &key, mac, sizeof(mac) );
+	return key;
+}
+
+
+static ipoib_endpt_t*
+__endpt_map_ref(
+	IN				endpt_port_t* const			p_port,
+	IN				uint64_t					key )
+{
+	cl_map_item_t	*p_item;
+	ipoib_endpt_t	*p_endpt = NULL;
+
+	cl_spinlock_acquire( &p_port->lock );
+	p_item = cl_qmap_get( &p_port->mac_endpts, key );
+	if( p_item != cl_qmap_end( &p_port->mac_endpts ) )
+	{
+		p_endpt = PARENT_STRUCT( p_item, ipoib_endpt_t, mac_item );
+		cl_atomic_inc( &p_endpt->ref_cnt );
+	}
+	cl_spinlock_release( &p_port->lock );
+	return p_endpt;
+}
+
+
+/* Same steps as __endpt_cache_get and the slow path of __endpt_mgr_ref. */
+static ipoib_endpt_t*
+__endpt_cache_ref(
+	IN				endpt_port_t* const			p_port,
+	IN				uint32_t					cpu,
+	IN				uint64_t					key,
+		OUT			boolean_t* const			p_hit )
+{
+	ipoib_endpt_cache_entry_t	*p_entry;
+	ipoib_endpt_t				*p_endpt = NULL;
+	cl_map_item_t				*p_item;
+
+	p_entry = ipoib_endpt_cache_entry( &p_port->cache, cpu, key );
+	if( p_entry && p_entry->key == key )
+	{
+		cl_atomic_inc( &p_port->endpt_rdr );
+		p_endpt = ipoib_endpt_cache_lookup( &p_port->cache, p_entry, key );
+		if( p_endpt )
+			cl_atomic_inc( &p_endpt->ref_cnt );
+		cl_atomic_dec( &p_port->endpt_rdr );
+	}
+
+	*p_hit = (p_endpt != NULL);
+	if( p_endpt )
+		return p_endpt;
+
+	cl_spinlock_acquire( &p_port->lock );
+	p_item = cl_qmap_get( &p_port->mac_endpts, key );
+	if( p_item != cl_qmap_end( &p_port->mac_endpts ) )
+	{
+		p_endpt = PARENT_STRUCT( p_item, ipoib_endpt_t, mac_item );
+		cl_atomic_inc( &p_endpt->ref_cnt );
+		ipoib_endpt_cache_fill( &p_port->cache, cpu, key, p_endpt );
+	}
+	cl_spinlock_release( &p_port->lock );
+	return p_endpt;
+}
+
+
+/*
+ * Invalidates the caches and waits for readers with the lock held, as the
+ * driver's removal paths do.  The caller removes endpoints and unblocks.
+ */
+static void
+__endpt_remove_begin(
+	IN				endpt_port_t* const			p_port )
+{
+	cl_spinlock_acquire( &p_port->lock );
+	ipoib_endpt_cache_invalidate( &p_port->cache );
+	while( p_port->endpt_rdr )
+	{
+		cl_spinlock_release( &p_port->lock );
+		cl_spinlock_acquire( &p_port->lock );
+	}
+}
+
+
+static void
+__endpt_remove_end(
+	IN				endpt_port_t* const			p_port )
+{
+	ipoib_endpt_cache_unblock( &p_port->cache );
+	cl_spinlock_release( &p_port->lock );
+}
+
+
+static void
+__endpt_remove(
+	IN				endpt_port_t* const			p_port,
+	IN				ipoib_endpt_t* const		p_endpt )
+{
+	__endpt_remove_begin( p_port );
+	cl_qmap_remove_item( &p_port->mac_endpts, &p_endpt->mac_item );
+	p_endpt->in_map = FALSE;
+	__endpt_remove_end( p_port );
+}
+
+
+static void
+__endpt_insert(
+	IN				endpt_port_t* const			p_port,
+	IN				ipoib_endpt_t* const		p_endpt )
+{
+	cl_spinlock_acquire( &p_port->lock );
+	cl_qmap_insert( &p_port->mac_endpts, p_endpt->key, &p_endpt->mac_item );
+	p_endpt->in_map = TRUE;
+	cl_spinlock_release( &p_port->lock );
+}
+
+
+/*
+ * Checks the invalidation protocol on processor 0's cache.  Returns the
+ * number of failed checks.
+ */
+static uint32_t
+__endpt_check( void )
+{
+	ipoib_endpt_t	*p_endpt, *p_ref;
+	boolean_t		hit;
+	uint32_t		errors = 0;
+
+	p_endpt = &g_endpt[0];
+
+	p_ref = __endpt_cache_ref( &g_port, 0, p_endpt->key, &hit );
+	if( p_ref != p_endpt || hit )
+		errors++, fprintf( stderr, "check: first lookup should miss\n" );
+	if( p_ref )
+		cl_atomic_dec( &p_ref->ref_cnt );
+
+	p_ref = __endpt_cache_ref( &g_port, 0, p_endpt->key, &hit );
+	if( p_ref != p_endpt || !hit )
+		errors++, fprintf( stderr, "check: second lookup should hit\n" );
+	if( p_ref )
+		cl_atomic_dec( &p_ref->ref_cnt );
+
+	/*
+	 * A send that looks the endpoint up while the removal waits for
+	 * readers must not put it back in the cache.
+	 */
+	__endpt_remove_begin( &g_port );
+	ipoib_endpt_cache_fill( &g_port.cache, 0, p_endpt->key, p_endpt );
+	if( ipoib_endpt_cache_lookup( &g_port.cache,
+		ipoib_endpt_cache_entry( &g_port.cache, 0, p_endpt->key ),
+		p_endpt->key ) )
+	{
+		errors++, fprintf( stderr, "check: cache filled during removal\n" );
+	}
+	cl_qmap_remove_item( &g_port.mac_endpts, &p_endpt->mac_item );
+	p_endpt->in_map = FALSE;
+	__endpt_remove_end( &g_port );
+
+	p_ref = __endpt_cache_ref( &g_port, 0, p_endpt->key, &hit );
+	if( p_ref )
+	{
+		errors++, fprintf( stderr, "check: removed endpoint returned\n" );
+		cl_atomic_dec( &p_ref->ref_cnt );
+	}
+
+	__endpt_insert( &g_port, p_endpt );
+	p_ref = __endpt_cache_ref( &g_port, 0, p_endpt->key, &hit );
+	if( p_ref != p_endpt || hit )
+		errors++, fprintf( stderr, "check: lookup after reinsert should miss\n" );
+	if( p_ref )
+		cl_atomic_dec( &p_ref->ref_cnt );
+
+	p_ref = __endpt_cache_ref( &g_port, 0, p_endpt->key, &hit );
+	if( p_ref != p_endpt || !hit )
+		errors++, fprintf( stderr, "check: cache not refilled after removal\n" );
+	if( p_ref )
+		cl_atomic_dec( &p_ref->ref_cnt );
+
+	return errors;
+}
+
+
+static DWORD WINAPI
+__endpt_thread(
+	IN				LPVOID						context )
+{
+	endpt_thread_t	*p_thread = (endpt_thread_t*)context;
+	ipoib_endpt_t	*p_endpt, *p_ref, *p_victim;
+	uint32_t		i, idx;
+	boolean_t		hit = FALSE;
+
+	while( !g_start )
+		;
+
+	for( i = 0; i < g_iters; i++ )
+	{
+		idx = bench_rand( &p_thread->seed ) % g_working_set;
+		p_endpt = &g_endpt[idx];
+
+		if( g_remove_every && !p_thread->cpu && !(i % g_remove_every) )
+		{
+			p_victim = &g_endpt[g_working_set +
+				p_thread->removals % (g_endpts - g_working_set)];
+			__endpt_remove( &g_port, p_victim );
+			__endpt_insert( &g_port, p_victim );
+			p_thread->removals++;
+		}
+
+		if( g_use_cache )
+			p_ref = __endpt_cache_ref( &g_port, p_thread->cpu, p_endpt->key, &hit );
+		else
+			p_ref = __endpt_map_ref( &g_port, p_endpt->key );
+
+		if( p_ref != p_endpt )
+		{
+			p_thread->errors++;
+			if( p_ref )
+				cl_atomic_dec( &p_ref->ref_cnt );
+			continue;
+		}
+
+		p_thread->lookups++;
+		if( hit )
+			p_thread->hits++;
+		cl_atomic_dec( &p_ref->ref_cnt );
+	}
+	return 0;
+}
+
+
+static uint32_t
+__endpt_run(
+	IN				boolean_t					use_cache )
+{
+	LARGE_INTEGER	start, end;
+	endpt_thread_t	total;
+	uint32_t		i;
+	double			ns;
+
+	g_use_cache = use_cache;
+	g_start = 0;
+	for( i = 0; i < g_threads; i++ )
+	{
+		cl_memclr( &g_thread[i], sizeof(g_thread[i]) );
+		g_thread[i].cpu = i;
+		g_thread[i].seed = i + 1;
+		g_thread[i].h_thread =
+			CreateThread( NULL, 0, __endpt_thread, &g_thread[i], 0, NULL );
+		if( !g_thread[i].h_thread )
+		{
+			fprintf( stderr, "CreateThread failed\n" );
+			exit( 1 );
+		}
+	}
+
+	QueryPerformanceCounter( &start );
+	InterlockedExchange( &g_start, 1 );
+	for( i = 0; i < g_threads; i++ )
+	{
+		WaitForSingleObject( g_thread[i].h_thread, INFINITE );
+		CloseHandle( g_thread[i].h_thread );
+	}
+	QueryPerformanceCounter( &end );
+	ns = bench_ns( &start, &end );
+
+	cl_memclr( &total, sizeof(total) );
+	for( i = 0; i < g_threads; i++ )
+	{
+		total.hits += g_thread[i].hits;
+		total.lookups += g_thread[i].lookups;
+		total.removals += g_thread[i].removals;
+		total.errors += g_thread[i].errors;
+	}
+
+	printf( "%-5s %2u threads: %7.1f ns/lookup per thread, %5.1f%% cache hits, "
+		"%u removals\n", use_cache ? "cache" : "map", g_threads,
+		ns / g_iters, total.lookups ?
+		100.0 * total.hits / total.lookups : 0.0, total.removals );
+	if( total.errors )
+		fprintf( stderr, "%u lookups did not find their endpoint\n", total.errors );
+	return total.errors;
+}
+
+
+static void
+__endpt_usage( void )
+{
+	fprintf( stderr, "Usage: ipoibbench endpt [-t threads] [-n endpoints]\n"
+		"                      [-w working_set] [-i iterations] "
+		"[-r remove_every]\n" );
+	exit( 2 );
+}
+
+
+int
+endpt_bench(
+	IN				int							argc,
+	IN				char*						argv[] )
+{
+	uint32_t		i, errors;
+
+	for( i = 1; i < (uint32_t)argc; i++ )
+	{
+		if( argv[i][0] != '-' || i + 1 >= (uint32_t)argc )
+			__endpt_usage();
+
+		switch( argv[i][1] )
+		{
+		case 't':
+			g_threads = atoi( argv[++i] );
+			break;
+		case 'n':
+			g_endpts = atoi( argv[++i] );
+			break;
+		case 'w':
+			g_working_set = atoi( argv[++i] );
+			break;
+		case 'i':
+			g_iters = atoi( argv[++i] );
+			break;
+		case 'r':
+			g_remove_every = atoi( argv[++i] );
+			break;
+		default:
+			__endpt_usage();
+		}
+	}
+	if( !g_threads || g_threads > ENDPT_MAX_THREADS || !g_endpts ||
+		!g_working_set || g_working_set > g_endpts || !g_iters ||
+		(g_remove_every && g_working_set == g_endpts) )
+	{
+		__endpt_usage();
+	}
+
+	g_endpt = (ipoib_endpt_t*)cl_zalloc( sizeof(ipoib_endpt_t) * g_endpts );
+	if( !g_endpt || cl_spinlock_init( &g_port.lock ) != CL_SUCCESS ||
+		!ipoib_endpt_cache_init( &g_port.cache, g_threads ) )
+	{
+		fprintf( stderr, "initialization failed\n" );
+		return 1;
+	}
+	cl_qmap_init( &g_port.mac_endpts );
+	for( i = 0; i < g_endpts; i++ )
+	{
+		g_endpt[i].key = __endpt_key( i );
+		__endpt_insert( &g_port, &g_endpt[i] );
+	}
+
+	errors = __endpt_check();
+	errors += __endpt_run( FALSE );
+	errors += __endpt_run( TRUE );
+
+	for( i = 0; i < g_endpts; i++ )
+	{
+		if( g_endpt[i].ref_cnt )
+			errors++;
+	}
+
+	ipoib_endpt_cache_destroy( &g_port.cache );
+	cl_spinlock_destroy( &g_port.lock );
+	cl_free( g_endpt );
+
+	if( errors )
+	{
+		printf( "FAILED: %u errors\n", errors );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,601 @@
+/*
+ * Copyright (c) 2008 Mellanox Technologies.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Abstract:
+ *	Software segmentation and receive coalescing benchmark.
+ *
+ *	Segments a large TCP send with ipoib_gso_build_hdr, the way the send
+ *	path does when the HCA can't do LSO, and coalesces the segments back
+ *	with the ipoib_gro_* functions, the way the receive path does.  Both
+ *	are timed per send, including the payload copy and checksum.
+ *
+ *	Before timing, the results are checked against a byte-wise reference
+ *	checksum: every segment header (lengths, IP identification, sequence
+ *	numbers, flags and both checksums), the partial checksum left for the
+ *	HCA, the packets that must not be segmented or coalesced, and the
+ *	coalesced packet, which must be the original send.
+ *
+ * Environment:
+ *	User Mode
+ */
+
+
+#include <string.h>
+#include "ipoib_gso.h"
+#include "ipoibbench.h"
+
+
+/* TCP timestamp option, padded: what most large sends carry. */
+#define GSO_OPT_LEN			12
+#define GSO_HDR_LEN			(sizeof(ip_hdr_t) + sizeof(tcp_hdr_t) + GSO_OPT_LEN)
+
+#define GSO_SEQ				0xFFFFF000
+#define GSO_IP_ID			0xFFF0
+
+/* MTUs accepted; segments are built in GSO_MAX_MTU byte slots. */
+#define GSO_MIN_MTU			576
+#define GSO_MAX_MTU			4096
+#define GSO_MAX_SEGS		(IPOIB_GRO_MAX_LEN / (GSO_MIN_MTU - GSO_HDR_LEN) + 2)
+
+
+typedef enum _gso_op
+{
+	GSO_OP_SEGMENT,
+	GSO_OP_SEGMENT_PARTIAL,
+	GSO_OP_COALESCE
+
+}	gso_op_t;
+
+
+typedef struct _gso_seg
+{
+	uint8_t					*p_ip;
+	uint32_t				len;
+
+}	gso_seg_t;
+
+
+static uint32_t		g_iters = 20000;
+static uint32_t		g_mtu = 2044;
+static uint32_t		g_len = 64000;
+
+static uint8_t		g_send[IPOIB_GRO_MAX_LEN];
+static uint8_t		g_coal[IPOIB_GRO_MAX_LEN];
+static uint8_t		g_seg_buf[GSO_MAX_SEGS][GSO_MAX_MTU];
+static gso_seg_t	g_seg[GSO_MAX_SEGS];
+
+
+/* Returns the folded sum of the TCP pseudo header, in host order. */
+static uint16_t
+__ref_pseudo(
+	IN		const	uint8_t*					p_ip,
+	IN				uint32_t					tcp_len )
+{
+	uint32_t	sum;
+
+	sum = bench_csum_ref( 0, p_ip + 12, 8 );
+	return bench_csum_ref( sum + IP_PROT_TCP + tcp_len, NULL, 0 );
+}
+
+
+/* Checks the IP and TCP checksums of a whole packet. */
+static boolean_t
+__ref_valid(
+	IN		const	uint8_t*					p_ip )
+{
+	const ip_hdr_t	*p_ip_hdr = (const ip_hdr_t*)p_ip;
+	uint32_t		ip_len, ip_hdr_len;
+
+	ip_len = cl_ntoh16( p_ip_hdr->length );
+	ip_hdr_len = IP_HEADER_LENGTH( p_ip_hdr );
+	if( bench_csum_ref( 0, p_ip, ip_hdr_len ) != 0xFFFF )
+		return FALSE;
+
+	return bench_csum_ref( __ref_pseudo( p_ip, ip_len - ip_hdr_len ),
+		p_ip + ip_hdr_len, ip_len - ip_hdr_len ) == 0xFFFF;
+}
+
+
+/*
+ * Builds a TCP send of payload_len bytes at p_ip, as the stack hands it to
+ * the driver with checksums offloaded: neither checksum is set.
+ */
+static uint32_t
+__build_send(
+	IN				uint8_t* const				p_ip,
+	IN				uint32_t					payload_len,
+	IN				uint8_t						flags,
+	IN				uint32_t					seed )
+{
+	ip_hdr_t	*p_ip_hdr = (ip_hdr_t*)p_ip;
+	tcp_hdr_t	*p_tcp_hdr = (tcp_hdr_t*)(p_ip + sizeof(ip_hdr_t));
+	uint8_t		*p_opt = (uint8_t*)(p_tcp_hdr + 1);
+	uint32_t	hdr_len, i;
+
+	hdr_len = GSO_HDR_LEN;
+	cl_memclr( p_ip, hdr_len );
+
+	p_ip_hdr->ver_hl = 0x45;
+	p_ip_hdr->length = cl_hton16( (uint16_t)(hdr_len + payload_len) );
+	p_ip_hdr->id = cl_hton16( GSO_IP_ID );
+	p_ip_hdr->offset_flags = CL_HTON16( 0x4000 );
+	p_ip_hdr->ttl = 64;
+	p_ip_hdr->prot = IP_PROT_TCP;
+	p_ip_hdr->src_ip = CL_HTON32( 0x0A000001 );
+	p_ip_hdr->dst_ip = CL_HTON32( 0x0A000002 );
+
+	p_tcp_hdr->src_port = CL_HTON16( 50000 );
+	p_tcp_hdr->dst_port = CL_HTON16( 5001 );
+	p_tcp_hdr->seq_num = cl_hton32( GSO_SEQ );
+	p_tcp_hdr->ack_num = CL_HTON32( 0x00C0FFEE );
+	p_tcp_hdr->offset = (uint8_t)(((sizeof(tcp_hdr_t) + GSO_OPT_LEN) / 4) << 4);
+	p_tcp_hdr->flags = flags;
+	p_tcp_hdr->window = CL_HTON16( 0x8000 );
+
+	/* NOP, NOP, timestamp. */
+	p_opt[0] = 1;
+	p_opt[1] = 1;
+	p_opt[2] = 8;
+	p_opt[3] = 10;
+	for( i = 4; i < GSO_OPT_LEN; i++ )
+		p_opt[i] = (uint8_t)i;
+
+	for( i = 0; i < payload_len; i++ )
+		p_ip[hdr_len + i] = (uint8_t)(bench_rand( &seed ) >> 4);
+
+	return hdr_len + payload_len;
+}
+
+
+/* Sets both checksums of a packet built by __build_send. */
+static void
+__csum_send(
+	IN				uint8_t* const				p_ip )
+{
+	ip_hdr_t	*p_ip_hdr = (ip_hdr_t*)p_ip;
+	tcp_hdr_t	*p_tcp_hdr = (tcp_hdr_t*)(p_ip + sizeof(ip_hdr_t));
+	uint32_t	tcp_len;
+
+	tcp_len = cl_ntoh16( p_ip_hdr->length ) - sizeof(ip_hdr_t);
+	p_ip_hdr->chksum = 0;
+	p_ip_hdr->chksum =
+		cl_hton16( (uint16_t)~bench_csum_ref( 0, p_ip, sizeof(ip_hdr_t) ) );
+	p_tcp_hdr->chksum = 0;
+	p_tcp_hdr->chksum = cl_hton16( (uint16_t)~bench_csum_ref(
+		__ref_pseudo( p_ip, tcp_len ), (uint8_t*)p_tcp_hdr, tcp_len ) );
+}
+
+
+/*
+ * Segments the send at g_send into g_seg_buf and returns the number of
+ * segments.
+ */
+static uint32_t
+__segment(
+	IN		const	ipoib_gso_t* const			p_gso,
+	IN				boolean_t					partial )
+{
+	const uint8_t	*p_payload = g_send + p_gso->hdr_len;
+	uint8_t			*p_seg;
+	uint32_t		seg, seg_len, payload_sum = 0;
+
+	for( seg = 0; seg < p_gso->n_segs; seg++ )
+	{
+		p_seg = g_seg_buf[seg];
+		seg_len = ipoib_gso_seg_len( p_gso, seg );
+
+		cl_memcpy( p_seg + p_gso->hdr_len, p_payload, seg_len );
+		if( !partial )
+			payload_sum = ipoib_csum_add( 0, p_seg + p_gso->hdr_len, seg_len );
+		ipoib_gso_build_hdr( p_gso, seg, payload_sum, partial, p_seg );
+
+		g_seg[seg].p_ip = p_seg;
+		g_seg[seg].len = p_gso->hdr_len + seg_len;
+		p_payload += seg_len;
+	}
+	return p_gso->n_segs;
+}
+
+
+/*
+ * Coalesces n_segs segments into g_coal.  Returns the number of segments
+ * merged into the first packet.
+ */
+static uint32_t
+__coalesce(
+	IN				uint32_t					n_segs )
+{
+	ipoib_gro_t		gro;
+	ipoib_gro_seg_t	seg;
+	uint32_t		i;
+
+	if( !ipoib_gro_parse( g_seg[0].p_ip, g_seg[0].len, &seg ) ||
+		!ipoib_gro_start( &gro, g_coal, sizeof(g_coal), g_seg[0].p_ip, &seg ) )
+	{
+		return 0;
+	}
+
+	for( i = 1; i < n_segs; i++ )
+	{
+		if( !ipoib_gro_parse( g_seg[i].p_ip, g_seg[i].len, &seg ) ||
+			!ipoib_gro_match( &gro, g_seg[i].p_ip, &seg ) ||
+			!ipoib_gro_append( &gro, g_seg[i].p_ip, &seg ) )
+		{
+			break;
+		}
+	}
+
+	ipoib_gro_finish( &gro );
+	return gro.n_segs;
+}
+
+
+#define GSO_CHECK( cond, msg )	\
+	if( !(cond) ) { errors++; fprintf( stderr, "check: %s\n", msg ); }
+
+/*
+ * Segments sends of several lengths at the given MTU and checks every
+ * segment header.  Returns the number of failed checks.
+ */
+static uint32_t
+__gso_check_mtu(
+	IN				uint32_t					mtu )
+{
+	static const uint8_t	send_flags[] = {
+		IPOIB_TCP_ACK,
+		IPOIB_TCP_ACK | IPOIB_TCP_PSH,
+		IPOIB_TCP_ACK | IPOIB_TCP_PSH | IPOIB_TCP_FIN | IPOIB_TCP_CWR
+	};
+	ipoib_gso_t		gso;
+	const ip_hdr_t	*p_ip_hdr;
+	const tcp_hdr_t	*p_tcp_hdr;
+	uint32_t		hdr_len, mss, lens[5], l, f, seg, off, tcp_len;
+	uint8_t			flags;
+	uint32_t		errors = 0;
+
+	hdr_len = GSO_HDR_LEN;
+	mss = mtu - hdr_len;
+	lens[0] = 1;
+	lens[1] = mss;
+	lens[2] = mss + 1;
+	lens[3] = 3 * mss - 1;
+	lens[4] = IPOIB_GRO_MAX_LEN - hdr_len;
+
+	for( l = 0; l < sizeof(lens) / sizeof(lens[0]); l++ )
+	for( f = 0; f < sizeof(send_flags); f++ )
+	{
+		__build_send( g_send, lens[l], send_flags[f], l + 1 );
+		if( !ipoib_gso_init( &gso, g_send, hdr_len, mtu ) )
+		{
+			errors++;
+			fprintf( stderr, "check: mtu %u len %u not segmented\n", mtu, lens[l] );
+			continue;
+		}
+		GSO_CHECK( gso.hdr_len == hdr_len && gso.mss == mss &&
+			gso.n_segs == (lens[l] + mss - 1) / mss, "segmentation parameters" );
+
+		__segment( &gso, FALSE );
+		for( seg = 0, off = 0; seg < gso.n_segs; seg++ )
+		{
+			p_ip_hdr = (const ip_hdr_t*)g_seg[seg].p_ip;
+			p_tcp_hdr = (const tcp_hdr_t*)(g_seg[seg].p_ip + sizeof(ip_hdr_t));
+
+			GSO_CHECK( g_seg[seg].len <= mtu, "segment longer than the MTU" );
+			GSO_CHECK( cl_ntoh16( p_ip_hdr->length ) == g_seg[seg].len,
+				"segment IP length" );
+			GSO_CHECK( cl_ntoh16( p_ip_hdr->id ) == (uint16_t)(GSO_IP_ID + seg),
+				"segment IP identification" );
+			GSO_CHECK( cl_ntoh32( p_tcp_hdr->seq_num ) == GSO_SEQ + off,
+				"segment sequence number" );
+			GSO_CHECK( !cl_memcmp( g_seg[seg].p_ip + hdr_len, g_send + hdr_len + off,
+				g_seg[seg].len - hdr_len ), "segment payload" );
+			GSO_CHECK( __ref_valid( g_seg[seg].p_ip ), "segment checksums" );
+
+			flags = send_flags[f];
+			if( seg )
+				flags &= ~IPOIB_TCP_CWR;
+			if( seg + 1 < gso.n_segs )
+				flags &= ~(IPOIB_TCP_FIN | IPOIB_TCP_PSH);
+			GSO_CHECK( p_tcp_hdr->flags == flags, "segment TCP flags" );
+
+			off += g_seg[seg].len - hdr_len;
+		}
+		GSO_CHECK( off == lens[l], "segments don't cover the send" );
+
+		/* Partial checksums are left for the HCA to complete. */
+		__segment( &gso, TRUE );
+		for( seg = 0; seg < gso.n_segs; seg++ )
+		{
+			p_tcp_hdr = (const tcp_hdr_t*)(g_seg[seg].p_ip + sizeof(ip_hdr_t));
+			tcp_len = g_seg[seg].len - sizeof(ip_hdr_t);
+			GSO_CHECK( cl_ntoh16( p_tcp_hdr->chksum ) ==
+				__ref_pseudo( g_seg[seg].p_ip, tcp_len ), "partial checksum" );
+			GSO_CHECK( bench_csum_ref( 0, g_seg[seg].p_ip, sizeof(ip_hdr_t) ) == 0xFFFF,
+				"partial segment IP checksum" );
+		}
+	}
+	return errors;
+}
+
+
+/* Checks the packets that must not be segmented. */
+static uint32_t
+__gso_check_reject( void )
+{
+	ipoib_gso_t	gso;
+	ip_hdr_t	*p_ip_hdr = (ip_hdr_t*)g_send;
+	tcp_hdr_t	*p_tcp_hdr = (tcp_hdr_t*)(g_send + sizeof(ip_hdr_t));
+	uint32_t	hdr_len, errors = 0;
+
+	hdr_len = GSO_HDR_LEN;
+
+	__build_send( g_send, 8000, IPOIB_TCP_ACK | IPOIB_TCP_SYN, 1 );
+	GSO_CHECK( !ipoib_gso_init( &gso, g_send, hdr_len, g_mtu ), "SYN segmented" );
+
+	__build_send( g_send, 8000, IPOIB_TCP_ACK | IPOIB_TCP_URG, 1 );
+	GSO_CHECK( !ipoib_gso_init( &gso, g_send, hdr_len, g_mtu ), "URG segmented" );
+
+	__build_send( g_send, 8000, IPOIB_TCP_ACK, 1 );
+	GSO_CHECK( !ipoib_gso_init( &gso, g_send, hdr_len - 1, g_mtu ),
+		"headers not in the buffer segmented" );
+	GSO_CHECK( !ipoib_gso_init( &gso, g_send, hdr_len, hdr_len ),
+		"MTU without room for payload segmented" );
+
+	p_ip_hdr->offset_flags = CL_HTON16( 0x2000 );
+	GSO_CHECK( !ipoib_gso_init( &gso, g_send, hdr_len, g_mtu ), "fragment segmented" );
+	p_ip_hdr->offset_flags = 0;
+
+	p_ip_hdr->prot = IP_PROT_UDP;
+	GSO_CHECK( !ipoib_gso_init( &gso, g_send, hdr_len, g_mtu ), "UDP segmented" );
+	p_ip_hdr->prot = IP_PROT_TCP;
+
+	p_tcp_hdr->offset = 0x40;
+	GSO_CHECK( !ipoib_gso_init( &gso, g_send, hdr_len, g_mtu ),
+		"short TCP header segmented" );
+
+	return errors;
+}
+
+
+/*
+ * Coalesces segmented sends back and checks the result, then checks the
+ * segments that must not be coalesced.  Returns the number of failed
+ * checks.
+ */
+static uint32_t
+__gro_check( void )
+{
+	ipoib_gso_t		gso;
+	ipoib_gro_t		gro;
+	ipoib_gro_seg_t	seg;
+	ip_hdr_t		*p_ip_hdr;
+	tcp_hdr_t		*p_tcp_hdr;
+	uint32_t		hdr_len, send_len, n_segs;
+	uint32_t		errors = 0;
+
+	hdr_len = GSO_HDR_LEN;
+
+	/* The whole send, with PSH on the last segment only. */
+	send_len = __build_send( g_send, 60000, IPOIB_TCP_ACK | IPOIB_TCP_PSH, 7 );
+	ipoib_gso_init( &gso, g_send, hdr_len, 2044 );
+	ipoib_csum_ip_hdr( (ip_hdr_t*)g_send );
+	n_segs = __segment( &gso, FALSE );
+
+	GSO_CHECK( __coalesce( n_segs ) == n_segs, "not all segments coalesced" );
+	GSO_CHECK( cl_ntoh16( ((ip_hdr_t*)g_coal)->length ) == send_len,
+		"coalesced IP length" );
+	GSO_CHECK( !cl_memcmp( g_coal, g_send, sizeof(ip_hdr_t) ),
+		"coalesced IP header differs from the send" );
+	GSO_CHECK( ((tcp_hdr_t*)(g_coal + sizeof(ip_hdr_t)))->flags ==
+		(IPOIB_TCP_ACK | IPOIB_TCP_PSH), "coalesced TCP flags" );
+	GSO_CHECK( !cl_memcmp( g_coal + hdr_len, g_send + hdr_len, send_len - hdr_len ),
+		"coalesced payload differs from the send" );
+	GSO_CHECK( __ref_valid( g_coal ), "coalesced checksums" );
+
+	/* Odd segment lengths put later payload on odd offsets. */
+	__build_send( g_send, 20001, IPOIB_TCP_ACK, 8 );
+	ipoib_gso_init( &gso, g_send, hdr_len, 1499 );
+	n_segs = __segment( &gso, FALSE );
+	GSO_CHECK( __coalesce( n_segs ) == n_segs, "not all odd segments coalesced" );
+	GSO_CHECK( __ref_valid( g_coal ), "coalesced checksums, odd segments" );
+
+	/* A bad payload checksum stops coalescing before the segment. */
+	__build_send( g_send, 20000, IPOIB_TCP_ACK, 9 );
+	ipoib_gso_init( &gso, g_send, hdr_len, 2044 );
+	n_segs = __segment( &gso, FALSE );
+	g_seg[2].p_ip[hdr_len + 5] ^= 0x10;
+	GSO_CHECK( __coalesce( n_segs ) == 2, "corrupt segment coalesced" );
+	GSO_CHECK( cl_ntoh16( ((ip_hdr_t*)g_coal)->length ) == hdr_len + 2 * gso.mss &&
+		__ref_valid( g_coal ), "packet coalesced before a corrupt segment" );
+	g_seg[2].p_ip[hdr_len + 5] ^= 0x10;
+
+	GSO_CHECK( ipoib_gro_parse( g_seg[0].p_ip, g_seg[0].len, &seg ) &&
+		ipoib_gro_start( &gro, g_coal, sizeof(g_coal), g_seg[0].p_ip, &seg ),
+		"first segment not started" );
+
+	/* Out of order. */
+	ipoib_gro_parse( g_seg[2].p_ip, g_seg[2].len, &seg );
+	GSO_CHECK( !ipoib_gro_match( &gro, g_seg[2].p_ip, &seg ),
+		"out of order segment matched" );
+
+	/* Same sequence, different window. */
+	p_tcp_hdr = (tcp_hdr_t*)(g_seg[1].p_ip + sizeof(ip_hdr_t));
+	p_tcp_hdr->window ^= CL_HTON16( 1 );
+	ipoib_gro_parse( g_seg[1].p_ip, g_seg[1].len, &seg );
+	GSO_CHECK( !ipoib_gro_match( &gro, g_seg[1].p_ip, &seg ),
+		"segment with another window matched" );
+	p_tcp_hdr->window ^= CL_HTON16( 1 );
+
+	/* Flags other than ACK and PSH. */
+	p_tcp_hdr->flags |= IPOIB_TCP_FIN;
+	GSO_CHECK( !ipoib_gro_parse( g_seg[1].p_ip, g_seg[1].len, &seg ),
+		"FIN segment parsed" );
+	p_tcp_hdr->flags &= ~IPOIB_TCP_FIN;
+
+	/* Truncated receive. */
+	GSO_CHECK( !ipoib_gro_parse( g_seg[1].p_ip, g_seg[1].len - 1, &seg ),
+		"truncated segment parsed" );
+
+	/* IP options. */
+	p_ip_hdr = (ip_hdr_t*)g_seg[1].p_ip;
+	p_ip_hdr->ver_hl = 0x46;
+	GSO_CHECK( !ipoib_gro_parse( g_seg[1].p_ip, g_seg[1].len, &seg ),
+		"segment with IP options parsed" );
+	p_ip_hdr->ver_hl = 0x45;
+
+	/* Fragment. */
+	p_ip_hdr->offset_flags |= CL_HTON16( 0x2000 );
+	GSO_CHECK( !ipoib_gro_parse( g_seg[1].p_ip, g_seg[1].len, &seg ),
+		"fragment parsed" );
+	p_ip_hdr->offset_flags &= ~CL_HTON16( 0x2000 );
+
+	/* A short segment ends the burst. */
+	__build_send( g_send, 2 * gso.mss - 10, IPOIB_TCP_ACK, 10 );
+	ipoib_gso_init( &gso, g_send, hdr_len, 2044 );
+	n_segs = __segment( &gso, FALSE );
+	g_seg[n_segs].p_ip = g_seg_buf[n_segs];
+	g_seg[n_segs].len = __build_send( g_seg[n_segs].p_ip, 100, IPOIB_TCP_ACK, 11 );
+	p_tcp_hdr = (tcp_hdr_t*)(g_seg[n_segs].p_ip + sizeof(ip_hdr_t));
+	p_tcp_hdr->seq_num = cl_hton32( GSO_SEQ + 2 * gso.mss - 10 );
+	__csum_send( g_seg[n_segs].p_ip );
+	GSO_CHECK( n_segs == 2 && __coalesce( n_segs + 1 ) == n_segs,
+		"segment after a short one coalesced" );
+
+	return errors;
+}
+
+
+/* Times one operation on the send at g_send; returns the errors seen. */
+static uint32_t
+__gso_time(
+	IN				const char*					name,
+	IN		const	ipoib_gso_t* const			p_gso,
+	IN				gso_op_t					op )
+{
+	LARGE_INTEGER	start, end;
+	uint32_t		i, errors = 0;
+	double			ns;
+
+	QueryPerformanceCounter( &start );
+	for( i = 0; i < g_iters; i++ )
+	{
+		switch( op )
+		{
+		case GSO_OP_SEGMENT:
+			__segment( p_gso, FALSE );
+			break;
+		case GSO_OP_SEGMENT_PARTIAL:
+			__segment( p_gso, TRUE );
+			break;
+		case GSO_OP_COALESCE:
+			if( __coalesce( p_gso->n_segs ) != p_gso->n_segs )
+				errors++;
+			break;
+		}
+	}
+	QueryPerformanceCounter( &end );
+	ns = bench_ns( &start, &end ) / g_iters;
+
+	printf( "%-13s %9.1f ns/send, %7.1f ns/segment, %6.2f Gb/s\n", name, ns,
+		ns / p_gso->n_segs, p_gso->payload_len * 8.0 / ns );
+	return errors;
+}
+
+
+static void
+__gso_usage( void )
+{
+	fprintf( stderr, "Usage: ipoibbench gso [-i iterations] [-m mtu] [-l length]\n"
+		"  mtu %u to %u, length 1 to %u\n", GSO_MIN_MTU, GSO_MAX_MTU,
+		(uint32_t)(IPOIB_GRO_MAX_LEN - GSO_HDR_LEN) );
+	exit( 2 );
+}
+
+
+int
+gso_bench(
+	IN				int							argc,
+	IN				char*						argv[] )
+{
+	ipoib_gso_t		gso;
+	uint32_t		i, errors;
+
+	for( i = 1; i < (uint32_t)argc; i++ )
+	{
+		if( argv[i][0] != '-' || i + 1 >= (uint32_t)argc )
+			__gso_usage();
+
+		switch( argv[i][1] )
+		{
+		case 'i':
+			g_iters = atoi( argv[++i] );
+			break;
+		case 'm':
+			g_mtu = atoi( argv[++i] );
+			break;
+		case 'l':
+			g_len = atoi( argv[++i] );
+			break;
+		default:
+			__gso_usage();
+		}
+	}
+	if( !g_iters || g_mtu < GSO_MIN_MTU || g_mtu > GSO_MAX_MTU ||
+		!g_len || g_len > IPOIB_GRO_MAX_LEN - GSO_HDR_LEN )
+	{
+		__gso_usage();
+	}
+
+	errors = __gso_check_mtu( 2044 );
+	errors += __gso_check_mtu( 1499 );
+	errors += __gso_check_mtu( GSO_MIN_MTU );
+	errors += __gso_check_reject();
+	errors += __gro_check();
+	if( errors )
+	{
+		printf( "FAILED: %u errors\n", errors );
+		return 1;
+	}
+
+	__build_send( g_send, g_len, IPOIB_TCP_ACK | IPOIB_TCP_PSH, 1 );
+	ipoib_gso_init( &gso, g_send, GSO_HDR_LEN, g_mtu );
+	printf( "%u byte sends, MTU %u, %u segments\n", g_len, g_mtu, gso.n_segs );
+
+	errors = __gso_time( "gso", &gso, GSO_OP_SEGMENT );
+	errors += __gso_time( "gso partial", &gso, GSO_OP_SEGMENT_PARTIAL );
+	__segment( &gso, FALSE );
+	errors += __gso_time( "gro", &gso, GSO_OP_COALESCE );
+	if( errors )
+	{
+		printf( "FAILED: %u sends not coalesced\n", errors );
+		return 1;
+	}
+	return 0;
+}
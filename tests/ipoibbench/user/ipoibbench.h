@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2008 Mellanox Technologies.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#if !defined(__IPOIBBENCH_H__)
+#define __IPOIBBENCH_H__
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <complib/cl_types.h>
+
+
+/*
+ * Each benchmark parses its own options from argv[1] on and returns the
+ * process exit code: 0 on success, 1 if a check failed, 2 on bad usage.
+ */
+typedef int
+(*bench_fn_t)(
+	IN				int							argc,
+	IN				char*						argv[] );
+
+int
+endpt_bench(
+	IN				int							argc,
+	IN				char*						argv[] );
+
+int
+gso_bench(
+	IN				int							argc,
+	IN				char*						argv[] );
+
+int
+csum_bench(
+	IN				int							argc,
+	IN				char*						argv[] );
+
+int
+rss_bench(
+	IN				int							argc,
+	IN				char*						argv[] );
+
+
+/* Elapsed time between two QueryPerformanceCounter readings, in ns. */
+static __inline double
+bench_ns(
+	IN		const	LARGE_INTEGER* const		p_start,
+	IN		const	LARGE_INTEGER* const		p_end )
+{
+	LARGE_INTEGER	freq;
+
+	QueryPerformanceFrequency( &freq );
+	return (double)(p_end->QuadPart - p_start->QuadPart) * 1e9 / freq.QuadPart;
+}
+
+
+/* Small LCG so runs are repeatable. */
+static __inline uint32_t
+bench_rand(
+	IN	OUT			uint32_t* const				p_seed )
+{
+	*p_seed = *p_seed * 1103515245 + 12345;
+	return *p_seed >> 8;
+}
+
+
+/*
+ * RFC 1071 checksum computed a byte pair at a time, independent of the
+ * word order and vector code in ipoib_csum.h.  Returns the folded sum in
+ * host order.
+ */
+static __inline uint16_t
+bench_csum_ref(
+	IN				uint32_t					sum,
+	IN		const	uint8_t*					p,
+	IN				uint32_t					len )
+{
+	uint64_t	acc = sum;
+	uint32_t	i;
+
+	for( i = 0; i + 1 < len; i += 2 )
+		acc += ((uint32_t)p[i] << 8) | p[i + 1];
+	if( len & 1 )
+		acc += (uint32_t)p[len - 1] << 8;
+
+	while( acc >> 16 )
+		acc = (acc & 0xFFFF) + (acc >> 16);
+	return (uint16_t)acc;
+}
+
+
+#endif	/* __IPOIBBENCH_H__ */
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2008 Mellanox Technologies.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Abstract:
+ *	IPoIB data path micro-benchmarks.  The driver code they exercise is
+ *	kept in header-only modules under ulp\ipoib\kernel that depend on
+ *	complib alone, so it is built into this program unchanged.
+ *
+ *		endpt	per-processor endpoint cache against the locked MAC map
+ *		gso		software TCP segmentation and receive coalescing
+ *		csum	Internet checksum against a 32-bit word loop
+ *		rss		receive side scaling hash and queue selection
+ *
+ * Environment:
+ *	User Mode
+ */
+
+
+#include <string.h>
+#include "ipoibbench.h"
+
+
+static const struct
+{
+	const char				*name;
+	bench_fn_t				pfn_bench;
+
+}	g_bench[] =
+{
+	{ "endpt",	endpt_bench },
+	{ "gso",	gso_bench },
+	{ "csum",	csum_bench },
+	{ "rss",	rss_bench },
+};
+
+
+static void
+__usage( void )
+{
+	int		i;
+
+	fprintf( stderr, "Usage: ipoibbench <benchmark> [options]\nBenchmarks:" );
+	for( i = 0; i < sizeof(g_bench) / sizeof(g_bench[0]); i++ )
+		fprintf( stderr, " %s", g_bench[i].name );
+	fprintf( stderr, "\n" );
+	exit( 2 );
+}
+
+
+int __cdecl
+main(
+	IN				int							argc,
+	IN				char*						argv[] )
+{
+	int		i;
+
+	if( argc < 2 )
+		__usage();
+
+	for( i = 0; i < sizeof(g_bench) / sizeof(g_bench[0]); i++ )
+	{
+		if( !strcmp( argv[1], g_bench[i].name ) )
+			return g_bench[i].pfn_bench( argc - 1, argv + 1 );
+	}
+
+	__usage();
+	return 2;
+}
@@ -0,0 +1,560 @@
+/*
+ * Copyright (c) 2008 Mellanox Technologies.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Abstract:
+ *	Receive side scaling benchmark.
+ *
+ *	Times ipoib_rss_classify and ipoib_rss_queue, which the UD receive
+ *	path runs on every packet, against hashing the same input one key bit
+ *	at a time, for TCP over IPv4 and IPv6.
+ *
+ *	Before timing, the hashes are checked against the Microsoft RSS
+ *	verification suite, for IPv4 and IPv6 with and without ports, and
+ *	random inputs against the bit-wise hash.  Packets that must only be
+ *	hashed on addresses, the indirection table sizes accepted and the
+ *	queues it selects are checked as well.
+ *
+ * Environment:
+ *	User Mode
+ */
+
+
+#include <string.h>
+#include "ipoib_rss.h"
+#include "ipoibbench.h"
+
+
+#define RSS_PKT_LEN			(sizeof(ipv6_hdr_t) + 2 * sizeof(net16_t))
+
+/* Distinct flows the timed loops cycle through.  Power of two. */
+#define RSS_FLOWS			4096
+
+/* Flows hashed to check the spread across queues. */
+#define RSS_SPREAD_FLOWS	(1 << 20)
+#define RSS_SPREAD_QUEUES	8
+
+
+/* Key of the Microsoft RSS verification suite. */
+static const uint8_t	g_rss_key[IPOIB_RSS_KEY_SIZE] =
+{
+	0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+	0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+	0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+	0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+	0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+
+typedef struct _rss_vector
+{
+	boolean_t				ipv6;
+	uint8_t					src[16];
+	uint8_t					dst[16];
+	uint16_t				src_port;
+	uint16_t				dst_port;
+	uint32_t				hash;
+	uint32_t				hash_ports;
+
+}	rss_vector_t;
+
+
+/* Microsoft RSS verification suite. */
+static const rss_vector_t	g_vectors[] =
+{
+	{ FALSE, { 66, 9, 149, 187 }, { 161, 142, 100, 80 }, 2794, 1766,
+		0x323e8fc2, 0x51ccc178 },
+	{ FALSE, { 199, 92, 111, 2 }, { 65, 69, 140, 83 }, 14230, 4739,
+		0xd718262a, 0xc626b0ea },
+	{ FALSE, { 24, 19, 198, 95 }, { 12, 22, 207, 184 }, 12898, 38024,
+		0xd2d0a5de, 0x5c2b394a },
+	{ FALSE, { 38, 27, 205, 30 }, { 209, 142, 163, 6 }, 48228, 2217,
+		0x82989176, 0xafc7327f },
+	{ FALSE, { 153, 39, 163, 191 }, { 202, 188, 127, 2 }, 44251, 1303,
+		0x5d1809c5, 0x10e828a2 },
+	/* 3ffe:2501:200:1fff::7 to 3ffe:2501:200:3::1 */
+	{ TRUE,
+		{ 0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x1f, 0xff,
+		0, 0, 0, 0, 0, 0, 0, 0x07 },
+		{ 0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x00, 0x03,
+		0, 0, 0, 0, 0, 0, 0, 0x01 },
+		2794, 1766, 0x2cc18cd5, 0x40207d3d },
+	/* 3ffe:501:8::260:97ff:fe40:efab to ff02::1 */
+	{ TRUE,
+		{ 0x3f, 0xfe, 0x05, 0x01, 0x00, 0x08, 0x00, 0x00,
+		0x02, 0x60, 0x97, 0xff, 0xfe, 0x40, 0xef, 0xab },
+		{ 0xff, 0x02, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0x01 },
+		14230, 4739, 0x0f0c461c, 0xdde51bbf },
+	/* 3ffe:1900:4545:3:200:f8ff:fe21:67cf to fe80::200:f8ff:fe21:67cf */
+	{ TRUE,
+		{ 0x3f, 0xfe, 0x19, 0x00, 0x45, 0x45, 0x00, 0x03,
+		0x02, 0x00, 0xf8, 0xff, 0xfe, 0x21, 0x67, 0xcf },
+		{ 0xfe, 0x80, 0, 0, 0, 0, 0, 0,
+		0x02, 0x00, 0xf8, 0xff, 0xfe, 0x21, 0x67, 0xcf },
+		44251, 38024, 0x4b61e985, 0x02d1feef },
+};
+
+
+static ipoib_rss_t		g_rss;
+
+static uint32_t			g_iters = 10000000;
+
+/* The timed loops store their result here so it can't be eliminated. */
+static volatile uint32_t	g_sink;
+
+
+/* Toeplitz hash computed one input bit at a time. */
+static uint32_t
+__rss_hash_bits(
+	IN		const	uint8_t*					p_key,
+	IN		const	uint8_t*					p_input,
+	IN				uint32_t					len )
+{
+	uint32_t	i, j, hash = 0;
+	uint32_t	window;
+
+	window = ((uint32_t)p_key[0] << 24) | ((uint32_t)p_key[1] << 16) |
+		((uint32_t)p_key[2] << 8) | p_key[3];
+
+	for( i = 0; i < len; i++ )
+	{
+		for( j = 0; j < 8; j++ )
+		{
+			if( p_input[i] & (0x80 >> j) )
+				hash ^= window;
+			window = (window << 1) | ((p_key[i + 4] >> (7 - j)) & 1);
+		}
+	}
+	return hash;
+}
+
+
+/*
+ * Builds a TCP packet, or a UDP one if tcp is FALSE, and returns the
+ * EtherType.  *p_len is set to the bytes classified.
+ */
+static net16_t
+__rss_build_pkt(
+	IN		const	rss_vector_t* const			p_vec,
+	IN				boolean_t					tcp,
+	IN				uint8_t* const				p_pkt,
+		OUT			uint32_t* const				p_len )
+{
+	ip_hdr_t	*p_ip_hdr;
+	ipv6_hdr_t	*p_ipv6_hdr;
+	net16_t		*p_ports;
+
+	cl_memclr( p_pkt, RSS_PKT_LEN );
+	if( p_vec->ipv6 )
+	{
+		p_ipv6_hdr = (ipv6_hdr_t*)p_pkt;
+		p_ipv6_hdr->ver_tc_fl = cl_hton32( 0x60000000 );
+		p_ipv6_hdr->next_header = tcp ? IP_PROT_TCP : IP_PROT_UDP;
+		cl_memcpy( p_ipv6_hdr->src_addr, p_vec->src, 16 );
+		cl_memcpy( p_ipv6_hdr->dest_addr, p_vec->dst, 16 );
+		p_ports = (net16_t*)(p_ipv6_hdr + 1);
+		*p_len = sizeof(ipv6_hdr_t) + 2 * sizeof(net16_t);
+	}
+	else
+	{
+		p_ip_hdr = (ip_hdr_t*)p_pkt;
+		p_ip_hdr->ver_hl = 0x45;
+		p_ip_hdr->prot = tcp ? IP_PROT_TCP : IP_PROT_UDP;
+		cl_memcpy( &p_ip_hdr->src_ip, p_vec->src, 4 );
+		cl_memcpy( &p_ip_hdr->dst_ip, p_vec->dst, 4 );
+		p_ports = (net16_t*)(p_ip_hdr + 1);
+		*p_len = sizeof(ip_hdr_t) + 2 * sizeof(net16_t);
+	}
+	p_ports[0] = cl_hton16( p_vec->src_port );
+	p_ports[1] = cl_hton16( p_vec->dst_port );
+
+	return p_vec->ipv6 ? ETH_PROT_TYPE_IPV6 : ETH_PROT_TYPE_IP;
+}
+
+
+/* Returns the number of failed checks. */
+static uint32_t
+__rss_check_vectors( void )
+{
+	const rss_vector_t	*p_vec;
+	uint8_t				pkt[RSS_PKT_LEN];
+	uint8_t				input[IPOIB_RSS_MAX_INPUT];
+	uint32_t			i, len, addr_len, hash, type;
+	uint32_t			want, want_ports;
+	net16_t				eth_type;
+	uint32_t			errors = 0;
+
+	for( i = 0; i < sizeof(g_vectors) / sizeof(g_vectors[0]); i++ )
+	{
+		p_vec = &g_vectors[i];
+		addr_len = p_vec->ipv6 ? 16 : 4;
+		want = p_vec->ipv6 ? IPOIB_RSS_HASH_IPV6 : IPOIB_RSS_HASH_IPV4;
+		want_ports = p_vec->ipv6 ?
+			IPOIB_RSS_HASH_TCP_IPV6 : IPOIB_RSS_HASH_TCP_IPV4;
+
+		/* The bit-wise hash against the published values. */
+		cl_memcpy( input, p_vec->src, addr_len );
+		cl_memcpy( input + addr_len, p_vec->dst, addr_len );
+		input[2 * addr_len] = (uint8_t)(p_vec->src_port >> 8);
+		input[2 * addr_len + 1] = (uint8_t)p_vec->src_port;
+		input[2 * addr_len + 2] = (uint8_t)(p_vec->dst_port >> 8);
+		input[2 * addr_len + 3] = (uint8_t)p_vec->dst_port;
+		if( __rss_hash_bits( g_rss_key, input, 2 * addr_len ) != p_vec->hash ||
+			__rss_hash_bits( g_rss_key, input, 2 * addr_len + 4 ) !=
+			p_vec->hash_ports )
+		{
+			errors++;
+			fprintf( stderr, "check: bit-wise hash of vector %u\n", i );
+		}
+
+		/* TCP with every hash type enabled: the 4-tuple. */
+		eth_type = __rss_build_pkt( p_vec, TRUE, pkt, &len );
+		g_rss.hash_types = IPOIB_RSS_HASH_ALL;
+		type = ipoib_rss_classify( &g_rss, eth_type, pkt, len, &hash );
+		if( type != want_ports || hash != p_vec->hash_ports )
+		{
+			errors++;
+			fprintf( stderr, "check: vector %u with ports: type 0x%x "
+				"hash 0x%08x, expected 0x%08x\n", i, type, hash,
+				p_vec->hash_ports );
+		}
+
+		/* Address only hashing: the 2-tuple. */
+		g_rss.hash_types = IPOIB_RSS_HASH_IPV4 | IPOIB_RSS_HASH_IPV6;
+		type = ipoib_rss_classify( &g_rss, eth_type, pkt, len, &hash );
+		if( type != want || hash != p_vec->hash )
+		{
+			errors++;
+			fprintf( stderr, "check: vector %u without ports: type 0x%x "
+				"hash 0x%08x, expected 0x%08x\n", i, type, hash, p_vec->hash );
+		}
+
+		/* Ports without the matching hash type: not hashed. */
+		g_rss.hash_types = p_vec->ipv6 ?
+			IPOIB_RSS_HASH_TCP_IPV4 : IPOIB_RSS_HASH_TCP_IPV6;
+		if( ipoib_rss_classify( &g_rss, eth_type, pkt, len, &hash ) )
+		{
+			errors++;
+			fprintf( stderr, "check: vector %u hashed with its type off\n", i );
+		}
+
+		/* UDP only hashes the addresses. */
+		eth_type = __rss_build_pkt( p_vec, FALSE, pkt, &len );
+		g_rss.hash_types = IPOIB_RSS_HASH_ALL;
+		type = ipoib_rss_classify( &g_rss, eth_type, pkt, len, &hash );
+		if( type != want || hash != p_vec->hash )
+		{
+			errors++;
+			fprintf( stderr, "check: UDP vector %u\n", i );
+		}
+
+		/* So do IPv4 fragments, including the first one. */
+		if( !p_vec->ipv6 )
+		{
+			eth_type = __rss_build_pkt( p_vec, TRUE, pkt, &len );
+			IP_SET_MORE_FRAGMENTS( (ip_hdr_t*)pkt );
+			type = ipoib_rss_classify( &g_rss, eth_type, pkt, len, &hash );
+			if( type != want || hash != p_vec->hash )
+			{
+				errors++;
+				fprintf( stderr, "check: fragment of vector %u\n", i );
+			}
+		}
+	}
+
+	return errors;
+}
+
+
+/* Returns the number of failed checks. */
+static uint32_t
+__rss_check_random( void )
+{
+	static const uint32_t	lens[] = { 8, 12, 32, 36 };
+	uint8_t		key[IPOIB_RSS_KEY_SIZE];
+	uint8_t		input[IPOIB_RSS_MAX_INPUT];
+	uint32_t	i, j, k, seed = 1;
+	uint32_t	errors = 0;
+
+	for( i = 0; i < 16; i++ )
+	{
+		for( j = 0; j < IPOIB_RSS_KEY_SIZE; j++ )
+			key[j] = (uint8_t)bench_rand( &seed );
+		ipoib_rss_set_key( &g_rss, key, IPOIB_RSS_KEY_SIZE );
+
+		for( j = 0; j < 1000; j++ )
+		{
+			for( k = 0; k < IPOIB_RSS_MAX_INPUT; k++ )
+				input[k] = (uint8_t)bench_rand( &seed );
+			for( k = 0; k < sizeof(lens) / sizeof(lens[0]); k++ )
+			{
+				if( ipoib_rss_hash( &g_rss, input, lens[k] ) !=
+					__rss_hash_bits( key, input, lens[k] ) )
+				{
+					errors++;
+					fprintf( stderr, "check: random key %u input %u, "
+						"%u bytes\n", i, j, lens[k] );
+				}
+			}
+		}
+	}
+
+	ipoib_rss_set_key( &g_rss, g_rss_key, IPOIB_RSS_KEY_SIZE );
+	return errors;
+}
+
+
+/* Returns the number of failed checks. */
+static uint32_t
+__rss_check_table( void )
+{
+	static const uint32_t	bad_sizes[] =
+		{ 0, 3, 96, IPOIB_RSS_MAX_TABLE_SIZE + 1, 2 * IPOIB_RSS_MAX_TABLE_SIZE };
+	uint32_t	table[2 * IPOIB_RSS_MAX_TABLE_SIZE];
+	uint32_t	counts[RSS_SPREAD_QUEUES];
+	uint8_t		input[12];
+	uint32_t	i, j, n, hash, min, max, seed = 7;
+	uint32_t	errors = 0;
+
+	for( i = 0; i < 2 * IPOIB_RSS_MAX_TABLE_SIZE; i++ )
+		table[i] = bench_rand( &seed ) % IPOIB_RSS_MAX_QUEUES;
+
+	for( i = 0; i < sizeof(bad_sizes) / sizeof(bad_sizes[0]); i++ )
+	{
+		if( ipoib_rss_set_table( &g_rss, table, bad_sizes[i] ) )
+		{
+			errors++;
+			fprintf( stderr, "check: table of %u entries accepted\n",
+				bad_sizes[i] );
+		}
+	}
+
+	/* The low bits of the hash index the table. */
+	for( n = 1; n <= IPOIB_RSS_MAX_TABLE_SIZE; n <<= 1 )
+	{
+		if( !ipoib_rss_set_table( &g_rss, table, n ) )
+		{
+			errors++;
+			fprintf( stderr, "check: table of %u entries rejected\n", n );
+			continue;
+		}
+
+		for( i = 0; i < sizeof(g_vectors) / sizeof(g_vectors[0]); i++ )
+		{
+			for( j = 0; j < 2; j++ )
+			{
+				hash = j ? g_vectors[i].hash_ports : g_vectors[i].hash;
+				if( ipoib_rss_queue( &g_rss, hash ) != table[hash % n] )
+				{
+					errors++;
+					fprintf( stderr, "check: queue of hash 0x%08x, "
+						"%u entries\n", hash, n );
+				}
+			}
+		}
+	}
+
+	/*
+	 * The default table spreads entries round robin; random IPv4 TCP
+	 * flows must then land evenly on the queues.
+	 */
+	for( i = 0; i < IPOIB_RSS_MAX_TABLE_SIZE; i++ )
+		table[i] = i % RSS_SPREAD_QUEUES;
+	ipoib_rss_set_table( &g_rss, table, IPOIB_RSS_MAX_TABLE_SIZE );
+
+	cl_memclr( counts, sizeof(counts) );
+	for( i = 0; i < RSS_SPREAD_FLOWS; i++ )
+	{
+		/* The low bits of the generator repeat too soon for a million flows. */
+		for( j = 0; j < sizeof(input); j++ )
+			input[j] = (uint8_t)(bench_rand( &seed ) >> 16);
+		counts[ipoib_rss_queue( &g_rss,
+			ipoib_rss_hash( &g_rss, input, sizeof(input) ) )]++;
+	}
+
+	min = max = counts[0];
+	for( i = 1; i < RSS_SPREAD_QUEUES; i++ )
+	{
+		if( counts[i] < min )
+			min = counts[i];
+		if( counts[i] > max )
+			max = counts[i];
+	}
+	printf( "%u flows on %u queues: %u to %u per queue\n",
+		RSS_SPREAD_FLOWS, RSS_SPREAD_QUEUES, min, max );
+	if( (uint64_t)max * 100 > (uint64_t)min * 105 )
+	{
+		errors++;
+		fprintf( stderr, "check: uneven spread across queues\n" );
+	}
+
+	return errors;
+}
+
+
+/*
+ * Returns ns per packet to classify and select a queue for RSS_FLOWS
+ * random TCP flows, or to hash them bit-wise.
+ */
+static double
+__rss_time(
+	IN				uint8_t* const				p_pkts,
+	IN				boolean_t					ipv6,
+	IN				boolean_t					bits )
+{
+	LARGE_INTEGER	start, end;
+	rss_vector_t	vec;
+	uint8_t			*p_pkt;
+	uint8_t			input[IPOIB_RSS_MAX_INPUT];
+	uint32_t		i, j, len, addr_len, hash, sum = 0, seed = 3;
+	net16_t			eth_type = 0;
+
+	cl_memclr( &vec, sizeof(vec) );
+	vec.ipv6 = ipv6;
+	for( i = 0; i < RSS_FLOWS; i++ )
+	{
+		for( j = 0; j < 16; j++ )
+		{
+			vec.src[j] = (uint8_t)bench_rand( &seed );
+			vec.dst[j] = (uint8_t)bench_rand( &seed );
+		}
+		vec.src_port = (uint16_t)bench_rand( &seed );
+		vec.dst_port = (uint16_t)bench_rand( &seed );
+		eth_type = __rss_build_pkt( &vec, TRUE, p_pkts + i * RSS_PKT_LEN, &len );
+	}
+
+	g_rss.hash_types = IPOIB_RSS_HASH_ALL;
+	addr_len = ipv6 ? 16 : 4;
+
+	QueryPerformanceCounter( &start );
+	if( bits )
+	{
+		/* Includes gathering the input, as classify does. */
+		for( i = 0; i < g_iters; i++ )
+		{
+			p_pkt = p_pkts + (i & (RSS_FLOWS - 1)) * RSS_PKT_LEN;
+			if( ipv6 )
+			{
+				cl_memcpy( input, ((ipv6_hdr_t*)p_pkt)->src_addr, 32 );
+				cl_memcpy( input + 32, p_pkt + sizeof(ipv6_hdr_t), 4 );
+			}
+			else
+			{
+				cl_memcpy( input, &((ip_hdr_t*)p_pkt)->src_ip, 8 );
+				cl_memcpy( input + 8, p_pkt + sizeof(ip_hdr_t), 4 );
+			}
+			hash = __rss_hash_bits( g_rss.key, input, 2 * addr_len + 4 );
+			sum += ipoib_rss_queue( &g_rss, hash );
+		}
+	}
+	else
+	{
+		for( i = 0; i < g_iters; i++ )
+		{
+			p_pkt = p_pkts + (i & (RSS_FLOWS - 1)) * RSS_PKT_LEN;
+			ipoib_rss_classify( &g_rss, eth_type, p_pkt, len, &hash );
+			sum += ipoib_rss_queue( &g_rss, hash );
+		}
+	}
+	QueryPerformanceCounter( &end );
+
+	g_sink = sum;
+	return bench_ns( &start, &end ) / g_iters;
+}
+
+
+static void
+__rss_usage( void )
+{
+	fprintf( stderr, "Usage: ipoibbench rss [-n packets]\n" );
+	exit( 2 );
+}
+
+
+int
+rss_bench(
+	IN				int							argc,
+	IN				char*						argv[] )
+{
+	uint8_t		*p_pkts;
+	uint32_t	i, errors;
+	double		ns_v4, ns_v4_bits, ns_v6, ns_v6_bits;
+
+	for( i = 1; i < (uint32_t)argc; i++ )
+	{
+		if( argv[i][0] != '-' || i + 1 >= (uint32_t)argc )
+			__rss_usage();
+
+		switch( argv[i][1] )
+		{
+		case 'n':
+			g_iters = atoi( argv[++i] );
+			break;
+		default:
+			__rss_usage();
+		}
+	}
+	if( !g_iters )
+		__rss_usage();
+
+	p_pkts = (uint8_t*)cl_malloc( RSS_FLOWS * RSS_PKT_LEN );
+	if( !p_pkts )
+	{
+		fprintf( stderr, "initialization failed\n" );
+		return 1;
+	}
+
+	ipoib_rss_set_key( &g_rss, g_rss_key, IPOIB_RSS_KEY_SIZE );
+	errors = __rss_check_vectors();
+	errors += __rss_check_random();
+	errors += __rss_check_table();
+	if( errors )
+	{
+		cl_free( p_pkts );
+		printf( "FAILED: %u errors\n", errors );
+		return 1;
+	}
+	printf( "verification suite passed\n" );
+
+	ns_v4 = __rss_time( p_pkts, FALSE, FALSE );
+	ns_v4_bits = __rss_time( p_pkts, FALSE, TRUE );
+	ns_v6 = __rss_time( p_pkts, TRUE, FALSE );
+	ns_v6_bits = __rss_time( p_pkts, TRUE, TRUE );
+
+	printf( "%-10s %12s %12s %8s\n",
+		"packets", "ns/packet", "bit-wise ns", "speedup" );
+	printf( "%-10s %12.1f %12.1f %7.2fx\n",
+		"TCP/IPv4", ns_v4, ns_v4_bits, ns_v4_bits / ns_v4 );
+	printf( "%-10s %12.1f %12.1f %7.2fx\n",
+		"TCP/IPv6", ns_v6, ns_v6_bits, ns_v6_bits / ns_v6 );
+
+	cl_free( p_pkts );
+	return 0;
+}
@@ -0,0 +1,563 @@
+/*
+ * Copyright (c) 2009 HNR Consulting.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * libibmad micro-benchmarks.
+ *
+ * decode: PortCounters, PortCountersExtended and PortInfo decode rates
+ * through mad_get_field(), the per-field accessors and the bulk decoders.
+ * Every method is first checked against mad_get_field() on the same
+ * random attributes, so a mismatch fails the run.
+ *
+ * pma: the PMA queries of an ibqueryerrors scan (ClassPortInfo once per
+ * node, then PortCounters and, when supported, PortCountersExtended for
+ * every port) issued one at a time through pma_query_via() and pipelined
+ * through the asynchronous RPC engine, against the simulated responder in
+ * umad_sim.c.  Both scans must find the same ports with errors.
+ *
+ * Environment:
+ *	User Mode
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <complib/cl_timer.h>
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+#include <iba/ib_types.h>
+
+#include "umad_sim.h"
+
+#define NUM_BUFS	256
+
+static uint8_t bufs[NUM_BUFS][IB_SMP_DATA_SIZE];
+static int iterations = 1000000;
+
+/* the compiler must not drop decodes whose result is unused */
+static volatile uint64_t sink;
+
+static void fill_random(void)
+{
+	int i, j;
+
+	srand(1);
+	for (i = 0; i < NUM_BUFS; i++)
+		for (j = 0; j < IB_SMP_DATA_SIZE; j++)
+			bufs[i][j] = (uint8_t) rand();
+}
+
+static void report(const char *attr, const char *method, int nfields,
+		   uint64_t usec)
+{
+	double ns = usec ? (double)usec * 1000 / iterations : 0;
+
+	printf("%-22s %-12s %3d fields  %8.1f ns/attr  %8.2f Mattr/s\n",
+	       attr, method, nfields, ns, ns ? 1000 / ns : 0);
+}
+
+/*
+ * PortCounters
+ */
+#define PC_GENERIC_FIRST	IB_PC_PORT_SELECT_F
+#define PC_GENERIC_LAST		IB_PC_XMT_WAIT_F
+
+static uint64_t pc_generic(uint8_t * buf)
+{
+	uint64_t sum = 0;
+	int f;
+
+	for (f = PC_GENERIC_FIRST; f <= PC_GENERIC_LAST; f++)
+		sum += mad_get_field(buf, 0, f);
+	return sum;
+}
+
+#define ADD_ACCESSOR32(name, offs, len)	sum += mad_pc_get_##name(buf);
+
+static uint64_t pc_accessors(uint8_t * buf)
+{
+	uint64_t sum = 0;
+
+	MAD_PC_FIELDS32(ADD_ACCESSOR32)
+	return sum;
+}
+#undef ADD_ACCESSOR32
+
+#define ADD_MEMBER32(name, offs, len)	sum += d.name;
+#define ADD_MEMBER64(name, offs)	sum += d.name;
+
+static uint64_t pc_bulk(uint8_t * buf)
+{
+	ibmad_port_counters_t d;
+	uint64_t sum = 0;
+
+	mad_decode_port_counters(buf, &d);
+	MAD_PC_FIELDS32(ADD_MEMBER32)
+	return sum;
+}
+
+/*
+ * PortCountersExtended
+ */
+static uint64_t pc_ext_generic(uint8_t * buf)
+{
+	uint64_t sum = 0;
+	int f;
+
+	sum += mad_get_field(buf, 0, IB_PC_EXT_PORT_SELECT_F);
+	sum += mad_get_field(buf, 0, IB_PC_EXT_COUNTER_SELECT_F);
+	for (f = IB_PC_EXT_XMT_BYTES_F; f <= IB_PC_EXT_RCV_MPKTS_F; f++)
+		sum += mad_get_field64(buf, 0, f);
+	return sum;
+}
+
+#define ADD_ACCESSOR32(name, offs, len)	sum += mad_pc_ext_get_##name(buf);
+#define ADD_ACCESSOR64(name, offs)	sum += mad_pc_ext_get_##name(buf);
+
+static uint64_t pc_ext_accessors(uint8_t * buf)
+{
+	uint64_t sum = 0;
+
+	MAD_PC_EXT_FIELDS32(ADD_ACCESSOR32)
+	MAD_PC_EXT_FIELDS64(ADD_ACCESSOR64)
+	return sum;
+}
+#undef ADD_ACCESSOR32
+#undef ADD_ACCESSOR64
+
+static uint64_t pc_ext_bulk(uint8_t * buf)
+{
+	ibmad_port_counters_ext_t d;
+	uint64_t sum = 0;
+
+	mad_decode_port_counters_ext(buf, &d);
+	MAD_PC_EXT_FIELDS32(ADD_MEMBER32)
+	MAD_PC_EXT_FIELDS64(ADD_MEMBER64)
+	return sum;
+}
+
+/*
+ * PortInfo: every field of the accessor list, looked up generically by
+ * the matching IB_PORT_*_F descriptor.
+ */
+static const enum MAD_FIELDS pi_fields32[] = {
+	IB_PORT_LID_F, IB_PORT_SMLID_F, IB_PORT_CAPMASK_F,
+	IB_PORT_DIAG_F, IB_PORT_MKEY_LEASE_F, IB_PORT_LOCAL_PORT_F,
+	IB_PORT_LINK_WIDTH_ENABLED_F, IB_PORT_LINK_WIDTH_SUPPORTED_F,
+	IB_PORT_LINK_WIDTH_ACTIVE_F, IB_PORT_LINK_SPEED_SUPPORTED_F,
+	IB_PORT_STATE_F, IB_PORT_PHYS_STATE_F, IB_PORT_LINK_DOWN_DEF_F,
+	IB_PORT_MKEY_PROT_BITS_F, IB_PORT_LMC_F,
+	IB_PORT_LINK_SPEED_ACTIVE_F, IB_PORT_LINK_SPEED_ENABLED_F,
+	IB_PORT_NEIGHBOR_MTU_F, IB_PORT_SMSL_F, IB_PORT_VL_CAP_F,
+	IB_PORT_INIT_TYPE_F, IB_PORT_VL_HIGH_LIMIT_F,
+	IB_PORT_VL_ARBITRATION_HIGH_CAP_F, IB_PORT_VL_ARBITRATION_LOW_CAP_F,
+	IB_PORT_INIT_TYPE_REPLY_F, IB_PORT_MTU_CAP_F,
+	IB_PORT_VL_STALL_COUNT_F, IB_PORT_HOQ_LIFE_F, IB_PORT_OPER_VLS_F,
+	IB_PORT_PART_EN_INB_F, IB_PORT_PART_EN_OUTB_F,
+	IB_PORT_FILTER_RAW_INB_F, IB_PORT_FILTER_RAW_OUTB_F,
+	IB_PORT_MKEY_VIOL_F, IB_PORT_PKEY_VIOL_F, IB_PORT_QKEY_VIOL_F,
+	IB_PORT_GUID_CAP_F, IB_PORT_CLIENT_REREG_F,
+	IB_PORT_MCAST_PKEY_SUPR_ENAB_F, IB_PORT_SUBN_TIMEOUT_F,
+	IB_PORT_RESP_TIME_VAL_F, IB_PORT_LOCAL_PHYS_ERR_F,
+	IB_PORT_OVERRUN_ERR_F, IB_PORT_MAX_CREDIT_HINT_F,
+	IB_PORT_LINK_ROUND_TRIP_F, IB_PORT_CAPMASK2_F,
+	IB_PORT_LINK_SPEED_EXT_ACTIVE_F, IB_PORT_LINK_SPEED_EXT_SUPPORTED_F,
+	IB_PORT_LINK_SPEED_EXT_ENABLED_F,
+};
+
+static uint64_t pi_generic(uint8_t * buf)
+{
+	uint64_t sum = 0;
+	int i;
+
+	sum += mad_get_field64(buf, 0, IB_PORT_MKEY_F);
+	sum += mad_get_field64(buf, 0, IB_PORT_GID_PREFIX_F);
+	for (i = 0; i < (int)(sizeof(pi_fields32) / sizeof(pi_fields32[0]));
+	     i++)
+		sum += mad_get_field(buf, 0, pi_fields32[i]);
+	return sum;
+}
+
+#define ADD_ACCESSOR32(name, offs, len)	sum += mad_portinfo_get_##name(buf);
+#define ADD_ACCESSOR64(name, offs)	sum += mad_portinfo_get_##name(buf);
+
+static uint64_t pi_accessors(uint8_t * buf)
+{
+	uint64_t sum = 0;
+
+	MAD_PORTINFO_FIELDS64(ADD_ACCESSOR64)
+	MAD_PORTINFO_FIELDS32(ADD_ACCESSOR32)
+	return sum;
+}
+#undef ADD_ACCESSOR32
+#undef ADD_ACCESSOR64
+
+static uint64_t pi_bulk(uint8_t * buf)
+{
+	ibmad_portinfo_t d;
+	uint64_t sum = 0;
+
+	mad_decode_portinfo(buf, &d);
+	MAD_PORTINFO_FIELDS64(ADD_MEMBER64)
+	MAD_PORTINFO_FIELDS32(ADD_MEMBER32)
+	return sum;
+}
+
+#define COUNT_FIELD32(name, offs, len)	+ 1
+#define COUNT_FIELD64(name, offs)	+ 1
+
+typedef uint64_t(decode_fn_t) (uint8_t * buf);
+
+static uint64_t run(decode_fn_t * fn)
+{
+	uint64_t start, sum = 0;
+	int i;
+
+	start = cl_get_time_stamp();
+	for (i = 0; i < iterations; i++)
+		sum += fn(bufs[i % NUM_BUFS]);
+	sink += sum;
+	return cl_get_time_stamp() - start;
+}
+
+static int bench_attr(const char *attr, int nfields, decode_fn_t * generic,
+		      decode_fn_t * accessors, decode_fn_t * bulk)
+{
+	int i;
+
+	/* the three methods sum the same fields, so the sums must agree */
+	for (i = 0; i < NUM_BUFS; i++)
+		if (accessors(bufs[i]) != generic(bufs[i]) ||
+		    bulk(bufs[i]) != generic(bufs[i])) {
+			fprintf(stderr, "%s: decode mismatch on buffer %d\n",
+				attr, i);
+			return -1;
+		}
+
+	report(attr, "mad_get_field", nfields, run(generic));
+	report(attr, "accessors", nfields, run(accessors));
+	report(attr, "bulk", nfields, run(bulk));
+	return 0;
+}
+
+static int bench_decode(void)
+{
+	int rc = 0;
+
+	fill_random();
+	rc |= bench_attr("PortCounters", 0 MAD_PC_FIELDS32(COUNT_FIELD32),
+			 pc_generic, pc_accessors, pc_bulk);
+	rc |= bench_attr("PortCountersExtended",
+			 0 MAD_PC_EXT_FIELDS32(COUNT_FIELD32)
+			 MAD_PC_EXT_FIELDS64(COUNT_FIELD64),
+			 pc_ext_generic, pc_ext_accessors, pc_ext_bulk);
+	rc |= bench_attr("PortInfo", 0 MAD_PORTINFO_FIELDS32(COUNT_FIELD32)
+			 MAD_PORTINFO_FIELDS64(COUNT_FIELD64),
+			 pi_generic, pi_accessors, pi_bulk);
+	return rc;
+}
+
+/*
+ * PMA scan
+ */
+static int pma_window = 64;
+static int pma_ext = 1;
+
+typedef struct pma_scan {
+	struct ibmad_rpc_engine *engine;
+	ib_portid_t *portids;
+	uint16_t *cap_masks;
+	int mads;
+	int failed;
+	int bad_ports;
+} pma_scan_t;
+
+static int pc_has_errors(uint8_t * data)
+{
+	ibmad_port_counters_t pc;
+
+	mad_decode_port_counters(data, &pc);
+	return pc.err_sym || pc.link_recovers || pc.link_downed ||
+	    pc.err_rcv || pc.err_physrcv || pc.err_switch_rel ||
+	    pc.xmt_discards || pc.err_xmtconstr || pc.err_rcvconstr ||
+	    pc.err_localinteg || pc.err_excess_ovr || pc.vl15_dropped;
+}
+
+static int pma_ext_supported(uint16_t cap_mask)
+{
+	return pma_ext && (cap_mask & (IB_PM_EXT_WIDTH_SUPPORTED |
+				       IB_PM_EXT_WIDTH_NOIETF_SUP));
+}
+
+static void pma_scan_seq(struct ibmad_port *srcport, pma_scan_t * scan)
+{
+	uint8_t data[IB_MAD_SIZE];
+	uint16_t cap_mask;
+	int lid, port;
+
+	for (lid = 1; lid <= sim_nodes; lid++) {
+		ib_portid_t *portid = &scan->portids[lid];
+
+		scan->mads++;
+		memset(data, 0, sizeof(data));
+		if (!pma_query_via(data, portid, 0, 0, CLASS_PORT_INFO,
+				   srcport)) {
+			scan->failed++;
+			continue;
+		}
+		memcpy(&cap_mask, data + 2, sizeof(cap_mask));
+
+		for (port = 1; port <= sim_ports; port++) {
+			scan->mads++;
+			memset(data, 0, sizeof(data));
+			if (!pma_query_via(data, portid, port, 0,
+					   IB_GSI_PORT_COUNTERS, srcport)) {
+				scan->failed++;
+				continue;
+			}
+			if (pc_has_errors(data))
+				scan->bad_ports++;
+
+			if (!pma_ext_supported(cap_mask))
+				continue;
+			scan->mads++;
+			if (!pma_query_via(data, portid, port, 0,
+					   IB_GSI_PORT_COUNTERS_EXT, srcport))
+				scan->failed++;
+		}
+	}
+}
+
+static void pma_port_cb(struct ibmad_rpc_engine *engine, ib_rpc_t * rpc,
+			ib_portid_t * dport, uint8_t * mad, int error,
+			void *cb_data)
+{
+	pma_scan_t *scan = cb_data;
+
+	if (error) {
+		scan->failed++;
+		return;
+	}
+	if (rpc->attr.id == IB_GSI_PORT_COUNTERS &&
+	    pc_has_errors(mad + IB_PC_DATA_OFFS))
+		scan->bad_ports++;
+}
+
+static void pma_cpi_cb(struct ibmad_rpc_engine *engine, ib_rpc_t * rpc,
+		       ib_portid_t * dport, uint8_t * mad, int error,
+		       void *cb_data)
+{
+	pma_scan_t *scan = cb_data;
+	ib_portid_t *portid;
+	uint16_t cap_mask;
+	int port;
+
+	if (error) {
+		scan->failed++;
+		return;
+	}
+
+	/* dport is a copy; the port queries need a stable portid */
+	portid = &scan->portids[dport->lid];
+	memcpy(&cap_mask, mad + IB_PC_DATA_OFFS + 2, sizeof(cap_mask));
+	scan->cap_masks[dport->lid] = cap_mask;
+
+	for (port = 1; port <= sim_ports; port++) {
+		scan->mads++;
+		if (pma_query_async_via(engine, portid, port, 0,
+					IB_GSI_PORT_COUNTERS, pma_port_cb,
+					scan) < 0)
+			scan->failed++;
+		if (!pma_ext_supported(cap_mask))
+			continue;
+		scan->mads++;
+		if (pma_query_async_via(engine, portid, port, 0,
+					IB_GSI_PORT_COUNTERS_EXT, pma_port_cb,
+					scan) < 0)
+			scan->failed++;
+	}
+}
+
+static int pma_scan_pipelined(struct ibmad_port *srcport, pma_scan_t * scan)
+{
+	int lid;
+
+	scan->engine = mad_rpc_engine_open(srcport, pma_window);
+	if (!scan->engine)
+		return -1;
+
+	for (lid = 1; lid <= sim_nodes; lid++) {
+		scan->mads++;
+		if (pma_query_async_via(scan->engine, &scan->portids[lid], 0, 0,
+					CLASS_PORT_INFO, pma_cpi_cb, scan) < 0)
+			scan->failed++;
+	}
+	if (mad_rpc_engine_wait(scan->engine) < 0)
+		return -1;
+
+	mad_rpc_engine_close(scan->engine);
+	return 0;
+}
+
+static int pma_scan_init(pma_scan_t * scan)
+{
+	int lid;
+
+	memset(scan, 0, sizeof(*scan));
+	scan->portids = calloc(sim_nodes + 1, sizeof(*scan->portids));
+	scan->cap_masks = calloc(sim_nodes + 1, sizeof(*scan->cap_masks));
+	if (!scan->portids || !scan->cap_masks)
+		return -1;
+	for (lid = 1; lid <= sim_nodes; lid++)
+		ib_portid_set(&scan->portids[lid], lid, 0, 0);
+	return sim_init();
+}
+
+static void pma_scan_free(pma_scan_t * scan)
+{
+	free(scan->portids);
+	free(scan->cap_masks);
+}
+
+static void pma_report(const char *mode, pma_scan_t * scan, uint64_t host_us)
+{
+	printf("%-10s %7d MADs %5d failed %5d bad ports  "
+	       "fabric %9.1f ms  host %7.1f ms (%.2f us/MAD)\n",
+	       mode, scan->mads, scan->failed, scan->bad_ports,
+	       (double)sim_now / 1000, (double)host_us / 1000,
+	       scan->mads ? (double)host_us / scan->mads : 0);
+}
+
+static int bench_pma(void)
+{
+	int mgmt_classes[] = { IB_PERFORMANCE_CLASS };
+	struct ibmad_port *srcport;
+	pma_scan_t seq, pipe;
+	uint64_t start, seq_sim;
+	int rc = 0;
+
+	srcport = mad_rpc_open_port(NULL, 0, mgmt_classes, 1);
+	if (!srcport) {
+		fprintf(stderr, "can't open simulated port\n");
+		return -1;
+	}
+
+	printf("simulated fabric: %d nodes x %d ports, rtt %d us, "
+	       "PMA service %d us, %d%% drops, window %d\n", sim_nodes,
+	       sim_ports, sim_rtt_us, sim_svc_us, sim_drop_pct, pma_window);
+
+	if (pma_scan_init(&seq) < 0)
+		return -1;
+	start = cl_get_time_stamp();
+	pma_scan_seq(srcport, &seq);
+	pma_report("sequential", &seq, cl_get_time_stamp() - start);
+	seq_sim = sim_now;
+
+	if (pma_scan_init(&pipe) < 0)
+		return -1;
+	start = cl_get_time_stamp();
+	if (pma_scan_pipelined(srcport, &pipe) < 0) {
+		fprintf(stderr, "pipelined scan failed\n");
+		rc = -1;
+	}
+	pma_report("pipelined", &pipe, cl_get_time_stamp() - start);
+	if (sim_now)
+		printf("speedup %.1fx\n", (double)seq_sim / sim_now);
+
+	if (pipe.bad_ports != seq.bad_ports || pipe.mads != seq.mads ||
+	    pipe.failed || seq.failed) {
+		fprintf(stderr, "scan results differ\n");
+		rc = -1;
+	}
+
+	pma_scan_free(&seq);
+	pma_scan_free(&pipe);
+	mad_rpc_close_port(srcport);
+	return rc;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: madbench [-i iterations] decode\n"
+		"       madbench [-n nodes] [-p ports] [-w window] "
+		"[-r rtt_us] [-s service_us]\n"
+		"                [-d drop_pct] [-x] pma\n"
+		"  -x  do not query PortCountersExtended\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-x")) {
+			pma_ext = 0;
+			continue;
+		}
+		if (i + 1 >= argc)
+			usage();
+		if (!strcmp(argv[i], "-i"))
+			iterations = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-n"))
+			sim_nodes = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-p"))
+			sim_ports = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-w"))
+			pma_window = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r"))
+			sim_rtt_us = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s"))
+			sim_svc_us = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-d"))
+			sim_drop_pct = atoi(argv[++i]);
+		else
+			usage();
+	}
+	if (i != argc - 1 || iterations <= 0 || sim_nodes <= 0 ||
+	    sim_ports <= 0 || sim_ports > 254 || pma_window <= 0)
+		usage();
+
+	if (!strcmp(argv[i], "decode"))
+		return bench_decode() ? 1 : 0;
+	if (!strcmp(argv[i], "pma"))
+		return bench_pma() ? 1 : 0;
+
+	usage();
+	return 2;
+}
@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2009 HNR Consulting.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Simulated PMA responder.
+ *
+ * Replaces libibumad for madbench: libibmad is linked from source against
+ * these umad_* entry points, so the real RPC code paths run unchanged
+ * while every PerfMgt Get is answered by a simulated fabric.
+ *
+ * The fabric has sim_nodes nodes with LIDs 1..sim_nodes and sim_ports
+ * ports each.  Every node answers one MAD at a time, taking sim_svc_us;
+ * the wire adds sim_rtt_us per round trip.  Time is virtual: umad_recv()
+ * advances the simulated clock to the next response instead of sleeping,
+ * so the measured scan time reflects the fabric model, not the host.
+ * A request may be dropped with probability sim_drop_pct percent; it is
+ * then reported back with ETIMEDOUT after its timeout, as the stack does.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+#include <iba/ib_types.h>
+
+#include "umad_sim.h"
+
+int sim_nodes = 648;
+int sim_ports = 36;
+int sim_rtt_us = 20;
+int sim_svc_us = 10;
+int sim_drop_pct = 0;
+uint16_t sim_cap_mask = IB_PM_EXT_WIDTH_SUPPORTED | IB_PM_PC_XMIT_WAIT_SUP;
+
+uint64_t sim_now;		/* virtual usec */
+uint64_t sim_mads;		/* requests answered or dropped */
+
+typedef struct sim_resp {
+	uint64_t due;
+	uint64_t seq;		/* keeps equal due times in send order */
+	int length;
+	uint8_t umad[sizeof(ib_user_mad_t) + IB_MAD_SIZE];
+} sim_resp_t;
+
+static sim_resp_t **heap;
+static int heap_cnt, heap_size;
+static uint64_t *node_busy;
+static uint64_t seq;
+
+static int resp_before(const sim_resp_t * a, const sim_resp_t * b)
+{
+	return a->due < b->due || (a->due == b->due && a->seq < b->seq);
+}
+
+static int heap_push(sim_resp_t * r)
+{
+	int i, parent;
+
+	if (heap_cnt == heap_size) {
+		int size = heap_size ? heap_size * 2 : 256;
+		sim_resp_t **h = realloc(heap, size * sizeof(*heap));
+
+		if (!h)
+			return -1;
+		heap = h;
+		heap_size = size;
+	}
+
+	for (i = heap_cnt++; i; i = parent) {
+		parent = (i - 1) / 2;
+		if (!resp_before(r, heap[parent]))
+			break;
+		heap[i] = heap[parent];
+	}
+	heap[i] = r;
+	return 0;
+}
+
+static sim_resp_t *heap_pop(void)
+{
+	sim_resp_t *top, *last;
+	int i, child;
+
+	if (!heap_cnt)
+		return NULL;
+
+	top = heap[0];
+	last = heap[--heap_cnt];
+	for (i = 0; (child = 2 * i + 1) < heap_cnt; i = child) {
+		if (child + 1 < heap_cnt &&
+		    resp_before(heap[child + 1], heap[child]))
+			child++;
+		if (!resp_before(heap[child], last))
+			break;
+		heap[i] = heap[child];
+	}
+	if (heap_cnt)
+		heap[i] = last;
+	return top;
+}
+
+/* deterministic counter contents, a few ports carry errors */
+static void fill_counters(uint8_t * data, int lid, int port, unsigned attr)
+{
+	uint32_t v;
+
+	if (attr == IB_GSI_PORT_COUNTERS) {
+		if ((lid * 31 + port) % 17 == 0) {
+			v = lid;
+			mad_encode_field(data, IB_PC_ERR_SYM_F, &v);
+			v = 1;
+			mad_encode_field(data, IB_PC_LINK_DOWNED_F, &v);
+		}
+		v = 1000 * port;
+		mad_encode_field(data, IB_PC_XMT_BYTES_F, &v);
+		mad_encode_field(data, IB_PC_RCV_BYTES_F, &v);
+	} else if (attr == IB_GSI_PORT_COUNTERS_EXT) {
+		mad_set_field64(data, 0, IB_PC_EXT_XMT_BYTES_F,
+				(uint64_t) lid << 32 | port);
+		mad_set_field64(data, 0, IB_PC_EXT_RCV_BYTES_F,
+				(uint64_t) lid << 32 | port);
+	}
+}
+
+static void build_response(uint8_t * mad, int lid)
+{
+	uint8_t *data = mad + IB_PC_DATA_OFFS;
+	unsigned attr = mad_get_field(mad, 0, IB_MAD_ATTRID_F);
+	int port = mad_get_field(data, 0, IB_PC_PORT_SELECT_F);
+
+	mad_set_field(mad, 0, IB_MAD_METHOD_F, IB_MAD_METHOD_GET_RESPONSE);
+	mad_set_field(mad, 0, IB_MAD_RESPONSE_F, 1);
+	mad_set_field(mad, 0, IB_MAD_STATUS_F, 0);
+
+	if (attr == CLASS_PORT_INFO) {
+		memset(data, 0, IB_PC_DATA_SZ);
+		mad_set_field(data, 0, IB_CPI_BASEVER_F, 1);
+		mad_set_field(data, 0, IB_CPI_CLASSVER_F, 1);
+		/* CapabilityMask, kept in network order like IB_PM_* */
+		memcpy(data + 2, &sim_cap_mask, sizeof(sim_cap_mask));
+		return;
+	}
+
+	if (attr != IB_GSI_PORT_COUNTERS && attr != IB_GSI_PORT_COUNTERS_EXT) {
+		mad_set_field(mad, 0, IB_MAD_STATUS_F, 0x0c);	/* unsupported */
+		return;
+	}
+
+	memset(data, 0, IB_PC_DATA_SZ);
+	mad_set_field(data, 0, IB_PC_PORT_SELECT_F, port);
+	if (port != 0xff && (port < 1 || port > sim_ports)) {
+		mad_set_field(mad, 0, IB_MAD_STATUS_F, 0x1c);	/* bad field */
+		return;
+	}
+	fill_counters(data, lid, port, attr);
+}
+
+int sim_init(void)
+{
+	free(node_busy);
+	node_busy = calloc(sim_nodes + 1, sizeof(*node_busy));
+	if (!node_busy)
+		return -1;
+	while (heap_cnt)
+		free(heap_pop());
+	sim_now = 0;
+	sim_mads = 0;
+	seq = 0;
+	srand(1);
+	return 0;
+}
+
+int umad_init(void)
+{
+	return 0;
+}
+
+int umad_done(void)
+{
+	return 0;
+}
+
+int umad_open_port(char *ca_name, int portnum)
+{
+	return 0;
+}
+
+int umad_close_port(int portid)
+{
+	return 0;
+}
+
+int umad_register(int portid, int mgmt_class, int mgmt_version,
+		  uint8_t rmpp_version, long method_mask[16 / sizeof(long)])
+{
+	return mgmt_class;
+}
+
+int umad_register_oui(int portid, int mgmt_class, uint8_t rmpp_version,
+		      uint8_t oui[3], long method_mask[16 / sizeof(long)])
+{
+	return mgmt_class;
+}
+
+int umad_unregister(int portid, int agentid)
+{
+	return 0;
+}
+
+void *umad_get_mad(void *umad)
+{
+	return ((ib_user_mad_t *) umad)->data;
+}
+
+size_t umad_size(void)
+{
+	return sizeof(ib_user_mad_t);
+}
+
+int umad_status(void *umad)
+{
+	return ((ib_user_mad_t *) umad)->status;
+}
+
+ib_mad_addr_t *umad_get_mad_addr(void *umad)
+{
+	return &((ib_user_mad_t *) umad)->addr;
+}
+
+int umad_set_grh(void *umad, void *mad_addr)
+{
+	((ib_user_mad_t *) umad)->addr.grh_present = mad_addr != NULL;
+	return 0;
+}
+
+int umad_set_pkey(void *umad, int pkey_index)
+{
+	((ib_user_mad_t *) umad)->addr.pkey_index = (uint16_t) pkey_index;
+	return 0;
+}
+
+int umad_set_addr(void *umad, int dlid, int dqp, int sl, int qkey)
+{
+	ib_user_mad_t *mad = (ib_user_mad_t *) umad;
+
+	mad->addr.qpn = htonl(dqp);
+	mad->addr.lid = htons((uint16_t) dlid);
+	mad->addr.qkey = htonl(qkey);
+	mad->addr.sl = (uint8_t) sl;
+	return 0;
+}
+
+void *umad_alloc(int num, size_t size)
+{
+	return calloc(num, size);
+}
+
+void umad_free(void *umad)
+{
+	free(umad);
+}
+
+int umad_send(int portid, int agentid, void *umad, int length,
+	      int timeout_ms, int retries)
+{
+	ib_user_mad_t *req = (ib_user_mad_t *) umad;
+	sim_resp_t *r;
+	uint64_t start;
+	int lid = ntohs(req->addr.lid);
+
+	if (length > IB_MAD_SIZE || lid < 1 || lid > sim_nodes) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	r = malloc(sizeof(*r));
+	if (!r) {
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(r->umad, umad, sizeof(ib_user_mad_t) + length);
+	((ib_user_mad_t *) r->umad)->agent_id = agentid;
+	r->length = length;
+	r->seq = seq++;
+	sim_mads++;
+
+	if (sim_drop_pct && rand() % 100 < sim_drop_pct) {
+		/* the stack hands the request back once it timed out */
+		((ib_user_mad_t *) r->umad)->status = ETIMEDOUT;
+		r->due = sim_now + (uint64_t) timeout_ms * 1000;
+	} else {
+		/* nodes answer one MAD at a time */
+		start = sim_now + sim_rtt_us / 2;
+		if (node_busy[lid] > start)
+			start = node_busy[lid];
+		node_busy[lid] = start + sim_svc_us;
+		r->due = node_busy[lid] + (sim_rtt_us + 1) / 2;
+		((ib_user_mad_t *) r->umad)->status = 0;
+		build_response(umad_get_mad(r->umad), lid);
+	}
+
+	if (heap_push(r) < 0) {
+		free(r);
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+int umad_recv(int portid, void *umad, int *length, int timeout_ms)
+{
+	sim_resp_t *r;
+	int agent;
+
+	if (!heap_cnt || heap[0]->due > sim_now + (uint64_t) timeout_ms * 1000) {
+		sim_now += (uint64_t) timeout_ms * 1000;
+		errno = EWOULDBLOCK;
+		return -EWOULDBLOCK;
+	}
+
+	r = heap_pop();
+	if (r->due > sim_now)
+		sim_now = r->due;
+
+	if (r->length > *length) {
+		free(r);
+		errno = ENOSPC;
+		return -ENOSPC;
+	}
+	memcpy(umad, r->umad, sizeof(ib_user_mad_t) + r->length);
+	*length = r->length;
+	agent = ((ib_user_mad_t *) umad)->agent_id;
+	free(r);
+	return agent;
+}
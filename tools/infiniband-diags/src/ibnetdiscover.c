@@ -73,6 +73,7 @@ static FILE *f;
 static char *node_name_map_file = NULL;
 static nn_map_t *node_name_map = NULL;
 static char *cache_file = NULL;
+static unsigned cache_flags = IBND_CACHE_FABRIC_FLAG_DEFAULT;
 static char *load_cache_file = NULL;
 static char *diff_cache_file = NULL;
 static unsigned diffcheck_flags = DIFF_FLAG_DEFAULT;
@@ -1004,6 +1005,9 @@ static int process_opt(void *context, int ch, char *optarg)
 			p = strtok(NULL, ",");
 		}
 		break;
+	case 6:
+		cache_flags |= IBND_CACHE_FABRIC_FLAG_MAPPED;
+		break;
 	case 's':
 		cfg->show_progress = 1;
 		break;
@@ -1058,6 +1062,8 @@ int main(int argc, char **argv)
 		{"node-name-map", 1, 1, "<file>", "node name map file"},
 		{"cache", 2, 1, "<file>",
 		 "filename to cache ibnetdiscover data to"},
+		{"mapped-cache", 6, 0, NULL,
+		 "write the --cache file in the mapped (version 2) format"},
 		{"load-cache", 3, 1, "<file>",
 		 "filename of ibnetdiscover cache to load"},
 		{"diff", 4, 1, "<file>",
@@ -1113,7 +1119,7 @@ int main(int argc, char **argv)
 		dump_topology(group, fabric);
 
 	if (cache_file)
-		if (ibnd_cache_fabric(fabric, cache_file, 0) < 0)
+		if (ibnd_cache_fabric(fabric, cache_file, cache_flags) < 0)
 			IBERROR("caching ibnetdiscover data failed\n");
 
 	ibnd_destroy_fabric(fabric);
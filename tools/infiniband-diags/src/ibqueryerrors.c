@@ -44,6 +44,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <time.h>
 #include <string.h>
 #include <getopt.h>
@@ -457,38 +458,19 @@ static int query_cap_mask(ib_portid_t * portid, char *node_name, int portnum,
 	return 0;
 }
 
-static int print_data_cnts(ib_portid_t * portid, uint16_t cap_mask,
-			   char *node_name, ibnd_node_t * node, int portnum,
-			   int *header_printed)
+static void dump_data_cnts(uint8_t * pc, uint16_t cap_mask, char *node_name,
+			   ibnd_node_t * node, int portnum, int *header_printed)
 {
-	uint8_t pc[1024];
 	int i;
 	int start_field = IB_PC_XMT_BYTES_F;
 	int end_field = IB_PC_RCV_PKTS_F;
 
-	memset(pc, 0, 1024);
-
 	if (cap_mask & (IB_PM_EXT_WIDTH_SUPPORTED | IB_PM_EXT_WIDTH_NOIETF_SUP)) {
-		if (!pma_query_via(pc, portid, portnum, ibd_timeout,
-				   IB_GSI_PORT_COUNTERS_EXT, ibmad_port)) {
-			IBWARN("IB_GSI_PORT_COUNTERS_EXT query failed on %s, %s port %d",
-			       node_name, portid2str(portid), portnum);
-			return (1);
-		}
 		start_field = IB_PC_EXT_XMT_BYTES_F;
 		if (cap_mask & IB_PM_EXT_WIDTH_SUPPORTED)
 			end_field = IB_PC_EXT_RCV_MPKTS_F;
 		else
 			end_field = IB_PC_EXT_RCV_PKTS_F;
-	} else {
-		if (!pma_query_via(pc, portid, portnum, ibd_timeout,
-				   IB_GSI_PORT_COUNTERS, ibmad_port)) {
-			IBWARN("IB_GSI_PORT_COUNTERS query failed on %s, %s port %d",
-			       node_name, portid2str(portid), portnum);
-			return (1);
-		}
-		start_field = IB_PC_XMT_BYTES_F;
-		end_field = IB_PC_RCV_PKTS_F;
 	}
 
 	if (!*header_printed) {
@@ -520,10 +502,49 @@ static int print_data_cnts(ib_portid_t * portid, uint16_t cap_mask,
 
 	if (portnum != 0xFF && port_config)
 		print_port_config(node_name, node, portnum);
+}
 
+static int print_data_cnts(ib_portid_t * portid, uint16_t cap_mask,
+			   char *node_name, ibnd_node_t * node, int portnum,
+			   int *header_printed)
+{
+	uint8_t pc[1024];
+
+	memset(pc, 0, 1024);
+
+	if (cap_mask & (IB_PM_EXT_WIDTH_SUPPORTED | IB_PM_EXT_WIDTH_NOIETF_SUP)) {
+		if (!pma_query_via(pc, portid, portnum, ibd_timeout,
+				   IB_GSI_PORT_COUNTERS_EXT, ibmad_port)) {
+			IBWARN("IB_GSI_PORT_COUNTERS_EXT query failed on %s, %s port %d",
+			       node_name, portid2str(portid), portnum);
+			return (1);
+		}
+	} else {
+		if (!pma_query_via(pc, portid, portnum, ibd_timeout,
+				   IB_GSI_PORT_COUNTERS, ibmad_port)) {
+			IBWARN("IB_GSI_PORT_COUNTERS query failed on %s, %s port %d",
+			       node_name, portid2str(portid), portnum);
+			return (1);
+		}
+	}
+
+	dump_data_cnts(pc, cap_mask, node_name, node, portnum, header_printed);
 	return (0);
 }
 
+static int report_errors(ib_portid_t * portid, uint16_t cap_mask,
+			 char *node_name, ibnd_node_t * node, int portnum,
+			 int *header_printed, uint8_t * pc, uint8_t * pc_ext)
+{
+	if (!(cap_mask & IB_PM_PC_XMIT_WAIT_SUP)) {
+		/* if PortCounters:PortXmitWait not supported clear this counter */
+		uint32_t foo = 0;
+		mad_encode_field(pc, IB_PC_XMT_WAIT_F, &foo);
+	}
+	return (print_results(portid, node_name, node, pc, portnum,
+			      header_printed, pc_ext, cap_mask));
+}
+
 static int print_errors(ib_portid_t * portid, uint16_t cap_mask,
 			char *node_name, ibnd_node_t * node, int portnum,
 			int *header_printed)
@@ -552,13 +573,8 @@ static int print_errors(ib_portid_t * portid, uint16_t cap_mask,
 		pc_ext = pce;
 	}
 
-	if (!(cap_mask & IB_PM_PC_XMIT_WAIT_SUP)) {
-		/* if PortCounters:PortXmitWait not supported clear this counter */
-		uint32_t foo = 0;
-		mad_encode_field(pc, IB_PC_XMT_WAIT_F, &foo);
-	}
-	return (print_results(portid, node_name, node, pc, portnum,
-			      header_printed, pc_ext, cap_mask));
+	return (report_errors(portid, cap_mask, node_name, node, portnum,
+			      header_printed, pc, pc_ext));
 }
 
 uint8_t *reset_pc_ext(void *rcvbuf, ib_portid_t * dest,
@@ -747,6 +763,373 @@ clear:
 	free(node_name);
 }
 
+/*
+ * Pipelined scan: ClassPortInfo, PortCounters and PortCountersExtended
+ * queries for all nodes are issued through an asynchronous RPC engine
+ * with at most "pma_window" MADs on the wire.  The port queries of a node
+ * are chained from its ClassPortInfo completion so the capability mask is
+ * queried once per node and reused for all of its ports.  Results are
+ * kept per port and reported in discovery order once the scan completes,
+ * producing the same output as the sequential scan.
+ */
+typedef struct scan_node scan_node_t;
+
+typedef struct scan_port {
+	scan_node_t *sn;
+	int portnum;
+	ib_portid_t portid;
+	int pending;
+	int pc_err;
+	int pce_err;
+	uint8_t pc[IB_PC_DATA_SZ];
+	uint8_t pce[IB_PC_DATA_SZ];
+} scan_port_t;
+
+struct scan_node {
+	ibnd_node_t *node;
+	char *node_name;
+	ib_portid_t portid;
+	int startport;
+	int cpi_port;
+	int cpi_err;
+	uint16_t cap_mask;
+	int all_port_sup;
+	scan_port_t all;
+	scan_port_t *ports;	/* indexed by port number */
+	scan_node_t *next;
+};
+
+static int pma_window = 0;
+static struct ibmad_rpc_engine *pma_engine = NULL;
+static scan_node_t *scan_head = NULL, *scan_tail = NULL;
+
+static int scan_ext_supported(scan_node_t * sn)
+{
+	return sn->cap_mask &
+	    (IB_PM_EXT_WIDTH_SUPPORTED | IB_PM_EXT_WIDTH_NOIETF_SUP);
+}
+
+/* error counters checked by print_results(), in field order */
+#define PC_ERR(f, m)	{ f, offsetof(ibmad_port_counters_t, m) }
+static const struct {
+	enum MAD_FIELDS field;
+	size_t offs;
+} pc_err_fields[] = {
+	PC_ERR(IB_PC_ERR_SYM_F, err_sym),
+	PC_ERR(IB_PC_LINK_RECOVERS_F, link_recovers),
+	PC_ERR(IB_PC_LINK_DOWNED_F, link_downed),
+	PC_ERR(IB_PC_ERR_RCV_F, err_rcv),
+	PC_ERR(IB_PC_ERR_PHYSRCV_F, err_physrcv),
+	PC_ERR(IB_PC_ERR_SWITCH_REL_F, err_switch_rel),
+	PC_ERR(IB_PC_XMT_DISCARDS_F, xmt_discards),
+	PC_ERR(IB_PC_ERR_XMTCONSTR_F, err_xmtconstr),
+	PC_ERR(IB_PC_ERR_RCVCONSTR_F, err_rcvconstr),
+	PC_ERR(IB_PC_ERR_LOCALINTEG_F, err_localinteg),
+	PC_ERR(IB_PC_ERR_EXCESS_OVR_F, err_excess_ovr),
+	PC_ERR(IB_PC_VL15_DROPPED_F, vl15_dropped),
+};
+
+#define PC_VAL(pc, offs)	(*(const uint32_t *)((const char *)(pc) + (offs)))
+
+/*
+ * Same test as print_results() without the side effects.  The scan checks
+ * every port, so the reply and the thresholds are each decoded in one pass.
+ */
+static int port_has_errors(uint8_t * pc, uint16_t cap_mask)
+{
+	static ibmad_port_counters_t thres;
+	static int thres_decoded = 0;
+	ibmad_port_counters_t c;
+	int i;
+
+	if (!thres_decoded) {
+		mad_decode_port_counters(thresholds, &thres);
+		thres_decoded = 1;
+	}
+	mad_decode_port_counters(pc, &c);
+
+	for (i = 0; i < (int)(sizeof(pc_err_fields) / sizeof(pc_err_fields[0]));
+	     i++) {
+		if (suppress(pc_err_fields[i].field))
+			continue;
+		if (PC_VAL(&c, pc_err_fields[i].offs) >
+		    PC_VAL(&thres, pc_err_fields[i].offs))
+			return 1;
+	}
+
+	if ((cap_mask & IB_PM_PC_XMIT_WAIT_SUP) && !suppress(IB_PC_XMT_WAIT_F)
+	    && c.xmt_wait > thres.xmt_wait)
+		return 1;
+	return 0;
+}
+
+static void scan_port_cb(struct ibmad_rpc_engine *engine, ib_rpc_t * rpc,
+			 ib_portid_t * dport, uint8_t * mad, int error,
+			 void *cb_data);
+
+static void scan_issue(scan_port_t * sp, unsigned attr_id)
+{
+	sp->pending++;
+	if (pma_query_async_via(pma_engine, &sp->portid, sp->portnum,
+				ibd_timeout, attr_id, scan_port_cb, sp) < 0) {
+		sp->pending--;
+		if (attr_id == IB_GSI_PORT_COUNTERS_EXT)
+			sp->pce_err = 1;
+		else
+			sp->pc_err = 1;
+	}
+}
+
+static void scan_port(scan_port_t * sp)
+{
+	scan_node_t *sn = sp->sn;
+
+	if (data_counters_only) {
+		/* print_data_cnts() reads one or the other into pc */
+		scan_issue(sp, scan_ext_supported(sn) ?
+			   IB_GSI_PORT_COUNTERS_EXT : IB_GSI_PORT_COUNTERS);
+		return;
+	}
+
+	scan_issue(sp, IB_GSI_PORT_COUNTERS);
+	if (scan_ext_supported(sn))
+		scan_issue(sp, IB_GSI_PORT_COUNTERS_EXT);
+}
+
+static void scan_ports(scan_node_t * sn)
+{
+	ibnd_node_t *node = sn->node;
+	int p;
+
+	for (p = sn->startport; p <= node->numports; p++)
+		if (node->ports[p])
+			scan_port(&sn->ports[p]);
+}
+
+static void scan_port_cb(struct ibmad_rpc_engine *engine, ib_rpc_t * rpc,
+			 ib_portid_t * dport, uint8_t * mad, int error,
+			 void *cb_data)
+{
+	scan_port_t *sp = cb_data;
+	scan_node_t *sn = sp->sn;
+	int pce = (rpc->attr.id == IB_GSI_PORT_COUNTERS_EXT &&
+		   !data_counters_only);
+
+	if (error) {
+		if (pce)
+			sp->pce_err = 1;
+		else
+			sp->pc_err = 1;
+	} else
+		memcpy(pce ? sp->pce : sp->pc, mad + IB_PC_DATA_OFFS,
+		       IB_PC_DATA_SZ);
+
+	if (--sp->pending || sp != &sn->all)
+		return;
+
+	/* print_node() only walks the ports when port ALL shows errors */
+	if (!sp->pc_err && !sp->pce_err && port_has_errors(sp->pc, sn->cap_mask))
+		scan_ports(sn);
+}
+
+static void scan_cpi_cb(struct ibmad_rpc_engine *engine, ib_rpc_t * rpc,
+			ib_portid_t * dport, uint8_t * mad, int error,
+			void *cb_data)
+{
+	scan_node_t *sn = cb_data;
+
+	if (error) {
+		sn->cpi_err = 1;
+	} else {
+		/* ClassPortInfo CapabilityMask, as in query_cap_mask() */
+		memcpy(&sn->cap_mask, mad + IB_PC_DATA_OFFS + 2,
+		       sizeof(sn->cap_mask));
+		if (sn->cap_mask & IB_PM_ALL_PORT_SELECT)
+			sn->all_port_sup = 1;
+	}
+
+	if (sn->all_port_sup && !data_counters_only)
+		scan_port(&sn->all);
+	else
+		scan_ports(sn);
+}
+
+static void scan_node(ibnd_node_t * node, void *user_data)
+{
+	scan_node_t *sn;
+	int p, type = 0;
+
+	switch (node->type) {
+	case IB_NODE_SWITCH:
+		type = PRINT_SWITCH;
+		break;
+	case IB_NODE_CA:
+		type = PRINT_CA;
+		break;
+	case IB_NODE_ROUTER:
+		type = PRINT_ROUTER;
+		break;
+	}
+
+	if ((type & node_type_to_print) == 0)
+		return;
+
+	sn = calloc(1, sizeof(*sn));
+	if (sn)
+		sn->ports = calloc(node->numports + 1, sizeof(*sn->ports));
+	if (!sn || !sn->ports)
+		IBERROR("Failed to allocate scan state");
+
+	sn->node = node;
+	sn->node_name = remap_node_name(node_name_map, node->guid,
+					node->nodedesc);
+	sn->startport = 1;
+	if (node->type == IB_NODE_SWITCH && node->smaenhsp0)
+		sn->startport = 0;
+
+	if (node->type == IB_NODE_SWITCH) {
+		ib_portid_set(&sn->portid, node->smalid, 0, 0);
+		p = 0;
+	} else {
+		for (p = 1; p <= node->numports; p++) {
+			if (node->ports[p]) {
+				ib_portid_set(&sn->portid,
+					      node->ports[p]->base_lid, 0, 0);
+				break;
+			}
+		}
+	}
+
+	sn->cpi_port = p;
+	sn->all.sn = sn;
+	sn->all.portnum = 0xFF;
+	sn->all.portid = sn->portid;
+	for (p = 0; p <= node->numports; p++) {
+		sn->ports[p].sn = sn;
+		sn->ports[p].portnum = p;
+		if (!node->ports[p])
+			continue;
+		if (node->type == IB_NODE_SWITCH)
+			ib_portid_set(&sn->ports[p].portid, node->smalid, 0, 0);
+		else
+			ib_portid_set(&sn->ports[p].portid,
+				      node->ports[p]->base_lid, 0, 0);
+	}
+
+	if (scan_tail)
+		scan_tail->next = sn;
+	else
+		scan_head = sn;
+	scan_tail = sn;
+
+	/* PerfMgt ClassPortInfo is a required attribute */
+	if (pma_query_async_via(pma_engine, &sn->portid, sn->cpi_port,
+				ibd_timeout, CLASS_PORT_INFO, scan_cpi_cb,
+				sn) < 0)
+		scan_cpi_cb(pma_engine, NULL, NULL, NULL, EIO, sn);
+}
+
+static int report_scan_port(scan_port_t * sp, int *header_printed)
+{
+	scan_node_t *sn = sp->sn;
+
+	if (data_counters_only) {
+		if (sp->pc_err) {
+			IBWARN("%s query failed on %s, %s port %d",
+			       scan_ext_supported(sn) ?
+			       "IB_GSI_PORT_COUNTERS_EXT" :
+			       "IB_GSI_PORT_COUNTERS", sn->node_name,
+			       portid2str(&sp->portid), sp->portnum);
+			return 0;
+		}
+		dump_data_cnts(sp->pc, sn->cap_mask, sn->node_name, sn->node,
+			       sp->portnum, header_printed);
+		return 0;
+	}
+
+	if (sp->pc_err) {
+		IBWARN("IB_GSI_PORT_COUNTERS query failed on %s, %s port %d",
+		       sn->node_name, portid2str(&sp->portid), sp->portnum);
+		return 0;
+	}
+	if (sp->pce_err) {
+		IBWARN("IB_GSI_PORT_COUNTERS_EXT query failed on %s, %s port %d",
+		       sn->node_name, portid2str(&sp->portid), sp->portnum);
+		return 0;
+	}
+	return report_errors(&sp->portid, sn->cap_mask, sn->node_name,
+			     sn->node, sp->portnum, header_printed, sp->pc,
+			     scan_ext_supported(sn) ? sp->pce : NULL);
+}
+
+static void report_scan_node(scan_node_t * sn)
+{
+	ibnd_node_t *node = sn->node;
+	int header_printed = 0;
+	int p;
+
+	if (sn->cpi_err)
+		IBWARN("classportinfo query failed on %s, %s port %d",
+		       sn->node_name, portid2str(&sn->portid), sn->cpi_port);
+
+	if (sn->all_port_sup && !data_counters_only &&
+	    !report_scan_port(&sn->all, &header_printed)) {
+		summary.ports_checked += node->numports;
+		goto clear;
+	}
+
+	for (p = sn->startport; p <= node->numports; p++) {
+		if (!node->ports[p])
+			continue;
+		report_scan_port(&sn->ports[p], &header_printed);
+		summary.ports_checked++;
+		if (!sn->all_port_sup)
+			clear_port(&sn->ports[p].portid, sn->cap_mask,
+				   sn->node_name, p);
+	}
+
+clear:
+	summary.nodes_checked++;
+	if (sn->all_port_sup)
+		clear_port(&sn->portid, sn->cap_mask, sn->node_name, 0xFF);
+}
+
+static int scan_fabric(ibnd_fabric_t * fabric)
+{
+	scan_node_t *sn, *next;
+	int rc;
+
+	pma_engine = mad_rpc_engine_open(ibmad_port, pma_window);
+	if (!pma_engine)
+		IBERROR("Failed to create PMA query engine");
+
+	ibnd_iter_nodes(fabric, scan_node, NULL);
+	rc = mad_rpc_engine_wait(pma_engine);
+
+	if (ibverbose) {
+		struct ibmad_rpc_engine_stats stats;
+
+		mad_rpc_engine_get_stats(pma_engine, &stats);
+		printf("## PMA queries: %" PRIu64 " sent, %" PRIu64
+		       " failed, %" PRIu64 " retries, max %d on wire\n",
+		       stats.sent, stats.errors, stats.retries,
+		       stats.max_on_wire);
+	}
+	mad_rpc_engine_close(pma_engine);
+	pma_engine = NULL;
+
+	for (sn = scan_head; sn; sn = next) {
+		next = sn->next;
+		if (!rc)
+			report_scan_node(sn);
+		free(sn->node_name);
+		free(sn->ports);
+		free(sn);
+	}
+	scan_head = scan_tail = NULL;
+	return rc;
+}
+
 static void add_suppressed(enum MAD_FIELDS field)
 {
 	if (sup_total >= SUP_MAX) {
@@ -812,6 +1195,9 @@ static int process_opt(void *context, int ch, char *optarg)
 	case 9:
 		data_counters_only = 1;
 		break;
+	case 10:
+		pma_window = strtoul(optarg, NULL, 0);
+		break;
 	case 'G':
 	case 'S':
 		port_guid_str = optarg;
@@ -886,6 +1272,9 @@ int main(int argc, char **argv)
 		{"outstanding_smps", 'o', 1, NULL,
 		 "specify the number of outstanding SMP's which should be "
 		 "issued during the scan"},
+		{"parallel", 10, 1, "<window>",
+		 "query the performance counters of many ports concurrently, "
+		 "keeping up to <window> PMA queries outstanding"},
 		{0}
 	};
 	char usage_args[] = "";
@@ -982,6 +1371,11 @@ int main(int argc, char **argv)
 			print_node(port->node, NULL);
 		} else
 			fprintf(stderr, "Failed to find node: %s\n", dr_path);
+	} else if (pma_window) {
+		if (scan_fabric(fabric)) {
+			rc = -1;
+			goto destroy_fabric;
+		}
 	} else
 		ibnd_iter_nodes(fabric, print_node, NULL);
 
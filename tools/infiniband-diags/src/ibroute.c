@@ -46,6 +46,7 @@
 
 #include <infiniband/umad.h>
 #include <infiniband/mad.h>
+#include <infiniband/ibnetdisc.h>
 #include <complib/cl_nodenamemap.h>
 
 #include "ibdiag_common.h"
@@ -53,6 +54,8 @@
 struct ibmad_port *srcport;
 
 static int brief, dump_all, multicast;
+static char *fabric_dump_file, *load_cache_file;
+static int smp_window = 64;
 
 /*******************************************/
 
@@ -364,6 +367,236 @@ char *dump_unicast_tables(ib_portid_t * portid, int startlid, int endlid)
 	return 0;
 }
 
+/*
+ * Fabric-wide dump: read the LFT (or, with -M, the MFT) of every switch
+ * through the asynchronous RPC engine, keeping up to smp_window SMPs on
+ * the wire across all switches, and write one line per table block:
+ *
+ *   <switch guid> U <block> <64 out ports, 2 hex digits each>
+ *   <switch guid> M <mlid> <position> <32 port masks, 4 hex digits each>
+ *
+ * preceded by one "S" line per switch.  Switches are sorted by GUID and
+ * blocks by index so two dumps can be compared with diff(1).
+ */
+typedef struct sw_tables {
+	ibnd_node_t *node;
+	ib_portid_t portid;
+	unsigned nports;
+	unsigned nblocks;	/* LFT blocks or MFT blocks */
+	unsigned chunks;	/* MFT port mask positions */
+	unsigned startblock;
+	uint8_t *data;		/* nblocks * chunks * IB_SMP_DATA_SIZE */
+	uint8_t *valid;		/* nblocks * chunks */
+	int errors;
+} sw_tables_t;
+
+static void sw_table_cb(struct ibmad_rpc_engine *engine, ib_rpc_t * rpc,
+			ib_portid_t * dport, uint8_t * mad, int error,
+			void *cb_data)
+{
+	sw_tables_t *sw = cb_data;
+	unsigned block, chunk = 0, idx;
+
+	if (multicast) {
+		block = (rpc->attr.mod & 0x1ff) + IB_MIN_MCAST_LID /
+		    IB_MLIDS_IN_BLOCK - sw->startblock;
+		chunk = rpc->attr.mod >> 28;
+	} else
+		block = rpc->attr.mod - sw->startblock;
+
+	idx = block * sw->chunks + chunk;
+	if (error) {
+		IBWARN("%s block %u position %u of switch 0x%016" PRIx64
+		       " failed", multicast ? "MFT" : "LFT", rpc->attr.mod,
+		       chunk, sw->node->guid);
+		sw->errors++;
+		return;
+	}
+	memcpy(sw->data + idx * IB_SMP_DATA_SIZE, mad + IB_SMP_DATA_OFFS,
+	       IB_SMP_DATA_SIZE);
+	sw->valid[idx] = 1;
+}
+
+static int sw_tables_setup(sw_tables_t * sw, ibnd_node_t * node)
+{
+	unsigned top, cap;
+
+	sw->node = node;
+	sw->nports = node->numports;
+	if (node->smalid)
+		ib_portid_set(&sw->portid, node->smalid, 0, 0);
+	else
+		sw->portid = node->path_portid;
+
+	if (multicast) {
+		mad_decode_field(node->switchinfo, IB_SW_MCAST_FDB_CAP_F, &cap);
+		mad_decode_field(node->switchinfo, IB_SW_MCAST_FDB_TOP_F, &top);
+		if (!cap)
+			return 0;
+		if (dump_all || !top || top >= IB_MIN_MCAST_LID + cap)
+			top = IB_MIN_MCAST_LID + cap - 1;
+		if (top > IB_MAX_MCAST_LID)
+			top = IB_MAX_MCAST_LID;
+		if (top < IB_MIN_MCAST_LID)
+			return 0;
+		sw->startblock = IB_MIN_MCAST_LID / IB_MLIDS_IN_BLOCK;
+		sw->nblocks = top / IB_MLIDS_IN_BLOCK - sw->startblock + 1;
+		sw->chunks = ALIGN(sw->nports + 1, 16) / 16;
+	} else {
+		mad_decode_field(node->switchinfo, IB_SW_LINEAR_FDB_TOP_F, &top);
+		if (top > IB_MAX_UCAST_LID)
+			top = IB_MAX_UCAST_LID;
+		sw->startblock = 0;
+		sw->nblocks = top / IB_SMP_DATA_SIZE + 1;
+		sw->chunks = 1;
+	}
+
+	sw->data = calloc(sw->nblocks * sw->chunks, IB_SMP_DATA_SIZE);
+	sw->valid = calloc(sw->nblocks * sw->chunks, 1);
+	if (!sw->data || !sw->valid)
+		IBERROR("Failed to allocate table buffers");
+	return 0;
+}
+
+static void sw_tables_issue(struct ibmad_rpc_engine *engine, sw_tables_t * sw)
+{
+	unsigned block, chunk, mod;
+
+	for (block = 0; block < sw->nblocks; block++)
+		for (chunk = 0; chunk < sw->chunks; chunk++) {
+			if (multicast)
+				mod = block | (chunk << 28);
+			else
+				mod = block;
+			if (smp_query_async_via(engine, &sw->portid,
+						multicast ?
+						IB_ATTR_MULTICASTFORWTBL :
+						IB_ATTR_LINEARFORWTBL, mod, 0,
+						sw_table_cb, sw) < 0)
+				sw->errors++;
+		}
+}
+
+static void sw_tables_write(FILE * f, sw_tables_t * sw)
+{
+	unsigned block, chunk, i, idx;
+	uint8_t *p;
+	int nonzero;
+
+	fprintf(f, "0x%016" PRIx64 " S %u %u %s %s\n", sw->node->guid,
+		sw->node->smalid, sw->nports, sw->errors ? "incomplete" : "ok",
+		clean_nodedesc(sw->node->nodedesc));
+
+	for (block = 0; block < sw->nblocks; block++)
+		for (chunk = 0; chunk < sw->chunks; chunk++) {
+			idx = block * sw->chunks + chunk;
+			p = sw->data + idx * IB_SMP_DATA_SIZE;
+			if (!sw->valid[idx]) {
+				fprintf(f, "0x%016" PRIx64 " %c 0x%04x %u "
+					"failed\n", sw->node->guid,
+					multicast ? 'M' : 'U',
+					multicast ? (block + sw->startblock) *
+					IB_MLIDS_IN_BLOCK :
+					block * IB_SMP_DATA_SIZE, chunk);
+				continue;
+			}
+
+			if (multicast) {
+				for (nonzero = 0, i = 0; i < IB_SMP_DATA_SIZE; i++)
+					nonzero |= p[i];
+				if (!nonzero && !dump_all)
+					continue;
+				fprintf(f, "0x%016" PRIx64 " M 0x%04x %u ",
+					sw->node->guid,
+					(block + sw->startblock) *
+					IB_MLIDS_IN_BLOCK, chunk);
+			} else
+				fprintf(f, "0x%016" PRIx64 " U 0x%04x ",
+					sw->node->guid,
+					block * IB_SMP_DATA_SIZE);
+
+			for (i = 0; i < IB_SMP_DATA_SIZE; i++)
+				fprintf(f, "%02x", p[i]);
+			fputc('\n', f);
+		}
+}
+
+static int cmp_sw_guid(const void *a, const void *b)
+{
+	const sw_tables_t *swa = a, *swb = b;
+
+	if (swa->node->guid < swb->node->guid)
+		return -1;
+	return swa->node->guid > swb->node->guid;
+}
+
+char *dump_fabric_tables(char *file)
+{
+	struct ibnd_config config = { 0 };
+	struct ibmad_rpc_engine_stats stats;
+	struct ibmad_rpc_engine *engine;
+	ibnd_fabric_t *fabric;
+	ibnd_node_t *node;
+	sw_tables_t *sws;
+	int i, nsw = 0, errors = 0;
+	FILE *f;
+
+	if (load_cache_file)
+		fabric = ibnd_load_fabric(load_cache_file, 0);
+	else {
+		config.timeout_ms = ibd_timeout;
+		fabric = ibnd_discover_fabric(ibd_ca, ibd_ca_port, NULL,
+					      &config);
+	}
+	if (!fabric)
+		return "fabric discovery failed";
+
+	for (node = fabric->switches; node; node = node->type_next)
+		nsw++;
+	sws = calloc(nsw ? nsw : 1, sizeof(*sws));
+	if (!sws)
+		IBERROR("Failed to allocate switch table");
+
+	for (i = 0, node = fabric->switches; node; node = node->type_next)
+		sw_tables_setup(&sws[i++], node);
+	qsort(sws, nsw, sizeof(*sws), cmp_sw_guid);
+
+	engine = mad_rpc_engine_open(srcport, smp_window);
+	if (!engine)
+		IBERROR("Failed to create SMP engine");
+	for (i = 0; i < nsw; i++)
+		sw_tables_issue(engine, &sws[i]);
+	if (mad_rpc_engine_wait(engine) < 0)
+		IBWARN("SMP receive failed; dump is incomplete");
+	mad_rpc_engine_get_stats(engine, &stats);
+	mad_rpc_engine_close(engine);
+
+	if (strcmp(file, "-") == 0)
+		f = stdout;
+	else if (!(f = fopen(file, "w")))
+		IBERROR("Failed to open %s", file);
+
+	fprintf(f, "# ibroute %s dump: %d switches\n",
+		multicast ? "MFT" : "LFT", nsw);
+	for (i = 0; i < nsw; i++) {
+		sw_tables_write(f, &sws[i]);
+		errors += sws[i].errors;
+		free(sws[i].data);
+		free(sws[i].valid);
+	}
+	if (f != stdout)
+		fclose(f);
+
+	if (ibverbose)
+		printf("%" PRIu64 " SMPs sent, %" PRIu64 " retries, max %d "
+		       "on wire, %d blocks failed\n", stats.sent,
+		       stats.retries, stats.max_on_wire, errors);
+
+	free(sws);
+	ibnd_destroy_fabric(fabric);
+	return errors ? "some forwarding table blocks could not be read" : 0;
+}
+
 static int process_opt(void *context, int ch, char *optarg)
 {
 	switch (ch) {
@@ -376,6 +609,15 @@ static int process_opt(void *context, int ch, char *optarg)
 	case 'n':
 		brief++;
 		break;
+	case 1:
+		fabric_dump_file = strdup(optarg);
+		break;
+	case 2:
+		load_cache_file = strdup(optarg);
+		break;
+	case 3:
+		smp_window = strtoul(optarg, NULL, 0);
+		break;
 	default:
 		return -1;
 	}
@@ -395,6 +637,13 @@ int main(int argc, char **argv)
 		{"no_dests", 'n', 0, NULL,
 		 "do not try to resolve destinations"},
 		{"Multicast", 'M', 0, NULL, "show multicast forwarding tables"},
+		{"fabric-dump", 1, 1, "<file>",
+		 "dump the forwarding tables of all switches to <file> "
+		 "(- for stdout)"},
+		{"load-cache", 2, 1, "<file>",
+		 "filename of ibnetdiscover cache to load (with --fabric-dump)"},
+		{"window", 3, 1, "<smps>",
+		 "number of outstanding SMPs with --fabric-dump (default 64)"},
 		{0}
 	};
 	char usage_args[] = "[<dest dr_path|lid|guid> [<startlid> [<endlid>]]]";
@@ -411,6 +660,9 @@ int main(int argc, char **argv)
 		"-M 4\t# dump all non empty mlids of switch with lid 4",
 		"-M 4 0xc010 0xc020\t# same, but with range",
 		"-M -n 4\t# simple dump format",
+		" -- Fabric wide examples:",
+		"--fabric-dump lft.txt\t# dump the LFTs of all switches",
+		"-M --fabric-dump mft.txt\t# dump the MFTs of all switches",
 		NULL,
 	};
 
@@ -420,7 +672,7 @@ int main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
-	if (!argc)
+	if (!argc && !fabric_dump_file)
 		ibdiag_show_usage();
 
 	if (argc > 1)
@@ -432,6 +684,14 @@ int main(int argc, char **argv)
 	if (!srcport)
 		IBERROR("Failed to open '%s' port '%d'", ibd_ca, ibd_ca_port);
 
+	if (fabric_dump_file) {
+		err = dump_fabric_tables(fabric_dump_file);
+		if (err)
+			IBERROR("dump tables: %s", err);
+		mad_rpc_close_port(srcport);
+		exit(0);
+	}
+
 	if (!argc) {
 		if (ib_resolve_self_via(&portid, 0, 0, srcport) < 0)
 			IBERROR("can't resolve self addr");
@@ -98,8 +98,9 @@ struct perf_count_ext perf_count_ext = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 /* Notes: IB semantics is to cap counters if count has exceeded limits.
  * Therefore we must check for overflows and cap the counters if necessary.
  *
- * mad_decode_field and mad_encode_field assume 32 bit integers passed in
- * for fields < 32 bits in length.
+ * mad_encode_field assumes 32 bit integers passed in for fields < 32 bits
+ * in length.  The aggregation decodes each reply in a single pass with
+ * mad_decode_port_counters[_ext]().
  */
 
 static void aggregate_4bit(uint32_t * dest, uint32_t val)
@@ -146,46 +147,28 @@ static void aggregate_64bit(uint64_t * dest, uint64_t val)
 
 static void aggregate_perfcounters(void)
 {
-	uint32_t val;
-
-	mad_decode_field(pc, IB_PC_PORT_SELECT_F, &val);
-	perf_count.portselect = val;
-	mad_decode_field(pc, IB_PC_COUNTER_SELECT_F, &val);
-	perf_count.counterselect = val;
-	mad_decode_field(pc, IB_PC_ERR_SYM_F, &val);
-	aggregate_16bit(&perf_count.symbolerrors, val);
-	mad_decode_field(pc, IB_PC_LINK_RECOVERS_F, &val);
-	aggregate_8bit(&perf_count.linkrecovers, val);
-	mad_decode_field(pc, IB_PC_LINK_DOWNED_F, &val);
-	aggregate_8bit(&perf_count.linkdowned, val);
-	mad_decode_field(pc, IB_PC_ERR_RCV_F, &val);
-	aggregate_16bit(&perf_count.rcverrors, val);
-	mad_decode_field(pc, IB_PC_ERR_PHYSRCV_F, &val);
-	aggregate_16bit(&perf_count.rcvremotephyerrors, val);
-	mad_decode_field(pc, IB_PC_ERR_SWITCH_REL_F, &val);
-	aggregate_16bit(&perf_count.rcvswrelayerrors, val);
-	mad_decode_field(pc, IB_PC_XMT_DISCARDS_F, &val);
-	aggregate_16bit(&perf_count.xmtdiscards, val);
-	mad_decode_field(pc, IB_PC_ERR_XMTCONSTR_F, &val);
-	aggregate_8bit(&perf_count.xmtconstrainterrors, val);
-	mad_decode_field(pc, IB_PC_ERR_RCVCONSTR_F, &val);
-	aggregate_8bit(&perf_count.rcvconstrainterrors, val);
-	mad_decode_field(pc, IB_PC_ERR_LOCALINTEG_F, &val);
-	aggregate_4bit(&perf_count.linkintegrityerrors, val);
-	mad_decode_field(pc, IB_PC_ERR_EXCESS_OVR_F, &val);
-	aggregate_4bit(&perf_count.excbufoverrunerrors, val);
-	mad_decode_field(pc, IB_PC_VL15_DROPPED_F, &val);
-	aggregate_16bit(&perf_count.vl15dropped, val);
-	mad_decode_field(pc, IB_PC_XMT_BYTES_F, &val);
-	aggregate_32bit(&perf_count.xmtdata, val);
-	mad_decode_field(pc, IB_PC_RCV_BYTES_F, &val);
-	aggregate_32bit(&perf_count.rcvdata, val);
-	mad_decode_field(pc, IB_PC_XMT_PKTS_F, &val);
-	aggregate_32bit(&perf_count.xmtpkts, val);
-	mad_decode_field(pc, IB_PC_RCV_PKTS_F, &val);
-	aggregate_32bit(&perf_count.rcvpkts, val);
-	mad_decode_field(pc, IB_PC_XMT_WAIT_F, &val);
-	aggregate_32bit(&perf_count.xmtwait, val);
+	ibmad_port_counters_t c;
+
+	mad_decode_port_counters(pc, &c);
+	perf_count.portselect = c.port_select;
+	perf_count.counterselect = c.counter_select;
+	aggregate_16bit(&perf_count.symbolerrors, c.err_sym);
+	aggregate_8bit(&perf_count.linkrecovers, c.link_recovers);
+	aggregate_8bit(&perf_count.linkdowned, c.link_downed);
+	aggregate_16bit(&perf_count.rcverrors, c.err_rcv);
+	aggregate_16bit(&perf_count.rcvremotephyerrors, c.err_physrcv);
+	aggregate_16bit(&perf_count.rcvswrelayerrors, c.err_switch_rel);
+	aggregate_16bit(&perf_count.xmtdiscards, c.xmt_discards);
+	aggregate_8bit(&perf_count.xmtconstrainterrors, c.err_xmtconstr);
+	aggregate_8bit(&perf_count.rcvconstrainterrors, c.err_rcvconstr);
+	aggregate_4bit(&perf_count.linkintegrityerrors, c.err_localinteg);
+	aggregate_4bit(&perf_count.excbufoverrunerrors, c.err_excess_ovr);
+	aggregate_16bit(&perf_count.vl15dropped, c.vl15_dropped);
+	aggregate_32bit(&perf_count.xmtdata, c.xmt_bytes);
+	aggregate_32bit(&perf_count.rcvdata, c.rcv_bytes);
+	aggregate_32bit(&perf_count.xmtpkts, c.xmt_pkts);
+	aggregate_32bit(&perf_count.rcvpkts, c.rcv_pkts);
+	aggregate_32bit(&perf_count.xmtwait, c.xmt_wait);
 }
 
 static void output_aggregate_perfcounters(ib_portid_t * portid,
@@ -229,31 +212,25 @@ static void output_aggregate_perfcounters(ib_portid_t * portid,
 
 static void aggregate_perfcounters_ext(uint16_t cap_mask)
 {
-	uint32_t val;
-	uint64_t val64;
-
-	mad_decode_field(pc, IB_PC_EXT_PORT_SELECT_F, &val);
-	perf_count_ext.portselect = val;
-	mad_decode_field(pc, IB_PC_EXT_COUNTER_SELECT_F, &val);
-	perf_count_ext.counterselect = val;
-	mad_decode_field(pc, IB_PC_EXT_XMT_BYTES_F, &val64);
-	aggregate_64bit(&perf_count_ext.portxmitdata, val64);
-	mad_decode_field(pc, IB_PC_EXT_RCV_BYTES_F, &val64);
-	aggregate_64bit(&perf_count_ext.portrcvdata, val64);
-	mad_decode_field(pc, IB_PC_EXT_XMT_PKTS_F, &val64);
-	aggregate_64bit(&perf_count_ext.portxmitpkts, val64);
-	mad_decode_field(pc, IB_PC_EXT_RCV_PKTS_F, &val64);
-	aggregate_64bit(&perf_count_ext.portrcvpkts, val64);
+	ibmad_port_counters_ext_t c;
+
+	mad_decode_port_counters_ext(pc, &c);
+	perf_count_ext.portselect = c.port_select;
+	perf_count_ext.counterselect = c.counter_select;
+	aggregate_64bit(&perf_count_ext.portxmitdata, c.xmt_bytes);
+	aggregate_64bit(&perf_count_ext.portrcvdata, c.rcv_bytes);
+	aggregate_64bit(&perf_count_ext.portxmitpkts, c.xmt_pkts);
+	aggregate_64bit(&perf_count_ext.portrcvpkts, c.rcv_pkts);
 
 	if (cap_mask & IB_PM_EXT_WIDTH_SUPPORTED) {
-		mad_decode_field(pc, IB_PC_EXT_XMT_UPKTS_F, &val64);
-		aggregate_64bit(&perf_count_ext.portunicastxmitpkts, val64);
-		mad_decode_field(pc, IB_PC_EXT_RCV_UPKTS_F, &val64);
-		aggregate_64bit(&perf_count_ext.portunicastrcvpkts, val64);
-		mad_decode_field(pc, IB_PC_EXT_XMT_MPKTS_F, &val64);
-		aggregate_64bit(&perf_count_ext.portmulticastxmitpkits, val64);
-		mad_decode_field(pc, IB_PC_EXT_RCV_MPKTS_F, &val64);
-		aggregate_64bit(&perf_count_ext.portmulticastrcvpkts, val64);
+		aggregate_64bit(&perf_count_ext.portunicastxmitpkts,
+				c.xmt_upkts);
+		aggregate_64bit(&perf_count_ext.portunicastrcvpkts,
+				c.rcv_upkts);
+		aggregate_64bit(&perf_count_ext.portmulticastxmitpkits,
+				c.xmt_mpkts);
+		aggregate_64bit(&perf_count_ext.portmulticastrcvpkts,
+				c.rcv_mpkts);
 	}
 }
 
@@ -355,6 +355,7 @@ adapter_construct(
 
 	p_adapter->state = IB_PNP_PORT_ADD;
 	p_adapter->port_rate = FOUR_X_IN_100BPS;
+	p_adapter->interrupt_moder = TRUE;
 }
 
 
@@ -561,6 +562,9 @@ __adapter_free(
 	cl_spinlock_destroy( &p_adapter->recv_stat_lock );
 	cl_spinlock_destroy( &p_adapter->send_stat_lock );
 
+	if( p_adapter->p_rss )
+		cl_free( p_adapter->p_rss );
+
 	cl_perf_destroy( &p_adapter->perf, TRUE );
 
 	cl_obj_deinit( p_obj );
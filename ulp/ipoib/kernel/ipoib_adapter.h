@@ -46,6 +46,7 @@
 #include "ip_stats.h"
 #include "ipoib_stat.h"
 #include "shutter.h"
+#include "ipoib_rss.h"
 #include "iba/ndk_ifc.h"
 
 
@@ -106,6 +107,8 @@ typedef struct _ipoib_params
 	boolean_t	cm_enabled;
 	uint32_t	cm_payload_mtu;
 	uint32_t	cm_xfer_block_size;
+	uint32_t	cm_idle_timeout;
+	uint32_t	cm_max_conns;
 	boolean_t LsoV1IPv4;              // Registry value for large send offload Version 1
 	boolean_t LsoV2IPv4;              // Registry value for large send offload Version 2 IPV4
 	boolean_t LsoV2IPv6;              // Registry value for large send offload Version2 IPV6
@@ -170,6 +173,14 @@ typedef struct _ipoib_params
 *
 *	lso
 *		(TRUE) Indicates support for hardware large/giant send offload
+*
+*	cm_idle_timeout
+*		Time, in seconds, after which an active RC connection that has not
+*		been used for sending is disconnected.  Zero keeps idle connections.
+*
+*	cm_max_conns
+*		Maximum number of active RC connections.  When exceeded, the least
+*		recently used connections are disconnected.  Zero means no limit.
 *		
 *********/
 
@@ -248,6 +259,10 @@ typedef struct _ipoib_adapter
 	//
 	shutter_t               recv_shutter;
 
+	ipoib_rss_t * volatile	p_rss;
+
+	boolean_t				interrupt_moder;
+
 #if defined(NDIS630_MINIPORT)
 	NDK_HANDLE 				h_ndk;
 #endif
@@ -354,6 +369,17 @@ typedef struct _ipoib_adapter
 *	p_ifc
 *		Pointer to transport interface.
 *
+*	p_rss
+*		Receive side scaling state set through OID_GEN_RECEIVE_SCALE_PARAMETERS,
+*		or NULL when RSS is disabled.  The state is never modified once
+*		published.  The receive path reads it without a lock at
+*		DISPATCH_LEVEL; a new state is swapped in with an interlocked
+*		exchange and the old one is freed once no processor can be using it.
+*
+*	interrupt_moder
+*		TRUE if the receive CQ interrupt moderation may adapt to the receive
+*		rate.  Set through OID_GEN_INTERRUPT_MODERATION.
+*
 *********/
 
 static inline void ipoib_cnt_inc( PULONG p_cnt)
@@ -122,6 +122,11 @@ static void
 __passive_conn_dreq_cb(
 	 IN	ib_cm_dreq_rec_t*			p_dreq_rec );
 
+/* callback on DREP (Disconnect Reply) arrival */
+static void
+__active_conn_drep_cb(
+	 IN	ib_cm_drep_rec_t*			p_drep_rec );
+
 static ib_api_status_t
 __conn_accept(
 	IN		ipoib_port_t* const		p_port,
@@ -1008,6 +1013,7 @@ __conn_reply_cb(
 
 	p_endpt->tx_mtu = p_port->p_adapter->params.cm_payload_mtu + sizeof(ipoib_hdr_t); 
 	endpt_cm_set_state(p_endpt, IPOIB_CM_CONNECTED);
+	endpt_cm_lru_insert( p_port, p_endpt );
 
 	IPOIB_PRINT( TRACE_LEVEL_INFORMATION, IPOIB_DBG_CM,
 		("Active RC CONNECTED to EP %s\n", p_endpt->tag) );
@@ -1285,6 +1291,27 @@ __passive_conn_dreq_cb(
 	IPOIB_EXIT( IPOIB_DBG_CM );
 }
 
+static void
+__active_conn_drep_cb(
+	 IN	ib_cm_drep_rec_t			*p_drep_rec )
+{
+	ipoib_endpt_t*		p_endpt;
+
+	IPOIB_ENTER( IPOIB_DBG_CM );
+
+	CL_ASSERT( p_drep_rec );
+
+	p_endpt	= (ipoib_endpt_t *)p_drep_rec->qp_context;
+	if( p_endpt )
+	{
+		DIPOIB_PRINT( TRACE_LEVEL_INFORMATION, IPOIB_DBG_CM_DCONN,
+			("DREP for EP %s status %s\n",
+				p_endpt->tag, p_endpt->p_ifc->get_err_str(p_drep_rec->cm_status)) );
+	}
+
+	IPOIB_EXIT( IPOIB_DBG_CM );
+}
+
 /*
  * If send & recv QPs are present they are in the ERROR state.
  */
@@ -1523,6 +1550,10 @@ cm_release_resources(
 	ASSERT( p_port );
 	ASSERT( p_endpt );
 
+	/* Tx resources are going away, the connection is no longer on the LRU. */
+	if( which_res >= -1 && which_res <= 1 )
+		endpt_cm_lru_remove( p_port, p_endpt );
+
 	if( which_res >= 0 )
 	{
 		cm_start_conn_teardown( p_port, p_endpt, which_res);
@@ -2835,6 +2866,266 @@ endpt_cm_disconnect(
 }
 
 
+/*
+ * Active connection LRU.
+ *
+ * Every endpoint with a connected active RC connection is on the port's
+ * conn_lru, ordered by the last time it was used for sending (to within a
+ * second).  The CM endpoint thread closes connections from the head of the
+ * list once they have been idle for params.cm_idle_timeout seconds, or while
+ * there are more than params.cm_max_conns of them.  A reaped endpoint stays
+ * valid for UD traffic and reconnects on its next send.
+ */
+void
+endpt_cm_lru_insert(
+	IN		ipoib_port_t* const			p_port,
+	IN		ipoib_endpt_t* const		p_endpt )
+{
+	boolean_t	over;
+
+	NdisAcquireSpinLock( &p_port->endpt_mgr.lru_lock );
+	p_endpt->cm_lru_time = cl_get_time_stamp_sec();
+	p_endpt->cm_reaped = FALSE;
+	if( !p_endpt->cm_on_lru )
+	{
+		InsertTailList( &p_port->endpt_mgr.conn_lru, &p_endpt->lru_item );
+		p_endpt->cm_on_lru = TRUE;
+		p_port->endpt_mgr.n_lru++;
+	}
+	over = (p_port->p_adapter->params.cm_max_conns &&
+		p_port->endpt_mgr.n_lru > p_port->p_adapter->params.cm_max_conns);
+	NdisReleaseSpinLock( &p_port->endpt_mgr.lru_lock );
+
+	/* Let the endpoint thread evict the least recently used connection. */
+	if( over )
+		cl_event_signal( &p_port->endpt_mgr.event );
+}
+
+
+void
+endpt_cm_lru_remove(
+	IN		ipoib_port_t* const			p_port,
+	IN		ipoib_endpt_t* const		p_endpt )
+{
+	NdisAcquireSpinLock( &p_port->endpt_mgr.lru_lock );
+	if( p_endpt->cm_on_lru )
+	{
+		RemoveEntryList( &p_endpt->lru_item );
+		p_endpt->cm_on_lru = FALSE;
+		p_port->endpt_mgr.n_lru--;
+	}
+	NdisReleaseSpinLock( &p_port->endpt_mgr.lru_lock );
+}
+
+
+void
+endpt_cm_touch(
+	IN		ipoib_port_t* const			p_port,
+	IN		ipoib_endpt_t* const		p_endpt )
+{
+	boolean_t	reconnect;
+
+	NdisAcquireSpinLock( &p_port->endpt_mgr.lru_lock );
+	p_endpt->cm_lru_time = cl_get_time_stamp_sec();
+	if( p_endpt->cm_on_lru )
+	{
+		RemoveEntryList( &p_endpt->lru_item );
+		InsertTailList( &p_port->endpt_mgr.conn_lru, &p_endpt->lru_item );
+	}
+	reconnect = p_endpt->cm_reaped;
+	p_endpt->cm_reaped = FALSE;
+	NdisReleaseSpinLock( &p_port->endpt_mgr.lru_lock );
+
+	if( !reconnect )
+		return;
+
+	/* Connection was reaped, the service ID from the ARP exchange is still valid. */
+	if( InterlockedCompareExchange( (volatile LONG *)&p_endpt->conn.state,
+			IPOIB_CM_QUEUED_TO_CONNECT, IPOIB_CM_DISCONNECTED ) == IPOIB_CM_DISCONNECTED )
+	{
+		IPOIB_PRINT( TRACE_LEVEL_INFORMATION, IPOIB_DBG_CM,
+			("Port[%d] EP %s reconnecting reaped RC connection\n",
+				p_port->port_num, p_endpt->tag) );
+		endpt_queue_cm_connection( p_port, p_endpt );
+		if( p_port->p_adapter->p_stat )
+			p_port->p_adapter->p_stat->cm.n_reconnects++;
+	}
+}
+
+
+/*
+ * Close an active RC connection; the endpoint remains UD valid.
+ * Called from the CM endpoint thread.
+ */
+static void
+__cm_reap_conn(
+	IN		ipoib_port_t* const			p_port,
+	IN		ipoib_endpt_t* const		p_endpt,
+	IN		boolean_t					evict )
+{
+	ib_api_status_t		ib_status;
+	ib_cm_dreq_t		cm_dreq;
+	cm_state_t			cm_state;
+
+	IPOIB_ENTER( IPOIB_DBG_CM_DCONN );
+
+	cm_state = (cm_state_t)InterlockedCompareExchange(
+					(volatile LONG *)&p_endpt->conn.state,
+					IPOIB_CM_DREQ_SENT, IPOIB_CM_CONNECTED );
+	if( cm_state != IPOIB_CM_CONNECTED )
+	{
+		IPOIB_EXIT( IPOIB_DBG_CM_DCONN );
+		return;
+	}
+
+	IPOIB_PRINT( TRACE_LEVEL_INFORMATION, IPOIB_DBG_CM_DCONN,
+		("Port[%d] EP %s %s RC connection, idle %u sec\n",
+			p_port->port_num, p_endpt->tag,
+			(evict ? "Evicting" : "Reaping idle"),
+			cl_get_time_stamp_sec() - p_endpt->cm_lru_time) );
+
+	/* Revert to UD before the send QP goes away. */
+	p_endpt->tx_mtu = p_port->p_adapter->params.payload_mtu;
+
+	if( p_endpt->conn.h_send_qp )
+	{
+		memset( &cm_dreq, 0, sizeof( ib_cm_dreq_t ) );
+		cm_dreq.h_qp = p_endpt->conn.h_send_qp;
+		cm_dreq.qp_type = IB_QPT_RELIABLE_CONN;
+		cm_dreq.pfn_cm_drep_cb = __active_conn_drep_cb;
+
+		ib_status = p_endpt->p_ifc->cm_dreq( &cm_dreq );
+		if( ib_status != IB_SUCCESS )
+		{
+			IPOIB_PRINT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
+				("SEND QP Disconnect EP %s status %s\n",
+					p_endpt->tag, p_endpt->p_ifc->get_err_str(ib_status)) );
+		}
+	}
+
+	cl_obj_lock( &p_port->obj );
+	endpt_unmap_conn_dgid( p_port, p_endpt );
+	cl_obj_unlock( &p_port->obj );
+
+	cm_release_resources( p_port, p_endpt, 1 );
+	endpt_cm_set_state( p_endpt, IPOIB_CM_DISCONNECTED );
+
+	NdisAcquireSpinLock( &p_port->endpt_mgr.lru_lock );
+	p_endpt->cm_reaped = TRUE;
+	NdisReleaseSpinLock( &p_port->endpt_mgr.lru_lock );
+
+	if( p_port->p_adapter->p_stat )
+	{
+		if( evict )
+			p_port->p_adapter->p_stat->cm.n_evicted++;
+		else
+			p_port->p_adapter->p_stat->cm.n_idle_reaped++;
+	}
+
+	IPOIB_EXIT( IPOIB_DBG_CM_DCONN );
+}
+
+
+void
+endpt_cm_reap_conns(
+	IN		ipoib_port_t* const			p_port )
+{
+	ipoib_endpt_t	*p_endpt;
+	uint32_t		idle_timeout = p_port->p_adapter->params.cm_idle_timeout;
+	uint32_t		max_conns = p_port->p_adapter->params.cm_max_conns;
+	uint32_t		now;
+	boolean_t		evict;
+
+	if( !idle_timeout && !max_conns )
+		return;
+
+	now = cl_get_time_stamp_sec();
+	for( ;; )
+	{
+		NdisAcquireSpinLock( &p_port->endpt_mgr.lru_lock );
+		if( IsListEmpty( &p_port->endpt_mgr.conn_lru ) )
+		{
+			NdisReleaseSpinLock( &p_port->endpt_mgr.lru_lock );
+			break;
+		}
+
+		/* The head is the least recently used connection. */
+		p_endpt = PARENT_STRUCT( p_port->endpt_mgr.conn_lru.Flink,
+								 ipoib_endpt_t, lru_item );
+		evict = (max_conns && p_port->endpt_mgr.n_lru > max_conns);
+		if( !evict &&
+			(!idle_timeout || (now - p_endpt->cm_lru_time) < idle_timeout) )
+		{
+			NdisReleaseSpinLock( &p_port->endpt_mgr.lru_lock );
+			break;
+		}
+
+		RemoveEntryList( &p_endpt->lru_item );
+		p_endpt->cm_on_lru = FALSE;
+		p_port->endpt_mgr.n_lru--;
+		ipoib_endpt_ref( p_endpt );
+		NdisReleaseSpinLock( &p_port->endpt_mgr.lru_lock );
+
+		__cm_reap_conn( p_port, p_endpt, evict );
+		ipoib_endpt_deref( p_endpt );
+	}
+
+	if( p_port->p_adapter->p_stat )
+		p_port->p_adapter->p_stat->cm.n_conns = p_port->endpt_mgr.n_lru;
+}
+
+
+/*
+ * Refill the SRQ after its limit event and re-arm the limit.
+ * Called from the CM endpoint thread.
+ */
+void
+ipoib_cm_srq_refill(
+	IN		ipoib_port_t* const			p_port )
+{
+	ib_api_status_t		ib_status;
+	ib_srq_attr_t		srq_attr;
+	int					wanted, shortage = 0;
+
+	IPOIB_ENTER( IPOIB_DBG_CM );
+
+	if( !p_port->ib_mgr.h_srq || !p_port->p_local_endpt )
+	{
+		IPOIB_EXIT( IPOIB_DBG_CM );
+		return;
+	}
+
+	wanted = p_port->p_adapter->params.rq_depth - p_port->cm_buf_mgr.posted;
+	if( wanted > 0 )
+	{
+		shortage = __cm_recv_mgr_repost_grow( p_port, p_port->p_local_endpt, wanted );
+		if( p_port->p_adapter->p_stat )
+			p_port->p_adapter->p_stat->cm.n_srq_refills += (wanted - shortage);
+	}
+	if( p_port->p_adapter->p_stat )
+		p_port->p_adapter->p_stat->cm.n_srq_limits++;
+
+	/* The limit event fires once per arming. */
+	memset( &srq_attr, 0, sizeof( ib_srq_attr_t ) );
+	srq_attr.srq_limit = p_port->p_adapter->params.rq_low_watermark;
+	ib_status = p_port->p_adapter->p_ifc->modify_srq( p_port->ib_mgr.h_srq,
+													  &srq_attr,
+													  IB_SRQ_LIMIT );
+	if( ib_status != IB_SUCCESS )
+	{
+		IPOIB_PRINT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
+			("SRQ limit re-arm failed %s\n",
+				p_port->p_adapter->p_ifc->get_err_str( ib_status )) );
+	}
+
+	IPOIB_PRINT( TRACE_LEVEL_INFORMATION, IPOIB_DBG_CM,
+		("Port[%d] SRQ refill wanted %d posted %d\n",
+			p_port->port_num, wanted, (wanted > 0 ? wanted - shortage : 0)) );
+
+	IPOIB_EXIT( IPOIB_DBG_CM );
+}
+
+
 #if IPOIB_CM
 
 static void
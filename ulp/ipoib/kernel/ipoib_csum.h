@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2008 Mellanox Technologies.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _IPOIB_CSUM_H_
+#define _IPOIB_CSUM_H_
+
+
+/*
+ * Internet (one's complement) checksum.
+ *
+ * Sums are accumulated on native 16-bit words, which assumes a little-endian
+ * processor, and folded to 16 bits when the checksum is stored.  On x64,
+ * buffers are summed 64 bytes at a time with SSE2, which the kernel can use
+ * without saving any state.  User-mode builds targeting AVX2 sum with
+ * 256-bit loads.  The driver doesn't: the kernel only preserves the upper
+ * halves of the YMM registers inside KeSaveExtendedProcessorState regions,
+ * and saving that state for every packet would cost about as much as the
+ * wider loads gain on MTU-sized buffers.
+ *
+ * This header only depends on complib and ip_packet.h so that it can be
+ * built into user-mode test and benchmark programs as well as the driver.
+ */
+#include <complib/cl_types.h>
+#include <complib/cl_byteswap.h>
+#include <ip_packet.h>
+
+#if defined( __AVX2__ ) && !defined( CL_KERNEL )
+#include <immintrin.h>
+#define IPOIB_CSUM_AVX2				1
+#elif defined( _M_AMD64 ) || defined( __SSE2__ )
+#include <emmintrin.h>
+#define IPOIB_CSUM_SSE2				1
+#endif
+
+/* Bytes summed per vector loop iteration. */
+#define IPOIB_CSUM_BLOCK			64
+
+/*
+ * Blocks summed before the 32-bit vector lanes are folded.  Each lane takes
+ * four 16-bit words per block, and the two accumulators are added before
+ * folding, so 8 * 0xFFFF * IPOIB_CSUM_MAX_BLOCKS must stay below 2^32.
+ */
+#define IPOIB_CSUM_MAX_BLOCKS		4096
+
+/* Words read from buffers of any type. */
+#ifdef __GNUC__
+typedef uint32_t __attribute__((__may_alias__))	ipoib_csum_u32_t;
+typedef uint16_t __attribute__((__may_alias__))	ipoib_csum_u16_t;
+#else
+typedef uint32_t								ipoib_csum_u32_t;
+typedef uint16_t								ipoib_csum_u16_t;
+#endif
+
+
+#if defined( IPOIB_CSUM_AVX2 )
+/* Returns the sum of n_blocks IPOIB_CSUM_BLOCK byte blocks. */
+static inline uint64_t
+__ipoib_csum_blocks(
+	IN		const	uint8_t*					p,
+	IN				uint32_t					n_blocks )
+{
+	const __m256i	zero = _mm256_setzero_si256();
+	__m256i			acc0, acc1, v;
+	__m128i			acc;
+	uint32_t		lanes[4];
+	uint32_t		n, i;
+	uint64_t		sum = 0;
+
+	while( n_blocks )
+	{
+		n = n_blocks < IPOIB_CSUM_MAX_BLOCKS ? n_blocks : IPOIB_CSUM_MAX_BLOCKS;
+		n_blocks -= n;
+
+		acc0 = acc1 = zero;
+		for( i = 0; i < n; i++, p += IPOIB_CSUM_BLOCK )
+		{
+			v = _mm256_loadu_si256( (const __m256i*)p );
+			acc0 = _mm256_add_epi32( acc0, _mm256_unpacklo_epi16( v, zero ) );
+			acc1 = _mm256_add_epi32( acc1, _mm256_unpackhi_epi16( v, zero ) );
+			v = _mm256_loadu_si256( (const __m256i*)(p + 32) );
+			acc0 = _mm256_add_epi32( acc0, _mm256_unpacklo_epi16( v, zero ) );
+			acc1 = _mm256_add_epi32( acc1, _mm256_unpackhi_epi16( v, zero ) );
+		}
+
+		acc0 = _mm256_add_epi32( acc0, acc1 );
+		acc = _mm_add_epi32( _mm256_castsi256_si128( acc0 ),
+			_mm256_extracti128_si256( acc0, 1 ) );
+		_mm_storeu_si128( (__m128i*)lanes, acc );
+		sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	return sum;
+}
+#elif defined( IPOIB_CSUM_SSE2 )
+/* Returns the sum of n_blocks IPOIB_CSUM_BLOCK byte blocks. */
+static inline uint64_t
+__ipoib_csum_blocks(
+	IN		const	uint8_t*					p,
+	IN				uint32_t					n_blocks )
+{
+	const __m128i	zero = _mm_setzero_si128();
+	__m128i			acc0, acc1, v;
+	uint32_t		lanes[4];
+	uint32_t		n, i, j;
+	uint64_t		sum = 0;
+
+	while( n_blocks )
+	{
+		n = n_blocks < IPOIB_CSUM_MAX_BLOCKS ? n_blocks : IPOIB_CSUM_MAX_BLOCKS;
+		n_blocks -= n;
+
+		acc0 = acc1 = zero;
+		for( i = 0; i < n; i++ )
+		{
+			for( j = 0; j < IPOIB_CSUM_BLOCK / 16; j++, p += 16 )
+			{
+				v = _mm_loadu_si128( (const __m128i*)p );
+				acc0 = _mm_add_epi32( acc0, _mm_unpacklo_epi16( v, zero ) );
+				acc1 = _mm_add_epi32( acc1, _mm_unpackhi_epi16( v, zero ) );
+			}
+		}
+
+		_mm_storeu_si128( (__m128i*)lanes, _mm_add_epi32( acc0, acc1 ) );
+		sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	return sum;
+}
+#endif
+
+
+/****f* IPoIB Driver/ipoib_csum_add
+* NAME
+*	ipoib_csum_add
+*
+* DESCRIPTION
+*	Adds a buffer to a 32-bit one's complement accumulator.  The buffer is
+*	taken to start on an even offset of the checksummed data.
+*
+* SYNOPSIS
+*/
+static inline uint32_t
+ipoib_csum_add(
+	IN				uint32_t					sum,
+	IN		const	void*						p_data,
+	IN				uint32_t					len )
+{
+	const uint8_t	*p = (const uint8_t*)p_data;
+	uint64_t		acc = sum;
+
+#if defined( IPOIB_CSUM_AVX2 ) || defined( IPOIB_CSUM_SSE2 )
+	if( len >= IPOIB_CSUM_BLOCK )
+	{
+		acc += __ipoib_csum_blocks( p, len / IPOIB_CSUM_BLOCK );
+		p += len & ~(IPOIB_CSUM_BLOCK - 1);
+		len &= IPOIB_CSUM_BLOCK - 1;
+	}
+#endif
+
+	while( len >= sizeof(uint32_t) )
+	{
+		acc += *(const ipoib_csum_u32_t*)p;
+		p += sizeof(uint32_t);
+		len -= sizeof(uint32_t);
+	}
+	if( len >= sizeof(uint16_t) )
+	{
+		acc += *(const ipoib_csum_u16_t*)p;
+		p += sizeof(uint16_t);
+		len -= sizeof(uint16_t);
+	}
+	if( len )
+		acc += *p;
+
+	acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+	acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+	return (uint32_t)acc;
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_csum_acc
+* NAME
+*	ipoib_csum_acc
+*
+* DESCRIPTION
+*	Adds a 32-bit partial sum to an accumulator, with end around carry.
+*
+* SYNOPSIS
+*/
+static inline uint32_t
+ipoib_csum_acc(
+	IN				uint32_t					sum,
+	IN				uint32_t					val )
+{
+	sum += val;
+	return sum + (sum < val);
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_csum_fold
+* NAME
+*	ipoib_csum_fold
+*
+* DESCRIPTION
+*	Folds an accumulator into a 16-bit one's complement sum.  The checksum
+*	field value is the complement of the result; data including a valid
+*	checksum folds to 0xFFFF.
+*
+* SYNOPSIS
+*/
+static inline uint16_t
+ipoib_csum_fold(
+	IN				uint32_t					sum )
+{
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return (uint16_t)sum;
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_csum_add_at
+* NAME
+*	ipoib_csum_add_at
+*
+* DESCRIPTION
+*	Adds a buffer that starts at the given offset of the checksummed data.
+*	Sums of buffers at odd offsets are byte swapped before being added.
+*
+* SYNOPSIS
+*/
+static inline uint32_t
+ipoib_csum_add_at(
+	IN				uint32_t					sum,
+	IN		const	void*						p_data,
+	IN				uint32_t					len,
+	IN				uint32_t					offset )
+{
+	uint32_t	part;
+
+	if( !(offset & 1) )
+		return ipoib_csum_add( sum, p_data, len );
+
+	part = ipoib_csum_fold( ipoib_csum_add( 0, p_data, len ) );
+	part = ((part & 0xFF) << 8) | (part >> 8);
+	return ipoib_csum_acc( sum, part );
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_csum_tcp4_pseudo
+* NAME
+*	ipoib_csum_tcp4_pseudo
+*
+* DESCRIPTION
+*	Returns the partial sum of the TCP pseudo header of an IPv4 packet.
+*
+* SYNOPSIS
+*/
+static inline uint32_t
+ipoib_csum_tcp4_pseudo(
+	IN		const	ip_hdr_t* const				p_ip_hdr,
+	IN				uint32_t					tcp_len )
+{
+	uint32_t	sum;
+
+	/* The source and destination addresses are adjacent. */
+	sum = ipoib_csum_add( 0, &p_ip_hdr->src_ip, 2 * sizeof(net32_t) );
+	sum = ipoib_csum_acc( sum, cl_hton16( IP_PROT_TCP ) );
+	return ipoib_csum_acc( sum, cl_hton16( (uint16_t)tcp_len ) );
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_csum
+* NAME
+*	ipoib_csum
+*
+* DESCRIPTION
+*	Returns the checksum of a buffer, ready to be stored in a header whose
+*	checksum field is zero in the buffer.
+*
+* SYNOPSIS
+*/
+static inline net16_t
+ipoib_csum(
+	IN		const	void*						p_data,
+	IN				uint32_t					len )
+{
+	return (net16_t)~ipoib_csum_fold( ipoib_csum_add( 0, p_data, len ) );
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_csum_ip_hdr
+* NAME
+*	ipoib_csum_ip_hdr
+*
+* DESCRIPTION
+*	Recomputes the header checksum of an IPv4 header.
+*
+* SYNOPSIS
+*/
+static inline void
+ipoib_csum_ip_hdr(
+	IN	OUT			ip_hdr_t* const				p_ip_hdr )
+{
+	p_ip_hdr->chksum = 0;
+	p_ip_hdr->chksum = ipoib_csum( p_ip_hdr, IP_HEADER_LENGTH( p_ip_hdr ) );
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_csum_update16
+* NAME
+*	ipoib_csum_update16
+*
+* DESCRIPTION
+*	Updates a stored checksum for a 16-bit field of the covered data changing
+*	from old_val to new_val (RFC 1624).
+*
+* SYNOPSIS
+*/
+static inline net16_t
+ipoib_csum_update16(
+	IN				net16_t						csum,
+	IN				net16_t						old_val,
+	IN				net16_t						new_val )
+{
+	uint32_t	sum;
+
+	sum = (uint16_t)~csum + (uint16_t)~old_val + (uint32_t)new_val;
+	return (net16_t)~ipoib_csum_fold( sum );
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_csum_update32
+* NAME
+*	ipoib_csum_update32
+*
+* DESCRIPTION
+*	Updates a stored checksum for a 32-bit field of the covered data changing
+*	from old_val to new_val.  The field must start on an even offset.
+*
+* SYNOPSIS
+*/
+static inline net16_t
+ipoib_csum_update32(
+	IN				net16_t						csum,
+	IN				net32_t						old_val,
+	IN				net32_t						new_val )
+{
+	uint32_t	sum;
+
+	sum = (uint16_t)~csum;
+	sum += (uint16_t)~old_val + (uint16_t)~(old_val >> 16);
+	sum += (uint16_t)new_val + (uint16_t)(new_val >> 16);
+	return (net16_t)~ipoib_csum_fold( sum );
+}
+/*********/
+
+
+#endif	/* _IPOIB_CSUM_H_ */
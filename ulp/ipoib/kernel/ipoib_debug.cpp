@@ -296,6 +296,9 @@ char *get_ib_recv_mode_str(ib_recv_mode_t m)
 	  case RECV_RC:
 		s = "RECV_RC";
 		break;
+	  case RECV_FRAG:
+		s = "RECV_FRAG";
+		break;
 	  default:
 		s = "Unknown ib_recv_mode_t value?";
 		break;
@@ -321,6 +321,7 @@ enum ref_cnt_buckets
 	ref_repost,		/* only in __recv_mgr_repost */
 	ref_recv_cb,	/* only in __recv_cb */
 	ref_send_cb,	/* only in __send_cb */
+	ref_recv_moder,	/* only while the moderation work item is queued */
 #if IPOIB_CM
 	ref_cm_recv_cb,	/* only in __recv_cm_cb */
 	ref_cm_send_cb,	/* only in __send_cm_cb */
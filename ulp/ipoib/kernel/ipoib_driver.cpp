@@ -233,6 +233,8 @@ IPOIB_REG_ENTRY HCARegTable[] = {
 	{NDIS_STRING_CONST("BCJoinRetry"),		1, IPOIB_OFFSET(bc_join_retry),			IPOIB_SIZE(bc_join_retry),		50, 		0,	  1000},
 	{NDIS_STRING_CONST("CmEnabled"),		0, IPOIB_OFFSET(cm_enabled),			IPOIB_SIZE(cm_enabled), 		FALSE,	   FALSE, TRUE},
 	{NDIS_STRING_CONST("CmPayloadMtu"), 	1, IPOIB_OFFSET(cm_payload_mtu),		IPOIB_SIZE(cm_payload_mtu), 	MAX_CM_PAYLOAD_MTU, 512, MAX_CM_PAYLOAD_MTU},
+	{NDIS_STRING_CONST("CmIdleTimeout"),	0, IPOIB_OFFSET(cm_idle_timeout),		IPOIB_SIZE(cm_idle_timeout),	300,		0,	  3600},
+	{NDIS_STRING_CONST("CmMaxConns"),		0, IPOIB_OFFSET(cm_max_conns),			IPOIB_SIZE(cm_max_conns),		0,			0,	  65535},
 	{NDIS_STRING_CONST("*LsoV1IPv4"),		0, IPOIB_OFFSET(LsoV1IPv4), 			IPOIB_SIZE(LsoV1IPv4),			1,			0,	  1},
 	{NDIS_STRING_CONST("*LsoV2IPv4"),		0, IPOIB_OFFSET(LsoV2IPv4), 			IPOIB_SIZE(LsoV2IPv4),			1,			0,	  1},
 	{NDIS_STRING_CONST("*LsoV2IPv6"),		0, IPOIB_OFFSET(LsoV2IPv6), 			IPOIB_SIZE(LsoV2IPv6),			1,			0,	  1},
@@ -1099,6 +1101,44 @@ SetAdapterRegistrationAttributes(
 }
 
 
+/*++
+Routine Description:
+	Fills the receive side scaling capabilities.  Receives are polled from
+	the single UD receive CQ and classified in software at DPC level, then
+	indicated on the processor selected by the indirection table.
+
+Arguments:
+	p_caps - capabilities structure to fill
+
+Return Value:
+	None.
+
+--*/
+static
+void
+FillReceiveScaleCapabilities(
+	PNDIS_RECEIVE_SCALE_CAPABILITIES p_caps )
+{
+	memset(p_caps, 0, sizeof(NDIS_RECEIVE_SCALE_CAPABILITIES));
+
+	p_caps->Header.Type = NDIS_OBJECT_TYPE_RSS_CAPABILITIES;
+#if defined(NDIS630_MINIPORT)
+	p_caps->Header.Revision = NDIS_RECEIVE_SCALE_CAPABILITIES_REVISION_2;
+	p_caps->Header.Size = NDIS_SIZEOF_RECEIVE_SCALE_CAPABILITIES_REVISION_2;
+	p_caps->NumberOfIndirectionTableEntries = IPOIB_RSS_MAX_TABLE_SIZE;
+#else
+	p_caps->Header.Revision = NDIS_RECEIVE_SCALE_CAPABILITIES_REVISION_1;
+	p_caps->Header.Size = NDIS_SIZEOF_RECEIVE_SCALE_CAPABILITIES_REVISION_1;
+#endif
+
+	p_caps->CapabilitiesFlags = NDIS_RSS_CAPS_CLASSIFICATION_AT_DPC |
+								NDIS_RSS_CAPS_HASH_TYPE_TCP_IPV4 |
+								NDIS_RSS_CAPS_HASH_TYPE_TCP_IPV6;
+	p_caps->NumberOfInterruptMessages = 1;
+	p_caps->NumberOfReceiveQueues = ipoib_rss_queue_count();
+}
+
+
 /*++
 Routine Description:
 	the routine sets generic attributes that are associated with a miniport 
@@ -1218,24 +1258,9 @@ SetGenericAttributes(
 	//
 	// Set RSS attributes
 	//
-	gat.RecvScaleCapabilities = NULL;
-#if 0
 	NDIS_RECEIVE_SCALE_CAPABILITIES RssCapabilities;
-	memset(&RssCapabilities, 0, sizeof(PNDIS_RECEIVE_SCALE_CAPABILITIES));
-	Status = MPFillRssCapabilities(pPort, &RssCapabilities, &unUsed);
-	if (NT_SUCCESS(Status)) 
-	{
-		gat.RecvScaleCapabilities = &RssCapabilities;
-	} 
-	else
-	{
-		//
-		// do not fail the call because of failure to get PM caps
-		//
-		Status = NDIS_STATUS_SUCCESS;
-		gat.RecvScaleCapabilities = NULL;
-	}
-#endif
+	FillReceiveScaleCapabilities(&RssCapabilities);
+	gat.RecvScaleCapabilities = &RssCapabilities;
 
 	Status = NdisMSetMiniportAttributes(h_adapter,
 			(PNDIS_MINIPORT_ADAPTER_ATTRIBUTES)&gat);
@@ -1838,8 +1863,11 @@ Exit:
 
 Routine Description:
 	The routine handles setting of OID_GEN_INTERRUPT_MODERATION.
+	Disabling moderation takes effect at the next receive rate sample,
+	no reset is needed.
 
 Arguments:
+	p_adapter - Pointer to the adapter
 	InformationBuffer - Pointer to the buffer that contains the data
 	InformationBufferLength - data length
 	
@@ -1850,6 +1878,7 @@ Return Value:
 static 
 NDIS_STATUS
 SetInterruptModeration(
+	ipoib_adapter_t *p_adapter,
 	PVOID InformationBuffer,
 	ULONG InformationBufferLength )
 {
@@ -1873,12 +1902,25 @@ SetInterruptModeration(
 		Status = NDIS_STATUS_INVALID_DATA;
 		goto Exit;
 	}
-	//
-	// BUGBUG: Need to handle disabling of interrupt moderation 
-	//							UH, 4-Jun-2008
-	//
-//	  ASSERT(pInteruptModerationParam->Flags == NDIS_INTERRUPT_MODERATION_CHANGE_NEEDS_RESET);
-//	  ASSERT(pInteruptModerationParam->InterruptModeration == NdisInterruptModerationEnabled);
+
+	switch( pInteruptModerationParam->InterruptModeration )
+	{
+	case NdisInterruptModerationEnabled:
+		p_adapter->interrupt_moder = TRUE;
+		break;
+
+	case NdisInterruptModerationDisabled:
+		p_adapter->interrupt_moder = FALSE;
+		break;
+
+	default:
+		Status = NDIS_STATUS_INVALID_DATA;
+		break;
+	}
+
+	IPOIB_PRINT( TRACE_LEVEL_INFORMATION, IPOIB_DBG_OID,
+		("Interrupt moderation %s\n",
+		p_adapter->interrupt_moder ? "enabled" : "disabled") );
 
 Exit:
 	IPOIB_EXIT(IPOIB_DBG_OID);
@@ -2834,10 +2876,10 @@ ipoib_query_info(
 							NDIS_INTERRUPT_MODERATION_PARAMETERS_REVISION_1;
 			InterruptModerationParam.Header.Size =
 						NDIS_SIZEOF_INTERRUPT_MODERATION_PARAMETERS_REVISION_1;
-			InterruptModerationParam.Flags =
-								NDIS_INTERRUPT_MODERATION_CHANGE_NEEDS_RESET;
+			InterruptModerationParam.Flags = 0;
 			InterruptModerationParam.InterruptModeration =
-										NdisInterruptModerationNotSupported;
+				p_adapter->interrupt_moder ? NdisInterruptModerationEnabled :
+											 NdisInterruptModerationDisabled;
 			buf_len = sizeof(NDIS_INTERRUPT_MODERATION_PARAMETERS);
 			src_buf = (PVOID) &InterruptModerationParam;  
 			break;
@@ -3141,6 +3183,216 @@ SetOffloadEncapsulation(
 }
 
 
+/*++
+Routine Description:
+	Returns once every active processor has run this thread at
+	PASSIVE_LEVEL.  The receive path reads the RSS state at DISPATCH_LEVEL,
+	so after this no processor can still be using a state that was
+	unpublished before the call.
+
+Arguments:
+	None
+
+Return Value:
+	None
+
+--*/
+static
+void
+__rss_wait_for_readers( void )
+{
+	ULONG						i, n_cpus;
+#if defined(NDIS630_MINIPORT)
+	GROUP_AFFINITY				affinity, old_affinity;
+	PROCESSOR_NUMBER			proc_num;
+#endif
+
+	ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+	n_cpus = ipoib_cpu_count();
+#if defined(NDIS630_MINIPORT)
+	for (i = 0; i < n_cpus; i++)
+	{
+		KeGetProcessorNumberFromIndex(i, &proc_num);
+		RtlZeroMemory(&affinity, sizeof(affinity));
+		affinity.Group = proc_num.Group;
+		affinity.Mask = AFFINITY_MASK(proc_num.Number);
+		KeSetSystemGroupAffinityThread(&affinity, i ? NULL : &old_affinity);
+	}
+	KeRevertToUserGroupAffinityThread(&old_affinity);
+#else
+	for (i = 0; i < n_cpus; i++)
+		KeSetSystemAffinityThread(AFFINITY_MASK(i));
+	KeRevertToUserAffinityThread();
+#endif
+}
+
+
+/*++
+Routine Description:
+	Handles OID_GEN_RECEIVE_SCALE_PARAMETERS.  A new RSS state is built from
+	the current one and the parameters that changed, then published with an
+	interlocked exchange so that the receive path can read it without a
+	lock and never sees a partially updated key or indirection table.
+
+	The first set after RSS was disabled has no current state to keep, so
+	the hash types, key and indirection table are taken from the parameters
+	even when flagged unchanged, and a table spreading hashes across all
+	RSS queues is used if none is supplied.
+
+Arguments:
+	p_adapter - the adapter
+	pBuf - NDIS_RECEIVE_SCALE_PARAMETERS buffer
+	len - size of the buffer
+
+Return Value:
+	NDIS_STATUS
+
+--*/
+static
+NDIS_STATUS
+SetReceiveScaleParameters(
+	ipoib_adapter_t *p_adapter,
+	void* const pBuf,
+	ULONG len )
+{
+	PNDIS_RECEIVE_SCALE_PARAMETERS	p_params;
+	ipoib_rss_t						*p_rss, *p_old;
+	uint32_t						table[IPOIB_RSS_MAX_TABLE_SIZE];
+	uint32_t						n_entries, n_queues, i;
+	BOOLEAN							first;
+	NDIS_STATUS						status = NDIS_STATUS_SUCCESS;
+
+	IPOIB_ENTER(IPOIB_DBG_OID);
+
+	if (len < NDIS_SIZEOF_RECEIVE_SCALE_PARAMETERS_REVISION_1)
+	{
+		status = NDIS_STATUS_INVALID_LENGTH;
+		goto Exit;
+	}
+
+	p_params = (PNDIS_RECEIVE_SCALE_PARAMETERS) pBuf;
+	if (p_params->Header.Type != NDIS_OBJECT_TYPE_RSS_PARAMETERS)
+	{
+		status = NDIS_STATUS_INVALID_DATA;
+		goto Exit;
+	}
+
+	p_rss = NULL;
+	if (!(p_params->Flags & NDIS_RSS_PARAM_FLAG_DISABLE_RSS))
+	{
+		p_rss = (ipoib_rss_t*) cl_zalloc(sizeof(ipoib_rss_t));
+		if (!p_rss)
+		{
+			status = NDIS_STATUS_RESOURCES;
+			goto Exit;
+		}
+
+		/*
+		 * OID sets are serialized and the published state is never
+		 * modified in place, so it can be copied as is.
+		 */
+		first = !p_adapter->p_rss;
+		if (!first)
+			memcpy(p_rss, p_adapter->p_rss, sizeof(ipoib_rss_t));
+
+		if (!(p_params->Flags & NDIS_RSS_PARAM_FLAG_HASH_INFO_UNCHANGED) ||
+			(first && p_params->HashInformation))
+		{
+			if (NDIS_RSS_HASH_TYPE_FROM_HASH_INFO(p_params->HashInformation) &&
+				NDIS_RSS_HASH_FUNC_FROM_HASH_INFO(p_params->HashInformation) !=
+				NdisHashFunctionToeplitz)
+			{
+				status = NDIS_STATUS_INVALID_PARAMETER;
+				goto Error;
+			}
+			p_rss->hash_types = IPOIB_RSS_HASH_ALL &
+				NDIS_RSS_HASH_TYPE_FROM_HASH_INFO(p_params->HashInformation);
+		}
+
+		if (!(p_params->Flags & NDIS_RSS_PARAM_FLAG_HASH_KEY_UNCHANGED) ||
+			(first && p_params->HashSecretKeySize))
+		{
+			if (p_params->HashSecretKeySize > IPOIB_RSS_KEY_SIZE ||
+				(ULONG)p_params->HashSecretKeyOffset +
+				p_params->HashSecretKeySize > len)
+			{
+				status = NDIS_STATUS_INVALID_PARAMETER;
+				goto Error;
+			}
+			ipoib_rss_set_key(p_rss,
+				(uint8_t*)p_params + p_params->HashSecretKeyOffset,
+				p_params->HashSecretKeySize);
+		}
+
+		if (!(p_params->Flags & NDIS_RSS_PARAM_FLAG_ITABLE_UNCHANGED) ||
+			(first && p_params->IndirectionTableSize))
+		{
+			if ((ULONG)p_params->IndirectionTableOffset +
+				p_params->IndirectionTableSize > len)
+			{
+				status = NDIS_STATUS_INVALID_PARAMETER;
+				goto Error;
+			}
+#if defined(NDIS630_MINIPORT)
+			PROCESSOR_NUMBER *p_tbl = (PROCESSOR_NUMBER*)
+				((uint8_t*)p_params + p_params->IndirectionTableOffset);
+
+			n_entries = p_params->IndirectionTableSize / sizeof(PROCESSOR_NUMBER);
+			for (i = 0; i < n_entries && i < IPOIB_RSS_MAX_TABLE_SIZE; i++)
+				table[i] = KeGetProcessorIndexFromNumber(&p_tbl[i]);
+#else
+			UCHAR *p_tbl = (UCHAR*)
+				((uint8_t*)p_params + p_params->IndirectionTableOffset);
+
+			n_entries = p_params->IndirectionTableSize;
+			for (i = 0; i < n_entries && i < IPOIB_RSS_MAX_TABLE_SIZE; i++)
+				table[i] = p_tbl[i] + p_params->BaseCpuNumber;
+#endif
+			if (!ipoib_rss_set_table(p_rss, table, n_entries))
+			{
+				status = NDIS_STATUS_INVALID_PARAMETER;
+				goto Error;
+			}
+		}
+		else if (first)
+		{
+			/* Without a table every hash would map to processor 0. */
+			n_queues = ipoib_rss_queue_count();
+			for (i = 0; i < IPOIB_RSS_MAX_TABLE_SIZE; i++)
+				table[i] = i % n_queues;
+			ipoib_rss_set_table(p_rss, table, IPOIB_RSS_MAX_TABLE_SIZE);
+		}
+
+		if (!p_rss->hash_types)
+		{
+			cl_free(p_rss);
+			p_rss = NULL;
+		}
+	}
+
+	IPOIB_PRINT(TRACE_LEVEL_INFORMATION, IPOIB_DBG_OID,
+		("RSS %s, hash types %#x\n", p_rss ? "enabled" : "disabled",
+		p_rss ? p_rss->hash_types : 0));
+
+	p_old = (ipoib_rss_t*)InterlockedExchangePointer(
+		(PVOID volatile*)&p_adapter->p_rss, p_rss);
+
+	if (p_old)
+	{
+		__rss_wait_for_readers();
+		cl_free(p_old);
+	}
+	goto Exit;
+
+Error:
+	cl_free(p_rss);
+Exit:
+	IPOIB_EXIT(IPOIB_DBG_OID);
+	return status;
+}
+
+
 //! Issues a hardware reset to the NIC and/or resets the driver's software state.
 /*	Tear down the connection and start over again.	This is only called when there is a problem.
 For example, if a send, query info, or set info had a time out.  MiniportCheckForHang will
@@ -3399,13 +3651,21 @@ ipoib_set_info(
 		break;
 
 	case OID_GEN_INTERRUPT_MODERATION:
-		status = SetInterruptModeration(info_buf, info_buf_len);
+		status = SetInterruptModeration(p_adapter, info_buf, info_buf_len);
 		break;
 
 	case OID_OFFLOAD_ENCAPSULATION:
 		 status = SetOffloadEncapsulation(info_buf, info_buf_len);
 		 break;
 
+	case OID_GEN_RECEIVE_SCALE_PARAMETERS:
+		IPOIB_PRINT( TRACE_LEVEL_INFORMATION,IPOIB_DBG_OID,
+			("Port %d received set for OID_GEN_RECEIVE_SCALE_PARAMETERS\n",
+				port_num) );
+		buf_len = info_buf_len;
+		status = SetReceiveScaleParameters(p_adapter, info_buf, info_buf_len);
+		break;
+
 #if defined(NDIS630_MINIPORT)
 		case OID_NDK_SET_STATE:
 		{
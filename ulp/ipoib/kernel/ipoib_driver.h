@@ -83,12 +83,38 @@
 #define MAX_RECV_WC		16
 #define MAX_CM_RECV_WC	16
 
+/*
+ * Receive polling budget: completions handled in the CQ callback before the
+ * rest is deferred to a work item, and per work item run.
+ */
+#define IPOIB_RECV_DPC_BUDGET		128
+#define IPOIB_RECV_WORK_BUDGET		512
+
+/* Receive buffers reposted at once while the RQ is above its low water mark. */
+#define IPOIB_RECV_REPOST_BATCH		16
+
+/*
+ * Receive CQ interrupt moderation: rate sampling period in microseconds,
+ * and the receive rates (packets per second) that select the low and high
+ * moderation levels.  A level is left when the rate drops below half its
+ * threshold.
+ */
+#define IPOIB_MODER_SAMPLE_USEC		100000
+#define IPOIB_MODER_LOW_RATE		20000
+#define IPOIB_MODER_HIGH_RATE		150000
+
 /* RC local data segs required to cover Max RC recv payload on a phys page basis */
 #define MAX_CM_RECV_SGE	(((64*1024) / PAGE_SIZE) + 1)
 
 #define SRQ_LOW_WATER 5
 #define SRQ_MIN_GROWTH (SRQ_LOW_WATER * 2)
 
+/*
+ * Interval, in microseconds, at which the CM endpoint thread wakes up to
+ * reap idle or surplus RC connections when it has nothing else to do.
+ */
+#define IPOIB_CM_REAP_INTERVAL_USEC	(10 * 1000000)
+
 typedef struct _ipoib_globals
 {
 	KSPIN_LOCK		lock;
@@ -247,6 +247,8 @@ __endpt_destroying(
 	{
 		cm_state_t	cstate = endpt_cm_get_state( p_endpt );
 
+		endpt_cm_lru_remove( p_port, p_endpt );
+
 		if( cstate != IPOIB_CM_DISCONNECTED && !p_endpt->cm_ep_destroy )
 		{
 			IPOIB_PRINT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
@@ -454,7 +456,10 @@ ipoib_endpt_cm_mgr_thread( IN void* p_context )
 
 	while( !p_port->endpt_mgr.thread_is_done )
 	{
-		cl_event_wait_on( &p_port->endpt_mgr.event, EVENT_NO_TIMEOUT, FALSE );
+		/* Wake up periodically to reap idle connections. */
+		cl_event_wait_on( &p_port->endpt_mgr.event,
+						  IPOIB_CM_REAP_INTERVAL_USEC,
+						  FALSE );
 	
 		while( ( p_item = NdisInterlockedRemoveHeadList( 
 								&p_port->endpt_mgr.pending_conns,
@@ -534,6 +539,14 @@ ipoib_endpt_cm_mgr_thread( IN void* p_context )
 			endpt_cm_set_state( p_endpt, IPOIB_CM_DISCONNECTED );
 			cl_obj_destroy( &p_endpt->obj );
 		}
+
+		if( p_port->endpt_mgr.thread_is_done )
+			break;
+
+		if( cl_atomic_xchg( &p_port->ib_mgr.srq_refill, 0 ) )
+			ipoib_cm_srq_refill( p_port );
+
+		endpt_cm_reap_conns( p_port );
 	}
 	p_port->endpt_mgr.thread_is_done++;
 
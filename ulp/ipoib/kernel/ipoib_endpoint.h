@@ -187,6 +187,8 @@ typedef struct _ipoib_endpt
 	cl_map_item_t			lid_item;
 	cl_fmap_item_t			conn_item;
 	LIST_ENTRY				list_item;
+	LIST_ENTRY				lru_item;
+	LIST_ENTRY				gc_item;
 	ib_query_handle_t		h_query;
 	ib_mcast_handle_t		h_mcast;
 	mac_addr_t				mac;
@@ -197,12 +199,17 @@ typedef struct _ipoib_endpt
 	ib_al_ifc_t				*p_ifc;
 	boolean_t    			is_in_use;
 	boolean_t				is_mcast_listener;
+	boolean_t				mcast_on_gc;
+	uint32_t				mcast_gc_expire;
 	endpt_recv_mgr_t		cm_recv;
 	endpt_conn_t			conn;
 	uint32_t				tx_mtu;
 	uint8_t					cm_flag;
 	uint8_t					cm_rx_flushing;
 	uint8_t					cm_ep_destroy;
+	uint8_t					cm_on_lru;
+	uint8_t					cm_reaped;
+	uint32_t				cm_lru_time;
 	char					tag[24]; // <(Broad/Multi)-cast or 0xLID> string
 
 }	ipoib_endpt_t;
@@ -229,6 +236,12 @@ typedef struct _ipoib_endpt
 *	list_item
 *		used when emdpoint is on the connection list.
 *
+*	lru_item
+*		used when the endpoint is on the port's connection LRU.
+*
+*	gc_item
+*		used when the endpoint is on the port's multicast GC list.
+*
 *	h_query
 *		Query handle for cancelling SA queries.
 *
@@ -260,6 +273,12 @@ typedef struct _ipoib_endpt
 *
 *	is_mcast_listener
 *
+*	mcast_on_gc
+*		Multicast endpoint is on the port's GC list.
+*
+*	mcast_gc_expire
+*		GC generation at which the endpoint is next checked for use.
+*
 *	cm_recv
 *		Manage NDIS NBLs (Network Buffer List) and completed recv work-requests.
 *
@@ -279,6 +298,16 @@ typedef struct _ipoib_endpt
 *	cm_ep_destroy
 *		SRQ async error routine should destroy the EP object.
 *
+*	cm_on_lru
+*		Endpoint is on the port's connection LRU.
+*
+*	cm_reaped
+*		The active RC connection was closed for being idle or least recently
+*		used; the next send queues a new connection.
+*
+*	cm_lru_time
+*		Time, in seconds, the endpoint was last moved on the connection LRU.
+*
 *	tag
 *		Endpoint tag string: asciz string 'lid 0xNNN'
 *
@@ -389,6 +418,24 @@ cm_destroy_recv_resources(
 	IN		ipoib_port_t* const			p_port,
 	IN		ipoib_endpt_t* const		p_endpt );
 
+void
+endpt_cm_lru_insert(
+	IN		ipoib_port_t* const			p_port,
+	IN		ipoib_endpt_t* const		p_endpt );
+
+void
+endpt_cm_lru_remove(
+	IN		ipoib_port_t* const			p_port,
+	IN		ipoib_endpt_t* const		p_endpt );
+
+void
+endpt_cm_reap_conns(
+	IN		ipoib_port_t* const			p_port );
+
+void
+ipoib_cm_srq_refill(
+	IN		ipoib_port_t* const			p_port );
+
 
 char *
 cm_get_state_str(
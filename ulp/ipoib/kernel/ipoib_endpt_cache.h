@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2008 Mellanox Technologies.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _IPOIB_ENDPT_CACHE_H_
+#define _IPOIB_ENDPT_CACHE_H_
+
+
+/*
+ * Per-processor endpoint lookup cache.
+ *
+ * Each processor has a small direct-mapped cache of MAC to endpoint lookups
+ * that the send path checks before searching mac_endpts under the port
+ * object lock.  The cache does not reference the endpoints.  Instead every
+ * entry records the generation it was filled under, and every path that
+ * takes endpoints out of mac_endpts first invalidates the caches by
+ * bumping the generation and then waits for the port's readers to drain.
+ * A reader that sees a current generation can therefore reference the
+ * cached endpoint, and a reader that started after the invalidation misses.
+ *
+ * Waiting for readers drops the port object lock, so an invalidation also
+ * blocks fills until the endpoints are out of the map.  Otherwise a send
+ * could cache an endpoint that is about to be removed under the new
+ * generation.
+ *
+ * This header only depends on complib so that it can be built into
+ * user-mode test and benchmark programs as well as the driver.
+ */
+#include <complib/cl_types.h>
+#include <complib/cl_atomic.h>
+#include <complib/cl_memory.h>
+
+
+/* Number of entries in each processor's endpoint cache.  Power of two. */
+#define IPOIB_ENDPT_CACHE_SIZE		128
+
+/* Maximum number of processors that get an endpoint cache. */
+#define IPOIB_ENDPT_CACHE_MAX_CPUS	64
+
+
+/****s* IPoIB Driver/ipoib_endpt_cache_entry_t
+* NAME
+*	ipoib_endpt_cache_entry_t
+*
+* DESCRIPTION
+*	Entry of the per-processor, direct-mapped cache that the send path
+*	checks before searching mac_endpts.  Entries are only written and read
+*	by their own processor at DISPATCH_LEVEL.
+*
+* SYNOPSIS
+*/
+typedef struct _ipoib_endpt_cache_entry
+{
+	uint64_t				key;
+	struct _ipoib_endpt		*p_endpt;
+	int32_t					gen;
+
+}	ipoib_endpt_cache_entry_t;
+/*
+* FIELDS
+*	key
+*		MAC address of the endpoint, as used to key mac_endpts.
+*
+*	p_endpt
+*		Cached endpoint.  The cache does not hold a reference.
+*
+*	gen
+*		Value of the cache generation when the entry was filled.
+*********/
+
+
+/****s* IPoIB Driver/ipoib_endpt_cache_t
+* NAME
+*	ipoib_endpt_cache_t
+*
+* DESCRIPTION
+*	Endpoint caches of all processors.
+*
+* SYNOPSIS
+*/
+typedef struct _ipoib_endpt_cache
+{
+	atomic32_t					gen;
+	uint32_t					block;
+	uint32_t					n_cpus;
+	ipoib_endpt_cache_entry_t	*p_entries;
+
+}	ipoib_endpt_cache_t;
+/*
+* FIELDS
+*	gen
+*		Generation of the caches.  Incremented whenever an endpoint leaves
+*		mac_endpts; entries filled under an older generation are ignored.
+*
+*	block
+*		Number of invalidations whose endpoints are not out of mac_endpts
+*		yet.  The caches are not filled while it is non-zero.
+*
+*	n_cpus
+*		Number of processors that have a cache.
+*
+*	p_entries
+*		n_cpus blocks of IPOIB_ENDPT_CACHE_SIZE entries, one block per
+*		processor index.  NULL if the caches could not be allocated.
+*
+* NOTES
+*	gen and block are only changed, and entries only filled, with the port
+*	object lock held.
+*********/
+
+
+/*
+ * Allocates caches for up to n_cpus processors.  Returns FALSE if they
+ * could not be allocated, in which case lookups always miss.
+ */
+static inline boolean_t
+ipoib_endpt_cache_init(
+		OUT			ipoib_endpt_cache_t* const	p_cache,
+	IN				uint32_t					n_cpus )
+{
+	n_cpus = min( n_cpus, IPOIB_ENDPT_CACHE_MAX_CPUS );
+
+	p_cache->gen = 0;
+	p_cache->block = 0;
+	p_cache->n_cpus = 0;
+	p_cache->p_entries = (ipoib_endpt_cache_entry_t*)cl_zalloc(
+		sizeof(ipoib_endpt_cache_entry_t) * IPOIB_ENDPT_CACHE_SIZE * n_cpus );
+	if( !p_cache->p_entries )
+		return FALSE;
+
+	p_cache->n_cpus = n_cpus;
+	return TRUE;
+}
+
+
+static inline void
+ipoib_endpt_cache_destroy(
+	IN	OUT			ipoib_endpt_cache_t* const	p_cache )
+{
+	if( p_cache->p_entries )
+		cl_free( p_cache->p_entries );
+	p_cache->p_entries = NULL;
+	p_cache->n_cpus = 0;
+}
+
+
+/*
+ * Returns the entry for key in processor cpu's cache, NULL if that
+ * processor has no cache.
+ */
+static inline ipoib_endpt_cache_entry_t*
+ipoib_endpt_cache_entry(
+	IN		const	ipoib_endpt_cache_t* const	p_cache,
+	IN				uint32_t					cpu,
+	IN				uint64_t					key )
+{
+	uint32_t		slot;
+
+	if( cpu >= p_cache->n_cpus )
+		return NULL;
+
+	/* Unicast MACs differ mostly in the low-order (QPN derived) bytes. */
+	slot = (uint32_t)(key ^ (key >> 24) ^ (key >> 40)) &
+		(IPOIB_ENDPT_CACHE_SIZE - 1);
+
+	return &p_cache->p_entries[cpu * IPOIB_ENDPT_CACHE_SIZE + slot];
+}
+
+
+/*
+ * Returns the cached endpoint for key, or NULL.  The caller must have
+ * registered as a reader of the map, with an interlocked operation that
+ * orders the generation read after it, and may only reference the endpoint
+ * before it deregisters.
+ */
+static inline struct _ipoib_endpt*
+ipoib_endpt_cache_lookup(
+	IN		const	ipoib_endpt_cache_t* const	p_cache,
+	IN		const	ipoib_endpt_cache_entry_t* const	p_entry,
+	IN				uint64_t					key )
+{
+	if( p_entry->key != key || p_entry->gen != p_cache->gen )
+		return NULL;
+
+	return p_entry->p_endpt;
+}
+
+
+/*
+ * Caches p_endpt for key on processor cpu unless an invalidation is in
+ * progress.  Called with the port object lock held, with the endpoint
+ * found in mac_endpts.
+ */
+static inline void
+ipoib_endpt_cache_fill(
+	IN	OUT			ipoib_endpt_cache_t* const	p_cache,
+	IN				uint32_t					cpu,
+	IN				uint64_t					key,
+	IN				struct _ipoib_endpt* const	p_endpt )
+{
+	ipoib_endpt_cache_entry_t	*p_entry;
+
+	if( p_cache->block )
+		return;
+
+	p_entry = ipoib_endpt_cache_entry( p_cache, cpu, key );
+	if( !p_entry )
+		return;
+
+	p_entry->key = key;
+	p_entry->p_endpt = p_endpt;
+	p_entry->gen = p_cache->gen;
+}
+
+
+/*
+ * Invalidates every processor's cache and blocks fills until the matching
+ * ipoib_endpt_cache_unblock.  Called with the port object lock held, before
+ * waiting for the readers to drain and removing endpoints from mac_endpts.
+ */
+static inline void
+ipoib_endpt_cache_invalidate(
+	IN	OUT			ipoib_endpt_cache_t* const	p_cache )
+{
+	p_cache->block++;
+	cl_atomic_inc( &p_cache->gen );
+}
+
+
+/*
+ * Allows fills again.  Called with the port object lock held, once the
+ * endpoints are out of mac_endpts.
+ */
+static inline void
+ipoib_endpt_cache_unblock(
+	IN	OUT			ipoib_endpt_cache_t* const	p_cache )
+{
+	CL_ASSERT( p_cache->block );
+	p_cache->block--;
+}
+
+
+#endif	/* _IPOIB_ENDPT_CACHE_H_ */
@@ -0,0 +1,628 @@
+/*
+ * Copyright (c) 2008 Mellanox Technologies.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _IPOIB_GSO_H_
+#define _IPOIB_GSO_H_
+
+
+/*
+ * Software TCP segmentation of large sends and coalescing of in-order TCP
+ * receives, for IPv4 over datagram mode.
+ *
+ * This header only depends on complib and ip_packet.h so that it can be
+ * built into user-mode test and benchmark programs as well as the driver.
+ */
+#include <complib/cl_types.h>
+#include <complib/cl_memory.h>
+#include <complib/cl_byteswap.h>
+#include <ip_packet.h>
+#include "ipoib_csum.h"
+
+
+/* TCP header flags. */
+#define IPOIB_TCP_FIN				0x01
+#define IPOIB_TCP_SYN				0x02
+#define IPOIB_TCP_RST				0x04
+#define IPOIB_TCP_PSH				0x08
+#define IPOIB_TCP_ACK				0x10
+#define IPOIB_TCP_URG				0x20
+#define IPOIB_TCP_ECE				0x40
+#define IPOIB_TCP_CWR				0x80
+
+/* Longest IP plus TCP header that is segmented: both with full options. */
+#define IPOIB_GSO_MAX_HDR			120
+
+/* Largest IP packet built by coalescing. */
+#define IPOIB_GRO_MAX_LEN			0xFFFF
+
+
+/****s* IPoIB Driver/ipoib_gso_t
+* NAME
+*	ipoib_gso_t
+*
+* DESCRIPTION
+*	Segmentation state of a large TCP send: a copy of its IP and TCP
+*	headers, used as the template for the headers of every segment, and
+*	the segment size and count.
+*
+* SYNOPSIS
+*/
+typedef struct _ipoib_gso
+{
+	uint8_t				hdr[IPOIB_GSO_MAX_HDR];
+	uint32_t			ip_hdr_len;
+	uint32_t			hdr_len;
+	uint32_t			mss;
+	uint32_t			payload_len;
+	uint32_t			n_segs;
+	uint32_t			seq;
+	uint16_t			ip_id;
+	uint8_t				tcp_flags;
+
+}	ipoib_gso_t;
+/*
+* FIELDS
+*	hdr
+*		IP and TCP headers of the send, options included.
+*
+*	ip_hdr_len
+*		Length of the IP header.
+*
+*	hdr_len
+*		Length of the IP and TCP headers.
+*
+*	mss
+*		TCP payload carried by every segment but the last.
+*
+*	payload_len
+*		TCP payload of the whole send.
+*
+*	n_segs
+*		Number of segments.
+*
+*	seq
+*		Sequence number of the first payload byte, in host order.
+*
+*	ip_id
+*		IP identification of the send, in host order.  Segments use
+*		consecutive values.
+*
+*	tcp_flags
+*		TCP flags of the send.
+*********/
+
+
+/****f* IPoIB Driver/ipoib_gso_init
+* NAME
+*	ipoib_gso_init
+*
+* DESCRIPTION
+*	Prepares the segmentation of an IPv4 TCP packet into IP packets of at
+*	most mtu bytes.  The IP and TCP headers must be contiguous in the
+*	hdr_avail bytes at p_ip.  Fragments, SYN, RST and urgent data are not
+*	segmented.
+*
+* SYNOPSIS
+*/
+static inline boolean_t
+ipoib_gso_init(
+		OUT			ipoib_gso_t* const			p_gso,
+	IN		const	uint8_t* const				p_ip,
+	IN				uint32_t					hdr_avail,
+	IN				uint32_t					mtu )
+{
+	const ip_hdr_t	*p_ip_hdr = (const ip_hdr_t*)p_ip;
+	const tcp_hdr_t	*p_tcp_hdr;
+	uint32_t		ip_len, ip_hdr_len, hdr_len;
+
+	if( hdr_avail < sizeof(ip_hdr_t) || (p_ip_hdr->ver_hl >> 4) != 4 ||
+		p_ip_hdr->prot != IP_PROT_TCP ||
+		IP_FRAGMENT_OFFSET( p_ip_hdr ) || IP_MORE_FRAGMENTS( p_ip_hdr ) )
+	{
+		return FALSE;
+	}
+
+	ip_hdr_len = IP_HEADER_LENGTH( p_ip_hdr );
+	if( ip_hdr_len < sizeof(ip_hdr_t) ||
+		hdr_avail < ip_hdr_len + sizeof(tcp_hdr_t) )
+	{
+		return FALSE;
+	}
+
+	p_tcp_hdr = (const tcp_hdr_t*)(p_ip + ip_hdr_len);
+	hdr_len = ip_hdr_len + TCP_HEADER_LENGTH( p_tcp_hdr );
+	ip_len = cl_ntoh16( p_ip_hdr->length );
+	if( TCP_HEADER_LENGTH( p_tcp_hdr ) < sizeof(tcp_hdr_t) ||
+		hdr_len > hdr_avail || hdr_len > IPOIB_GSO_MAX_HDR ||
+		ip_len <= hdr_len || mtu <= hdr_len )
+	{
+		return FALSE;
+	}
+
+	if( p_tcp_hdr->flags & (IPOIB_TCP_SYN | IPOIB_TCP_RST | IPOIB_TCP_URG) )
+		return FALSE;
+
+	/*
+	 * The stack leaves the IP checksum unset when it is offloaded; the
+	 * template gets a valid one that segments update incrementally.
+	 */
+	cl_memcpy( p_gso->hdr, p_ip, hdr_len );
+	ipoib_csum_ip_hdr( (ip_hdr_t*)p_gso->hdr );
+	p_gso->ip_hdr_len = ip_hdr_len;
+	p_gso->hdr_len = hdr_len;
+	p_gso->mss = mtu - hdr_len;
+	p_gso->payload_len = ip_len - hdr_len;
+	p_gso->n_segs = (p_gso->payload_len + p_gso->mss - 1) / p_gso->mss;
+	p_gso->seq = cl_ntoh32( p_tcp_hdr->seq_num );
+	p_gso->ip_id = cl_ntoh16( p_ip_hdr->id );
+	p_gso->tcp_flags = p_tcp_hdr->flags;
+	return TRUE;
+}
+/*
+* RETURN VALUES
+*	TRUE if the packet can be segmented, FALSE otherwise.
+*********/
+
+
+/****f* IPoIB Driver/ipoib_gso_seg_len
+* NAME
+*	ipoib_gso_seg_len
+*
+* DESCRIPTION
+*	Returns the TCP payload length of a segment.
+*
+* SYNOPSIS
+*/
+static inline uint32_t
+ipoib_gso_seg_len(
+	IN		const	ipoib_gso_t* const			p_gso,
+	IN				uint32_t					seg )
+{
+	if( seg + 1 < p_gso->n_segs )
+		return p_gso->mss;
+
+	return p_gso->payload_len - (p_gso->n_segs - 1) * p_gso->mss;
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_gso_build_hdr
+* NAME
+*	ipoib_gso_build_hdr
+*
+* DESCRIPTION
+*	Writes the hdr_len bytes of IP and TCP headers of a segment.  The IP
+*	length and identification and the TCP sequence number are set for the
+*	segment, and the IP checksum is updated incrementally.  FIN and PSH are only kept on the last segment and
+*	CWR only on the first.
+*
+*	The TCP checksum is computed from payload_sum, the ipoib_csum_add sum of
+*	the segment's payload.  If partial is set the payload sum is ignored
+*	and the checksum field is left holding the pseudo header sum, for the
+*	HCA to complete.
+*
+* SYNOPSIS
+*/
+static inline void
+ipoib_gso_build_hdr(
+	IN		const	ipoib_gso_t* const			p_gso,
+	IN				uint32_t					seg,
+	IN				uint32_t					payload_sum,
+	IN				boolean_t					partial,
+		OUT			uint8_t* const				p_hdr )
+{
+	ip_hdr_t	*p_ip_hdr = (ip_hdr_t*)p_hdr;
+	tcp_hdr_t	*p_tcp_hdr = (tcp_hdr_t*)(p_hdr + p_gso->ip_hdr_len);
+	uint32_t	seg_len, tcp_len, sum;
+	net16_t		ip_len, ip_id;
+	uint8_t		flags;
+
+	seg_len = ipoib_gso_seg_len( p_gso, seg );
+	tcp_len = p_gso->hdr_len - p_gso->ip_hdr_len + seg_len;
+
+	cl_memcpy( p_hdr, p_gso->hdr, p_gso->hdr_len );
+
+	ip_len = cl_hton16( (uint16_t)(p_gso->hdr_len + seg_len) );
+	ip_id = cl_hton16( (uint16_t)(p_gso->ip_id + seg) );
+	p_ip_hdr->chksum = ipoib_csum_update16( p_ip_hdr->chksum, p_ip_hdr->length, ip_len );
+	p_ip_hdr->chksum = ipoib_csum_update16( p_ip_hdr->chksum, p_ip_hdr->id, ip_id );
+	p_ip_hdr->length = ip_len;
+	p_ip_hdr->id = ip_id;
+
+	flags = p_gso->tcp_flags;
+	if( seg )
+		flags &= ~IPOIB_TCP_CWR;
+	if( seg + 1 < p_gso->n_segs )
+		flags &= ~(IPOIB_TCP_FIN | IPOIB_TCP_PSH);
+	p_tcp_hdr->flags = flags;
+	p_tcp_hdr->seq_num = cl_hton32( p_gso->seq + seg * p_gso->mss );
+
+	sum = ipoib_csum_tcp4_pseudo( p_ip_hdr, tcp_len );
+	if( partial )
+	{
+		p_tcp_hdr->chksum = ipoib_csum_fold( sum );
+		return;
+	}
+
+	p_tcp_hdr->chksum = 0;
+	sum = ipoib_csum_add( sum, p_tcp_hdr, p_gso->hdr_len - p_gso->ip_hdr_len );
+	sum = ipoib_csum_acc( sum, payload_sum );
+	p_tcp_hdr->chksum = (net16_t)~ipoib_csum_fold( sum );
+}
+/*********/
+
+
+/****s* IPoIB Driver/ipoib_gro_seg_t
+* NAME
+*	ipoib_gro_seg_t
+*
+* DESCRIPTION
+*	Parsed headers of a received TCP segment that is a coalescing candidate.
+*
+* SYNOPSIS
+*/
+typedef struct _ipoib_gro_seg
+{
+	uint32_t			hdr_len;
+	uint32_t			payload_len;
+	uint32_t			seq;
+
+}	ipoib_gro_seg_t;
+/*
+* FIELDS
+*	hdr_len
+*		Length of the IP and TCP headers.
+*
+*	payload_len
+*		TCP payload length.
+*
+*	seq
+*		Sequence number, in host order.
+*********/
+
+
+/****s* IPoIB Driver/ipoib_gro_t
+* NAME
+*	ipoib_gro_t
+*
+* DESCRIPTION
+*	A TCP packet being built by coalescing consecutive segments of a flow.
+*
+* SYNOPSIS
+*/
+typedef struct _ipoib_gro
+{
+	uint8_t				*p_ip;
+	uint32_t			hdr_len;
+	uint32_t			len;
+	uint32_t			max_len;
+	uint32_t			mss;
+	uint32_t			next_seq;
+	uint32_t			payload_sum;
+	uint32_t			n_segs;
+	uint8_t				flags;
+	boolean_t			closed;
+
+}	ipoib_gro_t;
+/*
+* FIELDS
+*	p_ip
+*		Buffer holding the packet, starting with the headers of its first
+*		segment.
+*
+*	hdr_len
+*		Length of the IP and TCP headers.
+*
+*	len
+*		Current IP packet length.
+*
+*	max_len
+*		Size of the buffer at p_ip.
+*
+*	mss
+*		Payload length of the first segment.  Longer segments are not
+*		merged and a shorter one is the last merged.
+*
+*	next_seq
+*		Sequence number expected of the next segment, in host order.
+*
+*	payload_sum
+*		ipoib_csum_add sum of the payload merged so far.
+*
+*	n_segs
+*		Number of segments merged.
+*
+*	flags
+*		TCP flags of the merged segments, to be set in the header.
+*
+*	closed
+*		Set once a segment ends the burst; no more are merged.
+*********/
+
+
+/****f* IPoIB Driver/ipoib_gro_parse
+* NAME
+*	ipoib_gro_parse
+*
+* DESCRIPTION
+*	Checks that the len bytes at p_ip hold an unfragmented IPv4 TCP segment
+*	without IP options, with payload and with no flags other than ACK and
+*	PSH, and parses its headers.
+*
+* SYNOPSIS
+*/
+static inline boolean_t
+ipoib_gro_parse(
+	IN		const	uint8_t* const				p_ip,
+	IN				uint32_t					len,
+		OUT			ipoib_gro_seg_t* const		p_seg )
+{
+	const ip_hdr_t	*p_ip_hdr = (const ip_hdr_t*)p_ip;
+	const tcp_hdr_t	*p_tcp_hdr;
+	uint32_t		ip_len, tcp_hdr_len;
+
+	if( len < sizeof(ip_hdr_t) + sizeof(tcp_hdr_t) ||
+		p_ip_hdr->ver_hl != 0x45 || p_ip_hdr->prot != IP_PROT_TCP ||
+		IP_FRAGMENT_OFFSET( p_ip_hdr ) || IP_MORE_FRAGMENTS( p_ip_hdr ) )
+	{
+		return FALSE;
+	}
+
+	p_tcp_hdr = (const tcp_hdr_t*)(p_ip + sizeof(ip_hdr_t));
+	tcp_hdr_len = TCP_HEADER_LENGTH( p_tcp_hdr );
+	ip_len = cl_ntoh16( p_ip_hdr->length );
+	if( tcp_hdr_len < sizeof(tcp_hdr_t) || ip_len > len ||
+		ip_len <= sizeof(ip_hdr_t) + tcp_hdr_len )
+	{
+		return FALSE;
+	}
+
+	if( (p_tcp_hdr->flags & ~IPOIB_TCP_PSH) != IPOIB_TCP_ACK )
+		return FALSE;
+
+	p_seg->hdr_len = sizeof(ip_hdr_t) + tcp_hdr_len;
+	p_seg->payload_len = ip_len - p_seg->hdr_len;
+	p_seg->seq = cl_ntoh32( p_tcp_hdr->seq_num );
+	return TRUE;
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_gro_verify
+* NAME
+*	ipoib_gro_verify
+*
+* DESCRIPTION
+*	Verifies the IP and TCP checksums of a parsed segment, given the sum of
+*	its payload.
+*
+* SYNOPSIS
+*/
+static inline boolean_t
+ipoib_gro_verify(
+	IN		const	uint8_t* const				p_ip,
+	IN		const	ipoib_gro_seg_t* const		p_seg,
+	IN				uint32_t					payload_sum )
+{
+	const ip_hdr_t	*p_ip_hdr = (const ip_hdr_t*)p_ip;
+	uint32_t		sum;
+
+	if( ipoib_csum_fold( ipoib_csum_add( 0, p_ip, sizeof(ip_hdr_t) ) ) != 0xFFFF )
+		return FALSE;
+
+	sum = ipoib_csum_tcp4_pseudo( p_ip_hdr,
+		p_seg->hdr_len - sizeof(ip_hdr_t) + p_seg->payload_len );
+	sum = ipoib_csum_add( sum, p_ip + sizeof(ip_hdr_t),
+		p_seg->hdr_len - sizeof(ip_hdr_t) );
+	sum = ipoib_csum_acc( sum, payload_sum );
+	return ipoib_csum_fold( sum ) == 0xFFFF;
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_gro_start
+* NAME
+*	ipoib_gro_start
+*
+* DESCRIPTION
+*	Starts a coalesced packet in the max_len bytes buffer at p_buf with a
+*	copy of a parsed segment.
+*
+* SYNOPSIS
+*/
+static inline boolean_t
+ipoib_gro_start(
+		OUT			ipoib_gro_t* const			p_gro,
+	IN				uint8_t* const				p_buf,
+	IN				uint32_t					max_len,
+	IN		const	uint8_t* const				p_ip,
+	IN		const	ipoib_gro_seg_t* const		p_seg )
+{
+	uint32_t	payload_sum;
+
+	if( max_len > IPOIB_GRO_MAX_LEN )
+		max_len = IPOIB_GRO_MAX_LEN;
+	if( p_seg->hdr_len + p_seg->payload_len > max_len )
+		return FALSE;
+
+	cl_memcpy( p_buf, p_ip, p_seg->hdr_len + p_seg->payload_len );
+	payload_sum = ipoib_csum_add( 0, p_buf + p_seg->hdr_len, p_seg->payload_len );
+	if( !ipoib_gro_verify( p_buf, p_seg, payload_sum ) )
+		return FALSE;
+
+	p_gro->p_ip = p_buf;
+	p_gro->hdr_len = p_seg->hdr_len;
+	p_gro->len = p_seg->hdr_len + p_seg->payload_len;
+	p_gro->max_len = max_len;
+	p_gro->mss = p_seg->payload_len;
+	p_gro->next_seq = p_seg->seq + p_seg->payload_len;
+	p_gro->payload_sum = payload_sum;
+	p_gro->n_segs = 1;
+	p_gro->flags = ((tcp_hdr_t*)(p_buf + sizeof(ip_hdr_t)))->flags;
+	p_gro->closed = (p_gro->flags & IPOIB_TCP_PSH) != 0;
+	return TRUE;
+}
+/*
+* RETURN VALUES
+*	FALSE if the segment does not fit or its checksums are wrong.
+*********/
+
+
+/****f* IPoIB Driver/ipoib_gro_match
+* NAME
+*	ipoib_gro_match
+*
+* DESCRIPTION
+*	Checks whether a parsed segment is the next in-order segment of the
+*	coalesced packet's flow and can be appended to it: same addresses,
+*	ports, IP service type and TTL, acknowledgement, window and TCP
+*	options, and no longer than the first segment.
+*
+* SYNOPSIS
+*/
+static inline boolean_t
+ipoib_gro_match(
+	IN		const	ipoib_gro_t* const			p_gro,
+	IN		const	uint8_t* const				p_ip,
+	IN		const	ipoib_gro_seg_t* const		p_seg )
+{
+	const ip_hdr_t	*p_ip_hdr = (const ip_hdr_t*)p_ip;
+	const ip_hdr_t	*p_gro_ip = (const ip_hdr_t*)p_gro->p_ip;
+	const tcp_hdr_t	*p_tcp_hdr = (const tcp_hdr_t*)(p_ip + sizeof(ip_hdr_t));
+	const tcp_hdr_t	*p_gro_tcp = (const tcp_hdr_t*)(p_gro->p_ip + sizeof(ip_hdr_t));
+
+	if( p_gro->closed || p_seg->hdr_len != p_gro->hdr_len ||
+		p_seg->seq != p_gro->next_seq || p_seg->payload_len > p_gro->mss ||
+		p_gro->len + p_seg->payload_len > p_gro->max_len )
+	{
+		return FALSE;
+	}
+
+	if( p_ip_hdr->src_ip != p_gro_ip->src_ip ||
+		p_ip_hdr->dst_ip != p_gro_ip->dst_ip ||
+		p_ip_hdr->svc_type != p_gro_ip->svc_type ||
+		p_ip_hdr->ttl != p_gro_ip->ttl ||
+		p_tcp_hdr->src_port != p_gro_tcp->src_port ||
+		p_tcp_hdr->dst_port != p_gro_tcp->dst_port ||
+		p_tcp_hdr->ack_num != p_gro_tcp->ack_num ||
+		p_tcp_hdr->window != p_gro_tcp->window )
+	{
+		return FALSE;
+	}
+
+	return cl_memcmp( p_tcp_hdr + 1, p_gro_tcp + 1,
+		p_seg->hdr_len - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t) ) == 0;
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_gro_append
+* NAME
+*	ipoib_gro_append
+*
+* DESCRIPTION
+*	Appends the payload of a matching segment to the coalesced packet.  The
+*	payload is copied first and checksummed from the copy; nothing is
+*	committed if the segment's checksums are wrong.
+*
+* SYNOPSIS
+*/
+static inline boolean_t
+ipoib_gro_append(
+	IN	OUT			ipoib_gro_t* const			p_gro,
+	IN		const	uint8_t* const				p_ip,
+	IN		const	ipoib_gro_seg_t* const		p_seg )
+{
+	uint8_t		*p_dst = p_gro->p_ip + p_gro->len;
+	uint32_t	payload_sum;
+	uint8_t		flags;
+
+	cl_memcpy( p_dst, p_ip + p_seg->hdr_len, p_seg->payload_len );
+	payload_sum = ipoib_csum_add( 0, p_dst, p_seg->payload_len );
+	if( !ipoib_gro_verify( p_ip, p_seg, payload_sum ) )
+		return FALSE;
+
+	if( (p_gro->len - p_gro->hdr_len) & 1 )
+	{
+		payload_sum = ipoib_csum_fold( payload_sum );
+		payload_sum = ((payload_sum & 0xFF) << 8) | (payload_sum >> 8);
+	}
+	p_gro->payload_sum = ipoib_csum_acc( p_gro->payload_sum, payload_sum );
+
+	flags = ((const tcp_hdr_t*)(p_ip + sizeof(ip_hdr_t)))->flags;
+	p_gro->len += p_seg->payload_len;
+	p_gro->next_seq += p_seg->payload_len;
+	p_gro->flags |= flags;
+	p_gro->n_segs++;
+	if( (flags & IPOIB_TCP_PSH) || p_seg->payload_len < p_gro->mss )
+		p_gro->closed = TRUE;
+	return TRUE;
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_gro_finish
+* NAME
+*	ipoib_gro_finish
+*
+* DESCRIPTION
+*	Completes the headers of a coalesced packet: IP length and checksum,
+*	TCP flags and checksum.
+*
+* SYNOPSIS
+*/
+static inline void
+ipoib_gro_finish(
+	IN	OUT			ipoib_gro_t* const			p_gro )
+{
+	ip_hdr_t	*p_ip_hdr = (ip_hdr_t*)p_gro->p_ip;
+	tcp_hdr_t	*p_tcp_hdr = (tcp_hdr_t*)(p_gro->p_ip + sizeof(ip_hdr_t));
+	uint32_t	sum;
+	net16_t		ip_len;
+
+	if( p_gro->n_segs == 1 )
+		return;
+
+	/* The first segment's IP checksum was verified; update it. */
+	ip_len = cl_hton16( (uint16_t)p_gro->len );
+	p_ip_hdr->chksum = ipoib_csum_update16( p_ip_hdr->chksum, p_ip_hdr->length, ip_len );
+	p_ip_hdr->length = ip_len;
+
+	p_tcp_hdr->flags = p_gro->flags;
+	p_tcp_hdr->chksum = 0;
+	sum = ipoib_csum_tcp4_pseudo( p_ip_hdr, p_gro->len - sizeof(ip_hdr_t) );
+	sum = ipoib_csum_add( sum, p_tcp_hdr, p_gro->hdr_len - sizeof(ip_hdr_t) );
+	sum = ipoib_csum_acc( sum, p_gro->payload_sum );
+	p_tcp_hdr->chksum = (net16_t)~ipoib_csum_fold( sum );
+}
+/*********/
+
+
+#endif	/* _IPOIB_GSO_H_ */
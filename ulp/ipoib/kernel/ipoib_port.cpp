@@ -219,6 +219,27 @@ static inline ipoib_recv_desc_t*
 __buf_mgr_get_recv(
 	IN				ipoib_port_t* const			p_port );
 
+static void
+__frag_pool_init(
+	IN				ipoib_port_t* const			p_port,
+	IN				ipoib_frag_pool_t* const	p_pool,
+	IN				uint32_t					n_frags,
+	IN				uint32_t					frag_size );
+
+static void
+__frag_pool_destroy(
+	IN				ipoib_frag_pool_t* const	p_pool );
+
+static inline NET_BUFFER_LIST*
+__buf_mgr_copy_recv(
+	IN				ipoib_port_t* const			p_port,
+	IN				ipoib_recv_desc_t* const	p_desc );
+
+static inline void
+__buf_mgr_put_recv_NBL(
+	IN				ipoib_port_t* const			p_port,
+	IN				NET_BUFFER_LIST* const		p_net_buffer_list );
+
 static inline void
 __buf_mgr_put_recv(
 	IN				ipoib_port_t* const			p_port,
@@ -259,6 +280,24 @@ static int32_t
 __recv_mgr_repost(
 	IN				ipoib_port_t* const			p_port );
 
+/* Posts receive buffers once a batch is missing from the receive queue. */
+static int32_t
+__recv_mgr_repost_batch(
+	IN				ipoib_port_t* const			p_port );
+
+static void
+__recv_mgr_moder_sample(
+	IN				ipoib_port_t* const			p_port,
+	IN				uint32_t					recv_cnt );
+
+static void
+__recv_mgr_moder_reset(
+	IN				ipoib_port_t* const			p_port );
+
+static inline IPOIB_ST_RECV*
+__recv_stat(
+	IN				ipoib_port_t* const			p_port );
+
 static void
 __recv_cb(
 	IN		const	ib_cq_handle_t				h_cq,
@@ -324,6 +363,14 @@ __recv_mgr_build_NBL_array(
 		OUT			cl_qlist_t*					p_done_list,
 		OUT			int32_t* const				p_discarded );
 
+static NET_BUFFER_LIST*
+__recv_mgr_rss_distribute(
+	IN				ipoib_port_t* const			p_port,
+	IN				NET_BUFFER_LIST*			p_head,
+	IN	OUT			int32_t* const				p_NBL_cnt );
+
+static KDEFERRED_ROUTINE __recv_rss_dpc;
+
 /******************************************************************************
 *
 * Send manager operations.
@@ -433,8 +480,6 @@ __build_lso_desc(
 	IN PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO p_lso_info,
 	IN				NET_BUFFER					*p_netbuf);
 
-static unsigned short ipchksum(unsigned short *ip, int len);
-
 static inline void
 ipoib_print_ip_hdr( 
 	IN				ip_hdr_t*	const 			p_ip_hdr )
@@ -523,6 +568,12 @@ __build_ipv4_fragments(
 	IN		uint32_t					ip_packet_len,
 	IN		MDL*						p_mdl );
 
+static NDIS_STATUS
+__build_tcp_segments(
+	IN		ipoib_send_NB_SG*			s_buf,
+	IN		ip_hdr_t* const				p_ip_hdr,
+	IN		uint32_t					buf_len );
+
 static void
 __update_fragment_ip_hdr(
 	IN		ip_hdr_t* const		p_ip_hdr,
@@ -625,6 +676,17 @@ __endpt_mgr_add_bcast(
 	IN				ipoib_port_t* const			p_port,
 	IN				ib_mcast_rec_t				*p_mcast_rec );
 
+static void
+__endpt_mgr_gc_insert(
+	IN				ipoib_port_t* const			p_port,
+	IN				ipoib_endpt_t* const		p_endpt,
+	IN				boolean_t					expired );
+
+static void
+__endpt_mgr_gc_remove(
+	IN				ipoib_port_t* const			p_port,
+	IN				ipoib_endpt_t* const		p_endpt );
+
 /******************************************************************************
 *
 * MCast operations.
@@ -828,6 +890,7 @@ __port_construct(
 
 	p_port->pPoWorkItem = NULL;
 	p_port->pPoWorkItemCM = NULL;
+	p_port->pPoWorkItemModer = NULL;
 
 	KeInitializeEvent( &p_port->sa_event, NotificationEvent, TRUE );
 	KeInitializeEvent( &p_port->leave_mcast_event, NotificationEvent, TRUE );
@@ -873,6 +936,13 @@ __port_init(
 		return IB_ERROR;
 	}
 #endif
+	p_port->pPoWorkItemModer = IoAllocateWorkItem(p_adapter->pdo);
+	if( p_port->pPoWorkItemModer == NULL )
+	{
+		IPOIB_PRINT_EXIT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
+			("IoAllocateWorkItem returned NULL for moderation\n") );
+		return IB_ERROR;
+	}
 	cl_status = cl_spinlock_init( &p_port->send_lock );
 	if( cl_status != CL_SUCCESS )
 	{
@@ -1082,6 +1152,8 @@ __port_free(
 	IoFreeWorkItem( p_port->pPoWorkItem );
 	if( p_port->pPoWorkItemCM )
 		IoFreeWorkItem( p_port->pPoWorkItemCM );
+	if( p_port->pPoWorkItemModer )
+		IoFreeWorkItem( p_port->pPoWorkItemModer );
 
 	cl_free( p_port );
 
@@ -1206,6 +1278,7 @@ __ib_mgr_init(
 			p_port->p_adapter->p_ifc->get_err_str( status )) );
 		return status;
 	}
+	__recv_mgr_moder_reset( p_port );
 
 	/* Allocate send CQ. */
 	cq_create.size = p_port->p_adapter->params.sq_depth;
@@ -1386,9 +1459,12 @@ __srq_async_event_cb(
 	switch( p_event_rec->code )
 	{
 	case IB_AE_SRQ_LIMIT_REACHED:
-				IPOIB_PRINT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
-			("SRQ ASYNC EVENT CODE %d: %s\n", 
-			p_event_rec->code, "IB_AE_SRQ_LIMIT_REACHED" ) );
+			IPOIB_PRINT( TRACE_LEVEL_INFORMATION, IPOIB_DBG_CM,
+				("SRQ ASYNC EVENT CODE %d: %s\n", 
+				p_event_rec->code, "IB_AE_SRQ_LIMIT_REACHED" ) );
+			/* The limit is disarmed; the endpoint thread refills and re-arms. */
+			if( !cl_atomic_xchg( &p_port->ib_mgr.srq_refill, 1 ) )
+				cl_event_signal( &p_port->endpt_mgr.event );
 			break;
 	case IB_AE_SRQ_CATAS_ERROR:
 			IPOIB_PRINT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
@@ -1428,7 +1504,7 @@ ipoib_port_srq_init(
 	srq_attr.max_sge = MAX_CM_RECV_SGE;
 
 	// if below threshold, then hardware fires async event
-	srq_attr.srq_limit = SRQ_LOW_WATER;
+	srq_attr.srq_limit = p_port->p_adapter->params.rq_low_watermark;
 	srq_attr.max_wr =
 		min( ((uint32_t)p_port->p_adapter->params.rq_depth * 8),
 				(p_port->p_ca_attrs->max_srq_wrs/2) );
@@ -1440,6 +1516,7 @@ ipoib_port_srq_init(
 			(p_port->p_ca_attrs->max_srq_wrs/2)) );
 
 	p_port->ib_mgr.srq_qp_cnt = 0; 
+	p_port->ib_mgr.srq_refill = 0;
 
 	ib_status = p_port->p_adapter->p_ifc->create_srq( p_port->ib_mgr.h_pd, 
 													  &srq_attr, 
@@ -1577,6 +1654,9 @@ __buf_mgr_construct(
 
 	p_port->buf_mgr.h_packet_pool = NULL;
 
+	cl_memclr( &p_port->buf_mgr.frag_pool, sizeof(ipoib_frag_pool_t) );
+	cl_memclr( &p_port->buf_mgr.gro_pool, sizeof(ipoib_frag_pool_t) );
+
 	NdisInitializeNPagedLookasideList( &p_port->buf_mgr.send_buf_list,
 		NULL, NULL, 0, MAX_LSO_PAYLOAD_MTU, 'bipi', 0 );
 
@@ -1723,6 +1803,16 @@ __buf_mgr_init(
 #endif
 	}
 
+	/*
+	 * Small receives are indicated from fragments, and TCP segments are
+	 * coalesced, when these are available.
+	 */
+	__frag_pool_init( p_port, &p_port->buf_mgr.frag_pool,
+		p_port->p_adapter->params.rq_depth, IPOIB_RECV_FRAG_SIZE );
+	__frag_pool_init( p_port, &p_port->buf_mgr.gro_pool,
+		p_port->p_adapter->params.rq_depth / IPOIB_RECV_GRO_RATIO,
+		IPOIB_RECV_GRO_SIZE );
+
 	IPOIB_EXIT( IPOIB_DBG_INIT );
 	return IB_SUCCESS;
 
@@ -1751,6 +1841,10 @@ __buf_mgr_destroy(
 
 	CL_ASSERT( p_port );
 
+	/* The fragment NBLs come from the receive packet pool; free them first. */
+	__frag_pool_destroy( &p_port->buf_mgr.frag_pool );
+	__frag_pool_destroy( &p_port->buf_mgr.gro_pool );
+
 	/* Destroy the send packet and buffer pools. 
 	if( p_port->buf_mgr.h_send_buf_pool )
 		NdisFreeBufferPool( p_port->buf_mgr.h_send_buf_pool );*/
@@ -2046,6 +2140,249 @@ __buf_mgr_put_recv_list(
 }
 
 
+/*
+ * Receive fragment pools.
+ *
+ * Receives of up to IPOIB_RECV_COPYBREAK bytes are copied into fragment
+ * buffers, several to a page, and indicated from there so that the full
+ * MTU descriptor goes straight back to the receive queue instead of being
+ * held until NDIS returns the NBL.  Consecutive TCP segments are coalesced
+ * into the larger buffers of a second pool the same way.  Free fragments
+ * are kept on lock-free per-processor lists; the pools are optional and
+ * receives are indicated from their descriptors if a pool could not be
+ * allocated or runs dry.
+ */
+static void
+__frag_pool_init(
+	IN				ipoib_port_t* const			p_port,
+	IN				ipoib_frag_pool_t* const	p_pool,
+	IN				uint32_t					n_frags,
+	IN				uint32_t					frag_size )
+{
+	ipoib_buf_mgr_t		*p_buf_mgr = &p_port->buf_mgr;
+	ipoib_recv_frag_t	*p_frag;
+	uint32_t			i, n_lists;
+
+	IPOIB_ENTER( IPOIB_DBG_INIT );
+
+	if( !n_frags )
+	{
+		IPOIB_EXIT( IPOIB_DBG_INIT );
+		return;
+	}
+
+	n_lists = ipoib_cpu_count();
+
+	/* Allocations of a page or more are page aligned. */
+	p_pool->p_mem = (uint8_t*)cl_zalloc( n_frags * frag_size );
+	p_pool->p_frags = (ipoib_recv_frag_t*)cl_zalloc(
+		n_frags * sizeof(ipoib_recv_frag_t) );
+	p_pool->p_lists = (SLIST_HEADER*)cl_zalloc( n_lists * sizeof(SLIST_HEADER) );
+	if( !p_pool->p_mem || !p_pool->p_frags || !p_pool->p_lists )
+	{
+		IPOIB_PRINT( TRACE_LEVEL_WARNING, IPOIB_DBG_INIT,
+			("Failed to allocate %u byte receive fragments.\n", frag_size) );
+		__frag_pool_destroy( p_pool );
+		IPOIB_EXIT( IPOIB_DBG_INIT );
+		return;
+	}
+
+	p_pool->frag_size = frag_size;
+	p_pool->n_lists = n_lists;
+	for( i = 0; i < n_lists; i++ )
+		InitializeSListHead( &p_pool->p_lists[i] );
+
+	for( i = 0; i < n_frags; i++ )
+	{
+		p_frag = &p_pool->p_frags[i];
+		p_frag->recv_mode = RECV_FRAG;
+		p_frag->type = PKT_TYPE_UCAST;
+		p_frag->p_pool = p_pool;
+		p_frag->p_buf = p_pool->p_mem + (i * frag_size);
+
+		p_frag->p_mdl = NdisAllocateMdl( p_port->p_adapter->h_adapter,
+										 p_frag->p_buf,
+										 frag_size );
+		if( !p_frag->p_mdl )
+			break;
+
+		p_frag->p_NBL = NdisAllocateNetBufferAndNetBufferList(
+							p_buf_mgr->h_packet_pool,
+							0,
+							0,
+							p_frag->p_mdl,
+							0,
+							0 );
+		if( !p_frag->p_NBL )
+		{
+			NdisFreeMdl( p_frag->p_mdl );
+			p_frag->p_mdl = NULL;
+			break;
+		}
+
+		NET_BUFFER_LIST_NEXT_NBL( p_frag->p_NBL ) = NULL;
+		IPOIB_PORT_FROM_NBL( p_frag->p_NBL ) = p_port;
+		IPOIB_RECV_FROM_NBL( p_frag->p_NBL ) = (ipoib_recv_desc_t*)p_frag;
+		p_frag->p_NBL->SourceHandle = p_port->p_adapter->h_adapter;
+
+		/* Count the fragment now so that destroy cleans it up on failure. */
+		p_pool->n_frags = i + 1;
+		InterlockedPushEntrySList( &p_pool->p_lists[i % n_lists],
+								   &p_frag->entry );
+	}
+
+	if( p_pool->n_frags != n_frags )
+	{
+		IPOIB_PRINT( TRACE_LEVEL_WARNING, IPOIB_DBG_INIT,
+			("Failed to allocate %u byte receive fragment NBLs.\n", frag_size) );
+		__frag_pool_destroy( p_pool );
+	}
+
+	IPOIB_EXIT( IPOIB_DBG_INIT );
+}
+
+
+static void
+__frag_pool_destroy(
+	IN				ipoib_frag_pool_t* const	p_pool )
+{
+	uint32_t			i;
+
+	for( i = 0; i < p_pool->n_frags; i++ )
+	{
+		NdisFreeNetBufferList( p_pool->p_frags[i].p_NBL );
+		NdisFreeMdl( p_pool->p_frags[i].p_mdl );
+	}
+	p_pool->n_frags = 0;
+	p_pool->n_lists = 0;
+
+	if( p_pool->p_lists )
+	{
+		cl_free( p_pool->p_lists );
+		p_pool->p_lists = NULL;
+	}
+	if( p_pool->p_frags )
+	{
+		cl_free( p_pool->p_frags );
+		p_pool->p_frags = NULL;
+	}
+	if( p_pool->p_mem )
+	{
+		cl_free( p_pool->p_mem );
+		p_pool->p_mem = NULL;
+	}
+}
+
+
+static inline ipoib_recv_frag_t*
+__frag_pool_get(
+	IN				ipoib_frag_pool_t* const	p_pool )
+{
+	SLIST_ENTRY			*p_entry;
+	uint32_t			i, cpu;
+
+	if( !p_pool->n_frags )
+		return NULL;
+
+	/* Take from this processor's list first, then from the others. */
+	cpu = ipoib_cpu_index() % p_pool->n_lists;
+	for( i = 0; i < p_pool->n_lists; i++ )
+	{
+		p_entry = InterlockedPopEntrySList(
+			&p_pool->p_lists[(cpu + i) % p_pool->n_lists] );
+		if( p_entry )
+			return PARENT_STRUCT( p_entry, ipoib_recv_frag_t, entry );
+	}
+	return NULL;
+}
+
+
+/* Returns a fragment to its pool without dropping a receive reference. */
+static inline void
+__frag_pool_free(
+	IN				ipoib_recv_frag_t* const	p_frag )
+{
+	ipoib_frag_pool_t	*p_pool = p_frag->p_pool;
+
+	CL_ASSERT( p_frag->recv_mode == RECV_FRAG );
+
+	NET_BUFFER_LIST_NEXT_NBL( p_frag->p_NBL ) = NULL;
+	InterlockedPushEntrySList(
+		&p_pool->p_lists[ipoib_cpu_index() % p_pool->n_lists],
+		&p_frag->entry );
+}
+
+
+static inline void
+__frag_pool_put(
+	IN				ipoib_port_t* const			p_port,
+	IN				ipoib_recv_frag_t* const	p_frag )
+{
+	__frag_pool_free( p_frag );
+
+	/* The receive is no longer outstanding. */
+	ipoib_port_deref( p_port, ref_get_recv );
+}
+
+
+/*
+ * Copies a short receive into a fragment and returns the fragment's NBL,
+ * or NULL if no fragment is free.  The caller returns the descriptor.
+ */
+static inline NET_BUFFER_LIST*
+__buf_mgr_copy_recv(
+	IN				ipoib_port_t* const			p_port,
+	IN				ipoib_recv_desc_t* const	p_desc )
+{
+	ipoib_recv_frag_t	*p_frag;
+	NET_BUFFER			*p_buf;
+	IPOIB_ST_RECV		*p_stat;
+
+	CL_ASSERT( p_desc->len <= IPOIB_RECV_FRAG_SIZE );
+
+	p_frag = __frag_pool_get( &p_port->buf_mgr.frag_pool );
+	if( !p_frag )
+		return NULL;
+
+#if IPOIB_INLINE_RECV
+	cl_memcpy( p_frag->p_buf, &p_desc->buf.eth.pkt, p_desc->len );
+#else
+	cl_memcpy( p_frag->p_buf, &p_desc->p_buf->eth.pkt, p_desc->len );
+#endif
+	p_frag->len = p_desc->len;
+	p_frag->type = p_desc->type;
+
+	p_buf = NET_BUFFER_LIST_FIRST_NB( p_frag->p_NBL );
+	NET_BUFFER_DATA_LENGTH( p_buf ) = p_desc->len;
+	NdisAdjustMdlLength( p_frag->p_mdl, p_desc->len );
+
+	/* Reference the port object for the outstanding receive. */
+	ipoib_port_ref( p_port, ref_get_recv );
+
+	p_stat = __recv_stat( p_port );
+	if( p_stat )
+		p_stat->n_copied++;
+
+	return p_frag->p_NBL;
+}
+
+
+/* Returns a UD receive NBL, from a descriptor or a fragment, to its pool. */
+static inline void
+__buf_mgr_put_recv_NBL(
+	IN				ipoib_port_t* const			p_port,
+	IN				NET_BUFFER_LIST* const		p_net_buffer_list )
+{
+	ipoib_recv_desc_t	*p_desc;
+
+	p_desc = IPOIB_RECV_FROM_NBL( p_net_buffer_list );
+	if( p_desc->recv_mode == RECV_FRAG )
+		__frag_pool_put( p_port, (ipoib_recv_frag_t*)p_desc );
+	else
+		__buf_mgr_put_recv( p_port, p_desc, p_net_buffer_list );
+}
+
+
 static inline NET_BUFFER_LIST*
 __buf_mgr_get_NBL(
 	IN				ipoib_port_t* const			p_port,
@@ -2122,6 +2459,11 @@ __recv_mgr_construct(
 {
 	cl_qlist_init( &p_port->recv_mgr.done_list );
 	p_port->recv_mgr.recv_NBL_array = NULL;
+	p_port->recv_mgr.n_rss_queues = 0;
+	p_port->recv_mgr.p_rss_queues = NULL;
+	cl_memclr( &p_port->recv_mgr.moder, sizeof(p_port->recv_mgr.moder) );
+	p_port->recv_mgr.moder.level = IPOIB_MODER_OFF;
+	p_port->recv_mgr.moder.target = IPOIB_MODER_OFF;
 }
 
 
@@ -2129,6 +2471,10 @@ static ib_api_status_t
 __recv_mgr_init(
 	IN				ipoib_port_t* const			p_port )
 {
+	ipoib_rss_queue_t	*p_queue;
+	uint32_t			i, n_queues;
+	cl_status_t			cl_status;
+
 	IPOIB_ENTER( IPOIB_DBG_INIT );
 
 	/* Allocate the NDIS_PACKET pointer array for indicating receives. */
@@ -2143,6 +2489,57 @@ __recv_mgr_init(
 		return IB_INSUFFICIENT_MEMORY;
 	}
 
+	/*
+	 * Allocate a queue per processor for RSS.  With a single processor
+	 * receives are always indicated in the CQ callback context.
+	 */
+	n_queues = ipoib_rss_queue_count();
+	if( n_queues < 2 )
+	{
+		IPOIB_EXIT( IPOIB_DBG_INIT );
+		return IB_SUCCESS;
+	}
+
+	p_port->recv_mgr.p_rss_queues = (ipoib_rss_queue_t*)cl_zalloc(
+		sizeof(ipoib_rss_queue_t) * n_queues );
+	if( !p_port->recv_mgr.p_rss_queues )
+	{
+		IPOIB_PRINT_EXIT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
+			("cl_zalloc for RSS queues failed.\n") );
+		return IB_INSUFFICIENT_MEMORY;
+	}
+
+	for( i = 0; i < n_queues; i++ )
+	{
+		p_queue = &p_port->recv_mgr.p_rss_queues[i];
+
+		cl_spinlock_construct( &p_queue->lock );
+		cl_status = cl_spinlock_init( &p_queue->lock );
+		if( cl_status != CL_SUCCESS )
+		{
+			IPOIB_PRINT_EXIT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
+				("cl_spinlock_init returned %#x\n", cl_status) );
+			return IB_ERROR;
+		}
+		/* Count the queue now so that destroy cleans it up on failure. */
+		p_port->recv_mgr.n_rss_queues = i + 1;
+
+		p_queue->p_head = NULL;
+		p_queue->pp_tail = &p_queue->p_head;
+		p_queue->NBL_cnt = 0;
+		p_queue->p_port = p_port;
+
+		KeInitializeDpc( &p_queue->dpc, __recv_rss_dpc, p_queue );
+#if defined(NDIS630_MINIPORT)
+		PROCESSOR_NUMBER	proc_num;
+
+		KeGetProcessorNumberFromIndex( i, &proc_num );
+		KeSetTargetProcessorDpcEx( &p_queue->dpc, &proc_num );
+#else
+		KeSetTargetProcessorDpc( &p_queue->dpc, (CCHAR)i );
+#endif
+	}
+
 	IPOIB_EXIT( IPOIB_DBG_INIT );
 	return IB_SUCCESS;
 }
@@ -2152,6 +2549,8 @@ static void
 __recv_mgr_destroy(
 	IN				ipoib_port_t* const			p_port )
 {
+	uint32_t		i;
+
 	IPOIB_ENTER( IPOIB_DBG_INIT );
 
 	CL_ASSERT( cl_is_qlist_empty( &p_port->recv_mgr.done_list ) );
@@ -2160,6 +2559,16 @@ __recv_mgr_destroy(
 	if( p_port->recv_mgr.recv_NBL_array )
 		cl_free( p_port->recv_mgr.recv_NBL_array );
 
+	if( p_port->recv_mgr.p_rss_queues )
+	{
+		for( i = 0; i < p_port->recv_mgr.n_rss_queues; i++ )
+		{
+			CL_ASSERT( !p_port->recv_mgr.p_rss_queues[i].p_head );
+			cl_spinlock_destroy( &p_port->recv_mgr.p_rss_queues[i].lock );
+		}
+		cl_free( p_port->recv_mgr.p_rss_queues );
+	}
+
 	IPOIB_EXIT( IPOIB_DBG_INIT );
 }
 
@@ -2269,6 +2678,237 @@ __recv_mgr_repost(
 	return p_port->p_adapter->params.rq_low_watermark - p_port->recv_mgr.depth;
 }
 
+
+/* Receive path statistics of the port's adapter, or NULL. */
+static inline IPOIB_ST_RECV*
+__recv_stat(
+	IN				ipoib_port_t* const			p_port )
+{
+	return p_port->p_adapter->p_stat ? &p_port->p_adapter->p_stat->recv : NULL;
+}
+
+
+/*
+ * Defers reposting until IPOIB_RECV_REPOST_BATCH buffers are missing from
+ * the RQ, or the RQ drops below its low water mark, so that buffers are
+ * handed to the HCA in chains rather than one post per returned NBL.
+ * Returns the same shortage value as __recv_mgr_repost.
+ * The recv_lock must be held by the caller.
+ */
+static int32_t
+__recv_mgr_repost_batch(
+	IN				ipoib_port_t* const			p_port )
+{
+	IPOIB_ST_RECV	*p_stat;
+
+	if( p_port->recv_mgr.depth >= p_port->p_adapter->params.rq_low_watermark &&
+		p_port->p_adapter->params.rq_depth - p_port->recv_mgr.depth <
+		IPOIB_RECV_REPOST_BATCH )
+	{
+		return p_port->p_adapter->params.rq_low_watermark - p_port->recv_mgr.depth;
+	}
+
+	p_stat = __recv_stat( p_port );
+	if( p_stat )
+		p_stat->n_reposts++;
+
+	return __recv_mgr_repost( p_port );
+}
+
+
+/* Completion count and delay (usec) for each receive moderation level. */
+static const struct _ipoib_moder_param
+{
+	uint16_t	cnt;
+	uint16_t	time;
+
+}	g_moder_params[IPOIB_MODER_LEVELS] =
+{
+	{ 0, 0 },		/* IPOIB_MODER_OFF */
+	{ 16, 16 },		/* IPOIB_MODER_LOW */
+	{ 64, 64 }		/* IPOIB_MODER_HIGH */
+};
+
+
+/*
+ * A new receive CQ starts unmoderated, so forget the level applied to the
+ * previous one and whether its HCA rejected moderation.
+ */
+static void
+__recv_mgr_moder_reset(
+	IN				ipoib_port_t* const			p_port )
+{
+	ipoib_recv_moder_t	*p_moder = &p_port->recv_mgr.moder;
+
+	cl_spinlock_acquire( &p_port->recv_lock );
+	p_moder->unsupported = FALSE;
+	p_moder->level = IPOIB_MODER_OFF;
+	p_moder->target = IPOIB_MODER_OFF;
+	p_moder->pkt_cnt = 0;
+	p_moder->sample_time = cl_get_time_stamp();
+	cl_spinlock_release( &p_port->recv_lock );
+}
+
+
+static IO_WORKITEM_ROUTINE __recv_mgr_moder_work;
+
+/*
+ * Applies the moderation level selected by the last rate sample to the
+ * receive CQ.  Runs at PASSIVE_LEVEL since the HCA may have to execute a
+ * command to modify the CQ.
+ */
+static void
+__recv_mgr_moder_work(
+	IN				DEVICE_OBJECT*				p_dev_obj,
+	IN				void*						context )
+{
+	ipoib_port_t		*p_port = (ipoib_port_t*)context;
+	ipoib_recv_moder_t	*p_moder = &p_port->recv_mgr.moder;
+	IPOIB_ST_RECV		*p_stat;
+	ipoib_moder_level_t	target;
+	ib_cq_handle_t		h_cq;
+	ib_api_status_t		status;
+
+	UNREFERENCED_PARAMETER(p_dev_obj);
+
+	IPOIB_ENTER( IPOIB_DBG_RECV );
+
+	/*
+	 * The port reference keeps the CA, and with it the CQ, open.  Only touch
+	 * the CQ while the port is up; a later sample retries the change.
+	 */
+	cl_obj_lock( &p_port->obj );
+	h_cq = (p_port->state == IB_QPS_RTS) ? p_port->ib_mgr.h_recv_cq : NULL;
+	cl_obj_unlock( &p_port->obj );
+	if( !h_cq )
+	{
+		cl_atomic_xchg( &p_moder->pending, 0 );
+		ipoib_port_deref( p_port, ref_recv_moder );
+		IPOIB_EXIT( IPOIB_DBG_RECV );
+		return;
+	}
+
+	cl_spinlock_acquire( &p_port->recv_lock );
+	target = p_moder->target;
+	cl_spinlock_release( &p_port->recv_lock );
+
+	status = p_port->p_adapter->p_ifc->modify_cq_moder( h_cq,
+		g_moder_params[target].cnt, g_moder_params[target].time );
+
+	cl_spinlock_acquire( &p_port->recv_lock );
+	p_stat = __recv_stat( p_port );
+	if( status == IB_SUCCESS )
+	{
+		p_moder->level = target;
+		if( p_stat )
+		{
+			p_stat->moder_level = target;
+			p_stat->moder_cnt = g_moder_params[target].cnt;
+			p_stat->moder_time = g_moder_params[target].time;
+			p_stat->n_moder_changes++;
+		}
+	}
+	else
+	{
+		/*
+		 * Don't retry on every sample if the HCA can't moderate.  Other
+		 * errors may be transient, so the next sample tries again.
+		 */
+		if( status == IB_UNSUPPORTED )
+			p_moder->unsupported = TRUE;
+		if( p_stat )
+			p_stat->n_moder_errors++;
+	}
+	cl_spinlock_release( &p_port->recv_lock );
+
+	if( status == IB_SUCCESS )
+	{
+		IPOIB_PRINT( TRACE_LEVEL_INFORMATION, IPOIB_DBG_RECV,
+			("Port[%d] receive moderation level %d (cnt %d, time %d)\n",
+			p_port->port_num, target, g_moder_params[target].cnt,
+			g_moder_params[target].time) );
+	}
+	else
+	{
+		IPOIB_PRINT( TRACE_LEVEL_WARNING, IPOIB_DBG_RECV,
+			("Port[%d] modify_cq_moder returned %s%s\n",
+			p_port->port_num, p_port->p_adapter->p_ifc->get_err_str( status ),
+			(status == IB_UNSUPPORTED) ? ", moderation disabled" : "") );
+	}
+
+	cl_atomic_xchg( &p_moder->pending, 0 );
+	ipoib_port_deref( p_port, ref_recv_moder );
+
+	IPOIB_EXIT( IPOIB_DBG_RECV );
+}
+
+
+/*
+ * Accounts for recv_cnt completed receives and, once per sample period,
+ * selects the moderation level that fits the measured receive rate.  Low
+ * rates run unmoderated so that latency is not affected.
+ * The recv_lock must be held by the caller.
+ */
+static void
+__recv_mgr_moder_sample(
+	IN				ipoib_port_t* const			p_port,
+	IN				uint32_t					recv_cnt )
+{
+	ipoib_recv_moder_t	*p_moder = &p_port->recv_mgr.moder;
+	IPOIB_ST_RECV		*p_stat;
+	ipoib_moder_level_t	target;
+	uint64_t			now, elapsed;
+	uint32_t			rate;
+
+	p_moder->pkt_cnt += recv_cnt;
+
+	now = cl_get_time_stamp();
+	elapsed = now - p_moder->sample_time;
+	if( elapsed < IPOIB_MODER_SAMPLE_USEC )
+		return;
+
+	rate = (uint32_t)(((uint64_t)p_moder->pkt_cnt * 1000000) / elapsed);
+	p_moder->pkt_cnt = 0;
+	p_moder->sample_time = now;
+
+	p_stat = __recv_stat( p_port );
+	if( p_stat )
+		p_stat->pkt_rate = rate;
+
+	if( !p_port->p_adapter->interrupt_moder )
+	{
+		target = IPOIB_MODER_OFF;
+	}
+	else if( rate >= IPOIB_MODER_HIGH_RATE || (p_moder->level == IPOIB_MODER_HIGH &&
+		rate >= IPOIB_MODER_HIGH_RATE / 2) )
+	{
+		target = IPOIB_MODER_HIGH;
+	}
+	else if( rate >= IPOIB_MODER_LOW_RATE || (p_moder->level != IPOIB_MODER_OFF &&
+		rate >= IPOIB_MODER_LOW_RATE / 2) )
+	{
+		target = IPOIB_MODER_LOW;
+	}
+	else
+	{
+		target = IPOIB_MODER_OFF;
+	}
+
+	p_moder->target = target;
+	if( target == p_moder->level || p_moder->unsupported )
+		return;
+
+	/* One change in flight at a time; the work item applies the latest target. */
+	if( cl_atomic_xchg( &p_moder->pending, 1 ) )
+		return;
+
+	ipoib_port_ref( p_port, ref_recv_moder );
+	IoQueueWorkItem( p_port->pPoWorkItemModer,
+					 (PIO_WORKITEM_ROUTINE) __recv_mgr_moder_work,
+					 DelayedWorkQueue,
+					 p_port );
+}
+
 // 	p_port->recv_lock held by caller.
 
 static inline ULONG __free_received_NBL(
@@ -2292,7 +2932,8 @@ static inline ULONG __free_received_NBL(
 		CL_ASSERT(p_port == IPOIB_PORT_FROM_NBL( cur_net_buffer_list ));
 		p_desc = IPOIB_RECV_FROM_NBL( cur_net_buffer_list );
 		
-		CL_ASSERT(p_desc->recv_mode == RECV_UD || p_desc->recv_mode == RECV_RC);
+		CL_ASSERT(p_desc->recv_mode == RECV_UD || p_desc->recv_mode == RECV_RC ||
+			p_desc->recv_mode == RECV_FRAG);
 
 		cl_perf_start( ReturnPutRecv );
 		if( p_desc->recv_mode == RECV_RC )
@@ -2309,7 +2950,7 @@ static inline ULONG __free_received_NBL(
 		}
 		else
 		{
-			__buf_mgr_put_recv( p_port, p_desc, cur_net_buffer_list );
+			__buf_mgr_put_recv_NBL( p_port, cur_net_buffer_list );
 		}
 		cl_perf_stop( &p_port->p_adapter->perf, ReturnPutRecv );
 	}
@@ -2365,7 +3006,7 @@ ipoib_return_net_buffer_list(
 
 	/* Repost buffers to HW */
 	cl_perf_start( ReturnRepostRecv );
-	shortage = __recv_mgr_repost( p_port );
+	shortage = __recv_mgr_repost_batch( p_port );
 	cl_perf_stop( &p_port->p_adapter->perf, ReturnRepostRecv );
 	cl_spinlock_release( &p_port->recv_lock );
 	cl_perf_stop( &p_port->p_adapter->perf, ReturnPacket );
@@ -2395,7 +3036,7 @@ __iopoib_WorkItem(
 
 	UNREFERENCED_PARAMETER(p_dev_obj);
 
-	while (WorkToDo && total_recv_cnt < 512) {
+	while (WorkToDo && total_recv_cnt < IPOIB_RECV_WORK_BUDGET) {
 		irql = KeRaiseIrqlToDpcLevel();
 		WorkToDo = __recv_cb_internal(NULL, p_port, &recv_cnt);
 		KeLowerIrql(irql);
@@ -2430,6 +3071,7 @@ __recv_cb_internal(
 	ULONG				recv_complete_flags = 0;
 	BOOLEAN				res;
 	BOOLEAN 			WorkToDo = FALSE;
+	IPOIB_ST_RECV		*p_stat;
 
 	PERF_DECLARE( RecvCompBundle );
 	PERF_DECLARE( RecvCb );
@@ -2490,7 +3132,7 @@ __recv_cb_internal(
 		recv_cnt += __recv_mgr_filter( p_port, p_wc, &done_list, &bad_list );
 		cl_perf_stop( &p_port->p_adapter->perf, FilterRecv );
 
-	} while( ( !p_free ) && ( recv_cnt < 128 )); 
+	} while( ( !p_free ) && ( recv_cnt < IPOIB_RECV_DPC_BUDGET )); 
 
 	*p_recv_cnt = (uint32_t)recv_cnt;
 
@@ -2504,6 +3146,15 @@ __recv_cb_internal(
 	/* Update our posted depth. */
 	p_port->recv_mgr.depth -= recv_cnt;
 
+	p_stat = __recv_stat( p_port );
+	if( p_stat )
+	{
+		p_stat->n_polls++;
+		if( !p_free )
+			p_stat->n_budget_hits++;
+	}
+	__recv_mgr_moder_sample( p_port, recv_cnt );
+
 	/* Return any discarded receives to the pool */
 	cl_perf_start( PutRecvList );
 	__buf_mgr_put_recv_list( p_port, &bad_list );
@@ -2511,9 +3162,9 @@ __recv_cb_internal(
 
 	do
 	{
-		/* Repost ASAP so we don't starve the RQ. */
+		/* Repost in batches; below the low water mark this reposts at once. */
 		cl_perf_start( RepostRecv );
-		shortage = __recv_mgr_repost( p_port );
+		shortage = __recv_mgr_repost_batch( p_port );
 		
 		cl_perf_stop( &p_port->p_adapter->perf, RepostRecv );
 
@@ -2546,12 +3197,25 @@ __recv_cb_internal(
 			res = shutter_add( &p_port->p_adapter->recv_shutter, NBL_cnt );
 			if (res)
 			{
-				NdisMIndicateReceiveNetBufferLists(
+				/*
+				 * Hand off receives for other processors to their RSS
+				 * queues and indicate the rest here.  NBL_cnt is reused
+				 * by the loop condition, so work on a copy.
+				 */
+				int32_t				local_cnt = NBL_cnt;
+				NET_BUFFER_LIST		*p_local;
+
+				p_local = __recv_mgr_rss_distribute(
+					p_port, p_port->recv_mgr.recv_NBL_array[0], &local_cnt );
+				if( p_local )
+				{
+					NdisMIndicateReceiveNetBufferLists(
 											p_port->p_adapter->h_adapter,
-											p_port->recv_mgr.recv_NBL_array[0],
+											p_local,
 											NDIS_DEFAULT_PORT_NUMBER,
-											NBL_cnt,
+											local_cnt,
 											recv_complete_flags );
+				}
 			}
 			else {
 				cl_spinlock_acquire( &p_port->recv_lock );
@@ -2590,10 +3254,8 @@ __recv_cb_internal(
 			cl_spinlock_acquire( &p_port->recv_lock );
 			while ( NBL_cnt-- > 0)
 			{
-				__buf_mgr_put_recv(
+				__buf_mgr_put_recv_NBL(
 					p_port,
-					(ipoib_recv_desc_t *)
-					IPOIB_RECV_FROM_NBL( p_port->recv_mgr.recv_NBL_array[NBL_cnt] ),
 					p_port->recv_mgr.recv_NBL_array[NBL_cnt] );
 			}
 			__recv_mgr_repost( p_port );
@@ -2652,6 +3314,173 @@ __recv_cb(
 }
 
 
+/*
+ * Software receive side scaling.  Receives are polled from the single UD
+ * receive CQ; each NBL is classified and hashed, and the ones the
+ * indirection table assigns to another processor are queued to that
+ * processor's DPC so that the protocol stack processes each flow on its
+ * RSS processor.  Returns the chain to indicate on the current processor
+ * and updates *p_NBL_cnt to its length.
+ */
+static NET_BUFFER_LIST*
+__recv_mgr_rss_distribute(
+	IN				ipoib_port_t* const			p_port,
+	IN				NET_BUFFER_LIST*			p_head,
+	IN	OUT			int32_t* const				p_NBL_cnt )
+{
+	ipoib_adapter_t		*p_adapter = p_port->p_adapter;
+	ipoib_rss_t			*p_rss;
+	ipoib_rss_queue_t	*p_queue;
+	NET_BUFFER			*p_NB;
+	eth_pkt_t			*p_eth;
+	NET_BUFFER_LIST		*p_NBL, *p_next, *p_local, **pp_local_tail;
+	NET_BUFFER_LIST		*heads[IPOIB_RSS_MAX_QUEUES];
+	NET_BUFFER_LIST		**tails[IPOIB_RSS_MAX_QUEUES];
+	ULONG				counts[IPOIB_RSS_MAX_QUEUES];
+	uint64_t			queued = 0;
+	uint32_t			n_queues, cur, target, hash = 0, hash_type;
+	ULONG				len;
+	int32_t				local_cnt = 0;
+
+	CL_ASSERT( KeGetCurrentIrql() == DISPATCH_LEVEL );
+
+	/*
+	 * The state is published with an interlocked exchange and only freed
+	 * after every processor has dropped below DISPATCH_LEVEL, so it stays
+	 * valid until this call returns.
+	 */
+	n_queues = p_port->recv_mgr.n_rss_queues;
+	p_rss = p_adapter->p_rss;
+	if( !n_queues || !p_rss )
+		return p_head;
+
+	cur = ipoib_cpu_index();
+
+	p_local = NULL;
+	pp_local_tail = &p_local;
+
+	for( p_NBL = p_head; p_NBL; p_NBL = p_next )
+	{
+		p_next = NET_BUFFER_LIST_NEXT_NBL( p_NBL );
+		NET_BUFFER_LIST_NEXT_NBL( p_NBL ) = NULL;
+
+		/*
+		 * NBL data starts at the Ethernet header built by the filter, in
+		 * the receive descriptor or in the fragment it was copied to.
+		 */
+		p_NB = NET_BUFFER_LIST_FIRST_NB( p_NBL );
+		p_eth = (eth_pkt_t*)((uint8_t*)MmGetMdlVirtualAddress(
+			NET_BUFFER_CURRENT_MDL( p_NB ) ) + NET_BUFFER_CURRENT_MDL_OFFSET( p_NB ));
+		len = NET_BUFFER_DATA_LENGTH( p_NB );
+
+		hash_type = 0;
+		if( len > sizeof(eth_hdr_t) )
+		{
+			hash_type = ipoib_rss_classify( p_rss, p_eth->hdr.type,
+				(uint8_t*)&p_eth->type.ip, len - sizeof(eth_hdr_t),
+				&hash );
+		}
+
+		target = cur;
+		if( hash_type )
+		{
+			NET_BUFFER_LIST_SET_HASH_VALUE( p_NBL, hash );
+			NET_BUFFER_LIST_SET_HASH_TYPE( p_NBL, hash_type );
+			NET_BUFFER_LIST_SET_HASH_FUNCTION( p_NBL, NdisHashFunctionToeplitz );
+			target = ipoib_rss_queue( p_rss, hash );
+		}
+		else
+		{
+			/* Receive NBLs are recycled; clear any stale hash. */
+			NET_BUFFER_LIST_INFO( p_NBL, NetBufferListHashValue ) = 0;
+			NET_BUFFER_LIST_INFO( p_NBL, NetBufferListHashInfo ) = 0;
+		}
+
+		if( target == cur || target >= n_queues )
+		{
+			*pp_local_tail = p_NBL;
+			pp_local_tail = &NET_BUFFER_LIST_NEXT_NBL( p_NBL );
+			local_cnt++;
+			continue;
+		}
+
+		if( !(queued & ((uint64_t)1 << target)) )
+		{
+			queued |= ((uint64_t)1 << target);
+			heads[target] = NULL;
+			tails[target] = &heads[target];
+			counts[target] = 0;
+		}
+		*tails[target] = p_NBL;
+		tails[target] = &NET_BUFFER_LIST_NEXT_NBL( p_NBL );
+		counts[target]++;
+	}
+
+	for( target = 0; queued; target++ )
+	{
+		if( !(queued & ((uint64_t)1 << target)) )
+			continue;
+		queued &= ~((uint64_t)1 << target);
+
+		p_queue = &p_port->recv_mgr.p_rss_queues[target];
+		cl_spinlock_acquire( &p_queue->lock );
+		*p_queue->pp_tail = heads[target];
+		p_queue->pp_tail = tails[target];
+		p_queue->NBL_cnt += counts[target];
+		cl_spinlock_release( &p_queue->lock );
+
+		/* The DPC releases the reference; one queued DPC drains all. */
+		ipoib_port_ref( p_port, ref_recv_cb );
+		if( !KeInsertQueueDpc( &p_queue->dpc, NULL, NULL ) )
+			ipoib_port_deref( p_port, ref_recv_cb );
+	}
+
+	*p_NBL_cnt = local_cnt;
+	return p_local;
+}
+
+
+static void
+__recv_rss_dpc(
+	IN				KDPC*						p_dpc,
+	IN				void*						context,
+	IN				void*						s_arg1,
+	IN				void*						s_arg2 )
+{
+	ipoib_rss_queue_t	*p_queue = (ipoib_rss_queue_t*)context;
+	ipoib_port_t		*p_port = p_queue->p_port;
+	NET_BUFFER_LIST		*p_head;
+	ULONG				NBL_cnt;
+
+	UNREFERENCED_PARAMETER( p_dpc );
+	UNREFERENCED_PARAMETER( s_arg1 );
+	UNREFERENCED_PARAMETER( s_arg2 );
+
+	IPOIB_ENTER( IPOIB_DBG_RECV );
+
+	cl_spinlock_acquire( &p_queue->lock );
+	p_head = p_queue->p_head;
+	NBL_cnt = p_queue->NBL_cnt;
+	p_queue->p_head = NULL;
+	p_queue->pp_tail = &p_queue->p_head;
+	p_queue->NBL_cnt = 0;
+	cl_spinlock_release( &p_queue->lock );
+
+	if( p_head )
+	{
+		NdisMIndicateReceiveNetBufferLists( p_port->p_adapter->h_adapter,
+											p_head,
+											NDIS_DEFAULT_PORT_NUMBER,
+											NBL_cnt,
+											NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL );
+	}
+
+	ipoib_port_deref( p_port, ref_recv_cb );
+
+	IPOIB_EXIT( IPOIB_DBG_RECV );
+}
+
+
 static void
 __recv_get_endpts(
 	IN				ipoib_port_t* const			p_port,
@@ -3675,6 +4504,7 @@ __recv_mgr_prepare_NBL(
 	NDIS_STATUS							status;
 	uint32_t							pkt_filter;
 	NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO 	chksum;
+	NET_BUFFER_LIST						*p_frag_NBL;
 
 	PERF_DECLARE( GetNdisPkt );
 
@@ -3753,7 +4583,13 @@ __recv_mgr_prepare_NBL(
 	}
 
 	cl_perf_start( GetNdisPkt );
-	*pp_net_buffer_list = __buf_mgr_get_NBL( p_port, p_desc );
+	p_frag_NBL = NULL;
+	if( p_desc->len <= IPOIB_RECV_COPYBREAK )
+		p_frag_NBL = __buf_mgr_copy_recv( p_port, p_desc );
+	if( p_frag_NBL )
+		*pp_net_buffer_list = p_frag_NBL;
+	else
+		*pp_net_buffer_list = __buf_mgr_get_NBL( p_port, p_desc );
 	cl_perf_stop( &p_port->p_adapter->perf, GetNdisPkt );
 	if( !*pp_net_buffer_list )
 	{
@@ -3795,19 +4631,177 @@ __recv_mgr_prepare_NBL(
 		break;
 	}
 
+	/* The data was copied, the descriptor can be reposted. */
+	if( p_frag_NBL )
+		__buf_mgr_put_recv( p_port, p_desc, NULL );
+
 	IPOIB_EXIT( IPOIB_DBG_RECV );
 	return IB_SUCCESS;
 }
 
 
+/*
+ * Receive coalescing.  A run of in-order segments of one TCP flow among the
+ * completed receives is copied into a buffer of the coalescing pool and
+ * indicated as a single packet, and the descriptors are returned at once.
+ * Segments are only coalesced if their IP and TCP checksums verify, so the
+ * coalesced packet is indicated with its checksums flagged as valid.
+ */
+
+/* Returns the IPv4 packet of a unicast UD receive and its length, or NULL. */
+static inline uint8_t*
+__recv_gro_ip(
+	IN				ipoib_recv_desc_t* const	p_desc,
+		OUT			uint32_t* const				p_len )
+{
+	eth_pkt_t	*p_eth;
+
+	if( p_desc->recv_mode != RECV_UD || p_desc->type != PKT_TYPE_UCAST ||
+		p_desc->len <= sizeof(eth_hdr_t) )
+	{
+		return NULL;
+	}
+
+#if IPOIB_INLINE_RECV
+	p_eth = &p_desc->buf.eth.pkt;
+#else
+	p_eth = &p_desc->p_buf->eth.pkt;
+#endif
+	if( p_eth->hdr.type != ETH_PROT_TYPE_IP )
+		return NULL;
+
+	*p_len = p_desc->len - sizeof(eth_hdr_t);
+	return (uint8_t*)&p_eth->type.ip;
+}
+
+
+/*
+ * Starts a coalesced packet with a receive if the receive that follows it
+ * is the next segment of the same TCP flow.  Returns the coalescing buffer,
+ * holding the first segment, or NULL.  The caller returns the descriptor.
+ */
+static ipoib_recv_frag_t*
+__recv_gro_open(
+	IN				ipoib_port_t* const			p_port,
+	IN				ipoib_recv_desc_t* const	p_desc,
+	IN				ipoib_recv_desc_t* const	p_next,
+		OUT			ipoib_gro_t* const			p_gro )
+{
+	ipoib_recv_frag_t	*p_frag;
+	ipoib_gro_seg_t		seg, next_seg;
+	uint8_t				*p_ip, *p_next_ip;
+	uint32_t			len, next_len, pkt_filter;
+
+	if( !p_port->buf_mgr.gro_pool.n_frags )
+		return NULL;
+
+	/* Same test as __recv_mgr_prepare_NBL applies to unicast receives. */
+	pkt_filter = p_port->p_adapter->packet_filter;
+	if( !(pkt_filter & (NDIS_PACKET_TYPE_PROMISCUOUS |
+						NDIS_PACKET_TYPE_ALL_FUNCTIONAL |
+						NDIS_PACKET_TYPE_SOURCE_ROUTING |
+						NDIS_PACKET_TYPE_DIRECTED)) )
+	{
+		return NULL;
+	}
+
+	p_ip = __recv_gro_ip( p_desc, &len );
+	p_next_ip = __recv_gro_ip( p_next, &next_len );
+	if( !p_ip || !p_next_ip ||
+		!ipoib_gro_parse( p_ip, len, &seg ) ||
+		!ipoib_gro_parse( p_next_ip, next_len, &next_seg ) ||
+		next_seg.seq != seg.seq + seg.payload_len )
+	{
+		return NULL;
+	}
+
+	p_frag = __frag_pool_get( &p_port->buf_mgr.gro_pool );
+	if( !p_frag )
+		return NULL;
+
+	/* The Ethernet header is kept in front of the coalesced packet. */
+	cl_memcpy( p_frag->p_buf, p_ip - sizeof(eth_hdr_t), sizeof(eth_hdr_t) );
+	if( !ipoib_gro_start( p_gro,
+						  p_frag->p_buf + sizeof(eth_hdr_t),
+						  p_frag->p_pool->frag_size - sizeof(eth_hdr_t),
+						  p_ip,
+						  &seg ) ||
+		!ipoib_gro_match( p_gro, p_next_ip, &next_seg ) )
+	{
+		__frag_pool_free( p_frag );
+		return NULL;
+	}
+	p_frag->type = p_desc->type;
+
+	/* Reference the port object for the outstanding receive. */
+	ipoib_port_ref( p_port, ref_get_recv );
+	return p_frag;
+}
+
+
+/* Appends a receive to the coalesced packet if it is the flow's next segment. */
+static inline boolean_t
+__recv_gro_add(
+	IN				ipoib_port_t* const			p_port,
+	IN	OUT			ipoib_gro_t* const			p_gro,
+	IN				ipoib_recv_desc_t* const	p_desc )
+{
+	ipoib_gro_seg_t		seg;
+	uint8_t				*p_ip;
+	uint32_t			len;
+	IPOIB_ST_RECV		*p_stat;
+
+	p_ip = __recv_gro_ip( p_desc, &len );
+	if( !p_ip || !ipoib_gro_parse( p_ip, len, &seg ) ||
+		!ipoib_gro_match( p_gro, p_ip, &seg ) ||
+		!ipoib_gro_append( p_gro, p_ip, &seg ) )
+	{
+		return FALSE;
+	}
+
+	p_stat = __recv_stat( p_port );
+	if( p_stat )
+		p_stat->n_coalesced++;
+	return TRUE;
+}
+
+
+/* Completes the coalesced packet and returns its NBL. */
+static NET_BUFFER_LIST*
+__recv_gro_close(
+	IN				ipoib_recv_frag_t* const	p_frag,
+	IN	OUT			ipoib_gro_t* const			p_gro )
+{
+	NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO	chksum;
+
+	ipoib_gro_finish( p_gro );
+
+	p_frag->len = sizeof(eth_hdr_t) + p_gro->len;
+	NET_BUFFER_DATA_LENGTH( NET_BUFFER_LIST_FIRST_NB( p_frag->p_NBL ) ) =
+		p_frag->len;
+	NdisAdjustMdlLength( p_frag->p_mdl, p_frag->len );
+
+	/* Every segment's checksums have been verified. */
+	chksum.Value = 0;
+	chksum.Receive.TcpChecksumSucceeded = TRUE;
+	chksum.Receive.IpChecksumSucceeded = TRUE;
+	NET_BUFFER_LIST_INFO( p_frag->p_NBL, TcpIpChecksumNetBufferListInfo ) =
+		(void*)(uintn_t)chksum.Value;
+
+	return p_frag->p_NBL;
+}
+
+
 static uint32_t
 __recv_mgr_build_NBL_array(
 	IN		ipoib_port_t* const		p_port,
 	OUT		cl_qlist_t*     		p_done_list OPTIONAL,
 	OUT		int32_t* const			p_discarded )
 {
-	cl_list_item_t			*p_item;
+	cl_list_item_t			*p_item, *p_next;
 	ipoib_recv_desc_t		*p_desc;
+	ipoib_recv_frag_t		*p_gro_frag = NULL;
+	ipoib_gro_t				gro;
 	uint32_t				i = 0;
 	ib_api_status_t			status;
 	
@@ -3828,6 +4822,40 @@ __recv_mgr_build_NBL_array(
 	{
 		p_desc = (ipoib_recv_desc_t*)p_item;
 
+		/* Extend the coalesced packet, or indicate it and start afresh. */
+		if( p_gro_frag )
+		{
+			if( __recv_gro_add( p_port, &gro, p_desc ) )
+			{
+				__buf_mgr_put_recv( p_port, p_desc, NULL );
+				p_item = cl_qlist_remove_head( p_done_list );
+				continue;
+			}
+
+			p_port->recv_mgr.recv_NBL_array[i] =
+				__recv_gro_close( p_gro_frag, &gro );
+			if (i)
+			{
+				NET_BUFFER_LIST_NEXT_NBL(p_port->recv_mgr.recv_NBL_array[i-1]) =
+					p_port->recv_mgr.recv_NBL_array[i];
+			}
+			i++;
+			p_gro_frag = NULL;
+		}
+
+		p_next = cl_qlist_head( p_done_list );
+		if( p_next != cl_qlist_end( p_done_list ) )
+		{
+			p_gro_frag = __recv_gro_open( p_port, p_desc,
+				(ipoib_recv_desc_t*)p_next, &gro );
+			if( p_gro_frag )
+			{
+				__buf_mgr_put_recv( p_port, p_desc, NULL );
+				p_item = cl_qlist_remove_head( p_done_list );
+				continue;
+			}
+		}
+
 		cl_perf_start( PreparePkt );
 		status = __recv_mgr_prepare_NBL( p_port, p_desc,
 			&p_port->recv_mgr.recv_NBL_array[i] );
@@ -3865,6 +4893,17 @@ __recv_mgr_build_NBL_array(
 		p_item = cl_qlist_remove_head( p_done_list );
 	}
 
+	if( p_gro_frag )
+	{
+		p_port->recv_mgr.recv_NBL_array[i] = __recv_gro_close( p_gro_frag, &gro );
+		if (i)
+		{
+			NET_BUFFER_LIST_NEXT_NBL(p_port->recv_mgr.recv_NBL_array[i-1]) =
+				p_port->recv_mgr.recv_NBL_array[i];
+		}
+		i++;
+	}
+
 	XIPOIB_EXIT( IPOIB_DBG_RECV );
 	return i;
 }
@@ -5127,6 +6166,20 @@ __send_mgr_filter_ip(
 						ip_packet_len) );
 				return NDIS_STATUS_FAILURE;
 			}
+
+			/* TCP is resegmented to the MTU rather than fragmented. */
+			if( prot == IP_PROT_TCP )
+			{
+				status = __build_tcp_segments( s_buf,
+											   (ip_hdr_t* const)p_ip_hdr,
+											   (uint32_t)buf_len );
+				if( status != NDIS_STATUS_NOT_SUPPORTED )
+				{
+					IPOIB_EXIT( IPOIB_DBG_SEND );
+					return status;
+				}
+			}
+
 			status = __build_ipv4_fragments( s_buf,
 											 (ip_hdr_t* const)p_ip_hdr,
 											 (uint32_t)buf_len,
@@ -5347,6 +6400,7 @@ __send_mgr_filter_igmp_v2(
 		{
 			cl_obj_lock( &p_port->obj );
 			p_endpt->is_mcast_listener = TRUE;
+			__endpt_mgr_gc_remove( p_port, p_endpt );
 			cl_obj_unlock( &p_port->obj );
             ipoib_endpt_deref( p_endpt );
 		}
@@ -5368,6 +6422,7 @@ __send_mgr_filter_igmp_v2(
 			cl_obj_lock( &p_port->obj );
 			p_endpt->is_mcast_listener = FALSE;
 			p_endpt->is_in_use = FALSE;
+			__endpt_mgr_gc_insert( p_port, p_endpt, TRUE );
 			cl_obj_unlock( &p_port->obj );
 			ipoib_endpt_deref( p_endpt );
 		}
@@ -5513,21 +6568,6 @@ __send_mgr_filter_udp(
 	return status;
 }
 
-static unsigned short ipchksum( unsigned short *ip, int len )
-{
-	unsigned long sum = 0;
-
-	len >>= 1;
-	while (len--) {
-		sum += *(ip++);
-		if (sum > 0xFFFF)
-		{
-			sum -= 0xFFFF;
-		}
-	}
-	return (unsigned short)((~sum) & 0x0000FFFF);
-}
-
 static NDIS_STATUS
 __send_mgr_filter_dhcp(
 	IN		const	ip_hdr_t* const				p_ip_hdr,
@@ -5702,7 +6742,7 @@ __send_mgr_filter_dhcp(
 	s_buf->p_send_buf->ip.hdr.length = cl_ntoh16( sizeof(ip_hdr_t) + sizeof(udp_hdr_t) + sizeof(dhcp_pkt_t) );
 	s_buf->p_send_buf->ip.prot.udp.hdr.length = cl_ntoh16( sizeof(udp_hdr_t) + sizeof(dhcp_pkt_t) );
 	s_buf->p_send_buf->ip.hdr.chksum = 0;
-	s_buf->p_send_buf->ip.hdr.chksum = ipchksum((unsigned short*) &s_buf->p_send_buf->ip.hdr, sizeof(ip_hdr_t));
+	s_buf->p_send_buf->ip.hdr.chksum = ipoib_csum( &s_buf->p_send_buf->ip.hdr, sizeof(ip_hdr_t) );
 
 	
 	/* no chksum for udp, in a case when HW does not support checksum offload */
@@ -6094,6 +7134,12 @@ __build_send_desc(
 		 * p_desc->send_qp to be RC not UD QP. Otherwise reset send_QP to UD QP.
 		 */
 
+		if( s_buf->p_port->p_adapter->params.cm_enabled &&
+			p_endpt->cm_flag == IPOIB_CM_FLAG_RC )
+		{
+			ipoib_endpt_cm_touch( s_buf->p_port, p_endpt );
+		}
+
 		if( s_buf->p_port->p_adapter->params.cm_enabled 
 		    && p_desc->send_qp == p_endpt->conn.h_send_qp )	// RC Tx
 		{
@@ -6953,6 +7999,12 @@ __endpt_mgr_construct(
 	cl_qmap_init( &p_port->endpt_mgr.mac_endpts );
 	cl_qmap_init( &p_port->endpt_mgr.lid_endpts );
 	cl_fmap_init( &p_port->endpt_mgr.gid_endpts, __gid_cmp );
+	cl_memclr( &p_port->endpt_mgr.cache, sizeof(p_port->endpt_mgr.cache) );
+	NdisInitializeListHead( &p_port->endpt_mgr.conn_lru );
+	p_port->endpt_mgr.n_lru = 0;
+	NdisInitializeListHead( &p_port->endpt_mgr.mcast_gc );
+	p_port->endpt_mgr.n_mcast_gc = 0;
+	p_port->endpt_mgr.mcast_gc_gen = 0;
 }
 
 
@@ -6962,6 +8014,16 @@ __endpt_mgr_init(
 {
 	IPOIB_ENTER( IPOIB_DBG_INIT );
 
+	/*
+	 * The endpoint caches only speed up the send path; run without them
+	 * if they cannot be allocated.
+	 */
+	if( !ipoib_endpt_cache_init( &p_port->endpt_mgr.cache, ipoib_cpu_count() ) )
+	{
+		IPOIB_PRINT( TRACE_LEVEL_WARNING, IPOIB_DBG_INIT,
+			("Failed to allocate endpoint caches, running without.\n") );
+	}
+
 	if( p_port->p_adapter->params.cm_enabled )
 	{
 		cl_fmap_init( &p_port->endpt_mgr.conn_endpts, __gid_cmp );
@@ -6973,6 +8035,8 @@ __endpt_mgr_init(
 		NdisInitializeListHead( &p_port->endpt_mgr.remove_conns );
 		NdisAllocateSpinLock( &p_port->endpt_mgr.remove_lock );
 
+		NdisAllocateSpinLock( &p_port->endpt_mgr.lru_lock );
+
 		cl_thread_init( &p_port->endpt_mgr.h_thread, 
 						ipoib_endpt_cm_mgr_thread,
 						( const void *)p_port, 
@@ -7016,11 +8080,65 @@ __endpt_mgr_destroy(
 				p_fmap_item = cl_fmap_head( &p_port->endpt_mgr.conn_endpts );
 			}
 		}
+		CL_ASSERT( IsListEmpty( &p_port->endpt_mgr.conn_lru ) );
+		NdisFreeSpinLock( &p_port->endpt_mgr.lru_lock );
 	}
 
+	ipoib_endpt_cache_destroy( &p_port->endpt_mgr.cache );
+
 	IPOIB_EXIT( IPOIB_DBG_INIT );
 }
 
+
+/*
+ * Looks up the current processor's endpoint cache, returning a referenced
+ * endpoint or NULL.  Lookups announce themselves through endpt_rdr, like
+ * the receive path does; see ipoib_endpt_cache.h.  Must be called at
+ * DISPATCH_LEVEL without the port object lock.
+ */
+static inline ipoib_endpt_t*
+__endpt_cache_get(
+	IN				ipoib_port_t* const			p_port,
+	IN				uint64_t					key )
+{
+	ipoib_endpt_cache_entry_t	*p_entry;
+	ipoib_endpt_t				*p_endpt;
+
+	CL_ASSERT( KeGetCurrentIrql() >= DISPATCH_LEVEL );
+
+	p_entry = ipoib_endpt_cache_entry(
+		&p_port->endpt_mgr.cache, ipoib_cpu_index(), key );
+	if( !p_entry || p_entry->key != key )
+		return NULL;
+
+	/* The interlocked increment orders the generation read after it. */
+	cl_atomic_inc( &p_port->endpt_rdr );
+	p_endpt = ipoib_endpt_cache_lookup( &p_port->endpt_mgr.cache, p_entry, key );
+	if( p_endpt )
+		ipoib_endpt_ref( p_endpt );
+	cl_atomic_dec( &p_port->endpt_rdr );
+
+	return p_endpt;
+}
+
+
+/*
+ * Fills the current processor's cache.  Called with the port object lock
+ * held, with the endpoint found in mac_endpts.
+ */
+static inline void
+__endpt_cache_set(
+	IN				ipoib_port_t* const			p_port,
+	IN				uint64_t					key,
+	IN				ipoib_endpt_t* const		p_endpt )
+{
+	CL_ASSERT( KeGetCurrentIrql() >= DISPATCH_LEVEL );
+
+	ipoib_endpt_cache_fill(
+		&p_port->endpt_mgr.cache, ipoib_cpu_index(), key, p_endpt );
+}
+
+
 static void
 __endpt_mgr_remove_all(
 	IN				ipoib_port_t* const			p_port )
@@ -7028,6 +8146,7 @@ __endpt_mgr_remove_all(
 	IPOIB_ENTER( IPOIB_DBG_ENDPT );
 	
 	cl_obj_lock( &p_port->obj );
+	ipoib_endpt_cache_invalidate( &p_port->endpt_mgr.cache );
 
 	/* Wait for all readers to complete. */
 	while( p_port->endpt_rdr )
@@ -7043,6 +8162,9 @@ __endpt_mgr_remove_all(
 	cl_qmap_remove_all( &p_port->endpt_mgr.mac_endpts );
 	cl_qmap_remove_all( &p_port->endpt_mgr.lid_endpts );
 	cl_fmap_remove_all( &p_port->endpt_mgr.gid_endpts );
+	NdisInitializeListHead( &p_port->endpt_mgr.mcast_gc );
+	p_port->endpt_mgr.n_mcast_gc = 0;
+	ipoib_endpt_cache_unblock( &p_port->endpt_mgr.cache );
 	cl_obj_unlock( &p_port->obj );
 
 	IPOIB_EXIT( IPOIB_DBG_ENDPT );
@@ -7067,6 +8189,7 @@ __endpt_mgr_reset_all(
 	cl_qlist_init( &conn_list );
 
 	cl_obj_lock( &p_port->obj );
+	ipoib_endpt_cache_invalidate( &p_port->endpt_mgr.cache );
 	/* Wait for all readers to complete. */
 	while( p_port->endpt_rdr )
 	{
@@ -7146,6 +8269,7 @@ __endpt_mgr_reset_all(
 			 */
 			cl_qmap_remove_item( &p_port->endpt_mgr.mac_endpts, &p_endpt->mac_item );
 			cl_fmap_remove_item( &p_port->endpt_mgr.gid_endpts, &p_endpt->gid_item );
+			__endpt_mgr_gc_remove( p_port, p_endpt );
 
 			cl_qlist_insert_tail( &mc_list, &p_endpt->mac_item.pool_item.list_item );
 		}
@@ -7176,6 +8300,7 @@ __endpt_mgr_reset_all(
 		}
 	}
 #endif
+	ipoib_endpt_cache_unblock( &p_port->endpt_mgr.cache );
 	cl_obj_unlock( &p_port->obj );
 
 	if( p_port->p_adapter->params.cm_enabled )
@@ -7240,6 +8365,7 @@ __endpt_mgr_remove(
 	CL_ASSERT(p_port->endpt_rdr > 0);
 
 	cl_obj_lock( &p_port->obj );
+	ipoib_endpt_cache_invalidate( &p_port->endpt_mgr.cache );
 	/* Wait for all readers to complete. */    
 	while( p_port->endpt_rdr > 1 )
 	{
@@ -7254,6 +8380,7 @@ __endpt_mgr_remove(
 	 * in the LID map if the GID has the same subnet prefix as us.
 	 */
 	cl_fmap_remove_item( &p_port->endpt_mgr.gid_endpts, &p_endpt->gid_item );
+	__endpt_mgr_gc_remove( p_port, p_endpt );
 #if IPOIB_CM
 	endpt_unmap_conn_dgid( p_port, p_endpt );
 #endif 
@@ -7263,6 +8390,7 @@ __endpt_mgr_remove(
 		p_endpt->dlid = 0;
 	}
 
+	ipoib_endpt_cache_unblock( &p_port->endpt_mgr.cache );
 	cl_obj_unlock( &p_port->obj );
 
 #if IPOIB_CM
@@ -7414,6 +8542,7 @@ __endpt_mgr_ref(
 	NDIS_STATUS		status;
 	cl_map_item_t	*p_item;
 	uint64_t		key;
+	KIRQL			irql;
 
 	PERF_DECLARE( EndptQueue );
 
@@ -7433,21 +8562,29 @@ __endpt_mgr_ref(
 	IPOIB_PRINT( TRACE_LEVEL_INFORMATION, IPOIB_DBG_ENDPT,
 		("Check MAC %s\n",mk_mac_str(&mac)) );
 
-	cl_obj_lock( &p_port->obj );
-	p_item = cl_qmap_get( &p_port->endpt_mgr.mac_endpts, key );
-	if( p_item == cl_qmap_end( &p_port->endpt_mgr.mac_endpts ) )
+	KeRaiseIrql( DISPATCH_LEVEL, &irql );
+	*pp_endpt = __endpt_cache_get( p_port, key );
+	KeLowerIrql( irql );
+
+	if( !*pp_endpt )
 	{
-		cl_obj_unlock( &p_port->obj );
-		IPOIB_PRINT_EXIT( TRACE_LEVEL_VERBOSE, IPOIB_DBG_ENDPT,
-			("Port[%d] Failed endpoint lookup MAC %s\n",
-				p_port->port_num, mk_mac_str(&mac)) );
-		return NDIS_STATUS_NO_ROUTE_TO_DESTINATION;
-	}
+		cl_obj_lock( &p_port->obj );
+		p_item = cl_qmap_get( &p_port->endpt_mgr.mac_endpts, key );
+		if( p_item == cl_qmap_end( &p_port->endpt_mgr.mac_endpts ) )
+		{
+			cl_obj_unlock( &p_port->obj );
+			IPOIB_PRINT_EXIT( TRACE_LEVEL_VERBOSE, IPOIB_DBG_ENDPT,
+				("Port[%d] Failed endpoint lookup MAC %s\n",
+					p_port->port_num, mk_mac_str(&mac)) );
+			return NDIS_STATUS_NO_ROUTE_TO_DESTINATION;
+		}
 
-	*pp_endpt = PARENT_STRUCT( p_item, ipoib_endpt_t, mac_item );
-	ipoib_endpt_ref( *pp_endpt );
+		*pp_endpt = PARENT_STRUCT( p_item, ipoib_endpt_t, mac_item );
+		ipoib_endpt_ref( *pp_endpt );
+		__endpt_cache_set( p_port, key, *pp_endpt );
 
-	cl_obj_unlock( &p_port->obj );
+		cl_obj_unlock( &p_port->obj );
+	}
 
 	cl_perf_start( EndptQueue );
 	status = ipoib_endpt_queue( p_port, *pp_endpt );
@@ -7708,6 +8845,7 @@ ipoib_port_remove_endpt(
 
 	/* Remove the endpoint from the maps so further requests don't find it. */
 	cl_obj_lock( &p_port->obj );
+	ipoib_endpt_cache_invalidate( &p_port->endpt_mgr.cache );
 
 	/* Wait for all readers to finish */
 	while( p_port->endpt_rdr )
@@ -7716,6 +8854,7 @@ ipoib_port_remove_endpt(
 		cl_obj_lock( &p_port->obj );
 	}
 	p_item = cl_qmap_remove( &p_port->endpt_mgr.mac_endpts, key );
+	ipoib_endpt_cache_unblock( &p_port->endpt_mgr.cache );
 	/*
 	 * Dereference the endpoint.  If the ref count goes to zero, it
 	 * will get freed.
@@ -7728,6 +8867,7 @@ ipoib_port_remove_endpt(
 		 * in the LID map if the GID has the same subnet prefix as us.
 		 */
 		cl_fmap_remove_item( &p_port->endpt_mgr.gid_endpts, &p_endpt->gid_item );
+		__endpt_mgr_gc_remove( p_port, p_endpt );
 #if IPOIB_CM
 		endpt_unmap_conn_dgid( p_port, p_endpt );
 #endif
@@ -8879,7 +10019,12 @@ __mcast_cb(
 	CL_ASSERT(p_endpt->dlid == 0);
 	/* set flag that endpoint is use */
 	p_endpt->is_in_use = TRUE;
+	if( !p_endpt->is_mcast_listener )
+		__endpt_mgr_gc_insert( p_port, p_endpt, FALSE );
 	cl_obj_unlock( &p_port->obj );
+
+	if( p_port->p_adapter->p_stat )
+		p_port->p_adapter->p_stat->mcast.n_joins++;
 	
 	/* Try to send all pending sends. */
 	cl_spinlock_acquire( &p_port->send_lock );
@@ -8907,6 +10052,9 @@ ipoib_leave_mcast_cb(
 	IPOIB_PRINT( TRACE_LEVEL_VERBOSE, IPOIB_DBG_MCAST,
 		("port[%d] mcast_cnt %d\n", p_port->port_num, p_port->mcast_cnt));
 	
+	if( p_port->p_adapter->p_stat )
+		p_port->p_adapter->p_stat->mcast.n_leaves++;
+
 	ipoib_port_deref( p_port, ref_leave_mcast);
 	//It happens
 	//ASSERT(p_port->mcast_cnt > 0);
@@ -9080,59 +10228,144 @@ GetLsoHeaderSize(
 	return NDIS_STATUS_SUCCESS;
 }
 
+/*
+ * Multicast garbage collection.
+ *
+ * The multicast endpoints that the collector may destroy are on the endpoint
+ * manager's mcast_gc list; IGMP listeners, the broadcast group and the
+ * all-hosts group are not.  The list is ordered by mcast_gc_expire, the
+ * collector run at which an endpoint is next checked.  The send and receive
+ * paths only set is_in_use, so each run walks just the expired head of the
+ * list: endpoints used since they were queued go back to the tail for
+ * another run, unused ones are destroyed.
+ *
+ * Called with the port object lock held.
+ */
+static void
+__endpt_mgr_gc_insert(
+	IN				ipoib_port_t* const			p_port,
+	IN				ipoib_endpt_t* const		p_endpt,
+	IN				boolean_t					expired )
+{
+	const mac_addr_t DEFAULT_MCAST_GROUP = {0x01, 0x00, 0x5E, 0x00, 0x00, 0x01};
+
+	__endpt_mgr_gc_remove( p_port, p_endpt );
+
+	if( !memcmp( &p_endpt->mac, &DEFAULT_MCAST_GROUP, sizeof(mac_addr_t) ) )
+		return;
+
+	if( expired )
+	{
+		/* Nothing on the list expires earlier than the current run. */
+		p_endpt->mcast_gc_expire = p_port->endpt_mgr.mcast_gc_gen;
+		InsertHeadList( &p_port->endpt_mgr.mcast_gc, &p_endpt->gc_item );
+	}
+	else
+	{
+		p_endpt->mcast_gc_expire = p_port->endpt_mgr.mcast_gc_gen + 1;
+		InsertTailList( &p_port->endpt_mgr.mcast_gc, &p_endpt->gc_item );
+	}
+	p_endpt->mcast_on_gc = TRUE;
+	p_port->endpt_mgr.n_mcast_gc++;
+}
+
+
+static void
+__endpt_mgr_gc_remove(
+	IN				ipoib_port_t* const			p_port,
+	IN				ipoib_endpt_t* const		p_endpt )
+{
+	if( p_endpt->mcast_on_gc )
+	{
+		RemoveEntryList( &p_endpt->gc_item );
+		p_endpt->mcast_on_gc = FALSE;
+		p_port->endpt_mgr.n_mcast_gc--;
+	}
+}
+
+
 static void __port_do_mcast_garbage(ipoib_port_t* const	p_port)
 {
-    const mac_addr_t DEFAULT_MCAST_GROUP = {0x01, 0x00, 0x5E, 0x00, 0x00, 0x01};
 	/* Do garbage collecting... */
 
-	cl_map_item_t	*p_item;
 	ipoib_endpt_t	*p_endpt;
 	cl_qlist_t		destroy_mc_list;
+	uint32_t		gen;
+	uint32_t		scanned;
 	uint8_t			cnt;
+	boolean_t		invalidated;
 	const static GC_MAX_LEAVE_NUM = 80;
 
 	cl_qlist_init( &destroy_mc_list );
 
 	cl_obj_lock( &p_port->obj );
-	/* Wait for all readers to finish */
-	while( p_port->endpt_rdr )
-	{
-		cl_obj_unlock( &p_port->obj );
-		cl_obj_lock( &p_port->obj );
-	}
+	gen = ++p_port->endpt_mgr.mcast_gc_gen;
+	scanned = 0;
 	cnt = 0;
-	p_item = cl_qmap_head( &p_port->endpt_mgr.mac_endpts );
-	while( (p_item != cl_qmap_end( &p_port->endpt_mgr.mac_endpts )) && (cnt < GC_MAX_LEAVE_NUM))
+	invalidated = FALSE;
+	while( !IsListEmpty( &p_port->endpt_mgr.mcast_gc ) && (cnt < GC_MAX_LEAVE_NUM) )
 	{
-		p_endpt = PARENT_STRUCT( p_item, ipoib_endpt_t, mac_item );
-		p_item = cl_qmap_next( p_item );
+		p_endpt = PARENT_STRUCT( p_port->endpt_mgr.mcast_gc.Flink,
+								 ipoib_endpt_t, gc_item );
 
-		/* Check if the current endpoint is not a multicast listener */
+		/* The rest of the list expires in later runs. */
+		if( (int32_t)(p_endpt->mcast_gc_expire - gen) > 0 )
+			break;
 
-		if( p_endpt->h_mcast && 
-			(!p_endpt->is_mcast_listener) &&
-			( memcmp( &p_endpt->mac, &DEFAULT_MCAST_GROUP, sizeof(mac_addr_t) ) &&
-			 (!p_endpt->is_in_use) ))
+		if( p_endpt->is_in_use || !p_endpt->h_mcast )
 		{
-			cl_qmap_remove_item( &p_port->endpt_mgr.mac_endpts,
-				&p_endpt->mac_item );
-			cl_fmap_remove_item( &p_port->endpt_mgr.gid_endpts,
-				&p_endpt->gid_item );
+			scanned++;
+			p_endpt->is_in_use = FALSE;
+			__endpt_mgr_gc_insert( p_port, p_endpt, FALSE );
+			continue;
+		}
 
-			if( p_endpt->dlid )
+		if( !invalidated )
+		{
+			/*
+			 * Flush the endpoint caches and wait for all readers to finish
+			 * before the first removal.  The lock is dropped while waiting,
+			 * so look at the head of the list again afterwards.
+			 */
+			ipoib_endpt_cache_invalidate( &p_port->endpt_mgr.cache );
+			while( p_port->endpt_rdr )
 			{
-				cl_qmap_remove_item( &p_port->endpt_mgr.lid_endpts,
-					&p_endpt->lid_item );
-				p_endpt->dlid = 0;
+				cl_obj_unlock( &p_port->obj );
+				cl_obj_lock( &p_port->obj );
 			}
+			invalidated = TRUE;
+			continue;
+		}
+
+		scanned++;
+		__endpt_mgr_gc_remove( p_port, p_endpt );
+		cl_qmap_remove_item( &p_port->endpt_mgr.mac_endpts,
+			&p_endpt->mac_item );
+		cl_fmap_remove_item( &p_port->endpt_mgr.gid_endpts,
+			&p_endpt->gid_item );
 
-			cl_qlist_insert_tail(
-				&destroy_mc_list, &p_endpt->mac_item.pool_item.list_item );
-			cnt++;
+		if( p_endpt->dlid )
+		{
+			cl_qmap_remove_item( &p_port->endpt_mgr.lid_endpts,
+				&p_endpt->lid_item );
+			p_endpt->dlid = 0;
 		}
-		else
-			p_endpt->is_in_use = FALSE;
+
+		cl_qlist_insert_tail(
+			&destroy_mc_list, &p_endpt->mac_item.pool_item.list_item );
+		cnt++;
 	}
+
+	if( p_port->p_adapter->p_stat )
+	{
+		p_port->p_adapter->p_stat->mcast.n_gc_runs++;
+		p_port->p_adapter->p_stat->mcast.n_gc_listed = p_port->endpt_mgr.n_mcast_gc;
+		p_port->p_adapter->p_stat->mcast.gc_scanned = scanned;
+		p_port->p_adapter->p_stat->mcast.gc_destroyed = cnt;
+		p_port->p_adapter->p_stat->mcast.n_gc_destroyed += cnt;
+	}
+	if( invalidated )
+		ipoib_endpt_cache_unblock( &p_port->endpt_mgr.cache );
 	cl_obj_unlock( &p_port->obj );
 
 	/* Destroy all multicast endpoints now that we have released the lock. */
@@ -9700,6 +10933,238 @@ __build_ipv4_fragments(
 }
 
 
+/*
+ * Software TCP segmentation of a UD send larger than the path MTU, the
+ * alternative to IP fragmentation for TCP.  Each segment is a complete TCP
+ * packet in its own WR: ds[0] is the IPoIB header, ds[1] the segment's IP
+ * and TCP headers, built from the packet's headers in a lookaside buffer,
+ * and the remaining ds the segment's payload straight from the SGL.
+ * The lookaside buffer is released on the last WR's send completion.
+ *
+ * Returns NDIS_STATUS_NOT_SUPPORTED, before anything is set up, for
+ * packets that are left to IP fragmentation.
+ */
+
+/*
+ * Computes the payload checksum of every segment.  The payload is reached
+ * through the MDL chain, past the Ethernet, IP and TCP headers.
+ */
+static NDIS_STATUS
+__gso_payload_sums(
+	IN		NET_BUFFER*					p_netbuf,
+	IN		const ipoib_gso_t* const	p_gso,
+		OUT	uint32_t*					p_sums )
+{
+	MDL			*p_mdl = NET_BUFFER_CURRENT_MDL( p_netbuf );
+	ULONG		offset, mdl_len;
+	uint8_t		*p_data;
+	uint32_t	seg = 0, seg_off = 0, seg_len, len;
+
+	offset = NET_BUFFER_CURRENT_MDL_OFFSET( p_netbuf ) +
+		sizeof(eth_hdr_t) + p_gso->hdr_len;
+	seg_len = ipoib_gso_seg_len( p_gso, 0 );
+	p_sums[0] = 0;
+
+	while( seg < p_gso->n_segs )
+	{
+		if( !p_mdl )
+			return NDIS_STATUS_INVALID_PACKET;
+
+		mdl_len = MmGetMdlByteCount( p_mdl );
+		if( offset >= mdl_len )
+		{
+			offset -= mdl_len;
+			p_mdl = p_mdl->Next;
+			continue;
+		}
+
+		NdisQueryMdl( p_mdl, &p_data, &mdl_len, NormalPagePriority );
+		if( !p_data )
+			return NDIS_STATUS_RESOURCES;
+
+		p_data += offset;
+		mdl_len -= offset;
+		offset = 0;
+
+		while( mdl_len && seg < p_gso->n_segs )
+		{
+			len = min( mdl_len, seg_len - seg_off );
+			p_sums[seg] = ipoib_csum_add_at( p_sums[seg], p_data, len, seg_off );
+			p_data += len;
+			mdl_len -= len;
+			seg_off += len;
+
+			if( seg_off == seg_len && ++seg < p_gso->n_segs )
+			{
+				p_sums[seg] = 0;
+				seg_off = 0;
+				seg_len = ipoib_gso_seg_len( p_gso, seg );
+			}
+		}
+		p_mdl = p_mdl->Next;
+	}
+	return NDIS_STATUS_SUCCESS;
+}
+
+
+static NDIS_STATUS
+__build_tcp_segments(
+	IN		ipoib_send_NB_SG*			s_buf,
+	IN		ip_hdr_t* const				p_ip_hdr,
+	IN		uint32_t					buf_len )
+{
+	ipoib_gso_t		gso;
+	uint32_t		sums[MAX_WRS_PER_MSG];
+	uint32_t		seg, seg_len, len, ds_idx;
+	uint32_t		sgl_idx = 0, skip, cur_sge;
+	uint64_t		next_sgl_addr;
+	ULONG			DataOffset;
+	uint8_t			*p_buf;
+	boolean_t		partial;
+	NDIS_STATUS		status;
+	IPOIB_ST_SEND	*p_stat;
+
+	ipoib_port_t* const			p_port = s_buf->p_port;
+	ipoib_send_desc_t* const	p_desc = s_buf->p_send_desc;
+	SCATTER_GATHER_LIST*		p_sgl = s_buf->p_sgl;
+	NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO	chksum;
+
+	IPOIB_ENTER( IPOIB_DBG_SEND );
+
+	if( !ipoib_gso_init( &gso, (uint8_t*)p_ip_hdr, buf_len,
+						 s_buf->p_endpt->tx_mtu ) ||
+		gso.n_segs > MAX_WRS_PER_MSG )
+	{
+		IPOIB_EXIT( IPOIB_DBG_SEND );
+		return NDIS_STATUS_NOT_SUPPORTED;
+	}
+
+	ASSERT( p_sgl );
+	if( p_sgl->NumberOfElements > MAX_SEND_SGE )
+	{
+		IPOIB_EXIT( IPOIB_DBG_SEND );
+		return NDIS_STATUS_NOT_SUPPORTED;
+	}
+
+	/*
+	 * With TCP checksum offload the HCA completes the checksum of every
+	 * segment; otherwise the payload is summed here.
+	 */
+	chksum.Value = (ULONG)(ULONG_PTR)NET_BUFFER_LIST_INFO( s_buf->p_nbl,
+		TcpIpChecksumNetBufferListInfo );
+	partial = p_port->p_adapter->params.send_chksum_offload &&
+		chksum.Transmit.IsIPv4 && chksum.Transmit.TcpChecksum;
+	if( !partial )
+	{
+		status = __gso_payload_sums( s_buf->p_curr_nb, &gso, sums );
+		if( status != NDIS_STATUS_SUCCESS )
+		{
+			IPOIB_PRINT_EXIT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
+				("Failed to checksum TCP payload, status 0x%08X.\n", status) );
+			return status;
+		}
+	}
+
+	/* Skip the Ethernet, IP and TCP headers in the SGL. */
+	DataOffset = (ULONG)(NET_BUFFER_CURRENT_MDL_OFFSET(s_buf->p_curr_nb));
+	skip = sizeof(eth_hdr_t) + gso.hdr_len;
+	while( sgl_idx < p_sgl->NumberOfElements &&
+		   skip >= p_sgl->Elements[sgl_idx].Length - DataOffset )
+	{
+		skip -= p_sgl->Elements[sgl_idx].Length - DataOffset;
+		DataOffset = 0;
+		sgl_idx++;
+	}
+	if( sgl_idx == p_sgl->NumberOfElements )
+	{
+		IPOIB_PRINT_EXIT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
+			("No TCP payload in %u SG elements.\n", p_sgl->NumberOfElements) );
+		return NDIS_STATUS_INVALID_PACKET;
+	}
+	next_sgl_addr =
+		p_sgl->Elements[sgl_idx].Address.QuadPart + DataOffset + skip;
+	cur_sge = p_sgl->Elements[sgl_idx].Length - DataOffset - skip;
+
+	CL_ASSERT( s_buf->p_send_buf == NULL );
+	CL_ASSERT( gso.n_segs * gso.hdr_len <= p_port->buf_mgr.send_buf_len );
+	p_buf = (uint8_t *)
+		ExAllocateFromNPagedLookasideList( &p_port->buf_mgr.send_buf_list );
+	if( !p_buf )
+	{
+		IPOIB_PRINT_EXIT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
+			("Failed to allocate lookaside buffer.\n") );
+		return NDIS_STATUS_RESOURCES;
+	}
+	s_buf->p_send_buf = (send_buf_t*)p_buf;
+
+	/* local_ds[0] preset to ipoib_hdr_t in port->hdr[x] */
+	CL_ASSERT( p_desc->send_wr[0].local_ds[0].length == sizeof( ipoib_hdr_t ) );
+
+	for( seg = 0; seg < gso.n_segs; seg++ )
+	{
+		if( seg )
+			p_desc->send_wr[seg].local_ds[0] = p_desc->send_wr[0].local_ds[0];
+
+		ipoib_gso_build_hdr( &gso, seg, partial ? 0 : sums[seg], partial, p_buf );
+		p_desc->send_wr[seg].local_ds[1].vaddr = cl_get_physaddr( p_buf );
+		p_desc->send_wr[seg].local_ds[1].length = gso.hdr_len;
+		p_desc->send_wr[seg].local_ds[1].lkey = p_port->ib_mgr.lkey;
+		p_buf += gso.hdr_len;
+		ds_idx = 2;
+
+		for( seg_len = ipoib_gso_seg_len( &gso, seg ); seg_len; seg_len -= len )
+		{
+			if( !cur_sge )
+			{
+				if( ++sgl_idx == p_sgl->NumberOfElements )
+				{
+					IPOIB_PRINT_EXIT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
+						("SGL shorter than TCP payload of %u bytes.\n",
+							gso.payload_len) );
+					return NDIS_STATUS_INVALID_PACKET;
+				}
+				next_sgl_addr = p_sgl->Elements[sgl_idx].Address.QuadPart;
+				cur_sge = p_sgl->Elements[sgl_idx].Length;
+			}
+
+			if( ds_idx >= p_port->max_sq_sge_supported )
+			{
+				IPOIB_PRINT_EXIT( TRACE_LEVEL_ERROR, IPOIB_DBG_ERROR,
+					("Segment %u needs more than %u data segments.\n",
+						seg, p_port->max_sq_sge_supported) );
+				return NDIS_STATUS_RESOURCES;
+			}
+
+			len = min( cur_sge, seg_len );
+			p_desc->send_wr[seg].local_ds[ds_idx].vaddr = next_sgl_addr;
+			p_desc->send_wr[seg].local_ds[ds_idx].length = len;
+			p_desc->send_wr[seg].local_ds[ds_idx].lkey = p_port->ib_mgr.lkey;
+			ds_idx++;
+
+			next_sgl_addr += len;
+			cur_sge -= len;
+		}
+		p_desc->send_wr[seg].wr.num_ds = ds_idx;
+	}
+	p_desc->num_wrs = gso.n_segs;
+
+	p_stat = p_port->p_adapter->p_stat ? &p_port->p_adapter->p_stat->send : NULL;
+	if( p_stat )
+	{
+		p_stat->n_gso_sends++;
+		p_stat->n_gso_segs += gso.n_segs;
+	}
+
+	IPOIB_PRINT( TRACE_LEVEL_INFORMATION, IPOIB_DBG_SEND,
+		("TCP payload %u in %u segments of %u, hdr_len %u %s\n",
+			gso.payload_len, gso.n_segs, gso.mss, gso.hdr_len,
+			(partial ? "HW csum" : "SW csum")) );
+
+	IPOIB_EXIT( IPOIB_DBG_SEND );
+	return NDIS_STATUS_SUCCESS;
+}
+
+
 static void
 __update_fragment_ip_hdr(
 	IN		ip_hdr_t* const		p_ip_hdr,
@@ -9707,8 +11172,6 @@ __update_fragment_ip_hdr(
 	IN		uint16_t			fragment_offset, 
 	IN		BOOLEAN				more_fragments )
 {
-	uint16_t*	p_hdr = (uint16_t*)p_ip_hdr;
-
 	p_ip_hdr->length = cl_hton16( fragment_size ); // bytes
 	p_ip_hdr->offset_flags = cl_hton16( fragment_offset ); // 8-byte units
 
@@ -9720,8 +11183,7 @@ __update_fragment_ip_hdr(
 	{
 		IP_SET_LAST_FRAGMENT( p_ip_hdr );
 	}
-	p_ip_hdr->chksum = 0;
-	p_ip_hdr->chksum = ipchksum( p_hdr, IP_HEADER_LENGTH(p_ip_hdr) );
+	ipoib_csum_ip_hdr( p_ip_hdr );
 }
 
 static void
@@ -42,6 +42,9 @@
 #include <ip_packet.h>
 #include "ipoib_xfr_mgr.h"
 #include "ipoib_endpoint.h"
+#include "ipoib_rss.h"
+#include "ipoib_endpt_cache.h"
+#include "ipoib_gso.h"
 
 
 /*
@@ -105,6 +108,7 @@ typedef struct _ipoib_ib_mgr
 	ib_query_handle_t		h_query;
 	ib_srq_handle_t			h_srq;
 	atomic32_t				srq_qp_cnt;
+	atomic32_t				srq_refill;
 	net32_t					qpn;
 
 	ib_mr_handle_t			h_mr;
@@ -140,6 +144,10 @@ typedef struct _ipoib_ib_mgr
 *	srq_qp_cnt
 *		number of QPs bound to the SRQ
 *
+*	srq_refill
+*		Set when the SRQ dropped below its limit; the CM endpoint thread
+*		refills the SRQ and re-arms the limit.
+*
 *	qpn
 *		local QP number in net byte-order.
 *
@@ -330,6 +338,47 @@ typedef union _send_buf
 #include <complib/cl_packoff.h>
 
 
+/****s* IPoIB Driver/ipoib_frag_pool_t
+* NAME
+*	ipoib_frag_pool_t
+*
+* DESCRIPTION
+*	Pool of preallocated receive buffers, each with its own MDL and NBL,
+*	that UD receives are copied into before being indicated.
+*
+* SYNOPSIS
+*/
+typedef struct _ipoib_frag_pool
+{
+	uint8_t				*p_mem;
+	struct _ipoib_recv_frag	*p_frags;
+	uint32_t			n_frags;
+	uint32_t			frag_size;
+	uint32_t			n_lists;
+	SLIST_HEADER		*p_lists;
+
+}	ipoib_frag_pool_t;
+/*
+* FIELDS
+*	p_mem
+*		Page aligned memory carved into n_frags frag_size buffers.
+*
+*	p_frags
+*		Array of n_frags receive fragments, one per buffer.  Zero n_frags
+*		disables the pool.
+*
+*	frag_size
+*		Size of each buffer.
+*
+*	n_lists
+*		Number of free fragment lists, one per processor.
+*
+*	p_lists
+*		Lock-free lists of free fragments.  Fragments are returned to, and
+*		taken from, the list of the current processor first.
+*********/
+
+
 typedef struct _ipoib_buf_mgr
 {
 	cl_qpool_t			recv_pool;
@@ -341,6 +390,9 @@ typedef struct _ipoib_buf_mgr
 	
 	NDIS_HANDLE			h_send_pkt_pool;
 
+	ipoib_frag_pool_t	frag_pool;
+	ipoib_frag_pool_t	gro_pool;
+
 }	ipoib_buf_mgr_t;
 /*
 * FIELDS
@@ -352,8 +404,16 @@ typedef struct _ipoib_buf_mgr
 *
 *	send_buf_list
 *		Lookaside list for dynamically allocating send buffers for send
-*		operations which require copies (ARP, DHCP, IP fragmentation and any with more
-*		physical pages than can fit in the local data segments).
+*		operations which require copies (ARP, DHCP, IP fragmentation, TCP
+*		segmentation and any with more physical pages than can fit in the
+*		local data segments).
+*
+*	frag_pool
+*		IPOIB_RECV_FRAG_SIZE buffers that short receives are copied into.
+*
+*	gro_pool
+*		IPOIB_RECV_GRO_SIZE buffers that consecutive TCP segments are
+*		coalesced into.
 *********/
 
 typedef enum _ipoib_pkt_type
@@ -369,7 +429,8 @@ typedef enum _ipoib_pkt_type
 typedef enum __ib_recv_mode
 {
 	RECV_UD = 1,
-	RECV_RC = 2
+	RECV_RC = 2,
+	RECV_FRAG = 3
 
 }	ib_recv_mode_t;
 
@@ -503,6 +564,73 @@ typedef struct _ipoib_recv_desc
 *********/
 
 
+/* Receives up to this many bytes are copied into a fragment buffer. */
+#define IPOIB_RECV_COPYBREAK		256
+
+/* Size of a receive fragment buffer.  Must divide PAGE_SIZE. */
+#define IPOIB_RECV_FRAG_SIZE		256
+
+C_ASSERT( IPOIB_RECV_COPYBREAK <= IPOIB_RECV_FRAG_SIZE );
+C_ASSERT( (PAGE_SIZE % IPOIB_RECV_FRAG_SIZE) == 0 );
+
+/* Size of a receive coalescing buffer.  Must be a multiple of PAGE_SIZE. */
+#define IPOIB_RECV_GRO_SIZE			(16 * 1024)
+
+/* Receive descriptors per coalescing buffer. */
+#define IPOIB_RECV_GRO_RATIO		8
+
+C_ASSERT( (IPOIB_RECV_GRO_SIZE % PAGE_SIZE) == 0 );
+
+/****s* IPoIB Driver/ipoib_recv_frag_t
+* NAME
+*	ipoib_recv_frag_t
+*
+* DESCRIPTION
+*	Buffer that a UD receive is copied into so that its descriptor can be
+*	reposted at once: a small one, packed with others in a page, for a
+*	short receive, or a large one that consecutive TCP segments are
+*	coalesced into.
+*
+* SYNOPSIS
+*/
+typedef struct _ipoib_recv_frag
+{
+	cl_pool_item_t		item;	/* Must be first. */
+	uint32_t			len;
+	ipoib_pkt_type_t	type;
+	ib_recv_mode_t		recv_mode;	/* matches ipoib_recv_desc_t to this offset */
+	SLIST_ENTRY			entry;
+	ipoib_frag_pool_t	*p_pool;
+	uint8_t				*p_buf;
+	NET_BUFFER_LIST		*p_NBL;
+	MDL					*p_mdl;
+
+}	ipoib_recv_frag_t;
+/*
+* FIELDS
+*	item, len, type
+*		Same as in ipoib_recv_desc_t; item is unused.
+*
+*	recv_mode
+*		Always RECV_FRAG; identifies fragments among returned NBLs.
+*
+*	entry
+*		Link in the free lists of the fragment's pool.
+*
+*	p_pool
+*		Pool the fragment belongs to.
+*
+*	p_buf
+*		Buffer of the pool's frag_size bytes holding the Ethernet frame.
+*
+*	p_NBL
+*		NBL used to indicate the fragment, allocated with the fragment.
+*
+*	p_mdl
+*		MDL describing p_buf.
+*********/
+
+
 typedef struct __ipoib_send_wr
 {
 	ib_send_wr_t		wr;
@@ -538,11 +666,113 @@ typedef struct _ipoib_send_desc
 *********/
 
 
+/****s* IPoIB Driver/ipoib_rss_queue_t
+* NAME
+*	ipoib_rss_queue_t
+*
+* DESCRIPTION
+*	Per-processor queue of received NBLs waiting to be indicated from a DPC
+*	targeted at that processor.
+*
+* SYNOPSIS
+*/
+typedef struct _ipoib_rss_queue
+{
+	KDPC				dpc;
+	cl_spinlock_t		lock;
+	NET_BUFFER_LIST		*p_head;
+	NET_BUFFER_LIST		**pp_tail;
+	ULONG				NBL_cnt;
+	struct _ipoib_port	*p_port;
+
+}	ipoib_rss_queue_t;
+/*
+* FIELDS
+*	dpc
+*		DPC targeted at the queue's processor, indicating the queued NBLs.
+*
+*	lock
+*		Spinlock protecting the NBL chain.
+*
+*	p_head, pp_tail
+*		Chain of NBLs to indicate, linked through NET_BUFFER_LIST_NEXT_NBL.
+*
+*	NBL_cnt
+*		Number of NBLs in the chain.
+*
+*	p_port
+*		Owning port.
+*********/
+
+
+/* Receive CQ interrupt moderation levels. */
+typedef enum _ipoib_moder_level
+{
+	IPOIB_MODER_OFF = 0,
+	IPOIB_MODER_LOW,
+	IPOIB_MODER_HIGH,
+	IPOIB_MODER_LEVELS
+
+}	ipoib_moder_level_t;
+
+
+/****s* IPoIB Driver/ipoib_recv_moder_t
+* NAME
+*	ipoib_recv_moder_t
+*
+* DESCRIPTION
+*	Adaptive interrupt moderation state of the receive CQ.  The receive
+*	rate is sampled in the CQ callback and the moderation level that fits
+*	it is applied from a work item, since modifying the CQ may wait for
+*	the HCA.
+*
+* SYNOPSIS
+*/
+typedef struct _ipoib_recv_moder
+{
+	boolean_t			unsupported;
+	ipoib_moder_level_t	level;
+	ipoib_moder_level_t	target;
+	atomic32_t			pending;
+	uint32_t			pkt_cnt;
+	uint64_t			sample_time;
+
+}	ipoib_recv_moder_t;
+/*
+* FIELDS
+*	unsupported
+*		Set once the HCA returns IB_UNSUPPORTED for a moderation change;
+*		no further changes are attempted until the receive CQ is created
+*		again.
+*
+*	level
+*		Moderation level currently applied to the receive CQ.
+*
+*	target
+*		Moderation level selected by the last rate sample.
+*
+*	pending
+*		Non-zero while the work item applying target is queued.
+*
+*	pkt_cnt
+*		Receives completed since sample_time.
+*
+*	sample_time
+*		Time stamp, in microseconds, at which the current sample started.
+*
+* NOTES
+*	All fields but pending are protected by the port's recv_lock.
+*********/
+
+
 typedef struct _ipoib_recv_mgr
 {
-	int32_t			depth;
-	NET_BUFFER_LIST	**recv_NBL_array;
-	cl_qlist_t		done_list;
+	int32_t				depth;
+	NET_BUFFER_LIST		**recv_NBL_array;
+	cl_qlist_t			done_list;
+	uint32_t			n_rss_queues;
+	ipoib_rss_queue_t	*p_rss_queues;
+	ipoib_recv_moder_t	moder;
 
 }	ipoib_recv_mgr_t;
 /*
@@ -557,8 +787,53 @@ typedef struct _ipoib_recv_mgr
 *		List of receive descriptors (ipoib_desc_t) polled from the RX CQ which
 *		are used to construct the recv_NBL_array; array is then used to indicate
 *		received packets to NDIS 6.
+*
+*	n_rss_queues
+*		Number of processors receives can be spread across.
+*
+*	p_rss_queues
+*		Array of n_rss_queues per-processor indication queues, indexed by
+*		processor index.
+*
+*	moder
+*		Interrupt moderation state of the receive CQ.
 *********/
 
+
+/*
+ * Number of active processors, and the index of the current one.  The index
+ * is only stable while running at DISPATCH_LEVEL or above.
+ */
+static inline uint32_t
+ipoib_cpu_count( void )
+{
+#if defined(NDIS630_MINIPORT)
+	return KeQueryActiveProcessorCountEx( ALL_PROCESSOR_GROUPS );
+#else
+	return KeQueryActiveProcessorCount( NULL );
+#endif
+}
+
+static inline uint32_t
+ipoib_cpu_index( void )
+{
+#if defined(NDIS630_MINIPORT)
+	return KeGetCurrentProcessorIndex();
+#else
+	return KeGetCurrentProcessorNumber();
+#endif
+}
+
+
+/*
+ * Number of processors receives can be spread across by RSS.
+ */
+static inline uint32_t
+ipoib_rss_queue_count( void )
+{
+	return min( ipoib_cpu_count(), IPOIB_RSS_MAX_QUEUES );
+}
+
 #if 0
 class ItemListElement: public cl_list_item_t {
 	public:
@@ -648,6 +923,13 @@ typedef struct _ipoib_endpt_mgr
 	cl_thread_t				h_thread;
 	cl_event_t				event;
 	uint32_t				thread_is_done;
+	LIST_ENTRY				conn_lru;
+	NDIS_SPIN_LOCK			lru_lock;
+	uint32_t				n_lru;
+	LIST_ENTRY				mcast_gc;
+	uint32_t				n_mcast_gc;
+	uint32_t				mcast_gc_gen;
+	ipoib_endpt_cache_t		cache;
 }	ipoib_endpt_mgr_t;
 /*
 * FIELDS
@@ -663,6 +945,31 @@ typedef struct _ipoib_endpt_mgr
 *
 *	conn_endpts
 *		Map of connected endpts, keyed by remote gid.
+*
+*	conn_lru
+*		Endpoints with a connected active RC connection, least recently
+*		used for sending first.  Idle and surplus connections are reaped
+*		from the head by the CM endpoint thread.
+*
+*	lru_lock
+*		Protects conn_lru, n_lru and the endpoints' LRU fields.
+*
+*	n_lru
+*		Number of endpoints on conn_lru.
+*
+*	mcast_gc
+*		Multicast endpoints the garbage collector may destroy, in order of
+*		the GC generation at which they expire.  Protected by the port
+*		object lock.
+*
+*	n_mcast_gc
+*		Number of endpoints on mcast_gc.
+*
+*	mcast_gc_gen
+*		Number of garbage collector runs.
+*
+*	cache
+*		Per-processor endpoint lookup caches, see ipoib_endpt_cache.h.
 *********/
 
 #pragma warning(disable:4324)   // structure padded due to align()
@@ -713,6 +1020,7 @@ typedef struct _ipoib_port
 	LONG					n_no_progress;
 	PIO_WORKITEM			pPoWorkItem;
 	PIO_WORKITEM			pPoWorkItemCM;
+	PIO_WORKITEM			pPoWorkItemModer;
 	ipoib_prealloc_hdr_t	hdr[1];	/* Must be last! */
 
 }	ipoib_port_t;
@@ -809,6 +1117,9 @@ typedef struct _ipoib_port
 *
 *	pPoWorkItemCM
 *		DPC recv offload to worker thread for Connected Mode
+*
+*	pPoWorkItemModer
+*		Applies receive CQ interrupt moderation changes at PASSIVE_LEVEL
 *		
 *	hdr
 *		ipoib header array - 1 entry per outstanding send: UD or RC; see hdr_idx.
@@ -1051,6 +1362,25 @@ void
 endpt_cm_disconnect(
 	IN		ipoib_endpt_t*	const		p_endpt );
 
+void
+endpt_cm_touch(
+	IN		ipoib_port_t* const			p_port,
+	IN		ipoib_endpt_t* const		p_endpt );
+
+/*
+ * Called for every send to a CM capable endpoint.  Moves the endpoint to
+ * the tail of the connection LRU at most once a second, and reconnects
+ * endpoints whose connection was reaped.
+ */
+static inline void
+ipoib_endpt_cm_touch(
+	IN		ipoib_port_t* const			p_port,
+	IN		ipoib_endpt_t* const		p_endpt )
+{
+	if( p_endpt->cm_lru_time != cl_get_time_stamp_sec() || p_endpt->cm_reaped )
+		endpt_cm_touch( p_port, p_endpt );
+}
+
 void
 endpt_cm_release_resources(
 	IN				ipoib_port_t* const		p_port,
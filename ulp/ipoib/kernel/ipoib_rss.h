@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2008 Mellanox Technologies.  All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _IPOIB_RSS_H_
+#define _IPOIB_RSS_H_
+
+
+/*
+ * Receive side scaling classification and queue selection.
+ *
+ * This header only depends on complib and ip_packet.h so that it can be
+ * built into user-mode test and benchmark programs as well as the driver.
+ */
+#include <complib/cl_types.h>
+#include <complib/cl_memory.h>
+#include <ip_packet.h>
+
+
+/* Size of the Toeplitz secret key, in bytes. */
+#define IPOIB_RSS_KEY_SIZE			40
+
+/* Maximum number of entries in the indirection table.  Power of two. */
+#define IPOIB_RSS_MAX_TABLE_SIZE	128
+
+/* Maximum number of processors that receives are spread across. */
+#define IPOIB_RSS_MAX_QUEUES		64
+
+/* Longest hash input: IPv6 source and destination addresses plus ports. */
+#define IPOIB_RSS_MAX_INPUT			36
+
+/* Hash types.  The values match the NDIS_HASH_xxx flags. */
+#define IPOIB_RSS_HASH_IPV4			0x00000100
+#define IPOIB_RSS_HASH_TCP_IPV4		0x00000200
+#define IPOIB_RSS_HASH_IPV6			0x00000400
+#define IPOIB_RSS_HASH_TCP_IPV6		0x00001000
+
+#define IPOIB_RSS_HASH_ALL			\
+	(IPOIB_RSS_HASH_IPV4 | IPOIB_RSS_HASH_TCP_IPV4 | \
+	IPOIB_RSS_HASH_IPV6 | IPOIB_RSS_HASH_TCP_IPV6)
+
+
+/****s* IPoIB Driver/ipoib_rss_t
+* NAME
+*	ipoib_rss_t
+*
+* DESCRIPTION
+*	Receive side scaling state: the enabled hash types, the indirection
+*	table and the Toeplitz key expanded into per-byte lookup tables.
+*
+* SYNOPSIS
+*/
+typedef struct _ipoib_rss
+{
+	uint32_t			hash_types;
+	uint32_t			table_mask;
+	uint32_t			table[IPOIB_RSS_MAX_TABLE_SIZE];
+	uint8_t				key[IPOIB_RSS_KEY_SIZE];
+	uint32_t			key_tbl[IPOIB_RSS_MAX_INPUT][256];
+
+}	ipoib_rss_t;
+/*
+* FIELDS
+*	hash_types
+*		Combination of IPOIB_RSS_HASH_xxx flags.  Zero disables hashing.
+*
+*	table_mask
+*		Number of valid indirection table entries minus one.
+*
+*	table
+*		Indirection table, mapping the low bits of the hash to a queue.
+*
+*	key
+*		Toeplitz secret key.
+*
+*	key_tbl
+*		For every input byte position and byte value, the XOR of the 32-bit
+*		key windows selected by the set bits of that byte.  Hashing an
+*		input then takes one lookup per byte instead of one step per bit.
+*********/
+
+
+/****f* IPoIB Driver/ipoib_rss_set_key
+* NAME
+*	ipoib_rss_set_key
+*
+* DESCRIPTION
+*	Sets the Toeplitz secret key and rebuilds the per-byte lookup tables.
+*	Keys shorter than IPOIB_RSS_KEY_SIZE are padded with zeroes.
+*
+* SYNOPSIS
+*/
+static inline void
+ipoib_rss_set_key(
+	IN	OUT			ipoib_rss_t* const			p_rss,
+	IN		const	uint8_t* const				p_key,
+	IN				uint32_t					key_len )
+{
+	uint32_t	i, b, j;
+	uint64_t	window;
+	uint32_t	hash;
+
+	if( key_len > IPOIB_RSS_KEY_SIZE )
+		key_len = IPOIB_RSS_KEY_SIZE;
+
+	cl_memclr( p_rss->key, sizeof(p_rss->key) );
+	cl_memcpy( p_rss->key, p_key, key_len );
+
+	for( i = 0; i < IPOIB_RSS_MAX_INPUT; i++ )
+	{
+		/* 40 key bits, enough to shift a 32-bit window over 8 input bits. */
+		window = ((uint64_t)p_rss->key[i] << 32) |
+			((uint64_t)p_rss->key[i + 1] << 24) |
+			((uint64_t)p_rss->key[i + 2] << 16) |
+			((uint64_t)p_rss->key[i + 3] << 8) |
+			(uint64_t)p_rss->key[i + 4];
+
+		for( b = 0; b < 256; b++ )
+		{
+			hash = 0;
+			for( j = 0; j < 8; j++ )
+			{
+				if( b & (0x80 >> j) )
+					hash ^= (uint32_t)(window >> (8 - j));
+			}
+			p_rss->key_tbl[i][b] = hash;
+		}
+	}
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_rss_set_table
+* NAME
+*	ipoib_rss_set_table
+*
+* DESCRIPTION
+*	Sets the indirection table.  The number of entries must be a power of
+*	two no larger than IPOIB_RSS_MAX_TABLE_SIZE.
+*
+* SYNOPSIS
+*/
+static inline boolean_t
+ipoib_rss_set_table(
+	IN	OUT			ipoib_rss_t* const			p_rss,
+	IN		const	uint32_t* const				p_table,
+	IN				uint32_t					n_entries )
+{
+	if( !n_entries || n_entries > IPOIB_RSS_MAX_TABLE_SIZE ||
+		(n_entries & (n_entries - 1)) )
+	{
+		return FALSE;
+	}
+
+	cl_memcpy( p_rss->table, p_table, n_entries * sizeof(uint32_t) );
+	p_rss->table_mask = n_entries - 1;
+	return TRUE;
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_rss_hash
+* NAME
+*	ipoib_rss_hash
+*
+* DESCRIPTION
+*	Computes the Toeplitz hash of up to IPOIB_RSS_MAX_INPUT bytes.
+*
+* SYNOPSIS
+*/
+static inline uint32_t
+ipoib_rss_hash(
+	IN		const	ipoib_rss_t* const			p_rss,
+	IN		const	uint8_t*					p_input,
+	IN				uint32_t					len )
+{
+	uint32_t	i, hash = 0;
+
+	for( i = 0; i < len; i++ )
+		hash ^= p_rss->key_tbl[i][p_input[i]];
+
+	return hash;
+}
+/*********/
+
+
+/****f* IPoIB Driver/ipoib_rss_classify
+* NAME
+*	ipoib_rss_classify
+*
+* DESCRIPTION
+*	Classifies an IPv4 or IPv6 packet and hashes it according to the
+*	enabled hash types.  TCP packets are hashed on addresses and ports,
+*	everything else on addresses only.  IP fragments are hashed on
+*	addresses only so that all fragments of a datagram land together.
+*
+* SYNOPSIS
+*/
+static inline uint32_t
+ipoib_rss_classify(
+	IN		const	ipoib_rss_t* const			p_rss,
+	IN				net16_t						eth_type,
+	IN		const	uint8_t*					p_ip,
+	IN				uint32_t					len,
+		OUT			uint32_t* const				p_hash )
+{
+	uint8_t				input[IPOIB_RSS_MAX_INPUT];
+	uint32_t			input_len, hdr_len, hash_type;
+	const ip_hdr_t		*p_ip_hdr;
+	const ipv6_hdr_t	*p_ipv6_hdr;
+
+	if( eth_type == ETH_PROT_TYPE_IP )
+	{
+		if( len < sizeof(ip_hdr_t) )
+			return 0;
+
+		p_ip_hdr = (const ip_hdr_t*)p_ip;
+		hdr_len = IP_HEADER_LENGTH( p_ip_hdr );
+		if( hdr_len < sizeof(ip_hdr_t) || hdr_len > len )
+			return 0;
+
+		cl_memcpy( &input[0], &p_ip_hdr->src_ip, sizeof(net32_t) );
+		cl_memcpy( &input[4], &p_ip_hdr->dst_ip, sizeof(net32_t) );
+		input_len = 2 * sizeof(net32_t);
+
+		if( (p_rss->hash_types & IPOIB_RSS_HASH_TCP_IPV4) &&
+			p_ip_hdr->prot == IP_PROT_TCP &&
+			!IP_FRAGMENT_OFFSET( p_ip_hdr ) && !IP_MORE_FRAGMENTS( p_ip_hdr ) &&
+			len >= hdr_len + 2 * sizeof(net16_t) )
+		{
+			cl_memcpy( &input[input_len], p_ip + hdr_len, 2 * sizeof(net16_t) );
+			input_len += 2 * sizeof(net16_t);
+			hash_type = IPOIB_RSS_HASH_TCP_IPV4;
+		}
+		else if( p_rss->hash_types & IPOIB_RSS_HASH_IPV4 )
+		{
+			hash_type = IPOIB_RSS_HASH_IPV4;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+	else if( eth_type == ETH_PROT_TYPE_IPV6 )
+	{
+		if( len < sizeof(ipv6_hdr_t) )
+			return 0;
+
+		p_ipv6_hdr = (const ipv6_hdr_t*)p_ip;
+		cl_memcpy( &input[0], p_ipv6_hdr->src_addr, 16 );
+		cl_memcpy( &input[16], p_ipv6_hdr->dest_addr, 16 );
+		input_len = 32;
+
+		/* Extension headers are not walked; such packets use the 2-tuple. */
+		if( (p_rss->hash_types & IPOIB_RSS_HASH_TCP_IPV6) &&
+			p_ipv6_hdr->next_header == IP_PROT_TCP &&
+			len >= sizeof(ipv6_hdr_t) + 2 * sizeof(net16_t) )
+		{
+			cl_memcpy( &input[input_len],
+				p_ip + sizeof(ipv6_hdr_t), 2 * sizeof(net16_t) );
+			input_len += 2 * sizeof(net16_t);
+			hash_type = IPOIB_RSS_HASH_TCP_IPV6;
+		}
+		else if( p_rss->hash_types & IPOIB_RSS_HASH_IPV6 )
+		{
+			hash_type = IPOIB_RSS_HASH_IPV6;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+	else
+	{
+		return 0;
+	}
+
+	*p_hash = ipoib_rss_hash( p_rss, input, input_len );
+	return hash_type;
+}
+/*
+* RETURN VALUES
+*	The IPOIB_RSS_HASH_xxx type used to compute *p_hash, or zero if the
+*	packet was not hashed.
+*********/
+
+
+/****f* IPoIB Driver/ipoib_rss_queue
+* NAME
+*	ipoib_rss_queue
+*
+* DESCRIPTION
+*	Returns the queue (processor index) selected by the indirection table
+*	for a hash value.
+*
+* SYNOPSIS
+*/
+static inline uint32_t
+ipoib_rss_queue(
+	IN		const	ipoib_rss_t* const			p_rss,
+	IN				uint32_t					hash )
+{
+	return p_rss->table[hash & p_rss->table_mask];
+}
+/*********/
+
+
+#endif	/* _IPOIB_RSS_H_ */
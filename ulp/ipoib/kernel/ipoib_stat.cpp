@@ -22,6 +22,10 @@ PIPOIB_ST_DEVICE ipoib_st_dev_add()
 	for ( i = 0; i < IPOIB_ST_MAX_DEVICES; ++i ) {
 		if ( g_stat.dev[i].valid == FALSE ) {
 			g_stat.dev[i].valid = TRUE;
+			memset( &g_stat.dev[i].recv, 0, sizeof(g_stat.dev[i].recv) );
+			memset( &g_stat.dev[i].send, 0, sizeof(g_stat.dev[i].send) );
+			memset( &g_stat.dev[i].cm, 0, sizeof(g_stat.dev[i].cm) );
+			memset( &g_stat.dev[i].mcast, 0, sizeof(g_stat.dev[i].mcast) );
 			return &g_stat.dev[i];
 		}
 	}
@@ -36,6 +36,56 @@ Notes:
 typedef struct _ipoib_adapter ipoib_adapter_t;
 typedef struct _ipoib_port ipoib_port_t;
 
+// receive path
+typedef struct _IPOIB_ST_RECV
+{
+	ULONG				moder_level;		// current receive CQ moderation level
+	ULONG				moder_cnt;			// completions per event at that level
+	ULONG				moder_time;			// max event delay (usec) at that level
+	ULONG				pkt_rate;			// receives per second, last sample
+	ULONG				n_moder_changes;	// moderation changes applied
+	ULONG				n_moder_errors;		// moderation changes rejected by the HCA
+	ULONG				n_polls;			// receive CQ drains
+	ULONG				n_budget_hits;		// drains stopped by the poll budget
+	ULONG				n_reposts;			// batched receive reposts
+	ULONG				n_copied;			// small receives copied into fragments
+	ULONG				n_coalesced;		// TCP segments merged into a previous one
+	
+} IPOIB_ST_RECV, *PIPOIB_ST_RECV;
+
+// send path
+typedef struct _IPOIB_ST_SEND
+{
+	ULONG				n_gso_sends;		// TCP sends segmented in software
+	ULONG				n_gso_segs;			// segments sent for them
+	
+} IPOIB_ST_SEND, *PIPOIB_ST_SEND;
+
+// connected mode
+typedef struct _IPOIB_ST_CM
+{
+	ULONG				n_conns;			// active RC connections on the LRU
+	ULONG				n_idle_reaped;		// connections closed for being idle
+	ULONG				n_evicted;			// connections closed over CmMaxConns
+	ULONG				n_reconnects;		// reaped connections re-established
+	ULONG				n_srq_limits;		// SRQ low watermark events
+	ULONG				n_srq_refills;		// receives posted by SRQ refills
+	
+} IPOIB_ST_CM, *PIPOIB_ST_CM;
+
+// multicast
+typedef struct _IPOIB_ST_MCAST
+{
+	ULONG				n_joins;			// multicast groups joined
+	ULONG				n_leaves;			// multicast groups left
+	ULONG				n_gc_runs;			// garbage collector runs
+	ULONG				n_gc_listed;		// endpoints the collector may destroy
+	ULONG				gc_scanned;			// expired endpoints checked, last run
+	ULONG				gc_destroyed;		// endpoints destroyed, last run
+	ULONG				n_gc_destroyed;		// endpoints destroyed in total
+	
+} IPOIB_ST_MCAST, *PIPOIB_ST_MCAST;
+
 typedef struct _IPOIB_ST_DEVICE
 {
 	boolean_t			valid;				// all the structure is valid
@@ -44,6 +94,10 @@ typedef struct _IPOIB_ST_DEVICE
 	PRKTHREAD			p_halt_thread;		// thread, calling ipoib_halt
 	int					n_power_irps;		// NdisDevicePnPEventPowerProfileChanged 
 	int					n_pnp_irps;			// NdisDevicePnPEventSurpriseRemoved 
+	IPOIB_ST_RECV		recv;				// receive path moderation and polling
+	IPOIB_ST_SEND		send;				// send path segmentation
+	IPOIB_ST_CM			cm;					// connected mode connections and SRQ
+	IPOIB_ST_MCAST		mcast;				// multicast joins and garbage collection
 	
 } IPOIB_ST_DEVICE, *PIPOIB_ST_DEVICE;
 
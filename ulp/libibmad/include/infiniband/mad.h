@@ -1215,6 +1215,51 @@ MAD_EXPORT int mad_get_timeout(const struct ibmad_port *srcport,
 			       int override_ms);
 MAD_EXPORT int mad_get_retries(const struct ibmad_port *srcport);
 
+/* rpc_async.c */
+struct ibmad_rpc_engine;
+
+/*
+ * Completion callback of an asynchronous RPC.  error is 0 on success,
+ * ETIMEDOUT when all retries expired, EIO when the MAD completed with a
+ * non-zero status (rpc->rstatus holds it, a redirect is followed once) or
+ * another errno value, e.g. when the RPC could not be sent.
+ * mad points to the received MAD (NULL if none) and, like rpc and dport,
+ * is only valid for the duration of the callback.
+ */
+typedef void (ib_rpc_async_cb) (struct ibmad_rpc_engine * engine,
+				ib_rpc_t * rpc, ib_portid_t * dport,
+				uint8_t * mad, int error, void *cb_data);
+
+struct ibmad_rpc_engine_stats {
+	uint64_t sent;
+	uint64_t completed;
+	uint64_t errors;
+	uint64_t retries;
+	uint64_t timeouts;
+	uint64_t stale;		/* responses to requests no longer on wire */
+	int max_on_wire;
+};
+
+MAD_EXPORT struct ibmad_rpc_engine *mad_rpc_engine_open(const struct ibmad_port
+							 *srcport, int window);
+MAD_EXPORT void mad_rpc_engine_close(struct ibmad_rpc_engine *engine);
+/*
+ * Queue an RPC; payload is copied.  At most "window" RPCs are on the wire,
+ * the rest wait in FIFO order.  Completions are delivered from
+ * mad_rpc_engine_poll()/mad_rpc_engine_wait() only.  A non-zero rpc->trid
+ * whose low 32 bits match a queued or outstanding RPC fails with EEXIST.
+ */
+MAD_EXPORT int mad_rpc_async(struct ibmad_rpc_engine *engine, ib_rpc_t * rpc,
+			     ib_portid_t * dport, void *payload,
+			     ib_rpc_async_cb * cb, void *cb_data);
+/* returns the number of RPCs completed, or -1 on a receive error */
+MAD_EXPORT int mad_rpc_engine_poll(struct ibmad_rpc_engine *engine,
+				   int timeout_ms);
+MAD_EXPORT int mad_rpc_engine_wait(struct ibmad_rpc_engine *engine);
+MAD_EXPORT int mad_rpc_engine_outstanding(struct ibmad_rpc_engine *engine);
+MAD_EXPORT void mad_rpc_engine_get_stats(struct ibmad_rpc_engine *engine,
+					 struct ibmad_rpc_engine_stats *stats);
+
 /* register.c */
 MAD_EXPORT int mad_register_port_client(int port_id, int mgmt,
 					uint8_t rmpp_version);
@@ -1299,6 +1344,10 @@ MAD_EXPORT uint8_t *smp_set_status_via(void *data, ib_portid_t * portid,
 				       unsigned attrid, unsigned mod,
 				       unsigned timeout, int *rstatus,
 				       const struct ibmad_port *srcport);
+MAD_EXPORT int smp_query_async_via(struct ibmad_rpc_engine *engine,
+				  ib_portid_t * portid, unsigned attrid,
+				  unsigned mod, unsigned timeout,
+				  ib_rpc_async_cb * cb, void *cb_data);
 
 /* sa.c */
 uint8_t *sa_call(void *rcvbuf, ib_portid_t * portid, ib_sa_call_t * sa,
@@ -1348,6 +1397,10 @@ MAD_EXPORT uint8_t *performance_reset_via(void *rcvbuf, ib_portid_t * dest,
 					  int port, unsigned mask,
 					  unsigned timeout, unsigned id,
 					  const struct ibmad_port *srcport);
+MAD_EXPORT int pma_query_async_via(struct ibmad_rpc_engine *engine,
+				  ib_portid_t * dest, int port,
+				  unsigned timeout, unsigned id,
+				  ib_rpc_async_cb * cb, void *cb_data);
 
 /* bm.c */
 MAD_EXPORT uint8_t *bm_call_via(void *data, ib_portid_t * portid,
@@ -1412,6 +1465,215 @@ static inline uint64_t htonll(uint64_t x)
 #endif
 #endif				/* __BYTE_ORDER == __BIG_ENDIAN */
 
+/*
+ * Specialized field accessors.
+ *
+ * mad_get_field() looks the field up in ib_mad_f[] and resolves its bit
+ * alignment at run time on every call.  For the attributes that the
+ * diagnostics decode in bulk, the lists below describe each field once
+ * (name, bit offset and width as given in the IB spec) and are expanded
+ * into per-field inline accessors with the layout known at compile time,
+ * e.g. mad_portinfo_get_lid(buf) or mad_pc_ext_get_xmt_bytes(buf).
+ * buf points to the attribute data, as for mad_get_field(buf, 0, ...).
+ * Fields narrower than 32 bits never cross a 32 bit word.
+ */
+static inline uint32_t mad_get_bits32(const void *buf, unsigned offs,
+				      unsigned len)
+{
+	uint32_t v;
+
+	memcpy(&v, (const uint8_t *)buf + (offs >> 5) * 4, sizeof(v));
+	v = ntohl(v);
+	if (len == 32)
+		return v;
+	return (v >> (32 - (offs & 31) - len)) & ((1u << len) - 1);
+}
+
+static inline void mad_set_bits32(void *buf, unsigned offs, unsigned len,
+				  uint32_t val)
+{
+	uint8_t *p = (uint8_t *)buf + (offs >> 5) * 4;
+	uint32_t v, mask;
+
+	if (len == 32)
+		v = val;
+	else {
+		memcpy(&v, p, sizeof(v));
+		mask = ((1u << len) - 1) << (32 - (offs & 31) - len);
+		v = (ntohl(v) & ~mask) |
+		    ((val << (32 - (offs & 31) - len)) & mask);
+	}
+	v = htonl(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline uint64_t mad_get_bits64(const void *buf, unsigned offs)
+{
+	uint64_t v;
+
+	memcpy(&v, (const uint8_t *)buf + offs / 8, sizeof(v));
+	return ntohll(v);
+}
+
+static inline void mad_set_bits64(void *buf, unsigned offs, uint64_t val)
+{
+	val = htonll(val);
+	memcpy((uint8_t *)buf + offs / 8, &val, sizeof(val));
+}
+
+/* PortInfo (SMP data) */
+#define MAD_PORTINFO_FIELDS32(F) \
+	F(lid, 128, 16) \
+	F(smlid, 144, 16) \
+	F(capmask, 160, 32) \
+	F(diag_code, 192, 16) \
+	F(mkey_lease, 208, 16) \
+	F(local_port, 224, 8) \
+	F(link_width_enabled, 232, 8) \
+	F(link_width_supported, 240, 8) \
+	F(link_width_active, 248, 8) \
+	F(link_speed_supported, 256, 4) \
+	F(state, 260, 4) \
+	F(phys_state, 264, 4) \
+	F(link_down_def, 268, 4) \
+	F(mkey_prot_bits, 272, 2) \
+	F(lmc, 277, 3) \
+	F(link_speed_active, 280, 4) \
+	F(link_speed_enabled, 284, 4) \
+	F(neighbor_mtu, 288, 4) \
+	F(smsl, 292, 4) \
+	F(vl_cap, 296, 4) \
+	F(init_type, 300, 4) \
+	F(vl_high_limit, 304, 8) \
+	F(vl_arb_high_cap, 312, 8) \
+	F(vl_arb_low_cap, 320, 8) \
+	F(init_type_reply, 328, 4) \
+	F(mtu_cap, 332, 4) \
+	F(vl_stall_count, 336, 3) \
+	F(hoq_life, 339, 5) \
+	F(oper_vls, 344, 4) \
+	F(part_en_inb, 348, 1) \
+	F(part_en_outb, 349, 1) \
+	F(filter_raw_inb, 350, 1) \
+	F(filter_raw_outb, 351, 1) \
+	F(mkey_viol, 352, 16) \
+	F(pkey_viol, 368, 16) \
+	F(qkey_viol, 384, 16) \
+	F(guid_cap, 400, 8) \
+	F(client_rereg, 408, 1) \
+	F(mcast_pkey_supr_enab, 409, 1) \
+	F(subn_timeout, 411, 5) \
+	F(resp_time_val, 419, 5) \
+	F(local_phys_err, 424, 4) \
+	F(overrun_err, 428, 4) \
+	F(max_credit_hint, 432, 16) \
+	F(link_round_trip, 456, 24) \
+	F(capmask2, 480, 16) \
+	F(link_speed_ext_active, 496, 4) \
+	F(link_speed_ext_supported, 500, 4) \
+	F(link_speed_ext_enabled, 507, 5)
+#define MAD_PORTINFO_FIELDS64(F) \
+	F(mkey, 0) \
+	F(gid_prefix, 64)
+
+/* PortCounters (PMA data) */
+#define MAD_PC_FIELDS32(F) \
+	F(port_select, 8, 8) \
+	F(counter_select, 16, 16) \
+	F(err_sym, 32, 16) \
+	F(link_recovers, 48, 8) \
+	F(link_downed, 56, 8) \
+	F(err_rcv, 64, 16) \
+	F(err_physrcv, 80, 16) \
+	F(err_switch_rel, 96, 16) \
+	F(xmt_discards, 112, 16) \
+	F(err_xmtconstr, 128, 8) \
+	F(err_rcvconstr, 136, 8) \
+	F(counter_select2, 144, 8) \
+	F(err_localinteg, 152, 4) \
+	F(err_excess_ovr, 156, 4) \
+	F(vl15_dropped, 176, 16) \
+	F(xmt_bytes, 192, 32) \
+	F(rcv_bytes, 224, 32) \
+	F(xmt_pkts, 256, 32) \
+	F(rcv_pkts, 288, 32) \
+	F(xmt_wait, 320, 32)
+
+/* PortCountersExtended (PMA data) */
+#define MAD_PC_EXT_FIELDS32(F) \
+	F(port_select, 8, 8) \
+	F(counter_select, 16, 16)
+#define MAD_PC_EXT_FIELDS64(F) \
+	F(xmt_bytes, 64) \
+	F(rcv_bytes, 128) \
+	F(xmt_pkts, 192) \
+	F(rcv_pkts, 256) \
+	F(xmt_upkts, 320) \
+	F(rcv_upkts, 384) \
+	F(xmt_mpkts, 448) \
+	F(rcv_mpkts, 512)
+
+#define MAD_DEF_ACCESSORS32(attr, name, offs, len) \
+static inline uint32_t mad_##attr##_get_##name(const void *buf) \
+{ \
+	return mad_get_bits32(buf, offs, len); \
+} \
+static inline void mad_##attr##_set_##name(void *buf, uint32_t val) \
+{ \
+	mad_set_bits32(buf, offs, len, val); \
+}
+
+#define MAD_DEF_ACCESSORS64(attr, name, offs) \
+static inline uint64_t mad_##attr##_get_##name(const void *buf) \
+{ \
+	return mad_get_bits64(buf, offs); \
+} \
+static inline void mad_##attr##_set_##name(void *buf, uint64_t val) \
+{ \
+	mad_set_bits64(buf, offs, val); \
+}
+
+#define MAD_PORTINFO_ACC32(name, offs, len) \
+	MAD_DEF_ACCESSORS32(portinfo, name, offs, len)
+#define MAD_PORTINFO_ACC64(name, offs) \
+	MAD_DEF_ACCESSORS64(portinfo, name, offs)
+#define MAD_PC_ACC32(name, offs, len) \
+	MAD_DEF_ACCESSORS32(pc, name, offs, len)
+#define MAD_PC_EXT_ACC32(name, offs, len) \
+	MAD_DEF_ACCESSORS32(pc_ext, name, offs, len)
+#define MAD_PC_EXT_ACC64(name, offs) \
+	MAD_DEF_ACCESSORS64(pc_ext, name, offs)
+
+MAD_PORTINFO_FIELDS32(MAD_PORTINFO_ACC32)
+MAD_PORTINFO_FIELDS64(MAD_PORTINFO_ACC64)
+MAD_PC_FIELDS32(MAD_PC_ACC32)
+MAD_PC_EXT_FIELDS32(MAD_PC_EXT_ACC32)
+MAD_PC_EXT_FIELDS64(MAD_PC_EXT_ACC64)
+
+/* Whole attributes decoded in one pass, see mad_decode_*() in fields.c */
+#define MAD_MEMBER32(name, offs, len)	uint32_t name;
+#define MAD_MEMBER64(name, offs)	uint64_t name;
+
+typedef struct ibmad_portinfo {
+	MAD_PORTINFO_FIELDS64(MAD_MEMBER64)
+	MAD_PORTINFO_FIELDS32(MAD_MEMBER32)
+} ibmad_portinfo_t;
+
+typedef struct ibmad_port_counters {
+	MAD_PC_FIELDS32(MAD_MEMBER32)
+} ibmad_port_counters_t;
+
+typedef struct ibmad_port_counters_ext {
+	MAD_PC_EXT_FIELDS64(MAD_MEMBER64)
+	MAD_PC_EXT_FIELDS32(MAD_MEMBER32)
+} ibmad_port_counters_ext_t;
+
+MAD_EXPORT void mad_decode_portinfo(const void *buf, ibmad_portinfo_t * pi);
+MAD_EXPORT void mad_decode_port_counters(const void *buf,
+					 ibmad_port_counters_t * pc);
+MAD_EXPORT void mad_decode_port_counters_ext(const void *buf,
+					     ibmad_port_counters_ext_t * pc);
+
 /* Misc. macros: */
 /** align value \a l to \a size (ceil) */
 #define ALIGN(l, size) (((l) + ((size) - 1)) / (size) * (size))
@@ -960,6 +960,54 @@ void mad_encode_field(uint8_t * buf, enum MAD_FIELDS field, void *val)
 
 /************************/
 
+/*
+ * Bulk decoders: byte swap the attribute once, then extract every field
+ * from the host order words with compile time shifts and masks.
+ */
+static void _load_words(const void *buf, uint32_t * w, int nwords)
+{
+	const uint8_t *p = (const uint8_t *)buf;
+	int i;
+
+	for (i = 0; i < nwords; i++, p += 4)
+		w[i] = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+		    ((uint32_t) p[2] << 8) | p[3];
+}
+
+#define WORD_MASK(len)	((len) == 32 ? ~0u : (1u << ((len) & 31)) - 1)
+#define DECODE32(name, offs, len) \
+	out->name = (w[(offs) >> 5] >> ((32 - ((offs) & 31) - (len)) & 31)) & \
+		    WORD_MASK(len);
+#define DECODE64(name, offs) \
+	out->name = ((uint64_t) w[(offs) >> 5] << 32) | w[((offs) >> 5) + 1];
+
+void mad_decode_portinfo(const void *buf, ibmad_portinfo_t * out)
+{
+	uint32_t w[IB_SMP_DATA_SIZE / 4];
+
+	_load_words(buf, w, IB_SMP_DATA_SIZE / 4);
+	MAD_PORTINFO_FIELDS64(DECODE64)
+	MAD_PORTINFO_FIELDS32(DECODE32)
+}
+
+void mad_decode_port_counters(const void *buf, ibmad_port_counters_t * out)
+{
+	uint32_t w[11];
+
+	_load_words(buf, w, 11);
+	MAD_PC_FIELDS32(DECODE32)
+}
+
+void mad_decode_port_counters_ext(const void *buf,
+				  ibmad_port_counters_ext_t * out)
+{
+	uint32_t w[18];
+
+	_load_words(buf, w, 18);
+	MAD_PC_EXT_FIELDS64(DECODE64)
+	MAD_PC_EXT_FIELDS32(DECODE32)
+}
+
 static char *_mad_dump_val(const ib_field_t * f, char *buf, int bufsz,
 			   void *val)
 {
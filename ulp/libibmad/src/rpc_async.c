@@ -0,0 +1,500 @@
+/*
+ * Copyright (c) 2004-2009 Voltaire Inc.  All rights reserved.
+ * Copyright (c) 2009 HNR Consulting.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Pipelined (asynchronous) MAD RPC engine.
+ *
+ * Requests are queued on the engine and put on the wire while fewer than
+ * "window" requests are outstanding.  Outstanding requests are indexed by
+ * the low 32 bits of their TID so a response is matched in O(log n)
+ * regardless of how many queries are in flight.  Each request carries its
+ * own timeout and retry budget; a timed out request is resent with the
+ * same TID, exactly like _do_madrpc() does for the synchronous path.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+#include <complib/cl_qmap.h>
+#include <complib/cl_timer.h>
+
+#include "mad_internal.h"
+
+#undef DEBUG
+#define DEBUG	if (ibdebug)	IBWARN
+
+#define MAD_RPC_DEF_WINDOW	64
+#define MAD_RPC_MAX_REDIRECTS	1
+
+typedef struct ibmad_rpc_req {
+	cl_map_item_t on_wire;	/* must be first */
+	struct ibmad_rpc_req *qnext;
+	ib_rpc_t rpc;
+	ib_portid_t dport;
+	uint8_t payload[IB_MAD_SIZE];
+	int has_payload;
+	int timeout;
+	int retries;
+	int redirects;
+	int error;		/* for requests on the done list */
+	uint64_t deadline;	/* usec, local safety net */
+	ib_rpc_async_cb *cb;
+	void *cb_data;
+} ibmad_rpc_req_t;
+
+struct ibmad_rpc_engine {
+	const struct ibmad_port *srcport;
+	int window;
+	int max_retries;
+	ibmad_rpc_req_t *queue_head;
+	ibmad_rpc_req_t *queue_tail;
+	int queued;
+	ibmad_rpc_req_t *done_head;	/* failed before reaching the wire */
+	ibmad_rpc_req_t *done_tail;
+	int done;
+	cl_qmap_t on_wire;
+	uint64_t next_deadline;	/* earliest deadline in on_wire, usec */
+	struct ibmad_rpc_engine_stats stats;
+};
+
+static void queue_req(struct ibmad_rpc_engine *engine, ibmad_rpc_req_t * req)
+{
+	req->qnext = NULL;
+	if (!engine->queue_head)
+		engine->queue_head = req;
+	else
+		engine->queue_tail->qnext = req;
+	engine->queue_tail = req;
+	engine->queued++;
+}
+
+static ibmad_rpc_req_t *dequeue_req(struct ibmad_rpc_engine *engine)
+{
+	ibmad_rpc_req_t *req = engine->queue_head;
+
+	if (req) {
+		engine->queue_head = req->qnext;
+		if (!engine->queue_head)
+			engine->queue_tail = NULL;
+		engine->queued--;
+	}
+	return req;
+}
+
+/* Completions are only delivered from poll, so failures are parked here */
+static void fail_req(struct ibmad_rpc_engine *engine, ibmad_rpc_req_t * req,
+		     int error)
+{
+	req->error = error;
+	req->qnext = NULL;
+	if (!engine->done_head)
+		engine->done_head = req;
+	else
+		engine->done_tail->qnext = req;
+	engine->done_tail = req;
+	engine->done++;
+}
+
+static int send_req(struct ibmad_rpc_engine *engine, ibmad_rpc_req_t * req)
+{
+	uint8_t sndbuf[1024];
+	int agent, len;
+
+	agent = engine->srcport->class_agents[req->rpc.mgtclass & 0xff];
+	if (agent < 0) {
+		IBWARN("class 0x%x not registered on port",
+		       req->rpc.mgtclass & 0xff);
+		return -EINVAL;
+	}
+
+	memset(sndbuf, 0, umad_size() + IB_MAD_SIZE);
+	if ((len = mad_build_pkt(sndbuf, &req->rpc, &req->dport, NULL,
+				 req->has_payload ? req->payload : NULL)) < 0)
+		return -EINVAL;
+
+	if (ibdebug > 1) {
+		IBWARN(">>> sending: len %d pktsz %zu", len, umad_size() + len);
+		xdump(stderr, "send buf\n", sndbuf, umad_size() + len);
+	}
+
+	if (umad_send(engine->srcport->port_id, agent, sndbuf, len,
+		      req->timeout, 0) < 0) {
+		IBWARN("send failed; %m");
+		return -EIO;
+	}
+
+	/* the stack reports the timeout; this only catches a lost report */
+	req->deadline = cl_get_time_stamp() + (uint64_t) req->timeout * 2000;
+	if (req->deadline < engine->next_deadline)
+		engine->next_deadline = req->deadline;
+	return 0;
+}
+
+static void complete_req(struct ibmad_rpc_engine *engine,
+			 ibmad_rpc_req_t * req, uint8_t * mad, int error)
+{
+	if (error)
+		engine->stats.errors++;
+	else
+		engine->stats.completed++;
+	if (req->cb)
+		req->cb(engine, &req->rpc, &req->dport, mad, error,
+			req->cb_data);
+	free(req);
+}
+
+static void complete_done(struct ibmad_rpc_engine *engine)
+{
+	ibmad_rpc_req_t *req;
+
+	while ((req = engine->done_head) != NULL) {
+		engine->done_head = req->qnext;
+		if (!engine->done_head)
+			engine->done_tail = NULL;
+		engine->done--;
+		complete_req(engine, req, NULL, req->error);
+	}
+}
+
+static void fill_window(struct ibmad_rpc_engine *engine)
+{
+	ibmad_rpc_req_t *req;
+	int rc;
+
+	while ((int)cl_qmap_count(&engine->on_wire) < engine->window) {
+		req = dequeue_req(engine);
+		if (!req)
+			break;
+
+		/* a reused TID would shadow the request already on the wire */
+		if (cl_qmap_get(&engine->on_wire, (uint32_t) req->rpc.trid) !=
+		    cl_qmap_end(&engine->on_wire)) {
+			IBWARN("trid 0x%x already outstanding",
+			       (uint32_t) req->rpc.trid);
+			fail_req(engine, req, EEXIST);
+			continue;
+		}
+
+		if ((rc = send_req(engine, req)) < 0) {
+			fail_req(engine, req, -rc);
+			continue;
+		}
+		cl_qmap_insert(&engine->on_wire, (uint32_t) req->rpc.trid,
+			       &req->on_wire);
+		engine->stats.sent++;
+		if ((int)cl_qmap_count(&engine->on_wire) > engine->stats.max_on_wire)
+			engine->stats.max_on_wire =
+			    (int)cl_qmap_count(&engine->on_wire);
+	}
+}
+
+/* Resend a request that is already in the on-wire map, keeping its TID */
+static void retry_req(struct ibmad_rpc_engine *engine, ibmad_rpc_req_t * req,
+		      int error)
+{
+	int rc;
+
+	if (++req->retries >= engine->max_retries) {
+		DEBUG("timeout after %d retries, %d ms", req->retries,
+		      req->timeout * req->retries);
+		cl_qmap_remove_item(&engine->on_wire, &req->on_wire);
+		complete_req(engine, req, NULL, error);
+		return;
+	}
+
+	DEBUG("retry %d (timeout %d ms) dport (%s)", req->retries,
+	      req->timeout, portid2str(&req->dport));
+	engine->stats.retries++;
+	if ((rc = send_req(engine, req)) < 0) {
+		cl_qmap_remove_item(&engine->on_wire, &req->on_wire);
+		complete_req(engine, req, NULL, -rc);
+	}
+}
+
+static int redirect_req(ibmad_rpc_req_t * req, uint8_t * mad)
+{
+	ib_portid_t *port = &req->dport;
+
+	port->lid = mad_get_field(mad, 64, IB_CPI_REDIRECT_LID_F);
+	if (!port->lid) {
+		IBWARN("GID-based redirection is not supported");
+		return -1;
+	}
+
+	port->qp = mad_get_field(mad, 64, IB_CPI_REDIRECT_QP_F);
+	port->qkey = mad_get_field(mad, 64, IB_CPI_REDIRECT_QKEY_F);
+	port->sl = (uint8_t) mad_get_field(mad, 64, IB_CPI_REDIRECT_SL_F);
+
+	DEBUG("redirected to lid %d, qp 0x%x, qkey 0x%x, sl 0x%x",
+	      port->lid, port->qp, port->qkey, port->sl);
+	return 0;
+}
+
+static void process_recv(struct ibmad_rpc_engine *engine, uint8_t * umad)
+{
+	ibmad_rpc_req_t *req;
+	uint8_t *mad = umad_get_mad(umad);
+	uint32_t trid;
+	int status;
+
+	trid = (uint32_t) mad_get_field64(mad, 0, IB_MAD_TRID_F);
+	req = (ibmad_rpc_req_t *) cl_qmap_get(&engine->on_wire, trid);
+	if ((cl_map_item_t *) req == cl_qmap_end(&engine->on_wire)) {
+		DEBUG("dropping MAD with unknown trid 0x%x", trid);
+		engine->stats.stale++;
+		return;
+	}
+
+	if (ibdebug > 1) {
+		IBWARN("rcv buf:");
+		xdump(stderr, "rcv buf\n", mad, IB_MAD_SIZE);
+	}
+
+	status = umad_status(umad);
+	if (status == ETIMEDOUT) {
+		engine->stats.timeouts++;
+		retry_req(engine, req, ETIMEDOUT);
+		return;
+	}
+
+	cl_qmap_remove_item(&engine->on_wire, &req->on_wire);
+	if (status && status != ENOMEM) {
+		complete_req(engine, req, NULL, status);
+		return;
+	}
+
+	status = mad_get_field(mad, 0, IB_DRSMP_STATUS_F);
+	/* past the limit a redirect completes with EIO like other statuses */
+	if (status == IB_MAD_STS_REDIRECT &&
+	    req->redirects < MAD_RPC_MAX_REDIRECTS && !redirect_req(req, mad)) {
+		/* requeue at the tail; it keeps its TID */
+		req->redirects++;
+		req->retries = 0;
+		queue_req(engine, req);
+		return;
+	}
+
+	req->rpc.rstatus = status;
+	if (status != 0) {
+		DEBUG("MAD completed with error status 0x%x; dport (%s)",
+		      status, portid2str(&req->dport));
+		complete_req(engine, req, mad, EIO);
+		return;
+	}
+
+	if (req->rpc.mgtclass == IB_SA_CLASS)
+		req->rpc.recsz = mad_get_field(mad, 0, IB_SA_ATTROFFS_F);
+	complete_req(engine, req, mad, 0);
+}
+
+/*
+ * Timeouts the stack never reported; resend or fail them.  Cheap to call
+ * on every receive: nothing is scanned until the earliest deadline passes.
+ */
+static void expire_reqs(struct ibmad_rpc_engine *engine)
+{
+	cl_map_item_t *item, *next;
+	uint64_t now = cl_get_time_stamp();
+
+	if (now < engine->next_deadline)
+		return;
+
+	engine->next_deadline = (uint64_t) - 1;
+	for (item = cl_qmap_head(&engine->on_wire);
+	     item != cl_qmap_end(&engine->on_wire); item = next) {
+		next = cl_qmap_next(item);
+		if (((ibmad_rpc_req_t *) item)->deadline <= now) {
+			engine->stats.timeouts++;
+			retry_req(engine, (ibmad_rpc_req_t *) item, ETIMEDOUT);
+		}
+	}
+
+	/* resends above lowered next_deadline; account for the rest */
+	for (item = cl_qmap_head(&engine->on_wire);
+	     item != cl_qmap_end(&engine->on_wire); item = cl_qmap_next(item))
+		if (((ibmad_rpc_req_t *) item)->deadline < engine->next_deadline)
+			engine->next_deadline =
+			    ((ibmad_rpc_req_t *) item)->deadline;
+}
+
+static int req_queued(struct ibmad_rpc_engine *engine, uint32_t trid)
+{
+	ibmad_rpc_req_t *req;
+
+	for (req = engine->queue_head; req; req = req->qnext)
+		if ((uint32_t) req->rpc.trid == trid)
+			return 1;
+	return 0;
+}
+
+struct ibmad_rpc_engine *mad_rpc_engine_open(const struct ibmad_port *srcport,
+					     int window)
+{
+	struct ibmad_rpc_engine *engine;
+
+	engine = calloc(1, sizeof(*engine));
+	if (!engine) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	engine->srcport = srcport;
+	engine->window = window > 0 ? window : MAD_RPC_DEF_WINDOW;
+	engine->max_retries = mad_get_retries(srcport);
+	engine->next_deadline = (uint64_t) - 1;
+	cl_qmap_init(&engine->on_wire);
+	return engine;
+}
+
+void mad_rpc_engine_close(struct ibmad_rpc_engine *engine)
+{
+	ibmad_rpc_req_t *req;
+	cl_map_item_t *item;
+
+	complete_done(engine);
+	while ((req = dequeue_req(engine)) != NULL)
+		complete_req(engine, req, NULL, ECANCELED);
+
+	while ((item = cl_qmap_head(&engine->on_wire)) !=
+	       cl_qmap_end(&engine->on_wire)) {
+		cl_qmap_remove_item(&engine->on_wire, item);
+		complete_req(engine, (ibmad_rpc_req_t *) item, NULL, ECANCELED);
+	}
+
+	free(engine);
+}
+
+int mad_rpc_async(struct ibmad_rpc_engine *engine, ib_rpc_t * rpc,
+		  ib_portid_t * dport, void *payload, ib_rpc_async_cb * cb,
+		  void *cb_data)
+{
+	ibmad_rpc_req_t *req;
+
+	if (rpc->datasz > IB_MAD_SIZE - rpc->dataoffs) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* responses are matched by TID; a caller supplied one must be unique */
+	if (rpc->trid &&
+	    (cl_qmap_get(&engine->on_wire, (uint32_t) rpc->trid) !=
+	     cl_qmap_end(&engine->on_wire) ||
+	     req_queued(engine, (uint32_t) rpc->trid))) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	req = calloc(1, sizeof(*req));
+	if (!req) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	req->rpc = *rpc;
+	req->rpc.mgtclass &= 0xff;
+	if (!req->rpc.trid)
+		req->rpc.trid = mad_trid();
+	req->dport = *dport;
+	if (payload && rpc->datasz) {
+		memcpy(req->payload, payload, rpc->datasz);
+		req->has_payload = 1;
+	}
+	req->timeout = mad_get_timeout(engine->srcport, rpc->timeout);
+	req->cb = cb;
+	req->cb_data = cb_data;
+
+	queue_req(engine, req);
+	fill_window(engine);
+	return 0;
+}
+
+int mad_rpc_engine_poll(struct ibmad_rpc_engine *engine, int timeout_ms)
+{
+	uint8_t umad[1024];
+	int length, rc, done = 0;
+	uint64_t completed = engine->stats.completed + engine->stats.errors;
+
+	fill_window(engine);
+	complete_done(engine);
+	while (!cl_is_qmap_empty(&engine->on_wire)) {
+		length = IB_MAD_SIZE;
+		rc = umad_recv(engine->srcport->port_id, umad, &length,
+			       done ? 0 : timeout_ms);
+		if (rc < 0) {
+			if (rc != -EWOULDBLOCK && rc != -ETIMEDOUT) {
+				IBWARN("recv failed: %m");
+				return -1;
+			}
+			expire_reqs(engine);
+			break;
+		}
+		process_recv(engine, umad);
+		/* a steady flow of responses must not starve the expiry check */
+		expire_reqs(engine);
+		done = 1;
+	}
+	fill_window(engine);
+	complete_done(engine);
+
+	return (int)(engine->stats.completed + engine->stats.errors -
+		     completed);
+}
+
+int mad_rpc_engine_wait(struct ibmad_rpc_engine *engine)
+{
+	while (mad_rpc_engine_outstanding(engine))
+		if (mad_rpc_engine_poll(engine, madrpc_timeout) < 0)
+			return -1;
+	return 0;
+}
+
+int mad_rpc_engine_outstanding(struct ibmad_rpc_engine *engine)
+{
+	return (int)cl_qmap_count(&engine->on_wire) + engine->queued +
+	    engine->done;
+}
+
+void mad_rpc_engine_get_stats(struct ibmad_rpc_engine *engine,
+			      struct ibmad_rpc_engine_stats *stats)
+{
+	*stats = engine->stats;
+}
@@ -135,3 +135,30 @@ uint8_t *smp_query(void *rcvbuf, ib_portid_t * portid, unsigned attrid,
 {
 	return smp_query_via(rcvbuf, portid, attrid, mod, timeout, ibmp);
 }
+
+int smp_query_async_via(struct ibmad_rpc_engine *engine, ib_portid_t * portid,
+			unsigned attrid, unsigned mod, unsigned timeout,
+			ib_rpc_async_cb * cb, void *cb_data)
+{
+	ib_rpc_t rpc = { 0 };
+
+	DEBUG("attr 0x%x mod 0x%x route %s", attrid, mod, portid2str(portid));
+	rpc.method = IB_MAD_METHOD_GET;
+	rpc.attr.id = attrid;
+	rpc.attr.mod = mod;
+	rpc.timeout = timeout;
+	rpc.datasz = IB_SMP_DATA_SIZE;
+	rpc.dataoffs = IB_SMP_DATA_OFFS;
+
+	if ((portid->lid <= 0) ||
+	    (portid->drpath.drslid == 0xffff) ||
+	    (portid->drpath.drdlid == 0xffff))
+		rpc.mgtclass = IB_SMI_DIRECT_CLASS;	/* direct SMI */
+	else
+		rpc.mgtclass = IB_SMI_CLASS;	/* Lid routed SMI */
+
+	portid->sl = 0;
+	portid->qp = 0;
+
+	return mad_rpc_async(engine, &rpc, portid, NULL, cb, cb_data);
+}
@@ -171,6 +171,7 @@ typedef struct ibnd_fabric {
 	ibnd_node_t *switches;
 	ibnd_node_t *ch_adapters;
 	ibnd_node_t *routers;
+	struct ibnd_cache *cache;	/* set if loaded from a mapped cache */
 } ibnd_fabric_t;
 
 /** =========================================================================
@@ -198,6 +199,40 @@ IBND_EXPORT int ibnd_cache_fabric(ibnd_fabric_t * fabric, const char *file,
 
 #define IBND_CACHE_FABRIC_FLAG_DEFAULT      0x0000
 #define IBND_CACHE_FABRIC_FLAG_NO_OVERWRITE 0x0001
+#define IBND_CACHE_FABRIC_FLAG_MAPPED       0x0002
+	/**
+	 * By default caches are written in the version 1 format.
+	 * IBND_CACHE_FABRIC_FLAG_MAPPED writes the mapped (version 2) format
+	 * used by ibnd_open_cache; older readers cannot load it.
+	 * ibnd_load_fabric reads either.
+	 */
+
+/** =========================================================================
+ * Mapped cache queries
+ * Look up nodes and ports in a mapped cache file without rebuilding the
+ * fabric.  Results are copies; pointer members are left NULL.
+ */
+typedef struct ibnd_cache ibnd_cache_t;
+
+typedef struct ibnd_cache_port {
+	ibnd_port_t port;	/* port.node and port.remoteport are NULL */
+	uint64_t node_guid;
+	uint64_t remote_guid;	/* 0 if no remote port */
+	int remote_portnum;
+} ibnd_cache_port_t;
+
+IBND_EXPORT ibnd_cache_t *ibnd_open_cache(const char *file);
+IBND_EXPORT void ibnd_close_cache(ibnd_cache_t * cache);
+IBND_EXPORT int ibnd_cache_find_node_guid(ibnd_cache_t * cache,
+					 uint64_t guid, ibnd_node_t * node);
+IBND_EXPORT int ibnd_cache_find_port_guid(ibnd_cache_t * cache,
+					 uint64_t guid, int portnum,
+					 ibnd_cache_port_t * port);
+	/**
+	 * portnum: port to look up, or -1 for the lowest numbered port
+	 *          with this guid
+	 * returns 0 if found, -1 otherwise
+	 */
 
 /** =========================================================================
  * Node operations
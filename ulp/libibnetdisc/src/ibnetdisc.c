@@ -597,6 +597,9 @@ ibnd_node_t *ibnd_find_node_guid(ibnd_fabric_t * fabric, uint64_t guid)
 		return NULL;
 	}
 
+	if (fabric->cache)
+		return mapped_find_node_guid(fabric, guid);
+
 	for (node = fabric->nodestbl[hash]; node; node = node->htnext)
 		if (node->guid == guid)
 			return node;
@@ -759,6 +762,11 @@ void ibnd_destroy_fabric(ibnd_fabric_t * fabric)
 		free(ch);
 		ch = ch_next;
 	}
+	if (fabric->cache) {
+		destroy_mapped_fabric(fabric);
+		free(fabric);
+		return;
+	}
 	node = fabric->nodes;
 	while (node) {
 		next = node->next;
@@ -832,6 +840,9 @@ ibnd_port_t *ibnd_find_port_guid(ibnd_fabric_t * fabric, uint64_t guid)
 		return NULL;
 	}
 
+	if (fabric->cache)
+		return mapped_find_port_guid(fabric, guid);
+
 	for (port = fabric->portstbl[hash]; port; port = port->htnext)
 		if (port->guid == guid)
 			return port;
@@ -895,6 +906,11 @@ void ibnd_iter_ports(ibnd_fabric_t * fabric, ibnd_iter_port_func_t func,
 		return;
 	}
 
+	if (fabric->cache) {
+		mapped_iter_ports(fabric, func, user_data);
+		return;
+	}
+
 	for (i = 0; i<HTSZ; i++)
 		for (cur = fabric->portstbl[i]; cur; cur = cur->htnext)
 			func(cur, user_data);
@@ -47,6 +47,9 @@
 #include <string.h>
 #include <errno.h>
 #include <inttypes.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #include <infiniband/ibnetdisc.h>
 
@@ -98,6 +101,62 @@
  * 1 byte - port num remotely connected to
  */
 
+/* Mapped cache format (version 2)
+ *
+ * The version 2 format is made of fixed size records so the file can be
+ * mapped and queried in place.  Records reference each other by index,
+ * never by pointer, so the image is fully relocatable.  All sections
+ * start on an 8 byte boundary.
+ *
+ * Header (IBND_MAPPED_HEADER_LEN bytes)
+ *
+ * Bytes 1-28 - same as the version 1 header (version number is 2)
+ * Bytes 29-32 - header length
+ * Bytes 33-36 - offset of node records
+ * Bytes 37-40 - offset of port records
+ * Bytes 41-44 - offset of node index
+ * Bytes 45-48 - offset of port index
+ * Bytes 49-52 - total file length
+ * Bytes 53-64 - reserved
+ *
+ * Nodes are stored as (IBND_MAPPED_NODE_LEN bytes)
+ *
+ * 8 bytes - guid
+ * 2 bytes - smalid
+ * 1 byte - smalmc
+ * 1 byte - smaenhsp0 flag
+ * 1 byte - type
+ * 1 byte - numports
+ * 2 bytes - number of ports stored
+ * 4 bytes - index of first port record, the ports of a node are contiguous
+ * 4 bytes - reserved
+ * IB_SMP_DATA_SIZE bytes - switchinfo
+ * IB_SMP_DATA_SIZE bytes - info
+ * IB_SMP_DATA_SIZE bytes - nodedesc
+ *
+ * Ports are stored as (IBND_MAPPED_PORT_LEN bytes)
+ *
+ * 8 bytes - guid
+ * 4 bytes - index of the node record port "owned" by
+ * 4 bytes - index of the remote port record, IBND_MAPPED_NO_INDEX if none
+ * 1 byte - portnum
+ * 1 byte - external portnum
+ * 2 bytes - base lid
+ * 1 byte - lmc
+ * 3 bytes - reserved
+ * IB_SMP_DATA_SIZE bytes - info
+ * IB_SMP_DATA_SIZE bytes - ext_info
+ *
+ * The node and port indexes are arrays of (IBND_MAPPED_INDEX_LEN bytes)
+ *
+ * 8 bytes - guid
+ * 4 bytes - record index
+ * 1 byte - portnum (0 in the node index)
+ * 3 bytes - reserved
+ *
+ * sorted by guid, then portnum, so a lookup is a binary search.
+ */
+
 /* Structs that hold cache info temporarily before
  * the real structs can be reconstructed.
  */
@@ -146,6 +205,33 @@ typedef struct ibnd_fabric_cache {
 #define IBND_PORT_CACHE_KEY_LEN        (8 + 1)
 #define IBND_PORT_CACHE_LEN            (31 + IB_SMP_DATA_SIZE)
 
+#define IBND_FABRIC_CACHE_VERSION_MAPPED 0x00000002
+
+#define IBND_MAPPED_HEADER_LEN  (64)
+#define IBND_MAPPED_NODE_LEN    (24 + IB_SMP_DATA_SIZE*3)
+#define IBND_MAPPED_PORT_LEN    (24 + IB_SMP_DATA_SIZE*2)
+#define IBND_MAPPED_INDEX_LEN   (16)
+#define IBND_MAPPED_NO_INDEX    0xFFFFFFFF
+
+struct ibnd_cache {
+	int fd;
+	void *map_handle;
+	uint8_t *base;
+	size_t len;
+	uint64_t from_node_guid;
+	unsigned maxhops_discovered;
+	uint32_t node_count;
+	uint32_t port_count;
+	uint8_t *nodes;
+	uint8_t *ports;
+	uint8_t *node_index;
+	uint8_t *port_index;
+	/* records of a fabric loaded from this cache */
+	ibnd_node_t *node_recs;
+	ibnd_port_t *port_recs;
+	ibnd_port_t **port_ptrs;
+};
+
 static ssize_t ibnd_read(int fd, void *buf, size_t count)
 {
 	size_t count_done = 0;
@@ -219,6 +305,33 @@ static size_t _unmarshall_buf(const void *inbuf, void *outbuf, unsigned int len)
 	return len;
 }
 
+/* Returns the cache version and leaves fd positioned at the start */
+static int64_t _load_cache_version(int fd)
+{
+	uint8_t buf[IBND_FABRIC_CACHE_BUFLEN];
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	size_t offset = 0;
+
+	if (ibnd_read(fd, buf, 8) < 0)
+		return -1;
+
+	offset += _unmarshall32(buf + offset, &magic);
+	offset += _unmarshall32(buf + offset, &version);
+
+	if (magic != IBND_FABRIC_CACHE_MAGIC) {
+		IBND_DEBUG("invalid fabric cache file\n");
+		return -1;
+	}
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		IBND_DEBUG("lseek: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return version;
+}
+
 static int _load_header_info(int fd, ibnd_fabric_cache_t * fabric_cache,
 			     unsigned int *node_count, unsigned int *port_count)
 {
@@ -607,6 +720,451 @@ static int _rebuild_ports(ibnd_fabric_cache_t * fabric_cache)
 	return 0;
 }
 
+#ifdef _WIN32
+static void *ibnd_map_file(int fd, size_t len, void **handle)
+{
+	HANDLE map;
+	void *base;
+
+	map = CreateFileMapping((HANDLE) _get_osfhandle(fd), NULL,
+				PAGE_READONLY, 0, 0, NULL);
+	if (!map) {
+		IBND_DEBUG("CreateFileMapping: %lu\n", GetLastError());
+		return NULL;
+	}
+
+	base = MapViewOfFile(map, FILE_MAP_READ, 0, 0, len);
+	if (!base) {
+		IBND_DEBUG("MapViewOfFile: %lu\n", GetLastError());
+		CloseHandle(map);
+		return NULL;
+	}
+
+	*handle = map;
+	return base;
+}
+
+static void ibnd_unmap_file(void *base, size_t len, void *handle)
+{
+	UnmapViewOfFile(base);
+	CloseHandle((HANDLE) handle);
+}
+#else
+static void *ibnd_map_file(int fd, size_t len, void **handle)
+{
+	void *base;
+
+	base = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		IBND_DEBUG("mmap: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	*handle = NULL;
+	return base;
+}
+
+static void ibnd_unmap_file(void *base, size_t len, void *handle)
+{
+	munmap(base, len);
+}
+#endif
+
+static int _check_section(ibnd_cache_t * cache, uint32_t offset,
+			  uint32_t count, unsigned int reclen)
+{
+	if (offset > cache->len || offset % 8) {
+		IBND_DEBUG("Cache invalid: bad section offset %u\n", offset);
+		return -1;
+	}
+
+	if ((uint64_t) count * reclen > cache->len - offset) {
+		IBND_DEBUG("Cache invalid: section at %u truncated\n", offset);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _map_header_info(ibnd_cache_t * cache)
+{
+	uint8_t *buf = cache->base;
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint32_t header_len, node_off, port_off, node_idx_off, port_idx_off;
+	uint32_t file_len;
+	size_t offset = 0;
+	uint32_t tmp32;
+
+	if (cache->len < IBND_MAPPED_HEADER_LEN) {
+		IBND_DEBUG("invalid fabric cache file\n");
+		return -1;
+	}
+
+	offset += _unmarshall32(buf + offset, &magic);
+	if (magic != IBND_FABRIC_CACHE_MAGIC) {
+		IBND_DEBUG("invalid fabric cache file\n");
+		return -1;
+	}
+
+	offset += _unmarshall32(buf + offset, &version);
+	if (version != IBND_FABRIC_CACHE_VERSION_MAPPED) {
+		IBND_DEBUG("invalid fabric cache version\n");
+		return -1;
+	}
+
+	offset += _unmarshall32(buf + offset, &cache->node_count);
+	offset += _unmarshall32(buf + offset, &cache->port_count);
+	offset += _unmarshall64(buf + offset, &cache->from_node_guid);
+	offset += _unmarshall32(buf + offset, &tmp32);
+	cache->maxhops_discovered = tmp32;
+	offset += _unmarshall32(buf + offset, &header_len);
+	offset += _unmarshall32(buf + offset, &node_off);
+	offset += _unmarshall32(buf + offset, &port_off);
+	offset += _unmarshall32(buf + offset, &node_idx_off);
+	offset += _unmarshall32(buf + offset, &port_idx_off);
+	offset += _unmarshall32(buf + offset, &file_len);
+
+	if (header_len < IBND_MAPPED_HEADER_LEN || file_len != cache->len) {
+		IBND_DEBUG("Cache invalid: bad header or file length\n");
+		return -1;
+	}
+
+	if (_check_section(cache, node_off, cache->node_count,
+			   IBND_MAPPED_NODE_LEN) < 0
+	    || _check_section(cache, port_off, cache->port_count,
+			      IBND_MAPPED_PORT_LEN) < 0
+	    || _check_section(cache, node_idx_off, cache->node_count,
+			      IBND_MAPPED_INDEX_LEN) < 0
+	    || _check_section(cache, port_idx_off, cache->port_count,
+			      IBND_MAPPED_INDEX_LEN) < 0)
+		return -1;
+
+	cache->nodes = buf + node_off;
+	cache->ports = buf + port_off;
+	cache->node_index = buf + node_idx_off;
+	cache->port_index = buf + port_idx_off;
+
+	return 0;
+}
+
+static ibnd_cache_t *_map_cache(int fd)
+{
+	ibnd_cache_t *cache;
+	off_t len;
+
+	cache = (ibnd_cache_t *) malloc(sizeof(ibnd_cache_t));
+	if (!cache) {
+		IBND_DEBUG("OOM: cache\n");
+		return NULL;
+	}
+	memset(cache, '\0', sizeof(ibnd_cache_t));
+	cache->fd = fd;
+
+	if ((len = lseek(fd, 0, SEEK_END)) < 0) {
+		IBND_DEBUG("lseek: %s\n", strerror(errno));
+		goto cleanup;
+	}
+	cache->len = (size_t) len;
+
+	if (cache->len < IBND_MAPPED_HEADER_LEN) {
+		IBND_DEBUG("invalid fabric cache file\n");
+		goto cleanup;
+	}
+
+	cache->base = ibnd_map_file(fd, cache->len, &cache->map_handle);
+	if (!cache->base)
+		goto cleanup;
+
+	if (_map_header_info(cache) < 0)
+		goto cleanup;
+
+	return cache;
+
+cleanup:
+	if (cache->base)
+		ibnd_unmap_file(cache->base, cache->len, cache->map_handle);
+	free(cache);
+	return NULL;
+}
+
+static void _unmap_cache(ibnd_cache_t * cache)
+{
+	ibnd_unmap_file(cache->base, cache->len, cache->map_handle);
+	free(cache);
+}
+
+static uint32_t _search_index(uint8_t * index, uint32_t count, uint64_t guid,
+			      int portnum)
+{
+	uint32_t lo = 0;
+	uint32_t hi = count;
+	uint64_t entry_guid;
+	uint8_t entry_portnum;
+	uint32_t entry_rec;
+
+	/* find the first entry not less than (guid, portnum) */
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		uint8_t *entry = index + (size_t) mid * IBND_MAPPED_INDEX_LEN;
+
+		_unmarshall64(entry, &entry_guid);
+		_unmarshall8(entry + 12, &entry_portnum);
+		if (entry_guid < guid
+		    || (entry_guid == guid && (int) entry_portnum < portnum))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == count)
+		return IBND_MAPPED_NO_INDEX;
+
+	index += (size_t) lo * IBND_MAPPED_INDEX_LEN;
+	_unmarshall64(index, &entry_guid);
+	_unmarshall32(index + 8, &entry_rec);
+	_unmarshall8(index + 12, &entry_portnum);
+
+	if (entry_guid != guid || (portnum >= 0 && entry_portnum != portnum))
+		return IBND_MAPPED_NO_INDEX;
+
+	return entry_rec;
+}
+
+static void _map_node(ibnd_cache_t * cache, uint32_t idx, ibnd_node_t * node,
+		      uint16_t * ports_stored, uint32_t * first_port)
+{
+	uint8_t *buf = cache->nodes + (size_t) idx * IBND_MAPPED_NODE_LEN;
+	size_t offset = 0;
+	uint8_t tmp8;
+
+	offset += _unmarshall64(buf + offset, &node->guid);
+	offset += _unmarshall16(buf + offset, &node->smalid);
+	offset += _unmarshall8(buf + offset, &node->smalmc);
+	offset += _unmarshall8(buf + offset, &tmp8);
+	node->smaenhsp0 = tmp8;
+	offset += _unmarshall8(buf + offset, &tmp8);
+	node->type = tmp8;
+	offset += _unmarshall8(buf + offset, &tmp8);
+	node->numports = tmp8;
+	offset += _unmarshall16(buf + offset, ports_stored);
+	offset += _unmarshall32(buf + offset, first_port);
+	offset += 4;
+	offset += _unmarshall_buf(buf + offset, node->switchinfo,
+				  IB_SMP_DATA_SIZE);
+	offset += _unmarshall_buf(buf + offset, node->info, IB_SMP_DATA_SIZE);
+	offset += _unmarshall_buf(buf + offset, node->nodedesc,
+				  IB_SMP_DATA_SIZE);
+}
+
+static void _map_port(ibnd_cache_t * cache, uint32_t idx, ibnd_port_t * port,
+		      uint32_t * node_idx, uint32_t * remote_idx)
+{
+	uint8_t *buf = cache->ports + (size_t) idx * IBND_MAPPED_PORT_LEN;
+	size_t offset = 0;
+	uint8_t tmp8;
+
+	offset += _unmarshall64(buf + offset, &port->guid);
+	offset += _unmarshall32(buf + offset, node_idx);
+	offset += _unmarshall32(buf + offset, remote_idx);
+	offset += _unmarshall8(buf + offset, &tmp8);
+	port->portnum = tmp8;
+	offset += _unmarshall8(buf + offset, &tmp8);
+	port->ext_portnum = tmp8;
+	offset += _unmarshall16(buf + offset, &port->base_lid);
+	offset += _unmarshall8(buf + offset, &port->lmc);
+	offset += 3;
+	offset += _unmarshall_buf(buf + offset, port->info, IB_SMP_DATA_SIZE);
+	offset += _unmarshall_buf(buf + offset, port->ext_info,
+				  IB_SMP_DATA_SIZE);
+}
+
+/* Rebuild a fabric from a mapped cache.  Nodes, ports and the per node
+ * port tables are carved out of one array each, indexed by record
+ * number, and records reference each other by index, so the load does
+ * no per object allocation and no hashing.  The fabric keeps the cache
+ * mapped: guid lookups binary search its sorted indexes (see
+ * mapped_find_node_guid) and ibnd_destroy_fabric releases it.
+ *
+ * The cache is consumed, it is released on failure too.
+ */
+static ibnd_fabric_t *_load_mapped_fabric(ibnd_cache_t * cache)
+{
+	ibnd_fabric_t *fabric = NULL;
+	uint32_t *first_ports = NULL;
+	uint32_t *end_ports = NULL;
+	uint32_t *remotes = NULL;
+	size_t port_ptrs = 0;
+	uint32_t from_idx;
+	uint32_t i;
+
+	from_idx = _search_index(cache->node_index, cache->node_count,
+				 cache->from_node_guid, 0);
+	if (from_idx >= cache->node_count) {
+		IBND_DEBUG("Cache invalid: cannot find from node\n");
+		ibnd_close_cache(cache);
+		return NULL;
+	}
+
+	fabric = (ibnd_fabric_t *) malloc(sizeof(ibnd_fabric_t));
+	if (!fabric) {
+		IBND_DEBUG("OOM: fabric\n");
+		ibnd_close_cache(cache);
+		return NULL;
+	}
+	memset(fabric, '\0', sizeof(ibnd_fabric_t));
+	fabric->maxhops_discovered = cache->maxhops_discovered;
+	fabric->cache = cache;
+
+	cache->node_recs = (ibnd_node_t *) calloc(cache->node_count,
+						  sizeof(ibnd_node_t));
+	cache->port_recs = (ibnd_port_t *) calloc(cache->port_count + 1,
+						  sizeof(ibnd_port_t));
+	first_ports = (uint32_t *) calloc(cache->node_count,
+					  sizeof(*first_ports));
+	end_ports = (uint32_t *) calloc(cache->node_count, sizeof(*end_ports));
+	remotes = (uint32_t *) calloc(cache->port_count + 1, sizeof(*remotes));
+	if (!cache->node_recs || !cache->port_recs || !first_ports
+	    || !end_ports || !remotes) {
+		IBND_DEBUG("OOM: cache record tables\n");
+		goto cleanup;
+	}
+
+	/* Insert in reverse so fabric->nodes keeps the cached order */
+	for (i = cache->node_count; i-- > 0;) {
+		ibnd_node_t *node = &cache->node_recs[i];
+		uint16_t ports_stored;
+
+		_map_node(cache, i, node, &ports_stored, &first_ports[i]);
+		if (first_ports[i] > cache->port_count
+		    || ports_stored > cache->port_count - first_ports[i]) {
+			IBND_DEBUG("Cache invalid: node ports out of range\n");
+			goto cleanup;
+		}
+		end_ports[i] = first_ports[i] + ports_stored;
+		port_ptrs += node->numports + 1;
+
+		node->next = fabric->nodes;
+		fabric->nodes = node;
+		add_to_type_list(node, fabric);
+	}
+
+	cache->port_ptrs = (ibnd_port_t **) calloc(port_ptrs,
+						   sizeof(ibnd_port_t *));
+	if (!cache->port_ptrs) {
+		IBND_DEBUG("OOM: node->ports\n");
+		goto cleanup;
+	}
+
+	port_ptrs = 0;
+	for (i = 0; i < cache->node_count; i++) {
+		cache->node_recs[i].ports = cache->port_ptrs + port_ptrs;
+		port_ptrs += cache->node_recs[i].numports + 1;
+	}
+
+	for (i = 0; i < cache->port_count; i++) {
+		ibnd_port_t *port = &cache->port_recs[i];
+		ibnd_node_t *node;
+		uint32_t node_idx;
+
+		_map_port(cache, i, port, &node_idx, &remotes[i]);
+
+		if (node_idx >= cache->node_count
+		    || port->portnum > cache->node_recs[node_idx].numports) {
+			IBND_DEBUG("Cache invalid: cannot find node\n");
+			goto cleanup;
+		}
+
+		/* each node's ports are stored together, see _cache_mapped_fabric */
+		if (i < first_ports[node_idx] || i >= end_ports[node_idx]) {
+			IBND_DEBUG("Cache invalid: port outside its node\n");
+			goto cleanup;
+		}
+
+		node = &cache->node_recs[node_idx];
+		if (node->ports[port->portnum]) {
+			IBND_DEBUG("Cache invalid: duplicate port discovered\n");
+			goto cleanup;
+		}
+
+		port->node = node;
+		node->ports[port->portnum] = port;
+	}
+
+	for (i = 0; i < cache->port_count; i++) {
+		if (remotes[i] == IBND_MAPPED_NO_INDEX)
+			continue;
+
+		if (remotes[i] >= cache->port_count) {
+			IBND_DEBUG("Cache invalid: cannot find remote port\n");
+			goto cleanup;
+		}
+
+		cache->port_recs[i].remoteport = &cache->port_recs[remotes[i]];
+	}
+
+	fabric->from_node = &cache->node_recs[from_idx];
+
+	if (group_nodes(fabric))
+		goto cleanup;
+
+	free(remotes);
+	free(end_ports);
+	free(first_ports);
+	return fabric;
+
+cleanup:
+	free(remotes);
+	free(end_ports);
+	free(first_ports);
+	ibnd_destroy_fabric(fabric);
+	return NULL;
+}
+
+ibnd_node_t *mapped_find_node_guid(ibnd_fabric_t * fabric, uint64_t guid)
+{
+	ibnd_cache_t *cache = fabric->cache;
+	uint32_t idx;
+
+	idx = _search_index(cache->node_index, cache->node_count, guid, 0);
+	if (idx >= cache->node_count || cache->node_recs[idx].guid != guid)
+		return NULL;
+
+	return &cache->node_recs[idx];
+}
+
+ibnd_port_t *mapped_find_port_guid(ibnd_fabric_t * fabric, uint64_t guid)
+{
+	ibnd_cache_t *cache = fabric->cache;
+	uint32_t idx;
+
+	idx = _search_index(cache->port_index, cache->port_count, guid, -1);
+	if (idx >= cache->port_count || cache->port_recs[idx].guid != guid)
+		return NULL;
+
+	return &cache->port_recs[idx];
+}
+
+void mapped_iter_ports(ibnd_fabric_t * fabric, ibnd_iter_port_func_t func,
+		       void *user_data)
+{
+	ibnd_cache_t *cache = fabric->cache;
+	uint32_t i;
+
+	for (i = 0; i < cache->port_count; i++)
+		func(&cache->port_recs[i], user_data);
+}
+
+void destroy_mapped_fabric(ibnd_fabric_t * fabric)
+{
+	ibnd_cache_t *cache = fabric->cache;
+
+	free(cache->port_ptrs);
+	free(cache->port_recs);
+	free(cache->node_recs);
+	ibnd_close_cache(cache);
+}
+
 ibnd_fabric_t *ibnd_load_fabric(const char *file, unsigned int flags)
 {
 	unsigned int node_count = 0;
@@ -614,6 +1172,7 @@ ibnd_fabric_t *ibnd_load_fabric(const char *file, unsigned int flags)
 	ibnd_fabric_cache_t *fabric_cache = NULL;
 	ibnd_fabric_t *fabric = NULL;
 	ibnd_node_cache_t *node_cache = NULL;
+	int64_t version;
 	int fd = -1;
 	unsigned int i;
 
@@ -627,6 +1186,22 @@ ibnd_fabric_t *ibnd_load_fabric(const char *file, unsigned int flags)
 		return NULL;
 	}
 
+	if ((version = _load_cache_version(fd)) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	if (version == IBND_FABRIC_CACHE_VERSION_MAPPED) {
+		ibnd_cache_t *cache;
+
+		/* on success the fabric owns the mapping and fd */
+		if (!(cache = _map_cache(fd))) {
+			close(fd);
+			return NULL;
+		}
+		return _load_mapped_fabric(cache);
+	}
+
 	fabric_cache =
 	    (ibnd_fabric_cache_t *) malloc(sizeof(ibnd_fabric_cache_t));
 	if (!fabric_cache) {
@@ -866,6 +1441,212 @@ static int _cache_port(int fd, ibnd_port_t * port)
 	return 0;
 }
 
+typedef struct ibnd_index_entry {
+	uint64_t guid;
+	uint32_t rec;
+	uint8_t portnum;
+} ibnd_index_entry_t;
+
+static int _cmp_index_entry(const void *a, const void *b)
+{
+	const ibnd_index_entry_t *ea = a;
+	const ibnd_index_entry_t *eb = b;
+
+	if (ea->guid != eb->guid)
+		return ea->guid < eb->guid ? -1 : 1;
+	return (int) ea->portnum - (int) eb->portnum;
+}
+
+static void _cache_index(uint8_t * buf, ibnd_index_entry_t * entries,
+			 uint32_t count)
+{
+	size_t offset = 0;
+	uint32_t i;
+
+	qsort(entries, count, sizeof(*entries), _cmp_index_entry);
+
+	for (i = 0; i < count; i++) {
+		offset += _marshall64(buf + offset, entries[i].guid);
+		offset += _marshall32(buf + offset, entries[i].rec);
+		offset += _marshall8(buf + offset, entries[i].portnum);
+		offset += _marshall_buf(buf + offset, "\0\0\0", 3);
+	}
+}
+
+static uint32_t _find_index_entry(ibnd_index_entry_t * entries,
+				  uint32_t count, ibnd_port_t * port)
+{
+	ibnd_index_entry_t key;
+	ibnd_index_entry_t *entry;
+
+	key.guid = port->guid;
+	key.portnum = (uint8_t) port->portnum;
+
+	entry = bsearch(&key, entries, count, sizeof(*entries),
+			_cmp_index_entry);
+
+	return entry ? entry->rec : IBND_MAPPED_NO_INDEX;
+}
+
+static size_t _cache_mapped_node(uint8_t * buf, ibnd_node_t * node,
+				 uint16_t ports_stored, uint32_t first_port)
+{
+	size_t offset = 0;
+
+	offset += _marshall64(buf + offset, node->guid);
+	offset += _marshall16(buf + offset, node->smalid);
+	offset += _marshall8(buf + offset, node->smalmc);
+	offset += _marshall8(buf + offset, (uint8_t) node->smaenhsp0);
+	offset += _marshall8(buf + offset, (uint8_t) node->type);
+	offset += _marshall8(buf + offset, (uint8_t) node->numports);
+	offset += _marshall16(buf + offset, ports_stored);
+	offset += _marshall32(buf + offset, first_port);
+	offset += _marshall32(buf + offset, 0);
+	offset += _marshall_buf(buf + offset, node->switchinfo,
+				IB_SMP_DATA_SIZE);
+	offset += _marshall_buf(buf + offset, node->info, IB_SMP_DATA_SIZE);
+	offset += _marshall_buf(buf + offset, node->nodedesc, IB_SMP_DATA_SIZE);
+
+	return offset;
+}
+
+static size_t _cache_mapped_port(uint8_t * buf, ibnd_port_t * port,
+				 uint32_t node_idx, uint32_t remote_idx)
+{
+	size_t offset = 0;
+
+	offset += _marshall64(buf + offset, port->guid);
+	offset += _marshall32(buf + offset, node_idx);
+	offset += _marshall32(buf + offset, remote_idx);
+	offset += _marshall8(buf + offset, (uint8_t) port->portnum);
+	offset += _marshall8(buf + offset, (uint8_t) port->ext_portnum);
+	offset += _marshall16(buf + offset, port->base_lid);
+	offset += _marshall8(buf + offset, port->lmc);
+	offset += _marshall_buf(buf + offset, "\0\0\0", 3);
+	offset += _marshall_buf(buf + offset, port->info, IB_SMP_DATA_SIZE);
+	offset += _marshall_buf(buf + offset, port->ext_info, IB_SMP_DATA_SIZE);
+
+	return offset;
+}
+
+/* Lay the whole image out in memory and write it in one go; node and
+ * port records are cross referenced by index through the sorted port
+ * index, so no pointer survives into the file.
+ */
+static int _cache_mapped_fabric(int fd, ibnd_fabric_t * fabric)
+{
+	ibnd_index_entry_t *node_entries = NULL;
+	ibnd_index_entry_t *port_entries = NULL;
+	uint32_t node_count = 0;
+	uint32_t port_count = 0;
+	uint32_t node_off, port_off, node_idx_off, port_idx_off;
+	uint32_t n, p;
+	uint8_t *image = NULL;
+	size_t image_len;
+	size_t offset = 0;
+	ibnd_node_t *node;
+	int rc = -1;
+	int i;
+
+	for (node = fabric->nodes; node; node = node->next) {
+		node_count++;
+		for (i = 0; i <= node->numports; i++)
+			if (node->ports[i])
+				port_count++;
+	}
+
+	node_off = IBND_MAPPED_HEADER_LEN;
+	port_off = node_off + node_count * IBND_MAPPED_NODE_LEN;
+	node_idx_off = port_off + port_count * IBND_MAPPED_PORT_LEN;
+	port_idx_off = node_idx_off + node_count * IBND_MAPPED_INDEX_LEN;
+	image_len = port_idx_off + port_count * IBND_MAPPED_INDEX_LEN;
+
+	image = (uint8_t *) calloc(1, image_len);
+	node_entries = (ibnd_index_entry_t *)
+	    calloc(node_count + 1, sizeof(*node_entries));
+	port_entries = (ibnd_index_entry_t *)
+	    calloc(port_count + 1, sizeof(*port_entries));
+	if (!image || !node_entries || !port_entries) {
+		IBND_DEBUG("OOM: cache image\n");
+		goto cleanup;
+	}
+
+	offset += _marshall32(image + offset, IBND_FABRIC_CACHE_MAGIC);
+	offset += _marshall32(image + offset, IBND_FABRIC_CACHE_VERSION_MAPPED);
+	offset += _marshall32(image + offset, node_count);
+	offset += _marshall32(image + offset, port_count);
+	offset += _marshall64(image + offset, fabric->from_node->guid);
+	offset += _marshall32(image + offset, fabric->maxhops_discovered);
+	offset += _marshall32(image + offset, IBND_MAPPED_HEADER_LEN);
+	offset += _marshall32(image + offset, node_off);
+	offset += _marshall32(image + offset, port_off);
+	offset += _marshall32(image + offset, node_idx_off);
+	offset += _marshall32(image + offset, port_idx_off);
+	offset += _marshall32(image + offset, (uint32_t) image_len);
+
+	/* first pass assigns record numbers */
+	for (node = fabric->nodes, n = 0, p = 0; node; node = node->next, n++) {
+		node_entries[n].guid = node->guid;
+		node_entries[n].rec = n;
+		for (i = 0; i <= node->numports; i++) {
+			if (!node->ports[i])
+				continue;
+			port_entries[p].guid = node->ports[i]->guid;
+			port_entries[p].portnum = (uint8_t) node->ports[i]->portnum;
+			port_entries[p].rec = p;
+			p++;
+		}
+	}
+
+	_cache_index(image + node_idx_off, node_entries, node_count);
+	_cache_index(image + port_idx_off, port_entries, port_count);
+
+	for (node = fabric->nodes, n = 0, p = 0; node; node = node->next, n++) {
+		uint32_t first_port = p;
+
+		for (i = 0; i <= node->numports; i++) {
+			ibnd_port_t *port = node->ports[i];
+			uint32_t remote_idx = IBND_MAPPED_NO_INDEX;
+
+			if (!port)
+				continue;
+
+			if (port->remoteport) {
+				remote_idx = _find_index_entry(port_entries,
+							       port_count,
+							       port->remoteport);
+				if (remote_idx == IBND_MAPPED_NO_INDEX) {
+					IBND_DEBUG("remote port 0x%016" PRIx64
+						   " %d not in fabric\n",
+						   port->remoteport->guid,
+						   port->remoteport->portnum);
+					goto cleanup;
+				}
+			}
+
+			_cache_mapped_port(image + port_off +
+					   (size_t) p * IBND_MAPPED_PORT_LEN,
+					   port, n, remote_idx);
+			p++;
+		}
+
+		_cache_mapped_node(image + node_off +
+				   (size_t) n * IBND_MAPPED_NODE_LEN, node,
+				   (uint16_t) (p - first_port), first_port);
+	}
+
+	if (ibnd_write(fd, image, image_len) < 0)
+		goto cleanup;
+
+	rc = 0;
+
+cleanup:
+	free(port_entries);
+	free(node_entries);
+	free(image);
+	return rc;
+}
+
 int ibnd_cache_fabric(ibnd_fabric_t * fabric, const char *file,
 		      unsigned int flags)
 {
@@ -874,7 +1655,6 @@ int ibnd_cache_fabric(ibnd_fabric_t * fabric, const char *file,
 	ibnd_node_t *node_next = NULL;
 	unsigned int node_count = 0;
 	ibnd_port_t *port = NULL;
-	ibnd_port_t *port_next = NULL;
 	unsigned int port_count = 0;
 	int fd;
 	int i;
@@ -910,6 +1690,12 @@ int ibnd_cache_fabric(ibnd_fabric_t * fabric, const char *file,
 		return -1;
 	}
 
+	if (flags & IBND_CACHE_FABRIC_FLAG_MAPPED) {
+		if (_cache_mapped_fabric(fd, fabric) < 0)
+			goto cleanup;
+		goto done;
+	}
+
 	if (_cache_header_info(fd, fabric) < 0)
 		goto cleanup;
 
@@ -924,22 +1710,25 @@ int ibnd_cache_fabric(ibnd_fabric_t * fabric, const char *file,
 		node = node_next;
 	}
 
-	for (i = 0; i < HTSZ; i++) {
-		port = fabric->portstbl[i];
-		while (port) {
-			port_next = port->htnext;
+	/* walk ports through their nodes, fabrics loaded from a mapped
+	 * cache have no port hash */
+	for (node = fabric->nodes; node; node = node->next) {
+		for (i = 0; node->ports && i <= node->numports; i++) {
+			port = node->ports[i];
+			if (!port)
+				continue;
 
 			if (_cache_port(fd, port) < 0)
 				goto cleanup;
 
 			port_count++;
-			port = port_next;
 		}
 	}
 
 	if (_cache_header_counts(fd, node_count, port_count) < 0)
 		goto cleanup;
 
+done:
 	if (close(fd) < 0) {
 		IBND_DEBUG("close: %s\n", strerror(errno));
 		goto cleanup;
@@ -952,3 +1741,95 @@ cleanup:
 	close(fd);
 	return -1;
 }
+
+ibnd_cache_t *ibnd_open_cache(const char *file)
+{
+	ibnd_cache_t *cache;
+	int fd;
+
+	if (!file) {
+		IBND_DEBUG("file parameter NULL\n");
+		return NULL;
+	}
+
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		IBND_DEBUG("open: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	if (!(cache = _map_cache(fd))) {
+		close(fd);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void ibnd_close_cache(ibnd_cache_t * cache)
+{
+	int fd;
+
+	if (!cache)
+		return;
+
+	fd = cache->fd;
+	_unmap_cache(cache);
+	close(fd);
+}
+
+int ibnd_cache_find_node_guid(ibnd_cache_t * cache, uint64_t guid,
+			      ibnd_node_t * node)
+{
+	uint16_t ports_stored;
+	uint32_t first_port;
+	uint32_t idx;
+
+	if (!cache || !node) {
+		IBND_DEBUG("cache or node parameter NULL\n");
+		return -1;
+	}
+
+	idx = _search_index(cache->node_index, cache->node_count, guid, 0);
+	if (idx >= cache->node_count)
+		return -1;
+
+	memset(node, '\0', sizeof(*node));
+	_map_node(cache, idx, node, &ports_stored, &first_port);
+	return 0;
+}
+
+int ibnd_cache_find_port_guid(ibnd_cache_t * cache, uint64_t guid,
+			      int portnum, ibnd_cache_port_t * port)
+{
+	uint32_t node_idx;
+	uint32_t remote_idx;
+	uint32_t idx;
+
+	if (!cache || !port) {
+		IBND_DEBUG("cache or port parameter NULL\n");
+		return -1;
+	}
+
+	idx = _search_index(cache->port_index, cache->port_count, guid,
+			    portnum);
+	if (idx >= cache->port_count)
+		return -1;
+
+	memset(port, '\0', sizeof(*port));
+	_map_port(cache, idx, &port->port, &node_idx, &remote_idx);
+
+	if (node_idx < cache->node_count)
+		_unmarshall64(cache->nodes +
+			      (size_t) node_idx * IBND_MAPPED_NODE_LEN,
+			      &port->node_guid);
+
+	if (remote_idx < cache->port_count) {
+		uint8_t *rbuf = cache->ports +
+		    (size_t) remote_idx * IBND_MAPPED_PORT_LEN;
+
+		_unmarshall64(rbuf, &port->remote_guid);
+		port->remote_portnum = rbuf[16];
+	}
+
+	return 0;
+}
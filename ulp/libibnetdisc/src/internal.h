@@ -105,4 +105,11 @@ void add_to_type_list(ibnd_node_t * node, ibnd_fabric_t * fabric);
 
 void destroy_node(ibnd_node_t * node);
 
+/* fabrics loaded from a mapped cache, see ibnetdisc_cache.c */
+ibnd_node_t *mapped_find_node_guid(ibnd_fabric_t * fabric, uint64_t guid);
+ibnd_port_t *mapped_find_port_guid(ibnd_fabric_t * fabric, uint64_t guid);
+void mapped_iter_ports(ibnd_fabric_t * fabric, ibnd_iter_port_func_t func,
+		       void *user_data);
+void destroy_mapped_fabric(ibnd_fabric_t * fabric);
+
 #endif				/* _INTERNAL_H_ */
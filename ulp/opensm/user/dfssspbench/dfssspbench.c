@@ -0,0 +1,754 @@
+/*
+ * Copyright (c) 2002-2009 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Abstract:
+ *	Measures the dfsssp routing engine on a synthetic fabric.
+ *
+ *	A two level fat tree or a 3D torus is built in memory and routed
+ *	with the engine several times to time it.  The result is then
+ *	checked: every switch must forward every LID to the port owning it,
+ *	and for each SL the channel dependencies of the paths path_sl puts
+ *	on that SL must be acyclic.  The SL of each path is looked up by the
+ *	DLID it uses, so with LMC > 0 every LID of a port is checked on the
+ *	layer of its own route.  Finally the number of CA to CA paths on
+ *	each switch to switch link is reported.
+ *
+ * Environment:
+ *	User Mode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+/* The engine is not exported by opensm, so it is built in. */
+#include <osm_ucast_dfsssp.c>
+
+#define BENCH_NONE		0xFFFFFFFF
+#define BENCH_MAX_PORTS		64
+
+typedef struct bench_sw {
+	osm_switch_t sw;
+	osm_port_t port;
+	uint32_t index;
+	uint32_t num_cas;
+	uint16_t ca_lid;
+} bench_sw_t;
+/*
+ * port
+ *	Switch port 0, the switch LID.
+ *
+ * num_cas, ca_lid
+ *	CAs attached to the switch and the base LID of one of them, used as
+ *	the SLID of paths from the switch.
+ */
+
+typedef struct bench_fabric {
+	osm_opensm_t *p_osm;
+	struct osm_routing_engine re;
+	bench_sw_t **sws;
+	uint32_t num_sws;
+	osm_port_t **cas;
+	uint32_t num_cas;
+	osm_port_t **lid_port;
+	uint8_t sw_ports;
+	uint8_t op_vls;
+	uint8_t num_vls;
+	uint8_t lmc;
+	uint16_t next_lid;
+	uint64_t next_guid;
+	uint32_t num_channels;
+	uint32_t *ch_to;
+} bench_fabric_t;
+/*
+ * sw_ports
+ *	External ports of every switch.
+ *
+ * channels
+ *	Channel sw->index * (sw_ports + 1) + port is the link leaving switch
+ *	sw on port, ch_to is the switch at its far end or BENCH_NONE.
+ */
+
+static uint32_t g_runs = 5;
+static boolean_t g_base_lid;
+
+/* The engine logs to stdout, at the levels selected with -d. */
+void osm_log(IN osm_log_t * p_log, IN osm_log_level_t verbosity,
+	     IN const char *p_str, ...)
+{
+	va_list args;
+
+	if (!(p_log->level & verbosity))
+		return;
+
+	va_start(args, p_str);
+	vprintf(p_str, args);
+	va_end(args);
+}
+
+void osm_port_get_lid_range_ho(IN const osm_port_t * p_port,
+			       IN uint16_t * p_min_lid, IN uint16_t * p_max_lid)
+{
+	uint8_t lmc;
+
+	*p_min_lid = cl_ntoh16(osm_port_get_base_lid(p_port));
+	lmc = osm_port_get_lmc(p_port);
+	*p_max_lid = (uint16_t) (*p_min_lid + (1 << lmc) - 1);
+}
+
+static osm_node_t *bench_new_node(bench_fabric_t * f, uint8_t type,
+				  uint8_t num_ports)
+{
+	osm_node_t *p_node;
+	osm_physp_t *p_physp;
+	uint8_t port;
+
+	p_node = calloc(1, sizeof(osm_node_t) +
+			num_ports * sizeof(osm_physp_t));
+	if (!p_node)
+		return NULL;
+
+	p_node->node_info.node_type = type;
+	p_node->node_info.num_ports = num_ports;
+	p_node->node_info.node_guid = cl_hton64(++f->next_guid);
+	p_node->physp_tbl_size = num_ports + 1;
+
+	/* CAs have no port 0, switch ports share the node GUID */
+	for (port = 0; port <= num_ports; port++) {
+		p_physp = &p_node->physp_table[port];
+		if (type == IB_NODE_TYPE_SWITCH)
+			p_physp->port_guid = p_node->node_info.node_guid;
+		else if (port)
+			p_physp->port_guid = cl_hton64(++f->next_guid);
+		p_physp->port_num = port;
+		p_physp->p_node = p_node;
+		ib_port_info_set_op_vls(&p_physp->port_info, f->op_vls);
+	}
+
+	return p_node;
+}
+
+static void bench_set_lid(bench_fabric_t * f, osm_port_t * p_port,
+			  uint8_t lmc)
+{
+	uint16_t lids = (uint16_t) (1 << lmc);
+
+	/* base LIDs are aligned to the LMC */
+	f->next_lid = (f->next_lid + lids - 1) & ~(lids - 1);
+	p_port->p_physp->port_info.base_lid = cl_hton16(f->next_lid);
+	ib_port_info_set_lmc(&p_port->p_physp->port_info, lmc);
+	while (lids--)
+		f->lid_port[f->next_lid++] = p_port;
+}
+
+static bench_sw_t *bench_add_sw(bench_fabric_t * f)
+{
+	bench_sw_t *p_bsw;
+	osm_node_t *p_node;
+
+	p_bsw = calloc(1, sizeof(bench_sw_t));
+	if (!p_bsw)
+		return NULL;
+	p_node = bench_new_node(f, IB_NODE_TYPE_SWITCH, f->sw_ports);
+	if (!p_node) {
+		free(p_bsw);
+		return NULL;
+	}
+
+	p_node->sw = &p_bsw->sw;
+	p_bsw->sw.p_node = p_node;
+	p_bsw->sw.num_ports = f->sw_ports + 1;
+	p_bsw->port.p_node = p_node;
+	p_bsw->port.guid = p_node->node_info.node_guid;
+	p_bsw->port.p_physp = &p_node->physp_table[0];
+	p_bsw->index = f->num_sws;
+	bench_set_lid(f, &p_bsw->port, 0);
+
+	cl_qmap_insert(&f->p_osm->subn.sw_guid_tbl, p_bsw->port.guid,
+		       &p_bsw->sw.map_item);
+	cl_qmap_insert(&f->p_osm->subn.port_guid_tbl, p_bsw->port.guid,
+		       &p_bsw->port.map_item);
+	f->sws[f->num_sws++] = p_bsw;
+	return p_bsw;
+}
+
+static void bench_link(osm_physp_t * p_physp1, osm_physp_t * p_physp2)
+{
+	p_physp1->p_remote_physp = p_physp2;
+	p_physp2->p_remote_physp = p_physp1;
+}
+
+static int bench_add_ca(bench_fabric_t * f, bench_sw_t * p_bsw, uint8_t port)
+{
+	osm_port_t *p_port;
+	osm_node_t *p_node;
+
+	p_port = calloc(1, sizeof(osm_port_t));
+	if (!p_port)
+		return -1;
+	p_node = bench_new_node(f, IB_NODE_TYPE_CA, 1);
+	if (!p_node) {
+		free(p_port);
+		return -1;
+	}
+
+	p_port->p_node = p_node;
+	p_port->p_physp = &p_node->physp_table[1];
+	p_port->guid = p_port->p_physp->port_guid;
+	bench_set_lid(f, p_port, f->lmc);
+	bench_link(p_port->p_physp, &p_bsw->sw.p_node->physp_table[port]);
+
+	if (!p_bsw->num_cas++)
+		p_bsw->ca_lid = cl_ntoh16(osm_port_get_base_lid(p_port));
+
+	cl_qmap_insert(&f->p_osm->subn.port_guid_tbl, p_port->guid,
+		       &p_port->map_item);
+	f->cas[f->num_cas++] = p_port;
+	return 0;
+}
+
+static void bench_link_sws(bench_sw_t * p_bsw1, uint8_t port1,
+			   bench_sw_t * p_bsw2, uint8_t port2)
+{
+	bench_link(&p_bsw1->sw.p_node->physp_table[port1],
+		   &p_bsw2->sw.p_node->physp_table[port2]);
+}
+
+static int bench_alloc(bench_fabric_t * f, uint32_t num_sws,
+		       uint32_t num_cas, uint8_t sw_ports)
+{
+	uint32_t num_lids = num_sws + (num_cas << f->lmc);
+
+	if (sw_ports >= BENCH_MAX_PORTS || num_lids + num_sws + (1 << f->lmc)
+	    > IB_LID_UCAST_END_HO) {
+		fprintf(stderr, "fabric too large\n");
+		return -1;
+	}
+
+	f->sw_ports = sw_ports;
+	f->sws = calloc(num_sws, sizeof(bench_sw_t *));
+	f->cas = calloc(num_cas ? num_cas : 1, sizeof(osm_port_t *));
+	f->lid_port = calloc(IB_LID_UCAST_END_HO + 1, sizeof(osm_port_t *));
+	if (!f->sws || !f->cas || !f->lid_port)
+		return -1;
+	f->next_lid = 1;
+	return 0;
+}
+
+/*
+ * Leaves have the CAs on ports 1 to hosts and spine s on port hosts + 1 + s,
+ * spines have leaf l on port 1 + l.
+ */
+static int bench_fat_tree(bench_fabric_t * f, uint32_t spines,
+			  uint32_t leaves, uint32_t hosts)
+{
+	bench_sw_t *p_leaf;
+	uint32_t i, j, ports = hosts + spines;
+
+	if (leaves > ports)
+		ports = leaves;
+	if (bench_alloc(f, spines + leaves, leaves * hosts,
+			(uint8_t) (ports < BENCH_MAX_PORTS ?
+				   ports : BENCH_MAX_PORTS)))
+		return -1;
+
+	for (i = 0; i < spines + leaves; i++)
+		if (!bench_add_sw(f))
+			return -1;
+
+	for (i = 0; i < leaves; i++) {
+		p_leaf = f->sws[spines + i];
+		for (j = 0; j < hosts; j++)
+			if (bench_add_ca(f, p_leaf, (uint8_t) (1 + j)))
+				return -1;
+		for (j = 0; j < spines; j++)
+			bench_link_sws(p_leaf, (uint8_t) (hosts + 1 + j),
+				       f->sws[j], (uint8_t) (1 + i));
+	}
+
+	return 0;
+}
+
+/*
+ * Switches have the CAs on ports 1 to hosts, then the + and - neighbor of
+ * each dimension.  A dimension of size 2 has a single link.
+ */
+static int bench_torus(bench_fabric_t * f, const uint32_t dim[3],
+		       uint32_t hosts)
+{
+	bench_sw_t *p_bsw;
+	uint32_t i, j, d, c, stride, n = dim[0] * dim[1] * dim[2];
+
+	if (bench_alloc(f, n, n * hosts,
+			(uint8_t) (hosts + 6 < BENCH_MAX_PORTS ?
+				   hosts + 6 : BENCH_MAX_PORTS)))
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		p_bsw = bench_add_sw(f);
+		if (!p_bsw)
+			return -1;
+		for (j = 0; j < hosts; j++)
+			if (bench_add_ca(f, p_bsw, (uint8_t) (1 + j)))
+				return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		stride = 1;
+		for (d = 0; d < 3; stride *= dim[d], d++) {
+			c = (i / stride) % dim[d];
+			if (dim[d] < 2 || (dim[d] == 2 && c))
+				continue;
+			j = i - c * stride + ((c + 1) % dim[d]) * stride;
+			bench_link_sws(f->sws[i], (uint8_t) (hosts + 1 + 2 * d),
+				       f->sws[j], (uint8_t) (hosts + 2 + 2 * d));
+		}
+	}
+
+	return 0;
+}
+
+static int bench_setup(bench_fabric_t * f)
+{
+	osm_physp_t *p_rem;
+	bench_sw_t *p_bsw;
+	uint32_t i;
+	uint8_t port;
+
+	for (i = 0; i < f->num_sws; i++) {
+		p_bsw = f->sws[i];
+		p_bsw->sw.max_lid_ho = f->next_lid - 1;
+		p_bsw->sw.new_lft = malloc(f->next_lid);
+		if (!p_bsw->sw.new_lft)
+			return -1;
+	}
+
+	f->num_channels = f->num_sws * (f->sw_ports + 1);
+	f->ch_to = malloc(f->num_channels * sizeof(uint32_t));
+	if (!f->ch_to)
+		return -1;
+	for (i = 0; i < f->num_channels; i++) {
+		f->ch_to[i] = BENCH_NONE;
+		port = (uint8_t) (i % (f->sw_ports + 1));
+		if (!port)
+			continue;
+		p_rem = f->sws[i / (f->sw_ports + 1)]->sw.p_node->
+		    physp_table[port].p_remote_physp;
+		if (p_rem && p_rem->p_node->sw)
+			f->ch_to[i] = PARENT_STRUCT(p_rem->p_node->sw,
+						    bench_sw_t, sw)->index;
+	}
+
+	f->p_osm->subn.opt.lmc = f->lmc;
+	f->p_osm->routing_engine_used = &f->re;
+	f->re.type = OSM_ROUTING_ENGINE_TYPE_DFSSSP;
+	f->re.name = "dfsssp";
+	return osm_ucast_dfsssp_setup(&f->re, f->p_osm);
+}
+
+static void bench_destroy(bench_fabric_t * f)
+{
+	uint32_t i;
+
+	if (f->re.destroy)
+		f->re.destroy(f->re.context);
+
+	for (i = 0; i < f->num_sws; i++) {
+		free(f->sws[i]->sw.new_lft);
+		free(f->sws[i]->sw.p_node);
+		free(f->sws[i]);
+	}
+	for (i = 0; i < f->num_cas; i++) {
+		free(f->cas[i]->p_node);
+		free(f->cas[i]);
+	}
+	free(f->sws);
+	free(f->cas);
+	free(f->lid_port);
+	free(f->ch_to);
+}
+
+/*
+ * Follows the forwarding tables from switch p_bsw to lid, storing the
+ * switch to switch channels passed in path.  Returns their number, or -1
+ * if the tables do not deliver the LID to the port owning it.
+ */
+static int bench_walk(bench_fabric_t * f, bench_sw_t * p_bsw, uint16_t lid,
+		      uint32_t * path)
+{
+	osm_physp_t *p_rem;
+	uint16_t min_lid;
+	uint8_t port;
+	int n = 0;
+
+	for (;;) {
+		port = p_bsw->sw.new_lft[lid];
+		if (port == 0)
+			return f->lid_port[lid] == &p_bsw->port ? n : -1;
+		if (port > f->sw_ports)
+			return -1;
+
+		p_rem = p_bsw->sw.p_node->physp_table[port].p_remote_physp;
+		if (!p_rem)
+			return -1;
+		if (!p_rem->p_node->sw) {
+			min_lid = cl_ntoh16(osm_physp_get_base_lid(p_rem));
+			return lid >= min_lid &&
+			    lid < min_lid + (1 << f->lmc) ? n : -1;
+		}
+
+		if ((uint32_t) n >= f->num_sws)
+			return -1;
+		path[n++] = p_bsw->index * (f->sw_ports + 1) + port;
+		p_bsw = PARENT_STRUCT(p_rem->p_node->sw, bench_sw_t, sw);
+	}
+}
+
+/*
+ * Depth first search of the dependency graph of one SL.  deps holds one
+ * flag per channel and outgoing port of the switch it leads to.
+ */
+static boolean_t bench_has_cycle(bench_fabric_t * f, const uint8_t * deps,
+				 uint8_t * color, uint32_t * stack,
+				 uint32_t * next)
+{
+	uint32_t start, c, d, port, ports = f->sw_ports + 1;
+	int top;
+
+	memset(color, 0, f->num_channels);
+
+	for (start = 0; start < f->num_channels; start++) {
+		if (color[start] || f->ch_to[start] == BENCH_NONE)
+			continue;
+
+		top = 0;
+		stack[0] = start;
+		next[0] = 1;
+		color[start] = 1;
+
+		while (top >= 0) {
+			c = stack[top];
+			port = next[top]++;
+			if (port >= ports) {
+				color[c] = 2;
+				top--;
+				continue;
+			}
+			if (!deps[c * ports + port])
+				continue;
+
+			d = f->ch_to[c] * ports + port;
+			if (color[d] == 1)
+				return TRUE;
+			if (color[d] == 0) {
+				stack[++top] = d;
+				next[top] = 1;
+				color[d] = 1;
+			}
+		}
+	}
+
+	return FALSE;
+}
+
+/* Returns the number of errors found. */
+static uint32_t bench_check(bench_fabric_t * f)
+{
+	osm_port_t *p_port;
+	bench_sw_t *p_src, *p_dst;
+	uint64_t *load, sl_paths[IB_MAX_NUM_VLS] = { 0 };
+	uint64_t min_load = (uint64_t) - 1, max_load = 0, total = 0;
+	uint64_t paths = 0, hops = 0;
+	uint32_t *path, *stack, *next, i, k, links = 0, errors = 0;
+	uint32_t ports = f->sw_ports + 1;
+	uint16_t slid, dlid, lid;
+	uint8_t *deps, *color, sl;
+	int n;
+
+	path = malloc(f->num_sws * sizeof(uint32_t));
+	stack = malloc(f->num_channels * sizeof(uint32_t));
+	next = malloc(f->num_channels * sizeof(uint32_t));
+	color = malloc(f->num_channels);
+	load = calloc(f->num_channels, sizeof(uint64_t));
+	deps = calloc((size_t) IB_MAX_NUM_VLS * f->num_channels, ports);
+	if (!path || !stack || !next || !color || !load || !deps) {
+		fprintf(stderr, "cannot allocate the check tables\n");
+		errors++;
+		goto Exit;
+	}
+
+	for (i = 0; i < f->num_sws; i++) {
+		p_src = f->sws[i];
+		slid = p_src->num_cas ? p_src->ca_lid :
+		    cl_ntoh16(osm_port_get_base_lid(&p_src->port));
+
+		for (lid = 1; lid < f->next_lid; lid++) {
+			p_port = f->lid_port[lid];
+			if (!p_port)
+				continue;
+
+			n = bench_walk(f, p_src, lid, path);
+			if (n < 0) {
+				if (errors++ < 10)
+					fprintf(stderr, "LID %u not reached "
+						"from switch %u\n", lid, i);
+				continue;
+			}
+
+			/* as a CA would ask the SA: by its SLID and the DLID */
+			dlid = g_base_lid ?
+			    cl_ntoh16(osm_port_get_base_lid(p_port)) : lid;
+			sl = f->re.path_sl(f->re.context, 0, cl_hton16(slid),
+					   cl_hton16(dlid));
+			if (sl >= f->num_vls) {
+				if (errors++ < 10)
+					fprintf(stderr, "SL %u for LID %u from "
+						"switch %u is not a data VL\n",
+						sl, lid, i);
+				continue;
+			}
+
+			for (k = 0; k + 1 < (uint32_t) n; k++)
+				deps[(sl * f->num_channels + path[k]) * ports +
+				     path[k + 1] % ports] = 1;
+			sl_paths[sl]++;
+
+			if (p_port->p_node->sw || !p_src->num_cas)
+				continue;
+			p_dst = PARENT_STRUCT(p_port->p_physp->p_remote_physp->
+					      p_node->sw, bench_sw_t, sw);
+			if (p_dst == p_src)
+				continue;
+			paths += p_src->num_cas;
+			hops += (uint64_t) n * p_src->num_cas;
+			for (k = 0; k < (uint32_t) n; k++)
+				load[path[k]] += p_src->num_cas;
+		}
+	}
+
+	for (sl = 0; sl < f->num_vls; sl++) {
+		if (bench_has_cycle(f, deps + (size_t) sl * f->num_channels *
+				    ports, color, stack, next)) {
+			errors++;
+			fprintf(stderr, "SL %u has a credit loop\n", sl);
+		}
+	}
+
+	for (i = 0; i < f->num_channels; i++) {
+		if (f->ch_to[i] == BENCH_NONE)
+			continue;
+		links++;
+		total += load[i];
+		if (load[i] < min_load)
+			min_load = load[i];
+		if (load[i] > max_load)
+			max_load = load[i];
+	}
+
+	if (links && paths)
+		printf("%" PRIu64 " CA to CA paths, %.2f switch hops on "
+		       "average\n%u links carry %" PRIu64 " to %" PRIu64
+		       " paths, %.1f on average, max/avg %.2f\n", paths,
+		       (double)hops / paths, links, min_load, max_load,
+		       (double)total / links,
+		       (double)max_load * links / total);
+	for (sl = 0; sl < f->num_vls; sl++)
+		if (sl_paths[sl])
+			printf("SL %u: %" PRIu64 " routes\n", sl,
+			       sl_paths[sl]);
+
+Exit:
+	free(path);
+	free(stack);
+	free(next);
+	free(color);
+	free(load);
+	free(deps);
+	return errors;
+}
+
+static void bench_usage(void)
+{
+	fprintf(stderr,
+		"Usage: dfssspbench [-f spines,leaves,hosts | -t x,y,z,hosts]"
+		" [-l lmc]\n"
+		"                   [-v vls] [-r runs] [-b] [-d]\n"
+		"  -f  two level fat tree\n"
+		"  -t  3D torus, hosts per switch (default 4,4,4,2)\n"
+		"  -l  LMC of the CAs (default 0)\n"
+		"  -v  data VLs: 1, 2, 4, 8 or 15 (default 8)\n"
+		"  -r  routing runs timed (default 5)\n"
+		"  -b  look SLs up by the base LID of the destination port\n"
+		"      instead of the LID used, to show the loops this causes\n"
+		"  -d  print the engine log\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	bench_fabric_t fabric;
+	bench_fabric_t *f = &fabric;
+	uint32_t fat[3], dim[3] = { 4, 4, 4 }, hosts = 2, lmc = 0, vls = 8;
+	uint64_t start, t, min_time = (uint64_t) - 1, total = 0;
+	boolean_t fat_tree = FALSE;
+	uint32_t i, errors;
+	int status;
+
+	memset(f, 0, sizeof(*f));
+	f->p_osm = calloc(1, sizeof(osm_opensm_t));
+	if (!f->p_osm) {
+		fprintf(stderr, "initialization failed\n");
+		return 1;
+	}
+	f->p_osm->log.level = OSM_LOG_ERROR;
+
+	for (i = 1; i < (uint32_t) argc; i++) {
+		if (argv[i][0] != '-' || !argv[i][1] || argv[i][2])
+			bench_usage();
+
+		switch (argv[i][1]) {
+		case 'b':
+			g_base_lid = TRUE;
+			continue;
+		case 'd':
+			f->p_osm->log.level |= OSM_LOG_INFO | OSM_LOG_VERBOSE;
+			continue;
+		}
+
+		if (i + 1 >= (uint32_t) argc)
+			bench_usage();
+		switch (argv[i][1]) {
+		case 'f':
+			if (sscanf(argv[++i], "%u,%u,%u", &fat[0], &fat[1],
+				   &fat[2]) != 3 || !fat[0] || !fat[1])
+				bench_usage();
+			fat_tree = TRUE;
+			break;
+		case 't':
+			if (sscanf(argv[++i], "%u,%u,%u,%u", &dim[0], &dim[1],
+				   &dim[2], &hosts) != 4 ||
+			    !dim[0] || !dim[1] || !dim[2])
+				bench_usage();
+			break;
+		case 'l':
+			lmc = atoi(argv[++i]);
+			break;
+		case 'v':
+			vls = atoi(argv[++i]);
+			break;
+		case 'r':
+			g_runs = atoi(argv[++i]);
+			break;
+		default:
+			bench_usage();
+		}
+	}
+	if (lmc > IB_PORT_LMC_MAX || !g_runs)
+		bench_usage();
+
+	/* OperationalVLs encoding: 1 for VL0 only up to 5 for VL0-14 */
+	switch (vls) {
+	case 1:
+		f->op_vls = 1;
+		break;
+	case 2:
+		f->op_vls = 2;
+		break;
+	case 4:
+		f->op_vls = 3;
+		break;
+	case 8:
+		f->op_vls = 4;
+		break;
+	case 15:
+		f->op_vls = 5;
+		break;
+	default:
+		bench_usage();
+	}
+	f->num_vls = (uint8_t) vls;
+	f->lmc = (uint8_t) lmc;
+
+	cl_qmap_init(&f->p_osm->subn.sw_guid_tbl);
+	cl_qmap_init(&f->p_osm->subn.port_guid_tbl);
+
+	if (fat_tree)
+		status = bench_fat_tree(f, fat[0], fat[1], fat[2]);
+	else
+		status = bench_torus(f, dim, hosts);
+	if (status || bench_setup(f)) {
+		fprintf(stderr, "cannot build the fabric\n");
+		bench_destroy(f);
+		free(f->p_osm);
+		return 1;
+	}
+
+	if (fat_tree)
+		printf("fat tree, %u spines, %u leaves, %u hosts per leaf",
+		       fat[0], fat[1], fat[2]);
+	else
+		printf("torus %ux%ux%u, %u hosts per switch", dim[0], dim[1],
+		       dim[2], hosts);
+	printf(", LMC %u, %u VLs\n%u switches, %u CAs, %u LIDs\n", lmc, vls,
+	       f->num_sws, f->num_cas, f->next_lid - 1);
+
+	for (i = 0; i < g_runs; i++) {
+		start = cl_get_time_stamp();
+		status = f->re.ucast_build_fwd_tables(f->re.context);
+		t = cl_get_time_stamp() - start;
+		if (status) {
+			printf("FAILED: routing failed\n");
+			bench_destroy(f);
+			free(f->p_osm);
+			return 1;
+		}
+		total += t;
+		if (t < min_time)
+			min_time = t;
+	}
+	printf("routed in %.2f ms, %.2f ms on average over %u runs\n",
+	       min_time / 1000.0, total / 1000.0 / g_runs, g_runs);
+
+	errors = bench_check(f);
+	bench_destroy(f);
+	free(f->p_osm);
+
+	if (errors) {
+		printf("FAILED: %u errors\n", errors);
+		return 1;
+	}
+	printf("PASSED\n");
+	return 0;
+}
@@ -141,7 +141,7 @@ ibtrapgen_init( IN ibtrapgen_t * const p_ibtrapgen,
 
   /* all mads (actually wrappers) are taken and returned to a pool */
   osm_mad_pool_construct( &p_ibtrapgen->mad_pool );
-  status = osm_mad_pool_init( &p_ibtrapgen->mad_pool );
+  status = osm_mad_pool_init( &p_ibtrapgen->mad_pool, NULL );
   if( status != IB_SUCCESS )
     goto Exit;
 
@@ -474,6 +474,54 @@ BEGIN_C_DECLS
 */
 #define OSM_DEFAULT_SMP_MAX_ON_WIRE 4
 /***********/
+/****d* OpenSM: Base/OSM_DEFAULT_SMP_MAX_PER_NODE
+* NAME
+*	OSM_DEFAULT_SMP_MAX_PER_NODE
+*
+* DESCRIPTION
+*	Specifies the default number of VL15 SMP MADs allowed on
+*	the wire to a single node at any one time.
+*
+* SYNOPSIS
+*/
+#define OSM_DEFAULT_SMP_MAX_PER_NODE 2
+/***********/
+/****d* OpenSM: Base/OSM_DEFAULT_MCAST_THREADS
+* NAME
+*	OSM_DEFAULT_MCAST_THREADS
+*
+* DESCRIPTION
+*	Specifies the default number of threads used to find multicast
+*	tree roots.  Zero means one thread per processor.
+*
+* SYNOPSIS
+*/
+#define OSM_DEFAULT_MCAST_THREADS 0
+/***********/
+/****d* OpenSM: Base/OSM_DEFAULT_PATH_AGGR_MAX_MB
+* NAME
+*	OSM_DEFAULT_PATH_AGGR_MAX_MB
+*
+* DESCRIPTION
+*	Specifies the default memory limit, in MB, of the path parameters
+*	precomputed for the SA.
+*
+* SYNOPSIS
+*/
+#define OSM_DEFAULT_PATH_AGGR_MAX_MB 64
+/***********/
+/****d* OpenSM: Base/OSM_DEFAULT_FTREE_THREADS
+* NAME
+*	OSM_DEFAULT_FTREE_THREADS
+*
+* DESCRIPTION
+*	Specifies the default number of threads (and leaf switch
+*	partitions) used by the fat-tree routing engine.
+*
+* SYNOPSIS
+*/
+#define OSM_DEFAULT_FTREE_THREADS 1
+/***********/
 /****d* OpenSM: Base/OSM_SM_DEFAULT_QP0_RCV_SIZE
 * NAME
 *	OSM_SM_DEFAULT_QP0_RCV_SIZE
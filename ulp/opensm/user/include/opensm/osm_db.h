@@ -185,7 +185,8 @@ void osm_db_destroy(IN osm_db_t * p_db);
 *
 * SYNOPSIS
 */
-int osm_db_init(IN osm_db_t * p_db, IN osm_log_t * p_log);
+int osm_db_init(IN osm_db_t * p_db, IN osm_log_t * p_log,
+		IN boolean_t binary_log);
 /*
 * PARAMETERS
 *
@@ -195,6 +196,13 @@ int osm_db_init(IN osm_db_t * p_db, IN osm_log_t * p_log);
 *	p_log
 *		[in] Pointer to the OSM logging facility
 *
+*	binary_log
+*		[in] Keep the domains in append-only binary log files
+*		     (<domain>.bin) instead of text files. A store then only
+*		     appends the keys changed since the previous one, and
+*		     the log is rewritten once it grew too much. An empty
+*		     log is restored from the domain text file.
+*
 * RETURN VALUES
 *	0 on success 1 otherwise
 *
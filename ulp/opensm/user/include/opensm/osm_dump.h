@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2004-2009 Voltaire, Inc. All rights reserved.
+ * Copyright (c) 2002-2009 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/*
+ * Abstract:
+ * 	Background dumper and binary dump file format.
+ *
+ * Environment:
+ * 	Linux User Mode
+ *
+ */
+
+#ifndef _OSM_DUMP_H_
+#define _OSM_DUMP_H_
+
+#include <iba/ib_types.h>
+#include <complib/cl_event.h>
+#include <complib/cl_spinlock.h>
+#include <complib/cl_thread.h>
+#include <opensm/osm_base.h>
+
+#ifdef __cplusplus
+#  define BEGIN_C_DECLS extern "C" {
+#  define END_C_DECLS   }
+#else				/* !__cplusplus */
+#  define BEGIN_C_DECLS
+#  define END_C_DECLS
+#endif				/* __cplusplus */
+
+BEGIN_C_DECLS
+/****h* OpenSM/Dump
+* NAME
+*	Dump
+*
+* DESCRIPTION
+*	When dump_files_async is set, the LID matrix, LFT and multicast
+*	routes dumps are written by a background thread from a copy of
+*	the switch tables taken at the end of the sweep, so the SM does
+*	not wait for the files to be written.
+*
+*	When dump_files_binary is set, the LFTs and the LID matrix are
+*	also written to opensm-lfts.bin and opensm-lid-matrix.bin.  Both
+*	files start with an osm_dump_bin_hdr_t followed by one
+*	osm_dump_bin_sw_t per switch.  Each switch entry points to the
+*	switch table, which starts on an 8 byte boundary:
+*
+*	opensm-lfts.bin
+*		num_lids bytes, the output port of every LID.
+*
+*	opensm-lid-matrix.bin
+*		num_lids rows of num_ports bytes, the hop count to every
+*		LID through every port.  Port 0 holds the least hop count.
+*
+*	OSM_NO_PATH (0xFF) marks LIDs with no route.  Multi byte fields
+*	are in the byte order of the host that wrote the file, a reader
+*	seeing a byte swapped magic has to swap them.
+*
+*********/
+#define OSM_DUMP_BIN_MAGIC		0x4f534d44	/* "OSMD" */
+#define OSM_DUMP_BIN_VERSION		1
+#define OSM_DUMP_BIN_TYPE_LFTS		1
+#define OSM_DUMP_BIN_TYPE_LID_MATRIX	2
+
+/****s* OpenSM: Dump/osm_dump_bin_hdr_t
+* NAME
+*	osm_dump_bin_hdr_t
+*
+* DESCRIPTION
+*	Header of the binary dump files.
+*
+* SYNOPSIS
+*/
+typedef struct osm_dump_bin_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t type;
+	uint32_t num_switches;
+	uint32_t num_lids;
+} osm_dump_bin_hdr_t;
+/*
+* FIELDS
+*	magic
+*		OSM_DUMP_BIN_MAGIC.
+*
+*	version
+*		OSM_DUMP_BIN_VERSION.
+*
+*	type
+*		OSM_DUMP_BIN_TYPE_LFTS or OSM_DUMP_BIN_TYPE_LID_MATRIX.
+*
+*	num_switches
+*		Number of osm_dump_bin_sw_t entries following the header.
+*
+*	num_lids
+*		Number of LIDs in every switch table, the highest LID plus one.
+*
+* SEE ALSO
+*	osm_dump_bin_sw_t
+*********/
+
+/****s* OpenSM: Dump/osm_dump_bin_sw_t
+* NAME
+*	osm_dump_bin_sw_t
+*
+* DESCRIPTION
+*	Switch entry of the binary dump files.
+*
+* SYNOPSIS
+*/
+typedef struct osm_dump_bin_sw {
+	uint64_t guid;
+	uint64_t offset;
+	uint16_t lid;
+	uint8_t num_ports;
+	uint8_t reserved[5];
+} osm_dump_bin_sw_t;
+/*
+* FIELDS
+*	guid
+*		Node GUID of the switch.
+*
+*	offset
+*		Offset of the switch table from the start of the file.
+*
+*	lid
+*		LID of the switch.
+*
+*	num_ports
+*		Number of ports of the switch, including port 0.
+*
+* SEE ALSO
+*	osm_dump_bin_hdr_t
+*********/
+
+struct osm_dump_snapshot;
+
+/****s* OpenSM: Dump/osm_dumper_t
+* NAME
+*	osm_dumper_t
+*
+* DESCRIPTION
+*	Background dumper thread.
+*
+* SYNOPSIS
+*/
+typedef struct osm_dumper {
+	cl_thread_t thread;
+	cl_event_t signal_event;
+	cl_spinlock_t lock;
+	osm_thread_state_t thread_state;
+	struct osm_dump_snapshot *p_pending;
+} osm_dumper_t;
+/*
+* FIELDS
+*	thread
+*		Thread writing the dump files.
+*
+*	signal_event
+*		Signaled when a new snapshot is pending.
+*
+*	lock
+*		Protects p_pending.
+*
+*	thread_state
+*		State of the dumper thread.
+*
+*	p_pending
+*		Snapshot waiting to be written.  A newer snapshot replaces
+*		it, so only the latest state is written when sweeps
+*		complete faster than the files can be written.
+*
+* SEE ALSO
+*	osm_dump_all
+*********/
+
+/****f* OpenSM: Dump/osm_dumper_construct
+* NAME
+*	osm_dumper_construct
+*
+* DESCRIPTION
+*	Constructs the dumper object.
+*
+* SYNOPSIS
+*/
+void osm_dumper_construct(IN osm_dumper_t * p_dumper);
+/*
+* PARAMETERS
+*	p_dumper
+*		[in] Pointer to an osm_dumper_t object to construct.
+*
+* SEE ALSO
+*	osm_dumper_init, osm_dumper_destroy
+*********/
+
+/****f* OpenSM: Dump/osm_dumper_init
+* NAME
+*	osm_dumper_init
+*
+* DESCRIPTION
+*	Starts the dumper thread.
+*
+* SYNOPSIS
+*/
+ib_api_status_t osm_dumper_init(IN osm_dumper_t * p_dumper);
+/*
+* PARAMETERS
+*	p_dumper
+*		[in] Pointer to an osm_dumper_t object to initialize.
+*
+* RETURN VALUES
+*	IB_SUCCESS if the dumper thread was started.
+*
+* SEE ALSO
+*	osm_dumper_construct, osm_dumper_destroy
+*********/
+
+/****f* OpenSM: Dump/osm_dumper_destroy
+* NAME
+*	osm_dumper_destroy
+*
+* DESCRIPTION
+*	Stops the dumper thread and drops any snapshot not yet written.
+*	A dump in progress is interrupted when osm_exit_flag is set.
+*
+* SYNOPSIS
+*/
+void osm_dumper_destroy(IN osm_dumper_t * p_dumper);
+/*
+* PARAMETERS
+*	p_dumper
+*		[in] Pointer to an osm_dumper_t object to destroy.
+*
+* SEE ALSO
+*	osm_dumper_construct, osm_dumper_init
+*********/
+
+END_C_DECLS
+#endif				/* _OSM_DUMP_H_ */
@@ -716,5 +716,33 @@ int ib_path_rate_get_next(IN const int rate);
 * SEE ALSO
 *********/
 
+/****f* OpenSM: Helper/osm_crc32
+* NAME
+*	osm_crc32
+*
+* DESCRIPTION
+*	Continues a CRC-32 (IEEE 802.3) over a buffer.
+*
+* SYNOPSIS
+*/
+uint32_t osm_crc32(IN uint32_t crc, IN const void *buffer, IN size_t count);
+/*
+* PARAMETERS
+*	crc
+*		[in] CRC of the preceding data, or 0xFFFFFFFF to start.
+*
+*	buffer
+*		[in] Pointer to the data.
+*
+*	count
+*		[in] Number of bytes in the buffer.
+*
+* RETURN VALUES
+*	Returns the CRC including the buffer.  No final inversion is
+*	applied.
+*
+* SEE ALSO
+*********/
+
 END_C_DECLS
 #endif				/* _OSM_HELPER_H_ */
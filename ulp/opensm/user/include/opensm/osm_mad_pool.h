@@ -45,8 +45,11 @@
 
 #include <iba/ib_types.h>
 #include <complib/cl_atomic.h>
+#include <complib/cl_qlist.h>
+#include <complib/cl_spinlock.h>
 #include <opensm/osm_base.h>
 #include <opensm/osm_madw.h>
+#include <opensm/osm_stats.h>
 #include <vendor/osm_vendor.h>
 
 #ifdef __cplusplus
@@ -69,6 +72,12 @@ BEGIN_C_DECLS
 *
 *	The MAD Pool is thread safe.
 *
+*	MAD wrappers are carved out of slabs of OSM_MAD_POOL_SLAB_SIZE
+*	wrappers that are only released when the pool is destroyed.
+*	Free wrappers are kept in per-thread caches, so that getting and
+*	putting a wrapper only takes the lock of the calling thread's
+*	cache.  Caches refill from, and overflow into, a shared depot.
+*
 *	This object should be treated as opaque and should be
 *	manipulated only through the provided functions.
 *
@@ -76,6 +85,59 @@ BEGIN_C_DECLS
 *	Steve King, Intel
 *
 *********/
+/****d* OpenSM: MAD Pool/OSM_MAD_POOL_SLAB_SIZE
+* NAME
+*	OSM_MAD_POOL_SLAB_SIZE
+*
+* DESCRIPTION
+*	Number of MAD wrappers allocated at once when the pool grows.
+*	This is also the number of wrappers moved between a cache and
+*	the depot at a time.
+*
+* SYNOPSIS
+*/
+#define OSM_MAD_POOL_SLAB_SIZE 256
+/***********/
+
+/****d* OpenSM: MAD Pool/OSM_MAD_POOL_CACHES
+* NAME
+*	OSM_MAD_POOL_CACHES
+*
+* DESCRIPTION
+*	Number of per-thread caches.  Threads are hashed to a cache by
+*	their thread ID.
+*
+* SYNOPSIS
+*/
+#define OSM_MAD_POOL_CACHES 16
+/***********/
+
+/****s* OpenSM: MAD Pool/osm_mad_pool_cache_t
+* NAME
+*	osm_mad_pool_cache_t
+*
+* DESCRIPTION
+*	Free MAD wrappers of the threads hashed to this cache.
+*
+* SYNOPSIS
+*/
+typedef struct osm_mad_pool_cache {
+	cl_spinlock_t lock;
+	cl_qlist_t free_list;
+} osm_mad_pool_cache_t;
+/*
+* FIELDS
+*	lock
+*		Spinlock guarding the free list.
+*
+*	free_list
+*		Free MAD wrappers, most recently put first.  Holds at most
+*		twice OSM_MAD_POOL_SLAB_SIZE wrappers.
+*
+* SEE ALSO
+*	MAD Pool
+*********/
+
 /****s* OpenSM: MAD Pool/osm_mad_pool_t
 * NAME
 *	osm_mad_pool_t
@@ -90,12 +152,34 @@ BEGIN_C_DECLS
 */
 typedef struct osm_mad_pool {
 	atomic32_t mads_out;
+	osm_mad_pool_cache_t caches[OSM_MAD_POOL_CACHES];
+	cl_spinlock_t lock;
+	cl_qlist_t depot;
+	cl_qlist_t slabs;
+	osm_stats_t *p_stats;
 } osm_mad_pool_t;
 /*
 * FIELDS
 *	mads_out
 *		Running total of the number of MADs outstanding.
 *
+*	caches
+*		Per-thread caches of free MAD wrappers.
+*
+*	lock
+*		Spinlock guarding the depot and the slab list.
+*
+*	depot
+*		Free MAD wrappers reclaimed from overflowing caches or
+*		carved out of a new slab, handed out to caches that run
+*		empty.
+*
+*	slabs
+*		All slabs allocated by the pool.
+*
+*	p_stats
+*		Pointer to the OpenSM statistics block, or NULL.
+*
 * SEE ALSO
 *	MAD Pool
 *********/
@@ -134,7 +218,8 @@ void osm_mad_pool_construct(IN osm_mad_pool_t * p_pool);
 *
 * DESCRIPTION
 *	The osm_mad_pool_destroy function destroys a node, releasing
-*	all resources.
+*	all resources.  All MAD wrappers must have been returned to the
+*	pool, since the slabs holding them are freed.
 *
 * SYNOPSIS
 */
@@ -166,12 +251,17 @@ void osm_mad_pool_destroy(IN osm_mad_pool_t * p_pool);
 *
 * SYNOPSIS
 */
-ib_api_status_t osm_mad_pool_init(IN osm_mad_pool_t * p_pool);
+ib_api_status_t osm_mad_pool_init(IN osm_mad_pool_t * p_pool,
+				  IN osm_stats_t * p_stats);
 /*
 * PARAMETERS
 *	p_pool
 *		[in] Pointer to an osm_mad_pool_t object to initialize.
 *
+*	p_stats
+*		[in] Pointer to the OpenSM statistics block the pool reports
+*		its slab count and high-water mark into.  May be NULL.
+*
 * RETURN VALUES
 *	CL_SUCCESS if the MAD Pool was initialized successfully.
 *
@@ -317,6 +317,7 @@ typedef struct osm_perfmgr_context {
 	uint64_t node_guid;
 	uint16_t port;
 	uint8_t mad_method;	/* was this a get or a set */
+	ib_net16_t mad_attr_id;	/* which attribute was queried */
 #if ENABLE_OSM_PERF_MGR_PROFILE
 	struct timeval query_start;
 #endif
@@ -132,6 +132,35 @@ typedef struct osm_mgrp {
 * SEE ALSO
 *********/
 
+/****s* OpenSM: Multicast Group/osm_mgrp_root_member_t
+* NAME
+*	osm_mgrp_root_member_t
+*
+* DESCRIPTION
+*	A member switch of a multicast group, as seen by the last tree root
+*	selection.
+*
+* SYNOPSIS
+*/
+typedef struct osm_mgrp_root_member {
+	ib_net64_t guid;
+	uint32_t num_of_mcm;
+	uint8_t is_mc_member;
+} osm_mgrp_root_member_t;
+/*
+* FIELDS
+*	guid
+*		Node GUID of the switch.
+*
+*	num_of_mcm
+*		Number of member CA ports attached to the switch.
+*
+*	is_mc_member
+*		Whether the switch itself is a member.
+*
+* SEE ALSO
+*********/
+
 /****s* OpenSM: Multicast Group/osm_mgrp_box_t
 * NAME
 *	osm_mgrp_box_t
@@ -145,6 +174,11 @@ typedef struct osm_mgrp_box {
 	uint16_t mlid;
 	cl_qlist_t mgrp_list;
 	osm_mtree_node_t *root;
+	uint64_t root_sig;
+	osm_mgrp_root_member_t *root_members;
+	unsigned root_num_members;
+	ib_net64_t root_guid;
+	uint32_t root_hop_tables_gen;
 } osm_mgrp_box_t;
 /*
 * FIELDS
@@ -160,6 +194,23 @@ typedef struct osm_mgrp_box {
 *	mgrp_list
 *		List of multicast groups (mpgr object) having same MLID value.
 *
+*	root_sig
+*		Signature of the member switches the tree root was chosen for.
+*
+*	root_members, root_num_members
+*		The member switches the tree root was chosen for, sorted by
+*		GUID.  Equal signatures do not prove equal members, so these
+*		are compared before the root is reused.
+*
+*	root_guid
+*		Node GUID of the switch chosen as the tree root, or zero if
+*		none was chosen yet.
+*
+*	root_hop_tables_gen
+*		Unicast manager hop_tables_gen at the time the root was chosen.
+*		The root is reused while both the member switches and the
+*		generation are unchanged.
+*
 * SEE ALSO
 *********/
 
@@ -57,6 +57,7 @@
 #include <opensm/osm_perfmgr.h>
 #include <opensm/osm_event_plugin.h>
 #include <opensm/osm_db.h>
+#include <opensm/osm_dump.h>
 #include <opensm/osm_subnet.h>
 #include <opensm/osm_mad_pool.h>
 #include <opensm/osm_vl15intf.h>
@@ -107,6 +108,7 @@ typedef enum _osm_routing_engine_type {
 	OSM_ROUTING_ENGINE_TYPE_LASH,
 	OSM_ROUTING_ENGINE_TYPE_DOR,
 	OSM_ROUTING_ENGINE_TYPE_TORUS_2QOS,
+	OSM_ROUTING_ENGINE_TYPE_DFSSSP,
 	OSM_ROUTING_ENGINE_TYPE_UNKNOWN
 } osm_routing_engine_type_t;
 /***********/
@@ -132,8 +134,7 @@ struct osm_routing_engine {
 			     IN uint8_t in_port_num, IN uint8_t out_port_num,
 			     IN OUT ib_slvl_table_t *t);
 	uint8_t (*path_sl)(void *context, IN uint8_t path_sl_hint,
-			   IN const osm_port_t *src_port,
-			   IN const osm_port_t *dst_port);
+			   IN const ib_net16_t slid, IN const ib_net16_t dlid);
 	ib_api_status_t (*mcast_build_stree)(void *context,
 					     IN OUT osm_mgrp_box_t *mgb);
 	void (*destroy) (void *context);
@@ -167,7 +168,9 @@ struct osm_routing_engine {
 *		in_port_num/out_port_num should be ignored.
 *
 *	path_sl
-*		The callback for computing path SL.
+*		The callback for computing path SL.  slid and dlid are the
+*		LIDs the path uses, including any LMC offset, since engines
+*		may route the LIDs of one port on different layers.
 *
 *	mcast_build_stree
 *		The callback for building the spanning tree for multicast
@@ -216,6 +219,7 @@ typedef struct osm_opensm {
 	osm_stats_t stats;
 	osm_console_t console;
 	nn_map_t *node_name_map;
+	osm_dumper_t dumper;
 } osm_opensm_t;
 /*
 * FIELDS
@@ -266,6 +270,9 @@ typedef struct osm_opensm {
 *	stats
 *		Open SM statistics block
 *
+*	dumper
+*		Background thread writing the routing dump files.
+*
 * SEE ALSO
 *********/
 
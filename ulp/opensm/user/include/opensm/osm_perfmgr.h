@@ -75,6 +75,48 @@ extern "C" {
 #define OSM_PERFMGR_DEFAULT_SWEEP_TIME_S 180
 #define OSM_PERFMGR_DEFAULT_DUMP_FILE "opensm_port_counters.log"
 #define OSM_PERFMGR_DEFAULT_MAX_OUTSTANDING_QUERIES 500
+#define OSM_PERFMGR_EXPORT_SOCKET_PREFIX "unix:"
+
+/****s* OpenSM: PerfMgr/osm_perfmgr_export_rec_t
+* NAME
+*	osm_perfmgr_export_rec_t
+*
+* DESCRIPTION
+*	Counter sample streamed when perfmgr_export_binary is set.
+*	Fields are in the byte order of the host running OpenSM.
+*
+* SYNOPSIS
+*/
+typedef struct osm_perfmgr_export_rec {
+	uint64_t node_guid;
+	uint64_t time;
+	uint32_t xmit_data;
+	uint32_t rcv_data;
+	uint32_t xmit_pkts;
+	uint32_t rcv_pkts;
+	uint16_t time_delta;
+	uint16_t err;
+	uint8_t port;
+	uint8_t reserved[3];
+} osm_perfmgr_export_rec_t;
+/*
+* FIELDS
+*	time
+*		Time of the sample, in seconds since the Epoch.
+*
+*	time_delta
+*		Seconds since the previous sample of the port.
+*
+*	xmit_data, rcv_data, xmit_pkts, rcv_pkts
+*		Counter changes since the previous sample, data in units
+*		of 4 octets.
+*
+*	err
+*		Sum of the error counter changes since the previous sample.
+*
+* SEE ALSO
+*	perfmgr_db_sample_t
+*********/
 
 /****s* OpenSM: PerfMgr/osm_perfmgr_state_t */
 typedef enum {
@@ -100,6 +142,10 @@ typedef struct monitored_port {
 	ib_net16_t lid;
 	ib_net16_t pkey;
 	ib_net32_t qp;
+	/* Adaptive polling */
+	uint8_t interval;
+	uint8_t skipped;
+	boolean_t busy;
 } monitored_port_t;
 
 /* Node to store information about nodes being monitored */
@@ -110,6 +156,9 @@ typedef struct monitored_node {
 	boolean_t esp0;
 	char *name;
 	uint32_t num_ports;
+	uint16_t slot;
+	boolean_t cpi_valid;
+	ib_net16_t cap_mask;
 	monitored_port_t port[1];
 } monitored_node_t;
 
@@ -142,6 +191,13 @@ typedef struct osm_perfmgr {
 	monitored_node_t *remove_list;
 	ib_net64_t port_guid;
 	int16_t local_port;
+	uint16_t history_samples;
+	FILE *export_fp;
+	int export_sock;
+	uint16_t max_interval_s;
+	boolean_t spread_queries;
+	uint16_t sweep_slot;
+	uint16_t next_slot;
 } osm_perfmgr_t;
 /*
 * FIELDS
@@ -156,6 +212,25 @@ typedef struct osm_perfmgr {
 *
 *	mad_ctrl
 *	      Mad Controller
+*
+*	history_samples
+*	      Number of counter samples kept per port.
+*
+*	export_fp, export_sock
+*	      Where the counter samples are streamed to, if opened.
+*
+*	max_interval_s
+*	      Longest time between two queries of an idle port, 0 to
+*	      query every port on every sweep.
+*
+*	spread_queries
+*	      Spread the queries of a sweep over the sweep time.
+*
+*	sweep_slot
+*	      Part of the sweep being queried when spreading the queries.
+*
+*	next_slot
+*	      Slot given to the next node added to the monitored map.
 *********/
 
 /****f* OpenSM: Creation Functions */
@@ -108,6 +108,42 @@ typedef struct {
 	time_t time;
 } perfmgr_db_data_cnt_reading_t;
 
+/** =========================================================================
+ * Port counter sample
+ * Changes of the counters over time_delta seconds, saturated to the
+ * width of the fields.  err is the sum of all the error counters,
+ * the data counters are in units of 4 octets.
+ */
+typedef struct {
+	uint16_t time_delta;
+	uint16_t err;
+	uint32_t xmit_data;
+	uint32_t rcv_data;
+	uint32_t xmit_pkts;
+	uint32_t rcv_pkts;
+} perfmgr_db_sample_t;
+
+/** =========================================================================
+ * Port rates averaged over the samples in the history
+ */
+typedef struct {
+	uint32_t samples;
+	uint32_t interval_s;
+	double xmit_bytes_ps;
+	double rcv_bytes_ps;
+	double xmit_pkts_ps;
+	double rcv_pkts_ps;
+	double err_ps;
+} perfmgr_db_rate_t;
+
+/** =========================================================================
+ * Called for every sample not exported yet, oldest first
+ */
+typedef void (*perfmgr_db_export_fn_t) (uint64_t guid, uint8_t port,
+					time_t time,
+					perfmgr_db_sample_t * sample,
+					void *context);
+
 /** =========================================================================
  * Dump output options
  */
@@ -126,6 +162,12 @@ typedef struct db_port {
 	perfmgr_db_data_cnt_reading_t dc_total;
 	perfmgr_db_data_cnt_reading_t dc_previous;
 	time_t last_reset;
+	perfmgr_db_sample_t *hist;	/* ring of hist_size samples */
+	uint16_t hist_head;	/* slot of the next sample */
+	uint16_t hist_count;
+	uint16_t hist_unexported;
+	time_t hist_time;	/* time of the newest sample */
+	uint64_t hist_err;	/* errors since the newest sample */
 } db_port_t;
 
 /** =========================================================================
@@ -139,6 +181,7 @@ typedef struct db_node {
 	db_port_t *ports;
 	uint8_t num_ports;
 	char node_name[NODE_NAME_SIZE];
+	perfmgr_db_sample_t *hist;	/* history of all the ports */
 } db_node_t;
 
 /** =========================================================================
@@ -148,6 +191,7 @@ typedef struct perfmgr_db {
 	cl_qmap_t pc_data;	/* stores type (db_node_t *) */
 	cl_plock_t lock;
 	struct osm_perfmgr *perfmgr;
+	uint16_t hist_size;	/* samples per port, 0 if no history */
 } perfmgr_db_t;
 
 /**
@@ -180,6 +224,15 @@ perfmgr_db_err_t perfmgr_db_get_prev_dc(perfmgr_db_t * db, uint64_t guid,
 perfmgr_db_err_t perfmgr_db_clear_prev_dc(perfmgr_db_t * db, uint64_t guid,
 					  uint8_t port);
 
+perfmgr_db_err_t perfmgr_db_add_sample(perfmgr_db_t * db, uint64_t guid,
+				       uint8_t port,
+				       perfmgr_db_data_cnt_reading_t *
+				       reading);
+perfmgr_db_err_t perfmgr_db_get_rates(perfmgr_db_t * db, uint64_t guid,
+				      uint8_t port, perfmgr_db_rate_t * rates);
+void perfmgr_db_export(perfmgr_db_t * db, perfmgr_db_export_fn_t export_fn,
+		       void *context);
+
 void perfmgr_db_clear_counters(perfmgr_db_t * db);
 perfmgr_db_err_t perfmgr_db_dump(perfmgr_db_t * db, char *file,
 				 perfmgr_db_dump_t dump_type);
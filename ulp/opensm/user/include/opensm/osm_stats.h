@@ -93,6 +93,8 @@ typedef struct osm_stats {
 	atomic32_t sa_mads_sent;
 	atomic32_t sa_mads_rcvd_unknown;
 	atomic32_t sa_mads_ignored;
+	uint32_t mad_pool_slabs;
+	atomic32_t mad_pool_high_water;
 #ifdef HAVE_LIBPTHREAD
 	pthread_mutex_t mutex;
 	pthread_cond_t cond;
@@ -143,6 +145,12 @@ typedef struct osm_stats {
 *		Total number of SA MADs received because SM is not
 *		master or SM is in first time sweep.
 *
+*	mad_pool_slabs
+*		Number of MAD wrapper slabs allocated by the MAD pool.
+*
+*	mad_pool_high_water
+*		Highest number of MAD wrappers outstanding at once.
+*
 * SEE ALSO
 ***************/
 
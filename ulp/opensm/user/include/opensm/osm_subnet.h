@@ -151,6 +151,7 @@ typedef struct osm_subn_opt {
 	uint32_t max_wire_smps;
 	uint32_t max_wire_smps2;
 	uint32_t max_smps_timeout;
+	uint32_t max_wire_smps_per_node;
 	uint32_t transaction_timeout;
 	uint32_t transaction_retries;
 	uint8_t sm_priority;
@@ -180,6 +181,8 @@ typedef struct osm_subn_opt {
 	boolean_t force_heavy_sweep;
 	uint8_t log_flags;
 	char *dump_files_dir;
+	boolean_t dump_files_async;
+	boolean_t dump_files_binary;
 	char *log_file;
 	unsigned long log_max_size;
 	char *partition_config_file;
@@ -196,6 +199,8 @@ typedef struct osm_subn_opt {
 	boolean_t sweep_on_trap;
 	char *routing_engine_names;
 	boolean_t use_ucast_cache;
+	uint32_t mcast_threads;
+	uint32_t path_aggr_max_mb;
 	boolean_t connect_roots;
 	char *lid_matrix_dump_file;
 	char *lfts_file;
@@ -204,6 +209,7 @@ typedef struct osm_subn_opt {
 	char *io_guid_file;
 	boolean_t port_shifting;
 	uint32_t scatter_ports;
+	uint32_t ftree_threads;
 	uint16_t max_reverse_hops;
 	char *ids_guid_file;
 	char *guid_routing_order_file;
@@ -213,6 +219,7 @@ typedef struct osm_subn_opt {
 	boolean_t do_mesh_analysis;
 	boolean_t exit_on_fatal;
 	boolean_t honor_guid2lid_file;
+	boolean_t db_binary_log;
 	boolean_t daemon;
 	boolean_t sm_inactive;
 	boolean_t babbling_port_policy;
@@ -229,6 +236,11 @@ typedef struct osm_subn_opt {
 	boolean_t perfmgr_redir;
 	uint16_t perfmgr_sweep_time_s;
 	uint32_t perfmgr_max_outstanding_queries;
+	uint16_t perfmgr_max_interval_s;
+	boolean_t perfmgr_spread_queries;
+	uint16_t perfmgr_history_samples;
+	char *perfmgr_export_file;
+	boolean_t perfmgr_export_binary;
 	char *event_db_dump_file;
 #endif				/* ENABLE_OSM_PERF_MGR */
 	char *event_plugin_name;
@@ -281,6 +293,11 @@ typedef struct osm_subn_opt {
 *		The wait time in usec for timeout based SMPs.  Default is
 *		timeout * retries.
 *
+*	max_wire_smps_per_node
+*		The maximum number of SMPs outstanding to a single node, so
+*		that a slow or unresponsive node cannot hold the whole
+*		max_wire_smps window.  Zero means no limit.  Default is 2.
+*
 *	transaction_timeout
 *		The maximum time in milliseconds allowed for a transaction
 *		to complete.  Default is 200.
@@ -361,6 +378,15 @@ typedef struct osm_subn_opt {
 *		opensm.mcfdbs, and default log file (the latter for Windows,
 *		not Linux).
 *
+*	dump_files_async
+*		When TRUE, the LID matrix and LFT dumps are written by a
+*		background thread from a copy of the switch tables.
+*
+*	dump_files_binary
+*		When TRUE, the LID matrix and LFT dumps are also written
+*		in binary format to opensm-lid-matrix.bin and
+*		opensm-lfts.bin.
+*
 *	log_file
 *		Name of the log file (or NULL) for stdout.
 *
@@ -402,6 +428,16 @@ typedef struct osm_subn_opt {
 *	use_ucast_cache
 *		When TRUE enables unicast routing cache.
 *
+*	mcast_threads
+*		Number of threads used to find the multicast tree roots.
+*		Zero means one per processor.
+*
+*	path_aggr_max_mb
+*		Memory, in MB, the path parameters precomputed for the SA
+*		may use for all switches together.  When the fabric needs
+*		more, only the lower LIDs are precomputed and the SA walks
+*		the paths to the others.  Zero disables the precomputation.
+*
 *	lid_matrix_dump_file
 *		Name of the lid matrix dump file from where switch
 *		lid matrices (min hops tables) will be loaded
@@ -457,6 +493,13 @@ typedef struct osm_subn_opt {
 *		means that the file will be honored when SM is coming out of
 *		STANDBY. By default this is FALSE.
 *
+*	db_binary_log
+*		Keep the persistent database (guid2lid) in an append-only
+*		binary log (guid2lid.bin) instead of the text file, so that
+*		only the changed entries are written on each sweep. The text
+*		file is only read when the binary log is empty.
+*		By default this is FALSE.
+*
 *	daemon
 *		OpenSM will run in daemon mode.
 *
@@ -479,6 +522,26 @@ typedef struct osm_subn_opt {
 *	perfmgr_sweep_time_s
 *		Define the period (in seconds) of PerfMgr sweeps
 *
+*	perfmgr_max_interval_s
+*		Ports whose counters do not change are queried less often,
+*		up to this period (in seconds); 0 queries every port on
+*		every PerfMgr sweep
+*
+*	perfmgr_spread_queries
+*		Spread the PerfMgr queries over the sweep period instead
+*		of issuing them all at the start of the sweep
+*
+*	perfmgr_history_samples
+*		Number of counter samples kept per port by PerfMgr for
+*		rate computation, 0 disables the history
+*
+*	perfmgr_export_file
+*		File (or "unix:<path>" datagram socket) the PerfMgr
+*		streams the counter samples to
+*
+*	perfmgr_export_binary
+*		Stream the counter samples as binary records instead of CSV
+*
 *       event_db_dump_file
 *               File to dump the event database to
 *
@@ -514,6 +577,12 @@ typedef struct osm_subn_opt {
 *		When not zero, randomize best possible ports chosen
 *		for a route. The value is used as a random key seed.
 *
+*	ftree_threads
+*		Number of threads the fat-tree routing engine uses to route
+*		compute nodes.  The leaf switches are split into as many
+*		partitions, so the routes depend on this value but not on
+*		thread scheduling.  1 routes sequentially.
+*
 * SEE ALSO
 *	Subnet object
 *********/
@@ -79,6 +79,80 @@ BEGIN_C_DECLS
 *	Steve King, Intel
 *
 *********/
+/****d* OpenSM: Switch/osm_path_aggr_state_t
+* NAME
+*	osm_path_aggr_state_t
+*
+* DESCRIPTION
+*	State of a precomputed path parameters entry.
+*
+* SYNOPSIS
+*/
+typedef enum _osm_path_aggr_state {
+	OSM_PATH_AGGR_NONE = 0,
+	OSM_PATH_AGGR_VALID,
+	OSM_PATH_AGGR_BAD,
+	OSM_PATH_AGGR_BUSY
+} osm_path_aggr_state_t;
+/*
+* OSM_PATH_AGGR_NONE
+*	Not computed, e.g. the LID is not assigned to any port.
+*
+* OSM_PATH_AGGR_VALID
+*	The entry holds the parameters of the path.
+*
+* OSM_PATH_AGGR_BAD
+*	Walking the path fails, e.g. on a dead end or a loop.
+*
+* OSM_PATH_AGGR_BUSY
+*	Used while the entries are built to detect LFT loops.
+*********/
+
+/****s* OpenSM: Switch/osm_path_aggr_t
+* NAME
+*	osm_path_aggr_t
+*
+* DESCRIPTION
+*	Path parameters from the port through which a switch routes
+*	a LID up to the port of that LID, as collected by the SA when
+*	it walks the path for PathRecord and MultiPathRecord queries.
+*
+* SYNOPSIS
+*/
+typedef struct osm_path_aggr {
+	uint16_t sl_mask;
+	uint8_t mtu;
+	uint8_t rate;
+	uint8_t hops;
+	uint8_t state;
+} osm_path_aggr_t;
+/*
+* FIELDS
+*	sl_mask
+*		SLs that are not mapped to VL15 by any of the switches
+*		along the path.
+*
+*	mtu
+*		Lowest MTU capability of the switch ports along the path.
+*
+*	rate
+*		Lowest rate of the switch ports along the path.
+*
+*	hops
+*		Number of switches traversed after this one.  When zero
+*		the route port is linked to the destination port directly,
+*		and mtu, rate and sl_mask are not used.
+*
+*	state
+*		One of the osm_path_aggr_state_t values.
+*
+* NOTES
+*	The parameters of the destination port itself are not included.
+*
+* SEE ALSO
+*	Switch object, osm_ucast_mgr_build_path_aggr
+*********/
+
 /****s* OpenSM: Switch/osm_switch_t
 * NAME
 *	osm_switch_t
@@ -109,10 +183,9 @@ typedef struct osm_switch {
 	uint32_t mft_position;
 	unsigned endport_links;
 	unsigned need_update;
+	osm_path_aggr_t *path_aggr;
+	uint16_t path_aggr_size;
 	void *priv;
-	cl_map_item_t mgrp_item;
-	uint32_t num_of_mcm;
-	uint8_t is_mc_member;
 } osm_switch_t;
 /*
 * FIELDS
@@ -155,14 +228,12 @@ typedef struct osm_switch {
 *		When set indicates that switch was probably reset, so
 *		fwd tables and rest cached data should be flushed
 *
-*	mgrp_item
-*		map item for switch in building mcast tree
+*	path_aggr
+*		Path parameters to every LID, precomputed after the
+*		switches are configured.  NULL when not valid.
 *
-*	num_of_mcm
-*		number of mcast members(ports) connected to switch
-*
-*	is_mc_member
-*		whether switch is a mcast member itself
+*	path_aggr_size
+*		Number of entries in path_aggr.
 *
 * SEE ALSO
 *	Switch object
@@ -492,6 +563,40 @@ static inline osm_physp_t *osm_switch_get_route_by_lid(IN const osm_switch_t *
 *	Switch object
 *********/
 
+/****f* OpenSM: Switch/osm_switch_get_path_aggr
+* NAME
+*	osm_switch_get_path_aggr
+*
+* DESCRIPTION
+*	Returns the precomputed path parameters from this switch
+*	to the specified LID.
+*
+* SYNOPSIS
+*/
+static inline const osm_path_aggr_t *
+osm_switch_get_path_aggr(IN const osm_switch_t * p_sw, IN uint16_t lid_ho)
+{
+	if (!p_sw->path_aggr || lid_ho >= p_sw->path_aggr_size ||
+	    p_sw->path_aggr[lid_ho].state != OSM_PATH_AGGR_VALID)
+		return NULL;
+	return &p_sw->path_aggr[lid_ho];
+}
+/*
+* PARAMETERS
+*	p_sw
+*		[in] Pointer to an osm_switch_t object.
+*
+*	lid_ho
+*		[in] LID (host order) of the destination.
+*
+* RETURN VALUES
+*	Pointer to the path parameters, or NULL if they are not known
+*	and the path has to be walked.
+*
+* SEE ALSO
+*	Switch object, osm_path_aggr_t
+*********/
+
 /****f* OpenSM: Switch/osm_switch_sp0_is_lmc_capable
 * NAME
 *	osm_switch_sp0_is_lmc_capable
@@ -101,6 +101,7 @@ typedef struct osm_ucast_mgr {
 	boolean_t some_hop_count_set;
 	cl_qmap_t cache_sw_tbl;
 	boolean_t cache_valid;
+	uint32_t hop_tables_gen;
 } osm_ucast_mgr_t;
 /*
 * FIELDS
@@ -133,6 +134,12 @@ typedef struct osm_ucast_mgr {
 *	cache_valid
 *		TRUE if the unicast cache is valid.
 *
+*	hop_tables_gen
+*		Incremented every time the routing engines are run, as they
+*		may change the switches' min hop tables.  Used by the
+*		multicast manager to tell whether cached tree roots are
+*		still valid.
+*
 * SEE ALSO
 *	Unicast Manager object
 *********/
@@ -296,5 +303,55 @@ int osm_ucast_mgr_process(IN osm_ucast_mgr_t * p_mgr);
 * SEE ALSO
 *	Unicast Manager, Node Info Response Controller
 *********/
+
+/****f* OpenSM: Unicast Manager/osm_ucast_mgr_build_path_aggr
+* NAME
+*	osm_ucast_mgr_build_path_aggr
+*
+* DESCRIPTION
+*	Precomputes, for every switch and LID, the path parameters
+*	the SA collects when it walks a path for PathRecord and
+*	MultiPathRecord queries.
+*
+* SYNOPSIS
+*/
+void osm_ucast_mgr_build_path_aggr(IN osm_ucast_mgr_t * p_mgr);
+/*
+* PARAMETERS
+*	p_mgr
+*		[in] Pointer to an osm_ucast_mgr_t object.
+*
+* NOTES
+*	The entries follow the switches' current LFTs, port and SL2VL
+*	tables, so this should be called once the switches have been
+*	configured.
+*
+*	The tables of all switches together are kept within the
+*	path_aggr_max_mb option.  LIDs beyond what fits get no entries,
+*	and the SA walks the paths to them.
+*
+* SEE ALSO
+*	Unicast Manager, osm_path_aggr_t, osm_ucast_mgr_clear_path_aggr
+*********/
+
+/****f* OpenSM: Unicast Manager/osm_ucast_mgr_clear_path_aggr
+* NAME
+*	osm_ucast_mgr_clear_path_aggr
+*
+* DESCRIPTION
+*	Drops the precomputed path parameters, so that the SA walks
+*	the paths until they are built again.
+*
+* SYNOPSIS
+*/
+void osm_ucast_mgr_clear_path_aggr(IN osm_ucast_mgr_t * p_mgr);
+/*
+* PARAMETERS
+*	p_mgr
+*		[in] Pointer to an osm_ucast_mgr_t object.
+*
+* SEE ALSO
+*	Unicast Manager, osm_ucast_mgr_build_path_aggr
+*********/
 END_C_DECLS
 #endif				/* _OSM_UCAST_MGR_H_ */
@@ -101,6 +101,134 @@ typedef enum _osm_vl15_state {
 } osm_vl15_state_t;
 /***********/
 
+/****d* OpenSM: VL15/OSM_VL15_DEST_HASH_SIZE
+* NAME
+*	OSM_VL15_DEST_HASH_SIZE
+*
+* DESCRIPTION
+*	Number of hash buckets the destination queues are chained on.
+*	Must be a power of two.
+*
+* SYNOPSIS
+*/
+#define OSM_VL15_DEST_HASH_SIZE 1024
+/***********/
+
+/****d* OpenSM: VL15/OSM_VL15_BATCH_SIZE
+* NAME
+*	OSM_VL15_BATCH_SIZE
+*
+* DESCRIPTION
+*	Maximum number of MADs the poller takes off the queues
+*	per lock acquisition.
+*
+* SYNOPSIS
+*/
+#define OSM_VL15_BATCH_SIZE 16
+/***********/
+
+/****s* OpenSM: VL15/osm_vl15_dest_t
+* NAME
+*	osm_vl15_dest_t
+*
+* DESCRIPTION
+*	Queue of request MADs for one destination.
+*
+* SYNOPSIS
+*/
+typedef struct osm_vl15_dest {
+	cl_list_item_t list_item;
+	struct osm_vl15_dest *p_next;
+	cl_qlist_t fifo;
+	uint32_t on_wire;
+	boolean_t ready;
+	uint32_t hash;
+	ib_net16_t dlid;
+	uint8_t hop_count;
+	uint8_t path[IB_SUBNET_PATH_HOPS_MAX];
+} osm_vl15_dest_t;
+/*
+* FIELDS
+*	list_item
+*		Linkage on the ready list.  MUST BE FIRST MEMBER!
+*
+*	p_next
+*		Next destination in the same hash bucket, or on the
+*		free list.
+*
+*	fifo
+*		Request MADs waiting to be sent, in posting order.
+*
+*	on_wire
+*		Number of MADs sent from this queue and not yet answered
+*		or timed out.
+*
+*	ready
+*		TRUE while the queue is on the ready list, that is while
+*		it holds MADs and is below the per destination limit.
+*
+*	hash
+*		Hash of the destination, selecting its bucket.
+*
+*	dlid
+*		Destination LID, or IB_LID_PERMISSIVE for directed route
+*		SMPs.
+*
+*	hop_count, path
+*		Hop count and initial path of directed route SMPs.
+*
+* NOTES
+*	Destinations are keyed by LID, or by hop count and initial path
+*	for directed route SMPs.  A queue exists while it holds MADs or
+*	has MADs on the wire, and is then put on the free list for reuse.
+*
+* SEE ALSO
+*	VL15 object
+*********/
+
+/****s* OpenSM: VL15/osm_vl15_sweep_stats_t
+* NAME
+*	osm_vl15_sweep_stats_t
+*
+* DESCRIPTION
+*	Transmit window statistics, reset by osm_vl15_report.
+*
+* SYNOPSIS
+*/
+typedef struct osm_vl15_sweep_stats {
+	uint32_t smps_sent;
+	uint32_t batches;
+	uint64_t wire_sum;
+	uint32_t wire_max;
+	uint32_t window_waits;
+	uint32_t dest_limited;
+} osm_vl15_sweep_stats_t;
+/*
+* FIELDS
+*	smps_sent
+*		Number of request MADs sent.
+*
+*	batches
+*		Number of batches the poller took off the queues.
+*
+*	wire_sum
+*		Sum of the MADs on the wire as each request was sent,
+*		used to compute the average window occupancy.
+*
+*	wire_max
+*		Highest number of MADs on the wire.
+*
+*	window_waits
+*		Number of times the poller waited for a full window.
+*
+*	dest_limited
+*		Number of times a destination queue with MADs left was
+*		parked at the per destination limit.
+*
+* SEE ALSO
+*	VL15 object
+*********/
+
 /****s* OpenSM: VL15/osm_vl15_t
 * NAME
 *	osm_vl15_t
@@ -119,10 +247,14 @@ typedef struct osm_vl15 {
 	uint32_t max_wire_smps;
 	uint32_t max_wire_smps2;
 	uint32_t max_smps_timeout;
+	uint32_t max_smps_per_node;
 	cl_event_t signal;
 	cl_thread_t poller;
-	cl_qlist_t rfifo;
+	cl_qlist_t ready;
 	cl_qlist_t ufifo;
+	osm_vl15_dest_t *dests[OSM_VL15_DEST_HASH_SIZE];
+	osm_vl15_dest_t *free_dests;
+	osm_vl15_sweep_stats_t sweep_stats;
 	cl_spinlock_t lock;
 	osm_vendor_t *p_vend;
 	osm_log_t *p_log;
@@ -145,22 +277,36 @@ typedef struct osm_vl15 {
 *	max_smps_timeout
 *		Wait time in usec for timeout based SMPs.
 *
+*	max_smps_per_node
+*		Maximum number of VL15 MADs on the wire to one destination.
+*		Zero means no limit.
+*
 *	signal
 *		Event on which the poller sleeps.
 *
-*	rfifo
-*		First-in First-out queue for outbound VL15 MADs for which
-*		a response is expected, aka the "response fifo"
+*	ready
+*		Destination queues with request MADs that may be sent now,
+*		serviced round robin.
 *
 *	ufifo
 *		First-in First-out queue for outbound VL15 MADs for which
 *		no response is expected, aka the "unicast fifo".
 *
+*	dests
+*		Hash table of the per destination queues for outbound VL15
+*		MADs for which a response is expected.
+*
+*	free_dests
+*		Destination queues no longer in use, kept for reuse.
+*
+*	sweep_stats
+*		Transmit window statistics since the last report.
+*
 *	poller
 *		Worker thread pool that services the fifo to transmit VL15 MADs
 *
 *	lock
-*		Spinlock guarding the FIFO.
+*		Spinlock guarding the FIFOs and the destination queues.
 *
 *	p_vend
 *		Pointer to the vendor transport object.
@@ -253,7 +399,8 @@ ib_api_status_t osm_vl15_init(IN osm_vl15_t * p_vl15, IN osm_vendor_t * p_vend,
 			      IN osm_log_t * p_log, IN osm_stats_t * p_stats,
 			      IN int32_t max_wire_smps,
 			      IN int32_t max_wire_smps2,
-			      IN uint32_t max_smps_timeout);
+			      IN uint32_t max_smps_timeout,
+			      IN uint32_t max_smps_per_node);
 /*
 * PARAMETERS
 *	p_vl15
@@ -278,6 +425,9 @@ ib_api_status_t osm_vl15_init(IN osm_vl15_t * p_vl15, IN osm_vendor_t * p_vend,
 *	max_smps_timeout
 *		[in] Wait time in usec for timeout based SMPs.
 *
+*	max_smps_per_node
+*		[in] Maximum number of SMPs allowed on the wire to one
+*		     destination, zero for no limit.
 *
 * RETURN VALUES
 *	IB_SUCCESS if the VL15 object was initialized successfully.
@@ -347,6 +497,59 @@ void osm_vl15_poll(IN osm_vl15_t * p_vl);
 *	VL15 object, osm_vl15_construct, osm_vl15_init
 *********/
 
+/****f* OpenSM: VL15/osm_vl15_retire
+* NAME
+*	osm_vl15_retire
+*
+* DESCRIPTION
+*	Releases the window slot a request MAD held at its destination
+*	once the response arrived or the transaction failed.
+*
+* SYNOPSIS
+*/
+void osm_vl15_retire(IN osm_vl15_t * p_vl, IN const osm_madw_t * p_madw);
+/*
+* PARAMETERS
+*	p_vl15
+*		[in] Pointer to an osm_vl15_t object.
+*
+*	p_madw
+*		[in] Pointer to the request MAD wrapper.
+*
+* RETURN VALUES
+*	None.
+*
+* NOTES
+*	Must be called exactly once for every request MAD sent, before
+*	osm_vl15_poll and before the request is returned to the pool.
+*
+* SEE ALSO
+*	VL15 object, osm_vl15_post, osm_vl15_poll
+*********/
+
+/****f* OpenSM: VL15/osm_vl15_report
+* NAME
+*	osm_vl15_report
+*
+* DESCRIPTION
+*	Logs the transmit window statistics gathered since the last
+*	report and resets them.  Called at the end of each sweep.
+*
+* SYNOPSIS
+*/
+void osm_vl15_report(IN osm_vl15_t * p_vl);
+/*
+* PARAMETERS
+*	p_vl15
+*		[in] Pointer to an osm_vl15_t object.
+*
+* RETURN VALUES
+*	None.
+*
+* SEE ALSO
+*	VL15 object
+*********/
+
 /****f* OpenSM: VL15/osm_vl15_shutdown
 * NAME
 *	osm_vl15_shutdown
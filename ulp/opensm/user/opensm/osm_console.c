@@ -447,7 +447,9 @@ static void print_status(osm_opensm_t * p_osm, FILE * out)
 			"   SA unknown MADs rcvd           : %d\n"
 			"   SA MADs ignored                : %d\n"
 			"   SA MAD pool outstanding        : %d\n"
-			"   SM MAD pool outstanding        : %d\n",
+			"   SM MAD pool outstanding        : %d\n"
+			"   MAD pool high water            : %u\n"
+			"   MAD pool slabs                 : %u\n",
 			p_osm->stats.qp0_mads_outstanding,
 			p_osm->stats.qp0_mads_outstanding_on_wire,
 			p_osm->stats.qp0_mads_rcvd,
@@ -460,7 +462,9 @@ static void print_status(osm_opensm_t * p_osm, FILE * out)
 			p_osm->stats.sa_mads_rcvd_unknown,
 			p_osm->stats.sa_mads_ignored,
 			p_osm->sa.p_mad_pool->mads_out,
-			p_osm->sm.p_mad_pool->mads_out
+			p_osm->sm.p_mad_pool->mads_out,
+			p_osm->stats.mad_pool_high_water,
+			p_osm->stats.mad_pool_slabs
 );
 		fprintf(out, "\n   Subnet flags\n"
 			"   ------------\n"
@@ -35,7 +35,8 @@
 
 /*
  * Abstract:
- * Implementation of the osm_db interface using simple text files
+ * Implementation of the osm_db interface using simple text files or
+ * append-only binary log files
  */
 
 #if HAVE_CONFIG_H
@@ -46,8 +47,10 @@
 #include <sys/types.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <opensm/st.h>
 #include <opensm/osm_db.h>
+#include <opensm/osm_helper.h>
 
 /****d* Database/OSM_DB_MAX_LINE_LEN
  * NAME
@@ -73,6 +76,97 @@
 #define OSM_DB_MAX_GUID_LEN 32
 /**********/
 
+/****d* Database/OSM_DB_LOG_MAX_VAL_LEN
+ * NAME
+ * OSM_DB_LOG_MAX_VAL_LEN
+ *
+ * DESCRIPTION
+ * The Maximal value length accepted from a binary log record
+ *
+ * SYNOPSIS
+ */
+#define OSM_DB_LOG_MAX_VAL_LEN 65536
+/**********/
+
+/****d* Database/OSM_DB_LOG_MIN_COMPACT
+ * NAME
+ * OSM_DB_LOG_MIN_COMPACT
+ *
+ * DESCRIPTION
+ * The binary log is compacted when it holds more than twice as many
+ * records as the domain has keys, plus this number
+ *
+ * SYNOPSIS
+ */
+#define OSM_DB_LOG_MIN_COMPACT 1024
+/**********/
+
+#define OSM_DB_LOG_MAGIC	0x4f534d4c	/* "OSML" */
+#define OSM_DB_LOG_VERSION	1
+
+#define OSM_DB_LOG_OP_SET	1
+#define OSM_DB_LOG_OP_DELETE	2
+
+/****s* OpenSM: Database/osm_db_log_hdr_t
+ * NAME
+ * osm_db_log_hdr_t
+ *
+ * DESCRIPTION
+ * Header of a binary log file. It is followed by the records, each
+ *  being an osm_db_log_rec_t followed by the key and the value (with
+ *  no terminating nul). The fields are in host byte order.
+ *
+ * SYNOPSIS
+ */
+typedef struct osm_db_log_hdr {
+	uint32_t magic;
+	uint32_t version;
+} osm_db_log_hdr_t;
+/*
+ * FIELDS
+ *
+ * magic
+ *   OSM_DB_LOG_MAGIC
+ *
+ * version
+ *   OSM_DB_LOG_VERSION
+ *
+ *********/
+
+/****s* OpenSM: Database/osm_db_log_rec_t
+ * NAME
+ * osm_db_log_rec_t
+ *
+ * DESCRIPTION
+ * A binary log record, setting or deleting a single key
+ *
+ * SYNOPSIS
+ */
+typedef struct osm_db_log_rec {
+	uint8_t op;
+	uint8_t reserved;
+	uint16_t key_len;
+	uint32_t val_len;
+	uint32_t crc;
+} osm_db_log_rec_t;
+/*
+ * FIELDS
+ *
+ * op
+ *   OSM_DB_LOG_OP_SET or OSM_DB_LOG_OP_DELETE
+ *
+ * key_len
+ *   Length of the key following the record
+ *
+ * val_len
+ *   Length of the value following the key, zero for a delete
+ *
+ * crc
+ *   CRC32 of the record (with this field zeroed), the key and the value.
+ *   A record failing it was torn by a crash and ends the log.
+ *
+ *********/
+
 /****s* OpenSM: Database/osm_db_domain_imp
  * NAME
  * osm_db_domain_imp
@@ -85,12 +179,40 @@
  */
 typedef struct osm_db_domain_imp {
 	char *file_name;
+	char *text_file_name;
 	st_table *p_hash;
 	cl_spinlock_t lock;
+	st_table *p_dirty;
+	boolean_t compact;
+	unsigned log_records;
 } osm_db_domain_imp_t;
 /*
  * FIELDS
  *
+ * file_name
+ *   The domain file
+ *
+ * text_file_name
+ *   The text file of the domain when using a binary log, restored from
+ *   when the log is empty. NULL for a text domain.
+ *
+ * p_hash
+ *   The domain keys and values
+ *
+ * lock
+ *   Protects the domain
+ *
+ * p_dirty
+ *   Keys updated or deleted since the last store, to be appended to the
+ *   binary log. NULL for a text domain.
+ *
+ * compact
+ *   The binary log does not match the cache and has to be rewritten
+ *   on the next store
+ *
+ * log_records
+ *   The number of records in the binary log
+ *
  * SEE ALSO
  * osm_db_domain_t
  *********/
@@ -106,6 +228,7 @@ typedef struct osm_db_domain_imp {
  */
 typedef struct osm_db_imp {
 	char *db_dir_name;
+	boolean_t binary_log;
 } osm_db_imp_t;
 /*
  * FIELDS
@@ -113,6 +236,9 @@ typedef struct osm_db_imp {
  * db_dir_name
  *   The directory holding the database
  *
+ * binary_log
+ *   Keep the domains in append-only binary log files
+ *
  * SEE ALSO
  * osm_db_t
  *********/
@@ -133,7 +259,10 @@ void osm_db_domain_destroy(IN osm_db_domain_t * p_db_domain)
 	cl_spinlock_destroy(&p_domain_imp->lock);
 
 	st_free_table(p_domain_imp->p_hash);
+	if (p_domain_imp->p_dirty)
+		st_free_table(p_domain_imp->p_dirty);
 	free(p_domain_imp->file_name);
+	free(p_domain_imp->text_file_name);
 	free(p_domain_imp);
 }
 
@@ -149,7 +278,8 @@ void osm_db_destroy(IN osm_db_t * p_db)
 	free(p_db->p_db_imp);
 }
 
-int osm_db_init(IN osm_db_t * p_db, IN osm_log_t * p_log)
+int osm_db_init(IN osm_db_t * p_db, IN osm_log_t * p_log,
+		IN boolean_t binary_log)
 {
 	osm_db_imp_t *p_db_imp;
 	struct stat dstat;
@@ -165,6 +295,7 @@ int osm_db_init(IN osm_db_t * p_db, IN osm_log_t * p_log)
 	p_db_imp->db_dir_name = getenv("OSM_CACHE_DIR");
 	if (!p_db_imp->db_dir_name || !(*p_db_imp->db_dir_name))
 		p_db_imp->db_dir_name = strdup_expand(OSM_DEFAULT_CACHE_DIR);
+	p_db_imp->binary_log = binary_log;
 
 	/* Create the directory if it doesn't exist */
 	/* There is a difference in creating directory between windows and linux */
@@ -208,6 +339,7 @@ osm_db_domain_t *osm_db_domain_init(IN osm_db_t * p_db, IN char *domain_name)
 {
 	osm_db_domain_t *p_domain;
 	osm_db_domain_imp_t *p_domain_imp;
+	osm_db_imp_t *p_db_imp = (osm_db_imp_t *) p_db->p_db_imp;
 	size_t path_len;
 	osm_log_t *p_log = p_db->p_log;
 	FILE *p_file;
@@ -220,9 +352,9 @@ osm_db_domain_t *osm_db_domain_init(IN osm_db_t * p_db, IN char *domain_name)
 
 	p_domain_imp = malloc(sizeof(osm_db_domain_imp_t));
 	CL_ASSERT(p_domain_imp != NULL);
+	memset(p_domain_imp, 0, sizeof(*p_domain_imp));
 
-	path_len = strlen(((osm_db_imp_t *) p_db->p_db_imp)->db_dir_name)
-	    + strlen(domain_name) + 2;
+	path_len = strlen(p_db_imp->db_dir_name) + strlen(domain_name) + 6;
 
 	/* set the domain file name */
 	p_domain_imp->file_name = malloc(path_len);
@@ -233,7 +365,20 @@ osm_db_domain_t *osm_db_domain_init(IN osm_db_t * p_db, IN char *domain_name)
 #else
 		"%s/%s",
 #endif
-		 ((osm_db_imp_t *) p_db->p_db_imp)->db_dir_name, domain_name);
+		 p_db_imp->db_dir_name, domain_name);
+
+	/* a binary log lives next to the text file it replaces */
+	if (p_db_imp->binary_log) {
+		p_domain_imp->text_file_name = p_domain_imp->file_name;
+		p_domain_imp->file_name = malloc(path_len);
+		CL_ASSERT(p_domain_imp->file_name != NULL);
+		snprintf(p_domain_imp->file_name, path_len, "%s.bin",
+			 p_domain_imp->text_file_name);
+		p_domain_imp->p_dirty = st_init_strtable();
+		CL_ASSERT(p_domain_imp->p_dirty != NULL);
+		/* the log is only known to match once restored */
+		p_domain_imp->compact = TRUE;
+	}
 
 	/* make sure the file exists - or exit if not writable */
 	p_file = fopen(p_domain_imp->file_name, "a+");
@@ -241,6 +386,10 @@ osm_db_domain_t *osm_db_domain_init(IN osm_db_t * p_db, IN char *domain_name)
 		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 6102: "
 			"Failed to open the db file:%s\n",
 			p_domain_imp->file_name);
+		if (p_domain_imp->p_dirty)
+			st_free_table(p_domain_imp->p_dirty);
+		free(p_domain_imp->text_file_name);
+		free(p_domain_imp->file_name);
 		free(p_domain_imp);
 		free(p_domain);
 		p_domain = NULL;
@@ -263,12 +412,10 @@ Exit:
 	return p_domain;
 }
 
-int osm_db_restore(IN osm_db_domain_t * p_domain)
+static int db_text_restore(IN osm_log_t * p_log,
+			   IN osm_db_domain_imp_t * p_domain_imp,
+			   IN const char *file_name)
 {
-
-	osm_log_t *p_log = p_domain->p_db->p_log;
-	osm_db_domain_imp_t *p_domain_imp =
-	    (osm_db_domain_imp_t *) p_domain->p_domain_imp;
 	FILE *p_file;
 	int status;
 	char sLine[OSM_DB_MAX_LINE_LEN];
@@ -279,20 +426,13 @@ int osm_db_restore(IN osm_db_domain_t * p_domain)
 	char *endptr = NULL;
 	unsigned int line_num;
 
-	OSM_LOG_ENTER(p_log);
-
-	/* take the lock on the domain */
-	cl_spinlock_acquire(&p_domain_imp->lock);
-
 	/* open the file - read mode */
-	p_file = fopen(p_domain_imp->file_name, "r");
+	p_file = fopen(file_name, "r");
 
 	if (!p_file) {
 		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 6103: "
-			"Failed to open the db file:%s\n",
-			p_domain_imp->file_name);
-		status = 1;
-		goto Exit;
+			"Failed to open the db file:%s\n", file_name);
+		return 1;
 	}
 
 	/* parse the file allocating new hash tables as required */
@@ -326,8 +466,7 @@ int osm_db_restore(IN osm_db_domain_t * p_domain)
 					OSM_LOG(p_log, OSM_LOG_ERROR,
 						"ERR 6104: "
 						"Failed to get key from line:%u : %s (file:%s)\n",
-						line_num, sLine,
-						p_domain_imp->file_name);
+						line_num, sLine, file_name);
 					status = 1;
 					goto EndParsing;
 				}
@@ -335,8 +474,7 @@ int osm_db_restore(IN osm_db_domain_t * p_domain)
 					OSM_LOG(p_log, OSM_LOG_ERROR,
 						"ERR 610A: "
 						"Illegal key from line:%u : %s (file:%s)\n",
-						line_num, sLine,
-						p_domain_imp->file_name);
+						line_num, sLine, file_name);
 					status = 1;
 					goto EndParsing;
 				}
@@ -357,8 +495,7 @@ int osm_db_restore(IN osm_db_domain_t * p_domain)
 			} else if (sLine[0] != '\n') {
 				OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 6105: "
 					"How did we get here? line:%u : %s (file:%s)\n",
-					line_num, sLine,
-					p_domain_imp->file_name);
+					line_num, sLine, file_name);
 				status = 1;
 				goto EndParsing;
 			}
@@ -414,8 +551,179 @@ int osm_db_restore(IN osm_db_domain_t * p_domain)
 
 EndParsing:
 	fclose(p_file);
+	return status;
+}
+
+static uint32_t db_log_rec_crc(IN osm_db_log_rec_t * p_rec,
+			       IN const char *p_key, IN const char *p_val)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	crc = osm_crc32(crc, p_rec, sizeof(*p_rec));
+	crc = osm_crc32(crc, p_key, p_rec->key_len);
+	return osm_crc32(crc, p_val, p_rec->val_len);
+}
+
+/* replay the binary log into the cache. A crash while appending leaves
+   a torn last record which ends the replay, losing only the last store */
+static int db_log_restore(IN osm_log_t * p_log,
+			  IN osm_db_domain_imp_t * p_domain_imp)
+{
+	osm_db_log_hdr_t hdr;
+	osm_db_log_rec_t rec;
+	FILE *p_file;
+	char *p_buf = NULL;
+	char *p_key, *p_val;
+	char *p_prev_key, *p_prev_val;
+	boolean_t was_empty;
+	uint32_t crc;
+	long size, offset;
+	int status = 0;
+
+	was_empty = p_domain_imp->p_hash->num_entries == 0;
+
+	p_file = fopen(p_domain_imp->file_name, "rb");
+	if (!p_file) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 6103: "
+			"Failed to open the db file:%s\n",
+			p_domain_imp->file_name);
+		return 1;
+	}
+
+	/* the log is read at once and replayed from memory */
+	if (fseek(p_file, 0, SEEK_END) || (size = ftell(p_file)) < 0 ||
+	    fseek(p_file, 0, SEEK_SET)) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 6103: "
+			"Failed to read the db file:%s\n",
+			p_domain_imp->file_name);
+		fclose(p_file);
+		return 1;
+	}
+
+	if (size == 0) {
+		fclose(p_file);
+		p_domain_imp->compact = TRUE;
+		/* an empty log - take over the text file if there is one */
+		p_file = fopen(p_domain_imp->text_file_name, "r");
+		if (!p_file)
+			return 0;
+		fclose(p_file);
+		OSM_LOG(p_log, OSM_LOG_VERBOSE, "Converting %s to %s\n",
+			p_domain_imp->text_file_name, p_domain_imp->file_name);
+		return db_text_restore(p_log, p_domain_imp,
+				       p_domain_imp->text_file_name);
+	}
+
+	p_buf = malloc(size);
+	if (!p_buf || fread(p_buf, 1, size, p_file) != (size_t) size ||
+	    size < (long)sizeof(hdr)) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 6103: "
+			"Failed to read the db file:%s\n",
+			p_domain_imp->file_name);
+		p_domain_imp->compact = TRUE;
+		status = 1;
+		goto Exit;
+	}
+
+	memcpy(&hdr, p_buf, sizeof(hdr));
+	if (hdr.magic != OSM_DB_LOG_MAGIC || hdr.version != OSM_DB_LOG_VERSION) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 610C: "
+			"Illegal header in the db file:%s\n",
+			p_domain_imp->file_name);
+		p_domain_imp->compact = TRUE;
+		status = 1;
+		goto Exit;
+	}
+
+	p_domain_imp->log_records = 0;
+	offset = sizeof(hdr);
+	while (size - offset >= (long)sizeof(rec)) {
+		memcpy(&rec, p_buf + offset, sizeof(rec));
+		if ((rec.op != OSM_DB_LOG_OP_SET &&
+		     rec.op != OSM_DB_LOG_OP_DELETE) ||
+		    rec.key_len == 0 || rec.key_len > OSM_DB_MAX_GUID_LEN ||
+		    rec.val_len > OSM_DB_LOG_MAX_VAL_LEN ||
+		    size - offset - (long)sizeof(rec) <
+		    (long)(rec.key_len + rec.val_len))
+			break;
+
+		p_key = p_buf + offset + sizeof(rec);
+		p_val = p_key + rec.key_len;
+		crc = rec.crc;
+		rec.crc = 0;
+		if (db_log_rec_crc(&rec, p_key, p_val) != crc)
+			break;
+
+		p_key = malloc(rec.key_len + 1);
+		memcpy(p_key, p_buf + offset + sizeof(rec), rec.key_len);
+		p_key[rec.key_len] = '\0';
+
+		/* the record replaces any previous value of the key */
+		if (rec.op == OSM_DB_LOG_OP_SET) {
+			p_val = malloc(rec.val_len + 1);
+			memcpy(p_val, p_buf + offset + sizeof(rec) +
+			       rec.key_len, rec.val_len);
+			p_val[rec.val_len] = '\0';
+			OSM_LOG(p_log, OSM_LOG_DEBUG,
+				"Got key:%s value:%s\n", p_key, p_val);
+			if (st_lookup(p_domain_imp->p_hash, (st_data_t) p_key,
+				      (void *)&p_prev_val)) {
+				/* the existing entry keeps its key */
+				st_insert(p_domain_imp->p_hash,
+					  (st_data_t) p_key, (st_data_t) p_val);
+				free(p_prev_val);
+				free(p_key);
+			} else
+				st_insert(p_domain_imp->p_hash,
+					  (st_data_t) p_key, (st_data_t) p_val);
+		} else {
+			p_prev_key = p_key;
+			if (st_delete(p_domain_imp->p_hash,
+				      (void *)&p_prev_key,
+				      (void *)&p_prev_val)) {
+				free(p_prev_key);
+				free(p_prev_val);
+			}
+			free(p_key);
+		}
+
+		p_domain_imp->log_records++;
+		offset += sizeof(rec) + rec.key_len + rec.val_len;
+	}
+
+	if (offset != size) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 610D: "
+			"Ignoring torn record at offset %ld of the db file:%s\n",
+			offset, p_domain_imp->file_name);
+		/* rewrite the log without the torn tail */
+		p_domain_imp->compact = TRUE;
+	} else if (was_empty)
+		p_domain_imp->compact = FALSE;
 
 Exit:
+	free(p_buf);
+	fclose(p_file);
+	return status;
+}
+
+int osm_db_restore(IN osm_db_domain_t * p_domain)
+{
+	osm_log_t *p_log = p_domain->p_db->p_log;
+	osm_db_domain_imp_t *p_domain_imp =
+	    (osm_db_domain_imp_t *) p_domain->p_domain_imp;
+	int status;
+
+	OSM_LOG_ENTER(p_log);
+
+	/* take the lock on the domain */
+	cl_spinlock_acquire(&p_domain_imp->lock);
+
+	if (p_domain_imp->p_dirty)
+		status = db_log_restore(p_log, p_domain_imp);
+	else
+		status = db_text_restore(p_log, p_domain_imp,
+					 p_domain_imp->file_name);
+
 	cl_spinlock_release(&p_domain_imp->lock);
 	OSM_LOG_EXIT(p_log);
 	return status;
@@ -431,6 +739,179 @@ static int dump_tbl_entry(st_data_t key, st_data_t val, st_data_t arg)
 	return ST_CONTINUE;
 }
 
+static void db_log_write_rec(IN FILE * p_file, IN uint8_t op,
+			     IN const char *p_key, IN const char *p_val)
+{
+	osm_db_log_rec_t rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.op = op;
+	rec.key_len = (uint16_t) strlen(p_key);
+	rec.val_len = p_val ? (uint32_t) strlen(p_val) : 0;
+	rec.crc = db_log_rec_crc(&rec, p_key, p_val);
+
+	fwrite(&rec, sizeof(rec), 1, p_file);
+	fwrite(p_key, 1, rec.key_len, p_file);
+	if (rec.val_len)
+		fwrite(p_val, 1, rec.val_len, p_file);
+}
+
+static int write_tbl_entry(st_data_t key, st_data_t val, st_data_t arg)
+{
+	db_log_write_rec((FILE *) arg, OSM_DB_LOG_OP_SET, (char *)key,
+			 (char *)val);
+	return ST_CONTINUE;
+}
+
+struct db_log_context {
+	osm_db_domain_imp_t *p_domain_imp;
+	FILE *p_file;
+};
+
+static int append_dirty_entry(st_data_t key, st_data_t val, st_data_t arg)
+{
+	struct db_log_context *p_cxt = (struct db_log_context *)arg;
+	char *p_key = (char *)key;
+	char *p_val;
+
+	if (st_lookup(p_cxt->p_domain_imp->p_hash, key, (void *)&p_val))
+		db_log_write_rec(p_cxt->p_file, OSM_DB_LOG_OP_SET, p_key,
+				 p_val);
+	else
+		db_log_write_rec(p_cxt->p_file, OSM_DB_LOG_OP_DELETE, p_key,
+				 NULL);
+	p_cxt->p_domain_imp->log_records++;
+
+	free(p_key);
+	return ST_DELETE;
+}
+
+static int clear_dirty_entry(st_data_t key, st_data_t val, st_data_t arg)
+{
+	free((char *)key);
+	return ST_DELETE;
+}
+
+/* make sure what was written reached the disk */
+static int db_log_sync(IN FILE * p_file)
+{
+	if (fflush(p_file))
+		return 1;
+#ifdef __WIN__
+	if (_commit(_fileno(p_file)))
+		return 1;
+#else
+	if (fsync(fileno(p_file)))
+		return 1;
+#endif
+	return ferror(p_file);
+}
+
+static int db_log_compact(IN osm_log_t * p_log,
+			  IN osm_db_domain_imp_t * p_domain_imp)
+{
+	osm_db_log_hdr_t hdr;
+	char *p_tmp_file_name;
+	FILE *p_file;
+	int status;
+
+	p_tmp_file_name = malloc(sizeof(char) *
+				 (strlen(p_domain_imp->file_name) + 8));
+	strcpy(p_tmp_file_name, p_domain_imp->file_name);
+	strcat(p_tmp_file_name, ".tmp");
+
+	p_file = fopen(p_tmp_file_name, "wb");
+	if (!p_file) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 6107: "
+			"Failed to open the db file:%s for writing\n",
+			p_tmp_file_name);
+		status = 1;
+		goto Exit;
+	}
+
+	hdr.magic = OSM_DB_LOG_MAGIC;
+	hdr.version = OSM_DB_LOG_VERSION;
+	fwrite(&hdr, sizeof(hdr), 1, p_file);
+	st_foreach(p_domain_imp->p_hash, write_tbl_entry, (st_data_t) p_file);
+	status = db_log_sync(p_file);
+	if (fclose(p_file))
+		status = 1;
+	if (status) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 610E: "
+			"Failed to write the db file:%s\n", p_tmp_file_name);
+		remove(p_tmp_file_name);
+		goto Exit;
+	}
+
+#ifdef __WIN__
+	/* rename does not replace an existing file, and removing it first
+	   would leave no db at all if the rename then failed */
+	status = MoveFileEx(p_tmp_file_name, p_domain_imp->file_name,
+			    MOVEFILE_REPLACE_EXISTING |
+			    MOVEFILE_WRITE_THROUGH) ? 0 : (int)GetLastError();
+#else
+	status = rename(p_tmp_file_name, p_domain_imp->file_name);
+#endif
+	if (status) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 6108: "
+			"Failed to rename the db file to:%s (err:%u)\n",
+			p_domain_imp->file_name, status);
+		goto Exit;
+	}
+
+	OSM_LOG(p_log, OSM_LOG_DEBUG, "Compacted %u records of %s to %u\n",
+		p_domain_imp->log_records, p_domain_imp->file_name,
+		p_domain_imp->p_hash->num_entries);
+	p_domain_imp->compact = FALSE;
+	p_domain_imp->log_records = p_domain_imp->p_hash->num_entries;
+	st_foreach(p_domain_imp->p_dirty, clear_dirty_entry, (st_data_t) NULL);
+
+Exit:
+	free(p_tmp_file_name);
+	return status;
+}
+
+/* append the keys changed since the last store to the binary log,
+   compacting it when it grew too much */
+static int db_log_store(IN osm_log_t * p_log,
+			IN osm_db_domain_imp_t * p_domain_imp)
+{
+	struct db_log_context context;
+	int status;
+
+	if (p_domain_imp->compact ||
+	    p_domain_imp->log_records + p_domain_imp->p_dirty->num_entries >
+	    2 * p_domain_imp->p_hash->num_entries + OSM_DB_LOG_MIN_COMPACT)
+		return db_log_compact(p_log, p_domain_imp);
+
+	if (p_domain_imp->p_dirty->num_entries == 0)
+		return 0;
+
+	context.p_domain_imp = p_domain_imp;
+	context.p_file = fopen(p_domain_imp->file_name, "ab");
+	if (!context.p_file) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 6107: "
+			"Failed to open the db file:%s for writing\n",
+			p_domain_imp->file_name);
+		return 1;
+	}
+
+	st_foreach(p_domain_imp->p_dirty, append_dirty_entry,
+		   (st_data_t) & context);
+	status = db_log_sync(context.p_file);
+	if (fclose(context.p_file))
+		status = 1;
+	if (status) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR 610E: "
+			"Failed to write the db file:%s\n",
+			p_domain_imp->file_name);
+		/* the tail may be torn, rewrite the whole log next time */
+		p_domain_imp->compact = TRUE;
+	}
+
+	return status;
+}
+
 int osm_db_store(IN osm_db_domain_t * p_domain)
 {
 	osm_log_t *p_log = p_domain->p_db->p_log;
@@ -442,6 +923,15 @@ int osm_db_store(IN osm_db_domain_t * p_domain)
 	OSM_LOG_ENTER(p_log);
 
 	p_domain_imp = (osm_db_domain_imp_t *) p_domain->p_domain_imp;
+
+	if (p_domain_imp->p_dirty) {
+		cl_spinlock_acquire(&p_domain_imp->lock);
+		status = db_log_store(p_log, p_domain_imp);
+		cl_spinlock_release(&p_domain_imp->lock);
+		OSM_LOG_EXIT(p_log);
+		return status;
+	}
+
 	p_tmp_file_name = malloc(sizeof(char) *
 				 (strlen(p_domain_imp->file_name) + 8));
 	strcpy(p_tmp_file_name, p_domain_imp->file_name);
@@ -499,6 +989,12 @@ int osm_db_clear(IN osm_db_domain_t * p_domain)
 
 	cl_spinlock_acquire(&p_domain_imp->lock);
 	st_foreach(p_domain_imp->p_hash, clear_tbl_entry, (st_data_t) NULL);
+	if (p_domain_imp->p_dirty) {
+		st_foreach(p_domain_imp->p_dirty, clear_dirty_entry,
+			   (st_data_t) NULL);
+		/* the binary log no longer matches the cache */
+		p_domain_imp->compact = TRUE;
+	}
 	cl_spinlock_release(&p_domain_imp->lock);
 
 	return 0;
@@ -526,6 +1022,21 @@ int osm_db_keys(IN osm_db_domain_t * p_domain, OUT cl_list_t * p_key_list)
 	return 0;
 }
 
+/* remember a key to be appended to the binary log on the next store */
+static void db_mark_dirty(IN osm_db_domain_imp_t * p_domain_imp,
+			  IN char *p_key)
+{
+	char *p_dirty_key;
+
+	if (!p_domain_imp->p_dirty || p_domain_imp->compact ||
+	    st_is_member(p_domain_imp->p_dirty, (st_data_t) p_key))
+		return;
+
+	p_dirty_key = malloc(sizeof(char) * (strlen(p_key) + 1));
+	strcpy(p_dirty_key, p_key);
+	st_insert(p_domain_imp->p_dirty, (st_data_t) p_dirty_key, 0);
+}
+
 char *osm_db_lookup(IN osm_db_domain_t * p_domain, IN char *p_key)
 {
 	osm_db_domain_imp_t *p_domain_imp =
@@ -558,6 +1069,10 @@ int osm_db_update(IN osm_db_domain_t * p_domain, IN char *p_key, IN char *p_val)
 		OSM_LOG(p_log, OSM_LOG_DEBUG,
 			"Key:%s previously exists in:%s with value:%s\n",
 			p_key, p_domain_imp->file_name, p_prev_val);
+		if (!strcmp(p_prev_val, p_val)) {
+			cl_spinlock_release(&p_domain_imp->lock);
+			return 0;
+		}
 		p_new_key = p_key;
 	} else {
 		/* need to allocate the key */
@@ -575,6 +1090,8 @@ int osm_db_update(IN osm_db_domain_t * p_domain, IN char *p_key, IN char *p_val)
 	if (p_prev_val)
 		free(p_prev_val);
 
+	db_mark_dirty(p_domain_imp, p_key);
+
 	cl_spinlock_release(&p_domain_imp->lock);
 
 	return 0;
@@ -601,6 +1118,7 @@ int osm_db_delete(IN osm_db_domain_t * p_domain, IN char *p_key)
 			res = 1;
 		} else {
 			free(p_prev_val);
+			db_mark_dirty(p_domain_imp, p_key);
 			res = 0;
 		}
 	} else {
@@ -617,6 +1135,58 @@ int osm_db_delete(IN osm_db_domain_t * p_domain, IN char *p_key)
 #ifdef TEST_OSMDB
 #include <stdlib.h>
 #include <math.h>
+#include <complib/cl_timer.h>
+
+/* time storing and restoring num_keys guid2lid like entries */
+static void bench(osm_log_t * p_log, int num_keys, boolean_t binary_log)
+{
+	osm_db_t db;
+	osm_db_domain_t *p_dbd;
+	char key_buf[32];
+	char val_buf[32];
+	uint64_t start;
+	int i;
+
+	osm_db_construct(&db);
+	if (osm_db_init(&db, p_log, binary_log)) {
+		printf("db init failed\n");
+		exit(1);
+	}
+
+	p_dbd = osm_db_domain_init(&db, binary_log ? "bench_bin" : "bench_text");
+	osm_db_restore(p_dbd);
+
+	for (i = 0; i < num_keys; i++) {
+		sprintf(key_buf, "0x%016x", i);
+		sprintf(val_buf, "%u %u", i + 1, i + 1);
+		osm_db_update(p_dbd, key_buf, val_buf);
+	}
+	start = cl_get_time_stamp();
+	osm_db_store(p_dbd);
+	printf("%s: full store of %d keys: %" PRIu64 " usec\n",
+	       binary_log ? "binary" : "text", num_keys,
+	       cl_get_time_stamp() - start);
+
+	/* a sweep moving one LID in a hundred */
+	for (i = 0; i < num_keys; i += 100) {
+		sprintf(key_buf, "0x%016x", i);
+		sprintf(val_buf, "%u %u", num_keys + i + 1, num_keys + i + 1);
+		osm_db_update(p_dbd, key_buf, val_buf);
+	}
+	start = cl_get_time_stamp();
+	osm_db_store(p_dbd);
+	printf("%s: store of %d changed keys: %" PRIu64 " usec\n",
+	       binary_log ? "binary" : "text", (num_keys + 99) / 100,
+	       cl_get_time_stamp() - start);
+
+	osm_db_clear(p_dbd);
+	start = cl_get_time_stamp();
+	osm_db_restore(p_dbd);
+	printf("%s: restore: %" PRIu64 " usec\n",
+	       binary_log ? "binary" : "text", cl_get_time_stamp() - start);
+
+	osm_db_destroy(&db);
+}
 
 int main(int argc, char **argv)
 {
@@ -632,10 +1202,18 @@ int main(int argc, char **argv)
 	cl_list_construct(&keys);
 	cl_list_init(&keys, 10);
 
-	osm_log_init_v2(&log, TRUE, 0xff, "/var/log/osm_db_test.log", 0, FALSE);
+	osm_log_init_v2(&log, TRUE, argc > 1 ? OSM_LOG_ERROR : 0xff,
+			"/var/log/osm_db_test.log", 0, FALSE);
+
+	/* osm_db_test <num_keys> compares the text and binary formats */
+	if (argc > 1) {
+		bench(&log, atoi(argv[1]), FALSE);
+		bench(&log, atoi(argv[1]), TRUE);
+		exit(0);
+	}
 
 	osm_db_construct(&db);
-	if (osm_db_init(&db, &log)) {
+	if (osm_db_init(&db, &log, FALSE)) {
 		printf("db init failed\n");
 		exit(1);
 	}
@@ -296,71 +296,248 @@ static void dump_mcast_routes(cl_map_item_t * item, FILE * file, void *cxt)
 	}
 }
 
-static void dump_lid_matrix(cl_map_item_t * item, FILE * file, void *cxt)
+/*
+ * The LID matrix and LFT dumps are written from a copy of the switch
+ * tables, so that they can be written while the SM goes on changing
+ * the tables.
+ */
+struct dump_lid {
+	ib_net64_t port_guid;
+	uint8_t node_type;
+	char *desc;
+};
+
+struct dump_sw {
+	ib_net64_t guid;
+	ib_net16_t lid;
+	uint16_t max_lid_ho;
+	uint8_t num_ports;
+	char *desc;
+	uint8_t *lft;
+	uint8_t *hops;
+};
+
+#define DUMP_LFT	(1 << 0)
+#define DUMP_HOPS	(1 << 1)
+
+struct osm_dump_snapshot {
+	osm_log_t *p_log;
+	char *dir;
+	boolean_t binary;
+	uint16_t max_lid_ho;
+	struct dump_lid *lids;
+	unsigned num_sws;
+	struct dump_sw *sws;
+};
+
+static void dump_sw_destroy(struct dump_sw *sw)
+{
+	free(sw->desc);
+	free(sw->lft);
+	free(sw->hops);
+}
+
+static int dump_sw_init(struct dump_sw *sw, osm_switch_t * p_sw,
+			unsigned what)
 {
-	osm_switch_t *p_sw = (osm_switch_t *) item;
-	osm_opensm_t *p_osm = cxt;
 	osm_node_t *p_node = p_sw->p_node;
-	unsigned max_lid = p_sw->max_lid_ho;
-	unsigned max_port = p_sw->num_ports;
+	unsigned lid, n;
+
+	memset(sw, 0, sizeof(*sw));
+	sw->guid = osm_node_get_node_guid(p_node);
+	sw->lid = osm_node_get_base_lid(p_node, 0);
+	sw->max_lid_ho = p_sw->max_lid_ho;
+	sw->num_ports = p_sw->num_ports;
+	sw->desc = strdup(p_node->print_desc);
+	if (!sw->desc)
+		goto Error;
+
+	if (what & DUMP_LFT) {
+		sw->lft = malloc(sw->max_lid_ho + 1);
+		if (!sw->lft)
+			goto Error;
+		n = sw->max_lid_ho + 1;
+		if (n > p_sw->lft_size)
+			n = p_sw->lft_size;
+		memset(sw->lft, OSM_NO_PATH, sw->max_lid_ho + 1);
+		if (p_sw->lft && n > 1)
+			memcpy(sw->lft + 1, p_sw->lft + 1, n - 1);
+	}
+
+	if (what & DUMP_HOPS) {
+		n = sw->num_ports;
+		sw->hops = malloc((sw->max_lid_ho + 1) * n);
+		if (!sw->hops)
+			goto Error;
+		memset(sw->hops, OSM_NO_PATH, (sw->max_lid_ho + 1) * n);
+		for (lid = 1; lid <= sw->max_lid_ho; lid++)
+			if (p_sw->hops && lid < p_sw->num_hops &&
+			    p_sw->hops[lid])
+				memcpy(sw->hops + lid * n, p_sw->hops[lid], n);
+	}
+
+	return 0;
+
+Error:
+	dump_sw_destroy(sw);
+	return -1;
+}
+
+static void dump_snapshot_free(struct osm_dump_snapshot *snap)
+{
+	unsigned i;
+
+	if (snap->lids)
+		for (i = 0; i <= snap->max_lid_ho; i++)
+			free(snap->lids[i].desc);
+	for (i = 0; i < snap->num_sws; i++)
+		dump_sw_destroy(&snap->sws[i]);
+	free(snap->lids);
+	free(snap->sws);
+	free(snap->dir);
+	free(snap);
+}
+
+static struct osm_dump_snapshot *dump_snapshot_take(osm_opensm_t * p_osm,
+						    unsigned what)
+{
+	struct osm_dump_snapshot *snap;
+	osm_subn_t *p_subn = &p_osm->subn;
+	osm_switch_t *p_sw;
+	osm_port_t *p_port;
+	unsigned i, size;
+
+	snap = calloc(1, sizeof(*snap));
+	if (!snap)
+		return NULL;
+
+	snap->p_log = &p_osm->log;
+	snap->dir = strdup(p_subn->opt.dump_files_dir);
+	size = cl_ptr_vector_get_size(&p_subn->port_lid_tbl);
+	snap->max_lid_ho = (uint16_t) (size ? size - 1 : 0);
+	snap->lids = calloc(snap->max_lid_ho + 1, sizeof(snap->lids[0]));
+	if (!snap->dir || !snap->lids)
+		goto Error;
+
+	for (i = 1; i <= snap->max_lid_ho; i++) {
+		p_port = osm_get_port_by_lid_ho(p_subn, (uint16_t) i);
+		if (!p_port)
+			continue;
+		snap->lids[i].port_guid = osm_port_get_guid(p_port);
+		snap->lids[i].node_type = osm_node_get_type(p_port->p_node);
+		snap->lids[i].desc = strdup(p_port->p_node->print_desc);
+		if (!snap->lids[i].desc)
+			goto Error;
+	}
+
+	if (!what)
+		return snap;
+
+	snap->sws = calloc(cl_qmap_count(&p_subn->sw_guid_tbl) + 1,
+			   sizeof(snap->sws[0]));
+	if (!snap->sws)
+		goto Error;
+
+	for (p_sw = (osm_switch_t *) cl_qmap_head(&p_subn->sw_guid_tbl);
+	     p_sw != (osm_switch_t *) cl_qmap_end(&p_subn->sw_guid_tbl);
+	     p_sw = (osm_switch_t *) cl_qmap_next(&p_sw->map_item)) {
+		if (dump_sw_init(&snap->sws[snap->num_sws], p_sw, what))
+			goto Error;
+		snap->num_sws++;
+	}
+
+	return snap;
+
+Error:
+	OSM_LOG(&p_osm->log, OSM_LOG_ERROR, "ERR 4F01: "
+		"cannot allocate memory for the routing dump\n");
+	dump_snapshot_free(snap);
+	return NULL;
+}
+
+static const struct dump_lid *dump_get_lid(struct osm_dump_snapshot *snap,
+					   unsigned lid)
+{
+	if (lid > snap->max_lid_ho || !snap->lids[lid].desc)
+		return NULL;
+	return &snap->lids[lid];
+}
+
+static void write_lid_matrix(FILE * file, struct osm_dump_snapshot *snap,
+			     struct dump_sw *sw)
+{
+	const struct dump_lid *p_lid;
+	uint8_t *row;
 	uint16_t lid;
 	uint8_t port;
 
-	fprintf(file, "Switch: guid 0x%016" PRIx64 "\n",
-		cl_ntoh64(osm_node_get_node_guid(p_node)));
-	for (lid = 1; lid <= max_lid; lid++) {
-		osm_port_t *p_port;
-		if (osm_switch_get_least_hops(p_sw, lid) == OSM_NO_PATH)
+	fprintf(file, "Switch: guid 0x%016" PRIx64 "\n", cl_ntoh64(sw->guid));
+	for (lid = 1; lid <= sw->max_lid_ho; lid++) {
+		row = sw->hops + lid * sw->num_ports;
+		if (row[0] == OSM_NO_PATH)
 			continue;
 		fprintf(file, "0x%04x:", lid);
-		for (port = 0; port < max_port; port++)
-			fprintf(file, " %02x",
-				osm_switch_get_hop_count(p_sw, lid, port));
-		p_port = osm_get_port_by_lid_ho(&p_osm->subn, lid);
-		if (p_port)
+		for (port = 0; port < sw->num_ports; port++)
+			fprintf(file, " %02x", row[port]);
+		p_lid = dump_get_lid(snap, lid);
+		if (p_lid)
 			fprintf(file, " # portguid 0x016%" PRIx64,
-				cl_ntoh64(osm_port_get_guid(p_port)));
+				cl_ntoh64(p_lid->port_guid));
 		fprintf(file, "\n");
 	}
 }
 
-static void dump_ucast_lfts(cl_map_item_t * item, FILE * file, void *cxt)
+static void write_ucast_lfts(FILE * file, struct osm_dump_snapshot *snap,
+			     struct dump_sw *sw)
 {
-	osm_switch_t *p_sw = (osm_switch_t *) item;
-	osm_opensm_t *p_osm = cxt;
-	osm_node_t *p_node = p_sw->p_node;
-	unsigned max_lid = p_sw->max_lid_ho;
-	unsigned max_port = p_sw->num_ports;
+	const struct dump_lid *p_lid;
+	unsigned max_lid = sw->max_lid_ho;
 	uint16_t lid;
 	uint8_t port;
 
 	fprintf(file, "Unicast lids [0-%u] of switch Lid %u guid 0x%016"
 		PRIx64 " (\'%s\'):\n",
-		max_lid, cl_ntoh16(osm_node_get_base_lid(p_node, 0)),
-		cl_ntoh64(osm_node_get_node_guid(p_node)), p_node->print_desc);
+		max_lid, cl_ntoh16(sw->lid), cl_ntoh64(sw->guid), sw->desc);
 	for (lid = 0; lid <= max_lid; lid++) {
-		osm_port_t *p_port;
-		port = osm_switch_get_port_by_lid(p_sw, lid);
+		port = sw->lft[lid];
 
-		if (port >= max_port)
+		if (port >= sw->num_ports)
 			continue;
 
 		fprintf(file, "0x%04x %03u # ", lid, port);
 
-		p_port = osm_get_port_by_lid_ho(&p_osm->subn, lid);
-		if (p_port) {
-			p_node = p_port->p_node;
+		p_lid = dump_get_lid(snap, lid);
+		if (p_lid)
 			fprintf(file, "%s portguid 0x%016" PRIx64 ": \'%s\'",
-				ib_get_node_type_str(osm_node_get_type(p_node)),
-				cl_ntoh64(osm_port_get_guid(p_port)),
-				p_node->print_desc);
-		} else
+				ib_get_node_type_str(p_lid->node_type),
+				cl_ntoh64(p_lid->port_guid), p_lid->desc);
+		else
 			fprintf(file, "unknown node and type");
 		fprintf(file, "\n");
 	}
 	fprintf(file, "%u lids dumped\n", max_lid);
 }
 
+static void dump_lid_matrix(cl_map_item_t * item, FILE * file, void *cxt)
+{
+	struct dump_sw sw;
+
+	if (dump_sw_init(&sw, (osm_switch_t *) item, DUMP_HOPS))
+		return;
+	write_lid_matrix(file, cxt, &sw);
+	dump_sw_destroy(&sw);
+}
+
+static void dump_ucast_lfts(cl_map_item_t * item, FILE * file, void *cxt)
+{
+	struct dump_sw sw;
+
+	if (dump_sw_init(&sw, (osm_switch_t *) item, DUMP_LFT))
+		return;
+	write_ucast_lfts(file, cxt, &sw);
+	dump_sw_destroy(&sw);
+}
+
 static void dump_topology_node(cl_map_item_t * item, FILE * file, void *cxt)
 {
 	osm_node_t *p_node = (osm_node_t *) item;
@@ -648,30 +825,318 @@ static void dump_qmap(FILE * file, cl_qmap_t * map,
 	cl_qmap_apply_func(map, dump_item, &dump_context);
 }
 
+static FILE *dump_open_file(osm_log_t * p_log, const char *dir,
+			    const char *file_name, const char *mode)
+{
+	char path[1024];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file_name);
+
+	file = fopen(path, mode);
+	if (!file)
+		OSM_LOG(p_log, OSM_LOG_ERROR,
+			"cannot create file \'%s\': %s\n",
+			path, strerror(errno));
+	return file;
+}
+
 void osm_dump_qmap_to_file(osm_opensm_t * p_osm, const char *file_name,
 			   cl_qmap_t * map,
 			   void (*func) (cl_map_item_t *, FILE *, void *),
 			   void *cxt)
 {
-	char path[1024];
 	FILE *file;
 
-	snprintf(path, sizeof(path), "%s/%s",
-		 p_osm->subn.opt.dump_files_dir, file_name);
+	file = dump_open_file(&p_osm->log, p_osm->subn.opt.dump_files_dir,
+			      file_name, "w");
+	if (!file)
+		return;
+
+	dump_qmap(file, map, func, cxt);
+
+	fclose(file);
+}
+
+static void dump_snapshot_to_file(struct osm_dump_snapshot *snap,
+				  const char *file_name,
+				  void (*func) (FILE *,
+						struct osm_dump_snapshot *,
+						struct dump_sw *))
+{
+	FILE *file;
+	unsigned i;
+
+	file = dump_open_file(snap->p_log, snap->dir, file_name, "w");
+	if (!file)
+		return;
+
+	for (i = 0; i < snap->num_sws && !osm_exit_flag; i++)
+		func(file, snap, &snap->sws[i]);
+
+	fclose(file);
+}
+
+#define DUMP_BIN_ALIGN(x)	(((x) + 7) & ~7ULL)
+
+static void dump_bin_fill(FILE * file, uint64_t len)
+{
+	uint8_t fill[256];
+	size_t n;
+
+	memset(fill, OSM_NO_PATH, sizeof(fill));
+	while (len) {
+		n = len > sizeof(fill) ? sizeof(fill) : (size_t) len;
+		fwrite(fill, 1, n, file);
+		len -= n;
+	}
+}
+
+/*
+ * The binary files are written to a temporary file which is renamed
+ * when complete, so that a reader mapping the file never sees it half
+ * written.
+ */
+static void dump_bin_file(struct osm_dump_snapshot *snap,
+			  const char *file_name, uint16_t type)
+{
+	char path[1024], tmp_path[1024 + 4];
+	osm_dump_bin_hdr_t hdr;
+	osm_dump_bin_sw_t bin_sw;
+	struct dump_sw *sw;
+	uint64_t offset, size, len;
+	unsigned num_lids = 0, width, i;
+	FILE *file;
+
+	for (i = 0; i < snap->num_sws; i++)
+		if (snap->sws[i].max_lid_ho + 1U > num_lids)
+			num_lids = snap->sws[i].max_lid_ho + 1;
+
+	snprintf(path, sizeof(path), "%s/%s", snap->dir, file_name);
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
 
-	file = fopen(path, "w");
+	file = fopen(tmp_path, "wb");
 	if (!file) {
-		OSM_LOG(&p_osm->log, OSM_LOG_ERROR,
+		OSM_LOG(snap->p_log, OSM_LOG_ERROR,
 			"cannot create file \'%s\': %s\n",
-			path, strerror(errno));
+			tmp_path, strerror(errno));
 		return;
 	}
 
-	dump_qmap(file, map, func, cxt);
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = OSM_DUMP_BIN_MAGIC;
+	hdr.version = OSM_DUMP_BIN_VERSION;
+	hdr.type = type;
+	hdr.num_switches = snap->num_sws;
+	hdr.num_lids = num_lids;
+	fwrite(&hdr, sizeof(hdr), 1, file);
+
+	len = sizeof(hdr) + (uint64_t) snap->num_sws * sizeof(bin_sw);
+	offset = DUMP_BIN_ALIGN(len);
+	for (i = 0; i < snap->num_sws; i++) {
+		sw = &snap->sws[i];
+		width = type == OSM_DUMP_BIN_TYPE_LFTS ? 1 : sw->num_ports;
+		memset(&bin_sw, 0, sizeof(bin_sw));
+		bin_sw.guid = cl_ntoh64(sw->guid);
+		bin_sw.offset = offset;
+		bin_sw.lid = cl_ntoh16(sw->lid);
+		bin_sw.num_ports = sw->num_ports;
+		fwrite(&bin_sw, sizeof(bin_sw), 1, file);
+		offset += DUMP_BIN_ALIGN((uint64_t) num_lids * width);
+	}
+	dump_bin_fill(file, DUMP_BIN_ALIGN(len) - len);
 
+	for (i = 0; i < snap->num_sws && !osm_exit_flag; i++) {
+		sw = &snap->sws[i];
+		if (type == OSM_DUMP_BIN_TYPE_LFTS) {
+			width = 1;
+			fwrite(sw->lft, 1, sw->max_lid_ho + 1, file);
+		} else {
+			width = sw->num_ports;
+			fwrite(sw->hops, width, sw->max_lid_ho + 1, file);
+		}
+		len = (uint64_t) num_lids * width;
+		size = (uint64_t) (sw->max_lid_ho + 1) * width;
+		dump_bin_fill(file, DUMP_BIN_ALIGN(len) - size);
+	}
+
+	if (ferror(file) || osm_exit_flag) {
+		fclose(file);
+		unlink(tmp_path);
+		if (!osm_exit_flag)
+			OSM_LOG(snap->p_log, OSM_LOG_ERROR,
+				"cannot write file \'%s\'\n", tmp_path);
+		return;
+	}
 	fclose(file);
+
+#ifdef __WIN__
+	/* rename does not replace an existing file on Windows */
+	if (!MoveFileEx(tmp_path, path, MOVEFILE_REPLACE_EXISTING)) {
+		OSM_LOG(snap->p_log, OSM_LOG_ERROR,
+			"cannot rename \'%s\' to \'%s\' (err:%u)\n",
+			tmp_path, path, (unsigned)GetLastError());
+		unlink(tmp_path);
+	}
+#else
+	if (rename(tmp_path, path)) {
+		OSM_LOG(snap->p_log, OSM_LOG_ERROR,
+			"cannot rename \'%s\' to \'%s\': %s\n",
+			tmp_path, path, strerror(errno));
+		unlink(tmp_path);
+	}
+#endif
+}
+
+static void dump_snapshot_write(struct osm_dump_snapshot *snap)
+{
+	/* unicast routes */
+	dump_snapshot_to_file(snap, "opensm-lid-matrix.dump",
+			      write_lid_matrix);
+	dump_snapshot_to_file(snap, "opensm-lfts.dump", write_ucast_lfts);
+
+	if (snap->binary) {
+		dump_bin_file(snap, "opensm-lfts.bin", OSM_DUMP_BIN_TYPE_LFTS);
+		dump_bin_file(snap, "opensm-lid-matrix.bin",
+			      OSM_DUMP_BIN_TYPE_LID_MATRIX);
+	}
+}
+
+static void dumper_thread(void *context)
+{
+	osm_dumper_t *p_dumper = context;
+	struct osm_dump_snapshot *snap;
+
+	while (p_dumper->thread_state == OSM_THREAD_STATE_RUN) {
+		cl_event_wait_on(&p_dumper->signal_event, EVENT_NO_TIMEOUT,
+				 TRUE);
+
+		for (;;) {
+			cl_spinlock_acquire(&p_dumper->lock);
+			snap = p_dumper->p_pending;
+			p_dumper->p_pending = NULL;
+			cl_spinlock_release(&p_dumper->lock);
+
+			if (!snap)
+				break;
+
+			if (p_dumper->thread_state == OSM_THREAD_STATE_RUN) {
+				OSM_LOG(snap->p_log, OSM_LOG_VERBOSE,
+					"Writing routing dump of %u switches\n",
+					snap->num_sws);
+				dump_snapshot_write(snap);
+			}
+			dump_snapshot_free(snap);
+		}
+	}
+}
+
+void osm_dumper_construct(IN osm_dumper_t * p_dumper)
+{
+	memset(p_dumper, 0, sizeof(*p_dumper));
+	p_dumper->thread_state = OSM_THREAD_STATE_NONE;
+	cl_thread_construct(&p_dumper->thread);
+	cl_event_construct(&p_dumper->signal_event);
+	cl_spinlock_construct(&p_dumper->lock);
+}
+
+ib_api_status_t osm_dumper_init(IN osm_dumper_t * p_dumper)
+{
+	cl_status_t cl_status;
+
+	cl_status = cl_spinlock_init(&p_dumper->lock);
+	if (cl_status != CL_SUCCESS)
+		return IB_ERROR;
+
+	cl_status = cl_event_init(&p_dumper->signal_event, FALSE);
+	if (cl_status != CL_SUCCESS)
+		return IB_ERROR;
+
+	p_dumper->thread_state = OSM_THREAD_STATE_RUN;
+	cl_status = cl_thread_init(&p_dumper->thread, dumper_thread, p_dumper,
+				   "opensm dumper");
+	if (cl_status != CL_SUCCESS) {
+		p_dumper->thread_state = OSM_THREAD_STATE_NONE;
+		return IB_ERROR;
+	}
+
+	return IB_SUCCESS;
+}
+
+void osm_dumper_destroy(IN osm_dumper_t * p_dumper)
+{
+	if (p_dumper->thread_state != OSM_THREAD_STATE_NONE) {
+		p_dumper->thread_state = OSM_THREAD_STATE_EXIT;
+		cl_event_signal(&p_dumper->signal_event);
+	}
+	cl_thread_destroy(&p_dumper->thread);
+	p_dumper->thread_state = OSM_THREAD_STATE_NONE;
+
+	if (p_dumper->p_pending) {
+		dump_snapshot_free(p_dumper->p_pending);
+		p_dumper->p_pending = NULL;
+	}
+
+	cl_event_destroy(&p_dumper->signal_event);
+	cl_spinlock_destroy(&p_dumper->lock);
 }
 
+static void dumper_queue(osm_dumper_t * p_dumper,
+			 struct osm_dump_snapshot *snap)
+{
+	struct osm_dump_snapshot *p_old;
+
+	cl_spinlock_acquire(&p_dumper->lock);
+	p_old = p_dumper->p_pending;
+	p_dumper->p_pending = snap;
+	cl_spinlock_release(&p_dumper->lock);
+
+	if (p_old) {
+		OSM_LOG(snap->p_log, OSM_LOG_VERBOSE,
+			"Previous routing dump not written yet, dropping it\n");
+		dump_snapshot_free(p_old);
+	}
+
+	cl_event_signal(&p_dumper->signal_event);
+}
+
+static void dump_ucast_tables(osm_opensm_t * osm)
+{
+	struct osm_dump_snapshot *snap;
+	boolean_t async = osm->subn.opt.dump_files_async &&
+	    osm->dumper.thread_state == OSM_THREAD_STATE_RUN;
+
+	/*
+	 * The full copy of the switch tables is only needed when the
+	 * files are written in the background or in binary format,
+	 * otherwise the switches are copied one at a time.
+	 */
+	if (async || osm->subn.opt.dump_files_binary) {
+		CL_PLOCK_ACQUIRE(&osm->lock);
+		snap = dump_snapshot_take(osm, DUMP_LFT | DUMP_HOPS);
+		CL_PLOCK_RELEASE(&osm->lock);
+		if (!snap)
+			return;
+		snap->binary = osm->subn.opt.dump_files_binary;
+		if (async)
+			dumper_queue(&osm->dumper, snap);
+		else {
+			dump_snapshot_write(snap);
+			dump_snapshot_free(snap);
+		}
+		return;
+	}
+
+	snap = dump_snapshot_take(osm, 0);
+	if (!snap)
+		return;
+	/* unicast routes */
+	osm_dump_qmap_to_file(osm, "opensm-lid-matrix.dump",
+			      &osm->subn.sw_guid_tbl, dump_lid_matrix, snap);
+	osm_dump_qmap_to_file(osm, "opensm-lfts.dump",
+			      &osm->subn.sw_guid_tbl, dump_ucast_lfts, snap);
+	dump_snapshot_free(snap);
+}
 
 static void print_report(osm_opensm_t * osm, FILE * file)
 {
@@ -695,12 +1160,7 @@ void osm_dump_all(osm_opensm_t * osm)
 {
 	if (osm_log_is_active(&osm->log, OSM_LOG_ROUTING)) {
 		/* unicast routes */
-		osm_dump_qmap_to_file(osm, "opensm-lid-matrix.dump",
-				      &osm->subn.sw_guid_tbl, dump_lid_matrix,
-				      osm);
-		osm_dump_qmap_to_file(osm, "opensm-lfts.dump",
-				      &osm->subn.sw_guid_tbl, dump_ucast_lfts,
-				      osm);
+		dump_ucast_tables(osm);
 		if (osm_log_is_active(&osm->log, OSM_LOG_DEBUG))
 			dump_qmap(stdout, &osm->subn.sw_guid_tbl,
 				  dump_ucast_path_distribution, osm);
@@ -77,6 +77,7 @@
 #include <osm_torus.c>
 #include <osm_trap_rcv.c>
 #include <osm_ucast_cache.c>
+#include <osm_ucast_dfsssp.c>
 #include <osm_ucast_file.c>
 #include <osm_ucast_ftree.c>
 #include <osm_ucast_lash.c>
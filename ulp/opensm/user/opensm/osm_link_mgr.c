@@ -58,7 +58,6 @@ static uint8_t link_mgr_get_smsl(IN osm_sm_t * sm, IN osm_physp_t * p_physp)
 {
 	osm_opensm_t *p_osm = sm->p_subn->p_osm;
 	struct osm_routing_engine *re = p_osm->routing_engine_used;
-	const osm_port_t *p_sm_port, *p_src_port;
 	ib_net16_t slid;
 	uint8_t sl;
 
@@ -74,15 +73,9 @@ static uint8_t link_mgr_get_smsl(IN osm_sm_t * sm, IN osm_physp_t * p_physp)
 		return sm->p_subn->opt.sm_sl;
 	}
 
-	/* Find osm_port of the SM itself = dest_port */
-	p_sm_port = osm_get_port_by_lid(sm->p_subn, sm->p_subn->sm_base_lid);
-
-	/* Find osm_port of the source = p_physp */
-	p_src_port = osm_get_port_by_lid(sm->p_subn, slid);
-
 	/* Call into routing engine to find proper SL */
 	sl = re->path_sl(re->context, sm->p_subn->opt.sm_sl,
-			 p_src_port, p_sm_port);
+			 slid, sm->p_subn->sm_base_lid);
 
 	OSM_LOG_EXIT(sm->p_log);
 	return sl;
@@ -46,27 +46,202 @@
 
 #include <stdlib.h>
 #include <string.h>
+#ifndef __WIN__
+#include <pthread.h>
+#endif
 #include <opensm/osm_mad_pool.h>
 #include <opensm/osm_madw.h>
 #include <vendor/osm_vendor_api.h>
 
+typedef struct mad_pool_slab {
+	cl_list_item_t list_item;
+	osm_madw_t madw[OSM_MAD_POOL_SLAB_SIZE];
+} mad_pool_slab_t;
+
+static osm_mad_pool_cache_t *mad_pool_get_cache(IN osm_mad_pool_t * p_pool)
+{
+#ifdef __WIN__
+	uint32_t id = GetCurrentThreadId();
+#else
+	uint32_t id = (uint32_t) (uintptr_t) pthread_self();
+#endif
+
+	return &p_pool->caches[((id * 2654435761U) >> 16) %
+			       OSM_MAD_POOL_CACHES];
+}
+
+/*
+   Moves up to count wrappers from the head of one list to another.
+ */
+static void mad_pool_move(IN cl_qlist_t * p_dest, IN cl_qlist_t * p_src,
+			  IN unsigned count)
+{
+	while (count-- && !cl_is_qlist_empty(p_src))
+		cl_qlist_insert_tail(p_dest, cl_qlist_remove_head(p_src));
+}
+
+/*
+   Called with the pool lock held.
+ */
+static boolean_t mad_pool_grow(IN osm_mad_pool_t * p_pool)
+{
+	mad_pool_slab_t *p_slab;
+	unsigned i;
+
+	p_slab = malloc(sizeof(*p_slab));
+	if (!p_slab)
+		return FALSE;
+
+	cl_qlist_insert_tail(&p_pool->slabs, &p_slab->list_item);
+	for (i = 0; i < OSM_MAD_POOL_SLAB_SIZE; i++)
+		cl_qlist_insert_tail(&p_pool->depot,
+				     &p_slab->madw[i].list_item);
+
+	if (p_pool->p_stats)
+		p_pool->p_stats->mad_pool_slabs++;
+
+	return TRUE;
+}
+
+/*
+   Several threads may allocate at once, so only ever move the mark
+   up, and retry if another thread changed it in between.
+ */
+static void mad_pool_raise_high_water(IN atomic32_t * p_high_water,
+				      IN uint32_t mads_out)
+{
+	uint32_t high_water = *p_high_water;
+
+	while (mads_out > high_water) {
+		uint32_t prev = cl_atomic_comp_xchg(p_high_water, high_water,
+						    mads_out);
+		if (prev == high_water)
+			break;
+		high_water = prev;
+	}
+}
+
+static osm_madw_t *mad_pool_alloc(IN osm_mad_pool_t * p_pool)
+{
+	osm_mad_pool_cache_t *p_cache = mad_pool_get_cache(p_pool);
+	cl_qlist_t refill;
+	cl_list_item_t *p_item;
+	uint32_t mads_out;
+
+	cl_spinlock_acquire(&p_cache->lock);
+	p_item = cl_qlist_remove_head(&p_cache->free_list);
+	cl_spinlock_release(&p_cache->lock);
+
+	if (p_item == cl_qlist_end(&p_cache->free_list)) {
+		/*
+		   The cache ran empty, take a slab worth of wrappers
+		   from the depot, growing the pool if needed.
+		 */
+		cl_qlist_init(&refill);
+
+		cl_spinlock_acquire(&p_pool->lock);
+		if (cl_is_qlist_empty(&p_pool->depot) &&
+		    !mad_pool_grow(p_pool)) {
+			cl_spinlock_release(&p_pool->lock);
+			return NULL;
+		}
+		mad_pool_move(&refill, &p_pool->depot, OSM_MAD_POOL_SLAB_SIZE);
+		cl_spinlock_release(&p_pool->lock);
+
+		p_item = cl_qlist_remove_head(&refill);
+
+		cl_spinlock_acquire(&p_cache->lock);
+		cl_qlist_insert_list_tail(&p_cache->free_list, &refill);
+		cl_spinlock_release(&p_cache->lock);
+	}
+
+	mads_out = cl_atomic_inc(&p_pool->mads_out);
+	if (p_pool->p_stats)
+		mad_pool_raise_high_water(&p_pool->p_stats->mad_pool_high_water,
+					  mads_out);
+
+	return (osm_madw_t *) p_item;
+}
+
+static void mad_pool_free(IN osm_mad_pool_t * p_pool, IN osm_madw_t * p_madw)
+{
+	osm_mad_pool_cache_t *p_cache = mad_pool_get_cache(p_pool);
+	cl_qlist_t reclaim;
+
+	cl_qlist_init(&reclaim);
+
+	cl_spinlock_acquire(&p_cache->lock);
+	cl_qlist_insert_head(&p_cache->free_list, &p_madw->list_item);
+	/*
+	   Threads that mostly put wrappers (e.g. the dispatcher retiring
+	   responses) would otherwise pile them up in their cache; hand the
+	   coldest slab worth back to the depot.
+	 */
+	if (cl_qlist_count(&p_cache->free_list) > 2 * OSM_MAD_POOL_SLAB_SIZE) {
+		while (cl_qlist_count(&reclaim) < OSM_MAD_POOL_SLAB_SIZE)
+			cl_qlist_insert_head(&reclaim,
+					     cl_qlist_remove_tail
+					     (&p_cache->free_list));
+	}
+	cl_spinlock_release(&p_cache->lock);
+
+	cl_atomic_dec(&p_pool->mads_out);
+
+	if (!cl_is_qlist_empty(&reclaim)) {
+		cl_spinlock_acquire(&p_pool->lock);
+		cl_qlist_insert_list_tail(&p_pool->depot, &reclaim);
+		cl_spinlock_release(&p_pool->lock);
+	}
+}
+
 void osm_mad_pool_construct(IN osm_mad_pool_t * p_pool)
 {
+	unsigned i;
+
 	CL_ASSERT(p_pool);
 
 	memset(p_pool, 0, sizeof(*p_pool));
+	for (i = 0; i < OSM_MAD_POOL_CACHES; i++) {
+		cl_spinlock_construct(&p_pool->caches[i].lock);
+		cl_qlist_init(&p_pool->caches[i].free_list);
+	}
+	cl_spinlock_construct(&p_pool->lock);
+	cl_qlist_init(&p_pool->depot);
+	cl_qlist_init(&p_pool->slabs);
 }
 
 void osm_mad_pool_destroy(IN osm_mad_pool_t * p_pool)
 {
+	unsigned i;
+
 	CL_ASSERT(p_pool);
+
+	for (i = 0; i < OSM_MAD_POOL_CACHES; i++) {
+		cl_qlist_init(&p_pool->caches[i].free_list);
+		cl_spinlock_destroy(&p_pool->caches[i].lock);
+	}
+	cl_qlist_init(&p_pool->depot);
+	while (!cl_is_qlist_empty(&p_pool->slabs))
+		free(cl_qlist_remove_head(&p_pool->slabs));
+	cl_spinlock_destroy(&p_pool->lock);
 }
 
-ib_api_status_t osm_mad_pool_init(IN osm_mad_pool_t * p_pool)
+ib_api_status_t osm_mad_pool_init(IN osm_mad_pool_t * p_pool,
+				  IN osm_stats_t * p_stats)
 {
+	ib_api_status_t status;
+	unsigned i;
+
 	p_pool->mads_out = 0;
+	p_pool->p_stats = p_stats;
 
-	return IB_SUCCESS;
+	for (i = 0; i < OSM_MAD_POOL_CACHES; i++) {
+		status = cl_spinlock_init(&p_pool->caches[i].lock);
+		if (status != CL_SUCCESS)
+			return status;
+	}
+
+	return cl_spinlock_init(&p_pool->lock);
 }
 
 osm_madw_t *osm_mad_pool_get(IN osm_mad_pool_t * p_pool,
@@ -83,7 +258,7 @@ osm_madw_t *osm_mad_pool_get(IN osm_mad_pool_t * p_pool,
 	/*
 	   First, acquire a mad wrapper from the mad wrapper pool.
 	 */
-	p_madw = malloc(sizeof(*p_madw));
+	p_madw = mad_pool_alloc(p_pool);
 	if (p_madw == NULL)
 		goto Exit;
 
@@ -95,12 +270,11 @@ osm_madw_t *osm_mad_pool_get(IN osm_mad_pool_t * p_pool,
 	p_mad = osm_vendor_get(h_bind, total_size, &p_madw->vend_wrap);
 	if (p_mad == NULL) {
 		/* Don't leak wrappers! */
-		free(p_madw);
+		mad_pool_free(p_pool, p_madw);
 		p_madw = NULL;
 		goto Exit;
 	}
 
-	cl_atomic_inc(&p_pool->mads_out);
 	/*
 	   Finally, attach the wire MAD to this wrapper.
 	 */
@@ -125,14 +299,13 @@ osm_madw_t *osm_mad_pool_get_wrapper(IN osm_mad_pool_t * p_pool,
 	/*
 	   First, acquire a mad wrapper from the mad wrapper pool.
 	 */
-	p_madw = malloc(sizeof(*p_madw));
+	p_madw = mad_pool_alloc(p_pool);
 	if (p_madw == NULL)
 		goto Exit;
 
 	/*
 	   Finally, initialize the wrapper object.
 	 */
-	cl_atomic_inc(&p_pool->mads_out);
 	osm_madw_init(p_madw, h_bind, total_size, p_mad_addr);
 	osm_madw_set_mad(p_madw, p_mad);
 
@@ -144,13 +317,12 @@ osm_madw_t *osm_mad_pool_get_wrapper_raw(IN osm_mad_pool_t * p_pool)
 {
 	osm_madw_t *p_madw;
 
-	p_madw = malloc(sizeof(*p_madw));
+	p_madw = mad_pool_alloc(p_pool);
 	if (!p_madw)
 		return NULL;
 
 	osm_madw_init(p_madw, 0, 0, 0);
 	osm_madw_set_mad(p_madw, 0);
-	cl_atomic_inc(&p_pool->mads_out);
 
 	return p_madw;
 }
@@ -168,6 +340,5 @@ void osm_mad_pool_put(IN osm_mad_pool_t * p_pool, IN osm_madw_t * p_madw)
 	/*
 	   Return the mad wrapper to the wrapper pool
 	 */
-	free(p_madw);
-	cl_atomic_dec(&p_pool->mads_out);
+	mad_pool_free(p_pool, p_madw);
 }
@@ -50,6 +50,8 @@
 #include <string.h>
 #include <iba/ib_types.h>
 #include <complib/cl_debug.h>
+#include <complib/cl_atomic.h>
+#include <complib/cl_thread.h>
 #include <opensm/osm_opensm.h>
 #include <opensm/osm_sm.h>
 #include <opensm/osm_multicast.h>
@@ -163,129 +165,257 @@ void osm_purge_mtree(osm_sm_t * sm, IN osm_mgrp_box_t * mbox)
 	OSM_LOG_EXIT(sm->p_log);
 }
 
-static void create_mgrp_switch_map(cl_qmap_t * m, cl_qlist_t * port_list)
+/**********************************************************************
+ Per group description of the switches that the member ports are on
+ or attached to. This is everything root selection looks at, so two
+ groups with the same member switches get the same root.
+ **********************************************************************/
+typedef struct mcast_mgr_member_sw {
+	osm_switch_t *p_sw;
+	ib_net64_t guid;
+	uint16_t lid_ho;
+	uint32_t num_of_mcm;
+	uint8_t is_mc_member;
+} mcast_mgr_member_sw_t;
+
+typedef struct mcast_mgr_group {
+	cl_map_item_t sig_item;	/* must be first */
+	uint16_t mlid;
+	osm_mgrp_box_t *mbox;
+	cl_qlist_t port_list;
+	mcast_mgr_member_sw_t *members;
+	unsigned num_members;
+	uint64_t sig;
+	osm_switch_t *p_root;
+	struct mcast_mgr_group *p_same;
+	boolean_t find_root;
+	ib_api_status_t status;
+} mcast_mgr_group_t;
+
+static int compare_member_sw(const void *p1, const void *p2)
+{
+	uint64_t guid1 = cl_ntoh64(((const mcast_mgr_member_sw_t *)p1)->guid);
+	uint64_t guid2 = cl_ntoh64(((const mcast_mgr_member_sw_t *)p2)->guid);
+
+	return guid1 < guid2 ? -1 : guid1 > guid2 ? 1 : 0;
+}
+
+/**********************************************************************
+ Collapse the member ports into the sorted array of member switches.
+ Ports of switches count the switch itself as a member, CA ports
+ count as hosts attached to the remote switch.
+ **********************************************************************/
+static mcast_mgr_member_sw_t *make_member_sw_array(cl_qlist_t * port_list,
+						    unsigned *p_count)
 {
+	mcast_mgr_member_sw_t *members;
 #ifdef __WIN__
 	osm_mcast_work_obj_t *wobj=NULL;
 #else
 	osm_mcast_work_obj_t *wobj;
 #endif
 	osm_port_t *port;
-#ifdef __WIN__
-	osm_switch_t *sw=NULL;
-#else
 	osm_switch_t *sw;
-#endif
-	ib_net64_t guid;
 	cl_list_item_t *i;
+	unsigned n = 0, j, k;
+
+	members = malloc(cl_qlist_count(port_list) * sizeof(*members));
+	if (!members)
+		return NULL;
 
-	cl_qmap_init(m);
 	for (i = cl_qlist_head(port_list); i != cl_qlist_end(port_list);
 	     i = cl_qlist_next(i)) {
 		wobj = cl_item_obj(i, wobj, list_item);
 		port = wobj->p_port;
 		if (port->p_node->sw) {
 			sw = port->p_node->sw;
-			sw->is_mc_member = 1;
+			members[n].num_of_mcm = 0;
+			members[n].is_mc_member = 1;
 		} else {
 			sw = port->p_physp->p_remote_physp->p_node->sw;
-			sw->num_of_mcm++;
+			members[n].num_of_mcm = 1;
+			members[n].is_mc_member = 0;
 		}
-		guid = osm_node_get_node_guid(sw->p_node);
-		if (cl_qmap_get(m, guid) == cl_qmap_end(m))
-			cl_qmap_insert(m, guid, &sw->mgrp_item);
+		members[n].p_sw = sw;
+		members[n].guid = osm_node_get_node_guid(sw->p_node);
+		members[n].lid_ho =
+		    cl_ntoh16(osm_node_get_base_lid(sw->p_node, 0));
+		n++;
 	}
+
+	qsort(members, n, sizeof(*members), compare_member_sw);
+
+	for (j = 0, k = 1; k < n; k++) {
+		if (members[k].guid == members[j].guid) {
+			members[j].num_of_mcm += members[k].num_of_mcm;
+			members[j].is_mc_member |= members[k].is_mc_member;
+		} else
+			members[++j] = members[k];
+	}
+
+	*p_count = n ? j + 1 : 0;
+	return members;
 }
 
-static void destroy_mgrp_switch_map(cl_qmap_t * m)
+/**********************************************************************
+ The parts of a member switch entry that root selection depends on.
+ The max hops metric only cares whether the switch itself is a member,
+ the average hops metric also weights by the number of hosts.
+ **********************************************************************/
+static boolean_t member_sw_equal(const mcast_mgr_member_sw_t * m1,
+				 const mcast_mgr_member_sw_t * m2)
 {
-#ifdef __WIN__
-	osm_switch_t *sw=NULL;
-#else
-	osm_switch_t *sw;
+	return m1->guid == m2->guid && m1->is_mc_member == m2->is_mc_member
+#ifdef OSM_VENDOR_INTF_ANAFA
+	    && m1->num_of_mcm == m2->num_of_mcm
 #endif
-	cl_map_item_t *i;
+	    ;
+}
 
-	for (i = cl_qmap_head(m); i != cl_qmap_end(m); i = cl_qmap_next(i)) {
-		sw = cl_item_obj(i, sw, mgrp_item);
-		sw->num_of_mcm = 0;
-		sw->is_mc_member = 0;
+static uint64_t member_sw_signature(const mcast_mgr_member_sw_t * members,
+				    unsigned count)
+{
+	uint64_t sig = 14695981039346656037ULL;
+	uint64_t val;
+	unsigned i;
+
+	for (i = 0; i < count; i++) {
+		val = cl_ntoh64(members[i].guid) ^
+		    ((uint64_t) members[i].is_mc_member << 63);
+#ifdef OSM_VENDOR_INTF_ANAFA
+		val ^= (uint64_t) members[i].num_of_mcm << 32;
+#endif
+		sig = (sig ^ val) * 1099511628211ULL;
+		sig ^= sig >> 29;
 	}
-	cl_qmap_remove_all(m);
+
+	return sig;
+}
+
+/**********************************************************************
+ Whether the member switches are the ones the current root of the
+ group was chosen for, compared the same way as member_sw_equal.
+ **********************************************************************/
+static boolean_t root_members_equal(const osm_mgrp_box_t * mbox,
+				    const mcast_mgr_member_sw_t * members,
+				    unsigned count)
+{
+	const osm_mgrp_root_member_t *m;
+	unsigned i;
+
+	if (mbox->root_num_members != count)
+		return FALSE;
+
+	for (i = 0; i < count; i++) {
+		m = &mbox->root_members[i];
+		if (m->guid != members[i].guid ||
+		    m->is_mc_member != members[i].is_mc_member)
+			return FALSE;
+#ifdef OSM_VENDOR_INTF_ANAFA
+		if (m->num_of_mcm != members[i].num_of_mcm)
+			return FALSE;
+#endif
+	}
+
+	return TRUE;
+}
+
+/**********************************************************************
+ Remember the member switches a root was chosen for.  Returns FALSE
+ if out of memory, in which case the root must not be reused.
+ **********************************************************************/
+static boolean_t save_root_members(osm_mgrp_box_t * mbox,
+				   const mcast_mgr_member_sw_t * members,
+				   unsigned count)
+{
+	osm_mgrp_root_member_t *m;
+	unsigned i;
+
+	if (count != mbox->root_num_members) {
+		m = realloc(mbox->root_members, count * sizeof(*m));
+		if (!m)
+			return FALSE;
+		mbox->root_members = m;
+		mbox->root_num_members = count;
+	}
+
+	for (i = 0; i < count; i++) {
+		m = &mbox->root_members[i];
+		m->guid = members[i].guid;
+		m->num_of_mcm = members[i].num_of_mcm;
+		m->is_mc_member = members[i].is_mc_member;
+	}
+
+	return TRUE;
 }
 
 /**********************************************************************
  Calculate the maximal "min hops" from the given switch to any
- of the group HCAs
+ of the group HCAs.
+
+ Evaluation stops as soon as the result can no longer get below
+ the given bound (the best candidate found so far), in which case
+ the returned value is only a lower bound.
  **********************************************************************/
 #ifdef OSM_VENDOR_INTF_ANAFA
-static float mcast_mgr_compute_avg_hops(osm_sm_t * sm, cl_qmap_t * m,
-					const osm_switch_t * this_sw)
+static float mcast_mgr_compute_avg_hops(const mcast_mgr_member_sw_t * members,
+					unsigned count,
+					const osm_switch_t * this_sw,
+					float bound)
 {
-	float avg_hops = 0;
 	uint32_t hops = 0;
 	uint32_t num_ports = 0;
-	uint16_t lid;
 	uint32_t least_hops;
-	cl_map_item_t *i;
-	osm_switch_t *sw;
+	unsigned i;
 
-	OSM_LOG_ENTER(sm->p_log);
+	for (i = 0; i < count; i++)
+		num_ports += members[i].num_of_mcm + members[i].is_mc_member;
 
-	for (i = cl_qmap_head(m); i != cl_qmap_end(m); i = cl_qmap_next(i)) {
-		sw = cl_item_obj(i, sw, mcast_item);
-		lid = cl_ntoh16(osm_node_get_base_lid(sw->p_node, 0));
-		least_hops = osm_switch_get_least_hops(this_sw, lid);
+	/* We shouldn't be here if there aren't any ports in the group. */
+	CL_ASSERT(num_ports);
+
+	for (i = 0; i < count; i++) {
+		least_hops = osm_switch_get_least_hops(this_sw,
+						       members[i].lid_ho);
 		/* for all host that are MC members and attached to the switch,
 		   we should add the (least_hops + 1) * number_of_such_hosts.
 		   If switch itself is in the MC, we should add the least_hops only */
-		hops += (least_hops + 1) * sw->num_of_mcm +
-		    least_hops * sw->is_mc_member;
-		num_ports += sw->num_of_mcm + sw->is_mc_member;
+		hops += (least_hops + 1) * members[i].num_of_mcm +
+		    least_hops * members[i].is_mc_member;
+		if ((float)(hops / num_ports) >= bound)
+			break;
 	}
 
-	/* We shouldn't be here if there aren't any ports in the group. */
-	CL_ASSERT(num_ports);
-
-	avg_hops = (float)(hops / num_ports);
-
-	OSM_LOG_EXIT(sm->p_log);
-	return avg_hops;
+	return (float)(hops / num_ports);
 }
 #else
-static float mcast_mgr_compute_max_hops(osm_sm_t * sm, cl_qmap_t * m,
-					const osm_switch_t * this_sw)
+static float mcast_mgr_compute_max_hops(const mcast_mgr_member_sw_t * members,
+					unsigned count,
+					const osm_switch_t * this_sw,
+					float bound)
 {
 	uint32_t max_hops = 0, hops;
-	uint16_t lid;
-	cl_map_item_t *i;
-#ifdef __WIN__
-	osm_switch_t *sw=NULL;
-#else
-	osm_switch_t *sw;
-#endif
-
-	OSM_LOG_ENTER(sm->p_log);
+	unsigned i;
 
 	/*
 	   For each member of the multicast group, compute the
 	   number of hops to its base LID.
 	 */
-	for (i = cl_qmap_head(m); i != cl_qmap_end(m); i = cl_qmap_next(i)) {
-		sw = cl_item_obj(i, sw, mgrp_item);
-		lid = cl_ntoh16(osm_node_get_base_lid(sw->p_node, 0));
-		hops = osm_switch_get_least_hops(this_sw, lid);
-		if (!sw->is_mc_member)
+	for (i = 0; i < count; i++) {
+		hops = osm_switch_get_least_hops(this_sw, members[i].lid_ho);
+		if (!members[i].is_mc_member)
 			hops += 1;
-		if (hops > max_hops)
+		if (hops > max_hops) {
 			max_hops = hops;
+			if ((float)max_hops >= bound)
+				break;
+		}
 	}
 
 	/* Note that at this point we might get (max_hops == 0),
 	   which means that there's only one member in the mcast
 	   group, and it's the current switch */
 
-	OSM_LOG_EXIT(sm->p_log);
 	return (float)max_hops;
 }
 #endif
@@ -295,11 +425,13 @@ static float mcast_mgr_compute_max_hops(osm_sm_t * sm, cl_qmap_t * m,
    center of the spanning tree.  The current algorithm chooses
    a switch with the lowest average hop count to the members
    of the multicast group.
+
+   Called from the worker threads, so it may only read the subnet.
 **********************************************************************/
 static osm_switch_t *mcast_mgr_find_optimal_switch(osm_sm_t * sm,
-						   cl_qlist_t * list)
+						   const mcast_mgr_member_sw_t *
+						   members, unsigned count)
 {
-	cl_qmap_t mgrp_sw_map;
 	cl_qmap_t *p_sw_tbl;
 	osm_switch_t *p_sw, *p_best_sw = NULL;
 	float hops = 0;
@@ -309,7 +441,6 @@ static osm_switch_t *mcast_mgr_find_optimal_switch(osm_sm_t * sm,
 
 	p_sw_tbl = &sm->p_subn->sw_guid_tbl;
 
-	create_mgrp_switch_map(&mgrp_sw_map, list);
 	for (p_sw = (osm_switch_t *) cl_qmap_head(p_sw_tbl);
 	     p_sw != (osm_switch_t *) cl_qmap_end(p_sw_tbl);
 	     p_sw = (osm_switch_t *) cl_qmap_next(&p_sw->map_item)) {
@@ -317,14 +448,17 @@ static osm_switch_t *mcast_mgr_find_optimal_switch(osm_sm_t * sm,
 			continue;
 
 #ifdef OSM_VENDOR_INTF_ANAFA
-		hops = mcast_mgr_compute_avg_hops(sm, &mgrp_sw_map, p_sw);
+		hops = mcast_mgr_compute_avg_hops(members, count, p_sw,
+						  best_hops);
 #else
-		hops = mcast_mgr_compute_max_hops(sm, &mgrp_sw_map, p_sw);
+		hops = mcast_mgr_compute_max_hops(members, count, p_sw,
+						  best_hops);
 #endif
 
 		OSM_LOG(sm->p_log, OSM_LOG_DEBUG,
-			"Switch 0x%016" PRIx64 ", hops = %f\n",
-			cl_ntoh64(osm_node_get_node_guid(p_sw->p_node)), hops);
+			"Switch 0x%016" PRIx64 ", hops %s %f\n",
+			cl_ntoh64(osm_node_get_node_guid(p_sw->p_node)),
+			hops < best_hops ? "=" : ">=", hops);
 
 		if (hops < best_hops) {
 			p_best_sw = p_sw;
@@ -341,30 +475,193 @@ static osm_switch_t *mcast_mgr_find_optimal_switch(osm_sm_t * sm,
 		OSM_LOG(sm->p_log, OSM_LOG_VERBOSE,
 			"No multicast capable switches detected\n");
 
-	destroy_mgrp_switch_map(&mgrp_sw_map);
 	OSM_LOG_EXIT(sm->p_log);
 	return p_best_sw;
 }
 
 /**********************************************************************
-   This function returns the existing or optimal root switch for the tree.
+   Build the member port list and member switch array of a group.
+   Called from the worker threads.
 **********************************************************************/
-static osm_switch_t *mcast_mgr_find_root_switch(osm_sm_t * sm, cl_qlist_t *list)
+static void mcast_mgr_prepare_group(osm_sm_t * sm, mcast_mgr_group_t * grp)
 {
-	osm_switch_t *p_sw = NULL;
+	cl_qlist_init(&grp->port_list);
 
-	OSM_LOG_ENTER(sm->p_log);
+	if (!grp->mbox)
+		return;
 
+	/* build the first "subset" containing all member ports */
+	if (make_port_list(&grp->port_list, grp->mbox)) {
+		OSM_LOG(sm->p_log, OSM_LOG_ERROR, "ERR 0A10: "
+			"Insufficient memory to make port list\n");
+		grp->status = IB_ERROR;
+		return;
+	}
+
+	if (cl_qlist_count(&grp->port_list) < 2)
+		return;
+
+	grp->members = make_member_sw_array(&grp->port_list,
+					    &grp->num_members);
+	if (!grp->members) {
+		OSM_LOG(sm->p_log, OSM_LOG_ERROR, "ERR 0A07: "
+			"Insufficient memory to make member switch list\n");
+		grp->status = IB_ERROR;
+		return;
+	}
+
+	grp->sig = member_sw_signature(grp->members, grp->num_members);
+}
+
+/**********************************************************************
+   Locate the switch around which to create the spanning tree.
+   Called from the worker threads.
+**********************************************************************/
+static void mcast_mgr_find_group_root(osm_sm_t * sm, mcast_mgr_group_t * grp)
+{
 	/*
 	   We always look for the best multicast tree root switch.
 	   Otherwise since we always start with a a single join
 	   the root will be always on the first switch attached to it.
 	   - Very bad ...
 	 */
-	p_sw = mcast_mgr_find_optimal_switch(sm, list);
+	if (grp->find_root)
+		grp->p_root = mcast_mgr_find_optimal_switch(sm, grp->members,
+							    grp->num_members);
+}
+
+/**********************************************************************
+   Decide which groups actually need a root search.  A group keeps the
+   root it had if neither its member switches nor the hop tables have
+   changed since the root was chosen, and groups with the same member
+   switches share the result of a single search.
+**********************************************************************/
+static void mcast_mgr_reuse_roots(osm_sm_t * sm, mcast_mgr_group_t * groups,
+				  unsigned num_groups)
+{
+	uint32_t hop_tables_gen = sm->ucast_mgr.hop_tables_gen;
+	cl_qmap_t sig_map;
+	cl_map_item_t *item;
+	mcast_mgr_group_t *grp, *same;
+	osm_mgrp_box_t *mbox;
+	osm_node_t *p_node;
+	unsigned i, reused = 0, shared = 0, searched = 0;
+
+	OSM_LOG_ENTER(sm->p_log);
+
+	cl_qmap_init(&sig_map);
+
+	for (i = 0; i < num_groups; i++) {
+		grp = &groups[i];
+		mbox = grp->mbox;
+		if (!grp->members)
+			continue;
+
+		if (mbox->root_guid && mbox->root_sig == grp->sig &&
+		    mbox->root_hop_tables_gen == hop_tables_gen &&
+		    root_members_equal(mbox, grp->members, grp->num_members)) {
+			p_node = osm_get_node_by_guid(sm->p_subn,
+						      mbox->root_guid);
+			if (p_node && p_node->sw &&
+			    osm_switch_supports_mcast(p_node->sw)) {
+				grp->p_root = p_node->sw;
+				reused++;
+				goto Insert;
+			}
+		}
+
+		item = cl_qmap_get(&sig_map, grp->sig);
+		if (item != cl_qmap_end(&sig_map)) {
+			same = (mcast_mgr_group_t *) item;
+			if (same->num_members == grp->num_members) {
+				unsigned j;
+
+				for (j = 0; j < grp->num_members; j++)
+					if (!member_sw_equal(&same->members[j],
+							     &grp->members[j]))
+						break;
+				if (j == grp->num_members) {
+					grp->p_same = same;
+					shared++;
+					continue;
+				}
+			}
+		}
+
+		grp->find_root = TRUE;
+		searched++;
+Insert:
+		if (cl_qmap_get(&sig_map, grp->sig) == cl_qmap_end(&sig_map))
+			cl_qmap_insert(&sig_map, grp->sig, &grp->sig_item);
+	}
+
+	OSM_LOG(sm->p_log, OSM_LOG_VERBOSE,
+		"Multicast roots: %u searched, %u kept, %u shared\n",
+		searched, reused, shared);
 
 	OSM_LOG_EXIT(sm->p_log);
-	return p_sw;
+}
+
+/**********************************************************************
+   Run a per group step over all groups, spreading the groups over
+   the configured number of worker threads.
+**********************************************************************/
+typedef struct mcast_mgr_work {
+	osm_sm_t *sm;
+	mcast_mgr_group_t *groups;
+	unsigned num_groups;
+	void (*pfn_process) (osm_sm_t * sm, mcast_mgr_group_t * grp);
+	atomic32_t next;
+} mcast_mgr_work_t;
+
+static void mcast_mgr_worker(void *context)
+{
+	mcast_mgr_work_t *work = context;
+	int32_t i;
+
+	while ((i = cl_atomic_inc(&work->next) - 1) < (int32_t) work->num_groups)
+		work->pfn_process(work->sm, &work->groups[i]);
+}
+
+static void mcast_mgr_run_parallel(osm_sm_t * sm, mcast_mgr_group_t * groups,
+				   unsigned num_groups,
+				   void (*pfn_process) (osm_sm_t * sm,
+							mcast_mgr_group_t *
+							grp))
+{
+	mcast_mgr_work_t work;
+	cl_thread_t *threads = NULL;
+	unsigned num_threads, started = 0, i;
+
+	work.sm = sm;
+	work.groups = groups;
+	work.num_groups = num_groups;
+	work.pfn_process = pfn_process;
+	work.next = 0;
+
+	num_threads = sm->p_subn->opt.mcast_threads;
+	if (!num_threads)
+		num_threads = cl_proc_count();
+	if (num_threads > num_groups)
+		num_threads = num_groups;
+
+	if (num_threads > 1)
+		threads = malloc((num_threads - 1) * sizeof(*threads));
+	if (threads)
+		for (; started < num_threads - 1; started++) {
+			cl_thread_construct(&threads[started]);
+			if (cl_thread_init(&threads[started], mcast_mgr_worker,
+					   &work, "opensm mcast") != CL_SUCCESS)
+				break;
+		}
+
+	/* The calling thread takes its share, and does it all if
+	   no worker could be started. */
+	mcast_mgr_worker(&work);
+
+	for (i = 0; i < started; i++)
+		cl_thread_destroy(&threads[i]);
+	free(threads);
 }
 
 static int mcast_mgr_set_mft_block(osm_sm_t * sm, IN osm_switch_t * p_sw,
@@ -745,9 +1042,9 @@ Exit:
 }
 
 static ib_api_status_t mcast_mgr_build_spanning_tree(osm_sm_t * sm,
-						     osm_mgrp_box_t * mbox)
+						     mcast_mgr_group_t * grp)
 {
-	cl_qlist_t port_list;
+	osm_mgrp_box_t *mbox = grp->mbox;
 	uint32_t num_ports;
 	osm_switch_t *p_sw;
 	ib_api_status_t status = IB_SUCCESS;
@@ -763,20 +1060,18 @@ static ib_api_status_t mcast_mgr_build_spanning_tree(osm_sm_t * sm,
 	 */
 	osm_purge_mtree(sm, mbox);
 
-	/* build the first "subset" containing all member ports */
-	if (make_port_list(&port_list, mbox)) {
-		OSM_LOG(sm->p_log, OSM_LOG_ERROR, "ERR 0A10: "
-			"Insufficient memory to make port list\n");
-		status = IB_ERROR;
+	if (grp->status != IB_SUCCESS) {
+		drop_port_list(&grp->port_list);
+		status = grp->status;
 		goto Exit;
 	}
 
-	num_ports = cl_qlist_count(&port_list);
+	num_ports = cl_qlist_count(&grp->port_list);
 	if (num_ports < 2) {
 		OSM_LOG(sm->p_log, OSM_LOG_VERBOSE,
 			"MLID 0x%X has %u members - nothing to do\n",
 			mbox->mlid, num_ports);
-		drop_port_list(&port_list);
+		drop_port_list(&grp->port_list);
 		goto Exit;
 	}
 
@@ -793,21 +1088,29 @@ static ib_api_status_t mcast_mgr_build_spanning_tree(osm_sm_t * sm,
 	 */
 
 	/*
-	   Locate the switch around which to create the spanning
-	   tree for this multicast group.
+	   The switch around which to create the spanning tree for this
+	   multicast group was located (or reused) beforehand.
 	 */
-	p_sw = mcast_mgr_find_root_switch(sm, &port_list);
+	p_sw = grp->p_same ? grp->p_same->p_root : grp->p_root;
 	if (p_sw == NULL) {
 		OSM_LOG(sm->p_log, OSM_LOG_ERROR, "ERR 0A08: "
 			"Unable to locate a suitable switch for group 0x%X\n",
 			mbox->mlid);
-		drop_port_list(&port_list);
+		drop_port_list(&grp->port_list);
+		mbox->root_guid = 0;
 		status = IB_ERROR;
 		goto Exit;
 	}
 
-	mbox->root = mcast_mgr_branch(sm, mbox->mlid, p_sw, &port_list, 0, 0,
-				      &max_depth);
+	if (save_root_members(mbox, grp->members, grp->num_members)) {
+		mbox->root_sig = grp->sig;
+		mbox->root_guid = osm_node_get_node_guid(p_sw->p_node);
+	} else
+		mbox->root_guid = 0;
+	mbox->root_hop_tables_gen = sm->ucast_mgr.hop_tables_gen;
+
+	mbox->root = mcast_mgr_branch(sm, mbox->mlid, p_sw, &grp->port_list,
+				      0, 0, &max_depth);
 
 	OSM_LOG(sm->p_log, OSM_LOG_VERBOSE,
 		"Configured MLID 0x%X for %u ports, max tree depth = %u\n",
@@ -1010,35 +1313,37 @@ Exit:
  Process the entire group.
  NOTE : The lock should be held externally!
  **********************************************************************/
-static ib_api_status_t mcast_mgr_process_mlid(osm_sm_t * sm, uint16_t mlid)
+static ib_api_status_t mcast_mgr_process_mlid(osm_sm_t * sm,
+					      mcast_mgr_group_t * grp)
 {
 	ib_api_status_t status = IB_SUCCESS;
 	struct osm_routing_engine *re = sm->p_subn->p_osm->routing_engine_used;
-	osm_mgrp_box_t *mbox;
+	osm_mgrp_box_t *mbox = grp->mbox;
 
 	OSM_LOG_ENTER(sm->p_log);
 
 	OSM_LOG(sm->p_log, OSM_LOG_DEBUG,
-		"Processing multicast group with lid 0x%X\n", mlid);
+		"Processing multicast group with lid 0x%X\n", grp->mlid);
 
 	/* Clear the multicast tables to start clean, then build
 	   the spanning tree which sets the mcast table bits for each
 	   port in the group. */
-	mcast_mgr_clear(sm, mlid);
+	mcast_mgr_clear(sm, grp->mlid);
 
-	mbox = osm_get_mbox_by_mlid(sm->p_subn, cl_hton16(mlid));
 	if (mbox) {
 		if (re && re->mcast_build_stree)
 			status = re->mcast_build_stree(re->context, mbox);
 		else
-			status = mcast_mgr_build_spanning_tree(sm, mbox);
+			status = mcast_mgr_build_spanning_tree(sm, grp);
 
 		if (status != IB_SUCCESS)
 			OSM_LOG(sm->p_log, OSM_LOG_ERROR, "ERR 0A17: "
 				"Unable to create spanning tree (%s) for mlid "
-				"0x%x\n", ib_get_err_str(status), mlid);
+				"0x%x\n", ib_get_err_str(status), grp->mlid);
 	}
 
+	free(grp->members);
+
 	OSM_LOG_EXIT(sm->p_log);
 	return status;
 }
@@ -1182,8 +1487,10 @@ static int alloc_mfts(osm_sm_t * sm)
  **********************************************************************/
 int osm_mcast_mgr_process(osm_sm_t * sm, boolean_t config_all)
 {
+	struct osm_routing_engine *re;
+	mcast_mgr_group_t *groups;
 	int ret = 0;
-	unsigned i;
+	unsigned i, num_groups = 0;
 	unsigned max_mlid;
 
 	OSM_LOG_ENTER(sm->p_log);
@@ -1206,16 +1513,48 @@ int osm_mcast_mgr_process(osm_sm_t * sm, boolean_t config_all)
 
 	max_mlid = config_all ? sm->p_subn->max_mcast_lid_ho
 			- IB_LID_MCAST_START_HO : sm->mlids_req_max;
+
+	groups = malloc((max_mlid + 1) * sizeof(*groups));
+	if (!groups) {
+		OSM_LOG(sm->p_log, OSM_LOG_ERROR, "ERR 0A18: "
+			"Insufficient memory to process multicast groups\n");
+		ret = -1;
+		goto exit;
+	}
+
 	for (i = 0; i <= max_mlid; i++) {
 		if (sm->mlids_req[i] ||
 		    (config_all && sm->p_subn->mboxes[i])) {
 			sm->mlids_req[i] = 0;
-			mcast_mgr_process_mlid(sm, i + IB_LID_MCAST_START_HO);
+			memset(&groups[num_groups], 0, sizeof(*groups));
+			groups[num_groups].mlid = i + IB_LID_MCAST_START_HO;
+			groups[num_groups].mbox = sm->p_subn->mboxes[i];
+			num_groups++;
 		}
 	}
 
 	sm->mlids_req_max = 0;
 
+	/*
+	   Member lists and root switches only read the subnet, so they
+	   are found for all the groups up front by the worker threads.
+	   Trees are then built one group at a time, as building them
+	   updates the switches' multicast tables.
+	 */
+	re = sm->p_subn->p_osm->routing_engine_used;
+	if (!re || !re->mcast_build_stree) {
+		mcast_mgr_run_parallel(sm, groups, num_groups,
+				       mcast_mgr_prepare_group);
+		mcast_mgr_reuse_roots(sm, groups, num_groups);
+		mcast_mgr_run_parallel(sm, groups, num_groups,
+				       mcast_mgr_find_group_root);
+	}
+
+	for (i = 0; i < num_groups; i++)
+		mcast_mgr_process_mlid(sm, &groups[i]);
+
+	free(groups);
+
 	ret = mcast_mgr_set_mftables(sm);
 
 	osm_dump_mcast_routes(sm->p_subn->p_osm);
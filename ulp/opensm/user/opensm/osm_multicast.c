@@ -67,6 +67,7 @@ static osm_mgrp_box_t *mgrp_box_new(uint16_t mlid)
 void mgrp_box_delete(osm_mgrp_box_t *mbox)
 {
 	osm_mtree_destroy(mbox->root);
+	free(mbox->root_members);
 	free(mbox);
 }
 
@@ -72,6 +72,7 @@ extern int osm_ucast_ftree_setup(struct osm_routing_engine *, osm_opensm_t *);
 extern int osm_ucast_lash_setup(struct osm_routing_engine *, osm_opensm_t *);
 extern int osm_ucast_dor_setup(struct osm_routing_engine *, osm_opensm_t *);
 extern int osm_ucast_torus2QoS_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_dfsssp_setup(struct osm_routing_engine *, osm_opensm_t *);
 
 const static struct routing_engine_module routing_modules[] = {
 	{"minhop", osm_ucast_minhop_setup},
@@ -82,6 +83,7 @@ const static struct routing_engine_module routing_modules[] = {
 	{"lash", osm_ucast_lash_setup},
 	{"dor", osm_ucast_dor_setup},
 	{"torus-2QoS", osm_ucast_torus2QoS_setup},
+	{"dfsssp", osm_ucast_dfsssp_setup},
 	{NULL, NULL}
 };
 
@@ -106,6 +108,8 @@ const char *osm_routing_engine_type_str(IN osm_routing_engine_type_t type)
 		return "dor";
 	case OSM_ROUTING_ENGINE_TYPE_TORUS_2QOS:
 		return "torus-2QoS";
+	case OSM_ROUTING_ENGINE_TYPE_DFSSSP:
+		return "dfsssp";
 	default:
 		break;
 	}
@@ -136,6 +140,8 @@ osm_routing_engine_type_t osm_routing_engine_type(IN const char *str)
 		return OSM_ROUTING_ENGINE_TYPE_DOR;
 	else if (!strcasecmp(str, "torus-2QoS"))
 		return OSM_ROUTING_ENGINE_TYPE_TORUS_2QOS;
+	else if (!strcasecmp(str, "dfsssp"))
+		return OSM_ROUTING_ENGINE_TYPE_DFSSSP;
 	else
 		return OSM_ROUTING_ENGINE_TYPE_UNKNOWN;
 }
@@ -232,6 +238,7 @@ void osm_opensm_construct(IN osm_opensm_t * p_osm)
 	osm_db_construct(&p_osm->db);
 	osm_mad_pool_construct(&p_osm->mad_pool);
 	osm_vl15_construct(&p_osm->vl15);
+	osm_dumper_construct(&p_osm->dumper);
 	osm_log_construct(&p_osm->log);
 }
 
@@ -293,6 +300,9 @@ void osm_opensm_destroy(IN osm_opensm_t * p_osm)
 	/* shut down the dispatcher - so no new messages cross */
 	cl_disp_shutdown(&p_osm->disp);
 
+	/* wait for the dump files being written */
+	osm_dumper_destroy(&p_osm->dumper);
+
 	/* dump SA DB */
 	if (p_osm->subn.opt.sa_db_dump)
 		osm_sa_db_file_dump(p_osm);
@@ -307,8 +317,9 @@ void osm_opensm_destroy(IN osm_opensm_t * p_osm)
 #endif				/* ENABLE_OSM_PERF_MGR */
 	osm_db_destroy(&p_osm->db);
 	osm_vl15_destroy(&p_osm->vl15, &p_osm->mad_pool);
-	osm_mad_pool_destroy(&p_osm->mad_pool);
+	/* the vendor returns its outstanding MADs to the pool */
 	osm_vendor_delete(&p_osm->p_vendor);
+	osm_mad_pool_destroy(&p_osm->mad_pool);
 	osm_subn_destroy(&p_osm->subn);
 	cl_disp_destroy(&p_osm->disp);
 #ifdef HAVE_LIBPTHREAD
@@ -408,19 +419,20 @@ ib_api_status_t osm_opensm_init(IN osm_opensm_t * p_osm,
 		goto Exit;
 	}
 
-	status = osm_mad_pool_init(&p_osm->mad_pool);
+	status = osm_mad_pool_init(&p_osm->mad_pool, &p_osm->stats);
 	if (status != IB_SUCCESS)
 		goto Exit;
 
 	status = osm_vl15_init(&p_osm->vl15, p_osm->p_vendor,
 			       &p_osm->log, &p_osm->stats,
 			       p_opt->max_wire_smps, p_opt->max_wire_smps2,
-			       p_opt->max_smps_timeout);
+			       p_opt->max_smps_timeout,
+			       p_opt->max_wire_smps_per_node);
 	if (status != IB_SUCCESS)
 		goto Exit;
 
 	/* the DB is in use by the SM and SA so init before */
-	status = osm_db_init(&p_osm->db, &p_osm->log);
+	status = osm_db_init(&p_osm->db, &p_osm->log, p_opt->db_binary_log);
 	if (status != IB_SUCCESS)
 		goto Exit;
 
@@ -437,6 +449,10 @@ ib_api_status_t osm_opensm_init(IN osm_opensm_t * p_osm,
 	if (status != IB_SUCCESS)
 		goto Exit;
 
+	status = osm_dumper_init(&p_osm->dumper);
+	if (status != IB_SUCCESS)
+		goto Exit;
+
 	cl_qlist_init(&p_osm->plugin_list);
 
 	if (p_opt->event_plugin_name)
@@ -50,9 +50,12 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 #include <poll.h>
 #include <errno.h>
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <float.h>
 #include <arpa/inet.h>
@@ -67,6 +70,12 @@
 #include <opensm/osm_helper.h>
 
 #define PERFMGR_INITIAL_TID_VALUE 0xcafe
+#define PERFMGR_MAX_SWEEP_SLOTS 60
+#define PERFMGR_EXT_WIDTH_MASK (IB_PM_EXT_WIDTH_SUPPORTED | \
+				IB_PM_EXT_WIDTH_NOIETF_SUP)
+/* CounterSelect of all the counters, or of the error counters only */
+#define PERFMGR_SELECT_ALL 0xFFFF
+#define PERFMGR_SELECT_ERR 0x0FFF
 
 #if ENABLE_OSM_PERF_MGR_PROFILE
 struct {
@@ -235,6 +244,7 @@ static void perfmgr_mad_send_err_callback(void *bind_context,
 		memset(&p_mon_node->port[port], 0, sizeof(monitored_port_t));
 		p_mon_node->port[port].orig_lid = orig_lid;
 		p_mon_node->port[port].valid = TRUE;
+		p_mon_node->port[port].interval = 1;
 		cl_plock_release(&pm->osm->lock);
 	}
 
@@ -350,16 +360,29 @@ static ib_net16_t get_lid(osm_node_t * p_node, uint8_t port,
 }
 
 /**********************************************************************
- * Form and send the Port Counters MAD for a single port.
+ * Return TRUE if the PMA of the node has PortCountersExtended
+ **********************************************************************/
+static inline boolean_t has_ext_counters(monitored_node_t * mon_node)
+{
+	return (mon_node->cap_mask & PERFMGR_EXT_WIDTH_MASK) != 0;
+}
+
+/**********************************************************************
+ * Form and send the Port Counters MAD for a single port.  mad_attr_id
+ * selects PortCounters, PortCountersExtended or ClassPortInfo, the
+ * latter ignoring port and counter_select.
  **********************************************************************/
 static ib_api_status_t perfmgr_send_pc_mad(osm_perfmgr_t * perfmgr,
 					   ib_net16_t dest_lid,
 					   ib_net32_t dest_qp, uint16_t pkey_ix,
 					   uint8_t port, uint8_t mad_method,
+					   ib_net16_t mad_attr_id,
+					   uint16_t counter_select,
 					   osm_madw_context_t * p_context)
 {
 	ib_api_status_t status = IB_SUCCESS;
 	ib_port_counters_t *port_counter = NULL;
+	ib_port_counters_ext_t *port_counter_ext = NULL;
 	ib_perfmgt_mad_t *pm_mad = NULL;
 	osm_madw_t *p_madw = NULL;
 
@@ -381,14 +404,20 @@ static ib_api_status_t perfmgr_send_pc_mad(osm_perfmgr_t * perfmgr,
 	pm_mad->header.class_spec = 0;
 	pm_mad->header.trans_id =
 	    cl_hton64((uint64_t) cl_atomic_inc(&perfmgr->trans_id));
-	pm_mad->header.attr_id = IB_MAD_ATTR_PORT_CNTRS;
+	pm_mad->header.attr_id = mad_attr_id;
 	pm_mad->header.resv = 0;
 	pm_mad->header.attr_mod = 0;
 
-	port_counter = (ib_port_counters_t *) & pm_mad->data;
-	memset(port_counter, 0, sizeof(*port_counter));
-	port_counter->port_select = port;
-	port_counter->counter_select = 0xFFFF;
+	memset(&pm_mad->data, 0, sizeof(pm_mad->data));
+	if (mad_attr_id == IB_MAD_ATTR_PORT_CNTRS) {
+		port_counter = (ib_port_counters_t *) & pm_mad->data;
+		port_counter->port_select = port;
+		port_counter->counter_select = cl_hton16(counter_select);
+	} else if (mad_attr_id == IB_MAD_ATTR_PORT_CNTRS_EXT) {
+		port_counter_ext = (ib_port_counters_ext_t *) & pm_mad->data;
+		port_counter_ext->port_select = port;
+		port_counter_ext->counter_select = cl_hton16(counter_select);
+	}
 
 	p_madw->mad_addr.dest_lid = dest_lid;
 	p_madw->mad_addr.addr_type.gsi.remote_qp = dest_qp;
@@ -401,6 +430,7 @@ static ib_api_status_t perfmgr_send_pc_mad(osm_perfmgr_t * perfmgr,
 
 	if (p_context)
 		p_madw->context = *p_context;
+	p_madw->context.perfmgr_context.mad_attr_id = mad_attr_id;
 
 	status = osm_vendor_send(perfmgr->bind_handle, p_madw, TRUE);
 
@@ -452,6 +482,8 @@ static void collect_guids(cl_map_item_t * p_map_item, void *context)
 		mon_node->guid = node_guid;
 		mon_node->name = strdup(node->print_desc);
 		mon_node->num_ports = num_ports;
+		/* deal the nodes out to the slots of a sweep in turn */
+		mon_node->slot = pm->next_slot++;
 		/* check for enhanced switch port 0 */
 		mon_node->esp0 = (node->sw &&
 				  ib_switch_info_is_enhanced_port0(&node->sw->
@@ -459,6 +491,7 @@ static void collect_guids(cl_map_item_t * p_map_item, void *context)
 		for (port = mon_node->esp0 ? 0 : 1; port < num_ports; port++) {
 			mon_node->port[port].orig_lid = 0;
 			mon_node->port[port].valid = FALSE;
+			mon_node->port[port].interval = 1;
 			if (osm_physp_is_valid(&node->physp_table[port])) {
 				mon_node->port[port].orig_lid = get_base_lid(node, port);
 				mon_node->port[port].valid = TRUE;
@@ -473,6 +506,56 @@ Exit:
 	OSM_LOG_EXIT(pm->log);
 }
 
+/**********************************************************************
+ * Number of parts the queries of a sweep are spread over
+ **********************************************************************/
+static uint16_t sweep_slots(osm_perfmgr_t * pm)
+{
+	if (!pm->spread_queries || pm->sweep_time_s <= 1)
+		return 1;
+	return pm->sweep_time_s < PERFMGR_MAX_SWEEP_SLOTS ?
+	    pm->sweep_time_s : PERFMGR_MAX_SWEEP_SLOTS;
+}
+
+/**********************************************************************
+ * Longest interval, in sweeps, between two queries of a port
+ **********************************************************************/
+static uint8_t max_interval(osm_perfmgr_t * pm)
+{
+	unsigned sweeps;
+
+	if (!pm->max_interval_s || !pm->sweep_time_s)
+		return 1;
+	sweeps = pm->max_interval_s / pm->sweep_time_s;
+	if (sweeps < 1)
+		return 1;
+	return sweeps > UINT8_MAX ? UINT8_MAX : sweeps;
+}
+
+/**********************************************************************
+ * Ports which counters changed are queried on every sweep, the others
+ * twice less often after every query, up to max_interval.
+ **********************************************************************/
+static void perfmgr_update_interval(osm_perfmgr_t * pm,
+				    monitored_node_t * mon_node,
+				    uint8_t port, boolean_t changed)
+{
+	monitored_port_t *mon_port;
+	unsigned max = max_interval(pm), next;
+
+	if (port >= mon_node->num_ports)
+		return;
+
+	mon_port = &mon_node->port[port];
+	if (changed || mon_port->busy)
+		mon_port->interval = 1;
+	else {
+		next = mon_port->interval * 2;
+		mon_port->interval = next < max ? next : max;
+	}
+	mon_port->busy = FALSE;
+}
+
 /**********************************************************************
  * query the Port Counters of all the nodes in the subnet.
  **********************************************************************/
@@ -482,10 +565,16 @@ static void perfmgr_query_counters(cl_map_item_t * p_map_item, void *context)
 	osm_perfmgr_t *pm = context;
 	osm_node_t *node = NULL;
 	monitored_node_t *mon_node = (monitored_node_t *) p_map_item;
+	monitored_port_t *mon_port;
 	osm_madw_context_t mad_context;
 	uint64_t node_guid = 0;
 	ib_net32_t remote_qp;
 	uint8_t port, num_ports = 0;
+	boolean_t cpi_sent = FALSE;
+
+	/* only the nodes of the current part of the sweep */
+	if (mon_node->slot % sweep_slots(pm) != pm->sweep_slot)
+		return;
 
 	OSM_LOG_ENTER(pm->log);
 
@@ -521,8 +610,14 @@ static void perfmgr_query_counters(cl_map_item_t * p_map_item, void *context)
 		if (!osm_node_get_physp_ptr(node, port))
 			continue;
 
-		if (!mon_node->port[port].valid)
+		mon_port = &mon_node->port[port];
+		if (!mon_port->valid)
+			continue;
+
+		/* idle ports are only queried every interval sweeps */
+		if (++mon_port->skipped < mon_port->interval)
 			continue;
+		mon_port->skipped = 0;
 
 		lid = get_lid(node, port, mon_node);
 		if (lid == 0) {
@@ -541,19 +636,49 @@ static void perfmgr_query_counters(cl_map_item_t * p_map_item, void *context)
 #if ENABLE_OSM_PERF_MGR_PROFILE
 		gettimeofday(&mad_context.perfmgr_context.query_start, NULL);
 #endif
+		/* learn once whether the PMA has the 64 bit counters */
+		if (!mon_node->cpi_valid && !cpi_sent) {
+			status = perfmgr_send_pc_mad(pm, lid, remote_qp,
+						     mon_port->pkey_ix, port,
+						     IB_MAD_METHOD_GET,
+						     IB_MAD_ATTR_CLASS_PORT_INFO,
+						     0, &mad_context);
+			if (status != IB_SUCCESS)
+				OSM_LOG(pm->log, OSM_LOG_ERROR, "ERR 4C25: "
+					"Failed to issue ClassPortInfo query "
+					"for node 0x%" PRIx64 " (%s)\n",
+					node_guid, node->print_desc);
+			cpi_sent = TRUE;
+		}
+
 		OSM_LOG(pm->log, OSM_LOG_VERBOSE, "Getting stats for node 0x%"
 			PRIx64 " port %d (lid %u) (%s)\n", node_guid, port,
 			cl_ntoh16(lid), node->print_desc);
 		status = perfmgr_send_pc_mad(pm, lid, remote_qp,
-					     mon_node->port[port].pkey_ix,
-					     port, IB_MAD_METHOD_GET,
-					     &mad_context);
+					     mon_port->pkey_ix, port,
+					     IB_MAD_METHOD_GET,
+					     IB_MAD_ATTR_PORT_CNTRS,
+					     PERFMGR_SELECT_ALL, &mad_context);
 		if (status != IB_SUCCESS)
 			OSM_LOG(pm->log, OSM_LOG_ERROR, "ERR 4C09: "
 				"Failed to issue port counter query for node 0x%"
 				PRIx64 " port %d (%s)\n",
 				node->node_info.node_guid, port,
 				node->print_desc);
+
+		if (!has_ext_counters(mon_node))
+			continue;
+
+		status = perfmgr_send_pc_mad(pm, lid, remote_qp,
+					     mon_port->pkey_ix, port,
+					     IB_MAD_METHOD_GET,
+					     IB_MAD_ATTR_PORT_CNTRS_EXT,
+					     PERFMGR_SELECT_ALL, &mad_context);
+		if (status != IB_SUCCESS)
+			OSM_LOG(pm->log, OSM_LOG_ERROR, "ERR 4C26: "
+				"Failed to issue extended port counter query "
+				"for node 0x%" PRIx64 " port %d (%s)\n",
+				node_guid, port, node->print_desc);
 	}
 Exit:
 	cl_plock_release(&pm->osm->lock);
@@ -782,6 +907,178 @@ _exit:
 	return ret;
 }
 
+/**********************************************************************
+ * Streaming export of the counter samples
+ **********************************************************************/
+#define PERFMGR_EXPORT_BUF_SIZE 4096
+
+typedef struct export_buf {
+	osm_perfmgr_t *pm;
+	boolean_t binary;
+	unsigned dropped;
+	size_t len;
+	char buf[PERFMGR_EXPORT_BUF_SIZE];
+} export_buf_t;
+
+static void export_open(osm_perfmgr_t * pm)
+{
+	const char *name = pm->subn->opt.perfmgr_export_file;
+	size_t prefix_len = strlen(OSM_PERFMGR_EXPORT_SOCKET_PREFIX);
+	struct sockaddr_un addr;
+	int sock;
+	FILE *fp;
+
+	if (!strncmp(name, OSM_PERFMGR_EXPORT_SOCKET_PREFIX, prefix_len)) {
+		name += prefix_len;
+		if (strlen(name) >= sizeof(addr.sun_path)) {
+			OSM_LOG(pm->log, OSM_LOG_ERROR, "ERR 4C21: "
+				"export socket path too long: %s\n", name);
+			return;
+		}
+		sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if (sock < 0) {
+			OSM_LOG(pm->log, OSM_LOG_ERROR, "ERR 4C22: "
+				"cannot create export socket: %s\n",
+				strerror(errno));
+			return;
+		}
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, name);
+		/* the reader may not be there yet, retry on the next sweep */
+		if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			OSM_LOG(pm->log, OSM_LOG_VERBOSE,
+				"Export socket %s not available: %s\n", name,
+				strerror(errno));
+			close(sock);
+			return;
+		}
+		pm->export_sock = sock;
+		return;
+	}
+
+	fp = fopen(name, "a");
+	if (!fp) {
+		OSM_LOG(pm->log, OSM_LOG_ERROR, "ERR 4C23: "
+			"cannot open export file \'%s\': %s\n", name,
+			strerror(errno));
+		return;
+	}
+	if (!pm->subn->opt.perfmgr_export_binary &&
+	    !fseek(fp, 0, SEEK_END) && ftell(fp) == 0)
+		fprintf(fp, "# time,node_guid,port,time_delta,xmit_data,"
+			"rcv_data,xmit_pkts,rcv_pkts,errors\n");
+	pm->export_fp = fp;
+}
+
+static void export_close(osm_perfmgr_t * pm)
+{
+	if (pm->export_fp) {
+		fclose(pm->export_fp);
+		pm->export_fp = NULL;
+	}
+	if (pm->export_sock >= 0) {
+		close(pm->export_sock);
+		pm->export_sock = -1;
+	}
+}
+
+static void export_flush(export_buf_t * eb)
+{
+	osm_perfmgr_t *pm = eb->pm;
+
+	if (!eb->len)
+		return;
+
+	if (pm->export_fp) {
+		if (fwrite(eb->buf, 1, eb->len, pm->export_fp) != eb->len)
+			eb->dropped++;
+	} else if (pm->export_sock >= 0) {
+		/* never let a slow reader hold up the PerfMgr */
+		if (send(pm->export_sock, eb->buf, eb->len, MSG_DONTWAIT) < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK &&
+			    errno != ENOBUFS) {
+				OSM_LOG(pm->log, OSM_LOG_VERBOSE,
+					"Export socket closed: %s\n",
+					strerror(errno));
+				close(pm->export_sock);
+				pm->export_sock = -1;
+			}
+			eb->dropped++;
+		}
+	} else
+		eb->dropped++;
+
+	eb->len = 0;
+}
+
+static void export_sample(uint64_t guid, uint8_t port, time_t time,
+			  perfmgr_db_sample_t * sample, void *context)
+{
+	export_buf_t *eb = context;
+	osm_perfmgr_export_rec_t rec;
+	char line[160];
+	int len;
+
+	if (eb->binary) {
+		memset(&rec, 0, sizeof(rec));
+		rec.node_guid = guid;
+		rec.time = time;
+		rec.xmit_data = sample->xmit_data;
+		rec.rcv_data = sample->rcv_data;
+		rec.xmit_pkts = sample->xmit_pkts;
+		rec.rcv_pkts = sample->rcv_pkts;
+		rec.time_delta = sample->time_delta;
+		rec.err = sample->err;
+		rec.port = port;
+		if (eb->len + sizeof(rec) > sizeof(eb->buf))
+			export_flush(eb);
+		memcpy(eb->buf + eb->len, &rec, sizeof(rec));
+		eb->len += sizeof(rec);
+		return;
+	}
+
+	len = snprintf(line, sizeof(line), "%" PRIu64 ",0x%016" PRIx64
+		       ",%u,%u,%u,%u,%u,%u,%u\n", (uint64_t) time, guid, port,
+		       sample->time_delta, sample->xmit_data, sample->rcv_data,
+		       sample->xmit_pkts, sample->rcv_pkts, sample->err);
+	if (eb->len + len > sizeof(eb->buf))
+		export_flush(eb);
+	memcpy(eb->buf + eb->len, line, len);
+	eb->len += len;
+}
+
+/**********************************************************************
+ * Stream the samples collected since the previous export.  Records are
+ * sent whole, one buffer per datagram when exporting to a socket.
+ **********************************************************************/
+static void perfmgr_export(osm_perfmgr_t * pm)
+{
+	export_buf_t eb;
+
+	if (!pm->subn->opt.perfmgr_export_file || !pm->history_samples)
+		return;
+
+	if (!pm->export_fp && pm->export_sock < 0)
+		export_open(pm);
+	/* keep the samples in the history until there is a reader */
+	if (!pm->export_fp && pm->export_sock < 0)
+		return;
+
+	eb.pm = pm;
+	eb.binary = pm->subn->opt.perfmgr_export_binary;
+	eb.dropped = 0;
+	eb.len = 0;
+	perfmgr_db_export(pm->db, export_sample, &eb);
+	export_flush(&eb);
+	if (pm->export_fp)
+		fflush(pm->export_fp);
+
+	if (eb.dropped)
+		OSM_LOG(pm->log, OSM_LOG_VERBOSE,
+			"Dropped %u PerfMgr export buffers\n", eb.dropped);
+}
+
 /**********************************************************************
  * Main PerfMgr processor - query the performance counters.
  **********************************************************************/
@@ -794,8 +1091,13 @@ void osm_perfmgr_process(osm_perfmgr_t * pm)
 	if (pm->state != PERFMGR_STATE_ENABLED)
 		return;
 
-	if (pm->subn->sm_state == IB_SMINFO_STATE_STANDBY ||
-	    pm->subn->sm_state == IB_SMINFO_STATE_NOTACTIVE)
+	/* the sweep time may have changed since the previous slot */
+	if (pm->sweep_slot >= sweep_slots(pm))
+		pm->sweep_slot = 0;
+
+	if (pm->sweep_slot == 0 &&
+	    (pm->subn->sm_state == IB_SMINFO_STATE_STANDBY ||
+	     pm->subn->sm_state == IB_SMINFO_STATE_NOTACTIVE))
 		perfmgr_discovery(pm->subn->p_osm);
 
 	/* if redirection enabled, determine local port */
@@ -820,16 +1122,22 @@ void osm_perfmgr_process(osm_perfmgr_t * pm)
 	gettimeofday(&before, NULL);
 #endif
 	pm->sweep_state = PERFMGR_SWEEP_ACTIVE;
-	/* With the global lock held, collect the node guids */
-	/* FIXME we should be able to track SA notices
-	 * and not have to sweep the node_guid_tbl each pass
-	 */
-	OSM_LOG(pm->log, OSM_LOG_VERBOSE, "Gathering PerfMgr stats\n");
-	cl_plock_acquire(&pm->osm->lock);
-	cl_qmap_apply_func(&pm->subn->node_guid_tbl, collect_guids, pm);
-	cl_plock_release(&pm->osm->lock);
+	if (pm->sweep_slot == 0) {
+		/* stream what the previous sweep collected */
+		perfmgr_export(pm);
+
+		/* With the global lock held, collect the node guids */
+		/* FIXME we should be able to track SA notices
+		 * and not have to sweep the node_guid_tbl each pass
+		 */
+		OSM_LOG(pm->log, OSM_LOG_VERBOSE, "Gathering PerfMgr stats\n");
+		cl_plock_acquire(&pm->osm->lock);
+		cl_qmap_apply_func(&pm->subn->node_guid_tbl, collect_guids,
+				   pm);
+		cl_plock_release(&pm->osm->lock);
+	}
 
-	/* then for each node query their counters */
+	/* then for each node of this slot query their counters */
 	cl_qmap_apply_func(&pm->monitored_map, perfmgr_query_counters, pm);
 
 	/* clean out any nodes found to be removed during the sweep */
@@ -852,6 +1160,8 @@ void osm_perfmgr_process(osm_perfmgr_t * pm)
 	clear_mad_stats();
 #endif
 
+	if (++pm->sweep_slot >= sweep_slots(pm))
+		pm->sweep_slot = 0;
 	pm->sweep_state = PERFMGR_SWEEP_SLEEP;
 }
 
@@ -864,7 +1174,9 @@ static void perfmgr_sweep(void *arg)
 	osm_perfmgr_t *pm = arg;
 
 	osm_sm_signal(pm->sm, OSM_SIGNAL_PERFMGR_SWEEP);
-	cl_timer_start(&pm->sweep_timer, pm->sweep_time_s * 1000);
+	/* one slot of the sweep at a time when spreading the queries */
+	cl_timer_start(&pm->sweep_timer,
+		       pm->sweep_time_s * 1000 / sweep_slots(pm));
 }
 
 void osm_perfmgr_shutdown(osm_perfmgr_t * pm)
@@ -881,6 +1193,7 @@ void osm_perfmgr_destroy(osm_perfmgr_t * pm)
 	OSM_LOG_ENTER(pm->log);
 	perfmgr_db_destroy(pm->db);
 	cl_timer_destroy(&pm->sweep_timer);
+	export_close(pm);
 	OSM_LOG_EXIT(pm->log);
 }
 
@@ -892,6 +1205,8 @@ void osm_perfmgr_destroy(osm_perfmgr_t * pm)
  * The one time this will not work is if the port is getting errors fast
  * enough to have the reading overtake the previous reading.  In this case,
  * counters will be missed.
+ *
+ * Either reading may be NULL when it is not part of the response.
  **********************************************************************/
 static void perfmgr_check_oob_clear(osm_perfmgr_t * pm,
 				    monitored_node_t * mon_node, uint8_t port,
@@ -901,6 +1216,9 @@ static void perfmgr_check_oob_clear(osm_perfmgr_t * pm,
 	perfmgr_db_err_reading_t prev_err;
 	perfmgr_db_data_cnt_reading_t prev_dc;
 
+	if (!cr)
+		goto check_dc;
+
 	if (perfmgr_db_get_prev_err(pm->db, mon_node->guid, port, &prev_err)
 	    != PERFMGR_EVENT_DB_SUCCESS) {
 		OSM_LOG(pm->log, OSM_LOG_VERBOSE, "Failed to find previous "
@@ -928,7 +1246,10 @@ static void perfmgr_check_oob_clear(osm_perfmgr_t * pm,
 		perfmgr_db_clear_prev_err(pm->db, mon_node->guid, port);
 	}
 
-	/* FIXME handle extended counters */
+check_dc:
+	if (!dc)
+		return;
+
 	if (perfmgr_db_get_prev_dc(pm->db, mon_node->guid, port, &prev_dc)
 	    != PERFMGR_EVENT_DB_SUCCESS) {
 		OSM_LOG(pm->log, OSM_LOG_VERBOSE,
@@ -975,7 +1296,9 @@ static int counter_overflow_32(ib_net32_t val)
 
 /**********************************************************************
  * Check if the port counters have overflowed and if so issue a clear
- * MAD to the port.
+ * MAD to the port.  The data counters of ports with PortCountersExtended
+ * are read from the 64 bit counters, so they are neither checked nor
+ * cleared.
  **********************************************************************/
 static void perfmgr_check_overflow(osm_perfmgr_t * pm,
 				   monitored_node_t * mon_node, int16_t pkey_ix,
@@ -984,6 +1307,7 @@ static void perfmgr_check_overflow(osm_perfmgr_t * pm,
 	osm_madw_context_t mad_context;
 	ib_api_status_t status;
 	ib_net32_t remote_qp;
+	boolean_t ext = has_ext_counters(mon_node);
 
 	OSM_LOG_ENTER(pm->log);
 
@@ -999,10 +1323,10 @@ static void perfmgr_check_overflow(osm_perfmgr_t * pm,
 	    counter_overflow_4(PC_LINK_INT(pc->link_int_buffer_overrun)) ||
 	    counter_overflow_4(PC_BUF_OVERRUN(pc->link_int_buffer_overrun)) ||
 	    counter_overflow_16(pc->vl15_dropped) ||
-	    counter_overflow_32(pc->xmit_data) ||
-	    counter_overflow_32(pc->rcv_data) ||
-	    counter_overflow_32(pc->xmit_pkts) ||
-	    counter_overflow_32(pc->rcv_pkts)) {
+	    (!ext && (counter_overflow_32(pc->xmit_data) ||
+		      counter_overflow_32(pc->rcv_data) ||
+		      counter_overflow_32(pc->xmit_pkts) ||
+		      counter_overflow_32(pc->rcv_pkts)))) {
 		osm_node_t *p_node = NULL;
 		ib_net16_t lid = 0;
 
@@ -1035,7 +1359,9 @@ static void perfmgr_check_overflow(osm_perfmgr_t * pm,
 		/* clear port counters */
 		status = perfmgr_send_pc_mad(pm, lid, remote_qp, pkey_ix,
 					     port, IB_MAD_METHOD_SET,
-					     &mad_context);
+					     IB_MAD_ATTR_PORT_CNTRS,
+					     ext ? PERFMGR_SELECT_ERR :
+					     PERFMGR_SELECT_ALL, &mad_context);
 		if (status != IB_SUCCESS)
 			OSM_LOG(pm->log, OSM_LOG_ERROR, "PerfMgr: ERR 4C11: "
 				"Failed to send clear counters MAD for %s (0x%"
@@ -1043,7 +1369,8 @@ static void perfmgr_check_overflow(osm_perfmgr_t * pm,
 				mon_node->name, mon_node->guid, port);
 
 		perfmgr_db_clear_prev_err(pm->db, mon_node->guid, port);
-		perfmgr_db_clear_prev_dc(pm->db, mon_node->guid, port);
+		if (!ext)
+			perfmgr_db_clear_prev_dc(pm->db, mon_node->guid, port);
 	}
 
 Exit:
@@ -1094,6 +1421,47 @@ static void perfmgr_log_events(osm_perfmgr_t * pm,
 			time_diff, mon_node->name, mon_node->guid, port);
 }
 
+/**********************************************************************
+ * Return TRUE if the error counters or the packet counters moved since
+ * the previous reading.  Either reading may be NULL.
+ **********************************************************************/
+static boolean_t perfmgr_counters_changed(osm_perfmgr_t * pm, uint64_t guid,
+					  uint8_t port,
+					  perfmgr_db_err_reading_t * cr,
+					  perfmgr_db_data_cnt_reading_t * dc)
+{
+	perfmgr_db_err_reading_t prev_err;
+	perfmgr_db_data_cnt_reading_t prev_dc;
+
+	/* no need to look when every port is queried on every sweep */
+	if (max_interval(pm) == 1)
+		return TRUE;
+
+	if (cr && perfmgr_db_get_prev_err(pm->db, guid, port, &prev_err) ==
+	    PERFMGR_EVENT_DB_SUCCESS &&
+	    (cr->symbol_err_cnt != prev_err.symbol_err_cnt ||
+	     cr->link_err_recover != prev_err.link_err_recover ||
+	     cr->link_downed != prev_err.link_downed ||
+	     cr->rcv_err != prev_err.rcv_err ||
+	     cr->rcv_rem_phys_err != prev_err.rcv_rem_phys_err ||
+	     cr->rcv_switch_relay_err != prev_err.rcv_switch_relay_err ||
+	     cr->xmit_discards != prev_err.xmit_discards ||
+	     cr->xmit_constraint_err != prev_err.xmit_constraint_err ||
+	     cr->rcv_constraint_err != prev_err.rcv_constraint_err ||
+	     cr->link_integrity != prev_err.link_integrity ||
+	     cr->buffer_overrun != prev_err.buffer_overrun ||
+	     cr->vl15_dropped != prev_err.vl15_dropped))
+		return TRUE;
+
+	if (dc && perfmgr_db_get_prev_dc(pm->db, guid, port, &prev_dc) ==
+	    PERFMGR_EVENT_DB_SUCCESS &&
+	    (dc->xmit_pkts != prev_dc.xmit_pkts ||
+	     dc->rcv_pkts != prev_dc.rcv_pkts))
+		return TRUE;
+
+	return FALSE;
+}
+
 static int16_t validate_redir_pkey(osm_perfmgr_t *pm, ib_net16_t pkey)
 {
 	int16_t pkey_ix = -1;
@@ -1172,6 +1540,7 @@ static void pc_recv_process(void *context, void *data)
 	monitored_node_t *p_mon_node;
 	int16_t pkey_ix = 0;
 	boolean_t valid = TRUE;
+	boolean_t ext, changed;
 
 	OSM_LOG_ENTER(pm->log);
 
@@ -1192,6 +1561,7 @@ static void pc_recv_process(void *context, void *data)
 		PRIx64 " port %u\n", p_mad->status, node_guid, port);
 
 	CL_ASSERT(p_mad->attr_id == IB_MAD_ATTR_PORT_CNTRS ||
+		  p_mad->attr_id == IB_MAD_ATTR_PORT_CNTRS_EXT ||
 		  p_mad->attr_id == IB_MAD_ATTR_CLASS_PORT_INFO);
 
 	/* Response could also be redirection (IBM eHCA PMA does this) */
@@ -1281,7 +1651,14 @@ static void pc_recv_process(void *context, void *data)
 		status = perfmgr_send_pc_mad(pm, cpi->redir_lid, cpi->redir_qp,
 					     pkey_ix, port,
 					     mad_context->perfmgr_context.
-					     mad_method, mad_context);
+					     mad_method,
+					     mad_context->perfmgr_context.
+					     mad_attr_id,
+					     has_ext_counters(p_mon_node) &&
+					     mad_context->perfmgr_context.
+					     mad_method == IB_MAD_METHOD_SET ?
+					     PERFMGR_SELECT_ERR :
+					     PERFMGR_SELECT_ALL, mad_context);
 		if (status != IB_SUCCESS)
 			OSM_LOG(pm->log, OSM_LOG_ERROR, "ERR 4C14: "
 				"Failed to send redirected MAD with method 0x%x for node 0x%"
@@ -1291,32 +1668,85 @@ static void pc_recv_process(void *context, void *data)
 		goto Exit;
 	}
 
-	perfmgr_db_fill_err_read(wire_read, &err_reading);
-	/* FIXME separate query for extended counters if they are supported
-	 * on the port.
+	if (p_mad->attr_id == IB_MAD_ATTR_CLASS_PORT_INFO) {
+		ib_class_port_info_t *cpi =
+		    (ib_class_port_info_t *) &
+		    (osm_madw_get_perfmgt_mad_ptr(p_madw)->data);
+
+		cl_plock_acquire(&pm->osm->lock);
+		p_mon_node->cap_mask = p_mad->status ? 0 : cpi->cap_mask;
+		p_mon_node->cpi_valid = TRUE;
+		cl_plock_release(&pm->osm->lock);
+
+		OSM_LOG(pm->log, OSM_LOG_VERBOSE,
+			"%s (0x%" PRIx64 ") PMA capability mask 0x%04x%s\n",
+			p_mon_node->name, node_guid,
+			cl_ntoh16(p_mon_node->cap_mask),
+			has_ext_counters(p_mon_node) ?
+			", using PortCountersExtended" : "");
+		goto Exit;
+	}
+
+	if (p_mad->attr_id == IB_MAD_ATTR_PORT_CNTRS_EXT) {
+		perfmgr_db_fill_data_cnt_read_epc((ib_port_counters_ext_t *)
+						  wire_read, &data_reading);
+
+		/* detect an out of band clear on the port */
+		perfmgr_check_oob_clear(pm, p_mon_node, port, NULL,
+					&data_reading);
+
+		changed = perfmgr_counters_changed(pm, node_guid, port, NULL,
+						   &data_reading);
+		/* before the reading becomes the previous one */
+		perfmgr_db_add_sample(pm->db, node_guid, port, &data_reading);
+		perfmgr_db_add_dc_reading(pm->db, node_guid, port,
+					  &data_reading);
+		perfmgr_update_interval(pm, p_mon_node, port, changed);
+		goto Stats;
+	}
+
+	/* the data counters of ports with PortCountersExtended are
+	 * processed with the PortCountersExtended response
 	 */
+	ext = has_ext_counters(p_mon_node);
+
+	perfmgr_db_fill_err_read(wire_read, &err_reading);
 	perfmgr_db_fill_data_cnt_read_pc(wire_read, &data_reading);
 
 	/* detect an out of band clear on the port */
 	if (mad_context->perfmgr_context.mad_method != IB_MAD_METHOD_SET)
 		perfmgr_check_oob_clear(pm, p_mon_node, port, &err_reading,
-					&data_reading);
+					ext ? NULL : &data_reading);
 
 	/* log any critical events from this reading */
 	perfmgr_log_events(pm, p_mon_node, port, &err_reading);
 
 	if (mad_context->perfmgr_context.mad_method == IB_MAD_METHOD_GET) {
+		changed = perfmgr_counters_changed(pm, node_guid, port,
+						   &err_reading,
+						   ext ? NULL : &data_reading);
 		perfmgr_db_add_err_reading(pm->db, node_guid, port,
 					   &err_reading);
-		perfmgr_db_add_dc_reading(pm->db, node_guid, port,
-					  &data_reading);
+		if (ext) {
+			if (changed && port < p_mon_node->num_ports)
+				p_mon_node->port[port].busy = TRUE;
+		} else {
+			/* before the reading becomes the previous one */
+			perfmgr_db_add_sample(pm->db, node_guid, port,
+					      &data_reading);
+			perfmgr_db_add_dc_reading(pm->db, node_guid, port,
+						  &data_reading);
+			perfmgr_update_interval(pm, p_mon_node, port, changed);
+		}
 	} else {
 		perfmgr_db_clear_prev_err(pm->db, node_guid, port);
-		perfmgr_db_clear_prev_dc(pm->db, node_guid, port);
+		if (!ext)
+			perfmgr_db_clear_prev_dc(pm->db, node_guid, port);
 	}
 
 	perfmgr_check_overflow(pm, p_mon_node, pkey_ix, port, wire_read);
 
+Stats:
 #if ENABLE_OSM_PERF_MGR_PROFILE
 	do {
 		struct timeval proc_time;
@@ -1361,6 +1791,14 @@ ib_api_status_t osm_perfmgr_init(osm_perfmgr_t * pm, osm_opensm_t * osm,
 	pm->max_outstanding_queries = p_opt->perfmgr_max_outstanding_queries;
 	pm->osm = osm;
 	pm->local_port = -1;
+	pm->history_samples = p_opt->perfmgr_history_samples;
+	pm->export_sock = -1;
+	pm->max_interval_s = p_opt->perfmgr_max_interval_s;
+	pm->spread_queries = p_opt->perfmgr_spread_queries;
+	if (p_opt->perfmgr_export_file && !pm->history_samples)
+		OSM_LOG(&osm->log, OSM_LOG_ERROR, "ERR 4C24: "
+			"perfmgr_export_file needs perfmgr_history_samples, "
+			"counter samples will not be exported\n");
 
 	status = cl_timer_init(&pm->sweep_timer, perfmgr_sweep, pm);
 	if (status != IB_SUCCESS)
@@ -63,6 +63,7 @@ perfmgr_db_t *perfmgr_db_construct(osm_perfmgr_t *perfmgr)
 	cl_plock_construct(&db->lock);
 	cl_plock_init(&db->lock);
 	db->perfmgr = perfmgr;
+	db->hist_size = perfmgr->history_samples;
 	return db;
 }
 
@@ -109,7 +110,8 @@ static inline perfmgr_db_err_t bad_node_port(db_node_t * node, uint8_t port)
 /** =========================================================================
  */
 static db_node_t *malloc_node(uint64_t guid, boolean_t esp0,
-			      uint8_t num_ports, char *name)
+			      uint8_t num_ports, char *name,
+			      uint16_t hist_size)
 {
 	int i = 0;
 	time_t cur_time = 0;
@@ -120,6 +122,13 @@ static db_node_t *malloc_node(uint64_t guid, boolean_t esp0,
 	rc->ports = calloc(num_ports, sizeof(db_port_t));
 	if (!rc->ports)
 		goto free_rc;
+	rc->hist = NULL;
+	if (hist_size) {
+		rc->hist = calloc((size_t) num_ports * hist_size,
+				  sizeof(perfmgr_db_sample_t));
+		if (!rc->hist)
+			goto free_ports;
+	}
 	rc->num_ports = num_ports;
 	rc->node_guid = guid;
 	rc->esp0 = esp0;
@@ -129,11 +138,15 @@ static db_node_t *malloc_node(uint64_t guid, boolean_t esp0,
 		rc->ports[i].last_reset = cur_time;
 		rc->ports[i].err_previous.time = cur_time;
 		rc->ports[i].dc_previous.time = cur_time;
+		if (rc->hist)
+			rc->ports[i].hist = &rc->hist[i * hist_size];
 	}
 	snprintf(rc->node_name, sizeof(rc->node_name), "%s", name);
 
 	return rc;
 
+free_ports:
+	free(rc->ports);
 free_rc:
 	free(rc);
 	return NULL;
@@ -147,6 +160,8 @@ static void free_node(db_node_t * node)
 		return;
 	if (node->ports)
 		free(node->ports);
+	if (node->hist)
+		free(node->hist);
 	free(node);
 }
 
@@ -170,7 +185,7 @@ perfmgr_db_create_entry(perfmgr_db_t * db, uint64_t guid, boolean_t esp0,
 	cl_plock_excl_acquire(&db->lock);
 	if (!get(db, guid)) {
 		db_node_t *pc_node = malloc_node(guid, esp0, num_ports,
-						 name);
+						 name, db->hist_size);
 		if (!pc_node) {
 			rc = PERFMGR_EVENT_DB_NOMEM;
 			goto Exit;
@@ -317,6 +332,18 @@ perfmgr_db_add_err_reading(perfmgr_db_t * db, uint64_t guid, uint8_t port,
 	    (reading->vl15_dropped - previous->vl15_dropped);
 	p_port->err_total.vl15_dropped += epi_pe_data.vl15_dropped;
 
+	/* the next sample reports the errors found in between */
+	if (p_port->hist)
+		p_port->hist_err += epi_pe_data.symbol_err_cnt +
+		    epi_pe_data.link_err_recover + epi_pe_data.link_downed +
+		    epi_pe_data.rcv_err + epi_pe_data.rcv_rem_phys_err +
+		    epi_pe_data.rcv_switch_relay_err +
+		    epi_pe_data.xmit_discards +
+		    epi_pe_data.xmit_constraint_err +
+		    epi_pe_data.rcv_constraint_err +
+		    epi_pe_data.link_integrity + epi_pe_data.buffer_overrun +
+		    epi_pe_data.vl15_dropped;
+
 	p_port->err_previous = *reading;
 
 	osm_opensm_report_event(db->perfmgr->osm, OSM_EVENT_ID_PORT_ERRORS,
@@ -494,6 +521,207 @@ Exit:
 	return rc;
 }
 
+/**********************************************************************
+ * Counter history functions
+ **********************************************************************/
+static inline uint64_t counter_delta(uint64_t cur, uint64_t prev)
+{
+	/* a counter going backwards has been cleared in between */
+	return cur >= prev ? cur - prev : cur;
+}
+
+static inline uint32_t sat32(uint64_t val)
+{
+	return val > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t) val;
+}
+
+perfmgr_db_err_t
+perfmgr_db_add_sample(perfmgr_db_t * db, uint64_t guid, uint8_t port,
+		      perfmgr_db_data_cnt_reading_t * reading)
+{
+	db_port_t *p_port = NULL;
+	db_node_t *node = NULL;
+	perfmgr_db_data_cnt_reading_t *previous;
+	perfmgr_db_sample_t *sample;
+	perfmgr_db_err_t rc = PERFMGR_EVENT_DB_SUCCESS;
+	time_t time_delta;
+
+	cl_plock_excl_acquire(&db->lock);
+	node = get(db, guid);
+	if ((rc = bad_node_port(node, port)) != PERFMGR_EVENT_DB_SUCCESS)
+		goto Exit;
+
+	p_port = &node->ports[port];
+	if (!p_port->hist)
+		goto Exit;
+
+	/* The previous readings of a new port are not real readings,
+	 * the first one only sets the start of the history.
+	 */
+	if (!p_port->hist_time) {
+		p_port->hist_time = reading->time;
+		p_port->hist_err = 0;
+		goto Exit;
+	}
+
+	previous = &p_port->dc_previous;
+	sample = &p_port->hist[p_port->hist_head];
+
+	time_delta = reading->time - p_port->hist_time;
+	if (time_delta < 0)
+		time_delta = 0;
+	sample->time_delta = time_delta > 0xFFFF ? 0xFFFF : time_delta;
+
+	sample->err = p_port->hist_err > 0xFFFF ? 0xFFFF :
+	    (uint16_t) p_port->hist_err;
+	p_port->hist_err = 0;
+
+	sample->xmit_data =
+	    sat32(counter_delta(reading->xmit_data, previous->xmit_data));
+	sample->rcv_data =
+	    sat32(counter_delta(reading->rcv_data, previous->rcv_data));
+	sample->xmit_pkts =
+	    sat32(counter_delta(reading->xmit_pkts, previous->xmit_pkts));
+	sample->rcv_pkts =
+	    sat32(counter_delta(reading->rcv_pkts, previous->rcv_pkts));
+
+	if (++p_port->hist_head == db->hist_size)
+		p_port->hist_head = 0;
+	if (p_port->hist_count < db->hist_size)
+		p_port->hist_count++;
+	if (p_port->hist_unexported < db->hist_size)
+		p_port->hist_unexported++;
+	p_port->hist_time = reading->time;
+
+Exit:
+	cl_plock_release(&db->lock);
+	return rc;
+}
+
+/**********************************************************************
+ * Internal call db->lock should be held when calling
+ **********************************************************************/
+static void get_rates(db_port_t * p_port, perfmgr_db_rate_t * rates)
+{
+	uint64_t xmit_data = 0, rcv_data = 0, xmit_pkts = 0, rcv_pkts = 0;
+	uint64_t err = 0, interval = 0;
+	perfmgr_db_sample_t *sample;
+	int i;
+
+	memset(rates, 0, sizeof(*rates));
+	for (i = 0; i < p_port->hist_count; i++) {
+		sample = &p_port->hist[i];
+		interval += sample->time_delta;
+		err += sample->err;
+		xmit_data += sample->xmit_data;
+		rcv_data += sample->rcv_data;
+		xmit_pkts += sample->xmit_pkts;
+		rcv_pkts += sample->rcv_pkts;
+	}
+
+	rates->samples = p_port->hist_count;
+	rates->interval_s = interval > 0xFFFFFFFF ? 0xFFFFFFFF :
+	    (uint32_t) interval;
+	if (!interval)
+		return;
+
+	/* data counters are in units of 4 octets */
+	rates->xmit_bytes_ps = (double)xmit_data * 4 / interval;
+	rates->rcv_bytes_ps = (double)rcv_data * 4 / interval;
+	rates->xmit_pkts_ps = (double)xmit_pkts / interval;
+	rates->rcv_pkts_ps = (double)rcv_pkts / interval;
+	rates->err_ps = (double)err / interval;
+}
+
+perfmgr_db_err_t
+perfmgr_db_get_rates(perfmgr_db_t * db, uint64_t guid, uint8_t port,
+		     perfmgr_db_rate_t * rates)
+{
+	db_node_t *node = NULL;
+	perfmgr_db_err_t rc = PERFMGR_EVENT_DB_SUCCESS;
+
+	cl_plock_acquire(&db->lock);
+
+	node = get(db, guid);
+	if ((rc = bad_node_port(node, port)) != PERFMGR_EVENT_DB_SUCCESS)
+		goto Exit;
+
+	if (!node->hist) {
+		rc = PERFMGR_EVENT_DB_NOT_IMPL;
+		goto Exit;
+	}
+
+	get_rates(&node->ports[port], rates);
+
+Exit:
+	cl_plock_release(&db->lock);
+	return rc;
+}
+
+/* Define a context for the export_node callback */
+typedef struct {
+	perfmgr_db_t *db;
+	perfmgr_db_export_fn_t export_fn;
+	void *context;
+} export_context_t;
+
+static void export_node(cl_map_item_t * const p_map_item, void *context)
+{
+	db_node_t *node = (db_node_t *) p_map_item;
+	export_context_t *c = context;
+	uint16_t size = c->db->hist_size;
+	db_port_t *p_port;
+	time_t time;
+	int i, j, idx;
+
+	if (!node->hist)
+		return;
+
+	for (i = 0; i < node->num_ports; i++) {
+		p_port = &node->ports[i];
+		if (!p_port->hist_unexported)
+			continue;
+
+		/* walk back from the newest sample to get the time of
+		 * the oldest one not exported yet
+		 */
+		time = p_port->hist_time;
+		idx = p_port->hist_head;
+		for (j = 1; j < p_port->hist_unexported; j++) {
+			idx = idx ? idx - 1 : size - 1;
+			time -= p_port->hist[idx].time_delta;
+		}
+		idx = idx ? idx - 1 : size - 1;
+
+		for (j = 0; j < p_port->hist_unexported; j++) {
+			if (j)
+				time += p_port->hist[idx].time_delta;
+			c->export_fn(node->node_guid, i, time,
+				     &p_port->hist[idx], c->context);
+			if (++idx == size)
+				idx = 0;
+		}
+		p_port->hist_unexported = 0;
+	}
+}
+
+/**********************************************************************
+ * Pass the samples added since the last export to export_fn
+ **********************************************************************/
+void perfmgr_db_export(perfmgr_db_t * db, perfmgr_db_export_fn_t export_fn,
+		       void *context)
+{
+	export_context_t c;
+
+	c.db = db;
+	c.export_fn = export_fn;
+	c.context = context;
+
+	cl_plock_excl_acquire(&db->lock);
+	cl_qmap_apply_func(&db->pc_data, export_node, &c);
+	cl_plock_release(&db->lock);
+}
+
 static void clear_counters(cl_map_item_t * const p_map_item, void *context)
 {
 	db_node_t *node = (db_node_t *) p_map_item;
@@ -667,6 +895,23 @@ static void dump_node_hr(db_node_t * node, FILE * fp)
 			node->ports[i].dc_total.unicast_rcv_pkts,
 			node->ports[i].dc_total.multicast_xmit_pkts,
 			node->ports[i].dc_total.multicast_rcv_pkts);
+
+		if (node->ports[i].hist_count) {
+			perfmgr_db_rate_t rates;
+
+			get_rates(&node->ports[i], &rates);
+			fprintf(fp,
+				"     rates over %us (%u samples):\n"
+				"     xmit_bytes/s         : %.1f\n"
+				"     rcv_bytes/s          : %.1f\n"
+				"     xmit_pkts/s          : %.1f\n"
+				"     rcv_pkts/s           : %.1f\n"
+				"     errors/s             : %.3f\n",
+				rates.interval_s, rates.samples,
+				rates.xmit_bytes_ps, rates.rcv_bytes_ps,
+				rates.xmit_pkts_ps, rates.rcv_pkts_ps,
+				rates.err_ps);
+		}
 	}
 }
 
@@ -177,6 +177,7 @@ static ib_api_status_t mpr_rcv_get_path_parms(IN osm_sa_t * sa,
 	int in_port_num = 0;
 	uint8_t i;
 	osm_qos_level_t *p_qos_level = NULL;
+	const osm_path_aggr_t *p_aggr;
 	uint16_t valid_sl_mask = 0xffff;
 
 	OSM_LOG_ENTER(sa->p_log);
@@ -418,6 +419,28 @@ static ib_api_status_t mpr_rcv_get_path_parms(IN osm_sa_t * sa,
 				goto Exit;
 			}
 		}
+
+		/*
+		   The rest of the path is precomputed after routing,
+		   if it is known and passes the checks skip the walk.
+		   The link to the destination counts as one more hop.
+		 */
+		p_aggr = osm_switch_get_path_aggr(p_node->sw, dest_lid_ho);
+		if (p_aggr && hops + p_aggr->hops + 1 <= MAX_HOPS &&
+		    (!sa->p_subn->opt.qos ||
+		     (valid_sl_mask & p_aggr->sl_mask))) {
+			if (p_aggr->hops) {
+				if (mtu > p_aggr->mtu)
+					mtu = p_aggr->mtu;
+				if (ib_path_compare_rates(rate, p_aggr->rate) > 0)
+					rate = p_aggr->rate;
+				if (sa->p_subn->opt.qos)
+					valid_sl_mask &= p_aggr->sl_mask;
+			}
+			hops += p_aggr->hops + 1;
+			p_physp = p_dest_physp;
+			break;
+		}
 	}
 
 	/*
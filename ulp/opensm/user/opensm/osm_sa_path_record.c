@@ -180,6 +180,7 @@ static ib_api_status_t pr_rcv_get_path_parms(IN osm_sa_t * sa,
 	uint8_t i;
 	ib_slvl_table_t *p_slvl_tbl = NULL;
 	osm_qos_level_t *p_qos_level = NULL;
+	const osm_path_aggr_t *p_aggr;
 	uint16_t valid_sl_mask = 0xffff;
 	int hops = 0;
 
@@ -384,7 +385,7 @@ static ib_api_status_t pr_rcv_get_path_parms(IN osm_sa_t * sa,
 					  ib_port_info_compute_rate(p_pi,
 								    p_pi0->capability_mask & IB_PORT_CAP_HAS_EXT_SPEEDS)) > 0)
 			rate = ib_port_info_compute_rate(p_pi,
-							 p_pi->capability_mask & IB_PORT_CAP_HAS_EXT_SPEEDS);
+							 p_pi0->capability_mask & IB_PORT_CAP_HAS_EXT_SPEEDS);
 
 		if (sa->p_subn->opt.qos) {
 			/*
@@ -426,6 +427,27 @@ static ib_api_status_t pr_rcv_get_path_parms(IN osm_sa_t * sa,
 			status = IB_NOT_FOUND;
 			goto Exit;
 		}
+
+		/*
+		   The rest of the path is precomputed after routing,
+		   if it is known and passes the checks skip the walk.
+		 */
+		p_aggr = osm_switch_get_path_aggr(p_node->sw, dest_lid_ho);
+		if (p_aggr && hops + p_aggr->hops <= MAX_HOPS &&
+		    (!sa->p_subn->opt.qos ||
+		     (valid_sl_mask & p_aggr->sl_mask))) {
+			if (p_aggr->hops) {
+				if (mtu > p_aggr->mtu)
+					mtu = p_aggr->mtu;
+				if (ib_path_compare_rates(rate, p_aggr->rate) > 0)
+					rate = p_aggr->rate;
+				if (sa->p_subn->opt.qos)
+					valid_sl_mask &= p_aggr->sl_mask;
+				hops += p_aggr->hops;
+			}
+			p_physp = p_dest_physp;
+			break;
+		}
 	}
 
 	/*
@@ -815,7 +837,9 @@ static ib_api_status_t pr_rcv_get_path_parms(IN osm_sa_t * sa,
 	 * engine override it.
 	 */
 	if (p_re && p_re->path_sl)
-		sl = p_re->path_sl(p_re->context, sl, p_src_port, p_dest_port);
+		sl = p_re->path_sl(p_re->context, sl,
+				   osm_port_get_base_lid(p_src_port),
+				   cl_hton16(dest_lid_ho));
 
 	/* reset pkey when raw traffic */
 	if (comp_mask & IB_PR_COMPMASK_RAWTRAFFIC &&
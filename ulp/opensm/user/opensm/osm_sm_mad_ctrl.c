@@ -142,11 +142,13 @@ static void sm_mad_ctrl_disp_done_callback(IN void *context, IN void *p_data)
  * sm_mad_ctrl_update_wire_stats
  *
  * DESCRIPTION
- * Updates wire stats for outstanding MADs and calls the VL15 poller.
+ * Updates wire stats for outstanding MADs, releases the window slot
+ * of the request MAD and calls the VL15 poller.
  *
  * SYNOPSIS
  */
-static void sm_mad_ctrl_update_wire_stats(IN osm_sm_mad_ctrl_t * p_ctrl)
+static void sm_mad_ctrl_update_wire_stats(IN osm_sm_mad_ctrl_t * p_ctrl,
+					  IN const osm_madw_t * p_req_madw)
 {
 	uint32_t mads_on_wire;
 
@@ -159,6 +161,8 @@ static void sm_mad_ctrl_update_wire_stats(IN osm_sm_mad_ctrl_t * p_ctrl)
 		"%u SMPs on the wire, %u outstanding\n", mads_on_wire,
 		p_ctrl->p_stats->qp0_mads_outstanding);
 
+	osm_vl15_retire(p_ctrl->p_vl15, p_req_madw);
+
 	/*
 	   We can signal the VL15 controller to send another MAD
 	   if any are waiting for transmission.
@@ -201,7 +205,7 @@ static void sm_mad_ctrl_process_get_resp(IN osm_sm_mad_ctrl_t * p_ctrl,
 
 	p_old_madw = transaction_context;
 
-	sm_mad_ctrl_update_wire_stats(p_ctrl);
+	sm_mad_ctrl_update_wire_stats(p_ctrl, p_old_madw);
 
 	/*
 	   Copy the MAD Wrapper context from the requesting MAD
@@ -773,7 +777,7 @@ static void sm_mad_ctrl_send_err_cb(IN void *context, IN osm_madw_t * p_madw)
 	   An error occurred.  No response was received to a request MAD.
 	   Retire the original request MAD.
 	 */
-	sm_mad_ctrl_update_wire_stats(p_ctrl);
+	sm_mad_ctrl_update_wire_stats(p_ctrl, p_madw);
 
 	if (osm_madw_get_err_msg(p_madw) != CL_DISP_MSGID_NONE) {
 		OSM_LOG(p_ctrl->p_log, OSM_LOG_DEBUG,
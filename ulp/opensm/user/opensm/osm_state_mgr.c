@@ -1121,12 +1121,19 @@ static void do_sweep(osm_sm_t * sm)
 			    !osm_sa_db_file_dump(sm->p_subn->p_osm))
 				osm_opensm_report_event(sm->p_subn->p_osm,
 					OSM_EVENT_ID_SA_DB_DUMPED, NULL);
+			osm_vl15_report(sm->p_vl15);
 			OSM_LOG_MSG_BOX(sm->p_log, OSM_LOG_VERBOSE,
 					"LIGHT SWEEP COMPLETE");
 			return;
 		}
 	}
 
+	/*
+	 * Paths may change from here on, so the SA has to walk them
+	 * until the switches are configured again.
+	 */
+	osm_ucast_mgr_clear_path_aggr(&sm->ucast_mgr);
+
 	/*
 	 * Unicast cache should be invalidated if there were errors
 	 * during initialization or if subnet re-route is requested.
@@ -1166,6 +1173,7 @@ static void do_sweep(osm_sm_t * sm)
 			return;
 
 		if (!sm->p_subn->subnet_initialization_error) {
+			osm_ucast_mgr_build_path_aggr(&sm->ucast_mgr);
 			OSM_LOG_MSG_BOX(sm->p_log, OSM_LOG_VERBOSE,
 					"REROUTE COMPLETE");
 			osm_opensm_report_event(sm->p_subn->p_osm,
@@ -1361,6 +1369,8 @@ repeat_discovery:
 	 * take into account these lfts. */
 	sm->p_subn->ignore_existing_lfts = FALSE;
 
+	osm_ucast_mgr_build_path_aggr(&sm->ucast_mgr);
+
 	OSM_LOG_MSG_BOX(sm->p_log, OSM_LOG_VERBOSE,
 			"SWITCHES CONFIGURED FOR UNICAST");
 	osm_opensm_report_event(sm->p_subn->p_osm,
@@ -1404,6 +1414,8 @@ repeat_discovery:
 	 * The sweep completed!
 	 */
 
+	osm_vl15_report(sm->p_vl15);
+
 	/*
 	 * Send trap 64 on newly discovered endports
 	 */
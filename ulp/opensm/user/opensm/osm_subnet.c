@@ -300,6 +300,7 @@ static const opt_rec_t opt_tbl[] = {
 	{ "max_wire_smps", OPT_OFFSET(max_wire_smps), opts_parse_uint32, NULL, 1 },
 	{ "max_wire_smps2", OPT_OFFSET(max_wire_smps2), opts_parse_uint32, NULL, 1 },
 	{ "max_smps_timeout", OPT_OFFSET(max_smps_timeout), opts_parse_uint32, NULL, 1 },
+	{ "max_wire_smps_per_node", OPT_OFFSET(max_wire_smps_per_node), opts_parse_uint32, NULL, 1 },
 	{ "console", OPT_OFFSET(console), opts_parse_charp, NULL, 0 },
 	{ "console_port", OPT_OFFSET(console_port), opts_parse_uint16, NULL, 0 },
 	{ "transaction_timeout", OPT_OFFSET(transaction_timeout), opts_parse_uint32, NULL, 0 },
@@ -337,6 +338,8 @@ static const opt_rec_t opt_tbl[] = {
 	{ "routing_engine", OPT_OFFSET(routing_engine_names), opts_parse_charp, NULL, 0 },
 	{ "connect_roots", OPT_OFFSET(connect_roots), opts_parse_boolean, NULL, 1 },
 	{ "use_ucast_cache", OPT_OFFSET(use_ucast_cache), opts_parse_boolean, NULL, 0 },
+	{ "mcast_threads", OPT_OFFSET(mcast_threads), opts_parse_uint32, NULL, 1 },
+	{ "path_aggr_max_mb", OPT_OFFSET(path_aggr_max_mb), opts_parse_uint32, NULL, 1 },
 	{ "log_file", OPT_OFFSET(log_file), opts_parse_charp, NULL, 0 },
 	{ "log_max_size", OPT_OFFSET(log_max_size), opts_parse_uint32, opts_setup_log_max_size, 1 },
 	{ "log_flags", OPT_OFFSET(log_flags), opts_parse_uint8, opts_setup_log_flags, 1 },
@@ -347,6 +350,8 @@ static const opt_rec_t opt_tbl[] = {
 	{ "qos", OPT_OFFSET(qos), opts_parse_boolean, NULL, 1 },
 	{ "qos_policy_file", OPT_OFFSET(qos_policy_file), opts_parse_charp, NULL, 0 },
 	{ "dump_files_dir", OPT_OFFSET(dump_files_dir), opts_parse_charp, NULL, 0 },
+	{ "dump_files_async", OPT_OFFSET(dump_files_async), opts_parse_boolean, NULL, 1 },
+	{ "dump_files_binary", OPT_OFFSET(dump_files_binary), opts_parse_boolean, NULL, 1 },
 	{ "lid_matrix_dump_file", OPT_OFFSET(lid_matrix_dump_file), opts_parse_charp, NULL, 0 },
 	{ "lfts_file", OPT_OFFSET(lfts_file), opts_parse_charp, NULL, 0 },
 	{ "root_guid_file", OPT_OFFSET(root_guid_file), opts_parse_charp, NULL, 0 },
@@ -354,6 +359,7 @@ static const opt_rec_t opt_tbl[] = {
 	{ "io_guid_file", OPT_OFFSET(io_guid_file), opts_parse_charp, NULL, 0 },
 	{ "port_shifting", OPT_OFFSET(port_shifting), opts_parse_boolean, NULL, 1 },
 	{ "scatter_ports", OPT_OFFSET(scatter_ports), opts_parse_uint32, NULL, 1 },
+	{ "ftree_threads", OPT_OFFSET(ftree_threads), opts_parse_uint32, NULL, 1 },
 	{ "max_reverse_hops", OPT_OFFSET(max_reverse_hops), opts_parse_uint16, NULL, 0 },
 	{ "ids_guid_file", OPT_OFFSET(ids_guid_file), opts_parse_charp, NULL, 0 },
 	{ "guid_routing_order_file", OPT_OFFSET(guid_routing_order_file), opts_parse_charp, NULL, 0 },
@@ -363,6 +369,7 @@ static const opt_rec_t opt_tbl[] = {
 	{ "do_mesh_analysis", OPT_OFFSET(do_mesh_analysis), opts_parse_boolean, NULL, 1 },
 	{ "exit_on_fatal", OPT_OFFSET(exit_on_fatal), opts_parse_boolean, NULL, 1 },
 	{ "honor_guid2lid_file", OPT_OFFSET(honor_guid2lid_file), opts_parse_boolean, NULL, 1 },
+	{ "db_binary_log", OPT_OFFSET(db_binary_log), opts_parse_boolean, NULL, 0 },
 	{ "daemon", OPT_OFFSET(daemon), opts_parse_boolean, NULL, 0 },
 	{ "sm_inactive", OPT_OFFSET(sm_inactive), opts_parse_boolean, NULL, 1 },
 	{ "babbling_port_policy", OPT_OFFSET(babbling_port_policy), opts_parse_boolean, NULL, 1 },
@@ -372,6 +379,11 @@ static const opt_rec_t opt_tbl[] = {
 	{ "perfmgr_redir", OPT_OFFSET(perfmgr_redir), opts_parse_boolean, NULL, 0 },
 	{ "perfmgr_sweep_time_s", OPT_OFFSET(perfmgr_sweep_time_s), opts_parse_uint16, NULL, 0 },
 	{ "perfmgr_max_outstanding_queries", OPT_OFFSET(perfmgr_max_outstanding_queries), opts_parse_uint32, NULL, 0 },
+	{ "perfmgr_max_interval_s", OPT_OFFSET(perfmgr_max_interval_s), opts_parse_uint16, NULL, 0 },
+	{ "perfmgr_spread_queries", OPT_OFFSET(perfmgr_spread_queries), opts_parse_boolean, NULL, 0 },
+	{ "perfmgr_history_samples", OPT_OFFSET(perfmgr_history_samples), opts_parse_uint16, NULL, 0 },
+	{ "perfmgr_export_file", OPT_OFFSET(perfmgr_export_file), opts_parse_charp, NULL, 0 },
+	{ "perfmgr_export_binary", OPT_OFFSET(perfmgr_export_binary), opts_parse_boolean, NULL, 0 },
 	{ "event_db_dump_file", OPT_OFFSET(event_db_dump_file), opts_parse_charp, NULL, 0 },
 #endif				/* ENABLE_OSM_PERF_MGR */
 	{ "event_plugin_name", OPT_OFFSET(event_plugin_name), opts_parse_charp, NULL, 0 },
@@ -462,6 +474,7 @@ static void subn_opt_destroy(IN osm_subn_opt_t * p_opt)
 	free(p_opt->sa_db_file);
 	free(p_opt->torus_conf_file);
 #ifdef ENABLE_OSM_PERF_MGR
+	free(p_opt->perfmgr_export_file);
 	free(p_opt->event_db_dump_file);
 #endif /* ENABLE_OSM_PERF_MGR */
 	free(p_opt->event_plugin_name);
@@ -767,6 +780,7 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 	p_opt->transaction_retries = OSM_DEFAULT_RETRY_COUNT;
 	p_opt->max_smps_timeout = 1000 * p_opt->transaction_timeout *
 				  p_opt->transaction_retries;
+	p_opt->max_wire_smps_per_node = OSM_DEFAULT_SMP_MAX_PER_NODE;
 	/* by default we will consider waiting for 50x transaction timeout normal */
 	p_opt->max_msg_fifo_timeout = 50 * OSM_DEFAULT_TRANS_TIMEOUT_MILLISEC;
 	p_opt->sm_priority = OSM_DEFAULT_SM_PRIORITY;
@@ -797,6 +811,7 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 	p_opt->force_heavy_sweep = FALSE;
 	p_opt->log_flags = OSM_LOG_DEFAULT_LEVEL;
 	p_opt->honor_guid2lid_file = FALSE;
+	p_opt->db_binary_log = FALSE;
 	p_opt->daemon = FALSE;
 	p_opt->sm_inactive = FALSE;
 	p_opt->babbling_port_policy = FALSE;
@@ -807,6 +822,11 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 	p_opt->perfmgr_sweep_time_s = OSM_PERFMGR_DEFAULT_SWEEP_TIME_S;
 	p_opt->perfmgr_max_outstanding_queries =
 	    OSM_PERFMGR_DEFAULT_MAX_OUTSTANDING_QUERIES;
+	p_opt->perfmgr_max_interval_s = 0;
+	p_opt->perfmgr_spread_queries = FALSE;
+	p_opt->perfmgr_history_samples = 0;
+	p_opt->perfmgr_export_file = NULL;
+	p_opt->perfmgr_export_binary = FALSE;
 	p_opt->event_db_dump_file = NULL; /* use default */
 #endif				/* ENABLE_OSM_PERF_MGR */
 
@@ -818,6 +838,8 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 	if (!p_opt->dump_files_dir || !(*p_opt->dump_files_dir))
 		p_opt->dump_files_dir = OSM_DEFAULT_TMP_DIR;
 	p_opt->dump_files_dir = strdup(p_opt->dump_files_dir);
+	p_opt->dump_files_async = FALSE;
+	p_opt->dump_files_binary = FALSE;
 	p_opt->log_file = strdup(OSM_DEFAULT_LOG_FILE);
 	p_opt->log_max_size = 0;
 	p_opt->partition_config_file = strdup(OSM_DEFAULT_PARTITION_CONFIG_FILE);
@@ -831,6 +853,8 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 	p_opt->port_profile_switch_nodes = FALSE;
 	p_opt->sweep_on_trap = TRUE;
 	p_opt->use_ucast_cache = FALSE;
+	p_opt->mcast_threads = OSM_DEFAULT_MCAST_THREADS;
+	p_opt->path_aggr_max_mb = OSM_DEFAULT_PATH_AGGR_MAX_MB;
 	p_opt->routing_engine_names = NULL;
 	p_opt->connect_roots = FALSE;
 	p_opt->lid_matrix_dump_file = NULL;
@@ -840,6 +864,7 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 	p_opt->io_guid_file = NULL;
 	p_opt->port_shifting = FALSE;
 	p_opt->scatter_ports = OSM_DEFAULT_SCATTER_PORTS;
+	p_opt->ftree_threads = OSM_DEFAULT_FTREE_THREADS;
 	p_opt->max_reverse_hops = 0;
 	p_opt->ids_guid_file = NULL;
 	p_opt->guid_routing_order_file = NULL;
@@ -1516,7 +1541,7 @@ int osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"# commas so that specific ordering of routing algorithms will\n"
 		"# be tried if earlier routing engines fail.\n"
 		"# Supported engines: minhop, updn, dnup, file, ftree, lash,\n"
-		"#    dor, torus-2QoS\n"
+		"#    dor, torus-2QoS, dfsssp\n"
 		"routing_engine %s\n\n", p_opts->routing_engine_names ?
 		p_opts->routing_engine_names : null_str);
 
@@ -1530,6 +1555,18 @@ int osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"use_ucast_cache %s\n\n",
 		p_opts->use_ucast_cache ? "TRUE" : "FALSE");
 
+	fprintf(out,
+		"# Number of threads used to find multicast tree roots\n"
+		"# (0 means one per processor)\n"
+		"mcast_threads %u\n\n",
+		p_opts->mcast_threads);
+
+	fprintf(out,
+		"# Memory in MB for the path parameters precomputed for the SA\n"
+		"# (0 disables them, the SA then walks every path)\n"
+		"path_aggr_max_mb %u\n\n",
+		p_opts->path_aggr_max_mb);
+
 	fprintf(out,
 		"# Lid matrix dump file name\n"
 		"lid_matrix_dump_file %s\n\n", p_opts->lid_matrix_dump_file ?
@@ -1591,6 +1628,12 @@ int osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"scatter_ports %d\n\n",
 		p_opts->scatter_ports);
 
+	fprintf(out,
+		"# Number of threads used by ftree to route compute nodes.\n"
+		"# Routes depend on this value; 1 routes sequentially\n"
+		"ftree_threads %u\n\n",
+		p_opts->ftree_threads);
+
 	fprintf(out,
 		"# SA database file name\nsa_db_file %s\n\n",
 		p_opts->sa_db_file ? p_opts->sa_db_file : null_str);
@@ -1618,12 +1661,16 @@ int osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"polling_retry_number %u\n\n"
 		"# If TRUE honor the guid2lid file when coming out of standby\n"
 		"# state, if such file exists and is valid\n"
-		"honor_guid2lid_file %s\n\n",
+		"honor_guid2lid_file %s\n\n"
+		"# If TRUE the guid2lid database is kept in an append-only\n"
+		"# binary log (guid2lid.bin) instead of the text file\n"
+		"db_binary_log %s\n\n",
 		p_opts->sm_priority,
 		p_opts->ignore_other_sm ? "TRUE" : "FALSE",
 		p_opts->sminfo_polling_timeout,
 		p_opts->polling_retry_number,
-		p_opts->honor_guid2lid_file ? "TRUE" : "FALSE");
+		p_opts->honor_guid2lid_file ? "TRUE" : "FALSE",
+		p_opts->db_binary_log ? "TRUE" : "FALSE");
 
 	fprintf(out,
 		"#\n# TIMING AND THREADING OPTIONS\n#\n"
@@ -1634,6 +1681,9 @@ int osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"max_wire_smps2 %u\n\n"
 		"# The timeout in [usec] used for sending SMPs above max_wire_smps limit and below max_wire_smps2 limit\n"
 		"max_smps_timeout %u\n\n"
+		"# Maximum number of SMPs outstanding to a single node\n"
+		"# (0 means no limit)\n"
+		"max_wire_smps_per_node %u\n\n"
 		"# The maximum time in [msec] allowed for a transaction to complete\n"
 		"transaction_timeout %u\n\n"
 		"# The maximum number of retries allowed for a transaction to complete\n"
@@ -1648,6 +1698,7 @@ int osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		p_opts->max_wire_smps,
 		p_opts->max_wire_smps2,
 		p_opts->max_smps_timeout,
+		p_opts->max_wire_smps_per_node,
 		p_opts->transaction_timeout,
 		p_opts->transaction_retries,
 		p_opts->max_msg_fifo_timeout,
@@ -1678,11 +1729,28 @@ int osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"# sweep time in seconds\n"
 		"perfmgr_sweep_time_s %u\n\n"
 		"# Max outstanding queries\n"
-		"perfmgr_max_outstanding_queries %u\n\n",
+		"perfmgr_max_outstanding_queries %u\n\n"
+		"# Max time in seconds between queries of idle ports\n"
+		"# (0 = query every port on every sweep)\n"
+		"perfmgr_max_interval_s %u\n\n"
+		"# Spread the queries over the sweep time\n"
+		"perfmgr_spread_queries %s\n\n"
+		"# Number of counter samples kept per port (0 = no history)\n"
+		"perfmgr_history_samples %u\n\n"
+		"# File or unix:<socket path> to stream the counter samples to\n"
+		"perfmgr_export_file %s\n\n"
+		"# Stream binary records instead of CSV\n"
+		"perfmgr_export_binary %s\n\n",
 		p_opts->perfmgr ? "TRUE" : "FALSE",
 		p_opts->perfmgr_redir ? "TRUE" : "FALSE",
 		p_opts->perfmgr_sweep_time_s,
-		p_opts->perfmgr_max_outstanding_queries);
+		p_opts->perfmgr_max_outstanding_queries,
+		p_opts->perfmgr_max_interval_s,
+		p_opts->perfmgr_spread_queries ? "TRUE" : "FALSE",
+		p_opts->perfmgr_history_samples,
+		p_opts->perfmgr_export_file ?
+		p_opts->perfmgr_export_file : null_str,
+		p_opts->perfmgr_export_binary ? "TRUE" : "FALSE");
 
 	fprintf(out,
 		"#\n# Event DB Options\n#\n"
@@ -1722,6 +1790,11 @@ int osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"accum_log_file %s\n\n"
 		"# The directory to hold the file OpenSM dumps\n"
 		"dump_files_dir %s\n\n"
+		"# If TRUE the LID matrix and LFT dumps are written in background\n"
+		"dump_files_async %s\n\n"
+		"# If TRUE the LID matrix and LFT dumps are also written in\n"
+		"# binary format (opensm-lid-matrix.bin and opensm-lfts.bin)\n"
+		"dump_files_binary %s\n\n"
 		"# If TRUE enables new high risk options and hardware specific quirks\n"
 		"enable_quirks %s\n\n"
 		"# If TRUE disables client reregistration\n"
@@ -1748,6 +1821,8 @@ int osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		p_opts->log_max_size,
 		p_opts->accum_log_file ? "TRUE" : "FALSE",
 		p_opts->dump_files_dir,
+		p_opts->dump_files_async ? "TRUE" : "FALSE",
+		p_opts->dump_files_binary ? "TRUE" : "FALSE",
 		p_opts->enable_quirks ? "TRUE" : "FALSE",
 		p_opts->no_clients_rereg ? "TRUE" : "FALSE",
 		p_opts->disable_multicast ? "TRUE" : "FALSE",
@@ -92,6 +92,8 @@ void osm_switch_delete(IN OUT osm_switch_t ** pp_sw)
 		free(p_sw->lft);
 	if (p_sw->new_lft)
 		free(p_sw->new_lft);
+	if (p_sw->path_aggr)
+		free(p_sw->path_aggr);
 	if (p_sw->hops) {
 		for (i = 0; i < p_sw->num_hops; i++)
 			if (p_sw->hops[i])
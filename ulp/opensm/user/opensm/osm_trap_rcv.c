@@ -134,48 +134,6 @@ static uint64_t aging_tracker_callback(IN uint64_t key, IN uint32_t num_regs,
 	return 0;
 }
 
-/**********************************************************************
- * CRC calculation for notice identification
- **********************************************************************/
-
-#define CRC32_POLYNOMIAL   0xEDB88320L
-
-/* calculate the crc for a given buffer */
-static uint32_t trap_calc_crc32(void *buffer, uint32_t count)
-{
-	uint32_t temp1, temp2;
-	uint32_t crc = -1L;
-	unsigned char *p = (unsigned char *)buffer;
-	/* precalculated table for faster crc calculation */
-	static uint32_t crc_table[256];
-	static boolean_t first = TRUE;
-	int i, j;
-
-	/* if we need to initialize the lookup table */
-	if (first) {
-		/* calc the CRC table */
-		for (i = 0; i <= 255; i++) {
-			crc = i;
-			for (j = 8; j > 0; j--)
-				if (crc & 1)
-					crc = (crc >> 1) ^ CRC32_POLYNOMIAL;
-				else
-					crc >>= 1;
-			crc_table[i] = crc;
-		}
-		first = FALSE;
-	}
-
-	crc = -1L;
-	/* do the calculation */
-	while (count-- != 0) {
-		temp1 = (crc >> 8) & 0x00FFFFFFL;
-		temp2 = crc_table[((int)crc ^ *p++) & 0xFF];
-		crc = temp1 ^ temp2;
-	}
-	return crc;
-}
-
 /* The key is created in the following manner:
    port_num  lid   crc
    \______/ \___/ \___/
@@ -184,7 +142,8 @@ static uint32_t trap_calc_crc32(void *buffer, uint32_t count)
 static uint64_t trap_get_key(IN uint16_t lid, IN uint8_t port_num,
 			     IN ib_mad_notice_attr_t * p_ntci)
 {
-	uint32_t crc = trap_calc_crc32(p_ntci, sizeof(ib_mad_notice_attr_t));
+	uint32_t crc = osm_crc32(0xFFFFFFFF, p_ntci,
+				  sizeof(ib_mad_notice_attr_t));
 	return ((uint64_t) port_num << 48) | ((uint64_t) lid << 32) | crc;
 }
 
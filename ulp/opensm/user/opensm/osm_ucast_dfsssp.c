@@ -0,0 +1,1084 @@
+/*
+ * Copyright (c) 2004-2009 Voltaire, Inc. All rights reserved.
+ * Copyright (c) 2002-2009 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Abstract:
+ *      Implementation of the deadlock-free single-source-shortest-path
+ *      (DFSSSP) routing engine.
+ *
+ *      Every destination LID is routed with Dijkstra's algorithm over the
+ *      switch graph.  The weight of a link is one plus the number of source
+ *      ports already routed over it, so later destinations avoid the links
+ *      earlier ones loaded and the paths spread over the whole fabric.
+ *
+ *      The resulting paths are then assigned to virtual layers (SLs).  All
+ *      paths start in layer 0; as long as the channel dependency graph
+ *      (CDG) of a layer has a cycle, the paths inducing the weakest edge
+ *      of the cycle move up to the next layer.  Each layer ends up
+ *      acyclic, so the routing is deadlock free as long as the fabric has
+ *      enough VLs for the layers needed.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <iba/ib_types.h>
+#include <complib/cl_debug.h>
+#include <complib/cl_qmap.h>
+#include <complib/cl_timer.h>
+#include <opensm/osm_switch.h>
+#include <opensm/osm_opensm.h>
+#include <opensm/osm_log.h>
+
+#define DFSSSP_NONE		0xFFFFFFFF
+#define DFSSSP_INFINITY		((uint64_t)-1)
+
+typedef struct dfsssp_link {
+	uint32_t id;
+	uint32_t from;
+	uint32_t to;
+	uint8_t port;
+	uint64_t weight;
+	struct dfsssp_link *rev;
+	struct dfsssp_link *next;
+} dfsssp_link_t;
+
+typedef struct dfsssp_vertex {
+	osm_switch_t *sw;
+	uint8_t num_ports;
+	dfsssp_link_t *links;
+	dfsssp_link_t **port_link;
+	uint32_t num_terminals;
+	uint64_t distance;
+	dfsssp_link_t *used_link;
+	uint32_t heap_index;
+	uint32_t flow;
+	uint8_t *layer;
+} dfsssp_vertex_t;
+
+typedef struct dfsssp_dest {
+	uint16_t lid;
+	uint32_t vertex;
+	uint8_t port;
+	boolean_t is_terminal;
+} dfsssp_dest_t;
+
+typedef struct dfsssp_cdg_edge {
+	uint32_t to;
+	uint32_t num_paths;
+	struct dfsssp_cdg_edge *next;
+} dfsssp_cdg_edge_t;
+
+typedef struct dfsssp {
+	osm_opensm_t *p_osm;
+	dfsssp_vertex_t *vertices;
+	uint32_t num_vertices;
+	dfsssp_link_t **channels;
+	uint32_t num_channels;
+	dfsssp_dest_t *dests;
+	uint32_t num_dests;
+	uint16_t max_lid;
+	uint32_t *lid_vertex;
+	uint32_t *heap;
+	uint32_t heap_size;
+	uint32_t *order;
+	uint32_t *path;
+	dfsssp_cdg_edge_t **cdg;
+	uint8_t *color;
+	uint32_t *stack;
+	dfsssp_cdg_edge_t **stack_edge;
+	uint32_t *stack_pos;
+	uint8_t max_layers;
+	uint8_t num_layers;
+	uint64_t layer_paths[IB_MAX_NUM_VLS];
+} dfsssp_t;
+/*
+ * vertices
+ *	One vertex per switch.  Links are directed, one per connected switch
+ *	port; rev is the link of the same cable in the other direction.
+ *
+ * dests
+ *	Every LID in the subnet, with the switch it hangs off and the port
+ *	leading to it from there (0 for the switch itself).  Ordered by LMC
+ *	offset first so that all base LIDs are routed before any alternates.
+ *
+ * lid_vertex
+ *	Switch vertex of each routed LID, DFSSSP_NONE for unrouted LIDs.
+ *
+ * heap, order, path
+ *	Scratch space: the Dijkstra priority queue, the order in which it
+ *	settled the vertices, and the channels of one path.
+ *
+ * cdg
+ *	Channel dependency graph of the layer being processed, one edge
+ *	list per channel.
+ *
+ * layer (per vertex)
+ *	Virtual layer of the path from the switch to each LID.
+ */
+
+static void dfsssp_cdg_clear(dfsssp_t * p_dfsssp)
+{
+	dfsssp_cdg_edge_t *e, *next;
+	uint32_t i;
+
+	if (!p_dfsssp->cdg)
+		return;
+
+	for (i = 0; i < p_dfsssp->num_channels; i++) {
+		for (e = p_dfsssp->cdg[i]; e; e = next) {
+			next = e->next;
+			free(e);
+		}
+		p_dfsssp->cdg[i] = NULL;
+	}
+}
+
+static void dfsssp_clear_priv(dfsssp_t * p_dfsssp)
+{
+	osm_subn_t *p_subn = &p_dfsssp->p_osm->subn;
+	osm_switch_t *p_sw;
+
+	/* drop any existing references to dfsssp vertices */
+	for (p_sw = (osm_switch_t *) cl_qmap_head(&p_subn->sw_guid_tbl);
+	     p_sw != (osm_switch_t *) cl_qmap_end(&p_subn->sw_guid_tbl);
+	     p_sw = (osm_switch_t *) cl_qmap_next(&p_sw->map_item))
+		p_sw->priv = NULL;
+}
+
+static void dfsssp_cleanup(dfsssp_t * p_dfsssp)
+{
+	dfsssp_link_t *l, *next;
+	uint32_t i;
+
+	dfsssp_cdg_clear(p_dfsssp);
+
+	if (p_dfsssp->vertices) {
+		for (i = 0; i < p_dfsssp->num_vertices; i++) {
+			for (l = p_dfsssp->vertices[i].links; l; l = next) {
+				next = l->next;
+				free(l);
+			}
+			free(p_dfsssp->vertices[i].port_link);
+			free(p_dfsssp->vertices[i].layer);
+		}
+		free(p_dfsssp->vertices);
+	}
+
+	free(p_dfsssp->channels);
+	free(p_dfsssp->dests);
+	free(p_dfsssp->lid_vertex);
+	free(p_dfsssp->heap);
+	free(p_dfsssp->order);
+	free(p_dfsssp->path);
+	free(p_dfsssp->cdg);
+	free(p_dfsssp->color);
+	free(p_dfsssp->stack);
+	free(p_dfsssp->stack_edge);
+	free(p_dfsssp->stack_pos);
+
+	p_dfsssp->vertices = NULL;
+	p_dfsssp->num_vertices = 0;
+	p_dfsssp->channels = NULL;
+	p_dfsssp->num_channels = 0;
+	p_dfsssp->dests = NULL;
+	p_dfsssp->num_dests = 0;
+	p_dfsssp->lid_vertex = NULL;
+	p_dfsssp->heap = NULL;
+	p_dfsssp->order = NULL;
+	p_dfsssp->path = NULL;
+	p_dfsssp->cdg = NULL;
+	p_dfsssp->color = NULL;
+	p_dfsssp->stack = NULL;
+	p_dfsssp->stack_edge = NULL;
+	p_dfsssp->stack_pos = NULL;
+	p_dfsssp->num_layers = 0;
+}
+
+static int dfsssp_build_graph(dfsssp_t * p_dfsssp)
+{
+	osm_log_t *p_log = &p_dfsssp->p_osm->log;
+	osm_subn_t *p_subn = &p_dfsssp->p_osm->subn;
+	osm_switch_t *p_sw;
+	osm_physp_t *p_physp, *p_rem_physp;
+	dfsssp_vertex_t *v;
+	dfsssp_link_t *l, *r;
+	uint32_t i, num_links = 0;
+	uint8_t port, op_vls, vl_min = 5;
+
+	OSM_LOG_ENTER(p_log);
+
+	p_dfsssp->num_vertices = cl_qmap_count(&p_subn->sw_guid_tbl);
+	p_dfsssp->vertices = calloc(p_dfsssp->num_vertices,
+				    sizeof(dfsssp_vertex_t));
+	if (!p_dfsssp->vertices)
+		goto Error;
+
+	i = 0;
+	for (p_sw = (osm_switch_t *) cl_qmap_head(&p_subn->sw_guid_tbl);
+	     p_sw != (osm_switch_t *) cl_qmap_end(&p_subn->sw_guid_tbl);
+	     p_sw = (osm_switch_t *) cl_qmap_next(&p_sw->map_item)) {
+		v = &p_dfsssp->vertices[i++];
+		v->sw = p_sw;
+		v->num_ports = osm_node_get_num_physp(p_sw->p_node);
+		v->port_link = calloc(v->num_ports, sizeof(dfsssp_link_t *));
+		if (!v->port_link)
+			goto Error;
+		p_sw->priv = v;
+	}
+
+	/* one directed link per connected switch port, starting at port 1 */
+	for (i = 0; i < p_dfsssp->num_vertices; i++) {
+		v = &p_dfsssp->vertices[i];
+		for (port = 1; port < v->num_ports; port++) {
+			p_physp = osm_node_get_physp_ptr(v->sw->p_node, port);
+			if (!p_physp)
+				continue;
+			p_rem_physp = p_physp->p_remote_physp;
+			if (!p_rem_physp)
+				continue;
+
+			op_vls = ib_port_info_get_op_vls(&p_physp->port_info);
+			if (op_vls && op_vls < vl_min)
+				vl_min = op_vls;
+
+			if (!p_rem_physp->p_node->sw ||
+			    p_rem_physp->p_node->sw == v->sw)
+				continue;
+
+			l = calloc(1, sizeof(dfsssp_link_t));
+			if (!l)
+				goto Error;
+			l->id = num_links++;
+			l->from = i;
+			l->to = (uint32_t) ((dfsssp_vertex_t *)
+					    p_rem_physp->p_node->sw->priv -
+					    p_dfsssp->vertices);
+			l->port = port;
+			l->weight = 1;
+			l->next = v->links;
+			v->links = l;
+			v->port_link[port] = l;
+		}
+	}
+
+	p_dfsssp->num_channels = num_links;
+	p_dfsssp->channels = calloc(num_links ? num_links : 1,
+				    sizeof(dfsssp_link_t *));
+	if (!p_dfsssp->channels)
+		goto Error;
+
+	/* pair every link with the opposite direction of the same cable */
+	for (i = 0; i < p_dfsssp->num_vertices; i++) {
+		v = &p_dfsssp->vertices[i];
+		for (l = v->links; l; l = l->next) {
+			p_dfsssp->channels[l->id] = l;
+			p_physp = osm_node_get_physp_ptr(v->sw->p_node, l->port);
+			p_rem_physp = p_physp->p_remote_physp;
+			r = p_dfsssp->vertices[l->to].
+			    port_link[osm_physp_get_port_num(p_rem_physp)];
+			if (!r || r->to != i) {
+				OSM_LOG(p_log, OSM_LOG_ERROR, "ERR AF01: "
+					"link from switch 0x%016" PRIx64
+					" port %u has no way back\n",
+					cl_ntoh64(osm_node_get_node_guid
+						  (v->sw->p_node)), l->port);
+				goto Error;
+			}
+			l->rev = r;
+		}
+	}
+
+	vl_min = 1 << (vl_min - 1);
+	if (vl_min > 15)
+		vl_min = 15;
+	p_dfsssp->max_layers = vl_min;
+
+	OSM_LOG(p_log, OSM_LOG_VERBOSE,
+		"%u switches, %u links, %u VLs available\n",
+		p_dfsssp->num_vertices, p_dfsssp->num_channels,
+		p_dfsssp->max_layers);
+
+	OSM_LOG_EXIT(p_log);
+	return 0;
+
+Error:
+	OSM_LOG(p_log, OSM_LOG_ERROR, "ERR AF02: "
+		"cannot build the switch graph\n");
+	OSM_LOG_EXIT(p_log);
+	return -1;
+}
+
+static int dfsssp_add_dest(dfsssp_t * p_dfsssp, uint16_t lid,
+			   osm_port_t * p_port)
+{
+	osm_physp_t *p_physp = p_port->p_physp;
+	dfsssp_dest_t *d = &p_dfsssp->dests[p_dfsssp->num_dests];
+	osm_switch_t *p_sw;
+
+	if (p_port->p_node->sw) {
+		p_sw = p_port->p_node->sw;
+		d->port = 0;
+		d->is_terminal = FALSE;
+	} else {
+		if (!p_physp->p_remote_physp ||
+		    !p_physp->p_remote_physp->p_node->sw)
+			return 0;
+		p_sw = p_physp->p_remote_physp->p_node->sw;
+		d->port = osm_physp_get_port_num(p_physp->p_remote_physp);
+		d->is_terminal = TRUE;
+	}
+
+	if (!p_sw->priv)
+		return 0;
+
+	d->lid = lid;
+	d->vertex = (uint32_t) ((dfsssp_vertex_t *) p_sw->priv -
+				p_dfsssp->vertices);
+	p_dfsssp->lid_vertex[lid] = d->vertex;
+	p_dfsssp->num_dests++;
+	return 1;
+}
+
+static int dfsssp_find_dests(dfsssp_t * p_dfsssp)
+{
+	osm_log_t *p_log = &p_dfsssp->p_osm->log;
+	osm_subn_t *p_subn = &p_dfsssp->p_osm->subn;
+	cl_qmap_t *p_tbl = &p_subn->port_guid_tbl;
+	cl_map_item_t *item;
+	osm_port_t *p_port;
+	osm_physp_t *p_rem_physp;
+	uint16_t min_lid_ho, max_lid_ho, lid;
+	uint32_t i, n = 0;
+	unsigned offset, lids_per_port;
+
+	OSM_LOG_ENTER(p_log);
+
+	p_dfsssp->max_lid = 0;
+	for (item = cl_qmap_head(p_tbl); item != cl_qmap_end(p_tbl);
+	     item = cl_qmap_next(item)) {
+		p_port = (osm_port_t *) item;
+		osm_port_get_lid_range_ho(p_port, &min_lid_ho, &max_lid_ho);
+		if (!min_lid_ho || !max_lid_ho)
+			continue;
+		n += max_lid_ho - min_lid_ho + 1;
+		if (max_lid_ho > p_dfsssp->max_lid)
+			p_dfsssp->max_lid = max_lid_ho;
+
+		/* source ports attached to each switch */
+		if (!p_port->p_node->sw) {
+			p_rem_physp = p_port->p_physp->p_remote_physp;
+			if (p_rem_physp && p_rem_physp->p_node->sw &&
+			    p_rem_physp->p_node->sw->priv)
+				((dfsssp_vertex_t *) p_rem_physp->p_node->sw->
+				 priv)->num_terminals++;
+		}
+	}
+
+	p_dfsssp->dests = calloc(n ? n : 1, sizeof(dfsssp_dest_t));
+	p_dfsssp->lid_vertex = malloc((p_dfsssp->max_lid + 1) *
+				      sizeof(uint32_t));
+	if (!p_dfsssp->dests || !p_dfsssp->lid_vertex) {
+		OSM_LOG(p_log, OSM_LOG_ERROR, "ERR AF03: "
+			"cannot allocate the destination table\n");
+		OSM_LOG_EXIT(p_log);
+		return -1;
+	}
+	for (lid = 0; lid <= p_dfsssp->max_lid; lid++)
+		p_dfsssp->lid_vertex[lid] = DFSSSP_NONE;
+
+	lids_per_port = 1 << p_subn->opt.lmc;
+	for (offset = 0; offset < lids_per_port; offset++) {
+		for (item = cl_qmap_head(p_tbl); item != cl_qmap_end(p_tbl);
+		     item = cl_qmap_next(item)) {
+			p_port = (osm_port_t *) item;
+			osm_port_get_lid_range_ho(p_port, &min_lid_ho,
+						  &max_lid_ho);
+			if (!min_lid_ho || !max_lid_ho ||
+			    min_lid_ho + offset > max_lid_ho)
+				continue;
+			dfsssp_add_dest(p_dfsssp, min_lid_ho + offset, p_port);
+		}
+	}
+
+	for (i = 0; i < p_dfsssp->num_vertices; i++) {
+		p_dfsssp->vertices[i].layer = calloc(p_dfsssp->max_lid + 1,
+						     sizeof(uint8_t));
+		if (!p_dfsssp->vertices[i].layer) {
+			OSM_LOG(p_log, OSM_LOG_ERROR, "ERR AF04: "
+				"cannot allocate the layer tables\n");
+			OSM_LOG_EXIT(p_log);
+			return -1;
+		}
+	}
+
+	OSM_LOG(p_log, OSM_LOG_VERBOSE, "%u destination LIDs\n",
+		p_dfsssp->num_dests);
+	OSM_LOG_EXIT(p_log);
+	return 0;
+}
+
+/*
+ * Binary min-heap of vertex indices, keyed by distance.  heap_index of a
+ * vertex is its position in the heap, DFSSSP_NONE when not queued.
+ */
+static inline int heap_less(dfsssp_t * p_dfsssp, uint32_t a, uint32_t b)
+{
+	dfsssp_vertex_t *va = &p_dfsssp->vertices[a];
+	dfsssp_vertex_t *vb = &p_dfsssp->vertices[b];
+
+	if (va->distance != vb->distance)
+		return va->distance < vb->distance;
+	return a < b;
+}
+
+static inline void heap_set(dfsssp_t * p_dfsssp, uint32_t pos, uint32_t v)
+{
+	p_dfsssp->heap[pos] = v;
+	p_dfsssp->vertices[v].heap_index = pos;
+}
+
+static void heap_up(dfsssp_t * p_dfsssp, uint32_t pos)
+{
+	uint32_t v = p_dfsssp->heap[pos], parent;
+
+	while (pos) {
+		parent = (pos - 1) / 2;
+		if (!heap_less(p_dfsssp, v, p_dfsssp->heap[parent]))
+			break;
+		heap_set(p_dfsssp, pos, p_dfsssp->heap[parent]);
+		pos = parent;
+	}
+	heap_set(p_dfsssp, pos, v);
+}
+
+static void heap_down(dfsssp_t * p_dfsssp, uint32_t pos)
+{
+	uint32_t v = p_dfsssp->heap[pos], child;
+
+	for (;;) {
+		child = 2 * pos + 1;
+		if (child >= p_dfsssp->heap_size)
+			break;
+		if (child + 1 < p_dfsssp->heap_size &&
+		    heap_less(p_dfsssp, p_dfsssp->heap[child + 1],
+			      p_dfsssp->heap[child]))
+			child++;
+		if (!heap_less(p_dfsssp, p_dfsssp->heap[child], v))
+			break;
+		heap_set(p_dfsssp, pos, p_dfsssp->heap[child]);
+		pos = child;
+	}
+	heap_set(p_dfsssp, pos, v);
+}
+
+static void heap_update(dfsssp_t * p_dfsssp, uint32_t v)
+{
+	if (p_dfsssp->vertices[v].heap_index == DFSSSP_NONE) {
+		heap_set(p_dfsssp, p_dfsssp->heap_size++, v);
+		heap_up(p_dfsssp, p_dfsssp->heap_size - 1);
+	} else
+		heap_up(p_dfsssp, p_dfsssp->vertices[v].heap_index);
+}
+
+static uint32_t heap_pop(dfsssp_t * p_dfsssp)
+{
+	uint32_t v = p_dfsssp->heap[0];
+
+	p_dfsssp->vertices[v].heap_index = DFSSSP_NONE;
+	if (--p_dfsssp->heap_size) {
+		heap_set(p_dfsssp, 0, p_dfsssp->heap[p_dfsssp->heap_size]);
+		heap_down(p_dfsssp, 0);
+	}
+	return v;
+}
+
+/*
+ * Computes the lightest path from every switch to the destination switch.
+ * Relaxes the reverse of every link out of a settled vertex, so used_link
+ * of each vertex ends up being its next hop towards dest.  Returns the
+ * number of settled vertices, in settle order in p_dfsssp->order.
+ */
+static uint32_t dfsssp_dijkstra(dfsssp_t * p_dfsssp, uint32_t dest)
+{
+	dfsssp_vertex_t *u, *w;
+	dfsssp_link_t *l;
+	uint32_t i, n = 0;
+	uint64_t distance;
+
+	for (i = 0; i < p_dfsssp->num_vertices; i++) {
+		p_dfsssp->vertices[i].distance = DFSSSP_INFINITY;
+		p_dfsssp->vertices[i].used_link = NULL;
+		p_dfsssp->vertices[i].heap_index = DFSSSP_NONE;
+	}
+
+	p_dfsssp->heap_size = 0;
+	p_dfsssp->vertices[dest].distance = 0;
+	heap_update(p_dfsssp, dest);
+
+	while (p_dfsssp->heap_size) {
+		i = heap_pop(p_dfsssp);
+		p_dfsssp->order[n++] = i;
+		u = &p_dfsssp->vertices[i];
+		for (l = u->links; l; l = l->next) {
+			w = &p_dfsssp->vertices[l->to];
+			distance = u->distance + l->rev->weight;
+			if (distance < w->distance) {
+				w->distance = distance;
+				w->used_link = l->rev;
+				heap_update(p_dfsssp, l->to);
+			}
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Adds the source ports routed over each link for this destination to its
+ * weight.  Vertices settle in order of distance, so walking the settle
+ * order backwards visits every vertex after all vertices routed through it.
+ */
+static void dfsssp_update_weights(dfsssp_t * p_dfsssp, uint32_t num_settled)
+{
+	dfsssp_vertex_t *v;
+	uint32_t i;
+
+	for (i = 0; i < num_settled; i++) {
+		v = &p_dfsssp->vertices[p_dfsssp->order[i]];
+		v->flow = v->num_terminals;
+	}
+
+	for (i = num_settled - 1; i > 0; i--) {
+		v = &p_dfsssp->vertices[p_dfsssp->order[i]];
+		if (!v->flow)
+			continue;
+		v->used_link->weight += v->flow;
+		p_dfsssp->vertices[v->used_link->to].flow += v->flow;
+	}
+}
+
+static int dfsssp_route(dfsssp_t * p_dfsssp)
+{
+	osm_log_t *p_log = &p_dfsssp->p_osm->log;
+	dfsssp_vertex_t *v;
+	dfsssp_dest_t *d;
+	uint32_t i, j, n;
+
+	OSM_LOG_ENTER(p_log);
+
+	for (i = 0; i < p_dfsssp->num_vertices; i++) {
+		v = &p_dfsssp->vertices[i];
+		memset(v->sw->new_lft, OSM_NO_PATH, v->sw->max_lid_ho + 1);
+	}
+
+	for (i = 0; i < p_dfsssp->num_dests; i++) {
+		d = &p_dfsssp->dests[i];
+		n = dfsssp_dijkstra(p_dfsssp, d->vertex);
+
+		for (j = 0; j < n; j++) {
+			v = &p_dfsssp->vertices[p_dfsssp->order[j]];
+			if (d->lid > v->sw->max_lid_ho)
+				continue;
+			v->sw->new_lft[d->lid] = (j == 0) ?
+			    d->port : v->used_link->port;
+		}
+
+		if (n < p_dfsssp->num_vertices)
+			OSM_LOG(p_log, OSM_LOG_DEBUG,
+				"LID %u unreachable from %u switches\n",
+				d->lid, p_dfsssp->num_vertices - n);
+
+		/* only traffic to end ports counts towards the link load */
+		if (d->is_terminal)
+			dfsssp_update_weights(p_dfsssp, n);
+	}
+
+	OSM_LOG_EXIT(p_log);
+	return 0;
+}
+
+/*
+ * Collects the channels of the path from switch src to dest into
+ * p_dfsssp->path, following the forwarding tables just built.  Returns the
+ * number of channels, or -1 if the path does not reach dest.
+ */
+static int dfsssp_get_path(dfsssp_t * p_dfsssp, uint32_t src,
+			   const dfsssp_dest_t * d)
+{
+	dfsssp_vertex_t *v;
+	dfsssp_link_t *l;
+	uint8_t port;
+	int n = 0;
+
+	while (src != d->vertex) {
+		if ((uint32_t) n >= p_dfsssp->num_vertices)
+			return -1;
+		v = &p_dfsssp->vertices[src];
+		if (d->lid > v->sw->max_lid_ho)
+			return -1;
+		port = v->sw->new_lft[d->lid];
+		if (port == OSM_NO_PATH || port == 0 || port >= v->num_ports)
+			return -1;
+		l = v->port_link[port];
+		if (!l)
+			return -1;
+		p_dfsssp->path[n++] = l->id;
+		src = l->to;
+	}
+
+	return n;
+}
+
+static int dfsssp_cdg_add(dfsssp_t * p_dfsssp, uint32_t from, uint32_t to)
+{
+	dfsssp_cdg_edge_t *e;
+
+	for (e = p_dfsssp->cdg[from]; e; e = e->next)
+		if (e->to == to) {
+			e->num_paths++;
+			return 0;
+		}
+
+	e = malloc(sizeof(dfsssp_cdg_edge_t));
+	if (!e)
+		return -1;
+	e->to = to;
+	e->num_paths = 1;
+	e->next = p_dfsssp->cdg[from];
+	p_dfsssp->cdg[from] = e;
+	return 0;
+}
+
+static void dfsssp_cdg_remove(dfsssp_t * p_dfsssp, uint32_t from, uint32_t to)
+{
+	dfsssp_cdg_edge_t **pp_e, *e;
+
+	for (pp_e = &p_dfsssp->cdg[from]; (e = *pp_e); pp_e = &e->next)
+		if (e->to == to) {
+			if (!--e->num_paths) {
+				*pp_e = e->next;
+				free(e);
+			}
+			return;
+		}
+}
+
+/*
+ * Builds the CDG of a layer from all paths currently assigned to it.
+ * Returns the number of paths in the layer, or -1 on allocation failure.
+ */
+static int64_t dfsssp_cdg_build(dfsssp_t * p_dfsssp, uint8_t layer)
+{
+	dfsssp_dest_t *d;
+	uint32_t i, src;
+	int64_t num_paths = 0;
+	int n, k;
+
+	dfsssp_cdg_clear(p_dfsssp);
+
+	for (i = 0; i < p_dfsssp->num_dests; i++) {
+		d = &p_dfsssp->dests[i];
+		for (src = 0; src < p_dfsssp->num_vertices; src++) {
+			if (src == d->vertex ||
+			    p_dfsssp->vertices[src].layer[d->lid] != layer)
+				continue;
+			n = dfsssp_get_path(p_dfsssp, src, d);
+			if (n < 0)
+				continue;
+			num_paths++;
+			for (k = 0; k + 1 < n; k++)
+				if (dfsssp_cdg_add(p_dfsssp, p_dfsssp->path[k],
+						   p_dfsssp->path[k + 1]))
+					return -1;
+		}
+	}
+
+	return num_paths;
+}
+
+/*
+ * Depth first search for a cycle in the CDG.  Returns TRUE and the edge of
+ * the cycle induced by the fewest paths if there is one.
+ */
+static boolean_t dfsssp_cdg_find_cycle(dfsssp_t * p_dfsssp,
+				       uint32_t * p_from, uint32_t * p_to)
+{
+	dfsssp_cdg_edge_t *e, *weakest;
+	uint32_t start, c, top, i;
+
+	memset(p_dfsssp->color, 0, p_dfsssp->num_channels);
+
+	for (start = 0; start < p_dfsssp->num_channels; start++) {
+		if (p_dfsssp->color[start])
+			continue;
+
+		top = 0;
+		p_dfsssp->stack[0] = start;
+		p_dfsssp->stack_edge[0] = p_dfsssp->cdg[start];
+		p_dfsssp->stack_pos[start] = 0;
+		p_dfsssp->color[start] = 1;
+
+		for (;;) {
+			c = p_dfsssp->stack[top];
+			e = p_dfsssp->stack_edge[top];
+			if (!e) {
+				p_dfsssp->color[c] = 2;
+				if (!top)
+					break;
+				top--;
+				p_dfsssp->stack_edge[top] =
+				    p_dfsssp->stack_edge[top]->next;
+				continue;
+			}
+
+			if (p_dfsssp->color[e->to] == 0) {
+				top++;
+				p_dfsssp->stack[top] = e->to;
+				p_dfsssp->stack_edge[top] = p_dfsssp->cdg[e->to];
+				p_dfsssp->stack_pos[e->to] = top;
+				p_dfsssp->color[e->to] = 1;
+				continue;
+			}
+
+			if (p_dfsssp->color[e->to] == 1) {
+				/* the cycle is the stack from e->to up to c */
+				weakest = e;
+				*p_from = c;
+				for (i = p_dfsssp->stack_pos[e->to]; i < top; i++)
+					if (p_dfsssp->stack_edge[i]->num_paths <
+					    weakest->num_paths) {
+						weakest = p_dfsssp->stack_edge[i];
+						*p_from = p_dfsssp->stack[i];
+					}
+				*p_to = weakest->to;
+				return TRUE;
+			}
+
+			p_dfsssp->stack_edge[top] = e->next;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * Moves every path of the layer that induces the dependency from -> to
+ * up to the next layer, taking its dependencies out of the layer's CDG.
+ * Returns the number of paths moved, or -1 if the layers are exhausted.
+ */
+static int64_t dfsssp_move_paths(dfsssp_t * p_dfsssp, uint8_t layer,
+				 uint32_t from, uint32_t to)
+{
+	dfsssp_link_t *l1 = p_dfsssp->channels[from];
+	dfsssp_link_t *l2 = p_dfsssp->channels[to];
+	osm_switch_t *p_sw1 = p_dfsssp->vertices[l1->from].sw;
+	osm_switch_t *p_sw2 = p_dfsssp->vertices[l2->from].sw;
+	dfsssp_dest_t *d;
+	uint32_t i, src;
+	int64_t moved = 0;
+	int n, k;
+
+	if (layer + 1 >= p_dfsssp->max_layers)
+		return -1;
+
+	for (i = 0; i < p_dfsssp->num_dests; i++) {
+		d = &p_dfsssp->dests[i];
+		if (d->lid > p_sw1->max_lid_ho || d->lid > p_sw2->max_lid_ho ||
+		    p_sw1->new_lft[d->lid] != l1->port ||
+		    p_sw2->new_lft[d->lid] != l2->port)
+			continue;
+
+		for (src = 0; src < p_dfsssp->num_vertices; src++) {
+			if (src == d->vertex ||
+			    p_dfsssp->vertices[src].layer[d->lid] != layer)
+				continue;
+			n = dfsssp_get_path(p_dfsssp, src, d);
+			for (k = 0; k + 1 < n; k++)
+				if (p_dfsssp->path[k] == from &&
+				    p_dfsssp->path[k + 1] == to)
+					break;
+			if (k + 1 >= n)
+				continue;
+
+			for (k = 0; k + 1 < n; k++)
+				dfsssp_cdg_remove(p_dfsssp, p_dfsssp->path[k],
+						  p_dfsssp->path[k + 1]);
+			p_dfsssp->vertices[src].layer[d->lid] = layer + 1;
+			moved++;
+		}
+	}
+
+	return moved;
+}
+
+static int dfsssp_assign_layers(dfsssp_t * p_dfsssp)
+{
+	osm_log_t *p_log = &p_dfsssp->p_osm->log;
+	uint32_t from, to, num_cycles;
+	int64_t num_paths, moved;
+	uint8_t layer;
+	int status = 0;
+
+	OSM_LOG_ENTER(p_log);
+
+	memset(p_dfsssp->layer_paths, 0, sizeof(p_dfsssp->layer_paths));
+	p_dfsssp->num_layers = 0;
+
+	for (layer = 0; layer < p_dfsssp->max_layers; layer++) {
+		num_paths = dfsssp_cdg_build(p_dfsssp, layer);
+		if (num_paths < 0) {
+			OSM_LOG(p_log, OSM_LOG_ERROR, "ERR AF05: "
+				"cannot allocate the channel dependency "
+				"graph\n");
+			status = -1;
+			goto Exit;
+		}
+		if (!num_paths)
+			break;
+
+		num_cycles = 0;
+		while (dfsssp_cdg_find_cycle(p_dfsssp, &from, &to)) {
+			moved = dfsssp_move_paths(p_dfsssp, layer, from, to);
+			if (moved < 0) {
+				OSM_LOG(p_log, OSM_LOG_ERROR, "ERR AF06: "
+					"%u VLs are not enough to break all "
+					"credit loops\n", p_dfsssp->max_layers);
+				status = -1;
+				goto Exit;
+			}
+			if (!moved) {
+				OSM_LOG(p_log, OSM_LOG_ERROR, "ERR AF07: "
+					"no path induces a dependency of the "
+					"cycle found in layer %u\n", layer);
+				status = -1;
+				goto Exit;
+			}
+			num_paths -= moved;
+			num_cycles++;
+		}
+
+		p_dfsssp->layer_paths[layer] = num_paths;
+		p_dfsssp->num_layers = layer + 1;
+		OSM_LOG(p_log, OSM_LOG_VERBOSE,
+			"layer %u: %" PRIu64 " paths, %u cycles broken\n",
+			layer, num_paths, num_cycles);
+	}
+
+Exit:
+	dfsssp_cdg_clear(p_dfsssp);
+	OSM_LOG_EXIT(p_log);
+	return status;
+}
+
+static void dfsssp_report(dfsssp_t * p_dfsssp, uint64_t route_time,
+			  uint64_t layer_time)
+{
+	osm_log_t *p_log = &p_dfsssp->p_osm->log;
+	dfsssp_link_t *l;
+	uint64_t load, min_load = DFSSSP_INFINITY, max_load = 0, total = 0;
+	uint32_t i, unused = 0;
+	uint8_t layer;
+
+	for (i = 0; i < p_dfsssp->num_channels; i++) {
+		l = p_dfsssp->channels[i];
+		load = l->weight - 1;
+		if (load < min_load)
+			min_load = load;
+		if (load > max_load)
+			max_load = load;
+		if (!load)
+			unused++;
+		total += load;
+
+		OSM_LOG(p_log, OSM_LOG_DEBUG,
+			"switch 0x%016" PRIx64 " port %u -> switch 0x%016"
+			PRIx64 ": %" PRIu64 " paths\n",
+			cl_ntoh64(osm_node_get_node_guid
+				  (p_dfsssp->vertices[l->from].sw->p_node)),
+			l->port,
+			cl_ntoh64(osm_node_get_node_guid
+				  (p_dfsssp->vertices[l->to].sw->p_node)),
+			load);
+	}
+
+	if (p_dfsssp->num_channels)
+		OSM_LOG(p_log, OSM_LOG_INFO,
+			"%u links carry %" PRIu64 " to %" PRIu64
+			" paths each, %" PRIu64 " on average, %u unused\n",
+			p_dfsssp->num_channels, min_load, max_load,
+			total / p_dfsssp->num_channels, unused);
+
+	for (layer = 0; layer < p_dfsssp->num_layers; layer++)
+		OSM_LOG(p_log, OSM_LOG_INFO, "SL %u: %" PRIu64 " paths\n",
+			layer, p_dfsssp->layer_paths[layer]);
+
+	OSM_LOG(p_log, OSM_LOG_INFO,
+		"%u LIDs routed in %" PRIu64 " ms, %u of %u VLs assigned in %"
+		PRIu64 " ms\n", p_dfsssp->num_dests, route_time / 1000,
+		p_dfsssp->num_layers, p_dfsssp->max_layers, layer_time / 1000);
+}
+
+static int dfsssp_alloc_scratch(dfsssp_t * p_dfsssp)
+{
+	uint32_t n = p_dfsssp->num_vertices;
+	uint32_t c = p_dfsssp->num_channels ? p_dfsssp->num_channels : 1;
+
+	p_dfsssp->heap = malloc(n * sizeof(uint32_t));
+	p_dfsssp->order = malloc(n * sizeof(uint32_t));
+	p_dfsssp->path = malloc(n * sizeof(uint32_t));
+	p_dfsssp->cdg = calloc(c, sizeof(dfsssp_cdg_edge_t *));
+	p_dfsssp->color = malloc(c);
+	p_dfsssp->stack = malloc(c * sizeof(uint32_t));
+	p_dfsssp->stack_edge = malloc(c * sizeof(dfsssp_cdg_edge_t *));
+	p_dfsssp->stack_pos = malloc(c * sizeof(uint32_t));
+
+	if (!p_dfsssp->heap || !p_dfsssp->order || !p_dfsssp->path ||
+	    !p_dfsssp->cdg || !p_dfsssp->color || !p_dfsssp->stack ||
+	    !p_dfsssp->stack_edge || !p_dfsssp->stack_pos) {
+		OSM_LOG(&p_dfsssp->p_osm->log, OSM_LOG_ERROR, "ERR AF08: "
+			"cannot allocate routing scratch space\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int dfsssp_process(void *context)
+{
+	dfsssp_t *p_dfsssp = context;
+	osm_log_t *p_log = &p_dfsssp->p_osm->log;
+	uint64_t start, routed, layered;
+	int status;
+
+	OSM_LOG_ENTER(p_log);
+
+	dfsssp_clear_priv(p_dfsssp);
+	dfsssp_cleanup(p_dfsssp);
+
+	start = cl_get_time_stamp();
+
+	status = dfsssp_build_graph(p_dfsssp);
+	if (status)
+		goto Exit;
+
+	status = dfsssp_find_dests(p_dfsssp);
+	if (status)
+		goto Exit;
+
+	status = dfsssp_alloc_scratch(p_dfsssp);
+	if (status)
+		goto Exit;
+
+	status = dfsssp_route(p_dfsssp);
+	if (status)
+		goto Exit;
+	routed = cl_get_time_stamp();
+
+	status = dfsssp_assign_layers(p_dfsssp);
+	if (status)
+		goto Exit;
+	layered = cl_get_time_stamp();
+
+	dfsssp_report(p_dfsssp, routed - start, layered - routed);
+
+Exit:
+	if (status) {
+		dfsssp_clear_priv(p_dfsssp);
+		dfsssp_cleanup(p_dfsssp);
+	}
+	OSM_LOG_EXIT(p_log);
+	return status;
+}
+
+/*
+ * With LMC > 0 every LID of a port is a separate destination with its own
+ * route, so its layer is looked up by the LID the path actually uses.
+ */
+static uint8_t get_dfsssp_sl(void *context, uint8_t path_sl_hint,
+			     const ib_net16_t slid, const ib_net16_t dlid)
+{
+	dfsssp_t *p_dfsssp = context;
+	osm_opensm_t *p_osm = p_dfsssp->p_osm;
+	uint16_t slid_ho, dlid_ho;
+	uint32_t src, dst;
+
+	if (!(p_osm->routing_engine_used &&
+	      p_osm->routing_engine_used->type ==
+	      OSM_ROUTING_ENGINE_TYPE_DFSSSP) || !p_dfsssp->lid_vertex)
+		return OSM_DEFAULT_SL;
+
+	slid_ho = cl_ntoh16(slid);
+	dlid_ho = cl_ntoh16(dlid);
+	if (!slid_ho || !dlid_ho || slid_ho > p_dfsssp->max_lid ||
+	    dlid_ho > p_dfsssp->max_lid)
+		return OSM_DEFAULT_SL;
+
+	src = p_dfsssp->lid_vertex[slid_ho];
+	dst = p_dfsssp->lid_vertex[dlid_ho];
+	if (src == DFSSSP_NONE || dst == DFSSSP_NONE)
+		return OSM_DEFAULT_SL;
+
+	if (src == dst)
+		return 0;
+
+	return p_dfsssp->vertices[src].layer[dlid_ho];
+}
+
+static void dfsssp_delete(void *context)
+{
+	dfsssp_t *p_dfsssp = context;
+
+	dfsssp_cleanup(p_dfsssp);
+	free(p_dfsssp);
+}
+
+int osm_ucast_dfsssp_setup(struct osm_routing_engine *r, osm_opensm_t * p_osm)
+{
+	dfsssp_t *p_dfsssp = calloc(1, sizeof(dfsssp_t));
+	if (!p_dfsssp)
+		return -1;
+
+	p_dfsssp->p_osm = p_osm;
+
+	r->context = p_dfsssp;
+	r->ucast_build_fwd_tables = dfsssp_process;
+	r->path_sl = get_dfsssp_sl;
+	r->destroy = dfsssp_delete;
+
+	return 0;
+}
@@ -51,6 +51,9 @@
 #include <iba/ib_types.h>
 #include <complib/cl_qmap.h>
 #include <complib/cl_debug.h>
+#include <complib/cl_atomic.h>
+#include <complib/cl_thread.h>
+#include <complib/cl_timer.h>
 #include <opensm/osm_opensm.h>
 #include <opensm/osm_switch.h>
 
@@ -124,6 +127,7 @@ typedef struct ftree_port_t_ {
 	uint8_t remote_port_num;	/* port number on the remote node */
 	uint32_t counter_up;	/* number of allocated routes upwards */
 	uint32_t counter_down;	/* number of allocated routes downwards */
+	uint32_t part_idx;	/* index of this port's copy in a partition */
 } ftree_port_t;
 
 /***************************************************
@@ -154,6 +158,7 @@ typedef struct ftree_port_group_t_ {
 	boolean_t is_io;	/* whether this port is an I/O node */
 	uint32_t counter_down;	/* number of allocated routes downwards */
 	uint32_t counter_up;	/* number of allocated routes upwards */
+	uint32_t part_idx;	/* index of this group's copy in a partition */
 } ftree_port_group_t;
 
 /***************************************************
@@ -179,6 +184,7 @@ typedef struct ftree_sw_t_ {
 	uint8_t *hops;
 	uint32_t min_counter_down;
 	boolean_t counter_up_changed;
+	uint32_t part_idx;
 } ftree_sw_t;
 
 /***************************************************
@@ -219,6 +225,32 @@ typedef struct ftree_fabric_t_ {
 	boolean_t fabric_built;
 } ftree_fabric_t;
 
+/***************************************************
+ **
+ **  ftree_part_t definition
+ **
+ ***************************************************/
+
+/*
+ * In parallel mode the leaf switches are split into partitions that
+ * route their compute nodes concurrently. Each partition works on its
+ * own copy of the switches, switch port groups and ports, so that it
+ * keeps its own port load counters, and the counters are added up
+ * once all partitions are done.
+ */
+typedef struct ftree_part_t_ {
+	ftree_fabric_t *p_ftree;
+	cl_thread_t thread;
+	uint32_t first_leaf;
+	uint32_t leaves_num;
+	ftree_sw_t *sw_array;
+	ftree_port_group_t *group_array;
+	ftree_port_t *port_array;
+	ftree_port_group_t **group_ptr_array;
+	uint32_t groups_num;
+	uint64_t usecs;
+} ftree_part_t;
+
 /***************************************************
  **
  ** comparators
@@ -273,30 +305,32 @@ static inline boolean_t tuple_assigned(IN ftree_tuple_t tuple)
 
 /***************************************************/
 
-#define FTREE_TUPLE_BUFFERS_NUM 6
+/* Partitions route in parallel, so there are enough buffers for
+   several threads to be logging tuples at the same time */
+#define FTREE_TUPLE_BUFFERS_NUM 64
 
 static char *tuple_to_str(IN ftree_tuple_t tuple)
 {
 	static char buffer[FTREE_TUPLE_BUFFERS_NUM][FTREE_TUPLE_BUFF_LEN];
-	static uint8_t ind = 0;
+	static atomic32_t next = 0;
 	char *ret_buffer;
 	uint32_t i;
 
 	if (!tuple_assigned(tuple))
 		return "INDEX.NOT.ASSIGNED";
 
-	buffer[ind][0] = '\0';
+	ret_buffer = buffer[(uint32_t) cl_atomic_inc(&next) %
+			    FTREE_TUPLE_BUFFERS_NUM];
+	ret_buffer[0] = '\0';
 
 	for (i = 0; (i < FTREE_TUPLE_LEN) && (tuple[i] != 0xFF); i++) {
-		if ((strlen(buffer[ind]) + 10) > FTREE_TUPLE_BUFF_LEN)
+		if ((strlen(ret_buffer) + 10) > FTREE_TUPLE_BUFF_LEN)
 			return "INDEX.TOO.LONG";
 		if (i != 0)
-			strcat(buffer[ind], ".");
-		sprintf(&buffer[ind][strlen(buffer[ind])], "%u", tuple[i]);
+			strcat(ret_buffer, ".");
+		sprintf(&ret_buffer[strlen(ret_buffer)], "%u", tuple[i]);
 	}
 
-	ret_buffer = buffer[ind];
-	ind = (ind + 1) % FTREE_TUPLE_BUFFERS_NUM;
 	return ret_buffer;
 }				/* tuple_to_str() */
 
@@ -782,6 +816,31 @@ static int set_hops_on_remote_sw(IN ftree_port_group_t * p_group,
 
 /***************************************************/
 
+static inline uint32_t sw_get_port_groups_num(IN ftree_sw_t * p_sw)
+{
+	return (uint32_t) p_sw->down_port_groups_num +
+	    p_sw->up_port_groups_num + p_sw->sibling_port_groups_num;
+}
+
+/***************************************************/
+
+/*
+ * Returns the i-th port group of a switch, counting the down,
+ * up and sibling port groups in this order.
+ */
+static inline ftree_port_group_t **sw_get_port_group_ptr(IN ftree_sw_t * p_sw,
+							 IN uint32_t i)
+{
+	if (i < p_sw->down_port_groups_num)
+		return &p_sw->down_port_groups[i];
+	i -= p_sw->down_port_groups_num;
+	if (i < p_sw->up_port_groups_num)
+		return &p_sw->up_port_groups[i];
+	return &p_sw->sibling_port_groups[i - p_sw->up_port_groups_num];
+}
+
+/***************************************************/
+
 static inline uint8_t
 sw_get_least_hops(IN ftree_sw_t * p_sw, IN uint16_t target_lid)
 {
@@ -2730,109 +2789,441 @@ fabric_route_downgoing_by_going_up(IN ftree_fabric_t * p_ftree,
  *          call assign-down-going-port-by-ascending-up(FALSE,TRUE) on CURRENT switch
  */
 
-static void fabric_route_to_cns(IN ftree_fabric_t * p_ftree)
+static void fabric_route_to_cns_on_leaf(IN ftree_fabric_t * p_ftree,
+					IN ftree_sw_t * p_sw)
 {
-	ftree_sw_t *p_sw;
 	ftree_hca_t *p_hca;
 	ftree_port_group_t *p_leaf_port_group;
 	ftree_port_group_t *p_hca_port_group;
 	ftree_port_t *p_port;
-	unsigned int i, j;
+	unsigned int j;
 	uint16_t hca_lid;
-	unsigned routed_targets_on_leaf;
+	unsigned routed_targets_on_leaf = 0;
 
-	OSM_LOG_ENTER(&p_ftree->p_osm->log);
+	/* for each HCA connected to this switch */
+	for (j = 0; j < p_sw->down_port_groups_num; j++) {
+		p_leaf_port_group = p_sw->down_port_groups[j];
 
-	/* for each leaf switch (in indexing order) */
-	for (i = 0; i < p_ftree->leaf_switches_num; i++) {
-		p_sw = p_ftree->leaf_switches[i];
-		routed_targets_on_leaf = 0;
+		/* work with this port group only if the remote node is CA */
+		if (p_leaf_port_group->remote_node_type != IB_NODE_TYPE_CA)
+			continue;
 
-		/* for each HCA connected to this switch */
-		for (j = 0; j < p_sw->down_port_groups_num; j++) {
-			p_leaf_port_group = p_sw->down_port_groups[j];
+		p_hca = p_leaf_port_group->remote_hca_or_sw.p_hca;
 
-			/* work with this port group only if the remote node is CA */
-			if (p_leaf_port_group->remote_node_type !=
-			    IB_NODE_TYPE_CA)
-				continue;
+		/* work with this port group only if remote HCA has CNs */
+		if (!p_hca->cn_num)
+			continue;
 
-			p_hca = p_leaf_port_group->remote_hca_or_sw.p_hca;
+		p_hca_port_group =
+		    hca_get_port_group_by_remote_lid(p_hca,
+						     p_leaf_port_group->
+						     base_lid);
+		CL_ASSERT(p_hca_port_group);
 
-			/* work with this port group only if remote HCA has CNs */
-			if (!p_hca->cn_num)
-				continue;
+		/* work with this port group only if remote port is CN */
+		if (!p_hca_port_group->is_cn)
+			continue;
 
-			p_hca_port_group =
-			    hca_get_port_group_by_remote_lid(p_hca,
-							     p_leaf_port_group->
-							     base_lid);
-			CL_ASSERT(p_hca_port_group);
+		/* obtain the LID of HCA port */
+		hca_lid = p_leaf_port_group->remote_base_lid;
 
-			/* work with this port group only if remote port is CN */
-			if (!p_hca_port_group->is_cn)
-				continue;
+		/* set local LFT(LID) to the port that is connected to HCA */
+		cl_ptr_vector_at(&p_leaf_port_group->ports, 0, (void *)&p_port);
+		p_sw->p_osm_sw->new_lft[hca_lid] = p_port->port_num;
 
-			/* obtain the LID of HCA port */
-			hca_lid = p_leaf_port_group->remote_base_lid;
+		OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_DEBUG,
+			"Switch %s: set path to CN LID %u through port %u\n",
+			tuple_to_str(p_sw->tuple), hca_lid, p_port->port_num);
 
-			/* set local LFT(LID) to the port that is connected to HCA */
-			cl_ptr_vector_at(&p_leaf_port_group->ports, 0,
-					 (void *)&p_port);
-			p_sw->p_osm_sw->new_lft[hca_lid] = p_port->port_num;
+		/* set local min hop table(LID) to route to the CA */
+		sw_set_hops(p_sw, hca_lid, p_port->port_num, 1, FALSE);
 
-			OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_DEBUG,
-				"Switch %s: set path to CN LID %u through port %u\n",
-				tuple_to_str(p_sw->tuple),
-				hca_lid, p_port->port_num);
+		/* Assign downgoing ports by stepping up.
+		   Since we're routing here only CNs, we're routing it as REAL
+		   LID and updating fat-tree balancing counters. */
+		fabric_route_downgoing_by_going_up(p_ftree, p_sw,	/* local switch - used as a route-downgoing alg. start point */
+						   NULL,	/* prev. position switch */
+						   hca_lid,	/* LID that we're routing to */
+						   TRUE,	/* whether this HCA LID is real or dummy */
+						   TRUE,	/* whether this path to HCA should by tracked by counters */
+						   FALSE,	/* wheter target lid is a switch or not */
+						   0,	/* Number of reverse hops allowed */
+						   0,	/* Number of reverse hops done yet */
+						   1);	/* Number of hops done yet */
 
-			/* set local min hop table(LID) to route to the CA */
-			sw_set_hops(p_sw, hca_lid, p_port->port_num, 1, FALSE);
+		/* count how many real targets have been routed from this leaf switch */
+		routed_targets_on_leaf++;
+	}
 
-			/* Assign downgoing ports by stepping up.
-			   Since we're routing here only CNs, we're routing it as REAL
-			   LID and updating fat-tree balancing counters. */
+	/* We're done with the real targets (all CNs) of this leaf switch.
+	   Now route the dummy HCAs that are missing or that are non-CNs.
+	   When routing to dummy HCAs we don't fill lid matrices. */
+	if (p_ftree->max_cn_per_leaf > routed_targets_on_leaf) {
+		OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_DEBUG,
+			"Routing %u dummy CAs\n",
+			p_ftree->max_cn_per_leaf - p_sw->down_port_groups_num);
+		for (j = 0; j < p_ftree->max_cn_per_leaf - routed_targets_on_leaf;
+		     j++) {
+			/* assign downgoing ports by stepping up */
 			fabric_route_downgoing_by_going_up(p_ftree, p_sw,	/* local switch - used as a route-downgoing alg. start point */
 							   NULL,	/* prev. position switch */
-							   hca_lid,	/* LID that we're routing to */
-							   TRUE,	/* whether this HCA LID is real or dummy */
+							   0,	/* LID that we're routing to - ignored for dummy HCA */
+							   FALSE,	/* whether this HCA LID is real or dummy */
 							   TRUE,	/* whether this path to HCA should by tracked by counters */
-							   FALSE,	/* wheter target lid is a switch or not */
+							   FALSE,	/* Wheter the target LID is a switch or not */
 							   0,	/* Number of reverse hops allowed */
 							   0,	/* Number of reverse hops done yet */
 							   1);	/* Number of hops done yet */
+		}
+	}
+}				/* fabric_route_to_cns_on_leaf() */
+
+/***************************************************/
+
+static void fabric_route_to_cns(IN ftree_fabric_t * p_ftree)
+{
+	unsigned int i;
+
+	OSM_LOG_ENTER(&p_ftree->p_osm->log);
+
+	/* for each leaf switch (in indexing order) */
+	for (i = 0; i < p_ftree->leaf_switches_num; i++)
+		fabric_route_to_cns_on_leaf(p_ftree,
+					    p_ftree->leaf_switches[i]);
+	/* done going through all the leaf switches */
+	OSM_LOG_EXIT(&p_ftree->p_osm->log);
+}				/* fabric_route_to_cns() */
 
-			/* count how many real targets have been routed from this leaf switch */
-			routed_targets_on_leaf++;
+/***************************************************/
+
+/*
+ * Number the switches and the port groups and ports that belong to
+ * switches, so that their copies can be found in a partition.
+ */
+static uint32_t fabric_number_sw_objects(IN ftree_fabric_t * p_ftree,
+					 OUT uint32_t * p_groups_num,
+					 OUT uint32_t * p_ports_num)
+{
+	ftree_sw_t *p_sw;
+	ftree_port_group_t *p_group;
+	ftree_port_t *p_port;
+	uint32_t sw_num = 0, groups_num = 0, ports_num = 0;
+	uint32_t i, j, size;
+
+	for (p_sw = (ftree_sw_t *) cl_qmap_head(&p_ftree->sw_tbl);
+	     p_sw != (ftree_sw_t *) cl_qmap_end(&p_ftree->sw_tbl);
+	     p_sw = (ftree_sw_t *) cl_qmap_next(&p_sw->map_item)) {
+		p_sw->part_idx = sw_num++;
+		for (i = 0; i < sw_get_port_groups_num(p_sw); i++) {
+			p_group = *sw_get_port_group_ptr(p_sw, i);
+			p_group->part_idx = groups_num++;
+			size = cl_ptr_vector_get_size(&p_group->ports);
+			for (j = 0; j < size; j++) {
+				cl_ptr_vector_at(&p_group->ports, j,
+						 (void *)&p_port);
+				p_port->part_idx = ports_num++;
+			}
 		}
+	}
 
-		/* We're done with the real targets (all CNs) of this leaf switch.
-		   Now route the dummy HCAs that are missing or that are non-CNs.
-		   When routing to dummy HCAs we don't fill lid matrices. */
-		if (p_ftree->max_cn_per_leaf > routed_targets_on_leaf) {
-			OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_DEBUG,
-				"Routing %u dummy CAs\n",
-				p_ftree->max_cn_per_leaf -
-				p_sw->down_port_groups_num);
-			for (j = 0; j <
-			     p_ftree->max_cn_per_leaf - routed_targets_on_leaf;
-			     j++) {
-				/* assign downgoing ports by stepping up */
-				fabric_route_downgoing_by_going_up(p_ftree, p_sw,	/* local switch - used as a route-downgoing alg. start point */
-								   NULL,	/* prev. position switch */
-								   0,	/* LID that we're routing to - ignored for dummy HCA */
-								   FALSE,	/* whether this HCA LID is real or dummy */
-								   TRUE,	/* whether this path to HCA should by tracked by counters */
-								   FALSE,	/* Wheter the target LID is a switch or not */
-								   0,	/* Number of reverse hops allowed */
-								   0,	/* Number of reverse hops done yet */
-								   1);	/* Number of hops done yet */
+	*p_groups_num = groups_num;
+	*p_ports_num = ports_num;
+	return sw_num;
+}
+
+/***************************************************/
+
+static void part_destroy(IN ftree_part_t * p_part)
+{
+	uint32_t i;
+
+	if (p_part->group_array)
+		for (i = 0; i < p_part->groups_num; i++)
+			cl_ptr_vector_destroy(&p_part->group_array[i].ports);
+	free(p_part->sw_array);
+	free(p_part->group_array);
+	free(p_part->port_array);
+	free(p_part->group_ptr_array);
+}
+
+/***************************************************/
+
+/*
+ * Copy the switches, their port groups and ports into the partition,
+ * pointing the copies at each other instead of at the originals.
+ * Must be called after fabric_number_sw_objects().
+ */
+static int part_init(IN ftree_part_t * p_part, IN ftree_fabric_t * p_ftree,
+		     IN uint32_t sw_num, IN uint32_t groups_num,
+		     IN uint32_t ports_num)
+{
+	ftree_sw_t *p_sw, *p_sw_copy;
+	ftree_port_group_t *p_group, *p_group_copy;
+	ftree_port_t *p_port, *p_port_copy;
+	ftree_port_group_t **pp_groups;
+	uint32_t i, j, size;
+
+	p_part->p_ftree = p_ftree;
+	p_part->groups_num = groups_num;
+	p_part->sw_array = malloc(sw_num * sizeof(ftree_sw_t));
+	p_part->group_array = calloc(groups_num, sizeof(ftree_port_group_t));
+	p_part->port_array = malloc(ports_num * sizeof(ftree_port_t));
+	p_part->group_ptr_array =
+	    malloc(groups_num * sizeof(ftree_port_group_t *));
+	if ((sw_num && !p_part->sw_array) ||
+	    (groups_num && (!p_part->group_array ||
+			    !p_part->group_ptr_array)) ||
+	    (ports_num && !p_part->port_array))
+		return -1;
+
+	for (i = 0; i < groups_num; i++)
+		cl_ptr_vector_construct(&p_part->group_array[i].ports);
+
+	pp_groups = p_part->group_ptr_array;
+	for (p_sw = (ftree_sw_t *) cl_qmap_head(&p_ftree->sw_tbl);
+	     p_sw != (ftree_sw_t *) cl_qmap_end(&p_ftree->sw_tbl);
+	     p_sw = (ftree_sw_t *) cl_qmap_next(&p_sw->map_item)) {
+		p_sw_copy = &p_part->sw_array[p_sw->part_idx];
+		memcpy(p_sw_copy, p_sw, sizeof(ftree_sw_t));
+
+		p_sw_copy->down_port_groups = pp_groups;
+		pp_groups += p_sw->down_port_groups_num;
+		p_sw_copy->up_port_groups = pp_groups;
+		pp_groups += p_sw->up_port_groups_num;
+		p_sw_copy->sibling_port_groups = pp_groups;
+		pp_groups += p_sw->sibling_port_groups_num;
+
+		for (i = 0; i < sw_get_port_groups_num(p_sw); i++) {
+			p_group = *sw_get_port_group_ptr(p_sw, i);
+			p_group_copy = &p_part->group_array[p_group->part_idx];
+			memcpy(p_group_copy, p_group,
+			       sizeof(ftree_port_group_t));
+			p_group_copy->hca_or_sw.p_sw = p_sw_copy;
+			if (p_group->remote_node_type == IB_NODE_TYPE_SWITCH)
+				p_group_copy->remote_hca_or_sw.p_sw =
+				    &p_part->sw_array[p_group->
+						      remote_hca_or_sw.p_sw->
+						      part_idx];
+
+			cl_ptr_vector_construct(&p_group_copy->ports);
+			size = cl_ptr_vector_get_size(&p_group->ports);
+			if (cl_ptr_vector_init(&p_group_copy->ports, size, 8) !=
+			    CL_SUCCESS)
+				return -1;
+			for (j = 0; j < size; j++) {
+				cl_ptr_vector_at(&p_group->ports, j,
+						 (void *)&p_port);
+				p_port_copy =
+				    &p_part->port_array[p_port->part_idx];
+				memcpy(p_port_copy, p_port,
+				       sizeof(ftree_port_t));
+				if (cl_ptr_vector_insert(&p_group_copy->ports,
+							 p_port_copy, NULL) !=
+				    CL_SUCCESS)
+					return -1;
 			}
+
+			*sw_get_port_group_ptr(p_sw_copy, i) = p_group_copy;
 		}
 	}
-	/* done going through all the leaf switches */
+
+	return 0;
+}
+
+/***************************************************/
+
+static void fabric_route_part(IN void *context)
+{
+	ftree_part_t *p_part = context;
+	ftree_fabric_t *p_ftree = p_part->p_ftree;
+	ftree_sw_t *p_sw;
+	uint64_t start = cl_get_time_stamp();
+	uint32_t i;
+
+	for (i = 0; i < p_part->leaves_num; i++) {
+		p_sw = p_ftree->leaf_switches[p_part->first_leaf + i];
+		fabric_route_to_cns_on_leaf(p_ftree,
+					    &p_part->sw_array[p_sw->part_idx]);
+	}
+
+	p_part->usecs = cl_get_time_stamp() - start;
+}
+
+/***************************************************/
+
+/*
+ * Reorder a switch's port group array to match the order of the same
+ * groups in a partition's copy of the switch.
+ */
+static void sw_copy_group_order(IN ftree_port_group_t ** pp_groups,
+				IN ftree_port_group_t ** pp_copies,
+				IN uint8_t groups_num)
+{
+	ftree_port_group_t *tmp;
+	uint8_t i, j;
+
+	for (i = 0; i < groups_num; i++)
+		for (j = i; j < groups_num; j++)
+			if (pp_groups[j]->part_idx == pp_copies[i]->part_idx) {
+				tmp = pp_groups[i];
+				pp_groups[i] = pp_groups[j];
+				pp_groups[j] = tmp;
+				break;
+			}
+}
+
+/***************************************************/
+
+/*
+ * Add the routes that each partition allocated on the ports and port
+ * groups to the fabric's own counters. Partitions are merged in order
+ * and only counts are added, so the result does not depend on how the
+ * threads were scheduled.
+ */
+static void fabric_merge_parts(IN ftree_fabric_t * p_ftree,
+			       IN ftree_part_t * parts, IN uint32_t parts_num)
+{
+	ftree_sw_t *p_sw, *p_sw_copy;
+	ftree_port_group_t *p_group, *p_group_copy;
+	ftree_port_t *p_port, *p_port_copy;
+	uint32_t up, down, idx;
+	uint32_t i, j, k, size;
+
+	for (p_sw = (ftree_sw_t *) cl_qmap_head(&p_ftree->sw_tbl);
+	     p_sw != (ftree_sw_t *) cl_qmap_end(&p_ftree->sw_tbl);
+	     p_sw = (ftree_sw_t *) cl_qmap_next(&p_sw->map_item)) {
+		for (i = 0; i < sw_get_port_groups_num(p_sw); i++) {
+			p_group = *sw_get_port_group_ptr(p_sw, i);
+			up = down = 0;
+			for (k = 0; k < parts_num; k++) {
+				p_group_copy =
+				    &parts[k].group_array[p_group->part_idx];
+				up += p_group_copy->counter_up -
+				    p_group->counter_up;
+				down += p_group_copy->counter_down -
+				    p_group->counter_down;
+			}
+			p_group->counter_up += up;
+			p_group->counter_down += down;
+
+			size = cl_ptr_vector_get_size(&p_group->ports);
+			for (j = 0; j < size; j++) {
+				cl_ptr_vector_at(&p_group->ports, j,
+						 (void *)&p_port);
+				up = down = 0;
+				for (k = 0; k < parts_num; k++) {
+					p_port_copy =
+					    &parts[k].port_array[p_port->part_idx];
+					up += p_port_copy->counter_up -
+					    p_port->counter_up;
+					down += p_port_copy->counter_down -
+					    p_port->counter_down;
+				}
+				p_port->counter_up += up;
+				p_port->counter_down += down;
+			}
+		}
+
+		if (p_sw->down_port_groups_num) {
+			idx = p_sw->down_port_groups_idx;
+			for (k = 0; k < parts_num; k++)
+				idx += parts[k].sw_array[p_sw->part_idx].
+				    down_port_groups_idx +
+				    p_sw->down_port_groups_num -
+				    p_sw->down_port_groups_idx;
+			p_sw->down_port_groups_idx =
+			    idx % p_sw->down_port_groups_num;
+		}
+
+		/* continue from the group order of the last partition, as
+		   sequential routing would; the counters changed, so the
+		   groups get sorted again */
+		p_sw_copy = &parts[parts_num - 1].sw_array[p_sw->part_idx];
+		sw_copy_group_order(p_sw->down_port_groups,
+				    p_sw_copy->down_port_groups,
+				    p_sw->down_port_groups_num);
+		sw_copy_group_order(p_sw->up_port_groups,
+				    p_sw_copy->up_port_groups,
+				    p_sw->up_port_groups_num);
+		sw_copy_group_order(p_sw->sibling_port_groups,
+				    p_sw_copy->sibling_port_groups,
+				    p_sw->sibling_port_groups_num);
+		p_sw->counter_up_changed = TRUE;
+	}
+
+	for (p_sw = (ftree_sw_t *) cl_qmap_head(&p_ftree->sw_tbl);
+	     p_sw != (ftree_sw_t *) cl_qmap_end(&p_ftree->sw_tbl);
+	     p_sw = (ftree_sw_t *) cl_qmap_next(&p_sw->map_item))
+		recalculate_min_counter_down(p_sw);
+}
+
+/***************************************************/
+
+/*
+ * Route to the compute nodes with the leaf switches split into
+ * parts_num partitions, each routed by its own thread.  The routes
+ * only depend on the number of partitions, not on the scheduling.
+ * Falls back to sequential routing if the partitions can't be set up.
+ */
+static void fabric_route_to_cns_parallel(IN ftree_fabric_t * p_ftree,
+					 IN uint32_t parts_num)
+{
+	ftree_part_t *parts;
+	uint32_t sw_num, groups_num, ports_num;
+	uint32_t i, started = 0;
+
+	OSM_LOG_ENTER(&p_ftree->p_osm->log);
+
+	parts = calloc(parts_num, sizeof(ftree_part_t));
+	if (!parts)
+		goto Fallback;
+
+	sw_num = fabric_number_sw_objects(p_ftree, &groups_num, &ports_num);
+	for (i = 0; i < parts_num; i++) {
+		cl_thread_construct(&parts[i].thread);
+		if (part_init(&parts[i], p_ftree, sw_num, groups_num,
+			      ports_num))
+			goto Fallback;
+		parts[i].first_leaf =
+		    (uint32_t) ((uint64_t) p_ftree->leaf_switches_num * i /
+				parts_num);
+		parts[i].leaves_num =
+		    (uint32_t) ((uint64_t) p_ftree->leaf_switches_num *
+				(i + 1) / parts_num) - parts[i].first_leaf;
+	}
+
+	/* the last partition is routed by this thread */
+	for (; started < parts_num - 1; started++)
+		if (cl_thread_init(&parts[started].thread, fabric_route_part,
+				   &parts[started], "opensm ftree") !=
+		    CL_SUCCESS)
+			break;
+	for (i = started; i < parts_num; i++)
+		fabric_route_part(&parts[i]);
+	for (i = 0; i < started; i++)
+		cl_thread_destroy(&parts[i].thread);
+
+	fabric_merge_parts(p_ftree, parts, parts_num);
+
+	for (i = 0; i < parts_num; i++)
+		OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_VERBOSE,
+			"Partition %u: routed %u leaf switches in %" PRIu64
+			" usec\n", i, parts[i].leaves_num, parts[i].usecs);
+	goto Exit;
+
+Fallback:
+	OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_ERROR, "ERR AB2A: "
+		"Failed to set up routing partitions, "
+		"routing compute nodes sequentially\n");
+	fabric_route_to_cns(p_ftree);
+Exit:
+	if (parts) {
+		for (i = 0; i < parts_num; i++)
+			part_destroy(&parts[i]);
+		free(parts);
+	}
 	OSM_LOG_EXIT(&p_ftree->p_osm->log);
-}				/* fabric_route_to_cns() */
+}				/* fabric_route_to_cns_parallel() */
 
 /***************************************************/
 
@@ -4067,6 +4458,8 @@ Exit:
 static int do_routing(IN void *context)
 {
 	ftree_fabric_t *p_ftree = context;
+	uint32_t threads = p_ftree->p_osm->subn.opt.ftree_threads;
+	uint64_t t_start, t_cns, t_non_cns, t_switches, t_roots;
 	int status = 0;
 
 	OSM_LOG_ENTER(&p_ftree->p_osm->log);
@@ -4079,22 +4472,40 @@ static int do_routing(IN void *context)
 	OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_VERBOSE,
 		"Starting FatTree routing\n");
 
+	if (threads > p_ftree->leaf_switches_num)
+		threads = p_ftree->leaf_switches_num;
+
+	t_start = cl_get_time_stamp();
 	OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_VERBOSE,
 		"Filling switch forwarding tables for Compute Nodes\n");
-	fabric_route_to_cns(p_ftree);
+	if (threads > 1)
+		fabric_route_to_cns_parallel(p_ftree, threads);
+	else
+		fabric_route_to_cns(p_ftree);
+	t_cns = cl_get_time_stamp();
 
 	OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_VERBOSE,
 		"Filling switch forwarding tables for non-CN targets\n");
 	fabric_route_to_non_cns(p_ftree);
+	t_non_cns = cl_get_time_stamp();
 
 	OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_VERBOSE,
 		"Filling switch forwarding tables for switch-to-switch paths\n");
 	fabric_route_to_switches(p_ftree);
+	t_switches = cl_get_time_stamp();
 
 	OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_VERBOSE,
 		"Connecting switches that are unreachable within "
 		"Up/Down rules\n");
 	fabric_route_roots(p_ftree);
+	t_roots = cl_get_time_stamp();
+
+	OSM_LOG(&p_ftree->p_osm->log, OSM_LOG_INFO,
+		"FatTree routing phases (usec): CNs %" PRIu64
+		" (%u thread(s)), non-CNs %" PRIu64 ", switches %" PRIu64
+		", roots %" PRIu64 "\n", t_cns - t_start,
+		threads > 1 ? threads : 1, t_non_cns - t_cns,
+		t_switches - t_non_cns, t_roots - t_switches);
 
 	/* for each switch, set its fwd table */
 	cl_qmap_apply_func(&p_ftree->sw_tbl, set_sw_fwd_table, (void *)p_ftree);
@@ -1276,11 +1276,11 @@ static void lash_delete(void *context)
 }
 
 static uint8_t get_lash_sl(void *context, uint8_t path_sl_hint,
-			   const osm_port_t *p_src_port,
-			   const osm_port_t *p_dst_port)
+			   const ib_net16_t slid, const ib_net16_t dlid)
 {
 	unsigned dst_id;
 	unsigned src_id;
+	osm_port_t *p_src_port, *p_dst_port;
 	osm_switch_t *p_sw;
 	lash_t *p_lash = context;
 	osm_opensm_t *p_osm = p_lash->p_osm;
@@ -1289,6 +1289,14 @@ static uint8_t get_lash_sl(void *context, uint8_t path_sl_hint,
 	      p_osm->routing_engine_used->type == OSM_ROUTING_ENGINE_TYPE_LASH))
 		return OSM_DEFAULT_SL;
 
+	p_src_port = osm_get_port_by_lid(&p_osm->subn, slid);
+	if (!p_src_port)
+		return OSM_DEFAULT_SL;
+
+	p_dst_port = osm_get_port_by_lid(&p_osm->subn, dlid);
+	if (!p_dst_port)
+		return OSM_DEFAULT_SL;
+
 	p_sw = get_osm_switch_from_port(p_dst_port);
 	if (!p_sw || !p_sw->priv)
 		return OSM_DEFAULT_SL;
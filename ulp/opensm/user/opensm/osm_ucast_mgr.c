@@ -51,6 +51,7 @@
 #include <complib/cl_qmap.h>
 #include <complib/cl_debug.h>
 #include <complib/cl_qlist.h>
+#include <complib/cl_timer.h>
 #include <opensm/osm_ucast_mgr.h>
 #include <opensm/osm_sm.h>
 #include <opensm/osm_log.h>
@@ -1099,6 +1100,7 @@ int osm_ucast_mgr_process(IN osm_ucast_mgr_t * p_mgr)
 		goto Exit;
 
 	failed = -1;
+	p_mgr->hop_tables_gen++;
 	p_osm->routing_engine_used = NULL;
 	while (p_routing_eng) {
 		failed = ucast_mgr_route(p_routing_eng, p_osm);
@@ -1140,6 +1142,251 @@ Exit:
 	return failed;
 }
 
+/**********************************************************************
+ Path parameters precomputation.  For every switch and LID the entry
+ holds what the SA would collect walking from the port the switch
+ routes the LID to up to the port of that LID.  Entries of a LID are
+ built by following the LFTs and reusing the entries already built,
+ so every (switch, LID) pair is walked only once.
+ **********************************************************************/
+struct path_aggr_item {
+	osm_switch_t *p_sw;
+	const osm_physp_t *p_in;
+};
+
+static void path_aggr_set_hop(IN osm_path_aggr_t * p_aggr,
+			      IN const osm_physp_t * p_in,
+			      IN const osm_path_aggr_t * p_next,
+			      IN ib_net16_t lid)
+{
+	const osm_physp_t *p_out, *p_physp0;
+	ib_slvl_table_t *p_slvl_tbl;
+	osm_node_t *p_node;
+	uint16_t sl_mask = 0xffff;
+	boolean_t ext_speeds;
+	uint8_t mtu, rate, i;
+
+	p_node = osm_physp_get_node_ptr(p_in);
+	p_out = osm_switch_get_route_by_lid(p_node->sw, lid);
+	if (p_next->state != OSM_PATH_AGGR_VALID || !p_out ||
+	    p_next->hops >= IB_SUBNET_PATH_HOPS_MAX) {
+		p_aggr->state = OSM_PATH_AGGR_BAD;
+		return;
+	}
+
+	/* same as the SA, the rate uses the switch port 0 capabilities */
+	p_physp0 = osm_node_get_physp_ptr(p_node, 0);
+	ext_speeds = (p_physp0->port_info.capability_mask &
+		      IB_PORT_CAP_HAS_EXT_SPEEDS) ? TRUE : FALSE;
+
+	mtu = ib_port_info_get_mtu_cap(&p_in->port_info);
+	if (mtu > ib_port_info_get_mtu_cap(&p_out->port_info))
+		mtu = ib_port_info_get_mtu_cap(&p_out->port_info);
+
+	rate = ib_port_info_compute_rate(&p_in->port_info, ext_speeds);
+	if (ib_path_compare_rates(rate,
+				  ib_port_info_compute_rate(&p_out->port_info,
+							    ext_speeds)) > 0)
+		rate = ib_port_info_compute_rate(&p_out->port_info,
+						 ext_speeds);
+
+	p_slvl_tbl = osm_physp_get_slvl_tbl(p_out,
+					    osm_physp_get_port_num(p_in));
+	for (i = 0; i < IB_MAX_NUM_VLS; i++)
+		if (ib_slvl_table_get(p_slvl_tbl, i) == IB_DROP_VL)
+			sl_mask &= ~(1 << i);
+
+	if (p_next->hops) {
+		if (mtu > p_next->mtu)
+			mtu = p_next->mtu;
+		if (ib_path_compare_rates(rate, p_next->rate) > 0)
+			rate = p_next->rate;
+		sl_mask &= p_next->sl_mask;
+	}
+
+	p_aggr->mtu = mtu;
+	p_aggr->rate = rate;
+	p_aggr->sl_mask = sl_mask;
+	p_aggr->hops = p_next->hops + 1;
+	p_aggr->state = OSM_PATH_AGGR_VALID;
+}
+
+static void path_aggr_set_direct(IN osm_path_aggr_t * p_aggr)
+{
+	p_aggr->sl_mask = 0xffff;
+	p_aggr->hops = 0;
+	p_aggr->state = OSM_PATH_AGGR_VALID;
+}
+
+static void path_aggr_build_lid(IN osm_ucast_mgr_t * p_mgr,
+				IN uint16_t lid_ho,
+				IN struct path_aggr_item *stack)
+{
+	cl_qmap_t *p_sw_tbl = &p_mgr->p_subn->sw_guid_tbl;
+	cl_map_item_t *item;
+	const osm_physp_t *p_dest_physp, *p_physp, *p_remote;
+	osm_path_aggr_t *p_aggr, *p_next;
+	osm_switch_t *p_sw;
+	osm_port_t *p_port;
+	ib_net16_t lid = cl_hton16(lid_ho);
+	unsigned depth;
+
+	p_port = osm_get_port_by_lid_ho(p_mgr->p_subn, lid_ho);
+	if (!p_port)
+		return;
+
+	/* the SA walk ends on port 0 when the destination is a switch */
+	p_dest_physp = p_port->p_physp;
+	if (p_port->p_node->sw) {
+		p_dest_physp =
+		    osm_switch_get_route_by_lid(p_port->p_node->sw, lid);
+		if (!p_dest_physp)
+			return;
+	}
+
+	for (item = cl_qmap_head(p_sw_tbl); item != cl_qmap_end(p_sw_tbl);
+	     item = cl_qmap_next(item)) {
+		p_sw = (osm_switch_t *) item;
+		depth = 0;
+
+		/* follow the LFTs up to a switch whose entry is known */
+		while (p_sw->path_aggr[lid_ho].state == OSM_PATH_AGGR_NONE) {
+			p_aggr = &p_sw->path_aggr[lid_ho];
+			p_aggr->state = OSM_PATH_AGGR_BUSY;
+
+			p_physp = osm_switch_get_route_by_lid(p_sw, lid);
+			if (!p_physp) {
+				p_aggr->state = OSM_PATH_AGGR_BAD;
+				break;
+			}
+			if (p_physp == p_dest_physp) {
+				path_aggr_set_direct(p_aggr);
+				break;
+			}
+			p_remote = osm_physp_get_remote(p_physp);
+			if (p_remote == p_dest_physp) {
+				path_aggr_set_direct(p_aggr);
+				break;
+			}
+			if (!p_remote || !p_remote->p_node->sw) {
+				p_aggr->state = OSM_PATH_AGGR_BAD;
+				break;
+			}
+
+			stack[depth].p_sw = p_sw;
+			stack[depth].p_in = p_remote;
+			depth++;
+			p_sw = p_remote->p_node->sw;
+		}
+
+		/* a busy entry here means the LFTs loop, so the
+		   whole chain is bad */
+		p_next = &p_sw->path_aggr[lid_ho];
+		while (depth--) {
+			p_aggr = &stack[depth].p_sw->path_aggr[lid_ho];
+			path_aggr_set_hop(p_aggr, stack[depth].p_in, p_next,
+					  lid);
+			p_next = p_aggr;
+		}
+	}
+}
+
+static void path_aggr_free(IN cl_map_item_t * p_map_item, IN void *context)
+{
+	osm_switch_t *p_sw = (osm_switch_t *) p_map_item;
+
+	if (p_sw->path_aggr) {
+		free(p_sw->path_aggr);
+		p_sw->path_aggr = NULL;
+		p_sw->path_aggr_size = 0;
+	}
+}
+
+void osm_ucast_mgr_clear_path_aggr(IN osm_ucast_mgr_t * p_mgr)
+{
+	CL_PLOCK_EXCL_ACQUIRE(p_mgr->p_lock);
+	cl_qmap_apply_func(&p_mgr->p_subn->sw_guid_tbl, path_aggr_free, NULL);
+	CL_PLOCK_RELEASE(p_mgr->p_lock);
+}
+
+void osm_ucast_mgr_build_path_aggr(IN osm_ucast_mgr_t * p_mgr)
+{
+	cl_qmap_t *p_sw_tbl = &p_mgr->p_subn->sw_guid_tbl;
+	cl_map_item_t *item;
+	struct path_aggr_item *stack;
+	osm_switch_t *p_sw;
+	uint64_t start, max_size;
+	size_t size;
+	uint16_t lid_ho;
+
+	OSM_LOG_ENTER(p_mgr->p_log);
+
+	CL_PLOCK_EXCL_ACQUIRE(p_mgr->p_lock);
+
+	cl_qmap_apply_func(p_sw_tbl, path_aggr_free, NULL);
+
+	size = cl_ptr_vector_get_size(&p_mgr->p_subn->port_lid_tbl);
+	if (!cl_qmap_count(p_sw_tbl) || size <= 1)
+		goto Exit;
+	if (size > IB_LID_UCAST_END_HO + 1)
+		size = IB_LID_UCAST_END_HO + 1;
+
+	/* keep within the memory limit, the SA walks paths to higher LIDs */
+	max_size = ((uint64_t) p_mgr->p_subn->opt.path_aggr_max_mb << 20) /
+	    (cl_qmap_count(p_sw_tbl) * sizeof(osm_path_aggr_t));
+	if (max_size <= 1) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+			"Path parameters are not precomputed\n");
+		goto Exit;
+	}
+	if (size > max_size) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+			"Path parameters of %u switches limited to LIDs "
+			"below %u by path_aggr_max_mb %u\n",
+			(unsigned) cl_qmap_count(p_sw_tbl), (unsigned) max_size,
+			p_mgr->p_subn->opt.path_aggr_max_mb);
+		size = (size_t) max_size;
+	}
+
+	start = cl_get_time_stamp();
+
+	stack = malloc(cl_qmap_count(p_sw_tbl) * sizeof(*stack));
+	if (!stack)
+		goto Error;
+
+	for (item = cl_qmap_head(p_sw_tbl); item != cl_qmap_end(p_sw_tbl);
+	     item = cl_qmap_next(item)) {
+		p_sw = (osm_switch_t *) item;
+		p_sw->path_aggr = calloc(size, sizeof(*p_sw->path_aggr));
+		if (!p_sw->path_aggr) {
+			free(stack);
+			goto Error;
+		}
+		p_sw->path_aggr_size = (uint16_t) size;
+	}
+
+	for (lid_ho = 1; lid_ho < size; lid_ho++)
+		path_aggr_build_lid(p_mgr, lid_ho, stack);
+
+	free(stack);
+
+	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+		"Path parameters of %u switches to %u LIDs "
+		"precomputed in %" PRIu64 " usec\n",
+		(unsigned) cl_qmap_count(p_sw_tbl), (unsigned)(size - 1),
+		cl_get_time_stamp() - start);
+	goto Exit;
+
+Error:
+	OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR, "ERR 3A0F: "
+		"Cannot allocate path parameters tables, "
+		"SA will walk the paths\n");
+	cl_qmap_apply_func(p_sw_tbl, path_aggr_free, NULL);
+Exit:
+	CL_PLOCK_RELEASE(p_mgr->p_lock);
+	OSM_LOG_EXIT(p_mgr->p_log);
+}
+
 static int ucast_build_lid_matrices(void *context)
 {
 	return osm_ucast_mgr_build_lid_matrices(context);
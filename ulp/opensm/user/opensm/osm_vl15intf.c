@@ -45,6 +45,7 @@
 #  include <config.h>
 #endif				/* HAVE_CONFIG_H */
 
+#include <stdlib.h>
 #include <string.h>
 #include <iba/ib_types.h>
 #include <complib/cl_thread.h>
@@ -108,12 +109,196 @@ static void vl15_send_mad(osm_vl15_t * p_vl, osm_madw_t * p_madw)
 		cl_atomic_dec(&p_vl->p_stats->qp0_unicasts_sent);
 }
 
+static inline uint8_t vl15_path_len(const ib_smp_t * p_smp)
+{
+	return p_smp->hop_count < IB_SUBNET_PATH_HOPS_MAX ?
+	    p_smp->hop_count : IB_SUBNET_PATH_HOPS_MAX - 1;
+}
+
+/*
+   Looks up the queue of the MAD's destination, and creates it if
+   requested.  Must be called with the lock held.
+ */
+static osm_vl15_dest_t *vl15_get_dest(osm_vl15_t * p_vl,
+				      const osm_madw_t * p_madw,
+				      boolean_t create)
+{
+	const ib_smp_t *p_smp = osm_madw_get_smp_ptr(p_madw);
+	ib_net16_t dlid = p_madw->mad_addr.dest_lid;
+	osm_vl15_dest_t *p_dest;
+	uint32_t hash;
+	uint8_t i, len = 0;
+
+	/*
+	   SMPs sent by the SM are directed route, so the hop count and
+	   initial path identify the destination; LID routed ones are
+	   keyed by their LID.
+	 */
+	if (dlid != IB_LID_PERMISSIVE)
+		hash = cl_ntoh16(dlid);
+	else {
+		len = vl15_path_len(p_smp);
+		hash = 2166136261U ^ p_smp->hop_count;
+		for (i = 1; i <= len; i++)
+			hash = (hash ^ p_smp->initial_path[i]) * 16777619U;
+		hash ^= hash >> 16;
+	}
+
+	for (p_dest = p_vl->dests[hash & (OSM_VL15_DEST_HASH_SIZE - 1)];
+	     p_dest; p_dest = p_dest->p_next)
+		if (p_dest->hash == hash && p_dest->dlid == dlid &&
+		    (dlid != IB_LID_PERMISSIVE ||
+		     (p_dest->hop_count == p_smp->hop_count &&
+		      !memcmp(&p_dest->path[1], &p_smp->initial_path[1],
+			      len))))
+			return p_dest;
+
+	if (!create)
+		return NULL;
+
+	if (p_vl->free_dests) {
+		p_dest = p_vl->free_dests;
+		p_vl->free_dests = p_dest->p_next;
+	} else {
+		p_dest = malloc(sizeof(*p_dest));
+		if (!p_dest)
+			return NULL;
+		cl_qlist_init(&p_dest->fifo);
+	}
+
+	p_dest->on_wire = 0;
+	p_dest->ready = FALSE;
+	p_dest->hash = hash;
+	p_dest->dlid = dlid;
+	p_dest->hop_count = dlid == IB_LID_PERMISSIVE ? p_smp->hop_count : 0;
+	memcpy(&p_dest->path[1], &p_smp->initial_path[1], len);
+	p_dest->p_next = p_vl->dests[hash & (OSM_VL15_DEST_HASH_SIZE - 1)];
+	p_vl->dests[hash & (OSM_VL15_DEST_HASH_SIZE - 1)] = p_dest;
+	return p_dest;
+}
+
+/*
+   Moves the queue to the free list once it has nothing queued or
+   on the wire.  Must be called with the lock held.
+ */
+static void vl15_put_dest(osm_vl15_t * p_vl, osm_vl15_dest_t * p_dest)
+{
+	osm_vl15_dest_t **pp_dest;
+
+	if (p_dest->on_wire || p_dest->ready ||
+	    !cl_is_qlist_empty(&p_dest->fifo))
+		return;
+
+	pp_dest = &p_vl->dests[p_dest->hash & (OSM_VL15_DEST_HASH_SIZE - 1)];
+	while (*pp_dest != p_dest)
+		pp_dest = &(*pp_dest)->p_next;
+	*pp_dest = p_dest->p_next;
+
+	p_dest->p_next = p_vl->free_dests;
+	p_vl->free_dests = p_dest;
+}
+
+/*
+   Returns the queued request MADs to the pool and frees the queues
+   left idle.  Must be called with the lock held.
+ */
+static void vl15_flush_dests(osm_vl15_t * p_vl, osm_mad_pool_t * p_pool)
+{
+	osm_vl15_dest_t *p_dest, *p_next;
+	osm_madw_t *p_madw;
+	unsigned i;
+
+	for (i = 0; i < OSM_VL15_DEST_HASH_SIZE; i++)
+		for (p_dest = p_vl->dests[i]; p_dest; p_dest = p_next) {
+			p_next = p_dest->p_next;
+			while (!cl_is_qlist_empty(&p_dest->fifo)) {
+				p_madw = (osm_madw_t *)
+				    cl_qlist_remove_head(&p_dest->fifo);
+				OSM_LOG(p_vl->p_log, OSM_LOG_DEBUG,
+					"Releasing Request p_madw = %p\n",
+					p_madw);
+				osm_mad_pool_put(p_pool, p_madw);
+				osm_stats_dec_qp0_outstanding(p_vl->p_stats);
+			}
+			p_dest->ready = FALSE;
+			vl15_put_dest(p_vl, p_dest);
+		}
+	cl_qlist_init(&p_vl->ready);
+}
+
+static inline boolean_t vl15_dest_is_ready(osm_vl15_t * p_vl,
+					   osm_vl15_dest_t * p_dest)
+{
+	return !cl_is_qlist_empty(&p_dest->fifo) &&
+	    (!p_vl->max_smps_per_node ||
+	     p_dest->on_wire < p_vl->max_smps_per_node);
+}
+
+/*
+   Must be called with the lock held.
+ */
+static void vl15_dest_check_ready(osm_vl15_t * p_vl, osm_vl15_dest_t * p_dest)
+{
+	if (!p_dest->ready && vl15_dest_is_ready(p_vl, p_dest)) {
+		cl_qlist_insert_tail(&p_vl->ready, &p_dest->list_item);
+		p_dest->ready = TRUE;
+	}
+}
+
+/*
+   Takes up to OSM_VL15_BATCH_SIZE MADs off the queues.
+   Response-less MADs go first, then request MADs while the window
+   allows, one from each ready destination in turn.
+   Must be called with the lock held.
+ */
+static unsigned vl15_dequeue(osm_vl15_t * p_vl, osm_madw_t ** batch,
+			     int32_t max_smps)
+{
+	osm_vl15_sweep_stats_t *p_ss = &p_vl->sweep_stats;
+	osm_vl15_dest_t *p_dest;
+	int32_t on_wire = p_vl->p_stats->qp0_mads_outstanding_on_wire;
+	unsigned count = 0;
+
+	while (count < OSM_VL15_BATCH_SIZE &&
+	       !cl_is_qlist_empty(&p_vl->ufifo))
+		batch[count++] = (osm_madw_t *)
+		    cl_qlist_remove_head(&p_vl->ufifo);
+
+	while (count < OSM_VL15_BATCH_SIZE && on_wire < max_smps &&
+	       !cl_is_qlist_empty(&p_vl->ready)) {
+		p_dest = (osm_vl15_dest_t *) cl_qlist_remove_head(&p_vl->ready);
+		batch[count++] = (osm_madw_t *)
+		    cl_qlist_remove_head(&p_dest->fifo);
+		p_dest->on_wire++;
+
+		if (vl15_dest_is_ready(p_vl, p_dest))
+			cl_qlist_insert_tail(&p_vl->ready,
+					     &p_dest->list_item);
+		else {
+			p_dest->ready = FALSE;
+			if (!cl_is_qlist_empty(&p_dest->fifo))
+				p_ss->dest_limited++;
+		}
+
+		on_wire++;
+		p_ss->smps_sent++;
+		p_ss->wire_sum += on_wire;
+		if ((uint32_t) on_wire > p_ss->wire_max)
+			p_ss->wire_max = on_wire;
+	}
+
+	if (count)
+		p_ss->batches++;
+
+	return count;
+}
+
 static void vl15_poller(IN void *p_ptr)
 {
 	ib_api_status_t status;
-	osm_madw_t *p_madw;
+	osm_madw_t *batch[OSM_VL15_BATCH_SIZE];
 	osm_vl15_t *p_vl = p_ptr;
-	cl_qlist_t *p_fifo;
+	unsigned count, i;
 	int32_t max_smps = p_vl->max_wire_smps;
 	int32_t max_smps2 = p_vl->max_wire_smps2;
 
@@ -124,42 +309,46 @@ static void vl15_poller(IN void *p_ptr)
 
 	while (p_vl->thread_state == OSM_THREAD_STATE_RUN) {
 		/*
-		   Start servicing the FIFOs by pulling off MAD wrappers
-		   and passing them to the transport interface.
+		   Start servicing the FIFOs by pulling off a batch of MAD
+		   wrappers and passing them to the transport interface.
 		   There are lots of corner cases here so tread carefully.
 
 		   The unicast FIFO has priority, since somebody is waiting
-		   for a timely response.
+		   for a timely response.  Request MADs are taken round
+		   robin from the destination queues, so that a slow or
+		   dead node holding its slots cannot stall the others.
 		 */
 		cl_spinlock_acquire(&p_vl->lock);
-
-		if (cl_qlist_count(&p_vl->ufifo) != 0)
-			p_fifo = &p_vl->ufifo;
-		else
-			p_fifo = &p_vl->rfifo;
-
-		p_madw = (osm_madw_t *) cl_qlist_remove_head(p_fifo);
-
+		count = vl15_dequeue(p_vl, batch, max_smps);
 		cl_spinlock_release(&p_vl->lock);
 
-		if (p_madw != (osm_madw_t *) cl_qlist_end(p_fifo)) {
-			OSM_LOG(p_vl->p_log, OSM_LOG_DEBUG,
-				"Servicing p_madw = %p\n", p_madw);
-			if (osm_log_is_active(p_vl->p_log, OSM_LOG_FRAMES))
-				osm_dump_dr_smp(p_vl->p_log,
-						osm_madw_get_smp_ptr(p_madw),
-						OSM_LOG_FRAMES);
-
-			vl15_send_mad(p_vl, p_madw);
-		} else
+		if (count)
+			for (i = 0; i < count; i++) {
+				OSM_LOG(p_vl->p_log, OSM_LOG_DEBUG,
+					"Servicing p_madw = %p\n", batch[i]);
+				if (osm_log_is_active(p_vl->p_log,
+						      OSM_LOG_FRAMES))
+					osm_dump_dr_smp(p_vl->p_log,
+							osm_madw_get_smp_ptr
+							(batch[i]),
+							OSM_LOG_FRAMES);
+
+				vl15_send_mad(p_vl, batch[i]);
+			}
+		else
 			/*
-			   The VL15 FIFO is empty, so we have nothing left to do.
+			   The VL15 FIFOs are empty, or every destination
+			   with MADs queued is at its limit, so we have
+			   nothing left to do until a response arrives.
 			 */
 			status = cl_event_wait_on(&p_vl->signal,
 						  EVENT_NO_TIMEOUT, TRUE);
 
 		while (p_vl->p_stats->qp0_mads_outstanding_on_wire >= max_smps &&
 		       p_vl->thread_state == OSM_THREAD_STATE_RUN) {
+			cl_spinlock_acquire(&p_vl->lock);
+			p_vl->sweep_stats.window_waits++;
+			cl_spinlock_release(&p_vl->lock);
 			status = cl_event_wait_on(&p_vl->signal,
 						  p_vl->max_smps_timeout,
 						  TRUE);
@@ -193,14 +382,16 @@ void osm_vl15_construct(IN osm_vl15_t * p_vl)
 	p_vl->thread_state = OSM_THREAD_STATE_NONE;
 	cl_event_construct(&p_vl->signal);
 	cl_spinlock_construct(&p_vl->lock);
-	cl_qlist_init(&p_vl->rfifo);
+	cl_qlist_init(&p_vl->ready);
 	cl_qlist_init(&p_vl->ufifo);
 	cl_thread_construct(&p_vl->poller);
 }
 
 void osm_vl15_destroy(IN osm_vl15_t * p_vl, IN struct osm_mad_pool *p_pool)
 {
+	osm_vl15_dest_t *p_dest;
 	osm_madw_t *p_madw;
+	unsigned i;
 
 	OSM_LOG_ENTER(p_vl->p_log);
 
@@ -224,15 +415,23 @@ void osm_vl15_destroy(IN osm_vl15_t * p_vl, IN struct osm_mad_pool *p_pool)
 
 	cl_spinlock_acquire(&p_vl->lock);
 
-	while (!cl_is_qlist_empty(&p_vl->rfifo)) {
-		p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_vl->rfifo);
-		osm_mad_pool_put(p_pool, p_madw);
-	}
+	vl15_flush_dests(p_vl, p_pool);
 	while (!cl_is_qlist_empty(&p_vl->ufifo)) {
 		p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_vl->ufifo);
 		osm_mad_pool_put(p_pool, p_madw);
 	}
 
+	/* queues still waiting for responses go too */
+	for (i = 0; i < OSM_VL15_DEST_HASH_SIZE; i++)
+		while ((p_dest = p_vl->dests[i])) {
+			p_vl->dests[i] = p_dest->p_next;
+			free(p_dest);
+		}
+	while ((p_dest = p_vl->free_dests)) {
+		p_vl->free_dests = p_dest->p_next;
+		free(p_dest);
+	}
+
 	cl_spinlock_release(&p_vl->lock);
 
 	cl_event_destroy(&p_vl->signal);
@@ -246,7 +445,8 @@ ib_api_status_t osm_vl15_init(IN osm_vl15_t * p_vl, IN osm_vendor_t * p_vend,
 			      IN osm_log_t * p_log, IN osm_stats_t * p_stats,
 			      IN int32_t max_wire_smps,
 			      IN int32_t max_wire_smps2,
-			      IN uint32_t max_smps_timeout)
+			      IN uint32_t max_smps_timeout,
+			      IN uint32_t max_smps_per_node)
 {
 	ib_api_status_t status = IB_SUCCESS;
 
@@ -259,6 +459,7 @@ ib_api_status_t osm_vl15_init(IN osm_vl15_t * p_vl, IN osm_vendor_t * p_vend,
 	p_vl->max_wire_smps2 = max_wire_smps2;
 	p_vl->max_smps_timeout = max_wire_smps < max_wire_smps2 ?
 				 max_smps_timeout : EVENT_NO_TIMEOUT;
+	p_vl->max_smps_per_node = max_smps_per_node;
 
 	status = cl_event_init(&p_vl->signal, FALSE);
 	if (status != IB_SUCCESS)
@@ -308,6 +509,8 @@ void osm_vl15_poll(IN osm_vl15_t * p_vl)
 
 void osm_vl15_post(IN osm_vl15_t * p_vl, IN osm_madw_t * p_madw)
 {
+	osm_vl15_dest_t *p_dest;
+
 	OSM_LOG_ENTER(p_vl->p_log);
 
 	CL_ASSERT(p_vl->state == OSM_VL15_STATE_READY);
@@ -319,7 +522,17 @@ void osm_vl15_post(IN osm_vl15_t * p_vl, IN osm_madw_t * p_madw)
 	 */
 	cl_spinlock_acquire(&p_vl->lock);
 	if (p_madw->resp_expected == TRUE) {
-		cl_qlist_insert_tail(&p_vl->rfifo, &p_madw->list_item);
+		p_dest = vl15_get_dest(p_vl, p_madw, TRUE);
+		if (p_dest) {
+			cl_qlist_insert_tail(&p_dest->fifo,
+					     &p_madw->list_item);
+			vl15_dest_check_ready(p_vl, p_dest);
+		} else {
+			/* send it without the per destination limit */
+			OSM_LOG(p_vl->p_log, OSM_LOG_ERROR, "ERR 3E04: "
+				"cannot allocate destination queue\n");
+			cl_qlist_insert_tail(&p_vl->ufifo, &p_madw->list_item);
+		}
 		osm_stats_inc_qp0_outstanding(p_vl->p_stats);
 	} else
 		cl_qlist_insert_tail(&p_vl->ufifo, &p_madw->list_item);
@@ -335,6 +548,45 @@ void osm_vl15_post(IN osm_vl15_t * p_vl, IN osm_madw_t * p_madw)
 	OSM_LOG_EXIT(p_vl->p_log);
 }
 
+void osm_vl15_retire(IN osm_vl15_t * p_vl, IN const osm_madw_t * p_madw)
+{
+	osm_vl15_dest_t *p_dest;
+
+	if (!p_madw->resp_expected)
+		return;
+
+	cl_spinlock_acquire(&p_vl->lock);
+	p_dest = vl15_get_dest(p_vl, p_madw, FALSE);
+	if (p_dest) {
+		if (p_dest->on_wire)
+			p_dest->on_wire--;
+		vl15_dest_check_ready(p_vl, p_dest);
+		vl15_put_dest(p_vl, p_dest);
+	}
+	cl_spinlock_release(&p_vl->lock);
+}
+
+void osm_vl15_report(IN osm_vl15_t * p_vl)
+{
+	osm_vl15_sweep_stats_t ss;
+
+	cl_spinlock_acquire(&p_vl->lock);
+	ss = p_vl->sweep_stats;
+	memset(&p_vl->sweep_stats, 0, sizeof(p_vl->sweep_stats));
+	cl_spinlock_release(&p_vl->lock);
+
+	if (!ss.smps_sent)
+		return;
+
+	OSM_LOG(p_vl->p_log, OSM_LOG_VERBOSE,
+		"%u SMPs sent in %u batches, window occupancy "
+		"%" PRIu64 ".%02" PRIu64 " average, %u peak of %u, "
+		"%u full window waits, %u per node limit deferrals\n",
+		ss.smps_sent, ss.batches, ss.wire_sum / ss.smps_sent,
+		ss.wire_sum * 100 / ss.smps_sent % 100, ss.wire_max,
+		p_vl->max_wire_smps, ss.window_waits, ss.dest_limited);
+}
+
 void osm_vl15_shutdown(IN osm_vl15_t * p_vl, IN osm_mad_pool_t * p_mad_pool)
 {
 	osm_madw_t *p_madw;
@@ -361,16 +613,7 @@ void osm_vl15_shutdown(IN osm_vl15_t * p_vl, IN osm_mad_pool_t * p_mad_pool)
 	}
 
 	/* Request MADs we send out */
-	p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_vl->rfifo);
-	while (p_madw != (osm_madw_t *) cl_qlist_end(&p_vl->rfifo)) {
-		OSM_LOG(p_vl->p_log, OSM_LOG_DEBUG,
-			"Releasing Request p_madw = %p\n", p_madw);
-
-		osm_mad_pool_put(p_mad_pool, p_madw);
-		osm_stats_dec_qp0_outstanding(p_vl->p_stats);
-
-		p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_vl->rfifo);
-	}
+	vl15_flush_dests(p_vl, p_mad_pool);
 
 	/* free the lock */
 	cl_spinlock_release(&p_vl->lock);
@@ -510,7 +510,7 @@ osmtest_init(IN osmtest_t * const p_osmt,
 	}
 
 	osm_mad_pool_construct(&p_osmt->mad_pool);
-	status = osm_mad_pool_init(&p_osmt->mad_pool);
+	status = osm_mad_pool_init(&p_osmt->mad_pool, NULL);
 	if (status != IB_SUCCESS)
 		goto Exit;
 